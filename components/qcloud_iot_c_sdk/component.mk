@@ -11,14 +11,25 @@ COMPONENT_OBJS = sdk_src/data_template_action.o \
 				sdk_src/data_template_client_manager.o 	\
 				sdk_src/data_template_client.o 			\
 				sdk_src/data_template_event.o 				\
+				sdk_src/data_template_lan_control.o 	\
+				sdk_src/data_template_snapshot.o 	\
 				sdk_src/device_bind.o   					\
 				sdk_src/dynreg.o \
 				sdk_src/gateway_api.o  \
+				sdk_src/gateway_automation.o \
+				sdk_src/gateway_broker.o \
 				sdk_src/gateway_common.o \
+				sdk_src/gateway_ota.o \
+				sdk_src/gateway_template.o \
+				sdk_src/json_index.o                                        \
 				sdk_src/json_parser.o                                        \
 				sdk_src/json_token.o                                        \
 				sdk_src/kgmusic_client.o                                        \
+				sdk_src/log_async_print.o                                        \
+				sdk_src/log_binary.o                                        \
 				sdk_src/log_mqtt.o                                        \
+				sdk_src/log_ring.o                                        \
+				sdk_src/log_store.o                                        \
 				sdk_src/log_upload.o                                        \
 				sdk_src/mqtt_client.o                                        \
 				sdk_src/mqtt_client_common.o                                        \
@@ -40,13 +51,21 @@ COMPONENT_OBJS = sdk_src/data_template_action.o \
 				sdk_src/qcloud_iot_log.o                                        \
 				sdk_src/service_mqtt.o                                        \
 				sdk_src/string_utils.o                                        \
+				sdk_src/system_mqtt.o                                        \
 				sdk_src/utils_aes.o                                        \
 				sdk_src/utils_base64.o                                        \
+				sdk_src/utils_completion.o                                        \
+				sdk_src/utils_download_cache.o                                        \
+				sdk_src/utils_flash_writer.o                                        \
 				sdk_src/utils_getopt.o                                        \
+				sdk_src/utils_hash_index.o                                        \
 				sdk_src/utils_hmac.o                                        \
 				sdk_src/utils_httpc.o                                        \
+				sdk_src/utils_json_writer.o                                        \
 				sdk_src/utils_list.o                                        \
+				sdk_src/utils_lzss.o                                        \
 				sdk_src/utils_md5.o                                        \
+				sdk_src/utils_request_table.o                                        \
 				sdk_src/utils_ringbuff.o                                        \
 				sdk_src/utils_sha1.o                                        \
 				sdk_src/utils_timer.o                                        \
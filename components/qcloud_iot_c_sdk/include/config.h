@@ -3,13 +3,21 @@
 #define AUTH_WITH_NOTLS
 #define GATEWAY_ENABLED
 #define GATEWAY_AUTOMATION_ENABLED
+/* #undef GATEWAY_LOCAL_BROKER_ENABLED */
 /* #undef COAP_COMM_ENABLED */
 #define OTA_MQTT_CHANNEL
 /* #undef SYSTEM_COMM */
 #define EVENT_POST_ENABLED
 #define ACTION_ENABLED
+/* #undef LAN_CONTROL_ENABLED */
+/* #undef STATE_SNAPSHOT_ENABLED */
 #define DEV_DYN_REG_ENABLED
 #define LOG_UPLOAD
+/* #undef LOG_UPLOAD_BINARY */
+/* #undef LOG_UPLOAD_COMPRESS */
+/* #undef LOG_UPLOAD_MQTT */
+/* #undef LOG_ASYNC_PRINT_ENABLED */
+/* #undef LOG_RATE_LIMIT_ENABLED */
 /* #undef IOT_DEBUG */
 /* #undef DEBUG_DEV_INFO_USED */
 /* #undef AT_TCP_ENABLED */
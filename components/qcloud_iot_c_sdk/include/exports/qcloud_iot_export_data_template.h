@@ -366,6 +366,22 @@ int IOT_Template_Report(void *handle, char *pJsonDoc, size_t sizeOfBuffer, OnRep
  */
 int IOT_Template_Report_Sync(void *handle, char *pJsonDoc, size_t sizeOfBuffer, uint32_t timeout_ms);
 
+/**
+ * @brief report properties array in asynchronized way, the report JSON is
+ * written directly into the MQTT send buffer without a user buffer
+ *
+ * @param pClient           handle to data_template client
+ * @param count             number of properties
+ * @param pDeviceProperties array of properties
+ * @param callback          callback when response arrive
+ * @param userContext       user data for callback
+ * @param timeout_ms        timeout value for this operation (unit: ms)
+ * @return                  QCLOUD_RET_SUCCESS when success, or err code for
+ * failure
+ */
+int IOT_Template_Report_Array(void *handle, uint8_t count, DeviceProperty *pDeviceProperties[],
+                              OnReplyCallback callback, void *userContext, uint32_t timeout_ms);
+
 /**
  * @brief Get data_template state from server in asynchronized way.
  * Generally it's a way to sync data_template data during offline
@@ -611,6 +627,134 @@ int IOT_Action_Reply(void *pClient, const char *pClientToken, char *pJsonDoc, si
                      DeviceAction *pAction, sReplyPara *replyPara);
 #endif
 
+#ifdef LAN_CONTROL_ENABLED
+/* Parameters of the LAN control service */
+typedef struct {
+    uint16_t    port;             // UDP port to listen on
+    uint32_t    sync_timeout_ms;  // timeout of the report syncing LAN controls to the cloud
+    uint16_t    priority;         // priority of the service task
+    uint32_t    stack_size;       // stack size of the service task
+    const char *nonce_file;       // keeps the nonces used across reboots, path.tmp is used while it is rewritten
+} TemplateLanControlParams;
+
+#define DEFAULT_TEMPLATE_LAN_CONTROL_PARAMS {LAN_CONTROL_PORT, 5000, 1, 4096, NULL}
+
+/* Statistics of the LAN control service */
+typedef struct {
+    uint32_t control_cnt;    // controls applied
+    uint32_t status_cnt;     // get_status answered
+    uint32_t reject_cnt;     // datagrams dropped for bad signature, bad JSON or replay
+    uint32_t sync_cnt;       // properties synced to the cloud
+    uint32_t sync_fail_cnt;  // reports of the sync failed or timed out, retried later
+} TemplateLanControlStats;
+
+/**
+ * @brief Start the LAN control service, phones on the same network control the
+ * device over UDP without a cloud round trip
+ *
+ * Each datagram is 40 lowercase hex chars of HMAC-SHA1(lan_key, json) followed by
+ * the JSON message, lan_key being the 40 hex chars of
+ * HMAC-SHA1(device_secret, "${product_id}${device_name}lan_control"). A request
+ * carries the "nonce" of the device, "clientId" and "seq", seq increasing per
+ * clientId under a nonce, replays are dropped:
+ *   {"method":"control","clientToken":"t1","clientId":"phone","nonce":3,"seq":8,"params":{"power_switch":1}}
+ *   {"method":"get_status","clientToken":"t2","clientId":"phone","nonce":3,"seq":9}
+ * and is answered by a signed control_reply or get_status_reply with
+ * "data":{"reported":{...}} to its sender. A request without the current nonce
+ * is answered by a reply with code -1, status "stale nonce" and the "nonce" to
+ * send it again with. The nonce changes on every start, and when more than
+ * LAN_CONTROL_MAX_CLIENTS clients are in use. It is unique across reboots only
+ * with nonce_file, otherwise it is derived from the time.
+ *
+ * Controls are applied the same way as the ones from the cloud, then the current
+ * values of the registered properties they name are reported to the cloud in the
+ * background, retried while the report fails or the client is offline. Properties stay
+ * registered while the service runs.
+ *
+ * @param pClient   handle to data_template client, AUTH_MODE_KEY only
+ * @param pParams   service parameters, NULL for DEFAULT_TEMPLATE_LAN_CONTROL_PARAMS
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Template_LanControl_Start(void *pClient, TemplateLanControlParams *pParams);
+
+/**
+ * @brief Stop the LAN control service, call it from the thread of IOT_Template_Yield.
+ * IOT_Template_Destroy stops it too
+ *
+ * @param pClient   handle to data_template client
+ */
+void IOT_Template_LanControl_Stop(void *pClient);
+
+/**
+ * @brief Get statistics of the LAN control service
+ *
+ * @param pClient   handle to data_template client
+ * @param pStats    statistics since IOT_Template_LanControl_Start
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Template_LanControl_GetStats(void *pClient, TemplateLanControlStats *pStats);
+#endif
+
+#ifdef STATE_SNAPSHOT_ENABLED
+/* Statistics of the state snapshot journal */
+typedef struct {
+    uint32_t record_cnt;      // property values appended to the journal
+    uint32_t compact_cnt;     // rewrites of the journal into a snapshot
+    uint32_t write_fail_cnt;  // failed writes, the journal is rewritten on the next save
+    uint32_t delta_cnt;       // properties of get_status controls that differed from the current state
+    uint32_t skip_cnt;        // properties of get_status controls equal to the current state, not handed to callbacks
+} TemplateSnapshotStats;
+
+/**
+ * @brief Restore property values from the state snapshot journal, call it at
+ * boot before IOT_Template_Construct so that the device takes its last state
+ * without waiting for the network
+ *
+ * The journal written by IOT_Template_Snapshot_Start holds the values of the
+ * registered properties after each applied control and each accepted report.
+ * Properties are matched by key and type, the values of the others are kept.
+ *
+ * @param path               journal file
+ * @param count              number of properties
+ * @param pDeviceProperties  properties to restore, e.g. the ones registered later
+ * @return number of properties restored, 0 if there is no journal, or err code for failure
+ */
+int IOT_Template_Snapshot_Restore(const char *path, uint8_t count, DeviceProperty *pDeviceProperties[]);
+
+/**
+ * @brief Start journaling the registered properties to the state snapshot
+ * journal, call it after the properties are registered and restored
+ *
+ * The journal is rewritten as a snapshot of the current values at start, and
+ * then each applied control and each accepted report appends the properties
+ * whose values changed. While it runs, controls of get_status replies are
+ * reconciled with the current state: only the properties they change are handed
+ * to the property callbacks. Controls handed to usr_control_handle are not
+ * reconciled.
+ *
+ * @param pClient   handle to data_template client
+ * @param path      journal file, path.tmp is used while the journal is rewritten
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Template_Snapshot_Start(void *pClient, const char *path);
+
+/**
+ * @brief Stop journaling, IOT_Template_Destroy stops it too
+ *
+ * @param pClient   handle to data_template client
+ */
+void IOT_Template_Snapshot_Stop(void *pClient);
+
+/**
+ * @brief Get statistics of the state snapshot journal
+ *
+ * @param pClient   handle to data_template client
+ * @param pStats    statistics since IOT_Template_Snapshot_Start
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Template_Snapshot_GetStats(void *pClient, TemplateSnapshotStats *pStats);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
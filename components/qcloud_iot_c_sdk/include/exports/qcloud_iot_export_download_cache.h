@@ -0,0 +1,73 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_EXPORT_DOWNLOAD_CACHE_H_
+#define QCLOUD_IOT_EXPORT_DOWNLOAD_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t hit_cnt;        // downloads served wholly from the cache
+    uint32_t resume_cnt;     // downloads served partly from the cache
+    uint32_t miss_cnt;       // downloads fetched wholly from the network
+    uint32_t evict_cnt;      // entries evicted for the budget
+    uint32_t bytes_cached;   // bytes served from the cache
+    uint32_t bytes_fetched;  // bytes fetched from the network
+    uint32_t entry_num;      // entries in the cache, complete or partial
+    uint32_t bytes_used;     // bytes reserved by the entries
+} DownloadCacheStats;
+
+/**
+ * @brief Enable the download cache of resource and file manage downloads
+ *
+ * Downloaded files are kept in dir keyed by their MD5 and size, a download of a
+ * cached file completes without the network and a partly cached one resumes
+ * from where the cache ends. Entries are verified against their MD5 before
+ * they are committed. The least recently used entries are evicted to keep the
+ * cache within budget. The index is kept in dir through HAL_File*, so the
+ * cache survives reboots.
+ *
+ * Call it before any download starts, the cache is disabled by default.
+ *
+ * @param dir       existing directory for the cache files
+ * @param budget    max bytes of the cache files
+ * @return          QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_DownloadCache_Init(const char *dir, uint32_t budget);
+
+/**
+ * @brief Disable the download cache, the files are kept for the next init
+ *
+ * Call it when no download is running.
+ */
+void IOT_DownloadCache_Deinit(void);
+
+/**
+ * @brief Get the hit and miss statistics of the download cache
+ *
+ * @param stats     statistics since IOT_DownloadCache_Init
+ * @return          QCLOUD_RET_SUCCESS for success, or err code if the cache is disabled
+ */
+int IOT_DownloadCache_GetStats(DownloadCacheStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QCLOUD_IOT_EXPORT_DOWNLOAD_CACHE_H_ */
@@ -107,6 +107,9 @@ typedef enum {
     QCLOUD_ERR_GATEWAY_SESSION_TIMEOUT     = -223,  // Gateway sub-device session timeout
     QCLOUD_ERR_GATEWAY_SUBDEV_ONLINE       = -224,  // Gateway sub-device online
     QCLOUD_ERR_GATEWAY_SUBDEV_OFFLINE      = -225,  // Gateway sub-device offline
+    QCLOUD_ERR_GATEWAY_SUBDEV_OP_PENDING   = -226,  // Gateway sub-device has the same operation pending
+    QCLOUD_ERR_GATEWAY_TEMPLATE_NO_EXIST   = -227,  // Gateway template product, device or property not exist
+    QCLOUD_ERR_GATEWAY_OTA_NO_EXIST        = -228,  // Gateway OTA update of sub-device not exist
 
     QCLOUD_ERR_TCP_SOCKET_FAILED   = -601,  // TLS TCP socket connect fail
     QCLOUD_ERR_TCP_UNKNOWN_HOST    = -602,  // TCP unknown host (DNS fail)
@@ -93,6 +93,46 @@ typedef struct {
         DEFAULT_MQTTINIT_PARAMS, NULL, NULL \
     }
 
+/* Operation on sub-device */
+typedef enum {
+    eGATEWAY_SUBDEV_ONLINE = 0,
+    eGATEWAY_SUBDEV_OFFLINE,
+    eGATEWAY_SUBDEV_BIND,
+    eGATEWAY_SUBDEV_UNBIND,
+} GatewaySubdevOp;
+
+/* Result of operation on one sub-device */
+typedef struct {
+    GatewaySubdevOp op;
+    int             index;  // index of the sub-device in subdevs of the operation
+    const char *    product_id;
+    const char *    device_name;
+    int32_t         result;  // 0 for success, the result code from cloud, or err code
+} GatewaySubdevResult;
+
+/**
+ * @brief Define a callback to be invoked when the result of operation on a sub-device is known
+ *
+ * @param client    handle to gateway client
+ * @param result    result of the sub-device, valid only during the callback
+ * @param user_data user data of the operation
+ */
+typedef void (*OnGatewaySubdevResult)(void *client, const GatewaySubdevResult *result, void *user_data);
+
+/**
+ * @brief Define a handler of the messages routed to a sub-device
+ *
+ * @param client    handle to gateway client
+ * @param message   message of sub-device
+ * @param user_data user data of the handler
+ */
+typedef void (*OnGatewaySubdevMessage)(void *client, MQTTMessage *message, void *user_data);
+
+/* Route filter of data template down topics of all sub-devices: $thing/down/${type}/${product_id}/${device_name} */
+#define GATEWAY_ROUTE_THING_DOWN_FILTER            "$thing/down/+/+/+"
+#define GATEWAY_ROUTE_THING_DOWN_PRODUCT_ID_LEVEL  3
+#define GATEWAY_ROUTE_THING_DOWN_DEVICE_NAME_LEVEL 4
+
 /**
  * @brief Create gateway client and connect to MQTT server
  *
@@ -153,6 +193,406 @@ int IOT_Gateway_Subdev_Bind(void *client, GatewayParam *param, DeviceInfo *pBind
  */
 int IOT_Gateway_Subdev_Unbind(void *client, GatewayParam *param, DeviceInfo *pSubDevInfo);
 
+/**
+ * @brief Make a batch of sub-devices online, as many as fit are carried by one message
+ *
+ * @param client    handle to gateway client
+ * @param param     gateway parameters, sub-device members are not used
+ * @param subdevs   sub-devices, only product_id and device_name are used
+ * @param results   output result of each sub-device: 0 for online, the result code from cloud,
+ *                  QCLOUD_ERR_GATEWAY_SUBDEV_ONLINE if it is online already, or err code
+ * @param count     number of sub-devices
+ *
+ * @return QCLOUD_RET_SUCCESS if all are online, QCLOUD_ERR_FAILURE if some are not, or err code for failure
+ */
+int IOT_Gateway_Subdev_Online_Batch(void *client, GatewayParam *param, DeviceInfo *subdevs, int32_t *results,
+                                    int count);
+
+/**
+ * @brief Make a batch of sub-devices offline, as many as fit are carried by one message
+ *
+ * @param client    handle to gateway client
+ * @param param     gateway parameters, sub-device members are not used
+ * @param subdevs   sub-devices, only product_id and device_name are used
+ * @param results   output result of each sub-device: 0 for offline, the result code from cloud,
+ *                  QCLOUD_ERR_GATEWAY_SESSION_NO_EXIST if it is not online, or err code
+ * @param count     number of sub-devices
+ *
+ * @return QCLOUD_RET_SUCCESS if all are offline, QCLOUD_ERR_FAILURE if some are not, or err code for failure
+ */
+int IOT_Gateway_Subdev_Offline_Batch(void *client, GatewayParam *param, DeviceInfo *subdevs, int32_t *results,
+                                     int count);
+
+/**
+ * @brief Bind a batch of sub-devices, as many as fit are carried by one message
+ *
+ * @param client    handle to gateway client
+ * @param param     gateway parameters
+ * @param subdevs   sub-devices wait bind
+ * @param results   output result of each sub-device: 0 for bound, the result code from cloud, or err code
+ * @param count     number of sub-devices
+ *
+ * @return QCLOUD_RET_SUCCESS if all are bound, QCLOUD_ERR_FAILURE if some are not, or err code for failure
+ */
+int IOT_Gateway_Subdev_Bind_Batch(void *client, GatewayParam *param, DeviceInfo *subdevs, int32_t *results,
+                                  int count);
+
+/**
+ * @brief Start an operation on sub-devices without waiting for the results, any number of operations can be
+ * outstanding. The sub-devices are published right away, as many as fit in each message, and the result of
+ * each one is called back from the yield of gateway once its reply comes or its timeout passes.
+ *
+ * Sub-devices rejected before publishing are called back before this function returns, like one being
+ * online already or with the same operation outstanding (QCLOUD_ERR_GATEWAY_SUBDEV_OP_PENDING).
+ * Timeouts are checked in IOT_Gateway_Yield, with the yield thread they are checked when the next operation
+ * starts or a result comes. Callback shouldn't wait for another operation of the gateway.
+ *
+ * @param client    handle to gateway client
+ * @param param     gateway parameters, sub-device members are not used
+ * @param op        operation on sub-devices
+ * @param subdevs   sub-devices, bind uses their secret, not used after return
+ * @param count     number of sub-devices
+ * @param timeout_ms    timeout of each sub-device waiting for its result
+ * @param callback  called once for each sub-device with its result, QCLOUD_ERR_GATEWAY_SESSION_TIMEOUT for timeout
+ * @param user_data user data passed to callback
+ *
+ * @return QCLOUD_RET_SUCCESS when all are published or called back, or err code of publish for failure, the
+ *         sub-devices not published are called back with it
+ */
+int IOT_Gateway_Subdev_Operate_Async(void *client, GatewayParam *param, GatewaySubdevOp op, DeviceInfo *subdevs,
+                                     int count, uint32_t timeout_ms, OnGatewaySubdevResult callback, void *user_data);
+
+/**
+ * @brief Subscribe a wildcard filter for the topics of all sub-devices, each message is routed to the handler of
+ * the sub-device named by its topic, or to the event handler as MQTT_EVENT_PUBLISH_RECVEIVED if there is none.
+ * A topic subscribed exactly is still delivered to its own handler, and property controls of the sub-devices added
+ * to the gateway template go to the template.
+ *
+ * @param client            handle to gateway client
+ * @param topic_filter      topic filter with wildcards, like GATEWAY_ROUTE_THING_DOWN_FILTER
+ * @param product_id_level  level of product_id in topic, counted from 0
+ * @param device_name_level level of device_name in topic, counted from 0
+ * @param qos               qos of subscription
+ *
+ * @return packet id (>=0) when success, or err code (<0) for failure
+ */
+int IOT_Gateway_Route_Subscribe(void *client, char *topic_filter, int product_id_level, int device_name_level,
+                                QoS qos);
+
+/**
+ * @brief Set the handler of messages routed to a sub-device, the handler lives in the session of sub-device and
+ * is dropped with it when the sub-device goes offline
+ *
+ * @param client        handle to gateway client
+ * @param product_id    product id of sub-device
+ * @param device_name   device name of sub-device
+ * @param handler       message handler, NULL to remove
+ * @param user_data     user data of handler
+ *
+ * @return QCLOUD_RET_SUCCESS for success, QCLOUD_ERR_GATEWAY_SESSION_NO_EXIST if the sub-device is not online
+ */
+int IOT_Gateway_Route_Register(void *client, char *product_id, char *device_name, OnGatewaySubdevMessage handler,
+                               void *user_data);
+
+/**
+ * @brief Property in the data template of a sub-device product
+ */
+typedef struct {
+    const char *key;      // property id
+    int         type;     // TYPE_TEMPLATE_INT, _ENUM, _BOOL, _TIME, _FLOAT, _STRING or _STRINGENUM
+    uint16_t    str_len;  // max length of string value
+} GatewayTemplateProperty;
+
+/**
+ * @brief control of a sub-device, the values are stored before the callback
+ *
+ * @param handle        gateway template handle
+ * @param product_id    product id of the sub-device
+ * @param device_name   device name of the sub-device
+ * @param params        JSON object of the control
+ * @param user_data     user_data of IOT_Gateway_Template_Create
+ * @return code of control_reply, 0 for success
+ */
+typedef int (*OnGatewayTemplateControl)(void *handle, const char *product_id, const char *device_name,
+                                        const char *params, void *user_data);
+
+/**
+ * @brief create data template engine of sub-devices over the gateway connection
+ *
+ * Properties of all sub-devices of a product are stored by column, a few bytes
+ * for each device and property, and changed ones are reported in batches by
+ * IOT_Gateway_Template_Flush. Controls are received through one subscription
+ * of $thing/down/property/+/+ and routed by device, messages of sub-devices not
+ * added here go to the gateway route of IOT_Gateway_Route_Register. Controls of
+ * the devices added here come to the template also through broader route
+ * subscriptions, like the one of IOT_Gateway_Broker_Create. One template for a
+ * gateway client, destroy it before the gateway client.
+ *
+ * @param client             handle to gateway client
+ * @param flush_interval_ms  interval of reports by IOT_Gateway_Template_Flush
+ * @param control            control callback, NULL to store the values only
+ * @param user_data          user data of control
+ * @return handle, NULL for failure
+ */
+void *IOT_Gateway_Template_Create(void *client, uint32_t flush_interval_ms, OnGatewayTemplateControl control,
+                                  void *user_data);
+
+/**
+ * @brief destroy data template engine of sub-devices, before the gateway it was created on
+ *
+ * @param handle   gateway template handle
+ */
+void IOT_Gateway_Template_Destroy(void *handle);
+
+/**
+ * @brief add the data template of a product
+ *
+ * @param handle         gateway template handle
+ * @param product_id     product id
+ * @param properties     properties of the product, copied
+ * @param property_num   number of properties
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_Template_Add_Product(void *handle, const char *product_id, const GatewayTemplateProperty *properties,
+                                     int property_num);
+
+/**
+ * @brief add a sub-device, its values start from 0 and empty strings
+ *
+ * @param handle        gateway template handle
+ * @param product_id    product id of the sub-device
+ * @param device_name   device name of the sub-device
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_Template_Add_Device(void *handle, const char *product_id, const char *device_name);
+
+/**
+ * @brief remove a sub-device, its unreported values are dropped
+ *
+ * @param handle        gateway template handle
+ * @param product_id    product id of the sub-device
+ * @param device_name   device name of the sub-device
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_Template_Remove_Device(void *handle, const char *product_id, const char *device_name);
+
+/**
+ * @brief set property of a sub-device, it is reported by the next flush if changed
+ *
+ * Set_Int is for int, enum, bool and time, Set_Float for float and Set_String for strings
+ *
+ * @return QCLOUD_RET_SUCCESS for success, QCLOUD_ERR_GATEWAY_TEMPLATE_NO_EXIST for unknown
+ *         device or property, QCLOUD_ERR_INVAL for type mismatch or string too long
+ */
+int IOT_Gateway_Template_Set_Int(void *handle, const char *product_id, const char *device_name, const char *key,
+                                 int32_t value);
+int IOT_Gateway_Template_Set_Float(void *handle, const char *product_id, const char *device_name, const char *key,
+                                   float value);
+int IOT_Gateway_Template_Set_String(void *handle, const char *product_id, const char *device_name, const char *key,
+                                    const char *value);
+
+/**
+ * @brief get property of a sub-device
+ *
+ * @return QCLOUD_RET_SUCCESS for success, QCLOUD_ERR_GATEWAY_TEMPLATE_NO_EXIST for unknown
+ *         device or property, QCLOUD_ERR_INVAL for type mismatch or small buffer
+ */
+int IOT_Gateway_Template_Get_Int(void *handle, const char *product_id, const char *device_name, const char *key,
+                                 int32_t *value);
+int IOT_Gateway_Template_Get_Float(void *handle, const char *product_id, const char *device_name, const char *key,
+                                   float *value);
+int IOT_Gateway_Template_Get_String(void *handle, const char *product_id, const char *device_name, const char *key,
+                                    char *value, size_t value_len);
+
+/**
+ * @brief report changed properties of all sub-devices, one message for each device
+ *
+ * @param handle   gateway template handle
+ * @param force    report now instead of waiting for the flush interval
+ * @return number of reports published, or err code for failure, the rest is kept for the next flush
+ */
+int IOT_Gateway_Template_Flush(void *handle, bool force);
+
+#ifdef OTA_MQTT_CHANNEL
+/**
+ * @brief Local transport of firmware from the gateway to its sub-devices
+ *
+ * The callbacks run in IOT_Gateway_OTA_Yield and must not call the other IOT_Gateway_OTA functions.
+ */
+typedef struct {
+    /**
+     * @brief a sub-device starts receiving firmware, may be NULL
+     * @return 0 to go on, or <0 to fail the update
+     */
+    int (*begin)(void *user_data, const char *product_id, const char *device_name, const char *version,
+                 uint32_t file_size, const char *md5);
+
+    /**
+     * @brief firmware data from offset, offered again from the same offset until taken
+     * @return bytes taken, 0 when the sub-device is busy, or <0 to fail the update
+     */
+    int (*write)(void *user_data, const char *product_id, const char *device_name, uint32_t offset,
+                 const char *data, uint32_t len);
+
+    /**
+     * @brief transfer is over, may be NULL
+     * result is 0 when the whole firmware is sent, or IOT_OTAReportType of the failure
+     */
+    void (*end)(void *user_data, const char *product_id, const char *device_name, int result);
+} GatewayOTATransport;
+
+/**
+ * @brief create OTA distributor of sub-devices over the gateway connection
+ *
+ * Firmware updates of all sub-devices are received through one subscription of
+ * $ota/update/+/+. Each firmware is fetched once into store_dir by HAL_File*, named
+ * by its md5, and served from there to every sub-device updating to it, so the
+ * download cost of an update grows with unique firmwares rather than devices.
+ * Progress and results are reported on $ota/report of each sub-device.
+ * Destroy it after the gateway client.
+ *
+ * @param client     handle to gateway client
+ * @param store_dir  directory of the firmware store
+ * @param transport  local transport to sub-devices, copied, write is required
+ * @param user_data  user data of transport
+ * @return handle, NULL for failure
+ */
+void *IOT_Gateway_OTA_Create(void *client, const char *store_dir, const GatewayOTATransport *transport,
+                             void *user_data);
+
+/**
+ * @brief destroy OTA distributor before the gateway it was created on, partly fetched firmwares are kept in the
+ *        store and resumed later
+ *
+ * @param handle   gateway OTA handle
+ */
+void IOT_Gateway_OTA_Destroy(void *handle);
+
+/**
+ * @brief report the firmware version of a sub-device, the cloud pushes its update after that
+ *
+ * @param handle        gateway OTA handle
+ * @param product_id    product id of the sub-device
+ * @param device_name   device name of the sub-device
+ * @param version       firmware version, 1 to 32 chars
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_OTA_Report_Version(void *handle, const char *product_id, const char *device_name,
+                                   const char *version);
+
+/**
+ * @brief fetch firmwares and serve them to sub-devices
+ *
+ * One firmware is fetched at a time while every sub-device gets a piece of its
+ * firmware in each round, rounds go on until timeout_ms or no progress.
+ *
+ * @param handle      gateway OTA handle
+ * @param timeout_ms  time to work for
+ * @return number of sub-device updates in progress, or err code for failure
+ */
+int IOT_Gateway_OTA_Yield(void *handle, uint32_t timeout_ms);
+
+/**
+ * @brief report the result of a sub-device after the end of its transfer, its update is over
+ *
+ * @param handle        gateway OTA handle
+ * @param product_id    product id of the sub-device
+ * @param device_name   device name of the sub-device
+ * @param success       the sub-device runs the new firmware
+ * @return QCLOUD_RET_SUCCESS for success, QCLOUD_ERR_GATEWAY_OTA_NO_EXIST if no update of the sub-device
+ */
+int IOT_Gateway_OTA_Report_Result(void *handle, const char *product_id, const char *device_name, bool success);
+#endif
+
+#ifdef GATEWAY_LOCAL_BROKER_ENABLED
+/**
+ * @brief Define a callback to authenticate a sub-device connecting to the local broker
+ *
+ * @param user_data     user data of the broker
+ * @param product_id    product id of the sub-device, from its client id
+ * @param device_name   device name of the sub-device, from its client id
+ * @param username      username of CONNECT, "" if none
+ * @param password      password of CONNECT, "" if none
+ * @return 0 to accept the sub-device, others to refuse it
+ */
+typedef int (*OnGatewayBrokerAuth)(void *user_data, const char *product_id, const char *device_name,
+                                   const char *username, const char *password);
+
+/* Parameters of the local broker */
+typedef struct {
+    const char *        host;         // address to listen on, NULL for any
+    uint16_t            port;         // port to listen on
+    uint32_t            coalesce_ms;  // window to merge property reports of a sub-device, 0 to forward each one
+    OnGatewayBrokerAuth auth;         // NULL to accept any sub-device
+    void *              user_data;
+} GatewayBrokerParams;
+
+#define DEFAULT_GATEWAY_BROKER_PARAMS \
+    {                                 \
+        NULL, 1883, 200, NULL, NULL   \
+    }
+
+/* Statistics of the local broker */
+typedef struct {
+    uint32_t session_num;     // sessions open now
+    uint32_t connect_cnt;     // sub-devices connected
+    uint32_t refuse_cnt;      // connections refused
+    uint32_t local_msg_cnt;   // messages delivered to local subscribers
+    uint32_t upstream_cnt;    // messages of sub-devices for the cloud
+    uint32_t cloud_pub_cnt;   // messages published to the cloud
+    uint32_t coalesce_cnt;    // property reports merged into another one
+    uint32_t downstream_cnt;  // messages of the cloud for sub-devices
+} GatewayBrokerStats;
+
+/**
+ * @brief Create a local MQTT 3.1.1 broker that LAN sub-devices connect to directly
+ *
+ * A sub-device connects with client id ${product_id}${device_name} and is brought
+ * online through the gateway before its CONNACK. It publishes and subscribes on
+ * the $thing topics of its own, which are carried by the cloud session of the
+ * gateway, while topics without '$' are delivered among local clients only,
+ * without a cloud round trip. QoS0 property reports of a sub-device within
+ * coalesce_ms are merged into one, and the reply of the cloud is handed to the
+ * clientToken of each merged report.
+ *
+ * Sessions are clean, QoS is up to 1 without retransmission, retained and will
+ * messages are not kept. The route handlers of the connected sub-devices are
+ * taken by the broker, property controls of the sub-devices added to the gateway
+ * template still go to the template.
+ *
+ * @param client    handle to gateway client
+ * @param params    broker parameters, copied
+ * @return handle, NULL for failure
+ */
+void *IOT_Gateway_Broker_Create(void *client, const GatewayBrokerParams *params);
+
+/**
+ * @brief Destroy the local broker before the gateway client, from the thread of IOT_Gateway_Broker_Yield. The
+ * sub-devices connected are taken offline, after the results of bringing them online that are due
+ *
+ * @param handle    broker handle
+ */
+void IOT_Gateway_Broker_Destroy(void *handle);
+
+/**
+ * @brief Serve the local clients, call it from one thread along with IOT_Gateway_Yield
+ *
+ * @param handle        broker handle
+ * @param timeout_ms    time to serve for
+ * @return number of sessions, or err code for failure
+ */
+int IOT_Gateway_Broker_Yield(void *handle, uint32_t timeout_ms);
+
+/**
+ * @brief Get statistics of the local broker
+ *
+ * @param handle    broker handle
+ * @param stats     statistics since IOT_Gateway_Broker_Create
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_Broker_GetStats(void *handle, GatewayBrokerStats *stats);
+#endif
+
 /**
  * @brief Publish gateway MQTT message
  *
@@ -280,6 +720,132 @@ int IOT_Gateway_GetAutoMationList(void *client);
  * @return >= QCLOUD_RET_SUCCESS is success other is failed
  */
 int IOT_Gateway_EnableLocalAutoMation(void *client, QCLOUD_IO_GATEWAY_AUTOMATION_T *automation);
+
+#ifdef GATEWAY_AUTOMATION_ENABLED
+
+/**
+ * @brief Local automation engine
+ *
+ * Rules are evaluated on the gateway as sub-device properties are reported,
+ * the params of an automation are compiled when it is set:
+ *
+ * {
+ *     "matchType": 0,                      0: all conditions, 1: any condition
+ *     "effectiveBeginTime": "08:00",       optional window, across midnight if begin is later than end
+ *     "effectiveEndTime": "22:00",
+ *     "effectiveDays": "1111111",          optional, Sunday first
+ *     "conditions": [
+ *         {"type": 0, "productId": "ABC", "deviceName": "sensor", "propertyId": "temp", "op": "gt", "value": 30},
+ *         {"type": 1, "days": "0111110", "time": "07:30"}
+ *     ],
+ *     "actions": [
+ *         {"productId": "ABC", "deviceName": "fan", "data": {"power_switch": 1}}
+ *     ]
+ * }
+ *
+ * op is one of eq, ne, gt, ge, lt, le, boolean values compare as 0 and 1.
+ * A property condition triggers when it becomes true, a timer triggers at its
+ * minute. With matchType 0 the rule runs when it is triggered and all property
+ * conditions are true, and a rule with timers runs only at its timers.
+ */
+
+/**
+ * @brief execute one action of an automation
+ *
+ * Called with the engine locked, it must not call the engine
+ *
+ * @param automation_id  automation of the action
+ * @param product_id     product id of the sub-device to control
+ * @param device_name    device name of the sub-device to control
+ * @param data           JSON object of the properties to control
+ * @param user_data      user_data of IOT_Gateway_AutoMation_Create
+ * @return 0 for success, reported in the execution log
+ */
+typedef int (*OnAutoMationAction)(const char *automation_id, const char *product_id, const char *device_name,
+                                  const char *data, void *user_data);
+
+/**
+ * @brief create local automation engine
+ *
+ * @param action     executes the actions of automations
+ * @param user_data  user data of action
+ * @return engine handle, NULL for failure
+ */
+void *IOT_Gateway_AutoMation_Create(OnAutoMationAction action, void *user_data);
+
+/**
+ * @brief destroy local automation engine, detach it by destroying the gateway client first
+ *
+ * @param engine  engine handle
+ */
+void IOT_Gateway_AutoMation_Destroy(void *engine);
+
+/**
+ * @brief receive automations from cloud and report execution logs to it,
+ *        automations already on the cloud are fetched
+ *
+ * @param client  handle to gateway client
+ * @param engine  engine handle
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_AutoMation_Attach(void *client, void *engine);
+
+/**
+ * @brief compile and add an automation, or replace the one with the same id
+ *
+ * @param engine         engine handle
+ * @param automation_id  automation id
+ * @param status         0 for disabled
+ * @param params         JSON of the automation, modified in place while compiled
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_AutoMation_Set(void *engine, char *automation_id, int status, char *params);
+
+/**
+ * @brief delete an automation
+ *
+ * @param engine         engine handle
+ * @param automation_id  automation id
+ * @return QCLOUD_RET_SUCCESS for success, QCLOUD_ERR_FAILURE if it does not exist
+ */
+int IOT_Gateway_AutoMation_Delete(void *engine, char *automation_id);
+
+/**
+ * @brief feed a numeric or boolean property of a sub-device, automations triggered by it are executed
+ *
+ * @param engine       engine handle
+ * @param product_id   product id of the sub-device
+ * @param device_name  device name of the sub-device
+ * @param property     property id
+ * @param value        property value
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_AutoMation_Property(void *engine, const char *product_id, const char *device_name,
+                                    const char *property, double value);
+
+/**
+ * @brief feed the properties reported by a sub-device, like {"temp":25,"power_switch":1}
+ *
+ * @param engine       engine handle
+ * @param product_id   product id of the sub-device
+ * @param device_name  device name of the sub-device
+ * @param params       JSON object of properties, values other than number and boolean are skipped
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int IOT_Gateway_AutoMation_Report(void *engine, const char *product_id, const char *device_name, char *params);
+
+/**
+ * @brief run the timers due since the previous tick, call it at least once a minute
+ *
+ * Timers are not replayed on the first tick, nor after a gap of more than one day
+ * or when the time goes back.
+ *
+ * @param engine      engine handle
+ * @param local_time  seconds since 1970-01-01 00:00 in local time zone
+ */
+void IOT_Gateway_AutoMation_Tick(void *engine, uint32_t local_time);
+
+#endif
 /**
  * @brief get sub-device bind list from cloud platform
  *
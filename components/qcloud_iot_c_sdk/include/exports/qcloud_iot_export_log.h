@@ -27,6 +27,7 @@ extern "C" {
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -66,6 +67,21 @@ typedef int (*LogDelFunc)();
 // nothing exist
 typedef size_t (*LogGetSizeFunc)();
 
+/**
+ * @brief storage of the segmented log store, a region of flash or a file
+ *
+ * Offsets are inside the region. Each function returns 0 for success.
+ */
+typedef struct {
+    int (*read)(void *usr_data, uint32_t offset, void *buf, uint32_t len);
+    int (*program)(void *usr_data, uint32_t offset, const void *data, uint32_t len);
+    // NULL if the media needs no erase, erased bytes are written as 0xFF then
+    int (*erase)(void *usr_data, uint32_t offset, uint32_t len);
+    void *   usr_data;
+    uint32_t size;         // size of the region
+    uint32_t sector_size;  // erase unit, LOG_STORE_SEGMENT_SIZE must be a multiple of it
+} LogStoreOps;
+
 /**
  * @brief data structure to init feature of log upload
  */
@@ -82,8 +98,34 @@ typedef struct {
     LogReadFunc    read_func;
     LogDelFunc     del_func;
     LogGetSizeFunc get_size_func;
+    /* segmented log store used instead of the callbacks above when set. The
+     * saved logs are posted a segment at a time and deleted as they are
+     * acknowledged */
+    LogStoreOps *store_ops;
 } LogUploadInitParams;
 
+/**
+ * @brief what to do with a log when the async print queue is full
+ */
+typedef enum {
+    eLOG_ASYNC_DROP_NEW   = 0,  // drop the new log
+    eLOG_ASYNC_DROP_OLD   = 1,  // drop the oldest queued logs to make room for the new one
+    eLOG_ASYNC_PRINT_SYNC = 2,  // print the new log on the calling thread
+} LOG_ASYNC_OVERFLOW;
+
+/**
+ * @brief data structure to start async log print
+ */
+typedef struct {
+    uint32_t           queue_size;    // bytes of formatted logs the queue holds
+    LOG_ASYNC_OVERFLOW overflow;      // overflow behaviour when queue is full
+    LOG_LEVEL          bypass_level;  // logs of this level or more severe are printed on the calling thread
+    uint16_t           priority;      // priority of print task, keep it lower than the mqtt yield task
+    uint32_t           stack_size;    // stack size of print task
+} LogAsyncPrintParams;
+
+#define DEFAULT_LOG_ASYNC_PRINT_PARAMS {LOG_ASYNC_PRINT_QUEUE_SIZE, eLOG_ASYNC_DROP_NEW, eLOG_ERROR, 0, 2048}
+
 /**
  * @brief Set the global log level of print
  *
@@ -145,6 +187,33 @@ void IOT_Log_Fini_Uploader(void);
  */
 int IOT_Log_Upload(bool force_upload);
 
+/**
+ * @brief Print logs to console in a low priority task instead of the calling
+ * thread, logs are queued after formatting. LogMessageHandler is still called
+ * on the calling thread.
+ *
+ * @param params queue and task parameters, NULL for DEFAULT_LOG_ASYNC_PRINT_PARAMS
+ * @return QCLOUD_RET_SUCCESS when success, or error code when fail
+ */
+int IOT_Log_Start_Async_Print(LogAsyncPrintParams *params);
+
+/**
+ * @brief Print the queued logs and go back to printing on the calling thread
+ */
+void IOT_Log_Stop_Async_Print(void);
+
+/**
+ * @brief Limit the logs of one level from each call site with a token bucket:
+ * burst logs at most, then one more every interval_ms. The number of logs
+ * suppressed is logged before the next log passing from the same call site.
+ * Only works when LOG_RATE_LIMIT_ENABLED is defined.
+ *
+ * @param level       log level to limit
+ * @param burst       logs allowed in a burst, 0 for no limit
+ * @param interval_ms time to earn one more log
+ */
+void IOT_Log_Set_Rate_Limit(LOG_LEVEL level, uint16_t burst, uint32_t interval_ms);
+
 /**
  * @brief Generate log for print/upload, call LogMessageHandler if defined
  *
@@ -44,6 +44,18 @@ typedef enum {
  */
 int IOT_Get_Sys_Resource(void *pClient, eSysResourcType eType, DeviceInfo *pDevInfo, void *usrArg);
 
+/**
+ * @brief Get the time of IoT Hub estimated locally, never blocks
+ *
+ * The time is synced with IoT Hub in IOT_MQTT_Yield every TIME_SYNC_INTERVAL_MS.
+ * Half of the round trip is added to the time of the server and the drift of
+ * the local clock is estimated over the syncs. A time reply to
+ * IOT_Get_Sys_Resource syncs it too.
+ *
+ * @return                  UTC time in ms, or 0 if not synced yet
+ */
+int64_t IOT_Get_Sys_Time_Ms(void);
+
 #ifdef __cplusplus
 }
 #endif
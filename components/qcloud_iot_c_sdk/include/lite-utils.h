@@ -85,6 +85,55 @@ int LITE_get_double(double *value, char *src);
 int LITE_get_boolean(bool *value, char *src);
 int LITE_get_string(int8_t *value, char *src, uint16_t max_len);
 
+/**
+ * @brief view of a JSON value inside the source buffer, nothing is copied
+ *
+ * For string the view excludes the quotes and escapes are kept as is,
+ * for object and array the view includes the brackets.
+ */
+typedef struct {
+    const char *ptr;
+    size_t      len;
+    int         type;  // enum JSONTYPE
+} json_span_t;
+
+/**
+ * @brief find value by key without allocation, key could be dotted like "payload.devices"
+ *
+ * @param key            key or dotted path of the value
+ * @param src            JSON object, '\0' is required at or after src + src_len
+ * @param src_len        length of the JSON object
+ * @param span           view of the value in src
+ * @return               QCLOUD_RET_SUCCESS for success, QCLOUD_ERR_JSON_PARSE if not found
+ */
+int LITE_json_span_of(const char *key, const char *src, size_t src_len, json_span_t *span);
+
+int LITE_span_get_int32(int32_t *value, const json_span_t *span);
+int LITE_span_get_int16(int16_t *value, const json_span_t *span);
+int LITE_span_get_int8(int8_t *value, const json_span_t *span);
+int LITE_span_get_uint32(uint32_t *value, const json_span_t *span);
+int LITE_span_get_uint16(uint16_t *value, const json_span_t *span);
+int LITE_span_get_uint8(uint8_t *value, const json_span_t *span);
+int LITE_span_get_float(float *value, const json_span_t *span);
+int LITE_span_get_double(double *value, const json_span_t *span);
+int LITE_span_get_boolean(bool *value, const json_span_t *span);
+
+/**
+ * @brief copy value to caller buffer, escapes are decoded for string
+ *
+ * @param value          buffer for the result, always '\0' terminated
+ * @param span           view of the value
+ * @param buf_len        size of value, including the terminator
+ * @return               QCLOUD_RET_SUCCESS for success, QCLOUD_ERR_JSON_BUFFER_TRUNCATED if
+ *                       the result is truncated to fit buf_len
+ */
+int LITE_span_get_string(char *value, const json_span_t *span, size_t buf_len);
+
+/**
+ * @brief compare raw text of the value with str
+ */
+bool LITE_span_equal(const json_span_t *span, const char *str);
+
 typedef struct _json_key_t {
     char *      key;
     list_head_t list;
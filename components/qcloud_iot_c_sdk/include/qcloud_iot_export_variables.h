@@ -61,6 +61,20 @@
 #define MAX_LOG_MSG_LEN (1023)
 #endif
 
+// size of queue for async log print, holds formatted logs
+#define LOG_ASYNC_PRINT_QUEUE_SIZE 2048
+
+// interval of async log print task polling the queue (unit: ms)
+#define LOG_ASYNC_PRINT_INTERVAL_MS 20
+
+// call sites tracked by log rate limit at the same time
+#define LOG_RATE_LIMIT_SITES 16
+
+// default rate limit of ERR and WRN logs from one call site: a burst of
+// LOG_RATE_LIMIT_BURST logs, then one more every LOG_RATE_LIMIT_INTERVAL_MS
+#define LOG_RATE_LIMIT_BURST       10
+#define LOG_RATE_LIMIT_INTERVAL_MS 1000
+
 /*
  * Log upload related params, which will affect the size of device memory/disk
  * consumption
@@ -72,11 +86,41 @@
 // Max size of one http log upload. Should not larger than 5000
 #define MAX_HTTP_LOG_POST_SIZE 3000
 
+// drop the oldest logs instead of the new ones when log upload buffer is full
+#define LOG_UPLOAD_OVERWRITE_OLDEST 0
+
 // MAX size for saving log into NVS (files/FLASH) after upload fail
 #define MAX_LOG_SAVE_SIZE (3 * LOG_UPLOAD_BUFFER_SIZE)
 
+// size of one segment of the log store, saved logs are deleted a segment at a time
+#define LOG_STORE_SEGMENT_SIZE 4096
+
 // interval of log upload (unit: ms) Decrease this value if
 // LOG_UPLOAD_BUFFER_SIZE is small
 #define LOG_UPLOAD_INTERVAL_MS 2000
 
+// interval of time sync with IoT Hub (unit: ms), the time is estimated locally in between
+#define TIME_SYNC_INTERVAL_MS (60 * 60 * 1000)
+
+// retry interval of time sync before it succeeds (unit: ms)
+#define TIME_SYNC_RETRY_INTERVAL_MS (10 * 1000)
+
+// log messages published over MQTT and not acked yet, their logs stay in the upload buffer until then
+#define LOG_MQTT_MAX_INFLIGHT 4
+
+// republish a log message over MQTT if it is not acked in this time (unit: ms)
+#define LOG_MQTT_ACK_TIMEOUT_MS 5000
+
+// slice of yield a sync API drives the client with while waiting for its reply without a yield thread (unit: ms)
+#define COMPLETION_YIELD_SLICE_MS 10
+
+// default UDP port of the LAN control service of data template
+#define LAN_CONTROL_PORT 8267
+
+// retry interval of syncing LAN controls to the cloud after the report fails (unit: ms)
+#define LAN_CONTROL_SYNC_RETRY_MS 5000
+
+// bytes appended to the state snapshot journal of data template before it is compacted again
+#define STATE_SNAPSHOT_JOURNAL_LEN 2048
+
 #endif /* QCLOUD_IOT_EXPORT_VARIABLES_H_ */
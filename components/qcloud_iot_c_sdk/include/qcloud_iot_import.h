@@ -510,10 +510,10 @@ uintptr_t HAL_TCP_Connect(const char *host, uint16_t port);
  */
 uintptr_t HAL_TCP_CreatBind(const char *host, uint16_t port);
 /**
- * @brief tcp server accept
+ * @brief tcp server accept, never blocks
  *
  * @server_fd    tcp server file discriptor
- * @return  TCP socket handle (value>0) when success, or 0 otherwise
+ * @return  TCP socket handle (value>0) of a pending connection, or 0 if none is pending
  */
 uintptr_t HAL_TCP_Accept(int server_fd);
 /**
@@ -602,7 +602,7 @@ int HAL_UDP_Read(uintptr_t fd, unsigned char *data, unsigned int len);
 int HAL_UDP_ReadTimeout(uintptr_t fd, unsigned char *p_data, unsigned int datalen, unsigned int timeout_ms);
 #endif  // COAP_COMM_ENABLED
 
-#ifdef WIFI_CONFIG_ENABLED
+#if defined(WIFI_CONFIG_ENABLED) || defined(LAN_CONTROL_ENABLED)
 int   HAL_UDP_CreateBind(const char *host, unsigned short port);
 int   HAL_UDP_WriteTo(uintptr_t fd, const unsigned char *p_data, unsigned int datalen, char *host, unsigned short port);
 void  HAL_UDP_Close(uintptr_t fd);
@@ -611,7 +611,7 @@ char *HAL_UDP_GetErrnoStr();
 int HAL_UDP_GetErrno();
 int HAL_UDP_ReadTimeoutPeerInfo(uintptr_t fd, unsigned char *p_data, unsigned int datalen, unsigned int timeout_ms,
                                 char *recv_ip_addr, unsigned char recv_addr_len, unsigned short *recv_port);
-#endif  // WIFI_CONFIG_ENABLED
+#endif  // WIFI_CONFIG_ENABLED || LAN_CONTROL_ENABLED
 
 #ifdef LOG_UPLOAD
 /* Functions for saving/reading logs into/from NVS(files/FLASH) after log upload
@@ -216,7 +216,7 @@ void HAL_MutexUnlock(_IN_ void *mutex)
 #endif
 }
 
-#if ((defined MULTITHREAD_ENABLED) || (defined WIFI_CONFIG_ENABLED))
+#if ((defined MULTITHREAD_ENABLED) || (defined WIFI_CONFIG_ENABLED) || (defined LOG_ASYNC_PRINT_ENABLED))
 
 // platform-dependant thread routine/entry function
 static void _HAL_thread_func_wrapper_(void *ptr)
@@ -289,4 +289,36 @@ int HAL_SemaphoreWait(void *sem, uint32_t timeout_ms)
 {
     return osSemaphoreWait((osSemaphoreId)sem, timeout_ms);
 }
+
+#elif defined(MULTITHREAD_ENABLED)
+
+void *HAL_SemaphoreCreate(void)
+{
+    SemaphoreHandle_t sem = xSemaphoreCreateBinary();
+    if (NULL == sem) {
+        HAL_Printf("%s: xSemaphoreCreateBinary failed\n", __FUNCTION__);
+        return NULL;
+    }
+
+    return sem;
+}
+
+void HAL_SemaphoreDestroy(void *sem)
+{
+    vSemaphoreDelete(sem);
+}
+
+void HAL_SemaphorePost(void *sem)
+{
+    xSemaphoreGive(sem);
+}
+
+int HAL_SemaphoreWait(void *sem, uint32_t timeout_ms)
+{
+    if (xSemaphoreTake(sem, timeout_ms / portTICK_PERIOD_MS) != pdTRUE) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
 #endif
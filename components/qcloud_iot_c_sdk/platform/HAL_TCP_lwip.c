@@ -98,15 +98,71 @@ uintptr_t HAL_TCP_Connect(const char *host, uint16_t port)
     return (uintptr_t)ret;
 }
 
+uintptr_t HAL_TCP_CreatBind(const char *host, uint16_t port)
+{
+    struct sockaddr_in addr;
+    int                fd, opt = 1;
+
+    fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        Log_e("socket error: %s", STRING_PTR_PRINT_SANITY_CHECK(strerror(errno)));
+        return 0;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    memset(&addr, 0x00, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = host ? inet_addr(host) : htonl(INADDR_ANY);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 8)) {
+        Log_e("listen on %s:%d error: %s", host ? host : "*", port, STRING_PTR_PRINT_SANITY_CHECK(strerror(errno)));
+        close(fd);
+        return 0;
+    }
+
+    Log_i("TCP server listening on %s:%d", host ? host : "*", port);
+
+    return (uintptr_t)(fd + LWIP_SOCKET_FD_SHIFT);
+}
+
+uintptr_t HAL_TCP_Accept(int server_fd)
+{
+    struct sockaddr_in peer;
+    socklen_t          peer_len = sizeof(peer);
+    struct timeval     timeout  = {0, 0};
+    fd_set             sets;
+    int                fd;
+
+    server_fd -= LWIP_SOCKET_FD_SHIFT;
+
+    /* never blocks, 0 when no connection is pending */
+    FD_ZERO(&sets);
+    FD_SET(server_fd, &sets);
+    if (select(server_fd + 1, &sets, NULL, NULL, &timeout) <= 0) {
+        return 0;
+    }
+
+    fd = accept(server_fd, (struct sockaddr *)&peer, &peer_len);
+    if (fd < 0) {
+        Log_e("accept error: %s", STRING_PTR_PRINT_SANITY_CHECK(strerror(errno)));
+        return 0;
+    }
+
+    Log_d("accepted TCP client: %s:%d", STRING_PTR_PRINT_SANITY_CHECK(inet_ntoa(peer.sin_addr)), ntohs(peer.sin_port));
+
+    return (uintptr_t)(fd + LWIP_SOCKET_FD_SHIFT);
+}
+
 int HAL_TCP_Disconnect(uintptr_t fd)
 {
     int rc;
 
     fd -= LWIP_SOCKET_FD_SHIFT;
 
-    /* Shutdown both send and receive operations. */
+    /* Shutdown both send and receive operations, a listening socket has none to shut down. */
     rc = shutdown((int)fd, 2);
-    if (0 != rc) {
+    if (0 != rc && ENOTCONN != errno) {
         Log_e("shutdown error: %s", STRING_PTR_PRINT_SANITY_CHECK(strerror(errno)));
         return -1;
     }
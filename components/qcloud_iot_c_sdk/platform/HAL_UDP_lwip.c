@@ -164,7 +164,7 @@ int HAL_UDP_ReadTimeout(uintptr_t fd, unsigned char *p_data, unsigned int datale
 }
 #endif
 
-#ifdef WIFI_CONFIG_ENABLED
+#if defined(WIFI_CONFIG_ENABLED) || defined(LAN_CONTROL_ENABLED)
 /* lwIP socket handle start from 0 */
 #define WIFI_LWIP_SOCKET_FD_SHIFT 3
 
@@ -236,7 +236,7 @@ int HAL_UDP_ReadTimeoutPeerInfo(uintptr_t fd, unsigned char *p_data, unsigned in
     uint               addrLen = sizeof(source_addr);
     int                len     = 0;
 
-    Log_i("HAL_UDP_ReadTimeoutPeerInfo fd:%d", fd);
+    Log_d("HAL_UDP_ReadTimeoutPeerInfo fd:%d", fd);
 
     fd -= WIFI_LWIP_SOCKET_FD_SHIFT;
 
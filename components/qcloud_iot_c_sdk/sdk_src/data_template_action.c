@@ -34,74 +34,103 @@
 #include "qcloud_iot_export_data_template.h"
 
 // Action Subscribe
-static int _parse_action_input(DeviceAction *pAction, char *pInput)
+static int _update_action_input(DeviceProperty *pActionInput, const json_span_t *pValue)
 {
-    int             i;
-    char *          temp;
-    DeviceProperty *pActionInput = pAction->pInput;
+    int ret = 0;
+
+    switch (pActionInput->type) {
+        case JINT32:
+            ret = LITE_span_get_int32(pActionInput->data, pValue);
+            break;
+        case JFLOAT:
+            ret = LITE_span_get_float(pActionInput->data, pValue);
+            break;
+        case JUINT32:
+            ret = LITE_span_get_uint32(pActionInput->data, pValue);
+            break;
+        case JBOOL:
+            ret = LITE_span_get_boolean(pActionInput->data, pValue);
+            break;
+        case JINT16:
+            ret = LITE_span_get_int16(pActionInput->data, pValue);
+            break;
+        case JINT8:
+            ret = LITE_span_get_int8(pActionInput->data, pValue);
+            break;
+        case JUINT16:
+            ret = LITE_span_get_uint16(pActionInput->data, pValue);
+            break;
+        case JUINT8:
+            ret = LITE_span_get_uint8(pActionInput->data, pValue);
+            break;
+        case JSTRING:
+            Log_d("property data_buff_len %d", pActionInput->data_buff_len);
+            // truncate to data_buff_len, a too long string is not an error here
+            LITE_span_get_string(pActionInput->data, pValue, pActionInput->data_buff_len);
+            break;
+        default:
+            ret = QCLOUD_ERR_MQTT_UNKNOWN;
+            Log_e("type %d not supported", pActionInput->type);
+            break;
+    }
 
-    // check and copy
-    for (i = 0; i < pAction->input_num; i++) {
-        if (JSTRING == pActionInput[i].type) {
-            char *_p = LITE_json_value_of(pActionInput[i].key, pInput);
-            if (!_p) {
-                Log_e("action input data [%s] not found!", STRING_PTR_PRINT_SANITY_CHECK(pActionInput[i].key));
-                return -1;
-            }
-            strncpy(pActionInput[i].data, _p, pActionInput[i].data_buff_len);
-            HAL_Free(_p);
-        } else {
-            temp    = LITE_json_value_of(pActionInput[i].key, pInput);
-            int ret = 0;
-            if (NULL == temp) {
-                Log_e("action input data [%s] not found!", STRING_PTR_PRINT_SANITY_CHECK(pActionInput[i].key));
-                return -1;
-            }
-            switch (pActionInput[i].type) {
-                case JINT32:
-                    ret = LITE_get_int32(pActionInput[i].data, temp);
-                    break;
-                case JFLOAT:
-                    ret = LITE_get_float(pActionInput[i].data, temp);
-                    break;
-                case JUINT32:
-                    ret = LITE_get_uint32(pActionInput[i].data, temp);
-                    break;
-                case JBOOL:
-                    ret = LITE_get_boolean(pActionInput[i].data, temp);
-                    break;
-                case JINT16:
-                    ret = LITE_get_int16(pActionInput[i].data, temp);
-                    break;
-                case JINT8:
-                    ret = LITE_get_int8(pActionInput[i].data, temp);
-                    break;
-                case JUINT16:
-                    ret = LITE_get_uint16(pActionInput[i].data, temp);
-                    break;
-                case JUINT8:
-                    ret = LITE_get_uint8(pActionInput[i].data, temp);
-                    break;
-                case JSTRING:
-                    Log_d("property data_buff_len %d", pActionInput[i].data_buff_len);
-                    ret = LITE_get_string(pActionInput[i].data, temp, pActionInput[i].data_buff_len);
-                    break;
-                default:
-                    ret = QCLOUD_ERR_MQTT_UNKNOWN;
-                    Log_e("type %d not supported", pActionInput[i].type);
-                    break;
+    return ret;
+}
+
+/* walk members of input once and dispatch them through the input index of the action */
+static int _parse_action_input(ActionHandler *pActionHandle, const json_span_t *pInput)
+{
+    DeviceAction *  pAction = (DeviceAction *)pActionHandle->action;
+    DeviceProperty *pActionInput;
+    json_span_t     temp;
+    uint32_t        found[(UINT8_MAX + 1) / 32] = {0};
+    int             i, found_num = 0;
+
+    char *pos = NULL, *key = NULL, *val = NULL;
+    int   key_len = 0, val_len = 0, val_type = 0;
+
+    /* the iterator does not stop at the end of a nested object, so bound it by input length */
+    json_object_for_each_kv((char *)pInput->ptr, pos, key, key_len, val, val_len, val_type)
+    {
+        if (!key || key >= pInput->ptr + pInput->len) {
+            break;
+        }
+
+        pActionInput = (DeviceProperty *)hash_index_find(&pActionHandle->input_index, key, key_len);
+        if (!pActionInput || !val) {
+            continue;
+        }
+
+        temp.ptr  = val;
+        temp.len  = val_len;
+        temp.type = val_type;
+        if (_update_action_input(pActionInput, &temp) < 0) {
+            return -1;
+        }
+
+        i = pActionInput - pAction->pInput;
+        if (!(found[i / 32] & (1u << (i % 32)))) {
+            found[i / 32] |= 1u << (i % 32);
+            found_num++;
+        }
+    }
+
+    // every input is required
+    if (found_num != pAction->input_num) {
+        for (i = 0; i < pAction->input_num; i++) {
+            if (!(found[i / 32] & (1u << (i % 32)))) {
+                Log_e("action input data [%s] not found!", STRING_PTR_PRINT_SANITY_CHECK(pAction->pInput[i].key));
+                break;
             }
-            HAL_Free(temp);
-            if (ret < 0)
-                return -1;
         }
+        return -1;
     }
 
     return 0;
 }
 
 static void _handle_action(Qcloud_IoT_Template *pTemplate, List *list, const char *pClientToken, const char *pActionId,
-                           uint32_t timestamp, char *pInput)
+                           uint32_t timestamp, const json_span_t *pInput)
 {
     IOT_FUNC_ENTRY;
 
@@ -132,7 +161,7 @@ static void _handle_action(Qcloud_IoT_Template *pTemplate, List *list, const cha
             // check action id and call callback
             if (strcmp(pActionId, ((DeviceAction *)pActionHandle->action)->pActionId) || !(pActionHandle->callback))
                 continue;
-            if (!_parse_action_input(pActionHandle->action, pInput)) {
+            if (!_parse_action_input(pActionHandle, pInput)) {
                 ((DeviceAction *)pActionHandle->action)->timestamp = timestamp;
                 pActionHandle->callback(pTemplate, pClientToken, pActionHandle->action);
             }
@@ -151,59 +180,53 @@ static void _on_action_handle_callback(void *pClient, MQTTMessage *message, void
     //  (Qcloud_IoT_Template*)mqtt_client->event_handle.context;
     Qcloud_IoT_Template *template_client = (Qcloud_IoT_Template *)pUserData;
 
-    char *type_str     = NULL;
-    char *client_token = NULL;
-    char *action_id    = NULL;
-    char *pInput       = NULL;
-    int   timestamp    = 0;
+    char        type_str[MAX_SIZE_OF_METHOD];
+    char        client_token[MAX_SIZE_OF_CLIENT_TOKEN];
+    char        action_id[MAX_SIZE_OF_ACTION_ID];
+    json_span_t input;
+    int         timestamp = 0;
 
     Log_d("recv:%.*s", (int)message->payload_len, (char *)message->payload);
     if (!template_client)
         return;
 
     // prase_method
-    if (!parse_template_method_type((char *)message->payload, &type_str)) {
+    if (!parse_template_method_type((char *)message->payload, type_str, sizeof(type_str))) {
         Log_e("Fail to parse method!");
-        goto EXIT;
+        return;
     }
 
     if (strcmp(type_str, CALL_ACTION)) {
-        goto EXIT;
+        return;
     }
 
     // prase client Token
-    if (!parse_client_token((char *)message->payload, &client_token)) {
+    if (!parse_client_token((char *)message->payload, client_token, sizeof(client_token))) {
         Log_e("fail to parse client token!");
-        goto EXIT;
+        return;
     }
 
     // prase action ID
-    if (!parse_action_id((char *)message->payload, &action_id)) {
+    if (!parse_action_id((char *)message->payload, action_id, sizeof(action_id))) {
         Log_e("fail to parse action id!");
-        goto EXIT;
+        return;
     }
 
     // prase timestamp
     if (!parse_time_stamp((char *)message->payload, &timestamp)) {
         Log_e("fail to parse timestamp!");
-        goto EXIT;
+        return;
     }
 
     // prase action input
-    if (!parse_action_input((char *)message->payload, &pInput)) {
+    if (!parse_action_input((char *)message->payload, &input)) {
         Log_e("fail to parse action input!");
-        goto EXIT;
+        return;
     }
 
     // find action ID in register list and call handle
     _handle_action(template_client, template_client->inner_data.action_handle_list, client_token, action_id, timestamp,
-                   pInput);
-
-EXIT:
-    HAL_Free(type_str);
-    HAL_Free(client_token);
-    HAL_Free(pInput);
-    HAL_Free(action_id);
+                   &input);
 }
 
 int IOT_Action_Init(void *c)
@@ -227,12 +250,21 @@ int IOT_Action_Init(void *c)
 }
 
 // Action register
+static const char *_get_action_input_key(void *val)
+{
+    return ((DeviceProperty *)val)->key;
+}
+
 static int _add_action_handle_to_template_list(Qcloud_IoT_Template *pTemplate, DeviceAction *pAction,
                                                OnActionHandleCallback callback)
 {
     IOT_FUNC_ENTRY;
 
-    ActionHandler *action_handle = (ActionHandler *)HAL_Malloc(sizeof(ActionHandler));
+    int      i;
+    uint16_t slot_num = hash_index_slot_num(pAction->input_num);
+
+    // index of inputs is compiled here and shares the allocation with the handler
+    ActionHandler *action_handle = (ActionHandler *)HAL_Malloc(sizeof(ActionHandler) + slot_num * sizeof(void *));
     if (NULL == action_handle) {
         Log_e("run memory malloc is error!");
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
@@ -241,9 +273,21 @@ static int _add_action_handle_to_template_list(Qcloud_IoT_Template *pTemplate, D
     action_handle->callback = callback;
     action_handle->action   = pAction;
 
+    hash_index_init(&action_handle->input_index, (void **)(action_handle + 1), slot_num, _get_action_input_key);
+    for (i = 0; i < pAction->input_num; i++) {
+        if (hash_index_add(&action_handle->input_index, &pAction->pInput[i]) != QCLOUD_RET_SUCCESS) {
+            Log_e("invalid or duplicated input [%s] of action %s",
+                  STRING_PTR_PRINT_SANITY_CHECK(pAction->pInput[i].key),
+                  STRING_PTR_PRINT_SANITY_CHECK(pAction->pActionId));
+            HAL_Free(action_handle);
+            IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+        }
+    }
+
     ListNode *node = list_node_new(action_handle);
     if (NULL == node) {
         Log_e("run list_node_new is error!");
+        HAL_Free(action_handle);
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
     }
     qcloud_list_rpush(pTemplate->inner_data.action_handle_list, node);
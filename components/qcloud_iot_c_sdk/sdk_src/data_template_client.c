@@ -31,6 +31,7 @@ extern "C" {
 #include "data_template_action.h"
 #include "data_template_client_common.h"
 #include "data_template_client_json.h"
+#include "utils_completion.h"
 #include "utils_param_check.h"
 #include "qcloud_iot_export.h"
 #include "qcloud_iot_import.h"
@@ -187,6 +188,26 @@ static void _copy_template_init_params_to_mqtt(MQTTInitParams *pMqttInitParams,
     pMqttInitParams->auto_connect_enable    = templateInitParams->auto_connect_enable;
 }
 
+/* interval to expire the request of a sync API while waiting for its reply (unit: ms) */
+#define TEMPLATE_SYNC_EXPIRE_CHECK_MS 1000
+
+/* reply of a sync API, user context of its request */
+typedef struct {
+    ReplyAck   ack;
+    Completion completion;
+} TemplateSyncReply;
+
+static void _template_sync_wait(Qcloud_IoT_Template *pTemplate, TemplateSyncReply *reply)
+{
+    /* the callback always comes, with ACK_TIMEOUT once the request expires, reply stays in use until then */
+    while (utils_completion_wait(&reply->completion, pTemplate->mqtt, TEMPLATE_SYNC_EXPIRE_CHECK_MS,
+                                 IOT_Template_Yield, pTemplate) != QCLOUD_RET_SUCCESS) {
+        /* a yield thread doesn't expire requests */
+        handle_template_expired_reply(pTemplate);
+    }
+    utils_completion_deinit(&reply->completion);
+}
+
 static void _reply_ack_cb(void *pClient, Method method, ReplyAck replyAck, const char *pReceivedJsonDocument,
                           void *pUserdata)
 {
@@ -199,14 +220,17 @@ static void _reply_ack_cb(void *pClient, Method method, ReplyAck replyAck, const
         Log_d("Received Json Document is NULL");
     }
 
-    *((ReplyAck *)(request->user_context)) = replyAck;
+    TemplateSyncReply *reply = (TemplateSyncReply *)request->user_context;
+    reply->ack               = replyAck;
+    utils_completion_signal(&reply->completion);
 }
 
 /*control data may be for get status replay*/
 static void _get_status_reply_ack_cb(void *pClient, Method method, ReplyAck replyAck, const char *pReceivedJsonDocument,
                                      void *pUserdata)
 {
-    Request *request = (Request *)pUserdata;
+    Request *          request = (Request *)pUserdata;
+    TemplateSyncReply *reply   = (TemplateSyncReply *)request->user_context;
 
     Log_d("replyAck=%d", replyAck);
     if (NULL == pReceivedJsonDocument) {
@@ -215,11 +239,13 @@ static void _get_status_reply_ack_cb(void *pClient, Method method, ReplyAck repl
         Log_d("Received Json Document=%s", pReceivedJsonDocument);
     }
 
-    if (*((ReplyAck *)request->user_context) == ACK_ACCEPTED) {
+    // ack is set ahead when the reply carries control, which is cleared then
+    if (reply->ack == ACK_ACCEPTED) {
         IOT_Template_ClearControl(pClient, request->client_token, NULL, QCLOUD_IOT_MQTT_COMMAND_TIMEOUT);
     } else {
-        *((ReplyAck *)request->user_context) = replyAck;
+        reply->ack = replyAck;
     }
+    utils_completion_signal(&reply->completion);
 }
 
 static int _template_ConstructControlReply(char *jsonBuffer, size_t sizeOfBuffer, sReplyPara *replyPara)
@@ -319,6 +345,25 @@ static int _template_check_subscribe(Qcloud_IoT_Template *pTemplate, int packet_
     return QCLOUD_ERR_MQTT_SUB;
 }
 
+/* write "params":{...} of report array */
+static int _write_report_array_params(JsonWriter *writer, uint8_t count, DeviceProperty *pDeviceProperties[])
+{
+    int i;
+
+    json_writer_key(writer, CMD_CONTROL_PARA);
+    json_writer_object_begin(writer);
+    for (i = 0; i < count; i++) {
+        DeviceProperty *pJsonNode = pDeviceProperties[i];
+        if (!pJsonNode || !pJsonNode->key) {
+            return QCLOUD_ERR_INVAL;
+        }
+        write_json_node(writer, pJsonNode);
+    }
+    json_writer_object_end(writer);
+
+    return writer->err;
+}
+
 int IOT_Template_JSON_ConstructReportArray(void *pClient, char *jsonBuffer, size_t sizeOfBuffer, uint8_t count,
                                            DeviceProperty *pDeviceProperties[])
 {
@@ -328,46 +373,37 @@ int IOT_Template_JSON_ConstructReportArray(void *pClient, char *jsonBuffer, size
     Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
     POINTER_SANITY_CHECK(pTemplate, QCLOUD_ERR_INVAL);
 
-    size_t  remain_size    = 0;
-    int32_t rc_of_snprintf = 0;
-    int     rc;
-    int8_t  i;
-
-    build_empty_json(&(pTemplate->inner_data.token_num), jsonBuffer, pTemplate->device_info.product_id);
-    if ((ssize_t)(remain_size = sizeOfBuffer - strlen(jsonBuffer)) <= 1) {
-        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
-    }
-
-    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer) - 1, remain_size, ", \"params\":{");  //! json格式
-    rc             = check_snprintf_return(rc_of_snprintf, remain_size);
+    JsonWriter writer;
+    int        rc;
 
+    json_writer_init(&writer, jsonBuffer, sizeOfBuffer);
+    json_writer_object_begin(&writer);
+    template_write_client_token(&writer, &(pTemplate->inner_data.token_num), pTemplate->device_info.product_id);
+    rc = _write_report_array_params(&writer, count, pDeviceProperties);
     if (rc != QCLOUD_RET_SUCCESS) {
         return rc;
     }
+    json_writer_object_end(&writer);
 
-    for (i = 0; i < count; i++) {
-        DeviceProperty *pJsonNode = pDeviceProperties[i];
-        if (!pJsonNode || !pJsonNode->key) {
-            return QCLOUD_ERR_INVAL;
-        }
-        rc = put_json_node(jsonBuffer, remain_size, pJsonNode);
-
-        if (rc != QCLOUD_RET_SUCCESS) {
-            return rc;
-        }
+    rc = json_writer_finish(&writer);
+    if (rc < 0) {
+        Log_e("construct datatemplate report array failed: %d", rc);
+        return rc;
     }
 
-    if ((ssize_t)(remain_size = sizeOfBuffer - strlen(jsonBuffer)) <= 1) {
-        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
-    }
-    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer) - 1, remain_size, "}}");
-    rc             = check_snprintf_return(rc_of_snprintf, remain_size);
+    return QCLOUD_RET_SUCCESS;
+}
 
-    if (rc != QCLOUD_RET_SUCCESS) {
-        Log_e("construct datatemplate report array failed: %d", rc);
-    }
+typedef struct {
+    uint8_t          count;
+    DeviceProperty **pDeviceProperties;
+} ReportArrayContext;
 
-    return rc;
+static int _write_report_array(JsonWriter *writer, void *ctx)
+{
+    ReportArrayContext *report = (ReportArrayContext *)ctx;
+
+    return _write_report_array_params(writer, report->count, report->pDeviceProperties);
 }
 
 int IOT_Template_ClearControl(void *pClient, char *pClientToken, OnReplyCallback callback, uint32_t timeout_ms)
@@ -458,27 +494,61 @@ int IOT_Template_Report_Sync(void *pClient, char *pJsonDoc, size_t sizeOfBuffer,
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_NO_CONN);
     }
 
-    ReplyAck ack_report = ACK_NONE;
-    rc                  = IOT_Template_Report(pClient, pJsonDoc, sizeOfBuffer, _reply_ack_cb, &ack_report, timeout_ms);
-    if (rc != QCLOUD_RET_SUCCESS)
+    TemplateSyncReply reply = {ACK_NONE};
+    utils_completion_init(&reply.completion);
+    rc = IOT_Template_Report(pClient, pJsonDoc, sizeOfBuffer, _reply_ack_cb, &reply, timeout_ms);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        utils_completion_deinit(&reply.completion);
         IOT_FUNC_EXIT_RC(rc);
-    while (ACK_NONE == ack_report) {
-        IOT_Template_Yield(pClient, 200);
     }
+    _template_sync_wait(template, &reply);
 
-    if (ACK_ACCEPTED == ack_report) {
+    if (ACK_ACCEPTED == reply.ack) {
         IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
     }
-    if (ACK_TIMEOUT == ack_report) {
+    if (ACK_TIMEOUT == reply.ack) {
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_REPORT_TIMEOUT);
     }
-    if (ACK_REJECTED == ack_report) {
+    if (ACK_REJECTED == reply.ack) {
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_REPORT_REJECTED);
     }
 
     IOT_FUNC_EXIT_RC(rc);
 }
 
+int IOT_Template_Report_Array(void *pClient, uint8_t count, DeviceProperty *pDeviceProperties[],
+                              OnReplyCallback callback, void *userContext, uint32_t timeout_ms)
+{
+    IOT_FUNC_ENTRY;
+    int rc;
+
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pDeviceProperties, QCLOUD_ERR_INVAL);
+    NUMBERIC_SANITY_CHECK(timeout_ms, QCLOUD_ERR_INVAL);
+
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
+
+    if (IOT_MQTT_IsConnected(pTemplate->mqtt) == false) {
+        Log_e("template is disconnected");
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_NO_CONN);
+    }
+
+    // if topic $thing/down/property subscribe not success before, subsrcibe again
+    if (pTemplate->inner_data.sync_status < 0) {
+        rc = subscribe_template_downstream_topic(pTemplate);
+        if (rc < 0) {
+            Log_e("Subcribe $thing/down/property fail!");
+        }
+    }
+
+    ReportArrayContext report         = {count, pDeviceProperties};
+    RequestParams      request_params = DEFAULT_REQUEST_PARAMS;
+    _init_request_params(&request_params, REPORT, callback, userContext, timeout_ms / 1000);
+
+    rc = send_template_request_by_writer(pTemplate, &request_params, _write_report_array, &report);
+    IOT_FUNC_EXIT_RC(rc);
+}
+
 int IOT_Template_JSON_ConstructSysInfo(void *pClient, char *jsonBuffer, size_t sizeOfBuffer, DeviceProperty *pPlatInfo,
                                        DeviceProperty *pSelfInfo)
 {
@@ -488,79 +558,41 @@ int IOT_Template_JSON_ConstructSysInfo(void *pClient, char *jsonBuffer, size_t s
     Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
     POINTER_SANITY_CHECK(pTemplate, QCLOUD_ERR_INVAL);
 
-    size_t  remain_size    = 0;
-    int32_t rc_of_snprintf = 0;
-    int     rc;
-
-    build_empty_json(&(pTemplate->inner_data.token_num), jsonBuffer, pTemplate->device_info.product_id);
-    if ((ssize_t)(remain_size = sizeOfBuffer - strlen(jsonBuffer)) <= 1) {
-        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
-    }
-
-    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer) - 1, remain_size, ", \"params\":{");
-    rc             = check_snprintf_return(rc_of_snprintf, remain_size);
+    JsonWriter      writer;
+    DeviceProperty *pJsonNode;
+    int             rc;
 
-    if (rc != QCLOUD_RET_SUCCESS) {
-        return rc;
-    }
+    json_writer_init(&writer, jsonBuffer, sizeOfBuffer);
+    json_writer_object_begin(&writer);
+    template_write_client_token(&writer, &(pTemplate->inner_data.token_num), pTemplate->device_info.product_id);
+    json_writer_key(&writer, CMD_CONTROL_PARA);
+    json_writer_object_begin(&writer);
 
-    DeviceProperty *pJsonNode = pPlatInfo;
+    pJsonNode = pPlatInfo;
     while ((NULL != pJsonNode) && (NULL != pJsonNode->key)) {
-        rc = put_json_node(jsonBuffer, remain_size, pJsonNode);
-        if (rc != QCLOUD_RET_SUCCESS) {
-            return rc;
-        }
+        write_json_node(&writer, pJsonNode);
         pJsonNode++;
     }
 
-    if ((ssize_t)(remain_size = sizeOfBuffer - strlen(jsonBuffer)) <= 1) {
-        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
-    }
-    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer) - 1, remain_size, "},");
-    rc             = check_snprintf_return(rc_of_snprintf, remain_size);
-
-    if (rc != QCLOUD_RET_SUCCESS) {
-        return rc;
-    }
-
-    if ((ssize_t)(remain_size = sizeOfBuffer - strlen(jsonBuffer)) <= 1) {
-        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
-    }
-
     pJsonNode = pSelfInfo;
     if ((NULL == pJsonNode) || (NULL == pJsonNode->key)) {
         Log_d("No self define info");
-        goto end;
-    }
-    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer) - 2, remain_size, ", \"device_label\":{");
-    rc             = check_snprintf_return(rc_of_snprintf, remain_size);
-
-    if (rc != QCLOUD_RET_SUCCESS) {
-        return rc;
-    }
-
-    while ((NULL != pJsonNode) && (NULL != pJsonNode->key)) {
-        rc = put_json_node(jsonBuffer, remain_size, pJsonNode);
-        if (rc != QCLOUD_RET_SUCCESS) {
-            return rc;
+    } else {
+        json_writer_key(&writer, "device_label");
+        json_writer_object_begin(&writer);
+        while ((NULL != pJsonNode) && (NULL != pJsonNode->key)) {
+            write_json_node(&writer, pJsonNode);
+            pJsonNode++;
         }
-        pJsonNode++;
+        json_writer_object_end(&writer);
     }
 
-    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer) - 1, remain_size, "}},");
-    rc             = check_snprintf_return(rc_of_snprintf, remain_size);
-    if (rc != QCLOUD_RET_SUCCESS) {
-        return rc;
-    }
+    json_writer_object_end(&writer);
+    json_writer_object_end(&writer);
 
-end:
-    if ((ssize_t)(remain_size = sizeOfBuffer - strlen(jsonBuffer)) <= 1) {
-        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
-    }
-    rc_of_snprintf = HAL_Snprintf(jsonBuffer + strlen(jsonBuffer) - 1, remain_size, "}");
-    rc             = check_snprintf_return(rc_of_snprintf, remain_size);
+    rc = json_writer_finish(&writer);
 
-    return rc;
+    return (rc < 0) ? rc : QCLOUD_RET_SUCCESS;
 }
 
 int IOT_Template_Report_SysInfo(void *pClient, char *pJsonDoc, size_t sizeOfBuffer, OnReplyCallback callback,
@@ -613,20 +645,21 @@ int IOT_Template_Report_SysInfo_Sync(void *pClient, char *pJsonDoc, size_t sizeO
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_NO_CONN);
     }
 
-    ReplyAck ack_report = ACK_NONE;
-    rc = IOT_Template_Report_SysInfo(pClient, pJsonDoc, sizeOfBuffer, _reply_ack_cb, &ack_report, timeout_ms);
+    TemplateSyncReply reply = {ACK_NONE};
+    utils_completion_init(&reply.completion);
+    rc = IOT_Template_Report_SysInfo(pClient, pJsonDoc, sizeOfBuffer, _reply_ack_cb, &reply, timeout_ms);
 
-    if (rc != QCLOUD_RET_SUCCESS)
+    if (rc != QCLOUD_RET_SUCCESS) {
+        utils_completion_deinit(&reply.completion);
         IOT_FUNC_EXIT_RC(rc);
-    while (ACK_NONE == ack_report) {
-        IOT_Template_Yield(pClient, 200);
     }
+    _template_sync_wait(template, &reply);
 
-    if (ACK_ACCEPTED == ack_report) {
+    if (ACK_ACCEPTED == reply.ack) {
         rc = QCLOUD_RET_SUCCESS;
-    } else if (ACK_TIMEOUT == ack_report) {
+    } else if (ACK_TIMEOUT == reply.ack) {
         rc = QCLOUD_ERR_REPORT_TIMEOUT;
-    } else if (ACK_REJECTED == ack_report) {
+    } else if (ACK_REJECTED == reply.ack) {
         rc = QCLOUD_ERR_REPORT_REJECTED;
     }
 
@@ -682,19 +715,20 @@ int IOT_Template_GetStatus_sync(void *pClient, uint32_t timeout_ms)
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_NO_CONN);
     }
 
-    ReplyAck ack_request = ACK_NONE;
-    rc                   = IOT_Template_GetStatus(pClient, _get_status_reply_ack_cb, &ack_request, timeout_ms);
-    if (rc != QCLOUD_RET_SUCCESS)
+    TemplateSyncReply reply = {ACK_NONE};
+    utils_completion_init(&reply.completion);
+    rc = IOT_Template_GetStatus(pClient, _get_status_reply_ack_cb, &reply, timeout_ms);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        utils_completion_deinit(&reply.completion);
         IOT_FUNC_EXIT_RC(rc);
-    while (ACK_NONE == ack_request) {
-        IOT_Template_Yield(pClient, 200);
     }
+    _template_sync_wait(pTemplate, &reply);
 
-    if (ACK_ACCEPTED == ack_request) {
+    if (ACK_ACCEPTED == reply.ack) {
         rc = QCLOUD_RET_SUCCESS;
-    } else if (ACK_TIMEOUT == ack_request) {
+    } else if (ACK_TIMEOUT == reply.ack) {
         rc = QCLOUD_ERR_GET_TIMEOUT;
-    } else if (ACK_REJECTED == ack_request) {
+    } else if (ACK_REJECTED == reply.ack) {
         rc = QCLOUD_ERR_GET_REJECTED;
     }
 
@@ -782,6 +816,12 @@ int IOT_Template_Destroy_Except_MQTT(void *pClient)
     POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
 
     Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
+#ifdef LAN_CONTROL_ENABLED
+    IOT_Template_LanControl_Stop(pTemplate);
+#endif
+#ifdef STATE_SNAPSHOT_ENABLED
+    IOT_Template_Snapshot_Stop(pTemplate);
+#endif
     qcloud_iot_template_reset(pClient);
 
     if (NULL != pTemplate->DataTemplateDestroyCb) {
@@ -856,6 +896,13 @@ void *IOT_Template_Construct(TemplateInitParams *pParams, void *pMqttClient)
         goto End;
     }
 
+#ifndef AUTH_MODE_CERT
+    // the MQTT client keeps only the decoded psk, keys derived from the secret are taken from here
+    if (pParams->device_secret) {
+        strncpy(pTemplate->device_info.device_secret, pParams->device_secret, MAX_SIZE_OF_DEVICE_SECRET);
+    }
+#endif
+
     void *mqtt_client = NULL;
     if (NULL == pMqttClient) {
         if ((mqtt_client = IOT_MQTT_Construct(&mqtt_init_params)) == NULL) {
@@ -869,6 +916,12 @@ void *IOT_Template_Construct(TemplateInitParams *pParams, void *pMqttClient)
 #ifdef MULTITHREAD_ENABLED
     pTemplate->yield_thread_running = false;
 #endif
+#ifdef LAN_CONTROL_ENABLED
+    pTemplate->lan_control = NULL;
+#endif
+#ifdef STATE_SNAPSHOT_ENABLED
+    pTemplate->snapshot = NULL;
+#endif
 
     pTemplate->mqtt                        = mqtt_client;
     pTemplate->event_handle                = pParams->event_handle;
@@ -935,6 +988,12 @@ int IOT_Template_Destroy(void *pClient)
     POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
 
     Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
+#ifdef LAN_CONTROL_ENABLED
+    IOT_Template_LanControl_Stop(pTemplate);
+#endif
+#ifdef STATE_SNAPSHOT_ENABLED
+    IOT_Template_Snapshot_Stop(pTemplate);
+#endif
     qcloud_iot_template_reset(pTemplate);
     IOT_MQTT_Destroy(&pTemplate->mqtt);
 
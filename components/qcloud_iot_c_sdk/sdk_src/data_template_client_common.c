@@ -24,15 +24,81 @@ extern "C" {
 
 #include "data_template_client_common.h"
 
+#include <string.h>
+
 #include "qcloud_iot_import.h"
 
+static const char *_get_property_handle_key(void *val)
+{
+    DeviceProperty *pProperty = (DeviceProperty *)((PropertyHandler *)val)->property;
+
+    return pProperty ? pProperty->key : NULL;
+}
+
+/**
+ * @brief index property_handle_list into slot_num slots, the slots are reused
+ * when their number does not change, called with mutex held
+ */
+static int _rebuild_property_index(Qcloud_IoT_Template *pTemplate, uint16_t slot_num)
+{
+    IOT_FUNC_ENTRY;
+
+    HashIndex *index = &pTemplate->inner_data.property_index;
+    void **    slots = index->slots;
+    ListNode * node;
+
+    if (NULL == slots || slot_num != index->mask + 1) {
+        slots = (void **)HAL_Malloc(slot_num * sizeof(void *));
+        if (NULL == slots) {
+            Log_e("malloc %u property index slots failed", slot_num);
+            IOT_FUNC_EXIT_RC(QCLOUD_ERR_MALLOC);
+        }
+        HAL_Free(index->slots);
+    }
+
+    hash_index_init(index, slots, slot_num, _get_property_handle_key);
+    for (node = pTemplate->inner_data.property_handle_list->head; node; node = node->next) {
+        if (node->val && hash_index_add(index, node->val) != QCLOUD_RET_SUCCESS) {
+            Log_e("property %s not indexed", STRING_PTR_PRINT_SANITY_CHECK(_get_property_handle_key(node->val)));
+        }
+    }
+
+    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+}
+
 /**
- * @brief add registered propery's call back to data_template handle list
+ * @brief add a property to the index, which grows to twice its slots when it
+ * would pass half load, called with mutex held
+ */
+static int _index_property(Qcloud_IoT_Template *pTemplate, PropertyHandler *property_handle)
+{
+    HashIndex *index = &pTemplate->inner_data.property_index;
+    int        rc;
+
+    if (NULL == index->slots || (index->count + 1) * 2 > index->mask + 1) {
+        rc = _rebuild_property_index(pTemplate, hash_index_slot_num(index->count + 1));
+        if (rc != QCLOUD_RET_SUCCESS) {
+            return rc;
+        }
+    }
+
+    rc = hash_index_add(index, property_handle);
+    if (rc == QCLOUD_ERR_INVAL) {
+        return QCLOUD_ERR_PROPERTY_EXIST;
+    }
+
+    return rc;
+}
+
+/**
+ * @brief add registered propery's call back to data_template handle list, the
+ * property is left out of the list if it can't be indexed
  */
 static int _add_property_handle_to_template_list(Qcloud_IoT_Template *pTemplate, DeviceProperty *pProperty,
                                                  OnPropRegCallback callback)
 {
     IOT_FUNC_ENTRY;
+    int rc;
 
     PropertyHandler *property_handle = (PropertyHandler *)HAL_Malloc(sizeof(PropertyHandler));
     if (NULL == property_handle) {
@@ -42,10 +108,23 @@ static int _add_property_handle_to_template_list(Qcloud_IoT_Template *pTemplate,
 
     property_handle->callback = callback;
     property_handle->property = pProperty;
+#ifdef STATE_SNAPSHOT_ENABLED
+    property_handle->snapshot_hash = 0;
+#endif
+
+    rc = _index_property(pTemplate, property_handle);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        Log_e("index property %s failed: %d", pProperty->key, rc);
+        HAL_Free(property_handle);
+        IOT_FUNC_EXIT_RC(rc);
+    }
 
     ListNode *node = list_node_new(property_handle);
     if (NULL == node) {
         Log_e("run list_node_new is error!");
+        // the index is rebuilt in place from the list, which has no room to run out of
+        _rebuild_property_index(pTemplate, pTemplate->inner_data.property_index.mask + 1);
+        HAL_Free(property_handle);
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
     }
     qcloud_list_rpush(pTemplate->inner_data.property_handle_list, node);
@@ -53,29 +132,49 @@ static int _add_property_handle_to_template_list(Qcloud_IoT_Template *pTemplate,
     IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
 }
 
+PropertyHandler *template_common_find_property(Qcloud_IoT_Template *pTemplate, const char *key, size_t key_len)
+{
+    return (PropertyHandler *)hash_index_find(&pTemplate->inner_data.property_index, key, key_len);
+}
+
 int template_common_check_property_existence(Qcloud_IoT_Template *ptemplate, DeviceProperty *pProperty)
 {
-    ListNode *node;
+    PropertyHandler *property_handle;
+
+    if (NULL == pProperty || NULL == pProperty->key) {
+        return 0;
+    }
 
     HAL_MutexLock(ptemplate->mutex);
-    node = qcloud_list_find(ptemplate->inner_data.property_handle_list, pProperty);
+    property_handle = template_common_find_property(ptemplate, pProperty->key, strlen(pProperty->key));
     HAL_MutexUnlock(ptemplate->mutex);
 
-    return (NULL != node);
+    return (NULL != property_handle);
 }
 
 int template_common_remove_property(Qcloud_IoT_Template *ptemplate, DeviceProperty *pProperty)
 {
     int rc = QCLOUD_RET_SUCCESS;
 
-    ListNode *node;
+    PropertyHandler *property_handle;
+    ListNode *       node = NULL;
+
+    if (NULL == pProperty || NULL == pProperty->key) {
+        return QCLOUD_ERR_INVAL;
+    }
+
     HAL_MutexLock(ptemplate->mutex);
-    node = qcloud_list_find(ptemplate->inner_data.property_handle_list, pProperty);
+    property_handle = template_common_find_property(ptemplate, pProperty->key, strlen(pProperty->key));
+    if (property_handle && property_handle->property == pProperty) {
+        node = qcloud_list_find(ptemplate->inner_data.property_handle_list, property_handle);
+    }
     if (NULL == node) {
         rc = QCLOUD_ERR_NOT_PROPERTY_EXIST;
         Log_e("Try to remove a non-existent property.");
     } else {
+        // rebuilt in place, removing never allocates
         qcloud_list_remove(ptemplate->inner_data.property_handle_list, node);
+        rc = _rebuild_property_index(ptemplate, ptemplate->inner_data.property_index.mask + 1);
     }
     HAL_MutexUnlock(ptemplate->mutex);
 
@@ -101,6 +200,12 @@ int template_common_register_property_on_delta(Qcloud_IoT_Template *pTemplate, D
     IOT_FUNC_EXIT_RC(rc);
 }
 
+void template_common_clear_property_index(Qcloud_IoT_Template *pTemplate)
+{
+    HAL_Free(pTemplate->inner_data.property_index.slots);
+    memset(&pTemplate->inner_data.property_index, 0, sizeof(HashIndex));
+}
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -24,7 +24,6 @@ extern "C" {
 
 #include "data_template_client_json.h"
 
-#include <inttypes.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -45,67 +44,53 @@ int check_snprintf_return(int32_t returnCode, size_t maxSizeOfWrite)
     return QCLOUD_RET_SUCCESS;
 }
 
-void insert_str(char *pDestStr, char *pSourceStr, int pos)
-{
-    int len  = strlen(pDestStr);
-    int nlen = strlen(pSourceStr);
-    int i;
-    for (i = len - 1; i >= pos; --i) {
-        *(pDestStr + i + nlen) = *(pDestStr + i);
-    }
-
-    int n;
-    for (n = 0; n < nlen; n++) *(pDestStr + pos + n) = *pSourceStr++;
-    *(pDestStr + len + nlen) = 0;
-}
-
-static int _direct_update_value(char *value, DeviceProperty *pProperty)
+static int _direct_update_value(const json_span_t *value, DeviceProperty *pProperty)
 {
     int      rc    = QCLOUD_RET_SUCCESS;
     uint16_t index = 0;
 
     switch (pProperty->type) {
         case JBOOL:
-            rc = LITE_get_boolean(pProperty->data, value);
+            rc = LITE_span_get_boolean(pProperty->data, value);
             break;
         case JINT32:
-            rc = LITE_get_int32(pProperty->data, value);
+            rc = LITE_span_get_int32(pProperty->data, value);
             break;
         case JINT16:
-            rc = LITE_get_int16(pProperty->data, value);
+            rc = LITE_span_get_int16(pProperty->data, value);
             break;
         case JINT8:
-            rc = LITE_get_int8(pProperty->data, value);
+            rc = LITE_span_get_int8(pProperty->data, value);
             break;
         case JUINT32:
-            rc = LITE_get_uint32(pProperty->data, value);
+            rc = LITE_span_get_uint32(pProperty->data, value);
             break;
         case JUINT16:
-            rc = LITE_get_uint16(pProperty->data, value);
+            rc = LITE_span_get_uint16(pProperty->data, value);
             break;
         case JUINT8:
-            rc = LITE_get_uint8(pProperty->data, value);
+            rc = LITE_span_get_uint8(pProperty->data, value);
             break;
         case JFLOAT:
-            rc = LITE_get_float(pProperty->data, value);
+            rc = LITE_span_get_float(pProperty->data, value);
             break;
         case JDOUBLE:
-            rc = LITE_get_double(pProperty->data, value);
+            rc = LITE_span_get_double(pProperty->data, value);
             break;
         case JSTRING:
             Log_d("property data_buff_len %d", pProperty->data_buff_len);
-            rc = LITE_get_string(pProperty->data, value, pProperty->data_buff_len);
+            rc = LITE_span_get_string(pProperty->data, value, pProperty->data_buff_len + 1);
             break;
         case JOBJECT:
             for (index = 0; index < pProperty->struct_obj_num; index++) {
                 DeviceProperty *pJsonNode = &((((sDataPoint *)(pProperty->data)) + index)->data_property);
                 if ((pJsonNode != NULL) && (pJsonNode->key != NULL)) {
-                    update_value_if_key_match(value, pJsonNode);
+                    update_value_if_key_match(value->ptr, value->len, pJsonNode);
                 }
             }
             break;
         case JARRAY:
-            rc = LITE_get_string(pProperty->data, value, pProperty->data_buff_len);
+            rc = LITE_span_get_string(pProperty->data, value, pProperty->data_buff_len + 1);
             break;
         default:
             Log_e("Unknown type %d", pProperty->type);
@@ -115,180 +100,167 @@ static int _direct_update_value(char *value, DeviceProperty *pProperty)
     return rc;
 }
 
-static int _format_json_buffer(char *jsonBuffer, size_t remain_size, int type, void *pData)
+static void _write_json_number(JsonWriter *writer, int type, void *pData)
 {
-    int rc_of_snprintf = -1;
     switch (type) {
         case JINT32:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer, remain_size, "%" PRIi32 ",", *(int32_t *)(pData));
+            json_writer_int(writer, *(int32_t *)(pData));
             break;
         case JINT16:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer, remain_size, "%" PRIi16 ",", *(int16_t *)(pData));
+            json_writer_int(writer, *(int16_t *)(pData));
             break;
         case JINT8:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer, remain_size, "%" PRIi8 ",", *(int8_t *)(pData));
+            json_writer_int(writer, *(int8_t *)(pData));
             break;
         case JUINT32:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer, remain_size, "%" PRIu32 ",", *(uint32_t *)(pData));
+            json_writer_uint(writer, *(uint32_t *)(pData));
             break;
         case JUINT16:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer, remain_size, "%" PRIu16 ",", *(uint16_t *)(pData));
+            json_writer_uint(writer, *(uint16_t *)(pData));
             break;
         case JUINT8:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer, remain_size, "%" PRIu8 ",", *(uint8_t *)(pData));
+            json_writer_uint(writer, *(uint8_t *)(pData));
             break;
         case JDOUBLE:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer, remain_size, "%f,", *(double *)(pData));
+            json_writer_double(writer, *(double *)(pData));
             break;
         case JFLOAT:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer, remain_size, "%f,", *(float *)(pData));
-            break;
-        case JSTRING:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer, remain_size, "\"%s\",", (char *)(pData));
+            json_writer_double(writer, *(float *)(pData));
             break;
         default:
             Log_e("Shouldnt reach here");
+            json_writer_null(writer);
             break;
     }
-
-    return rc_of_snprintf;
 }
 
-int put_json_node(char *jsonBuffer, size_t sizeOfBuffer, DeviceProperty *pJsonNode)
+int write_json_node(JsonWriter *writer, DeviceProperty *pJsonNode)
 {
-    int          rc;
-    int32_t      rc_of_snprintf = 0;
-    size_t       remain_size    = 0;
-    size_t       current_size   = 0;
-    char *       pKey           = pJsonNode->key;
-    void *       pData          = pJsonNode->data;
-    JsonDataType type           = pJsonNode->type;
-
-    current_size = strlen(jsonBuffer);
-    if ((ssize_t)(remain_size = sizeOfBuffer - current_size) <= 1) {
-        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
-    }
-
-    rc_of_snprintf =
-        HAL_Snprintf(jsonBuffer + current_size, remain_size, "\"%s\":", STRING_PTR_PRINT_SANITY_CHECK(pKey));
-    rc = check_snprintf_return(rc_of_snprintf, remain_size);
-    if (rc != QCLOUD_RET_SUCCESS) {
-        return rc;
-    }
-    current_size += rc_of_snprintf;
-
-    if ((ssize_t)(remain_size = sizeOfBuffer - current_size) <= 1) {
-        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
-    }
+    uint16_t index;
+    void *   pData = pJsonNode->data;
 
+    json_writer_key(writer, STRING_PTR_PRINT_SANITY_CHECK(pJsonNode->key));
     if (pData == NULL) {
-        rc_of_snprintf = HAL_Snprintf(jsonBuffer + current_size, remain_size, "null,");
-        return check_snprintf_return(rc_of_snprintf, remain_size);
+        json_writer_null(writer);
+        return writer->err;
     }
 
-    if (type != JBOOL && type != JOBJECT && type != JARRAY) {
-        return check_snprintf_return(_format_json_buffer(jsonBuffer + current_size, remain_size, type, pData),
-                                     remain_size);
-    }
-
-    switch (type) {
+    switch (pJsonNode->type) {
         case JBOOL:
-            rc_of_snprintf =
-                HAL_Snprintf(jsonBuffer + current_size, remain_size, "%s,", *(bool *)(pData) ? "true" : "false");
+            json_writer_bool(writer, *(bool *)(pData));
+            break;
+        case JSTRING:
+            json_writer_string(writer, (char *)(pData));
             break;
         case JOBJECT:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer + current_size, remain_size, "{");
-            rc             = check_snprintf_return(rc_of_snprintf, remain_size);
-            if (rc != QCLOUD_RET_SUCCESS) {
-                return rc;
-            }
-            current_size += rc_of_snprintf;
-            remain_size = sizeOfBuffer - current_size;
-            if ((ssize_t)remain_size <= 1) {
-                return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
-            }
-            uint16_t index = 0;
-
+            json_writer_object_begin(writer);
             for (index = 0; index < pJsonNode->struct_obj_num; index++) {
-                DeviceProperty *pNode = &((((sDataPoint *)(pJsonNode->data)) + index)->data_property);
+                DeviceProperty *pNode = &((((sDataPoint *)(pData)) + index)->data_property);
                 if ((pNode != NULL) && (pNode->key) != NULL) {
-                    rc = put_json_node(jsonBuffer + current_size, remain_size, pNode);
-                    if (rc != QCLOUD_RET_SUCCESS) {
-                        return rc;
-                    }
-                    current_size = strlen(jsonBuffer);
-                    remain_size  = sizeOfBuffer - current_size;
-                    if ((ssize_t)remain_size <= 1) {
-                        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
-                    }
+                    write_json_node(writer, pNode);
                 }
             }
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer + current_size - 1, remain_size, "},");
+            json_writer_object_end(writer);
             break;
         case JARRAY:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer + current_size, remain_size, "%s,", (char *)(pData));
+            json_writer_raw_value(writer, (char *)(pData), strlen((char *)(pData)));
             break;
         default:
-            Log_e("Type %d is unknown", type);
+            _write_json_number(writer, pJsonNode->type, pData);
             break;
     }
 
-    rc = check_snprintf_return(rc_of_snprintf, remain_size);
+    return writer->err;
+}
 
-    return rc;
+int template_write_json_node(JsonWriter *writer, const char *pKey, void *pData, JsonDataType type)
+{
+    json_writer_key(writer, STRING_PTR_PRINT_SANITY_CHECK(pKey));
+    if (pData == NULL) {
+        json_writer_null(writer);
+        return writer->err;
+    }
+
+    switch (type) {
+        case JBOOL:
+            json_writer_uint(writer, *(bool *)(pData) ? 1 : 0);
+            break;
+        case JSTRING:
+        case JARRAY:
+            json_writer_string(writer, (char *)(pData));
+            break;
+        case JOBJECT:
+            json_writer_raw_value(writer, (char *)(pData), strlen((char *)(pData)));
+            break;
+        default:
+            _write_json_number(writer, type, pData);
+            break;
+    }
+
+    return writer->err;
 }
 
-int template_put_json_node(char *jsonBuffer, size_t sizeOfBuffer, const char *pKey, void *pData, JsonDataType type)
+/* start writing at the end of the '\0' terminated jsonBuffer */
+static int _append_writer_init(JsonWriter *writer, char *jsonBuffer, size_t sizeOfBuffer)
 {
-    int     rc;
-    int32_t rc_of_snprintf = 0;
-    size_t  current_size   = strlen(jsonBuffer);
-    size_t  remain_size    = sizeOfBuffer - current_size;
+    size_t current_size = strlen(jsonBuffer);
 
-    if ((ssize_t)remain_size <= 1) {
+    if (sizeOfBuffer <= current_size + 1) {
         return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
     }
 
-    rc_of_snprintf =
-        HAL_Snprintf(jsonBuffer + current_size, remain_size, "\"%s\":", STRING_PTR_PRINT_SANITY_CHECK(pKey));
-    rc = check_snprintf_return(rc_of_snprintf, remain_size);
-    if (rc != QCLOUD_RET_SUCCESS) {
+    json_writer_init(writer, jsonBuffer + current_size, sizeOfBuffer - current_size);
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* finish node with trailing ',', drop the partial node on failure */
+static int _append_writer_finish(JsonWriter *writer)
+{
+    json_writer_raw(writer, ",", 1);
+
+    int rc = json_writer_finish(writer);
+    if (rc < 0) {
+        writer->buf[0] = '\0';
         return rc;
     }
 
-    current_size += rc_of_snprintf;
-    if ((ssize_t)(remain_size = sizeOfBuffer - current_size) <= 1) {
-        return QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
-    }
+    return QCLOUD_RET_SUCCESS;
+}
 
-    if (pData == NULL) {
-        rc_of_snprintf = HAL_Snprintf(jsonBuffer + current_size, remain_size, "null,");
-        return check_snprintf_return(rc_of_snprintf, remain_size);
-    }
+int put_json_node(char *jsonBuffer, size_t sizeOfBuffer, DeviceProperty *pJsonNode)
+{
+    JsonWriter writer;
 
-    if (type != JBOOL && type != JOBJECT && type != JARRAY) {
-        return check_snprintf_return(_format_json_buffer(jsonBuffer + current_size, remain_size, type, pData),
-                                     remain_size);
+    int rc = _append_writer_init(&writer, jsonBuffer, sizeOfBuffer);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        return rc;
     }
 
-    switch (type) {
-        case JBOOL:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer + current_size, remain_size, "%u,", *(bool *)(pData) ? 1 : 0);
-            break;
-        case JOBJECT:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer + current_size, remain_size, "%s,", (char *)(pData));
-            break;
-        case JARRAY:
-            rc_of_snprintf = HAL_Snprintf(jsonBuffer + current_size, remain_size, "\"%s\",", (char *)(pData));
-            break;
-        default:
-            Log_e("Unknown type %d", type);
-            break;
+    write_json_node(&writer, pJsonNode);
+    return _append_writer_finish(&writer);
+}
+
+int template_put_json_node(char *jsonBuffer, size_t sizeOfBuffer, const char *pKey, void *pData, JsonDataType type)
+{
+    JsonWriter writer;
+
+    int rc = _append_writer_init(&writer, jsonBuffer, sizeOfBuffer);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        return rc;
     }
 
-    rc = check_snprintf_return(rc_of_snprintf, remain_size);
+    template_write_json_node(&writer, pKey, pData, type);
+    return _append_writer_finish(&writer);
+}
+
+void template_write_client_token(JsonWriter *writer, uint32_t *tokenNumber, const char *tokenPrefix)
+{
+    char client_token[MAX_SIZE_OF_CLIENT_TOKEN];
 
-    return rc;
+    HAL_Snprintf(client_token, sizeof(client_token), "%s-%u", STRING_PTR_PRINT_SANITY_CHECK(tokenPrefix),
+                 (*tokenNumber)++);
+    json_writer_key(writer, CLIENT_TOKEN_FIELD);
+    json_writer_string(writer, client_token);
 }
 
 void build_empty_json(uint32_t *tokenNumber, char *pJsonBuffer, char *tokenPrefix)
@@ -297,101 +269,156 @@ void build_empty_json(uint32_t *tokenNumber, char *pJsonBuffer, char *tokenPrefi
                  STRING_PTR_PRINT_SANITY_CHECK(tokenPrefix), (*tokenNumber)++);
 }
 
-bool parse_client_token(char *pJsonDoc, char **pClientToken)
+static bool _parse_str_field(const char *key, char *pJsonDoc, char *buf, size_t buf_len)
+{
+    json_span_t value;
+
+    if (LITE_json_span_of(key, pJsonDoc, strlen(pJsonDoc), &value) || value.type != JSSTRING) {
+        return false;
+    }
+
+    return LITE_span_get_string(buf, &value, buf_len) == QCLOUD_RET_SUCCESS;
+}
+
+bool parse_client_token(char *pJsonDoc, char *pClientToken, size_t buf_len)
 {
-    *pClientToken = LITE_json_value_of(CLIENT_TOKEN_FIELD, pJsonDoc);
-    return *pClientToken == NULL ? false : true;
+    return _parse_str_field(CLIENT_TOKEN_FIELD, pJsonDoc, pClientToken, buf_len);
+}
+
+uint32_t client_token_key(const char *pClientToken, const char *tokenPrefix)
+{
+    size_t      prefix_len = strlen(tokenPrefix);
+    const char *p          = pClientToken + prefix_len + 1;
+    uint32_t    key        = 0;
+
+    if (!strncmp(pClientToken, tokenPrefix, prefix_len) && pClientToken[prefix_len] == '-' && *p) {
+        while (*p >= '0' && *p <= '9') {
+            key = key * 10 + (*p++ - '0');
+        }
+        if (!*p) {
+            return key & 0x7FFFFFFF;
+        }
+    }
+
+    // FNV-1a of a token not written by the SDK, kept apart from the numbered ones
+    key = 2166136261u;
+    for (p = pClientToken; *p; p++) {
+        key = (key ^ (uint8_t)*p) * 16777619u;
+    }
+
+    return key | 0x80000000;
 }
 
-bool parse_action_id(char *pJsonDoc, char **pActionID)
+bool parse_action_id(char *pJsonDoc, char *pActionID, size_t buf_len)
 {
-    *pActionID = LITE_json_value_of(ACTION_ID_FIELD, pJsonDoc);
-    return *pActionID == NULL ? false : true;
+    return _parse_str_field(ACTION_ID_FIELD, pJsonDoc, pActionID, buf_len);
 }
 
 bool parse_time_stamp(char *pJsonDoc, int32_t *pTimestamp)
 {
-    bool ret = false;
+    json_span_t timestamp;
 
-    char *timestamp = LITE_json_value_of(TIME_STAMP_FIELD, pJsonDoc);
-    if (timestamp == NULL)
+    if (LITE_json_span_of(TIME_STAMP_FIELD, pJsonDoc, strlen(pJsonDoc), &timestamp))
         return false;
 
-    if (sscanf(timestamp, "%" SCNu32, pTimestamp) != 1) {
+    if (LITE_span_get_uint32((uint32_t *)pTimestamp, &timestamp) != QCLOUD_RET_SUCCESS) {
         Log_e("parse code failed, errCode: %d", QCLOUD_ERR_JSON_PARSE);
-    } else {
-        ret = true;
+        return false;
     }
 
-    HAL_Free(timestamp);
-
-    return ret;
+    return true;
 }
 
-bool parse_action_input(char *pJsonDoc, char **pActionInput)
+bool parse_action_input(char *pJsonDoc, json_span_t *pActionInput)
 {
-    *pActionInput = LITE_json_value_of(CMD_CONTROL_PARA, pJsonDoc);
-    return *pActionInput == NULL ? false : true;
+    return LITE_json_span_of(CMD_CONTROL_PARA, pJsonDoc, strlen(pJsonDoc), pActionInput) == QCLOUD_RET_SUCCESS &&
+           pActionInput->type == JSOBJECT;
 }
 
 bool parse_code_return(char *pJsonDoc, int32_t *pCode)
 {
-    bool ret = false;
+    json_span_t code;
 
-    char *code = LITE_json_value_of(REPLY_CODE, pJsonDoc);
-    if (code == NULL)
+    if (LITE_json_span_of(REPLY_CODE, pJsonDoc, strlen(pJsonDoc), &code))
         return false;
 
-    if (sscanf(code, "%" SCNi32, pCode) != 1) {
+    if (LITE_span_get_int32(pCode, &code) != QCLOUD_RET_SUCCESS) {
         Log_e("parse code failed, errCode: %d", QCLOUD_ERR_JSON_PARSE);
-    } else {
-        ret = true;
+        return false;
     }
 
-    HAL_Free(code);
+    return true;
+}
 
-    return ret;
+bool parse_status_return(char *pJsonDoc, char *pStatus, size_t buf_len)
+{
+    return _parse_str_field(REPLY_STATUS, pJsonDoc, pStatus, buf_len);
 }
 
-bool parse_status_return(char *pJsonDoc, char **pStatus)
+bool update_value_if_key_match(const char *pJsonDoc, size_t len, DeviceProperty *pProperty)
 {
-    *pStatus = LITE_json_value_of(REPLY_STATUS, pJsonDoc);
-    return *pStatus == NULL ? false : true;
+    json_span_t property_data;
+
+    if (LITE_json_span_of(pProperty->key, pJsonDoc, len, &property_data) || property_data.type == JSNULL) {
+        return false;
+    }
+
+    _direct_update_value(&property_data, pProperty);
+    return true;
 }
 
-bool update_value_if_key_match(char *pJsonDoc, DeviceProperty *pProperty)
+bool update_value_by_token(const JsonIndex *index, int val, DeviceProperty *pProperty)
 {
-    bool ret = false;
-
-    char *property_data = LITE_json_value_of(pProperty->key, pJsonDoc);
-    if ((property_data == NULL) || !(strncmp(property_data, "null", 4)) || !(strncmp(property_data, "NULL", 4))) {
-        ret = false;
-    } else {
-        _direct_update_value(property_data, pProperty);
-        ret = true;
+    uint16_t    index_of_struct;
+    json_span_t value;
+
+    if (index->tokens[val].type == JSNULL) {
+        return false;
     }
 
-    HAL_Free(property_data);
+    if (pProperty->type == JOBJECT) {
+        if (index->tokens[val].type != JSOBJECT) {
+            return false;
+        }
+        for (index_of_struct = 0; index_of_struct < pProperty->struct_obj_num; index_of_struct++) {
+            DeviceProperty *pJsonNode = &((((sDataPoint *)(pProperty->data)) + index_of_struct)->data_property);
+            if ((pJsonNode != NULL) && (pJsonNode->key != NULL)) {
+                update_value_by_index(index, val, pJsonNode);
+            }
+        }
+        return true;
+    }
+
+    value.ptr  = json_index_str(index, val);
+    value.len  = index->tokens[val].len;
+    value.type = index->tokens[val].type;
+    _direct_update_value(&value, pProperty);
+
+    return true;
+}
+
+bool update_value_by_index(const JsonIndex *index, int obj, DeviceProperty *pProperty)
+{
+    int val = json_index_find(index, obj, pProperty->key, strlen(pProperty->key));
 
-    return ret;
+    return (val < 0) ? false : update_value_by_token(index, val, pProperty);
 }
 
-bool parse_template_method_type(char *pJsonDoc, char **pMethod)
+bool parse_template_method_type(char *pJsonDoc, char *pMethod, size_t buf_len)
 {
-    *pMethod = LITE_json_value_of(METHOD_FIELD, pJsonDoc);
-    return *pMethod == NULL ? false : true;
+    return _parse_str_field(METHOD_FIELD, pJsonDoc, pMethod, buf_len);
 }
 
-bool parse_template_get_control(char *pJsonDoc, char **control)
+bool parse_template_get_control(char *pJsonDoc, json_span_t *control)
 {
-    *control = LITE_json_value_of(GET_CONTROL_PARA, pJsonDoc);
-    return *control == NULL ? false : true;
+    return LITE_json_span_of(GET_CONTROL_PARA, pJsonDoc, strlen(pJsonDoc), control) == QCLOUD_RET_SUCCESS &&
+           control->type == JSOBJECT;
 }
 
-bool parse_template_cmd_control(char *pJsonDoc, char **control)
+bool parse_template_cmd_control(char *pJsonDoc, json_span_t *control)
 {
-    *control = LITE_json_value_of(CMD_CONTROL_PARA, pJsonDoc);
-    return *control == NULL ? false : true;
+    return LITE_json_span_of(CMD_CONTROL_PARA, pJsonDoc, strlen(pJsonDoc), control) == QCLOUD_RET_SUCCESS &&
+           control->type == JSOBJECT;
 }
 
 #ifdef __cplusplus
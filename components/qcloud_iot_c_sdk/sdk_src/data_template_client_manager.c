@@ -28,17 +28,21 @@ extern "C" {
 #include <string.h>
 
 #include "data_template_client.h"
+#include "data_template_client_common.h"
 #include "data_template_client_json.h"
+#include "data_template_snapshot.h"
 #include "qcloud_iot_import.h"
 #include "utils_list.h"
 #include "utils_param_check.h"
-
-typedef void (*TraverseTemplateHandle)(Qcloud_IoT_Template *pTemplate, ListNode **node, List *list,
-                                       const char *pClientToken, const char *pType);
+#include "utils_request_table.h"
 
 static char sg_template_cloud_rcv_buf[CLOUD_IOT_JSON_RX_BUF_LEN];
 static char sg_template_clientToken[MAX_SIZE_OF_CLIENT_TOKEN];
 
+/* sg_template_cloud_rcv_buf is tokenized once and all fields are read from the index */
+static JsonToken sg_template_json_tokens[MAX_TEMPLATE_JSON_TOKENS];
+static JsonIndex sg_template_rcv_index;
+
 /**
  * @brief unsubsribe topic:  $thing/down/property/{ProductId}/{DeviceName}
  */
@@ -65,196 +69,166 @@ static int _unsubscribe_template_downstream_topic(Qcloud_IoT_Template *pTemplate
 }
 
 /**
- * @brief add request to data_template request wait for reply list
+ * @brief add request to reply_table to wait for its reply
  */
-static int _add_request_to_template_list(Qcloud_IoT_Template *pTemplate, const char *pClientToken,
-                                         RequestParams *pParams)
+static int _add_request_to_template_table(Qcloud_IoT_Template *pTemplate, const char *pClientToken,
+                                          RequestParams *pParams)
 {
     IOT_FUNC_ENTRY;
 
-    HAL_MutexLock(pTemplate->mutex);
-    if (pTemplate->inner_data.reply_list->len >= MAX_APPENDING_REQUEST_AT_ANY_GIVEN_TIME) {
-        HAL_MutexUnlock(pTemplate->mutex);
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MAX_APPENDING_REQUEST);
-    }
+    RequestEntry entry;
+    int          rc;
 
-    Request *request = (Request *)HAL_Malloc(sizeof(Request));
-    if (NULL == request) {
-        HAL_MutexUnlock(pTemplate->mutex);
-        Log_e("run memory malloc is error!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
-    }
-
-    request->callback = pParams->request_callback;
-    strncpy(request->client_token, pClientToken, MAX_SIZE_OF_CLIENT_TOKEN);
+    entry.token        = client_token_key(pClientToken, pTemplate->device_info.product_id);
+    entry.arg          = pParams->method;
+    entry.callback     = (void *)pParams->request_callback;
+    entry.user_context = pParams->user_context;
 
-    request->user_context = pParams->user_context;
-    request->method       = pParams->method;
+    HAL_MutexLock(pTemplate->mutex);
+    rc = request_table_add(&pTemplate->inner_data.reply_table, &entry, pParams->timeout_sec * 1000);
+    HAL_MutexUnlock(pTemplate->mutex);
 
-    InitTimer(&(request->timer));
-    countdown(&(request->timer), pParams->timeout_sec);
+    IOT_FUNC_EXIT_RC(rc);
+}
 
-    ListNode *node = list_node_new(request);
-    if (NULL == node) {
-        HAL_MutexUnlock(pTemplate->mutex);
-        Log_e("run list_node_new is error!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+static bool _wait_for_reply(Qcloud_IoT_Template *pTemplate, RequestParams *pParams)
+{
+#ifdef STATE_SNAPSHOT_ENABLED
+    // accepted reports are journaled, with or without a callback
+    if (REPORT == pParams->method && NULL != pTemplate->snapshot) {
+        return true;
     }
-
-    qcloud_list_rpush(pTemplate->inner_data.reply_list, node);
-
-    HAL_MutexUnlock(pTemplate->mutex);
-
-    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+#endif
+    return NULL != pParams->request_callback;
 }
 
 /**
- * @brief publish operation to server
- *
- * @param pClient                   handle to data_template client
- * @param method                    method type
- * @param pJsonDoc                  JSON to publish
- * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ * @brief call the callback of a request taken out of reply_table
  */
-int _publish_to_template_upstream_topic(Qcloud_IoT_Template *pTemplate, Method method, char *pJsonDoc)
+static void _call_template_request_callback(Qcloud_IoT_Template *pTemplate, const RequestEntry *entry,
+                                            const char *pClientToken, ReplyAck status)
 {
-    IOT_FUNC_ENTRY;
-    int rc = QCLOUD_RET_SUCCESS;
+    Request request;
 
-    char topic[MAX_SIZE_OF_CLOUD_TOPIC] = {0};
-    int  size;
-
-    size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC, "$thing/up/property/%s/%s", pTemplate->device_info.product_id,
-                        pTemplate->device_info.device_name);
-
-    if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC - 1) {
-        Log_e("buf size < topic length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+    if (NULL == entry->callback) {
+        return;
     }
 
-    PublishParams pubParams = DEFAULT_PUB_PARAMS;
-    pubParams.qos           = QOS0;
-    pubParams.payload_len   = strlen(pJsonDoc);
-    pubParams.payload       = (char *)pJsonDoc;
-
-    rc = IOT_MQTT_Publish(pTemplate->mqtt, topic, &pubParams);
+    strncpy(request.client_token, pClientToken, MAX_SIZE_OF_CLIENT_TOKEN - 1);
+    request.client_token[MAX_SIZE_OF_CLIENT_TOKEN - 1] = '\0';
+    request.method                                     = (Method)entry->arg;
+    request.user_context                               = entry->user_context;
+    request.callback                                   = (OnReplyCallback)entry->callback;
 
-    IOT_FUNC_EXIT_RC(rc);
+    request.callback(pTemplate, request.method, status, sg_template_cloud_rcv_buf, &request);
 }
 
 /**
- * @brief fill method json filed with the value of RequestParams and Method
+ * @brief take back the request of a failed publish
  */
-static int _set_template_json_type(char *pJsonDoc, size_t sizeOfBuffer, Method method)
+static void _remove_request_from_template_table(Qcloud_IoT_Template *pTemplate, const char *pClientToken)
 {
-    IOT_FUNC_ENTRY;
+    RequestEntry entry;
 
-    int rc = QCLOUD_RET_SUCCESS;
+    HAL_MutexLock(pTemplate->mutex);
+    request_table_take(&pTemplate->inner_data.reply_table,
+                       client_token_key(pClientToken, pTemplate->device_info.product_id), &entry);
+    HAL_MutexUnlock(pTemplate->mutex);
+}
 
-    POINTER_SANITY_CHECK(pJsonDoc, QCLOUD_ERR_INVAL);
-    char *method_str = NULL;
+/**
+ * @brief upstream request written into the MQTT send buffer, the members come
+ * from a preformatted JSON document or from write_cb
+ */
+typedef struct {
+    const char *             method;
+    const char *             json_doc;
+    const char *             client_token;
+    TemplateJsonWriteHandler write_cb;
+    void *                   ctx;
+} TemplateRequestPayload;
+
+/**
+ * @brief get method string of the request
+ */
+static const char *_get_template_method_str(Method method)
+{
     switch (method) {
         case GET:
-            method_str = GET_STATUS;
-            break;
+            return GET_STATUS;
         case REPORT:
-            method_str = REPORT_CMD;
-            break;
+            return REPORT_CMD;
         case RINFO:
-            method_str = INFO_CMD;
-            break;
+            return INFO_CMD;
         case REPLY:
-            method_str = CONTROL_CMD_REPLY;
-            break;
+            return CONTROL_CMD_REPLY;
         case CLEAR:
-            method_str = CLEAR_CONTROL;
-            break;
+            return CLEAR_CONTROL;
         default:
             Log_e("unexpected method!");
-            rc = QCLOUD_ERR_INVAL;
-            break;
+            return NULL;
     }
-    if (rc != QCLOUD_RET_SUCCESS)
-        IOT_FUNC_EXIT_RC(rc);
-
-    size_t json_len    = strlen(pJsonDoc);
-    size_t remain_size = sizeOfBuffer - json_len;
-
-    char json_node_str[64] = {0};
-    HAL_Snprintf(json_node_str, 64, "\"method\":\"%s\", ", method_str);
-
-    size_t json_node_len = strlen(json_node_str);
-    if (json_node_len >= remain_size - 1) {
-        rc = QCLOUD_ERR_INVAL;
-    } else {
-        insert_str(pJsonDoc, json_node_str, 1);
-    }
-
-    IOT_FUNC_EXIT_RC(rc);
 }
 
 /**
- * @brief iterator list and call traverseHandle for each node
+ * @brief write {"method":"xxx", ...} into the MQTT send buffer
  */
-static void _traverse_template_list(Qcloud_IoT_Template *pTemplate, List *list, const char *pClientToken,
-                                    const char *pType, TraverseTemplateHandle traverseHandle)
+static int _write_template_request_payload(unsigned char *buf, size_t buf_len, void *ctx)
 {
-    IOT_FUNC_ENTRY;
-
-    HAL_MutexLock(pTemplate->mutex);
-
-    if (list->len) {
-        ListIterator *iter;
-        ListNode *    node = NULL;
-
-        if (NULL == (iter = qcloud_list_iterator_new(list, LIST_TAIL))) {
-            HAL_MutexUnlock(pTemplate->mutex);
-            IOT_FUNC_EXIT;
-        }
-
-        for (;;) {
-            node = qcloud_list_iterator_next(iter);
-            if (NULL == node) {
-                break;
-            }
-
-            if (NULL == node->val) {
-                Log_e("node's value is invalid!");
-                continue;
-            }
-
-            traverseHandle(pTemplate, &node, list, pClientToken, pType);
+    TemplateRequestPayload *payload = (TemplateRequestPayload *)ctx;
+    JsonWriter              writer;
+    int                     rc;
+
+    json_writer_init(&writer, (char *)buf, buf_len);
+    json_writer_object_begin(&writer);
+    json_writer_key(&writer, METHOD_FIELD);
+    json_writer_string(&writer, payload->method);
+    if (payload->json_doc) {
+        json_writer_raw_members(&writer, payload->json_doc, strlen(payload->json_doc));
+    } else {
+        json_writer_key(&writer, CLIENT_TOKEN_FIELD);
+        json_writer_string(&writer, payload->client_token);
+        // a failed write_cb aborts the publish, the members it wrote may be incomplete
+        rc = payload->write_cb ? payload->write_cb(&writer, payload->ctx) : QCLOUD_RET_SUCCESS;
+        if (rc != QCLOUD_RET_SUCCESS) {
+            return rc;
         }
-
-        qcloud_list_iterator_destroy(iter);
     }
-    HAL_MutexUnlock(pTemplate->mutex);
+    json_writer_object_end(&writer);
 
-    IOT_FUNC_EXIT;
+    return json_writer_finish(&writer);
 }
 
 /**
- * @brief handle the timeout request wait for reply
+ * @brief publish operation to server
+ *
+ * @param pClient                   handle to data_template client
+ * @param payload                   request to publish
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
  */
-static void _handle_template_expired_reply_callback(Qcloud_IoT_Template *pTemplate, ListNode **node, List *list,
-                                                    const char *pClientToken, const char *pType)
+static int _publish_to_template_upstream_topic(Qcloud_IoT_Template *pTemplate, TemplateRequestPayload *payload)
 {
     IOT_FUNC_ENTRY;
+    int rc = QCLOUD_RET_SUCCESS;
 
-    Request *request = (Request *)(*node)->val;
-    if (NULL == request)
-        IOT_FUNC_EXIT;
+    char topic[MAX_SIZE_OF_CLOUD_TOPIC] = {0};
+    int  size;
 
-    if (expired(&request->timer)) {
-        if (request->callback != NULL) {
-            request->callback(pTemplate, request->method, ACK_TIMEOUT, sg_template_cloud_rcv_buf, request);
-        }
+    size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC, "$thing/up/property/%s/%s", pTemplate->device_info.product_id,
+                        pTemplate->device_info.device_name);
 
-        qcloud_list_remove(list, *node);
-        *node = NULL;
+    if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC - 1) {
+        Log_e("buf size < topic length!");
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
     }
 
-    IOT_FUNC_EXIT;
+    PublishParams pubParams = DEFAULT_PUB_PARAMS;
+    pubParams.qos           = QOS0;
+
+    rc = qcloud_iot_mqtt_publish_by_writer(pTemplate->mqtt, topic, &pubParams, _write_template_request_payload,
+                                           payload);
+
+    IOT_FUNC_EXIT_RC(rc);
 }
 
 static void _set_control_clientToken(const char *pClientToken)
@@ -277,16 +251,10 @@ void qcloud_iot_template_reset(Qcloud_IoT_Template *pTemplate)
         qcloud_list_destroy(pTemplate->inner_data.property_handle_list);
         pTemplate->inner_data.property_handle_list = NULL;
     }
+    template_common_clear_property_index(pTemplate);
 
-    if (pTemplate->inner_data.reply_list) {
-        qcloud_list_destroy(pTemplate->inner_data.reply_list);
-        pTemplate->inner_data.reply_list = NULL;
-    }
-
-    if (pTemplate->inner_data.event_list) {
-        qcloud_list_destroy(pTemplate->inner_data.event_list);
-        pTemplate->inner_data.event_list = NULL;
-    }
+    request_table_deinit(&pTemplate->inner_data.reply_table);
+    request_table_deinit(&pTemplate->inner_data.event_table);
 
     if (NULL != pTemplate->inner_data.action_handle_list) {
         qcloud_list_destroy(pTemplate->inner_data.action_handle_list);
@@ -300,6 +268,9 @@ int qcloud_iot_template_init(Qcloud_IoT_Template *pTemplate)
 
     POINTER_SANITY_CHECK(pTemplate, QCLOUD_ERR_INVAL);
 
+    // the index is built on the first property registered, nothing to free before
+    memset(&pTemplate->inner_data.property_index, 0, sizeof(HashIndex));
+
     pTemplate->mutex = HAL_MutexCreate();
     if (pTemplate->mutex == NULL)
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
@@ -312,19 +283,13 @@ int qcloud_iot_template_init(Qcloud_IoT_Template *pTemplate)
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
     }
 
-    pTemplate->inner_data.reply_list = qcloud_list_new();
-    if (pTemplate->inner_data.reply_list) {
-        pTemplate->inner_data.reply_list->free = HAL_Free;
-    } else {
-        Log_e("no memory to allocate reply_list");
+    if (request_table_init(&pTemplate->inner_data.reply_table, TEMPLATE_REPLY_POOL_SIZE) != QCLOUD_RET_SUCCESS) {
+        Log_e("no memory to allocate reply_table");
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
     }
 
-    pTemplate->inner_data.event_list = qcloud_list_new();
-    if (pTemplate->inner_data.event_list) {
-        pTemplate->inner_data.event_list->free = HAL_Free;
-    } else {
-        Log_e("no memory to allocate event_list");
+    if (request_table_init(&pTemplate->inner_data.event_table, TEMPLATE_EVENT_POOL_SIZE) != QCLOUD_RET_SUCCESS) {
+        Log_e("no memory to allocate event_table");
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
     }
 
@@ -343,8 +308,26 @@ void handle_template_expired_reply(Qcloud_IoT_Template *pTemplate)
 {
     IOT_FUNC_ENTRY;
 
-    _traverse_template_list(pTemplate, pTemplate->inner_data.reply_list, NULL, NULL,
-                            _handle_template_expired_reply_callback);
+    RequestEntry entry;
+    char         client_token[MAX_SIZE_OF_CLIENT_TOKEN];
+    bool         found;
+
+    // only due requests are taken, the callback runs unlocked and may send another one
+    for (;;) {
+        HAL_MutexLock(pTemplate->mutex);
+        found = request_table_take_expired(&pTemplate->inner_data.reply_table, &entry);
+        HAL_MutexUnlock(pTemplate->mutex);
+        if (!found) {
+            break;
+        }
+
+        // a hashed key can't give the token back, which only the get_status reply needs
+        client_token[0] = '\0';
+        if (!(entry.token & 0x80000000)) {
+            HAL_Snprintf(client_token, sizeof(client_token), "%s-%u", pTemplate->device_info.product_id, entry.token);
+        }
+        _call_template_request_callback(pTemplate, &entry, client_token, ACK_TIMEOUT);
+    }
 
     IOT_FUNC_EXIT;
 }
@@ -358,124 +341,248 @@ int send_template_request(Qcloud_IoT_Template *pTemplate, RequestParams *pParams
     POINTER_SANITY_CHECK(pJsonDoc, QCLOUD_ERR_INVAL);
     POINTER_SANITY_CHECK(pParams, QCLOUD_ERR_INVAL);
 
-    char *client_token = NULL;
+    char                   client_token[MAX_SIZE_OF_CLIENT_TOKEN];
+    TemplateRequestPayload payload = {NULL};
 
     // parse clientToken in pJsonDoc, return err if parse failed
-    if (!parse_client_token(pJsonDoc, &client_token)) {
+    if (!parse_client_token(pJsonDoc, client_token, sizeof(client_token))) {
         Log_e("fail to parse client token!");
         IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
     }
 
-    if (rc != QCLOUD_RET_SUCCESS)
-        IOT_FUNC_EXIT_RC(rc);
+    payload.method = _get_template_method_str(pParams->method);
+    if (NULL == payload.method) {
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+    }
+    payload.json_doc = pJsonDoc;
+
+    // added before publishing, the yield thread may handle the reply before the publish returns
+    if (_wait_for_reply(pTemplate, pParams)) {
+        rc = _add_request_to_template_table(pTemplate, client_token, pParams);
+        if (rc != QCLOUD_RET_SUCCESS) {
+            IOT_FUNC_EXIT_RC(rc);
+        }
+    }
+
+    // method is written in front of pJsonDoc while it is copied into the MQTT send buffer
+    rc = _publish_to_template_upstream_topic(pTemplate, &payload);
+    if ((rc != QCLOUD_RET_SUCCESS) && _wait_for_reply(pTemplate, pParams)) {
+        _remove_request_from_template_table(pTemplate, client_token);
+    }
+
+    IOT_FUNC_EXIT_RC(rc);
+}
+
+int send_template_request_by_writer(Qcloud_IoT_Template *pTemplate, RequestParams *pParams,
+                                    TemplateJsonWriteHandler write_cb, void *ctx)
+{
+    IOT_FUNC_ENTRY;
+    int rc = QCLOUD_RET_SUCCESS;
+
+    POINTER_SANITY_CHECK(pTemplate, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pParams, QCLOUD_ERR_INVAL);
 
-    rc = _set_template_json_type(pJsonDoc, sizeOfBuffer, pParams->method);
-    if (rc != QCLOUD_RET_SUCCESS)
-        IOT_FUNC_EXIT_RC(rc);
+    char                   client_token[MAX_SIZE_OF_CLIENT_TOKEN];
+    TemplateRequestPayload payload = {NULL};
 
-    if (rc == QCLOUD_RET_SUCCESS) {
-        rc = _publish_to_template_upstream_topic(pTemplate, pParams->method, pJsonDoc);
+    payload.method = _get_template_method_str(pParams->method);
+    if (NULL == payload.method) {
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
     }
 
-    if ((rc == QCLOUD_RET_SUCCESS) && (NULL != pParams->request_callback)) {
-        rc = _add_request_to_template_list(pTemplate, client_token, pParams);
+    HAL_Snprintf(client_token, sizeof(client_token), "%s-%u", pTemplate->device_info.product_id,
+                 pTemplate->inner_data.token_num++);
+    payload.client_token = client_token;
+    payload.write_cb     = write_cb;
+    payload.ctx          = ctx;
+
+    // added before publishing, the yield thread may handle the reply before the publish returns
+    if (_wait_for_reply(pTemplate, pParams)) {
+        rc = _add_request_to_template_table(pTemplate, client_token, pParams);
+        if (rc != QCLOUD_RET_SUCCESS) {
+            IOT_FUNC_EXIT_RC(rc);
+        }
     }
 
-    HAL_Free(client_token);
+    rc = _publish_to_template_upstream_topic(pTemplate, &payload);
+    if ((rc != QCLOUD_RET_SUCCESS) && _wait_for_reply(pTemplate, pParams)) {
+        _remove_request_from_template_table(pTemplate, client_token);
+    }
 
     IOT_FUNC_EXIT_RC(rc);
 }
 
-static void _handle_control(Qcloud_IoT_Template *pTemplate, char *control_str)
+/**
+ * @brief index the message in sg_template_cloud_rcv_buf, token storage is taken
+ * from heap when the message has more than MAX_TEMPLATE_JSON_TOKENS tokens
+ */
+static int _index_template_rcv_buf(size_t len, JsonToken **heap_tokens)
+{
+    int rc;
+
+    *heap_tokens = NULL;
+    rc = json_index_parse(&sg_template_rcv_index, sg_template_cloud_rcv_buf, len, sg_template_json_tokens,
+                          MAX_TEMPLATE_JSON_TOKENS);
+    if (rc != QCLOUD_ERR_MAX_JSON_TOKEN) {
+        return rc;
+    }
+
+    rc           = json_index_parse(&sg_template_rcv_index, sg_template_cloud_rcv_buf, len, NULL, 0);
+    *heap_tokens = (JsonToken *)HAL_Malloc(rc * sizeof(JsonToken));
+    if (*heap_tokens == NULL) {
+        Log_e("malloc %d json tokens failed", rc);
+        return QCLOUD_ERR_MALLOC;
+    }
+
+    return json_index_parse(&sg_template_rcv_index, sg_template_cloud_rcv_buf, len, *heap_tokens, rc);
+}
+
+/**
+ * @brief copy string field of the indexed message into buf
+ */
+static bool _get_rcv_str_field(const char *path, char *buf, size_t buf_len)
+{
+    int tok = json_index_get(&sg_template_rcv_index, 0, path);
+
+    if (tok < 0 || sg_template_rcv_index.tokens[tok].len >= buf_len) {
+        return false;
+    }
+
+    memcpy(buf, json_index_str(&sg_template_rcv_index, tok), sg_template_rcv_index.tokens[tok].len);
+    buf[sg_template_rcv_index.tokens[tok].len] = '\0';
+    return true;
+}
+
+static bool _get_rcv_code_field(int32_t *pCode)
+{
+    int  tok = json_index_get(&sg_template_rcv_index, 0, REPLY_CODE);
+    char code[16];
+
+    if (tok < 0 || sg_template_rcv_index.tokens[tok].type != JSNUMBER ||
+        sg_template_rcv_index.tokens[tok].len >= sizeof(code)) {
+        return false;
+    }
+
+    memcpy(code, json_index_str(&sg_template_rcv_index, tok), sg_template_rcv_index.tokens[tok].len);
+    code[sg_template_rcv_index.tokens[tok].len] = '\0';
+    return LITE_get_int32(pCode, code) == QCLOUD_RET_SUCCESS;
+}
+
+static bool _update_property(Qcloud_IoT_Template *pTemplate, const JsonIndex *index, int val,
+                             DeviceProperty *pProperty, eControlType type)
+{
+#ifdef STATE_SNAPSHOT_ENABLED
+    // get_status repeats the controls the restored state already has, only the changed properties are handed on
+    if (eGET_CTL == type && NULL != pTemplate->snapshot) {
+        return template_snapshot_update_delta(pTemplate, index, val, pProperty);
+    }
+#endif
+    return update_value_by_token(index, val, pProperty);
+}
+
+/**
+ * @brief handle control object in the indexed message, ctl_tok is '\0' terminated in place by caller.
+ * Members of control are walked once and dispatched through the property index.
+ */
+static void _handle_control(Qcloud_IoT_Template *pTemplate, const JsonIndex *index, int ctl_tok, eControlType type)
 {
     IOT_FUNC_ENTRY;
-    if (pTemplate->inner_data.property_handle_list->len) {
-        ListIterator *   iter;
-        ListNode *       node            = NULL;
-        PropertyHandler *property_handle = NULL;
+    char *           control_str = (char *)json_index_str(index, ctl_tok);
+    size_t           control_len = index->tokens[ctl_tok].len;
+    PropertyHandler *property_handle;
+    int              key, val;
 
-        if (NULL == (iter = qcloud_list_iterator_new(pTemplate->inner_data.property_handle_list, LIST_TAIL))) {
-            HAL_MutexUnlock(pTemplate->mutex);
-            IOT_FUNC_EXIT;
+    if (index->tokens[ctl_tok].type != JSOBJECT) {
+        IOT_FUNC_EXIT;
+    }
+
+    json_index_for_each_member(index, ctl_tok, key, val)
+    {
+        property_handle = template_common_find_property(pTemplate, json_index_str(index, key), index->tokens[key].len);
+        if (NULL == property_handle || NULL == property_handle->property) {
+            continue;
         }
 
-        for (;;) {
-            node = qcloud_list_iterator_next(iter);
-            if (NULL == node) {
-                break;
+        if (_update_property(pTemplate, index, val, property_handle->property, type)) {
+            if (property_handle->callback != NULL) {
+                property_handle->callback(pTemplate, control_str, control_len, property_handle->property);
             }
+        }
+    }
 
-            property_handle = (PropertyHandler *)(node->val);
-            if (NULL == property_handle) {
-                Log_e("node's value is invalid!");
-                continue;
-            }
+    IOT_FUNC_EXIT;
+}
 
-            if (property_handle->property != NULL) {
-                if (update_value_if_key_match(control_str, property_handle->property)) {
-                    if (property_handle->callback != NULL) {
-                        property_handle->callback(pTemplate, control_str, strlen(control_str),
-                                                  property_handle->property);
-                    }
-                    node = NULL;
-                }
-            }
-        }
+void template_apply_control(Qcloud_IoT_Template *pTemplate, const JsonIndex *index, int ctl_tok, eControlType type)
+{
+    char *control_str = (char *)json_index_str(index, ctl_tok);
+    char  last_char;
 
-        qcloud_list_iterator_destroy(iter);
+    // call usr's cb if registered, otherwise dispatch to the property callbacks
+    backup_json_str_last_char(control_str, index->tokens[ctl_tok].len, last_char);
+    if (NULL != pTemplate->usr_control_handle) {
+        pTemplate->usr_control_handle(pTemplate, control_str, type);
+    } else {
+        _handle_control(pTemplate, index, ctl_tok, type);
     }
+    restore_json_str_last_char(control_str, index->tokens[ctl_tok].len, last_char);
 
-    IOT_FUNC_EXIT;
+#ifdef STATE_SNAPSHOT_ENABLED
+    template_snapshot_save(pTemplate);
+#endif
 }
 
-static void _handle_template_reply_callback(Qcloud_IoT_Template *pTemplate, ListNode **node, List *list,
-                                            const char *pClientToken, const char *pType)
+static void _handle_template_reply(Qcloud_IoT_Template *pTemplate, const char *pClientToken, const char *pType)
 {
     IOT_FUNC_ENTRY;
 
-    Request *request = (Request *)(*node)->val;
-    if (NULL == request)
+    RequestEntry entry;
+    bool         found;
+
+    HAL_MutexLock(pTemplate->mutex);
+    found = request_table_take(&pTemplate->inner_data.reply_table,
+                               client_token_key(pClientToken, pTemplate->device_info.product_id), &entry);
+    HAL_MutexUnlock(pTemplate->mutex);
+    if (!found) {
         IOT_FUNC_EXIT;
+    }
 
-    if (strcmp(request->client_token, pClientToken) == 0) {
-        ReplyAck status = ACK_NONE;
+    ReplyAck status = ACK_NONE;
 
-        // check operation success or not according to code field of reply message
-        int32_t reply_code = 0;
+    // check operation success or not according to code field of reply message
+    int32_t reply_code = 0;
 
-        bool parse_success = parse_code_return(sg_template_cloud_rcv_buf, &reply_code);
-        if (parse_success) {
-            if (reply_code == 0) {
-                status = ACK_ACCEPTED;
-            } else {
-                status = ACK_REJECTED;
-            }
+    bool parse_success = _get_rcv_code_field(&reply_code);
+    if (parse_success) {
+        if (reply_code == 0) {
+            status = ACK_ACCEPTED;
+        } else {
+            status = ACK_REJECTED;
+        }
 
-            if (strcmp(pType, GET_STATUS_REPLY) == 0 && status == ACK_ACCEPTED) {
-                char *control_str = NULL;
-                if (parse_template_get_control(sg_template_cloud_rcv_buf, &control_str)) {
-                    Log_d("control data from get_status_reply");
-                    _set_control_clientToken(pClientToken);
-                    if (NULL != pTemplate->usr_control_handle) {  // call usr's cb if delta_handle registered,otherwise
-                                                                  // use _handle_delta
-                        pTemplate->usr_control_handle(pTemplate, control_str, eGET_CTL);
-                    } else {
-                        _handle_control(pTemplate, control_str);
-                    }
-                    HAL_Free(control_str);
-                    *((ReplyAck *)request->user_context) = ACK_ACCEPTED;  // prepare for clear_control
-                }
+        if (strcmp(pType, GET_STATUS_REPLY) == 0 && status == ACK_ACCEPTED) {
+            HAL_MutexLock(pTemplate->mutex);
+            int ctl_tok = json_index_get(&sg_template_rcv_index, 0, GET_CONTROL_PARA);
+            if (ctl_tok >= 0 && sg_template_rcv_index.tokens[ctl_tok].type == JSOBJECT) {
+                Log_d("control data from get_status_reply");
+                _set_control_clientToken(pClientToken);
+                template_apply_control(pTemplate, &sg_template_rcv_index, ctl_tok, eGET_CTL);
+                *((ReplyAck *)entry.user_context) = ACK_ACCEPTED;  // prepare for clear_control
             }
+            HAL_MutexUnlock(pTemplate->mutex);
+        }
 
-            if (request->callback != NULL) {
-                request->callback(pTemplate, request->method, status, sg_template_cloud_rcv_buf, request);
-            }
-        } else {
-            Log_e("parse template operation result code failed.");
+#ifdef STATE_SNAPSHOT_ENABLED
+        if (REPORT == (Method)entry.arg && status == ACK_ACCEPTED) {
+            HAL_MutexLock(pTemplate->mutex);
+            template_snapshot_save(pTemplate);
+            HAL_MutexUnlock(pTemplate->mutex);
         }
+#endif
 
-        qcloud_list_remove(list, *node);
-        *node = NULL;
+        _call_template_request_callback(pTemplate, &entry, pClientToken, status);
+    } else {
+        Log_e("parse template operation result code failed.");
     }
 
     IOT_FUNC_EXIT;
@@ -495,8 +602,9 @@ static void _on_template_downstream_topic_handler(void *pClient, MQTTMessage *me
         IOT_FUNC_EXIT;
     }
 
-    char *client_token = NULL;
-    char *type_str     = NULL;
+    char       client_token[MAX_SIZE_OF_CLIENT_TOKEN];
+    char       type_str[MAX_SIZE_OF_METHOD];
+    JsonToken *heap_tokens = NULL;
 
     if (message->payload_len > CLOUD_IOT_JSON_RX_BUF_LEN) {
         Log_e("The length of the received message exceeds the specified length!");
@@ -509,13 +617,19 @@ static void _on_template_downstream_topic_handler(void *pClient, MQTTMessage *me
     sg_template_cloud_rcv_buf[cloud_rcv_len] = '\0';  // jsmn_parse relies on a string
     // Log_i("recv:%s", sg_template_cloud_rcv_buf);
 
+    // tokenize once, every field below is looked up from the index
+    if (_index_template_rcv_buf(cloud_rcv_len, &heap_tokens) < 0) {
+        Log_e("Fail to parse json! Json=%s", sg_template_cloud_rcv_buf);
+        goto End;
+    }
+
     // parse the message type from topic $thing/down/property
-    if (!parse_template_method_type(sg_template_cloud_rcv_buf, &type_str)) {
+    if (!_get_rcv_str_field(METHOD_FIELD, type_str, sizeof(type_str))) {
         Log_e("Fail to parse method!");
         goto End;
     }
 
-    if (!parse_client_token(sg_template_cloud_rcv_buf, &client_token)) {
+    if (!_get_rcv_str_field(CLIENT_TOKEN_FIELD, client_token, sizeof(client_token))) {
         Log_e("Fail to parse client token! Json=%s", sg_template_cloud_rcv_buf);
         goto End;
     }
@@ -523,18 +637,10 @@ static void _on_template_downstream_topic_handler(void *pClient, MQTTMessage *me
     // handle control message
     if (!strcmp(type_str, CONTROL_CMD)) {
         HAL_MutexLock(template_client->mutex);
-        char *control_str = NULL;
-        if (parse_template_cmd_control(sg_template_cloud_rcv_buf, &control_str)) {
-            // Log_d("control_str:%s", control_str);
+        int ctl_tok = json_index_get(&sg_template_rcv_index, 0, CMD_CONTROL_PARA);
+        if (ctl_tok >= 0 && sg_template_rcv_index.tokens[ctl_tok].type == JSOBJECT) {
             _set_control_clientToken(client_token);
-            if (NULL !=
-                template_client
-                    ->usr_control_handle) {  // call usr's cb if delta_handle registered,otherwise use _handle_delta
-                template_client->usr_control_handle(template_client, control_str, eOPERATION_CTL);
-            } else {
-                _handle_control(template_client, control_str);
-            }
-            HAL_Free(control_str);
+            template_apply_control(template_client, &sg_template_rcv_index, ctl_tok, eOPERATION_CTL);
         }
 
         HAL_MutexUnlock(template_client->mutex);
@@ -542,12 +648,10 @@ static void _on_template_downstream_topic_handler(void *pClient, MQTTMessage *me
     }
 
     if (template_client != NULL)
-        _traverse_template_list(template_client, template_client->inner_data.reply_list, client_token, type_str,
-                                _handle_template_reply_callback);
+        _handle_template_reply(template_client, client_token, type_str);
 
 End:
-    HAL_Free(type_str);
-    HAL_Free(client_token);
+    HAL_Free(heap_tokens);
 
     IOT_FUNC_EXIT;
 }
@@ -37,147 +37,72 @@ extern "C" {
 #include "qcloud_iot_import.h"
 #include "utils_param_check.h"
 
-/**
- * @brief iterator event list and call traverseHandle for each node
- */
-static void _traverse_event_list(Qcloud_IoT_Template *pTemplate, List *list, const char *pClientToken,
-                                 MQTTMessage *message, eEventDealType eDealType)
-{
-    IOT_FUNC_ENTRY;
-
-    HAL_MutexLock(pTemplate->mutex);
-
-    if (list->len) {
-        ListIterator *iter;
-        ListNode *    node = NULL;
-
-        if (NULL == (iter = qcloud_list_iterator_new(list, LIST_TAIL))) {
-            HAL_MutexUnlock(pTemplate->mutex);
-            IOT_FUNC_EXIT;
-        }
-
-        for (;;) {
-            node = qcloud_list_iterator_next(iter);
-            if (NULL == node) {
-                break;
-            }
-
-            if (NULL == node->val) {
-                Log_e("node's value is invalid!");
-                continue;
-            }
-
-            sEventReply *pReply = (sEventReply *)node->val;
-            /*timeout check*/
-            if (eDEAL_EXPIRED == eDealType) {
-                if (expired(&pReply->timer)) {
-                    Log_e("eventToken[%s] timeout", pReply->client_token);
-                    qcloud_list_remove(list, node);
-                    node = NULL;
-                }
-            }
-
-            /*match event wait for reply by clientToken*/
-            if ((eDEAL_REPLY_CB == eDealType) && (0 == strcmp(pClientToken, pReply->client_token))) {
-                if (NULL != pReply->callback) {
-                    pReply->callback(pTemplate, message);
-                    Log_d("eventToken[%s] released", pReply->client_token);
-                    qcloud_list_remove(list, node);
-                    node = NULL;
-                }
-            }
-        }
-
-        qcloud_list_iterator_destroy(iter);
-    }
-    HAL_MutexUnlock(pTemplate->mutex);
-
-    IOT_FUNC_EXIT;
-}
-
 static void _on_event_reply_callback(void *pClient, MQTTMessage *message, void *userData)
 {
     POINTER_SANITY_CHECK_RTN(message);
     Qcloud_IoT_Template *template_client = (Qcloud_IoT_Template *)userData;
 
     int32_t code;
-    char *  client_token = NULL;
-    char *  status       = NULL;
+    char    client_token[MAX_SIZE_OF_CLIENT_TOKEN];
 
     Log_d("recv:%.*s", (int)message->payload_len, (char *)message->payload);
 
     // parse clientToken from payload
-    if (!parse_client_token((char *)message->payload, &client_token)) {
+    if (!parse_client_token((char *)message->payload, client_token, sizeof(client_token))) {
         Log_e("fail to parse client token!");
         return;
     }
 
     // parse code from payload
     if (!parse_code_return((char *)message->payload, &code)) {
-        HAL_Free(client_token);
         Log_e("fail to parse code");
         return;
     }
 
-    if (!parse_status_return((char *)message->payload, &status)) {
-        // Log_d("no status return");
-    }
+    Log_d("eventToken:%s code:%d  ", client_token, code);
 
-    Log_d("eventToken:%s code:%d  ", STRING_PTR_PRINT_SANITY_CHECK(client_token), code);
+    if (template_client != NULL) {
+        RequestEntry entry;
+        bool         found;
 
-    if (template_client != NULL)
-        _traverse_event_list(template_client, template_client->inner_data.event_list, client_token, message,
-                             eDEAL_REPLY_CB);
+        HAL_MutexLock(template_client->mutex);
+        found = request_table_take(&template_client->inner_data.event_table,
+                                   client_token_key(client_token, template_client->device_info.product_id), &entry);
+        HAL_MutexUnlock(template_client->mutex);
 
-    HAL_Free(client_token);
-    HAL_Free(status);
+        if (found && NULL != entry.callback) {
+            ((OnEventReplyCallback)entry.callback)(template_client, message);
+            Log_d("eventToken[%s] released", client_token);
+        }
+    }
 
     return;
 }
 
 /**
- * @brief create event reply struct and add to event_list
+ * @brief add event waiting for reply to event_table, its clientToken is written to pClientToken
  */
-static sEventReply *_create_event_add_to_list(Qcloud_IoT_Template *pTemplate, OnEventReplyCallback replyCb,
-                                              uint32_t reply_timeout_ms)
+static int _create_event_add_to_table(Qcloud_IoT_Template *pTemplate, OnEventReplyCallback replyCb,
+                                      uint32_t reply_timeout_ms, char *pClientToken)
 {
     IOT_FUNC_ENTRY;
 
-    HAL_MutexLock(pTemplate->mutex);
-    if (pTemplate->inner_data.event_list->len >= MAX_EVENT_WAIT_REPLY) {
-        HAL_MutexUnlock(pTemplate->mutex);
-        Log_e("Too many event wait for reply");
-        IOT_FUNC_EXIT_RC(NULL);
-    }
-
-    sEventReply *pReply = (sEventReply *)HAL_Malloc(sizeof(sEventReply));
-    if (NULL == pReply) {
-        HAL_MutexUnlock(pTemplate->mutex);
-        Log_e("run memory malloc is error!");
-        IOT_FUNC_EXIT_RC(NULL);
-    }
-
-    pReply->callback     = replyCb;
-    pReply->user_context = pTemplate;
+    RequestEntry entry = {0};
+    int          rc;
 
-    InitTimer(&(pReply->timer));
-    countdown(&(pReply->timer), reply_timeout_ms / 1000);
-    HAL_Snprintf(pReply->client_token, EVENT_TOKEN_MAX_LEN, "%s-%u", pTemplate->device_info.product_id,
+    HAL_MutexLock(pTemplate->mutex);
+    entry.token    = pTemplate->inner_data.token_num & 0x7FFFFFFF;
+    entry.callback = (void *)replyCb;
+    HAL_Snprintf(pClientToken, EVENT_TOKEN_MAX_LEN, "%s-%u", pTemplate->device_info.product_id,
                  pTemplate->inner_data.token_num++);
 
-    ListNode *node = list_node_new(pReply);
-    if (NULL == node) {
-        HAL_MutexUnlock(pTemplate->mutex);
-        Log_e("run list_node_new is error!");
-        HAL_Free(pReply);
-        IOT_FUNC_EXIT_RC(NULL);
-    }
-
-    qcloud_list_rpush(pTemplate->inner_data.event_list, node);
-
+    rc = request_table_add(&pTemplate->inner_data.event_table, &entry, reply_timeout_ms);
     HAL_MutexUnlock(pTemplate->mutex);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        Log_e("Too many event wait for reply");
+    }
 
-    IOT_FUNC_EXIT_RC(pReply);
+    IOT_FUNC_EXIT_RC(rc);
 }
 
 static int _iot_event_json_init(void *handle, char *jsonBuffer, size_t sizeOfBuffer, uint8_t event_count,
@@ -187,10 +112,9 @@ static int _iot_event_json_init(void *handle, char *jsonBuffer, size_t sizeOfBuf
 
     Qcloud_IoT_Template *ptemplate = (Qcloud_IoT_Template *)handle;
     int32_t              rc_of_snprintf;
-    sEventReply *        pReply;
+    char                 client_token[EVENT_TOKEN_MAX_LEN];
 
-    pReply = _create_event_add_to_list(ptemplate, replyCb, reply_timeout_ms);
-    if (!pReply) {
+    if (_create_event_add_to_table(ptemplate, replyCb, reply_timeout_ms, client_token) != QCLOUD_RET_SUCCESS) {
         Log_e("create event failed");
         return QCLOUD_ERR_FAILURE;
     }
@@ -198,10 +122,10 @@ static int _iot_event_json_init(void *handle, char *jsonBuffer, size_t sizeOfBuf
     memset(jsonBuffer, 0, sizeOfBuffer);
     if (event_count > SINGLE_EVENT) {
         rc_of_snprintf = HAL_Snprintf(jsonBuffer, sizeOfBuffer, "{\"method\":\"%s\", \"clientToken\":\"%s\", ",
-                                      POST_EVENTS, pReply->client_token);
+                                      POST_EVENTS, client_token);
     } else {
         rc_of_snprintf = HAL_Snprintf(jsonBuffer, sizeOfBuffer, "{\"method\":\"%s\", \"clientToken\":\"%s\", ",
-                                      POST_EVENT, pReply->client_token);
+                                      POST_EVENT, client_token);
     }
 
     return check_snprintf_return(rc_of_snprintf, sizeOfBuffer);
@@ -343,8 +267,13 @@ void handle_template_expired_event(void *client)
 {
     IOT_FUNC_ENTRY;
     Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)client;
+    RequestEntry         entry;
 
-    _traverse_event_list(pTemplate, pTemplate->inner_data.event_list, NULL, NULL, eDEAL_EXPIRED);
+    HAL_MutexLock(pTemplate->mutex);
+    while (request_table_take_expired(&pTemplate->inner_data.event_table, &entry)) {
+        Log_e("eventToken[%s-%u] timeout", pTemplate->device_info.product_id, entry.token);
+    }
+    HAL_MutexUnlock(pTemplate->mutex);
 
     IOT_FUNC_EXIT;
 }
@@ -0,0 +1,654 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qcloud_iot_export.h"
+#include "qcloud_iot_import.h"
+
+#ifdef LAN_CONTROL_ENABLED
+
+#include "data_template_lan_control.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "data_template_client_common.h"
+#include "data_template_client_json.h"
+#include "lite-utils.h"
+#include "utils_hmac.h"
+#include "utils_json_writer.h"
+
+static bool _time_reached(uint32_t deadline_ms)
+{
+    return (int32_t)(HAL_GetTimeMs() - deadline_ms) >= 0;
+}
+
+/* compare without an early exit, the time taken tells nothing about the signature */
+static bool _sign_equals(const char *a, const char *b)
+{
+    unsigned char diff = 0;
+    int           i;
+
+    for (i = 0; i < LAN_CONTROL_SIGN_LEN; i++) {
+        diff |= a[i] ^ b[i];
+    }
+
+    return 0 == diff;
+}
+
+static int _derive_key(LanControl *lan)
+{
+#ifdef AUTH_MODE_CERT
+    Log_e("LAN control needs the device secret of AUTH_MODE_KEY");
+    return QCLOUD_ERR_FAILURE;
+#else
+    DeviceInfo *device_info = &lan->pTemplate->device_info;
+    char        msg[MAX_SIZE_OF_PRODUCT_ID + MAX_SIZE_OF_DEVICE_NAME + sizeof(LAN_CONTROL_KEY_SALT)];
+    int         len;
+
+    if (!device_info->device_secret[0]) {
+        Log_e("no device secret to derive the LAN key");
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    len = HAL_Snprintf(msg, sizeof(msg), "%s%s%s", device_info->product_id, device_info->device_name,
+                       LAN_CONTROL_KEY_SALT);
+    utils_hmac_sha1(msg, len, lan->key, device_info->device_secret, strlen(device_info->device_secret));
+    return QCLOUD_RET_SUCCESS;
+#endif
+}
+
+/* the end of the nonces reserved is written to path.tmp and renamed over the nonce file, a nonce is taken only
+ * once it is reserved, so none is used again after a reboot */
+static int _reserve_nonces(LanControl *lan)
+{
+    char     tmp[LAN_CONTROL_PATH_LEN];
+    char     line[16];
+    uint32_t end = lan->nonce + LAN_CONTROL_NONCE_BLOCK;
+    void *   fp;
+    int      len;
+    bool     ok;
+
+    if (!lan->nonce_path[0]) {
+        lan->nonce_end = end;
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    HAL_Snprintf(tmp, sizeof(tmp), "%s%s", lan->nonce_path, LAN_CONTROL_TMP_SUFFIX);
+    fp = HAL_FileOpen(tmp, "wb");
+    if (!fp) {
+        Log_e("open %s failed", tmp);
+        return QCLOUD_ERR_FAILURE;
+    }
+    len = HAL_Snprintf(line, sizeof(line), "%u\n", end);
+    ok  = HAL_FileWrite(line, 1, len, fp) == len;
+    ok  = !HAL_FileClose(fp) && ok;
+
+    if (ok && HAL_FileRename(tmp, lan->nonce_path)) {
+        // file systems which do not rename over a file, the nonce is loaded from path.tmp while the file is missing
+        HAL_FileRemove(lan->nonce_path);
+        ok = !HAL_FileRename(tmp, lan->nonce_path);
+    }
+    if (!ok) {
+        Log_e("save LAN control nonce failed");
+        HAL_FileRemove(tmp);
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    lan->nonce_end = end;
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* the first nonce of a start, after those reserved before the reboot, or from the time without the nonce file */
+static int _init_nonce(LanControl *lan)
+{
+    char  tmp[LAN_CONTROL_PATH_LEN];
+    char  line[16] = {0};
+    void *fp;
+
+    if (!lan->nonce_path[0]) {
+        srand((unsigned)HAL_GetTimeMs());
+        lan->nonce = (uint32_t)HAL_Timer_current_sec() ^ ((uint32_t)rand() << 8);
+        return _reserve_nonces(lan);
+    }
+
+    fp = HAL_FileOpen(lan->nonce_path, "rb");
+    if (!fp) {
+        HAL_Snprintf(tmp, sizeof(tmp), "%s%s", lan->nonce_path, LAN_CONTROL_TMP_SUFFIX);
+        fp = HAL_FileOpen(tmp, "rb");
+    }
+    if (fp) {
+        if (!HAL_FileGets(line, sizeof(line), fp) || sscanf(line, "%u", &lan->nonce) != 1) {
+            Log_w("invalid LAN control nonce file");
+        }
+        HAL_FileClose(fp);
+    }
+
+    return _reserve_nonces(lan);
+}
+
+/* the seqs of the clients are forgotten, they start over with the next nonce, a failed reservation is retried on
+ * the next change */
+static void _next_nonce(LanControl *lan)
+{
+    memset(lan->clients, 0, sizeof(lan->clients));
+    if ((int32_t)(++lan->nonce - lan->nonce_end) >= 0 && _reserve_nonces(lan)) {
+        Log_e("LAN control nonce %u is not reserved, it may be used again after a reboot", lan->nonce);
+    }
+}
+
+/**
+ * @brief check seq of a client is beyond the last one accepted under the nonce, and take it. A client beyond the
+ * ones tracked changes the nonce, as the seq of another one would be forgotten
+ */
+static bool _take_seq(LanControl *lan, const char *client_id, size_t id_len, uint32_t seq)
+{
+    LanControlClient *client = NULL;
+    int               i;
+
+    for (i = 0; i < LAN_CONTROL_MAX_CLIENTS; i++) {
+        LanControlClient *slot = &lan->clients[i];
+        if (strlen(slot->client_id) == id_len && !memcmp(slot->client_id, client_id, id_len)) {
+            if ((int32_t)(seq - slot->seq) <= 0) {
+                return false;
+            }
+            client = slot;
+            break;
+        }
+        if (!client && !slot->client_id[0]) {
+            client = slot;
+        }
+    }
+
+    if (!client) {
+        Log_i("more than %d LAN control clients, change the nonce", LAN_CONTROL_MAX_CLIENTS);
+        _next_nonce(lan);
+        return false;
+    }
+    if (i == LAN_CONTROL_MAX_CLIENTS) {
+        memcpy(client->client_id, client_id, id_len);
+        client->client_id[id_len] = '\0';
+    }
+    client->seq = seq;
+    return true;
+}
+
+/* a number of uint32_t in the request */
+static bool _get_uint32(const JsonIndex *index, int tok, uint32_t *val)
+{
+    char str[16];
+
+    if (tok < 0 || index->tokens[tok].type != JSNUMBER || index->tokens[tok].len >= sizeof(str)) {
+        return false;
+    }
+    memcpy(str, json_index_str(index, tok), index->tokens[tok].len);
+    str[index->tokens[tok].len] = '\0';
+
+    return LITE_get_uint32(val, str) == QCLOUD_RET_SUCCESS;
+}
+
+static bool _method_is(const JsonIndex *index, int method_tok, const char *method)
+{
+    return index->tokens[method_tok].len == strlen(method) &&
+           !memcmp(json_index_str(index, method_tok), method, strlen(method));
+}
+
+/**
+ * @brief sign the reply written after the signature room of tx_buf and send it
+ * to the sender of the request
+ */
+static int _send_reply(LanControl *lan, JsonWriter *writer)
+{
+    int len = json_writer_finish(writer);
+    int rc;
+
+    if (len < 0) {
+        Log_e("LAN reply too long: %d", len);
+        return len;
+    }
+
+    utils_hmac_sha1(lan->tx_buf + LAN_CONTROL_SIGN_LEN, len, lan->tx_buf, lan->key, LAN_CONTROL_SIGN_LEN);
+    rc = HAL_UDP_WriteTo(lan->fd, (unsigned char *)lan->tx_buf, LAN_CONTROL_SIGN_LEN + len, lan->addr, lan->port);
+    if (rc < 0) {
+        Log_e("send LAN reply to %s:%u failed: %d", lan->addr, lan->port, rc);
+        return QCLOUD_ERR_TCP_WRITE_FAIL;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static void _reply_begin(LanControl *lan, JsonWriter *writer, const char *method, const JsonIndex *index,
+                         int token_tok, int code, const char *status)
+{
+    json_writer_init(writer, lan->tx_buf + LAN_CONTROL_SIGN_LEN, sizeof(lan->tx_buf) - LAN_CONTROL_SIGN_LEN);
+    json_writer_object_begin(writer);
+    json_writer_key(writer, METHOD_FIELD);
+    json_writer_string(writer, method);
+    json_writer_key(writer, CLIENT_TOKEN_FIELD);
+    json_writer_string_len(writer, json_index_str(index, token_tok), index->tokens[token_tok].len);
+    json_writer_key(writer, REPLY_CODE);
+    json_writer_int(writer, code);
+    json_writer_key(writer, REPLY_STATUS);
+    json_writer_string(writer, status);
+}
+
+/* called with lock held */
+static void _mark_dirty(LanControl *lan, DeviceProperty *property)
+{
+    int i;
+
+    for (i = 0; i < lan->dirty_num; i++) {
+        if (lan->dirty[i] == property) {
+            return;
+        }
+    }
+
+    if (lan->dirty_num == LAN_CONTROL_MAX_SYNC) {
+        Log_w("property %s not synced, too many waiting", property->key);
+        return;
+    }
+    lan->dirty[lan->dirty_num++] = property;
+}
+
+/* the request does not carry the current nonce, tell the client the one to send it again with */
+static void _reply_stale(LanControl *lan, const JsonIndex *index, int method_tok, int token_tok)
+{
+    JsonWriter writer;
+
+    if (_method_is(index, method_tok, CONTROL_CMD)) {
+        _reply_begin(lan, &writer, CONTROL_CMD_REPLY, index, token_tok, eDEAL_FAIL, "stale nonce");
+    } else if (_method_is(index, method_tok, GET_STATUS)) {
+        _reply_begin(lan, &writer, GET_STATUS_REPLY, index, token_tok, eDEAL_FAIL, "stale nonce");
+    } else {
+        return;
+    }
+    json_writer_key(&writer, LAN_CONTROL_NONCE_FIELD);
+    json_writer_uint(&writer, lan->nonce);
+    json_writer_object_end(&writer);
+    _send_reply(lan, &writer);
+}
+
+static void _handle_control(LanControl *lan, const JsonIndex *index, int token_tok)
+{
+    Qcloud_IoT_Template *pTemplate = lan->pTemplate;
+    PropertyHandler *    property_handle;
+    JsonWriter           writer;
+    int                  ctl_tok = json_index_get(index, 0, CMD_CONTROL_PARA);
+    int                  key;
+
+    if (ctl_tok < 0 || index->tokens[ctl_tok].type != JSOBJECT) {
+        _reply_begin(lan, &writer, CONTROL_CMD_REPLY, index, token_tok, eDEAL_FAIL, "invalid params");
+        json_writer_object_end(&writer);
+        _send_reply(lan, &writer);
+        return;
+    }
+
+    HAL_MutexLock(pTemplate->mutex);
+    template_apply_control(pTemplate, index, ctl_tok, eOPERATION_CTL);
+
+    HAL_MutexLock(lan->lock);
+    for (key = json_index_first_child(index, ctl_tok); key >= 0; key = index->tokens[key].next) {
+        property_handle = template_common_find_property(pTemplate, json_index_str(index, key), index->tokens[key].len);
+        if (property_handle && property_handle->property) {
+            _mark_dirty(lan, property_handle->property);
+        }
+    }
+    lan->stats.control_cnt++;
+    HAL_MutexUnlock(lan->lock);
+    HAL_MutexUnlock(pTemplate->mutex);
+
+    _reply_begin(lan, &writer, CONTROL_CMD_REPLY, index, token_tok, eDEAL_SUCCESS, "success");
+    json_writer_object_end(&writer);
+    _send_reply(lan, &writer);
+}
+
+static void _handle_get_status(LanControl *lan, const JsonIndex *index, int token_tok)
+{
+    Qcloud_IoT_Template *pTemplate = lan->pTemplate;
+    JsonWriter           writer;
+    ListIterator *       iter;
+    ListNode *           node;
+
+    HAL_MutexLock(pTemplate->mutex);
+    iter = qcloud_list_iterator_new(pTemplate->inner_data.property_handle_list, LIST_HEAD);
+    if (NULL == iter) {
+        HAL_MutexUnlock(pTemplate->mutex);
+        Log_e("new property list iterator failed");
+        _reply_begin(lan, &writer, GET_STATUS_REPLY, index, token_tok, eDEAL_FAIL, "internal error");
+        json_writer_object_end(&writer);
+        _send_reply(lan, &writer);
+        return;
+    }
+
+    _reply_begin(lan, &writer, GET_STATUS_REPLY, index, token_tok, eDEAL_SUCCESS, "success");
+    json_writer_key(&writer, "data");
+    json_writer_object_begin(&writer);
+    json_writer_key(&writer, "reported");
+    json_writer_object_begin(&writer);
+    while (NULL != (node = qcloud_list_iterator_next(iter))) {
+        PropertyHandler *property_handle = (PropertyHandler *)node->val;
+        if (property_handle && property_handle->property) {
+            write_json_node(&writer, property_handle->property);
+        }
+    }
+    qcloud_list_iterator_destroy(iter);
+    HAL_MutexUnlock(pTemplate->mutex);
+
+    json_writer_object_end(&writer);
+    json_writer_object_end(&writer);
+    json_writer_object_end(&writer);
+    if (QCLOUD_RET_SUCCESS == _send_reply(lan, &writer)) {
+        HAL_MutexLock(lan->lock);
+        lan->stats.status_cnt++;
+        HAL_MutexUnlock(lan->lock);
+    }
+}
+
+/**
+ * @brief verify and dispatch the datagram in rx_buf, drop it silently if it
+ * does not come from a holder of the key
+ */
+static void _handle_datagram(LanControl *lan, int len)
+{
+    char *    json     = lan->rx_buf + LAN_CONTROL_SIGN_LEN;
+    int       json_len = len - LAN_CONTROL_SIGN_LEN;
+    char      sign[LAN_CONTROL_SIGN_LEN];
+    uint32_t  seq, nonce;
+    bool      has_nonce;
+    JsonIndex index;
+    int       method_tok, token_tok, id_tok;
+
+    if (json_len <= 0) {
+        goto reject;
+    }
+    lan->rx_buf[len] = '\0';
+
+    utils_hmac_sha1(json, json_len, sign, lan->key, LAN_CONTROL_SIGN_LEN);
+    if (!_sign_equals(sign, lan->rx_buf)) {
+        Log_w("bad signature from %s:%u", lan->addr, lan->port);
+        goto reject;
+    }
+
+    if (json_index_parse(&index, json, json_len, lan->tokens, LAN_CONTROL_MAX_JSON_TOKENS) < 0) {
+        Log_w("invalid JSON from %s:%u", lan->addr, lan->port);
+        goto reject;
+    }
+
+    method_tok = json_index_get(&index, 0, METHOD_FIELD);
+    token_tok  = json_index_get(&index, 0, CLIENT_TOKEN_FIELD);
+    id_tok     = json_index_get(&index, 0, LAN_CONTROL_CLIENT_ID_FIELD);
+    if (method_tok < 0 || token_tok < 0 || id_tok < 0 || index.tokens[token_tok].type != JSSTRING ||
+        !index.tokens[id_tok].len || index.tokens[id_tok].len > LAN_CONTROL_CLIENT_ID_LEN ||
+        !_get_uint32(&index, json_index_get(&index, 0, LAN_CONTROL_SEQ_FIELD), &seq)) {
+        Log_w("invalid request from %s:%u", lan->addr, lan->port);
+        goto reject;
+    }
+
+    /* the seq is checked under the nonce only, a request of an earlier nonce may be a replay */
+    has_nonce = _get_uint32(&index, json_index_get(&index, 0, LAN_CONTROL_NONCE_FIELD), &nonce);
+    if (!has_nonce || nonce != lan->nonce ||
+        !_take_seq(lan, json_index_str(&index, id_tok), index.tokens[id_tok].len, seq)) {
+        if (has_nonce && nonce == lan->nonce) {
+            Log_w("replayed request from %s:%u", lan->addr, lan->port);
+        } else {
+            _reply_stale(lan, &index, method_tok, token_tok);
+        }
+        goto reject;
+    }
+
+    if (_method_is(&index, method_tok, CONTROL_CMD)) {
+        _handle_control(lan, &index, token_tok);
+        return;
+    }
+    if (_method_is(&index, method_tok, GET_STATUS)) {
+        _handle_get_status(lan, &index, token_tok);
+        return;
+    }
+    Log_w("unsupported method %.*s from %s:%u", index.tokens[method_tok].len, json_index_str(&index, method_tok),
+          lan->addr, lan->port);
+
+reject:
+    HAL_MutexLock(lan->lock);
+    lan->stats.reject_cnt++;
+    HAL_MutexUnlock(lan->lock);
+}
+
+static void _sync_reply_cb(void *pClient, Method method, ReplyAck replyAck, const char *pJsonDocument,
+                           void *pUserdata)
+{
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
+    LanControl *         lan       = (LanControl *)pTemplate->lan_control;
+    int                  i;
+
+    if (NULL == lan) {
+        return;
+    }
+
+    HAL_MutexLock(lan->lock);
+    if (ACK_ACCEPTED == replyAck) {
+        lan->stats.sync_cnt += lan->syncing_num;
+    } else {
+        Log_w("sync of LAN control failed: %d", replyAck);
+        lan->stats.sync_fail_cnt++;
+        for (i = 0; i < lan->syncing_num; i++) {
+            _mark_dirty(lan, lan->syncing[i]);
+        }
+        lan->sync_retry_ms = HAL_GetTimeMs() + LAN_CONTROL_SYNC_RETRY_MS;
+    }
+    lan->syncing_num   = 0;
+    lan->sync_inflight = false;
+    HAL_MutexUnlock(lan->lock);
+}
+
+/**
+ * @brief report the properties controlled over LAN, one report in flight at a time
+ */
+static void _sync_to_cloud(LanControl *lan)
+{
+    int rc, i;
+
+    HAL_MutexLock(lan->lock);
+    if (lan->sync_inflight || !lan->dirty_num || !_time_reached(lan->sync_retry_ms) ||
+        !IOT_Template_IsConnected(lan->pTemplate)) {
+        HAL_MutexUnlock(lan->lock);
+        return;
+    }
+    memcpy(lan->syncing, lan->dirty, lan->dirty_num * sizeof(DeviceProperty *));
+    lan->syncing_num   = lan->dirty_num;
+    lan->dirty_num     = 0;
+    lan->sync_inflight = true;
+    HAL_MutexUnlock(lan->lock);
+
+    rc = IOT_Template_Report_Array(lan->pTemplate, lan->syncing_num, lan->syncing, _sync_reply_cb, NULL,
+                                   lan->params.sync_timeout_ms);
+    if (rc == QCLOUD_RET_SUCCESS) {
+        return;
+    }
+
+    Log_w("sync of LAN control not sent: %d", rc);
+    HAL_MutexLock(lan->lock);
+    lan->stats.sync_fail_cnt++;
+    for (i = 0; i < lan->syncing_num; i++) {
+        _mark_dirty(lan, lan->syncing[i]);
+    }
+    lan->syncing_num   = 0;
+    lan->sync_inflight = false;
+    lan->sync_retry_ms = HAL_GetTimeMs() + LAN_CONTROL_SYNC_RETRY_MS;
+    HAL_MutexUnlock(lan->lock);
+}
+
+static void _lan_control_task(void *arg)
+{
+    LanControl *lan = (LanControl *)arg;
+    int         len;
+
+    while (lan->running) {
+        len = HAL_UDP_ReadTimeoutPeerInfo(lan->fd, (unsigned char *)lan->rx_buf, LAN_CONTROL_BUF_LEN,
+                                          LAN_CONTROL_POLL_MS, lan->addr, sizeof(lan->addr), &lan->port);
+        if (len > 0) {
+            _handle_datagram(lan, len);
+        } else if (len < 0) {
+            Log_w("LAN control read failed: %d", HAL_UDP_GetErrno());
+            HAL_SleepMs(LAN_CONTROL_ERR_SLEEP_MS);
+        }
+
+        _sync_to_cloud(lan);
+    }
+
+    lan->exit = true;
+}
+
+int IOT_Template_LanControl_Start(void *pClient, TemplateLanControlParams *pParams)
+{
+    static ThreadParams      thread_params  = {0};
+    TemplateLanControlParams default_params = DEFAULT_TEMPLATE_LAN_CONTROL_PARAMS;
+    Qcloud_IoT_Template *    pTemplate      = (Qcloud_IoT_Template *)pClient;
+    LanControl *             lan;
+    int                      rc;
+
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+
+    if (pTemplate->lan_control) {
+        return QCLOUD_RET_SUCCESS;
+    }
+    if (!pParams) {
+        pParams = &default_params;
+    }
+
+    lan = (LanControl *)HAL_Malloc(sizeof(LanControl));
+    if (!lan) {
+        Log_e("malloc LAN control failed");
+        return QCLOUD_ERR_MALLOC;
+    }
+    memset(lan, 0, sizeof(LanControl));
+    lan->pTemplate     = pTemplate;
+    lan->params        = *pParams;
+    lan->sync_retry_ms = HAL_GetTimeMs();
+
+    if (pParams->nonce_file) {
+        if (strlen(pParams->nonce_file) + sizeof(LAN_CONTROL_TMP_SUFFIX) > LAN_CONTROL_PATH_LEN) {
+            Log_e("LAN control nonce file path is too long");
+            HAL_Free(lan);
+            return QCLOUD_ERR_INVAL;
+        }
+        strcpy(lan->nonce_path, pParams->nonce_file);
+    }
+
+    rc = _derive_key(lan);
+    if (!rc) {
+        rc = _init_nonce(lan);
+    }
+    if (rc) {
+        HAL_Free(lan);
+        return rc;
+    }
+
+    lan->lock = HAL_MutexCreate();
+    if (!lan->lock) {
+        HAL_Free(lan);
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    lan->fd = HAL_UDP_CreateBind("0.0.0.0", pParams->port);
+    if (lan->fd <= 0) {
+        Log_e("bind LAN control port %u failed", pParams->port);
+        rc = QCLOUD_ERR_FAILURE;
+        goto err_exit;
+    }
+
+    pTemplate->lan_control    = lan;
+    lan->running              = true;
+    thread_params.thread_func = _lan_control_task;
+    thread_params.thread_name = LAN_CONTROL_TASK_NAME;
+    thread_params.user_arg    = lan;
+    thread_params.stack_size  = pParams->stack_size;
+    thread_params.priority    = pParams->priority;
+    rc                        = HAL_ThreadCreate(&thread_params);
+    if (rc) {
+        Log_e("create LAN control task failed: %d", rc);
+        pTemplate->lan_control = NULL;
+        rc                     = QCLOUD_ERR_FAILURE;
+        goto err_exit;
+    }
+
+    Log_i("LAN control listening on port %u", pParams->port);
+    return QCLOUD_RET_SUCCESS;
+
+err_exit:
+    if (lan->fd > 0) {
+        HAL_UDP_Close(lan->fd);
+    }
+    HAL_MutexDestroy(lan->lock);
+    HAL_Free(lan);
+    return rc;
+}
+
+void IOT_Template_LanControl_Stop(void *pClient)
+{
+    POINTER_SANITY_CHECK_RTN(pClient);
+
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
+    LanControl *         lan       = (LanControl *)pTemplate->lan_control;
+    int                  cnt       = 0;
+
+    if (!lan) {
+        return;
+    }
+
+    /* a sync reply from now on finds no service */
+    pTemplate->lan_control = NULL;
+    lan->running           = false;
+    while (!lan->exit && cnt++ < LAN_CONTROL_EXIT_WAIT_CNT) {
+        HAL_SleepMs(LAN_CONTROL_POLL_MS);
+    }
+
+    /* the task may still use the service, leave it */
+    if (!lan->exit) {
+        Log_e("LAN control task does not exit");
+        return;
+    }
+
+    HAL_UDP_Close(lan->fd);
+    HAL_MutexDestroy(lan->lock);
+    HAL_Free(lan);
+}
+
+int IOT_Template_LanControl_GetStats(void *pClient, TemplateLanControlStats *pStats)
+{
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pStats, QCLOUD_ERR_INVAL);
+
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
+    LanControl *         lan       = (LanControl *)pTemplate->lan_control;
+
+    if (!lan) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    HAL_MutexLock(lan->lock);
+    *pStats = lan->stats;
+    HAL_MutexUnlock(lan->lock);
+    return QCLOUD_RET_SUCCESS;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,573 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qcloud_iot_export.h"
+#include "qcloud_iot_import.h"
+
+#ifdef STATE_SNAPSHOT_ENABLED
+
+#include "data_template_snapshot.h"
+
+#include <string.h>
+
+#include "data_template_client_json.h"
+#include "utils_list.h"
+#include "utils_param_check.h"
+
+/* entry parsed from a record, key and value point into the record */
+typedef struct {
+    const char *   key;
+    uint8_t        key_len;
+    JsonDataType   type;
+    const uint8_t *value;
+    uint16_t       value_len;
+} SnapshotEntry;
+
+/* FNV-1a, never 0 which stands for no value journaled */
+static uint32_t _hash(const uint8_t *data, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    while (len--) {
+        hash = (hash ^ *data++) * 16777619u;
+    }
+
+    return hash ? hash : 1;
+}
+
+static void _put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static uint16_t _get_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static void _put_u32(uint8_t *p, uint32_t v)
+{
+    _put_u16(p, v & 0xFFFF);
+    _put_u16(p + 2, v >> 16);
+}
+
+static uint32_t _get_u32(const uint8_t *p)
+{
+    return _get_u16(p) | ((uint32_t)_get_u16(p + 2) << 16);
+}
+
+/* size of a fixed size value, 0 for the other types */
+static size_t _scalar_size(JsonDataType type)
+{
+    switch (type) {
+        case JINT32:
+        case JUINT32:
+            return sizeof(int32_t);
+        case JINT16:
+        case JUINT16:
+            return sizeof(int16_t);
+        case JINT8:
+        case JUINT8:
+            return sizeof(int8_t);
+        case JFLOAT:
+            return sizeof(float);
+        case JDOUBLE:
+            return sizeof(double);
+        case JBOOL:
+            return sizeof(bool);
+        default:
+            return 0;
+    }
+}
+
+static DeviceProperty *_struct_member(const DeviceProperty *pProperty, uint16_t i)
+{
+    return &((((sDataPoint *)(pProperty->data)) + i)->data_property);
+}
+
+static int _encode_entry(const DeviceProperty *pProperty, uint8_t *buf, size_t buf_len);
+
+/**
+ * @brief write the value of the property into buf
+ *
+ * @return length of the value, or -1 if it does not fit
+ */
+static int _encode_value(const DeviceProperty *pProperty, uint8_t *buf, size_t buf_len)
+{
+    const char *str = (const char *)pProperty->data;
+    size_t      len = 0;
+    uint16_t    i;
+    int         rc;
+
+    switch (pProperty->type) {
+        case JSTRING:
+        case JARRAY:
+            while (len < pProperty->data_buff_len && str[len]) {
+                len++;
+            }
+            break;
+        case JOBJECT:
+            for (i = 0; i < pProperty->struct_obj_num; i++) {
+                DeviceProperty *member = _struct_member(pProperty, i);
+                if (NULL == member->key) {
+                    continue;
+                }
+                rc = _encode_entry(member, buf + len, buf_len - len);
+                if (rc < 0) {
+                    return rc;
+                }
+                len += rc;
+            }
+            return len;
+        default:
+            len = _scalar_size(pProperty->type);
+            break;
+    }
+
+    if (len > buf_len) {
+        return -1;
+    }
+    memcpy(buf, pProperty->data, len);
+    return len;
+}
+
+/**
+ * @brief write the entry of the property into buf: key length, key, type,
+ * value length and value
+ *
+ * @return length of the entry, or -1 if it does not fit
+ */
+static int _encode_entry(const DeviceProperty *pProperty, uint8_t *buf, size_t buf_len)
+{
+    size_t key_len = strlen(pProperty->key);
+    size_t hdr_len = key_len + 4;
+    int    len;
+
+    if (key_len > 0xFF || hdr_len > buf_len) {
+        return -1;
+    }
+
+    len = _encode_value(pProperty, buf + hdr_len, buf_len - hdr_len);
+    if (len < 0 || len > 0xFFFF) {
+        return -1;
+    }
+
+    buf[0] = key_len;
+    memcpy(buf + 1, pProperty->key, key_len);
+    buf[hdr_len - 3] = pProperty->type;
+    _put_u16(buf + hdr_len - 2, len);
+    return hdr_len + len;
+}
+
+/**
+ * @brief parse the entry at the head of buf
+ *
+ * @return length of the entry, or -1 if it is malformed
+ */
+static int _parse_entry(const uint8_t *buf, size_t buf_len, SnapshotEntry *entry)
+{
+    size_t hdr_len;
+
+    if (buf_len < 1) {
+        return -1;
+    }
+    hdr_len = buf[0] + 4;
+    if (hdr_len > buf_len) {
+        return -1;
+    }
+
+    entry->key_len   = buf[0];
+    entry->key       = (const char *)buf + 1;
+    entry->type      = (JsonDataType)buf[hdr_len - 3];
+    entry->value_len = _get_u16(buf + hdr_len - 2);
+    entry->value     = buf + hdr_len;
+    if (entry->value_len > buf_len - hdr_len) {
+        return -1;
+    }
+
+    return hdr_len + entry->value_len;
+}
+
+static bool _key_equals(const SnapshotEntry *entry, const char *key)
+{
+    return NULL != key && strlen(key) == entry->key_len && !memcmp(key, entry->key, entry->key_len);
+}
+
+/**
+ * @brief set the property to the value of the entry
+ *
+ * @return false if the type or size of the entry does not match the property
+ */
+static bool _decode_value(const SnapshotEntry *entry, DeviceProperty *pProperty)
+{
+    SnapshotEntry member;
+    size_t        off, len;
+    uint16_t      i;
+    int           rc;
+
+    if (entry->type != pProperty->type) {
+        return false;
+    }
+
+    switch (pProperty->type) {
+        case JSTRING:
+        case JARRAY:
+            // the buffer holds data_buff_len chars and the terminator, as the JSON updates write it
+            len = (entry->value_len < pProperty->data_buff_len) ? entry->value_len : pProperty->data_buff_len;
+            memcpy(pProperty->data, entry->value, len);
+            ((char *)pProperty->data)[len] = '\0';
+            return true;
+        case JOBJECT:
+            for (off = 0; off < entry->value_len; off += rc) {
+                rc = _parse_entry(entry->value + off, entry->value_len - off, &member);
+                if (rc < 0) {
+                    return false;
+                }
+                for (i = 0; i < pProperty->struct_obj_num; i++) {
+                    if (_key_equals(&member, _struct_member(pProperty, i)->key)) {
+                        _decode_value(&member, _struct_member(pProperty, i));
+                        break;
+                    }
+                }
+            }
+            return true;
+        default:
+            len = _scalar_size(pProperty->type);
+            if (0 == len || len != entry->value_len) {
+                return false;
+            }
+            memcpy(pProperty->data, entry->value, len);
+            return true;
+    }
+}
+
+/**
+ * @brief write the record of the property into buf of the journal
+ *
+ * @return length of the record, or -1 if the property is too large to be journaled
+ */
+static int _encode_record(TemplateSnapshot *snapshot, const DeviceProperty *pProperty, uint32_t *hash)
+{
+    uint8_t *entry = snapshot->buf + STATE_SNAPSHOT_RECORD_HDR;
+    int      len   = _encode_entry(pProperty, entry, STATE_SNAPSHOT_ENTRY_LEN);
+
+    if (len < 0) {
+        return len;
+    }
+
+    *hash = _hash(entry, len);
+    _put_u16(snapshot->buf, len);
+    _put_u32(snapshot->buf + 2, *hash);
+    return STATE_SNAPSHOT_RECORD_HDR + len;
+}
+
+/**
+ * @brief rewrite the journal into a snapshot of the registered properties
+ *
+ * The snapshot is written to path.tmp and renamed over the journal, so a power
+ * cut leaves either the old journal or the new snapshot.
+ */
+static int _compact(Qcloud_IoT_Template *pTemplate, TemplateSnapshot *snapshot)
+{
+    char          tmp[STATE_SNAPSHOT_PATH_LEN];
+    ListIterator *iter;
+    ListNode *    node;
+    void *        fp;
+    uint32_t      size = 0;
+    uint32_t      hash;
+    int           len;
+    bool          ok = true;
+
+    if (snapshot->fp) {
+        HAL_FileClose(snapshot->fp);
+        snapshot->fp = NULL;
+    }
+    snapshot->broken = true;
+
+    HAL_Snprintf(tmp, sizeof(tmp), "%s%s", snapshot->path, STATE_SNAPSHOT_TMP_SUFFIX);
+    iter = qcloud_list_iterator_new(pTemplate->inner_data.property_handle_list, LIST_HEAD);
+    if (NULL == iter) {
+        return QCLOUD_ERR_MALLOC;
+    }
+    fp = HAL_FileOpen(tmp, "wb");
+    if (NULL == fp) {
+        Log_e("open %s failed", tmp);
+        qcloud_list_iterator_destroy(iter);
+        snapshot->stats.write_fail_cnt++;
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    while (ok && NULL != (node = qcloud_list_iterator_next(iter))) {
+        PropertyHandler *property_handle = (PropertyHandler *)node->val;
+        DeviceProperty * pProperty       = property_handle ? property_handle->property : NULL;
+        if (NULL == pProperty) {
+            continue;
+        }
+
+        property_handle->snapshot_hash = 0;
+        len                            = _encode_record(snapshot, pProperty, &hash);
+        if (len < 0) {
+            Log_w("property %s is too large to be journaled", pProperty->key);
+            continue;
+        }
+        ok                             = HAL_FileWrite(snapshot->buf, 1, len, fp) == (size_t)len;
+        property_handle->snapshot_hash = hash;
+        size += len;
+    }
+    qcloud_list_iterator_destroy(iter);
+
+    ok = !HAL_FileClose(fp) && ok;
+    if (!ok) {
+        HAL_FileRemove(tmp);
+    } else if (HAL_FileRename(tmp, snapshot->path)) {
+        // file systems which do not rename over a file, restore reads path.tmp while the journal is missing
+        HAL_FileRemove(snapshot->path);
+        ok = !HAL_FileRename(tmp, snapshot->path);
+    }
+    if (ok) {
+        snapshot->fp = HAL_FileOpen(snapshot->path, "ab");
+        ok           = NULL != snapshot->fp;
+    }
+    if (!ok) {
+        Log_e("rewrite state snapshot journal %s failed", snapshot->path);
+        snapshot->stats.write_fail_cnt++;
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    snapshot->size         = size;
+    snapshot->compact_size = size;
+    snapshot->broken       = false;
+    snapshot->stats.compact_cnt++;
+    return QCLOUD_RET_SUCCESS;
+}
+
+void template_snapshot_save(Qcloud_IoT_Template *pTemplate)
+{
+    TemplateSnapshot *snapshot = (TemplateSnapshot *)pTemplate->snapshot;
+    ListIterator *    iter;
+    ListNode *        node;
+    uint32_t          hash;
+    int               len;
+    bool              written = false;
+
+    if (NULL == snapshot) {
+        return;
+    }
+
+    // the snapshot has the current values, nothing is appended after it
+    if (snapshot->broken || snapshot->size - snapshot->compact_size >= STATE_SNAPSHOT_JOURNAL_LEN) {
+        _compact(pTemplate, snapshot);
+        return;
+    }
+
+    iter = qcloud_list_iterator_new(pTemplate->inner_data.property_handle_list, LIST_HEAD);
+    if (NULL == iter) {
+        return;
+    }
+    while (NULL != (node = qcloud_list_iterator_next(iter))) {
+        PropertyHandler *property_handle = (PropertyHandler *)node->val;
+        if (NULL == property_handle || NULL == property_handle->property) {
+            continue;
+        }
+
+        len = _encode_record(snapshot, property_handle->property, &hash);
+        if (len < 0 || hash == property_handle->snapshot_hash) {
+            continue;
+        }
+        if (HAL_FileWrite(snapshot->buf, 1, len, snapshot->fp) != (size_t)len) {
+            snapshot->broken = true;
+            break;
+        }
+        property_handle->snapshot_hash = hash;
+        snapshot->size += len;
+        snapshot->stats.record_cnt++;
+        written = true;
+    }
+    qcloud_list_iterator_destroy(iter);
+
+    if (written && !snapshot->broken && HAL_FileFlush(snapshot->fp)) {
+        snapshot->broken = true;
+    }
+    if (snapshot->broken) {
+        Log_e("write state snapshot journal %s failed", snapshot->path);
+        snapshot->stats.write_fail_cnt++;
+    }
+}
+
+bool template_snapshot_update_delta(Qcloud_IoT_Template *pTemplate, const JsonIndex *index, int val,
+                                    DeviceProperty *pProperty)
+{
+    TemplateSnapshot *snapshot = (TemplateSnapshot *)pTemplate->snapshot;
+    int               prev_len = _encode_value(pProperty, snapshot->prev, sizeof(snapshot->prev));
+    int               len;
+
+    if (!update_value_by_token(index, val, pProperty)) {
+        return false;
+    }
+
+    // a value too large to compare is taken as changed
+    len = _encode_value(pProperty, snapshot->buf, sizeof(snapshot->buf));
+    if (prev_len >= 0 && prev_len == len && !memcmp(snapshot->prev, snapshot->buf, len)) {
+        snapshot->stats.skip_cnt++;
+        return false;
+    }
+
+    snapshot->stats.delta_cnt++;
+    return true;
+}
+
+int IOT_Template_Snapshot_Restore(const char *path, uint8_t count, DeviceProperty *pDeviceProperties[])
+{
+    POINTER_SANITY_CHECK(path, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pDeviceProperties, QCLOUD_ERR_INVAL);
+
+    char          tmp[STATE_SNAPSHOT_PATH_LEN];
+    uint8_t       record[STATE_SNAPSHOT_RECORD_HDR + STATE_SNAPSHOT_ENTRY_LEN];
+    uint32_t      restored[STATE_SNAPSHOT_MAX_RESTORE / 32] = {0};
+    int           restored_num                              = 0;
+    uint8_t *     entry_buf                                 = record + STATE_SNAPSHOT_RECORD_HDR;
+    SnapshotEntry entry;
+    size_t        len;
+    void *        fp;
+    int           i;
+
+    fp = HAL_FileOpen(path, "rb");
+    if (NULL == fp) {
+        // the journal is missing only while a rewrite renames path.tmp to it
+        HAL_Snprintf(tmp, sizeof(tmp), "%s%s", path, STATE_SNAPSHOT_TMP_SUFFIX);
+        fp = HAL_FileOpen(tmp, "rb");
+        if (NULL == fp) {
+            Log_i("no state snapshot journal %s", path);
+            return 0;
+        }
+    }
+
+    while (HAL_FileRead(record, 1, STATE_SNAPSHOT_RECORD_HDR, fp) == STATE_SNAPSHOT_RECORD_HDR) {
+        len = _get_u16(record);
+        if (0 == len || len > STATE_SNAPSHOT_ENTRY_LEN || HAL_FileRead(entry_buf, 1, len, fp) != len ||
+            _hash(entry_buf, len) != _get_u32(record + 2) || _parse_entry(entry_buf, len, &entry) != (int)len) {
+            Log_w("state snapshot journal %s ends with a torn record", path);
+            break;
+        }
+
+        for (i = 0; i < count; i++) {
+            DeviceProperty *pProperty = pDeviceProperties[i];
+            if (NULL == pProperty || NULL == pProperty->data || !_key_equals(&entry, pProperty->key)) {
+                continue;
+            }
+            if (_decode_value(&entry, pProperty) && !(restored[i / 32] & (1u << (i % 32)))) {
+                restored[i / 32] |= 1u << (i % 32);
+                restored_num++;
+            }
+            break;
+        }
+    }
+    HAL_FileClose(fp);
+
+    Log_i("%d properties restored from %s", restored_num, path);
+    return restored_num;
+}
+
+int IOT_Template_Snapshot_Start(void *pClient, const char *path)
+{
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(path, QCLOUD_ERR_INVAL);
+
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
+    TemplateSnapshot *   snapshot;
+    int                  rc;
+
+    if (pTemplate->snapshot) {
+        return QCLOUD_RET_SUCCESS;
+    }
+    if (strlen(path) + sizeof(STATE_SNAPSHOT_TMP_SUFFIX) > STATE_SNAPSHOT_PATH_LEN) {
+        Log_e("state snapshot journal path too long: %s", path);
+        return QCLOUD_ERR_INVAL;
+    }
+
+    snapshot = (TemplateSnapshot *)HAL_Malloc(sizeof(TemplateSnapshot));
+    if (NULL == snapshot) {
+        Log_e("malloc state snapshot failed");
+        return QCLOUD_ERR_MALLOC;
+    }
+    memset(snapshot, 0, sizeof(TemplateSnapshot));
+    strncpy(snapshot->path, path, sizeof(snapshot->path) - 1);
+
+    HAL_MutexLock(pTemplate->mutex);
+    rc = _compact(pTemplate, snapshot);
+    if (QCLOUD_RET_SUCCESS == rc) {
+        pTemplate->snapshot = snapshot;
+    }
+    HAL_MutexUnlock(pTemplate->mutex);
+
+    if (rc) {
+        HAL_Free(snapshot);
+        return rc;
+    }
+
+    Log_i("state snapshot journal %s started, %u bytes", path, snapshot->size);
+    return QCLOUD_RET_SUCCESS;
+}
+
+void IOT_Template_Snapshot_Stop(void *pClient)
+{
+    POINTER_SANITY_CHECK_RTN(pClient);
+
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
+    TemplateSnapshot *   snapshot;
+
+    HAL_MutexLock(pTemplate->mutex);
+    snapshot            = (TemplateSnapshot *)pTemplate->snapshot;
+    pTemplate->snapshot = NULL;
+    HAL_MutexUnlock(pTemplate->mutex);
+
+    if (NULL == snapshot) {
+        return;
+    }
+
+    if (snapshot->fp) {
+        HAL_FileClose(snapshot->fp);
+    }
+    HAL_Free(snapshot);
+}
+
+int IOT_Template_Snapshot_GetStats(void *pClient, TemplateSnapshotStats *pStats)
+{
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pStats, QCLOUD_ERR_INVAL);
+
+    Qcloud_IoT_Template *pTemplate = (Qcloud_IoT_Template *)pClient;
+    int                  rc        = QCLOUD_ERR_FAILURE;
+
+    HAL_MutexLock(pTemplate->mutex);
+    if (pTemplate->snapshot) {
+        *pStats = ((TemplateSnapshot *)pTemplate->snapshot)->stats;
+        rc      = QCLOUD_RET_SUCCESS;
+    }
+    HAL_MutexUnlock(pTemplate->mutex);
+
+    return rc;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
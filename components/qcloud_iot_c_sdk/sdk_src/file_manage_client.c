@@ -33,6 +33,7 @@ extern "C" {
 
 #include "utils_timer.h"
 #include "utils_md5.h"
+#include "utils_download_cache.h"
 #include "utils_list.h"
 #include "utils_url_download.h"
 #include "utils_url_upload.h"
@@ -83,6 +84,8 @@ typedef struct {
     void *ch_signal; /* channel handle of signal exchanged with server */
     void *ch_fetch;  /* channel handle of download */
 
+    DownloadCacheSession cache; /* download cache session */
+
     int   request_id;
     void *mutex;
     List *file_wait_post_list;
@@ -311,6 +314,7 @@ static void _reset_handle_status(void *handle)
     pHandle->file_type = NULL;
 
     utils_md5_reset(pHandle->md5);
+    qcloud_download_cache_end(&pHandle->cache);
 }
 
 static int _file_manage_report_progress(void *handle, int progress, IOT_FILE_ReportType reportType)
@@ -856,6 +860,7 @@ int IOT_FileManage_Destroy(void *handle)
 
     qcloud_service_mqtt_event_register(eSERVICE_RESOURCE, NULL, NULL);
     qcloud_url_download_deinit(pHandle->ch_fetch);
+    qcloud_download_cache_end(&pHandle->cache);
     utils_md5_delete(pHandle->md5);
     if (pHandle->file_wait_post_list) {
         qcloud_list_destroy(pHandle->file_wait_post_list);
@@ -901,7 +906,8 @@ int IOT_FileManage_StartDownload(void *handle, uint32_t offset, uint32_t file_si
 
     FileManageHandle *pHandle = (FileManageHandle *)handle;
 
-    int ret;
+    uint32_t fetch_offset;
+    int      ret;
 
     Log_d("to download FW from offset: %u, size: %u", offset, file_size);
     pHandle->size_fetched = offset;
@@ -914,8 +920,16 @@ int IOT_FileManage_StartDownload(void *handle, uint32_t offset, uint32_t file_si
         }
     }
 
+    // the bytes in the download cache need no fetching
     qcloud_url_download_deinit(pHandle->ch_fetch);
-    pHandle->ch_fetch = qcloud_url_download_init(pHandle->url, offset, file_size, segment_size);
+    pHandle->ch_fetch = NULL;
+
+    fetch_offset = qcloud_download_cache_begin(&pHandle->cache, pHandle->md5sum, pHandle->size_file, offset);
+    if (fetch_offset >= file_size) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    pHandle->ch_fetch = qcloud_url_download_init(pHandle->url, fetch_offset, file_size, segment_size);
     if (!pHandle->ch_fetch) {
         Log_e("Initialize fetch module failed");
         return QCLOUD_ERR_FAILURE;
@@ -985,7 +999,13 @@ int IOT_FileManage_FetchYield(void *handle, char *buf, uint32_t buf_len, uint32_
         return QCLOUD_ERR_FAILURE;
     }
 
-    ret = qcloud_url_download_fetch(pHandle->ch_fetch, buf, buf_len, timeout_s);
+    ret = qcloud_download_cache_read(&pHandle->cache, buf, buf_len);
+    if (ret == 0) {
+        ret = qcloud_url_download_fetch(pHandle->ch_fetch, buf, buf_len, timeout_s);
+        if (ret > 0) {
+            qcloud_download_cache_write(&pHandle->cache, buf, ret);
+        }
+    }
     if (ret < 0) {
         pHandle->err = IOT_FILE_ERR_FETCH_FAILED;
         if (ret == QCLOUD_ERR_HTTP_AUTH) {  // OTA auth failed
@@ -1019,6 +1039,7 @@ int IOT_FileManage_FetchYield(void *handle, char *buf, uint32_t buf_len, uint32_
 
     if (pHandle->size_fetched >= pHandle->size_file) {
         pHandle->state = IOT_FILE_STATE_FETCHED;
+        qcloud_download_cache_end(&pHandle->cache);
     }
 
     utils_md5_update(pHandle->md5, (const unsigned char *)buf, ret);
@@ -1200,6 +1221,7 @@ int IOT_FileManage_Ioctl(void *handle, IOT_FILE_CmdType type, void *buf, size_t
                     *((uint32_t *)buf) = 1;
                 } else {
                     *((uint32_t *)buf) = 0;
+                    qcloud_download_cache_remove(pHandle->md5sum);
                     // report MD5 inconsistent
                     _file_manage_report_upgrade_result(pHandle, pHandle->version, IOT_FILE_TYPE_MD5_NOT_MATCH);
                 }
@@ -21,6 +21,7 @@
 
 #include <string.h>
 
+#include "gateway_automation.h"
 #include "gateway_common.h"
 #include "mqtt_client.h"
 #include "utils_param_check.h"
@@ -83,6 +84,7 @@ void _gateway_event_handler(void *client, void *context, MQTTEventMsg *msg)
             Log_d("gateway sub|unsub(%d) success, packet-id=%u", msg->event_type, (unsigned int)packet_id);
             if (gateway->gateway_data.sync_status == packet_id) {
                 gateway->gateway_data.sync_status = 0;
+                utils_completion_signal(&gateway->gateway_data.sync_done);
                 return;
             }
             break;
@@ -94,6 +96,7 @@ void _gateway_event_handler(void *client, void *context, MQTTEventMsg *msg)
             Log_d("gateway timeout|nack(%d) event, packet-id=%u", msg->event_type, (unsigned int)packet_id);
             if (gateway->gateway_data.sync_status == packet_id) {
                 gateway->gateway_data.sync_status = -1;
+                utils_completion_signal(&gateway->gateway_data.sync_done);
                 return;
             }
             break;
@@ -141,6 +144,21 @@ void *IOT_Gateway_Construct(GatewayInitParam *init_param)
 
     memset(gateway, 0, sizeof(Gateway));
 
+    gateway->lock = HAL_MutexCreate();
+    if (NULL == gateway->lock) {
+        Log_e("create gateway lock failed");
+        HAL_Free(gateway);
+        IOT_FUNC_EXIT_RC(NULL);
+    }
+
+    if (QCLOUD_RET_SUCCESS != request_table_init(&gateway->ops, GATEWAY_OP_POOL_SIZE)) {
+        Log_e("init sub-device operation table failed");
+        HAL_MutexDestroy(gateway->lock);
+        HAL_Free(gateway);
+        IOT_FUNC_EXIT_RC(NULL);
+    }
+    utils_completion_init(&gateway->gateway_data.sync_done);
+
     /* replace user event handle */
     gateway->event_handle.h_fp    = init_param->init_param.event_handle.h_fp;
     gateway->event_handle.context = init_param->init_param.event_handle.context;
@@ -153,6 +171,9 @@ void *IOT_Gateway_Construct(GatewayInitParam *init_param)
     gateway->mqtt = IOT_MQTT_Construct(&init_param->init_param);
     if (NULL == gateway->mqtt) {
         Log_e("construct MQTT failed");
+        utils_completion_deinit(&gateway->gateway_data.sync_done);
+        request_table_deinit(&gateway->ops);
+        HAL_MutexDestroy(gateway->lock);
         HAL_Free(gateway);
         IOT_FUNC_EXIT_RC(NULL);
     }
@@ -174,15 +195,28 @@ void *IOT_Gateway_Construct(GatewayInitParam *init_param)
     return (void *)gateway;
 }
 
+/* copy ids of the sub-device in param, the other members of DeviceInfo are not used by online and offline */
+static int _subdev_from_param(GatewayParam *param, DeviceInfo *subdev)
+{
+    if (strlen(param->subdev_product_id) > MAX_SIZE_OF_PRODUCT_ID ||
+        strlen(param->subdev_device_name) > MAX_SIZE_OF_DEVICE_NAME) {
+        Log_e("sub-device product_id or device_name too long");
+        return QCLOUD_ERR_INVAL;
+    }
+
+    memset(subdev, 0, sizeof(DeviceInfo));
+    strcpy(subdev->product_id, param->subdev_product_id);
+    strcpy(subdev->device_name, param->subdev_device_name);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
 int IOT_Gateway_Subdev_Online(void *client, GatewayParam *param)
 {
-    int            rc                                      = 0;
-    char           topic[MAX_SIZE_OF_CLOUD_TOPIC + 1]      = {0};
-    char           payload[GATEWAY_PAYLOAD_BUFFER_LEN + 1] = {0};
-    int            size                                    = 0;
-    SubdevSession *session                                 = NULL;
-    PublishParams  params                                  = DEFAULT_PUB_PARAMS;
-    Gateway *      gateway                                 = (Gateway *)client;
+    int        rc      = 0;
+    int32_t    result  = 0;
+    DeviceInfo subdev  = {0};
+    Gateway *  gateway = (Gateway *)client;
 
     POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
     POINTER_SANITY_CHECK(param, QCLOUD_ERR_INVAL);
@@ -192,68 +226,42 @@ int IOT_Gateway_Subdev_Online(void *client, GatewayParam *param)
     STRING_PTR_SANITY_CHECK(param->subdev_product_id, QCLOUD_ERR_INVAL);
     STRING_PTR_SANITY_CHECK(param->subdev_device_name, QCLOUD_ERR_INVAL);
 
-    session = subdev_find_session(gateway, param->subdev_product_id, param->subdev_device_name);
-    if (NULL == session) {
-        Log_d("there is no session, create a new session");
-
-        /* create subdev session */
-        session = subdev_add_session(gateway, param->subdev_product_id, param->subdev_device_name);
-        if (NULL == session) {
-            Log_e("create session error!");
-            IOT_FUNC_EXIT_RC(QCLOUD_ERR_GATEWAY_CREATE_SESSION_FAIL);
-        }
-    } else {
-        if (SUBDEV_SEESION_STATUS_ONLINE == session->session_status) {
-            Log_i("device have online");
-            IOT_FUNC_EXIT_RC(QCLOUD_ERR_GATEWAY_SUBDEV_ONLINE);
-        }
+    rc = _subdev_from_param(param, &subdev);
+    if (QCLOUD_RET_SUCCESS != rc) {
+        IOT_FUNC_EXIT_RC(rc);
     }
 
-    size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC + 1, GATEWAY_TOPIC_OPERATION_FMT, param->product_id,
-                        param->device_name);
-    if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC) {
-        Log_e("buf size < topic length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+    /* publish packet */
+    rc = gateway_subdev_operate_sync(gateway, param, eGATEWAY_SUBDEV_ONLINE, &subdev, &result, 1);
+    if (QCLOUD_ERR_FAILURE == rc && result < 0) {
+        rc = result;
     }
 
-    size = HAL_Snprintf(payload, GATEWAY_PAYLOAD_BUFFER_LEN + 1, GATEWAY_PAYLOAD_STATUS_FMT, GATEWAY_ONLINE_OP_STR,
-                        param->subdev_product_id, param->subdev_device_name);
-    if (size < 0 || size > GATEWAY_PAYLOAD_BUFFER_LEN) {
-        Log_e("buf size < payload length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
-    }
+    IOT_FUNC_EXIT_RC(rc);
+}
 
-    size = HAL_Snprintf(gateway->gateway_data.online.client_id, MAX_SIZE_OF_CLIENT_ID, GATEWAY_CLIENT_ID_FMT,
-                        param->subdev_product_id, param->subdev_device_name);
-    if (size < 0 || size > MAX_SIZE_OF_CLIENT_ID) {
-        Log_e("buf size < client_id length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
-    }
-    gateway->gateway_data.online.result = -2;
+int IOT_Gateway_Subdev_Online_Batch(void *client, GatewayParam *param, DeviceInfo *subdevs, int32_t *results,
+                                    int count)
+{
+    int      rc      = 0;
+    Gateway *gateway = (Gateway *)client;
 
-    params.qos         = QOS0;
-    params.payload_len = strlen(payload);
-    params.payload     = (char *)payload;
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(param, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(subdevs, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(results, QCLOUD_ERR_INVAL);
 
-    /* publish packet */
-    rc = gateway_publish_sync(gateway, topic, &params, &gateway->gateway_data.online.result);
-    if (QCLOUD_RET_SUCCESS != rc) {
-        subdev_remove_session(gateway, param->subdev_product_id, param->subdev_device_name);
-        IOT_FUNC_EXIT_RC(rc);
-    }
+    rc = gateway_subdev_operate_sync(gateway, param, eGATEWAY_SUBDEV_ONLINE, subdevs, results, count);
 
-    session->session_status = SUBDEV_SEESION_STATUS_ONLINE;
-    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+    IOT_FUNC_EXIT_RC(rc);
 }
 
 int IOT_Gateway_Subdev_Offline(void *client, GatewayParam *param)
 {
-    int            rc                                      = 0;
-    char           topic[MAX_SIZE_OF_CLOUD_TOPIC + 1]      = {0};
-    char           payload[GATEWAY_PAYLOAD_BUFFER_LEN + 1] = {0};
-    int            size                                    = 0;
-    SubdevSession *session                                 = NULL;
-    Gateway *      gateway                                 = (Gateway *)client;
+    int        rc      = 0;
+    int32_t    result  = 0;
+    DeviceInfo subdev  = {0};
+    Gateway *  gateway = (Gateway *)client;
 
     POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
     POINTER_SANITY_CHECK(param, QCLOUD_ERR_INVAL);
@@ -263,56 +271,34 @@ int IOT_Gateway_Subdev_Offline(void *client, GatewayParam *param)
     STRING_PTR_SANITY_CHECK(param->subdev_product_id, QCLOUD_ERR_INVAL);
     STRING_PTR_SANITY_CHECK(param->subdev_device_name, QCLOUD_ERR_INVAL);
 
-    session = subdev_find_session(gateway, param->subdev_product_id, param->subdev_device_name);
-    if (NULL == session) {
-        Log_d("no session, can not offline");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_GATEWAY_SESSION_NO_EXIST);
-    }
-    if (SUBDEV_SEESION_STATUS_OFFLINE == session->session_status) {
-        Log_i("device have offline");
-        /* free session */
-        subdev_remove_session(gateway, param->subdev_product_id, param->subdev_device_name);
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_GATEWAY_SUBDEV_OFFLINE);
-    }
-
-    size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC + 1, GATEWAY_TOPIC_OPERATION_FMT, param->product_id,
-                        param->device_name);
-    if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC) {
-        Log_e("buf size < topic length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+    rc = _subdev_from_param(param, &subdev);
+    if (QCLOUD_RET_SUCCESS != rc) {
+        IOT_FUNC_EXIT_RC(rc);
     }
 
-    size = HAL_Snprintf(payload, GATEWAY_PAYLOAD_BUFFER_LEN + 1, GATEWAY_PAYLOAD_STATUS_FMT, GATEWAY_OFFLIN_OP_STR,
-                        param->subdev_product_id, param->subdev_device_name);
-    if (size < 0 || size > GATEWAY_PAYLOAD_BUFFER_LEN) {
-        Log_e("buf size < payload length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+    /* publish packet */
+    rc = gateway_subdev_operate_sync(gateway, param, eGATEWAY_SUBDEV_OFFLINE, &subdev, &result, 1);
+    if (QCLOUD_ERR_FAILURE == rc && result < 0) {
+        rc = result;
     }
 
-    size = HAL_Snprintf(gateway->gateway_data.offline.client_id, MAX_SIZE_OF_CLIENT_ID, GATEWAY_CLIENT_ID_FMT,
-                        param->subdev_product_id, param->subdev_device_name);
-    if (size < 0 || size > MAX_SIZE_OF_CLIENT_ID) {
-        Log_e("buf size < client_id length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
-    }
-    gateway->gateway_data.offline.result = -2;
+    IOT_FUNC_EXIT_RC(rc);
+}
 
-    PublishParams params = DEFAULT_PUB_PARAMS;
-    params.qos           = QOS0;
-    params.payload_len   = strlen(payload);
-    params.payload       = (char *)payload;
+int IOT_Gateway_Subdev_Offline_Batch(void *client, GatewayParam *param, DeviceInfo *subdevs, int32_t *results,
+                                     int count)
+{
+    int      rc      = 0;
+    Gateway *gateway = (Gateway *)client;
 
-    /* publish packet */
-    rc = gateway_publish_sync(gateway, topic, &params, &gateway->gateway_data.offline.result);
-    if (QCLOUD_RET_SUCCESS != rc) {
-        IOT_FUNC_EXIT_RC(rc);
-    }
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(param, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(subdevs, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(results, QCLOUD_ERR_INVAL);
 
-    session->session_status = SUBDEV_SEESION_STATUS_OFFLINE;
-    /* free session */
-    subdev_remove_session(gateway, param->subdev_product_id, param->subdev_device_name);
+    rc = gateway_subdev_operate_sync(gateway, param, eGATEWAY_SUBDEV_OFFLINE, subdevs, results, count);
 
-    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+    IOT_FUNC_EXIT_RC(rc);
 }
 
 int IOT_Gateway_Subdev_GetBindList(void *client, GatewayParam *param, SubdevBindList *subdev_bindlist)
@@ -382,113 +368,67 @@ void IOT_Gateway_Subdev_DestoryBindList(SubdevBindList *subdev_bindlist)
 
 int IOT_Gateway_Subdev_Bind(void *client, GatewayParam *param, DeviceInfo *pBindSubDevInfo)
 {
-    char     topic[MAX_SIZE_OF_CLOUD_TOPIC + 1];
-    char     payload[GATEWAY_PAYLOAD_BUFFER_LEN + 1];
-    int      size    = 0;
+    int32_t  result  = SUBDEV_RESULT_PENDING;
     Gateway *gateway = (Gateway *)client;
 
-    memset(topic, 0, MAX_SIZE_OF_CLOUD_TOPIC);
-    size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC + 1, GATEWAY_TOPIC_OPERATION_FMT,
-                        STRING_PTR_PRINT_SANITY_CHECK(param->product_id),
-                        STRING_PTR_PRINT_SANITY_CHECK(param->device_name));
-    if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC) {
-        Log_e("buf size < topic length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
-    }
-
-    srand((unsigned)HAL_GetTimeMs());
-    int  nonce     = rand();
-    long timestamp = HAL_Timer_current_sec();
-
-    /*cal sign*/
-    char sign[SUBDEV_BIND_SIGN_LEN];
-    memset(sign, 0, SUBDEV_BIND_SIGN_LEN);
-    if (QCLOUD_RET_SUCCESS !=
-        subdev_bind_hmac_sha1_cal(pBindSubDevInfo, sign, SUBDEV_BIND_SIGN_LEN, nonce, timestamp)) {
-        Log_e("cal sign fail");
-        return QCLOUD_ERR_FAILURE;
-    }
-    memset(payload, 0, GATEWAY_PAYLOAD_BUFFER_LEN);
-#ifdef AUTH_MODE_CERT
-    size = HAL_Snprintf(payload, GATEWAY_PAYLOAD_BUFFER_LEN + 1, GATEWAY_PAYLOAD_OP_FMT, GATEWAY_BIND_OP_STR,
-                        pBindSubDevInfo->product_id, pBindSubDevInfo->device_name, sign, nonce, timestamp, "hmacsha1",
-                        "certificate");
-#else
-    size = HAL_Snprintf(payload, GATEWAY_PAYLOAD_BUFFER_LEN + 1, GATEWAY_PAYLOAD_OP_FMT, GATEWAY_BIND_OP_STR,
-                        pBindSubDevInfo->product_id, pBindSubDevInfo->device_name, sign, nonce, timestamp, "hmacsha1",
-                        "psk");
-#endif
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pBindSubDevInfo, QCLOUD_ERR_INVAL);
 
-    if (size < 0 || size > GATEWAY_PAYLOAD_BUFFER_LEN) {
-        Log_e("buf size < payload length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+    /* publish packet */
+    int rc = gateway_subdev_operate_sync(gateway, param, eGATEWAY_SUBDEV_BIND, pBindSubDevInfo, &result, 1);
+    if (QCLOUD_ERR_FAILURE == rc) {
+        IOT_FUNC_EXIT_RC(result);
     }
 
-    size = HAL_Snprintf(gateway->gateway_data.bind.client_id, MAX_SIZE_OF_CLIENT_ID, GATEWAY_CLIENT_ID_FMT,
-                        pBindSubDevInfo->product_id, pBindSubDevInfo->device_name);
-    if (size < 0 || size > MAX_SIZE_OF_CLIENT_ID) {
-        Log_e("buf size < client_id length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
-    }
+    IOT_FUNC_EXIT_RC(rc);
+}
 
-    PublishParams params = DEFAULT_PUB_PARAMS;
-    params.qos           = QOS0;
-    params.payload_len   = strlen(payload);
-    params.payload       = (char *)payload;
+int IOT_Gateway_Subdev_Bind_Batch(void *client, GatewayParam *param, DeviceInfo *subdevs, int32_t *results,
+                                  int count)
+{
+    Gateway *gateway = (Gateway *)client;
 
-    /* publish packet */
-    gateway->gateway_data.bind.result = -2;
-    int rc = gateway_publish_sync(gateway, topic, &params, &gateway->gateway_data.bind.result);
-    if (QCLOUD_RET_SUCCESS != rc) {
-        IOT_FUNC_EXIT_RC(gateway->gateway_data.bind.result);
-    }
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(subdevs, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(results, QCLOUD_ERR_INVAL);
 
-    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+    return gateway_subdev_operate_sync(gateway, param, eGATEWAY_SUBDEV_BIND, subdevs, results, count);
 }
 
 int IOT_Gateway_Subdev_Unbind(void *client, GatewayParam *param, DeviceInfo *pSubDevInfo)
 {
-    char     topic[MAX_SIZE_OF_CLOUD_TOPIC + 1];
-    char     payload[GATEWAY_PAYLOAD_BUFFER_LEN + 1];
-    int      size    = 0;
+    int32_t  result  = SUBDEV_RESULT_PENDING;
     Gateway *gateway = (Gateway *)client;
 
-    memset(topic, 0, MAX_SIZE_OF_CLOUD_TOPIC);
-    size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC + 1, GATEWAY_TOPIC_OPERATION_FMT,
-                        STRING_PTR_PRINT_SANITY_CHECK(param->product_id),
-                        STRING_PTR_PRINT_SANITY_CHECK(param->device_name));
-    if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC) {
-        Log_e("buf size < topic length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
-    }
-    memset(payload, 0, GATEWAY_PAYLOAD_BUFFER_LEN);
-    size = HAL_Snprintf(payload, GATEWAY_PAYLOAD_BUFFER_LEN + 1, GATEWAY_PAYLOAD_STATUS_FMT, GATEWAY_UNBIND_OP_STR,
-                        pSubDevInfo->product_id, pSubDevInfo->device_name);
-    if (size < 0 || size > GATEWAY_PAYLOAD_BUFFER_LEN) {
-        Log_e("buf size < payload length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
-    }
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pSubDevInfo, QCLOUD_ERR_INVAL);
 
-    size = HAL_Snprintf(gateway->gateway_data.unbind.client_id, MAX_SIZE_OF_CLIENT_ID, GATEWAY_CLIENT_ID_FMT,
-                        pSubDevInfo->product_id, pSubDevInfo->device_name);
-    if (size < 0 || size > MAX_SIZE_OF_CLIENT_ID) {
-        Log_e("buf size < client_id length!");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+    /* publish packet */
+    int rc = gateway_subdev_operate_sync(gateway, param, eGATEWAY_SUBDEV_UNBIND, pSubDevInfo, &result, 1);
+    if (QCLOUD_ERR_FAILURE == rc) {
+        IOT_FUNC_EXIT_RC(result);
     }
 
-    PublishParams params = DEFAULT_PUB_PARAMS;
-    params.qos           = QOS0;
-    params.payload_len   = strlen(payload);
-    params.payload       = (char *)payload;
+    IOT_FUNC_EXIT_RC(rc);
+}
 
-    /* publish packet */
-    gateway->gateway_data.unbind.result = -2;
-    int rc = gateway_publish_sync(gateway, topic, &params, &gateway->gateway_data.unbind.result);
-    if (QCLOUD_RET_SUCCESS != rc) {
-        IOT_FUNC_EXIT_RC(gateway->gateway_data.unbind.result);
+int IOT_Gateway_Subdev_Operate_Async(void *client, GatewayParam *param, GatewaySubdevOp op, DeviceInfo *subdevs,
+                                     int count, uint32_t timeout_ms, OnGatewaySubdevResult callback, void *user_data)
+{
+    Gateway *gateway = (Gateway *)client;
+
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(param, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(subdevs, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(callback, QCLOUD_ERR_INVAL);
+    NUMBERIC_SANITY_CHECK(count, QCLOUD_ERR_INVAL);
+
+    if (op < eGATEWAY_SUBDEV_ONLINE || op > eGATEWAY_SUBDEV_UNBIND) {
+        Log_e("invalid sub-device operation %d", op);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
     }
 
-    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+    return gateway_subdev_operate_async(gateway, param, op, subdevs, count, timeout_ms, callback, user_data);
 }
 
 void *IOT_Gateway_Get_Mqtt_Client(void *client)
@@ -504,14 +444,12 @@ int IOT_Gateway_Destroy(void *client)
     Gateway *gateway = (Gateway *)client;
     POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
 
-    SubdevSession *cur_session = gateway->session_list;
-    while (cur_session) {
-        SubdevSession *session = cur_session;
-        cur_session            = cur_session->next;
-        HAL_Free(session);
-    }
+    subdev_clear_sessions(gateway);
 
     IOT_MQTT_Destroy(&gateway->mqtt);
+    gateway_subdev_clear_ops(gateway);
+    utils_completion_deinit(&gateway->gateway_data.sync_done);
+    HAL_MutexDestroy(gateway->lock);
     HAL_Free(client);
 
     IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS)
@@ -522,7 +460,10 @@ int IOT_Gateway_Yield(void *client, uint32_t timeout_ms)
     Gateway *gateway = (Gateway *)client;
     POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
 
-    return IOT_MQTT_Yield(gateway->mqtt, timeout_ms);
+    int rc = IOT_MQTT_Yield(gateway->mqtt, timeout_ms);
+    gateway_subdev_expire_ops(gateway);
+
+    return rc;
 }
 
 int IOT_Gateway_Subscribe(void *client, char *topic_filter, SubscribeParams *params)
@@ -549,6 +490,54 @@ int IOT_Gateway_IsSubReady(void *client, char *topic_filter)
     return IOT_MQTT_IsSubReady(gateway->mqtt, topic_filter);
 }
 
+int IOT_Gateway_Route_Subscribe(void *client, char *topic_filter, int product_id_level, int device_name_level,
+                                QoS qos)
+{
+    SubscribeParams params  = DEFAULT_SUB_PARAMS;
+    Gateway *       gateway = (Gateway *)client;
+
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(topic_filter, QCLOUD_ERR_INVAL);
+
+    if (product_id_level < 0 || product_id_level > 0xFF || device_name_level < 0 || device_name_level > 0xFF ||
+        product_id_level == device_name_level) {
+        Log_e("invalid route levels %d %d", product_id_level, device_name_level);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+    }
+
+    params.qos                = qos;
+    params.on_message_handler = gateway_route_message_handler;
+    params.user_data          = GATEWAY_ROUTE_LEVELS(product_id_level, device_name_level);
+
+    return IOT_MQTT_Subscribe(gateway->mqtt, topic_filter, &params);
+}
+
+int IOT_Gateway_Route_Register(void *client, char *product_id, char *device_name, OnGatewaySubdevMessage handler,
+                               void *user_data)
+{
+    SubdevSession *session = NULL;
+    Gateway *      gateway = (Gateway *)client;
+
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_INVAL);
+
+    HAL_MutexLock(gateway->lock);
+    session = subdev_find_session(gateway, product_id, device_name);
+    if (session) {
+        session->handler      = handler;
+        session->handler_data = user_data;
+    }
+    HAL_MutexUnlock(gateway->lock);
+
+    if (NULL == session) {
+        Log_e("no session of %s/%s to route", product_id, device_name);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_GATEWAY_SESSION_NO_EXIST);
+    }
+
+    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+}
+
 int IOT_Gateway_Publish(void *client, char *topic_name, PublishParams *params)
 {
     Gateway *gateway = (Gateway *)client;
@@ -561,6 +550,9 @@ static int sg_gateway_automation_client_token_index = 1;
 
 #define GATEWAY_AUTOMATION_CLIENT_TOKEN_FORMAT "gatewayautomation-%s-%d"
 
+#define MAX_SIZE_OF_AUTOMATION_ID           (64)
+#define MAX_SIZE_OF_AUTOMATION_CLIENT_TOKEN (64)
+
 static void _gateway_automation_set_reply(void *client, char *client_token, char *automation_id, int code)
 {
     char payload[256] = {0};
@@ -589,39 +581,50 @@ static void _gateway_automation_del_reply(void *client, char *client_token, char
     qcloud_service_mqtt_post_msg(mqtt, payload, QOS0);
 }
 
+static bool _gateway_automation_get_str(const char *key, char *payload, char *buf, size_t buf_len)
+{
+    json_span_t value;
+
+    if (LITE_json_span_of(key, payload, strlen(payload), &value)) {
+        return false;
+    }
+    return LITE_span_get_string(buf, &value, buf_len) == QCLOUD_RET_SUCCESS;
+}
+
+/* payload is the writable copy made by service mqtt, params is terminated in place for the callback */
 static int _gateway_automation_set(bool reply, char *payload, void *user_data)
 {
-    char *automation_id = LITE_json_value_of("automationId", payload);
-    if (automation_id == NULL) {
+    char        automation_id[MAX_SIZE_OF_AUTOMATION_ID];
+    char        client_token[MAX_SIZE_OF_AUTOMATION_CLIENT_TOKEN];
+    json_span_t key_status, params;
+    int32_t     status;
+    char        last_char;
+
+    if (!_gateway_automation_get_str("automationId", payload, automation_id, sizeof(automation_id))) {
         Log_e("mation error id is null");
         return QCLOUD_ERR_FAILURE;
     }
 
-    char *key_status = LITE_json_value_of("status", payload);
-    char *params     = LITE_json_value_of("params", payload);
-
-    if (key_status == NULL || params == NULL) {
-        HAL_Free(key_status);
-        HAL_Free(params);
-        HAL_Free(automation_id);
+    if (LITE_json_span_of("status", payload, strlen(payload), &key_status) ||
+        LITE_json_span_of("params", payload, strlen(payload), &params) ||
+        LITE_span_get_int32(&status, &key_status)) {
         Log_e("mation error status and params is null");
         return QCLOUD_ERR_FAILURE;
     }
 
     QCLOUD_IO_GATEWAY_AUTOMATION_T *automation = (QCLOUD_IO_GATEWAY_AUTOMATION_T *)user_data;
 
-    int ret = automation->set_automation_callback(automation_id, atoi(key_status), params, automation->user_data);
+    backup_json_str_last_char(params.ptr, params.len, last_char);
+    int ret = automation->set_automation_callback(automation_id, status, (char *)params.ptr, automation->user_data);
+    restore_json_str_last_char(params.ptr, params.len, last_char);
 
     if (true == reply) {
-        char *client_token = LITE_json_value_of("clientToken", payload);
+        if (!_gateway_automation_get_str("clientToken", payload, client_token, sizeof(client_token))) {
+            client_token[0] = '\0';
+        }
         _gateway_automation_set_reply(automation->client, client_token, automation_id, ret);
-        HAL_Free(client_token);
     }
 
-    HAL_Free(key_status);
-    HAL_Free(params);
-    HAL_Free(automation_id);
-
     return ret;
 }
 
@@ -630,8 +633,10 @@ static void _gateway_automation_del(char *payload, void *user_data)
     POINTER_SANITY_CHECK_RTN(payload);
     POINTER_SANITY_CHECK_RTN(user_data);
 
-    char *automation_id = LITE_json_value_of("automationId", payload);
-    if (NULL == automation_id) {
+    char automation_id[MAX_SIZE_OF_AUTOMATION_ID];
+    char client_token[MAX_SIZE_OF_AUTOMATION_CLIENT_TOKEN];
+
+    if (!_gateway_automation_get_str("automationId", payload, automation_id, sizeof(automation_id))) {
         Log_e("Fail to parse params");
         return;
     }
@@ -639,16 +644,11 @@ static void _gateway_automation_del(char *payload, void *user_data)
 
     int ret = automation->del_automation_callback(automation_id, automation->user_data);
 
-    char *client_token = LITE_json_value_of("clientToken", payload);
-    if (NULL == client_token) {
+    if (!_gateway_automation_get_str("clientToken", payload, client_token, sizeof(client_token))) {
         Log_e("Fail to parse params");
-        goto exit;
+        return;
     }
     _gateway_automation_del_reply(automation->client, client_token, automation_id, ret);
-
-exit:
-    HAL_Free(automation_id);
-    HAL_Free(client_token);
 }
 
 static void _gateway_automation_list(char *payload, void *user_data)
@@ -656,15 +656,22 @@ static void _gateway_automation_list(char *payload, void *user_data)
     POINTER_SANITY_CHECK_RTN(payload);
     POINTER_SANITY_CHECK_RTN(user_data);
 
-    char *auto_list  = LITE_json_value_of("auto_list", payload);
-    char *pos        = NULL;
-    char *entry      = NULL;
-    int   entry_len  = 0;
-    int   entry_type = 0;
-    char  old_ch     = 0;
-    int   ret        = 0;
+    json_span_t auto_list;
+    char *      pos        = NULL;
+    char *      entry      = NULL;
+    int         entry_len  = 0;
+    int         entry_type = 0;
+    char        old_ch     = 0;
+    char        list_last_ch;
+    int         ret = 0;
+
+    if (LITE_json_span_of("auto_list", payload, strlen(payload), &auto_list) || auto_list.type != JSARRAY) {
+        Log_e("Fail to parse auto_list");
+        return;
+    }
 
-    json_array_for_each_entry(auto_list, pos, entry, entry_len, entry_type)
+    backup_json_str_last_char(auto_list.ptr, auto_list.len, list_last_ch);
+    json_array_for_each_entry((char *)auto_list.ptr, pos, entry, entry_len, entry_type)
     {
         if (!entry)
             continue;
@@ -672,11 +679,12 @@ static void _gateway_automation_list(char *payload, void *user_data)
         Log_d("list :%s", entry);
         // proc
         ret = _gateway_automation_set(false, entry, user_data);
+        restore_json_str_last_char(entry, entry_len, old_ch);
         if (QCLOUD_RET_SUCCESS != ret) {
             break;
         }
-        restore_json_str_last_char(entry, entry_len, old_ch);
     }
+    restore_json_str_last_char(auto_list.ptr, auto_list.len, list_last_ch);
 }
 
 static void _gateway_automation_callback(void *user_data, const char *payload, unsigned int payload_len)
@@ -693,20 +701,23 @@ static void _gateway_automation_callback(void *user_data, const char *payload, u
 
     Log_d("recv: %s", payload);
 
-    char *method = LITE_json_value_of("method", (char *)payload);
+    json_span_t method;
+
+    if (LITE_json_span_of("method", payload, payload_len, &method) || method.type != JSSTRING) {
+        Log_e("Fail to parse method");
+        return;
+    }
 
-    if (0 == strncmp(method, METHOD_GATEWAY_AUTOMATION_SET, sizeof(METHOD_GATEWAY_AUTOMATION_SET) - 1)) {
+    if (LITE_span_equal(&method, METHOD_GATEWAY_AUTOMATION_SET)) {
         // set auto mation
         _gateway_automation_set(true, (char *)payload, user_data);
-    } else if (0 == strncmp(method, METHOD_GATEWAY_AUTOMATION_DEL, sizeof(METHOD_GATEWAY_AUTOMATION_DEL) - 1)) {
+    } else if (LITE_span_equal(&method, METHOD_GATEWAY_AUTOMATION_DEL)) {
         // delete auto mation
         _gateway_automation_del((char *)payload, user_data);
-    } else if (0 == strncmp(method, METHOD_GATEWAY_AUTOMATION_LIST, sizeof(METHOD_GATEWAY_AUTOMATION_LIST) - 1)) {
+    } else if (LITE_span_equal(&method, METHOD_GATEWAY_AUTOMATION_LIST)) {
         // proc auto mation list
         _gateway_automation_list((char *)payload, user_data);
     }
-
-    HAL_Free(method);
 }
 
 int IOT_Gateway_LocalAutoMationLogCreate(char *json_buf, int buf_len, void *client, char *automation_id, char *log_json)
@@ -768,3 +779,62 @@ int IOT_Gateway_EnableLocalAutoMation(void *client, QCLOUD_IO_GATEWAY_AUTOMATION
 
     return qcloud_service_mqtt_init(mqtt->device_info.product_id, mqtt->device_info.device_name, mqtt);
 }
+
+#ifdef GATEWAY_AUTOMATION_ENABLED
+static int _gateway_automation_engine_set(char *automation_id, int status, char *params, void *user_data)
+{
+    return IOT_Gateway_AutoMation_Set(user_data, automation_id, status, params);
+}
+
+static int _gateway_automation_engine_del(char *automation_id, void *user_data)
+{
+    return IOT_Gateway_AutoMation_Delete(user_data, automation_id);
+}
+
+static void _gateway_automation_engine_report(void *client, const char *automation_id, int result)
+{
+    char log_json[32];
+    char json_buf[256];
+    int  len;
+
+    HAL_Snprintf(log_json, sizeof(log_json), "{\"result\":%d}", result);
+    len = IOT_Gateway_LocalAutoMationLogCreate(json_buf, sizeof(json_buf), client, (char *)automation_id, log_json);
+    if (len < 0 || len >= (int)sizeof(json_buf)) {
+        Log_e("automation %s log too long", automation_id);
+        return;
+    }
+
+    IOT_Gateway_LocalAutoMationReportLog(client, json_buf, len);
+}
+
+int IOT_Gateway_AutoMation_Attach(void *client, void *engine)
+{
+    IOT_FUNC_ENTRY;
+
+    AutomationEngine *automation = (AutomationEngine *)engine;
+    int               rc;
+
+    POINTER_SANITY_CHECK(client, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(automation, QCLOUD_ERR_INVAL);
+
+    automation->cloud.client                  = client;
+    automation->cloud.user_data               = automation;
+    automation->cloud.set_automation_callback = _gateway_automation_engine_set;
+    automation->cloud.del_automation_callback = _gateway_automation_engine_del;
+
+    HAL_MutexLock(automation->lock);
+    automation->client = client;
+    automation->report = _gateway_automation_engine_report;
+    HAL_MutexUnlock(automation->lock);
+
+    rc = IOT_Gateway_EnableLocalAutoMation(client, &automation->cloud);
+    if (rc < 0) {
+        Log_e("enable local automation failed: %d", rc);
+        IOT_FUNC_EXIT_RC(rc);
+    }
+
+    rc = IOT_Gateway_GetAutoMationList(client);
+
+    IOT_FUNC_EXIT_RC(rc < 0 ? rc : QCLOUD_RET_SUCCESS);
+}
+#endif
@@ -0,0 +1,1011 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gateway_automation.h"
+
+#ifdef GATEWAY_AUTOMATION_ENABLED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_parser.h"
+#include "lite-utils.h"
+#include "qcloud_iot_import.h"
+#include "utils_param_check.h"
+
+/* conditions are aligned for their double operand */
+#define AUTOMATION_ALIGN(size) (((size) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+
+static const char *sg_automation_op_str[] = {"eq", "ne", "gt", "ge", "lt", "le"};
+
+typedef struct {
+    AutomationEngine *engine;
+    AutomationRule *  rule;     // NULL while sizing
+    char *            str_pos;  // next free byte of the strings of rule
+    size_t            str_len;  // bytes of the strings
+    int               num;      // entries walked
+} AutomationCompile;
+
+typedef int (*AutomationEntryParser)(AutomationCompile *compile, const char *entry, size_t entry_len);
+
+static const char *_rule_get_key(void *val)
+{
+    return ((AutomationRule *)val)->id;
+}
+
+static const char *_slot_get_key(void *val)
+{
+    return ((AutomationSlot *)val)->key;
+}
+
+/* arrays grow by doubling, HAL has no realloc */
+static int _automation_grow(void **array, uint16_t *cap, size_t elem_size, int need, int max)
+{
+    int   cap_new = *cap ? *cap : 8;
+    void *array_new;
+
+    if (need <= *cap) {
+        return QCLOUD_RET_SUCCESS;
+    }
+    if (need > max) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    while (cap_new < need) {
+        cap_new <<= 1;
+    }
+    if (cap_new > max) {
+        cap_new = max;
+    }
+
+    array_new = HAL_Malloc(cap_new * elem_size);
+    if (!array_new) {
+        return QCLOUD_ERR_MALLOC;
+    }
+    if (*array) {
+        memcpy(array_new, *array, *cap * elem_size);
+        HAL_Free(*array);
+    }
+
+    *array = array_new;
+    *cap   = cap_new;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static int _automation_index_build(HashIndex *index, void ***storage, uint16_t *storage_num, void **vals, int num,
+                                   HashIndexGetKey get_key)
+{
+    uint16_t slot_num = hash_index_slot_num(num);
+    int      i;
+
+    if (slot_num > *storage_num) {
+        void **storage_new = HAL_Malloc(slot_num * sizeof(void *));
+        if (!storage_new) {
+            return QCLOUD_ERR_MALLOC;
+        }
+        HAL_Free(*storage);
+        *storage     = storage_new;
+        *storage_num = slot_num;
+    }
+
+    hash_index_init(index, *storage, slot_num, get_key);
+    for (i = 0; i < num; i++) {
+        hash_index_add(index, vals[i]);
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* add to the index if it has room for one more at half load, rebuild it later otherwise */
+static void _automation_index_add(HashIndex *index, bool *dirty, void *val)
+{
+    if (*dirty || !index->slots || (index->count + 1) * 2 > index->mask + 1 ||
+        hash_index_add(index, val) != QCLOUD_RET_SUCCESS) {
+        *dirty = true;
+    }
+}
+
+static AutomationRule *_rule_find(AutomationEngine *engine, const char *id)
+{
+    if (engine->rule_index_dirty) {
+        if (_automation_index_build(&engine->rule_index, &engine->rule_slots, &engine->rule_slot_num,
+                                    (void **)engine->rules, engine->rule_num, _rule_get_key)) {
+            return NULL;
+        }
+        engine->rule_index_dirty = false;
+    }
+
+    return hash_index_find(&engine->rule_index, id, strlen(id));
+}
+
+static AutomationSlot *_slot_find(AutomationEngine *engine, const char *key, size_t key_len)
+{
+    if (engine->slot_index_dirty) {
+        if (_automation_index_build(&engine->slot_index, &engine->slot_slots, &engine->slot_slot_num,
+                                    (void **)engine->slots, engine->slot_num, _slot_get_key)) {
+            return NULL;
+        }
+        engine->slot_index_dirty = false;
+    }
+
+    return hash_index_find(&engine->slot_index, key, key_len);
+}
+
+static int _slot_key(char *key, const char *product_id, const char *device_name, const char *property,
+                     size_t property_len)
+{
+    size_t pid_len = strlen(product_id);
+    size_t dn_len  = strlen(device_name);
+
+    if (pid_len + dn_len + property_len + 3 > GATEWAY_AUTOMATION_KEY_LEN) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    memcpy(key, product_id, pid_len);
+    key[pid_len] = '/';
+    memcpy(key + pid_len + 1, device_name, dn_len);
+    key[pid_len + 1 + dn_len] = '/';
+    memcpy(key + pid_len + dn_len + 2, property, property_len);
+    key[pid_len + dn_len + 2 + property_len] = '\0';
+
+    return pid_len + dn_len + 2 + property_len;
+}
+
+/* slot index of key, the slot is added if missing */
+static int _slot_get(AutomationEngine *engine, const char *key)
+{
+    AutomationSlot *slot = _slot_find(engine, key, strlen(key));
+
+    if (slot) {
+        return slot->index;
+    }
+
+    if (_automation_grow((void **)&engine->slots, &engine->slot_cap, sizeof(AutomationSlot *), engine->slot_num + 1,
+                         GATEWAY_AUTOMATION_MAX_SLOTS)) {
+        Log_e("too many properties in automations");
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    slot = HAL_Malloc(sizeof(AutomationSlot) + strlen(key) + 1);
+    if (!slot) {
+        return QCLOUD_ERR_MALLOC;
+    }
+    memset(slot, 0, sizeof(AutomationSlot));
+    strcpy(slot->key, key);
+    slot->index = engine->slot_num;
+
+    engine->slots[engine->slot_num] = slot;
+    _automation_index_add(&engine->slot_index, &engine->slot_index_dirty, slot);
+
+    return engine->slot_num++;
+}
+
+static bool _cond_compare(const AutomationCond *cond, double value)
+{
+    switch (cond->op) {
+        case eAUTOMATION_OP_EQ:
+            return value == cond->value;
+        case eAUTOMATION_OP_NE:
+            return value != cond->value;
+        case eAUTOMATION_OP_GT:
+            return value > cond->value;
+        case eAUTOMATION_OP_GE:
+            return value >= cond->value;
+        case eAUTOMATION_OP_LT:
+            return value < cond->value;
+        default:
+            return value <= cond->value;
+    }
+}
+
+static bool _rule_in_window(AutomationEngine *engine, const AutomationRule *rule)
+{
+    uint32_t now;
+    uint16_t minute;
+
+    if (rule->days == GATEWAY_AUTOMATION_ALL_DAYS && rule->begin_min == 0 &&
+        rule->end_min == GATEWAY_AUTOMATION_MINUTES_OF_DAY - 1) {
+        return true;
+    }
+
+    /* no clock yet */
+    if (engine->last_minute < 0) {
+        return false;
+    }
+
+    now    = engine->local_time + (HAL_GetTimeMs() - engine->local_time_ms) / 1000;
+    minute = (now / 60) % GATEWAY_AUTOMATION_MINUTES_OF_DAY;
+
+    /* 1970-01-01 is Thursday */
+    if (!(rule->days & (1 << ((now / 86400 + 4) % 7)))) {
+        return false;
+    }
+
+    if (rule->begin_min <= rule->end_min) {
+        return minute >= rule->begin_min && minute <= rule->end_min;
+    }
+
+    return minute >= rule->begin_min || minute <= rule->end_min;
+}
+
+static void _rule_fire(AutomationEngine *engine, AutomationRule *rule)
+{
+    int result = QCLOUD_RET_SUCCESS;
+    int rc;
+    int i;
+
+    if (!rule->status || !_rule_in_window(engine, rule)) {
+        return;
+    }
+
+    Log_d("automation %s fired", rule->id);
+
+    for (i = 0; i < rule->action_num; i++) {
+        rc = engine->action(rule->id, rule->actions[i].product_id, rule->actions[i].device_name,
+                            rule->actions[i].data, engine->user_data);
+        if (rc && !result) {
+            result = rc;
+        }
+    }
+
+    if (engine->report) {
+        engine->report(engine->client, rule->id, result);
+    }
+}
+
+static bool _rule_matched(const AutomationRule *rule, bool timer)
+{
+    if (rule->match_any) {
+        return true;
+    }
+
+    return rule->true_num == rule->prop_num && (timer || !rule->timer_num);
+}
+
+/* settle every condition on the slot before checking rules, a rule may have several of them */
+static void _slot_settle(AutomationSlot *slot, double value, uint32_t seq)
+{
+    AutomationRule *rule;
+    AutomationCond *cond;
+    bool            is_true;
+    int             i;
+
+    slot->value = value;
+    slot->valid = 1;
+
+    for (i = 0; i < slot->dep_num; i++) {
+        rule    = slot->deps[i].rule;
+        cond    = &rule->conds[slot->deps[i].cond];
+        is_true = _cond_compare(cond, value);
+        if (is_true == cond->is_true) {
+            continue;
+        }
+
+        cond->is_true = is_true;
+        if (is_true) {
+            rule->true_num++;
+            rule->rise_seq = seq;
+        } else {
+            rule->true_num--;
+        }
+    }
+}
+
+static void _slot_check(AutomationEngine *engine, AutomationSlot *slot, uint32_t seq)
+{
+    AutomationRule *rule;
+    int             i;
+
+    for (i = 0; i < slot->dep_num; i++) {
+        rule = slot->deps[i].rule;
+        if (rule->rise_seq != seq || rule->fire_seq == seq) {
+            continue;
+        }
+
+        rule->fire_seq = seq;
+        if (_rule_matched(rule, false)) {
+            _rule_fire(engine, rule);
+        }
+    }
+}
+
+static int _timer_compare(const void *a, const void *b)
+{
+    return (int)((const AutomationTimer *)a)->minute - (int)((const AutomationTimer *)b)->minute;
+}
+
+static int _timers_build(AutomationEngine *engine)
+{
+    AutomationTimer *timers = NULL;
+    AutomationRule * rule;
+    int              num = 0;
+    int              i, j;
+
+    for (i = 0; i < engine->rule_num; i++) {
+        num += engine->rules[i]->timer_num;
+    }
+
+    if (num) {
+        timers = HAL_Malloc(num * sizeof(AutomationTimer));
+        if (!timers) {
+            return QCLOUD_ERR_MALLOC;
+        }
+    }
+
+    num = 0;
+    for (i = 0; i < engine->rule_num; i++) {
+        rule = engine->rules[i];
+        for (j = 0; rule->timer_num && j < rule->cond_num; j++) {
+            if (rule->conds[j].type == eAUTOMATION_COND_TIMER) {
+                timers[num].rule   = rule;
+                timers[num].minute = rule->conds[j].slot;
+                timers[num].cond   = j;
+                num++;
+            }
+        }
+    }
+    qsort(timers, num, sizeof(AutomationTimer), _timer_compare);
+
+    HAL_Free(engine->timers);
+    engine->timers       = timers;
+    engine->timer_num    = num;
+    engine->timers_dirty = false;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* minutes since 1970-01-01 00:00 local time */
+static void _timers_run(AutomationEngine *engine, uint32_t minutes)
+{
+    uint16_t         minute = minutes % GATEWAY_AUTOMATION_MINUTES_OF_DAY;
+    uint8_t          day    = 1 << ((minutes / GATEWAY_AUTOMATION_MINUTES_OF_DAY + 4) % 7);
+    AutomationTimer *timer;
+    int              low  = 0;
+    int              high = engine->timer_num;
+    int              mid;
+
+    /* first timer at or after minute */
+    while (low < high) {
+        mid = (low + high) / 2;
+        if (engine->timers[mid].minute < minute) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    for (; low < engine->timer_num && engine->timers[low].minute == minute; low++) {
+        timer = &engine->timers[low];
+        if ((timer->rule->conds[timer->cond].op & day) && _rule_matched(timer->rule, true)) {
+            _rule_fire(engine, timer->rule);
+        }
+    }
+}
+
+static int _parse_minute(const json_span_t *span, uint16_t *minute)
+{
+    char time[6];
+    int  hour, min;
+
+    if (span->type != JSSTRING || LITE_span_get_string(time, span, sizeof(time)) ||
+        sscanf(time, "%d:%d", &hour, &min) != 2 || hour < 0 || hour > 23 || min < 0 || min > 59) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    *minute = hour * 60 + min;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static int _parse_days(const json_span_t *span, uint8_t *days)
+{
+    size_t i;
+
+    if (span->type != JSSTRING || span->len != 7) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    *days = 0;
+    for (i = 0; i < span->len; i++) {
+        if (span->ptr[i] == '1') {
+            *days |= 1 << i;
+        } else if (span->ptr[i] != '0') {
+            return QCLOUD_ERR_FAILURE;
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static int _parse_string(const char *key, const char *entry, size_t entry_len, char *buf, size_t buf_len)
+{
+    json_span_t span;
+
+    if (LITE_json_span_of(key, entry, entry_len, &span) || span.type != JSSTRING) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    return LITE_span_get_string(buf, &span, buf_len);
+}
+
+static int _parse_cond(AutomationCompile *compile, const char *entry, size_t entry_len)
+{
+    AutomationCond *cond;
+    json_span_t     span;
+    uint8_t         type = eAUTOMATION_COND_PROPERTY;
+    char            product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char            device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    char            property[GATEWAY_AUTOMATION_MAX_PROPERTY + 1];
+    char            key[GATEWAY_AUTOMATION_KEY_LEN];
+    bool            bool_value;
+    int             slot;
+
+    if (!compile->rule) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    cond = &compile->rule->conds[compile->num];
+    memset(cond, 0, sizeof(AutomationCond));
+
+    if (!LITE_json_span_of("type", entry, entry_len, &span) && LITE_span_get_uint8(&type, &span)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    cond->type = type;
+
+    if (type == eAUTOMATION_COND_TIMER) {
+        cond->op = GATEWAY_AUTOMATION_ALL_DAYS;
+        if (!LITE_json_span_of("days", entry, entry_len, &span) && _parse_days(&span, &cond->op)) {
+            return QCLOUD_ERR_FAILURE;
+        }
+        if (LITE_json_span_of("time", entry, entry_len, &span) || _parse_minute(&span, &cond->slot)) {
+            return QCLOUD_ERR_FAILURE;
+        }
+        compile->rule->timer_num++;
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    if (type != eAUTOMATION_COND_PROPERTY ||
+        _parse_string("productId", entry, entry_len, product_id, sizeof(product_id)) ||
+        _parse_string("deviceName", entry, entry_len, device_name, sizeof(device_name)) ||
+        _parse_string("propertyId", entry, entry_len, property, sizeof(property)) ||
+        LITE_json_span_of("op", entry, entry_len, &span)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    for (cond->op = 0; cond->op < sizeof(sg_automation_op_str) / sizeof(sg_automation_op_str[0]); cond->op++) {
+        if (span.type == JSSTRING && LITE_span_equal(&span, sg_automation_op_str[cond->op])) {
+            break;
+        }
+    }
+    if (cond->op > eAUTOMATION_OP_LE || LITE_json_span_of("value", entry, entry_len, &span)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    if (span.type == JSBOOLEAN) {
+        if (LITE_span_get_boolean(&bool_value, &span)) {
+            return QCLOUD_ERR_FAILURE;
+        }
+        cond->value = bool_value;
+    } else if (span.type != JSNUMBER || LITE_span_get_double(&cond->value, &span)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    _slot_key(key, product_id, device_name, property, strlen(property));
+    slot = _slot_get(compile->engine, key);
+    if (slot < 0) {
+        return slot;
+    }
+
+    cond->slot = slot;
+    compile->rule->prop_num++;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* copy a string of the action into the allocation of the rule, or size it */
+static int _action_string(AutomationCompile *compile, const char *key, const char *entry, size_t entry_len,
+                          bool raw, const char **str)
+{
+    json_span_t span;
+
+    if (LITE_json_span_of(key, entry, entry_len, &span) || (!raw && span.type != JSSTRING)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    if (!compile->rule) {
+        compile->str_len += span.len + 1;
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    *str = compile->str_pos;
+    if (span.type == JSSTRING) {
+        LITE_span_get_string(compile->str_pos, &span, span.len + 1);
+    } else {
+        memcpy(compile->str_pos, span.ptr, span.len);
+        compile->str_pos[span.len] = '\0';
+    }
+    compile->str_pos += strlen(compile->str_pos) + 1;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static int _parse_action(AutomationCompile *compile, const char *entry, size_t entry_len)
+{
+    AutomationAction *action = compile->rule ? &compile->rule->actions[compile->num] : NULL;
+
+    if (_action_string(compile, "productId", entry, entry_len, false, action ? &action->product_id : NULL) ||
+        _action_string(compile, "deviceName", entry, entry_len, false, action ? &action->device_name : NULL) ||
+        _action_string(compile, "data", entry, entry_len, true, action ? &action->data : NULL)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static int _automation_walk(AutomationCompile *compile, const json_span_t *array, AutomationEntryParser parser,
+                            int max)
+{
+    char *pos;
+    char *entry;
+    int   entry_len;
+    int   entry_type;
+    char  last_char;
+    int   rc = QCLOUD_RET_SUCCESS;
+
+    compile->num = 0;
+
+    backup_json_str_last_char(array->ptr, array->len, last_char);
+    json_array_for_each_entry((char *)array->ptr, pos, entry, entry_len, entry_type)
+    {
+        if (!entry || entry_type != JSOBJECT || compile->num >= max) {
+            rc = QCLOUD_ERR_FAILURE;
+            break;
+        }
+        rc = parser(compile, entry, entry_len);
+        if (rc) {
+            break;
+        }
+        compile->num++;
+    }
+    restore_json_str_last_char(array->ptr, array->len, last_char);
+
+    if (!rc && !compile->num) {
+        rc = QCLOUD_ERR_FAILURE;
+    }
+
+    return rc;
+}
+
+static void _rule_unlink(AutomationEngine *engine, AutomationRule *rule)
+{
+    AutomationSlot *slot;
+    int             i, j;
+
+    for (i = 0; i < rule->cond_num; i++) {
+        if (rule->conds[i].type != eAUTOMATION_COND_PROPERTY) {
+            continue;
+        }
+
+        slot = engine->slots[rule->conds[i].slot];
+        for (j = 0; j < slot->dep_num;) {
+            if (slot->deps[j].rule == rule) {
+                slot->deps[j] = slot->deps[--slot->dep_num];
+            } else {
+                j++;
+            }
+        }
+    }
+
+    if (rule->timer_num) {
+        engine->timers_dirty = true;
+    }
+}
+
+static int _rule_link(AutomationEngine *engine, AutomationRule *rule)
+{
+    AutomationSlot *slot;
+    AutomationCond *cond;
+    int             i;
+
+    for (i = 0; i < rule->cond_num; i++) {
+        cond = &rule->conds[i];
+        if (cond->type != eAUTOMATION_COND_PROPERTY) {
+            continue;
+        }
+
+        slot = engine->slots[cond->slot];
+        if (_automation_grow((void **)&slot->deps, &slot->dep_cap, sizeof(AutomationDep), slot->dep_num + 1,
+                             0xFFFF)) {
+            _rule_unlink(engine, rule);
+            return QCLOUD_ERR_MALLOC;
+        }
+        slot->deps[slot->dep_num].rule = rule;
+        slot->deps[slot->dep_num].cond = i;
+        slot->dep_num++;
+
+        /* start from the known value without firing */
+        cond->is_true = slot->valid && _cond_compare(cond, slot->value);
+        rule->true_num += cond->is_true;
+    }
+
+    if (rule->timer_num) {
+        engine->timers_dirty = true;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static AutomationRule *_rule_compile(AutomationEngine *engine, const char *automation_id, int status, char *params)
+{
+    AutomationCompile compile = {engine, NULL, NULL, strlen(automation_id) + 1, 0};
+    AutomationRule    rule;
+    AutomationRule *  result;
+    json_span_t       conds, actions, span;
+    size_t            params_len = strlen(params);
+    size_t            conds_pos, actions_pos, str_pos;
+
+    memset(&rule, 0, sizeof(rule));
+    rule.status    = status != 0;
+    rule.days      = GATEWAY_AUTOMATION_ALL_DAYS;
+    rule.end_min   = GATEWAY_AUTOMATION_MINUTES_OF_DAY - 1;
+    rule.match_any = 0;
+
+    if (!LITE_json_span_of("matchType", params, params_len, &span) && LITE_span_get_uint8(&rule.match_any, &span)) {
+        goto parse_err;
+    }
+    if (!LITE_json_span_of("effectiveBeginTime", params, params_len, &span) &&
+        _parse_minute(&span, &rule.begin_min)) {
+        goto parse_err;
+    }
+    if (!LITE_json_span_of("effectiveEndTime", params, params_len, &span) && _parse_minute(&span, &rule.end_min)) {
+        goto parse_err;
+    }
+    if (!LITE_json_span_of("effectiveDays", params, params_len, &span) && _parse_days(&span, &rule.days)) {
+        goto parse_err;
+    }
+    if (LITE_json_span_of("conditions", params, params_len, &conds) || conds.type != JSARRAY ||
+        LITE_json_span_of("actions", params, params_len, &actions) || actions.type != JSARRAY) {
+        goto parse_err;
+    }
+
+    /* size the rule */
+    if (_automation_walk(&compile, &conds, _parse_cond, GATEWAY_AUTOMATION_MAX_CONDS)) {
+        goto parse_err;
+    }
+    rule.cond_num = compile.num;
+    if (_automation_walk(&compile, &actions, _parse_action, GATEWAY_AUTOMATION_MAX_ACTIONS)) {
+        goto parse_err;
+    }
+    rule.action_num = compile.num;
+
+    conds_pos   = AUTOMATION_ALIGN(sizeof(AutomationRule));
+    actions_pos = conds_pos + rule.cond_num * sizeof(AutomationCond);
+    str_pos     = actions_pos + rule.action_num * sizeof(AutomationAction);
+
+    result = HAL_Malloc(str_pos + compile.str_len);
+    if (!result) {
+        Log_e("malloc automation %s failed", automation_id);
+        return NULL;
+    }
+
+    *result         = rule;
+    result->conds   = (AutomationCond *)((char *)result + conds_pos);
+    result->actions = (AutomationAction *)((char *)result + actions_pos);
+    result->id      = (char *)result + str_pos;
+    strcpy((char *)result->id, automation_id);
+
+    /* fill it */
+    compile.rule    = result;
+    compile.str_pos = (char *)result->id + strlen(automation_id) + 1;
+    if (_automation_walk(&compile, &conds, _parse_cond, rule.cond_num) ||
+        _automation_walk(&compile, &actions, _parse_action, rule.action_num)) {
+        HAL_Free(result);
+        goto parse_err;
+    }
+
+    return result;
+
+parse_err:
+    Log_e("invalid automation %s", automation_id);
+    return NULL;
+}
+
+void *IOT_Gateway_AutoMation_Create(OnAutoMationAction action, void *user_data)
+{
+    AutomationEngine *engine;
+
+    POINTER_SANITY_CHECK(action, NULL);
+
+    engine = HAL_Malloc(sizeof(AutomationEngine));
+    if (!engine) {
+        Log_e("malloc automation engine failed");
+        return NULL;
+    }
+    memset(engine, 0, sizeof(AutomationEngine));
+
+    engine->lock = HAL_MutexCreate();
+    if (!engine->lock) {
+        Log_e("create automation lock failed");
+        HAL_Free(engine);
+        return NULL;
+    }
+
+    engine->action           = action;
+    engine->user_data        = user_data;
+    engine->last_minute      = -1;
+    engine->rule_index_dirty = true;
+    engine->slot_index_dirty = true;
+
+    return engine;
+}
+
+void IOT_Gateway_AutoMation_Destroy(void *engine)
+{
+    AutomationEngine *automation = (AutomationEngine *)engine;
+    int               i;
+
+    POINTER_SANITY_CHECK_RTN(automation);
+
+    for (i = 0; i < automation->rule_num; i++) {
+        HAL_Free(automation->rules[i]);
+    }
+    for (i = 0; i < automation->slot_num; i++) {
+        HAL_Free(automation->slots[i]->deps);
+        HAL_Free(automation->slots[i]);
+    }
+
+    HAL_Free(automation->rules);
+    HAL_Free(automation->slots);
+    HAL_Free(automation->timers);
+    HAL_Free(automation->rule_slots);
+    HAL_Free(automation->slot_slots);
+    HAL_MutexDestroy(automation->lock);
+    HAL_Free(automation);
+}
+
+int IOT_Gateway_AutoMation_Set(void *engine, char *automation_id, int status, char *params)
+{
+    IOT_FUNC_ENTRY;
+
+    AutomationEngine *automation = (AutomationEngine *)engine;
+    AutomationRule *  rule;
+    AutomationRule *  old;
+    int               rc;
+    int               i;
+
+    POINTER_SANITY_CHECK(automation, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(automation_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(params, QCLOUD_ERR_INVAL);
+
+    HAL_MutexLock(automation->lock);
+
+    old = _rule_find(automation, automation_id);
+    if (!old && _automation_grow((void **)&automation->rules, &automation->rule_cap, sizeof(AutomationRule *),
+                                 automation->rule_num + 1, GATEWAY_AUTOMATION_MAX_RULES)) {
+        Log_e("too many automations");
+        rc = QCLOUD_ERR_FAILURE;
+        goto exit;
+    }
+
+    rule = _rule_compile(automation, automation_id, status, params);
+    if (!rule) {
+        rc = QCLOUD_ERR_FAILURE;
+        goto exit;
+    }
+
+    rc = _rule_link(automation, rule);
+    if (rc) {
+        HAL_Free(rule);
+        goto exit;
+    }
+
+    if (old) {
+        for (i = 0; automation->rules[i] != old; i++) {
+        }
+        _rule_unlink(automation, old);
+        HAL_Free(old);
+        automation->rules[i]         = rule;
+        automation->rule_index_dirty = true;
+    } else {
+        automation->rules[automation->rule_num++] = rule;
+        _automation_index_add(&automation->rule_index, &automation->rule_index_dirty, rule);
+    }
+
+    Log_i("automation %s set, %d conditions, %d actions", automation_id, rule->cond_num, rule->action_num);
+
+exit:
+    HAL_MutexUnlock(automation->lock);
+
+    IOT_FUNC_EXIT_RC(rc);
+}
+
+int IOT_Gateway_AutoMation_Delete(void *engine, char *automation_id)
+{
+    IOT_FUNC_ENTRY;
+
+    AutomationEngine *automation = (AutomationEngine *)engine;
+    AutomationRule *  rule;
+    int               i;
+
+    POINTER_SANITY_CHECK(automation, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(automation_id, QCLOUD_ERR_INVAL);
+
+    HAL_MutexLock(automation->lock);
+
+    rule = _rule_find(automation, automation_id);
+    if (!rule) {
+        HAL_MutexUnlock(automation->lock);
+        Log_e("automation %s not exist", automation_id);
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
+    }
+
+    for (i = 0; automation->rules[i] != rule; i++) {
+    }
+    automation->rules[i]         = automation->rules[--automation->rule_num];
+    automation->rule_index_dirty = true;
+
+    _rule_unlink(automation, rule);
+    HAL_Free(rule);
+
+    HAL_MutexUnlock(automation->lock);
+
+    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+}
+
+int IOT_Gateway_AutoMation_Property(void *engine, const char *product_id, const char *device_name,
+                                    const char *property, double value)
+{
+    AutomationEngine *automation = (AutomationEngine *)engine;
+    AutomationSlot *  slot;
+    char              key[GATEWAY_AUTOMATION_KEY_LEN];
+    int               key_len;
+
+    POINTER_SANITY_CHECK(automation, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(property, QCLOUD_ERR_INVAL);
+
+    /* no automation could refer to it */
+    key_len = _slot_key(key, product_id, device_name, property, strlen(property));
+    if (key_len < 0) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    HAL_MutexLock(automation->lock);
+    slot = _slot_find(automation, key, key_len);
+    if (slot) {
+        _slot_settle(slot, value, ++automation->seq);
+        _slot_check(automation, slot, automation->seq);
+    }
+    HAL_MutexUnlock(automation->lock);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* properties of one report are settled together, so a rule fires at most once for it */
+int IOT_Gateway_AutoMation_Report(void *engine, const char *product_id, const char *device_name, char *params)
+{
+    AutomationEngine *automation = (AutomationEngine *)engine;
+    AutomationSlot *  slots[GATEWAY_AUTOMATION_REPORT_BATCH];
+    int               slot_num = 0;
+    json_span_t       span;
+    char              key[GATEWAY_AUTOMATION_KEY_LEN];
+    int               key_len;
+    char *            pos, *prop, *val;
+    int               prop_len, val_len, val_type;
+    double            value;
+    bool              bool_value;
+    uint32_t          seq;
+    int               i;
+
+    POINTER_SANITY_CHECK(automation, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(params, QCLOUD_ERR_INVAL);
+
+    HAL_MutexLock(automation->lock);
+
+    seq = ++automation->seq;
+    json_object_for_each_kv(params, pos, prop, prop_len, val, val_len, val_type)
+    {
+        span.ptr  = val;
+        span.len  = val_len;
+        span.type = val_type;
+
+        if (val_type == JSBOOLEAN) {
+            if (LITE_span_get_boolean(&bool_value, &span)) {
+                continue;
+            }
+            value = bool_value;
+        } else if (val_type != JSNUMBER || LITE_span_get_double(&value, &span)) {
+            continue;
+        }
+
+        key_len = _slot_key(key, product_id, device_name, prop, prop_len);
+        if (key_len < 0) {
+            continue;
+        }
+
+        slots[slot_num] = _slot_find(automation, key, key_len);
+        if (!slots[slot_num]) {
+            continue;
+        }
+
+        _slot_settle(slots[slot_num++], value, seq);
+        if (slot_num == GATEWAY_AUTOMATION_REPORT_BATCH) {
+            for (i = 0; i < slot_num; i++) {
+                _slot_check(automation, slots[i], seq);
+            }
+            slot_num = 0;
+        }
+    }
+
+    for (i = 0; i < slot_num; i++) {
+        _slot_check(automation, slots[i], seq);
+    }
+
+    HAL_MutexUnlock(automation->lock);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+void IOT_Gateway_AutoMation_Tick(void *engine, uint32_t local_time)
+{
+    AutomationEngine *automation = (AutomationEngine *)engine;
+    int32_t           minutes    = local_time / 60;
+    int32_t           last;
+
+    POINTER_SANITY_CHECK_RTN(automation);
+
+    HAL_MutexLock(automation->lock);
+
+    last                      = automation->last_minute;
+    automation->local_time    = local_time;
+    automation->local_time_ms = HAL_GetTimeMs();
+    automation->last_minute   = minutes;
+
+    if (last < 0 || minutes <= last) {
+        goto exit;
+    }
+    if (minutes - last > GATEWAY_AUTOMATION_MINUTES_OF_DAY) {
+        Log_w("automation timers skipped for %d minutes", minutes - last);
+        goto exit;
+    }
+
+    if (automation->timers_dirty && _timers_build(automation)) {
+        Log_e("build automation timers failed");
+        automation->last_minute = last;
+        goto exit;
+    }
+
+    while (automation->timer_num && ++last <= minutes) {
+        _timers_run(automation, last);
+    }
+
+exit:
+    HAL_MutexUnlock(automation->lock);
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,1217 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qcloud_iot_export.h"
+#include "qcloud_iot_import.h"
+
+#ifdef GATEWAY_LOCAL_BROKER_ENABLED
+
+#include "gateway_broker.h"
+
+#include <string.h>
+
+#include "data_template_client_json.h"
+#include "gateway_common.h"
+#include "json_index.h"
+#include "mqtt_client.h"
+#include "utils_json_writer.h"
+#include "utils_param_check.h"
+#include "utils_timer.h"
+
+static bool _time_reached(uint32_t now, uint32_t deadline)
+{
+    return (int32_t)(now - deadline) >= 0;
+}
+
+/* span of the level of a topic, false if the topic has fewer levels */
+static bool _topic_level(const char *topic, size_t len, int level, const char **ptr, size_t *level_len)
+{
+    const char *end = topic + len;
+    const char *sep;
+
+    for (; level > 0; level--) {
+        sep = memchr(topic, '/', end - topic);
+        if (!sep) {
+            return false;
+        }
+        topic = sep + 1;
+    }
+
+    sep        = memchr(topic, '/', end - topic);
+    *ptr       = topic;
+    *level_len = (sep ? sep : end) - topic;
+
+    return true;
+}
+
+static bool _topic_level_equals(const char *topic, size_t len, int level, const char *str)
+{
+    const char *ptr;
+    size_t      level_len;
+
+    return _topic_level(topic, len, level, &ptr, &level_len) && level_len == strlen(str) &&
+           !memcmp(ptr, str, level_len);
+}
+
+/* ${prefix}${type}/${product_id}/${device_name} of the sub-device of the session */
+static bool _topic_is_own(GatewayBrokerSession *session, const char *topic, size_t len, const char *prefix)
+{
+    size_t      prefix_len = strlen(prefix);
+    const char *ptr;
+    size_t      level_len;
+
+    return len > prefix_len && !memcmp(topic, prefix, prefix_len) &&
+           !_topic_level(topic, len, GATEWAY_BROKER_THING_TOPIC_LEVELS, &ptr, &level_len) &&
+           _topic_level_equals(topic, len, GATEWAY_BROKER_PRODUCT_ID_TOPIC_LEVEL, session->product_id) &&
+           _topic_level_equals(topic, len, GATEWAY_BROKER_DEVICE_NAME_TOPIC_LEVEL, session->device_name);
+}
+
+/* '+' takes a whole level, '#' takes the whole last level */
+static bool _filter_is_valid(const char *filter, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if ('+' != filter[i] && '#' != filter[i]) {
+            continue;
+        }
+        if ((i && '/' != filter[i - 1]) || (i + 1 < len && '/' != filter[i + 1]) ||
+            ('#' == filter[i] && i + 1 != len)) {
+            return false;
+        }
+    }
+
+    return len > 0;
+}
+
+static bool _session_is(GatewayBrokerSession *session, const char *product_id, size_t product_id_len,
+                        const char *device_name, size_t device_name_len)
+{
+    return !strncmp(session->product_id, product_id, product_id_len) && '\0' == session->product_id[product_id_len] &&
+           !strncmp(session->device_name, device_name, device_name_len) &&
+           '\0' == session->device_name[device_name_len];
+}
+
+/* the socket is closed at once, the session is freed by the yield */
+static void _session_close(GatewayBrokerSession *session)
+{
+    if (session->fd) {
+        HAL_TCP_Disconnect(session->fd);
+        session->fd = 0;
+    }
+    session->state = GATEWAY_BROKER_CLOSED;
+}
+
+static int _session_send(GatewayBroker *broker, GatewayBrokerSession *session, uint32_t len)
+{
+    size_t written = 0;
+    int    rc;
+
+    if (!session->fd) {
+        return QCLOUD_ERR_TCP_WRITE_FAIL;
+    }
+
+    rc = HAL_TCP_Write(session->fd, broker->tx_buf, len, GATEWAY_BROKER_WRITE_TIMEOUT_MS, &written);
+    if (QCLOUD_RET_SUCCESS != rc || written != len) {
+        Log_w("send to %s%s failed: %d", session->product_id, session->device_name, rc);
+        _session_close(session);
+        return QCLOUD_RET_SUCCESS != rc ? rc : QCLOUD_ERR_TCP_WRITE_FAIL;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static int _send_connack(GatewayBroker *broker, GatewayBrokerSession *session, uint8_t code)
+{
+    unsigned char *ptr    = broker->tx_buf;
+    unsigned char  header = 0;
+
+    mqtt_init_packet_header(&header, CONNACK, QOS0, 0, 0);
+    mqtt_write_char(&ptr, header);
+    ptr += mqtt_write_packet_rem_len(ptr, 2);
+    mqtt_write_char(&ptr, 0); /* no session present, sessions are clean */
+    mqtt_write_char(&ptr, code);
+
+    return _session_send(broker, session, ptr - broker->tx_buf);
+}
+
+static void _session_refuse(GatewayBroker *broker, GatewayBrokerSession *session, uint8_t code)
+{
+    Log_w("refuse %s%s: %d", session->product_id, session->device_name, code);
+    broker->stats.refuse_cnt++;
+    _send_connack(broker, session, code);
+    _session_close(session);
+}
+
+/* deliver to the local subscribers with the highest QoS of their matching filters */
+static void _broker_deliver(GatewayBroker *broker, char *topic, uint16_t topic_len, unsigned char *payload,
+                            size_t payload_len, QoS qos)
+{
+    GatewayBrokerSession *session;
+    uint32_t              len;
+    int                   i, j, granted;
+
+    for (i = 0; i < broker->session_num; i++) {
+        session = broker->sessions[i];
+        if (GATEWAY_BROKER_CONNECTED != session->state) {
+            continue;
+        }
+
+        granted = -1;
+        for (j = 0; j < session->sub_num; j++) {
+            /* wildcards don't match topics beginning with '$' */
+            if (('$' == topic[0]) != ('$' == session->subs[j].filter[0]) ||
+                !mqtt_is_topic_matched(session->subs[j].filter, topic, topic_len)) {
+                continue;
+            }
+            if ((int)session->subs[j].qos > granted) {
+                granted = session->subs[j].qos;
+            }
+        }
+        if (granted < 0) {
+            continue;
+        }
+
+        granted = (int)qos < granted ? (int)qos : granted;
+        if (QOS0 != granted && !++session->packet_id) {
+            session->packet_id = 1;
+        }
+        if (serialize_publish_packet(broker->tx_buf, sizeof(broker->tx_buf), 0, (QoS)granted, 0, session->packet_id,
+                                     topic, payload, payload_len, &len)) {
+            Log_e("message of %s is too long: %u", topic, (unsigned)payload_len);
+            return;
+        }
+        if (QCLOUD_RET_SUCCESS == _session_send(broker, session, len)) {
+            broker->stats.local_msg_cnt++;
+        }
+    }
+}
+
+static void _broker_publish(GatewayBroker *broker, char *topic, char *payload, size_t payload_len, QoS qos)
+{
+    PublishParams params = DEFAULT_PUB_PARAMS;
+    int           rc;
+
+    params.qos         = qos;
+    params.payload     = payload;
+    params.payload_len = payload_len;
+
+    rc = IOT_Gateway_Publish(broker->gateway, topic, &params);
+    if (rc < 0) {
+        Log_e("publish %s failed: %d", topic, rc);
+        return;
+    }
+    broker->stats.cloud_pub_cnt++;
+}
+
+static bool _json_key_equals(const JsonIndex *index, int key, const char *str)
+{
+    return index->tokens[key].len == strlen(str) && !memcmp(json_index_str(index, key), str, index->tokens[key].len);
+}
+
+/* "key":value of a member as is, strings span their content without quotes */
+static void _json_write_member(JsonWriter *writer, const JsonIndex *index, int key, int val)
+{
+    const JsonToken *value = &index->tokens[val];
+    const char *     begin = json_index_str(index, key) - 1;
+    const char *     end   = index->json + value->start + value->len + (JSSTRING == value->type ? 1 : 0);
+
+    json_writer_raw_value(writer, begin, end - begin);
+}
+
+/* publish the merged report of the session with a token of the broker, the reply goes to the merged tokens */
+static void _report_flush(GatewayBroker *broker, GatewayBrokerSession *session)
+{
+    JsonWriter writer;
+    char       topic[MAX_SIZE_OF_CLOUD_TOPIC];
+    int        len;
+
+    if (!session->pending_params[0]) {
+        return;
+    }
+
+    HAL_Snprintf(session->sent_token, sizeof(session->sent_token), GATEWAY_BROKER_TOKEN_PREFIX "%u",
+                 broker->token_num++);
+    memcpy(&session->sent, &session->pending, sizeof(GatewayBrokerTokens));
+
+    json_writer_init(&writer, (char *)broker->tx_buf, sizeof(broker->tx_buf));
+    json_writer_object_begin(&writer);
+    json_writer_key(&writer, METHOD_FIELD);
+    json_writer_string(&writer, REPORT_CMD);
+    json_writer_key(&writer, CLIENT_TOKEN_FIELD);
+    json_writer_string(&writer, session->sent_token);
+    json_writer_key(&writer, CMD_CONTROL_PARA);
+    json_writer_raw_value(&writer, session->pending_params, strlen(session->pending_params));
+    json_writer_object_end(&writer);
+    len = json_writer_finish(&writer);
+
+    session->pending_params[0] = '\0';
+    session->pending.num       = 0;
+
+    if (len < 0) {
+        Log_e("write report of %s/%s failed: %d", session->product_id, session->device_name, len);
+        return;
+    }
+
+    HAL_Snprintf(topic, sizeof(topic), GATEWAY_BROKER_PROPERTY_TOPIC_FMT, session->product_id, session->device_name);
+    _broker_publish(broker, topic, (char *)broker->tx_buf, len, QOS0);
+}
+
+/* merge params into the pending ones of the session, those of params win */
+static int _report_merge_params(GatewayBrokerSession *session, const JsonIndex *report, int params)
+{
+    JsonToken  tokens[GATEWAY_BROKER_MAX_JSON_TOKENS];
+    JsonIndex  pending;
+    JsonWriter writer;
+    char       merged[GATEWAY_BROKER_REPORT_LEN];
+    int        key, val, len;
+
+    json_writer_init(&writer, merged, sizeof(merged));
+    json_writer_object_begin(&writer);
+    json_writer_raw_members(&writer, json_index_str(report, params), report->tokens[params].len);
+    if (session->pending_params[0]) {
+        if (json_index_parse(&pending, session->pending_params, strlen(session->pending_params), tokens,
+                             GATEWAY_BROKER_MAX_JSON_TOKENS) < 0) {
+            return QCLOUD_ERR_JSON_PARSE;
+        }
+        json_index_for_each_member(&pending, 0, key, val)
+        {
+            if (json_index_find(report, params, json_index_str(&pending, key), pending.tokens[key].len) < 0) {
+                _json_write_member(&writer, &pending, key, val);
+            }
+        }
+    }
+    json_writer_object_end(&writer);
+
+    len = json_writer_finish(&writer);
+    if (len < 0) {
+        return len;
+    }
+    memcpy(session->pending_params, merged, len + 1);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/**
+ * @brief Merge a property report of the session into the pending one
+ *
+ * Only reports of method, clientToken and params are merged, the others
+ * go to the cloud as they are.
+ *
+ * @return QCLOUD_RET_SUCCESS if merged, or err code if not
+ */
+static int _report_merge(GatewayBroker *broker, GatewayBrokerSession *session, unsigned char *payload,
+                         size_t payload_len)
+{
+    JsonToken   tokens[GATEWAY_BROKER_MAX_JSON_TOKENS];
+    JsonIndex   report;
+    const char *token     = NULL;
+    size_t      token_len = 0;
+    int         params    = -1;
+    int         key, val, rc;
+    bool        first;
+
+    if (json_index_parse(&report, (const char *)payload, payload_len, tokens, GATEWAY_BROKER_MAX_JSON_TOKENS) < 0 ||
+        JSOBJECT != tokens[0].type) {
+        return QCLOUD_ERR_JSON_PARSE;
+    }
+
+    json_index_for_each_member(&report, 0, key, val)
+    {
+        if (_json_key_equals(&report, key, METHOD_FIELD)) {
+            if (JSSTRING != tokens[val].type || !_json_key_equals(&report, val, REPORT_CMD)) {
+                return QCLOUD_ERR_INVAL;
+            }
+        } else if (_json_key_equals(&report, key, CLIENT_TOKEN_FIELD)) {
+            if (JSSTRING != tokens[val].type || tokens[val].len >= GATEWAY_BROKER_TOKEN_LEN) {
+                return QCLOUD_ERR_INVAL;
+            }
+            token     = json_index_str(&report, val);
+            token_len = tokens[val].len;
+        } else if (_json_key_equals(&report, key, CMD_CONTROL_PARA) && JSOBJECT == tokens[val].type) {
+            params = val;
+        } else {
+            return QCLOUD_ERR_INVAL;
+        }
+    }
+    if (params < 0) {
+        return QCLOUD_ERR_INVAL;
+    }
+
+    if (token && GATEWAY_BROKER_MAX_MERGE == session->pending.num) {
+        _report_flush(broker, session);
+    }
+
+    first = !session->pending_params[0];
+    rc    = _report_merge_params(session, &report, params);
+    if (QCLOUD_RET_SUCCESS != rc && !first) {
+        /* no room left, start over from this one */
+        _report_flush(broker, session);
+        first = true;
+        rc    = _report_merge_params(session, &report, params);
+    }
+    if (QCLOUD_RET_SUCCESS != rc) {
+        session->pending_params[0] = '\0';
+        return rc;
+    }
+
+    if (token) {
+        memcpy(session->pending.tokens[session->pending.num], token, token_len);
+        session->pending.tokens[session->pending.num++][token_len] = '\0';
+    }
+    if (first) {
+        session->pending_deadline_ms = HAL_GetTimeMs() + broker->params.coalesce_ms;
+    } else {
+        broker->stats.coalesce_cnt++;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* $thing/up topic of the sub-device of the session */
+static void _broker_upstream(GatewayBroker *broker, GatewayBrokerSession *session, char *topic, uint16_t topic_len,
+                             unsigned char *payload, size_t payload_len, QoS qos)
+{
+    broker->stats.upstream_cnt++;
+
+    if (broker->params.coalesce_ms && QOS0 == qos &&
+        _topic_level_equals(topic, topic_len, GATEWAY_BROKER_PROPERTY_TOPIC_LEVEL, "property") &&
+        QCLOUD_RET_SUCCESS == _report_merge(broker, session, payload, payload_len)) {
+        return;
+    }
+
+    /* the merged report goes first to keep the order of the sub-device */
+    _report_flush(broker, session);
+    _broker_publish(broker, topic, (char *)payload, payload_len, qos);
+}
+
+static void _handle_publish(GatewayBroker *broker, GatewayBrokerSession *session, unsigned char *buf, size_t len)
+{
+    char           topic[MAX_SIZE_OF_CLOUD_TOPIC];
+    char *         topic_name;
+    uint16_t       topic_len, packet_id;
+    unsigned char *payload;
+    size_t         payload_len;
+    uint8_t        dup, retained;
+    uint32_t       ack_len;
+    QoS            qos;
+
+    if (deserialize_publish_packet(&dup, &qos, &retained, &packet_id, &topic_name, &topic_len, &payload,
+                                   &payload_len, buf, len) ||
+        QOS2 == qos) {
+        Log_e("invalid PUBLISH of %s%s", session->product_id, session->device_name);
+        _session_close(session);
+        return;
+    }
+
+    if (QOS1 == qos) {
+        serialize_pub_ack_packet(broker->tx_buf, sizeof(broker->tx_buf), PUBACK, 0, packet_id, &ack_len);
+        if (_session_send(broker, session, ack_len)) {
+            return;
+        }
+    }
+
+    if (!topic_len || topic_len >= sizeof(topic) || memchr(topic_name, '+', topic_len) ||
+        memchr(topic_name, '#', topic_len)) {
+        Log_w("drop message of %s%s: invalid topic", session->product_id, session->device_name);
+        return;
+    }
+    memcpy(topic, topic_name, topic_len);
+    topic[topic_len] = '\0';
+
+    if ('$' != topic[0]) {
+        _broker_deliver(broker, topic, topic_len, payload, payload_len, qos);
+    } else if (_topic_is_own(session, topic, topic_len, GATEWAY_BROKER_UP_TOPIC_PREFIX)) {
+        _broker_upstream(broker, session, topic, topic_len, payload, payload_len, qos);
+    } else {
+        Log_w("drop message of %s/%s to %s", session->product_id, session->device_name, topic);
+    }
+}
+
+/* hand the reply of a merged report to the clientToken of each report in it */
+static void _broker_reply(GatewayBroker *broker, GatewayBrokerSession *session, char *topic, uint16_t topic_len,
+                          const JsonIndex *reply, QoS qos)
+{
+    JsonWriter writer;
+    size_t     size = reply->tokens[0].len + GATEWAY_BROKER_TOKEN_LEN + sizeof(CLIENT_TOKEN_FIELD) + 8;
+    char *     buf  = HAL_Malloc(size);
+    int        i, key, val, len;
+
+    if (!buf) {
+        Log_e("malloc %u failed", (unsigned)size);
+        return;
+    }
+
+    for (i = 0; i < session->sent.num; i++) {
+        json_writer_init(&writer, buf, size);
+        json_writer_object_begin(&writer);
+        json_index_for_each_member(reply, 0, key, val)
+        {
+            if (_json_key_equals(reply, key, CLIENT_TOKEN_FIELD)) {
+                json_writer_key(&writer, CLIENT_TOKEN_FIELD);
+                json_writer_string(&writer, session->sent.tokens[i]);
+            } else {
+                _json_write_member(&writer, reply, key, val);
+            }
+        }
+        json_writer_object_end(&writer);
+        len = json_writer_finish(&writer);
+        if (len >= 0) {
+            _broker_deliver(broker, topic, topic_len, (unsigned char *)buf, len, qos);
+        }
+    }
+    session->sent.num      = 0;
+    session->sent_token[0] = '\0';
+
+    HAL_Free(buf);
+}
+
+/* reply of the merged report published last by the session, false if not */
+static bool _broker_is_reply(GatewayBrokerSession *session, const char *topic, uint16_t topic_len,
+                             const JsonIndex *index)
+{
+    int method = json_index_find(index, 0, METHOD_FIELD, sizeof(METHOD_FIELD) - 1);
+    int token  = json_index_find(index, 0, CLIENT_TOKEN_FIELD, sizeof(CLIENT_TOKEN_FIELD) - 1);
+
+    return session->sent_token[0] && method >= 0 && token >= 0 &&
+           _topic_level_equals(topic, topic_len, GATEWAY_BROKER_PROPERTY_TOPIC_LEVEL, "property") &&
+           _json_key_equals(index, method, REPORT_CMD_REPLY) && _json_key_equals(index, token, session->sent_token);
+}
+
+/* $thing/down topics of the connected sub-devices, routed by the gateway */
+static void _broker_message_handler(void *client, MQTTMessage *message, void *user_data)
+{
+    GatewayBroker *       broker  = (GatewayBroker *)user_data;
+    GatewayBrokerSession *session = NULL;
+    JsonToken             tokens[GATEWAY_BROKER_MAX_JSON_TOKENS];
+    JsonIndex             index;
+    char                  topic[MAX_SIZE_OF_CLOUD_TOPIC];
+    const char *          product_id, *device_name;
+    size_t                product_id_len, device_name_len;
+    uint16_t              topic_len = message->topic_len;
+    int                   i;
+
+    if (message->topic_len >= sizeof(topic) ||
+        !_topic_level(message->ptopic, topic_len, GATEWAY_BROKER_PRODUCT_ID_TOPIC_LEVEL, &product_id,
+                      &product_id_len) ||
+        !_topic_level(message->ptopic, topic_len, GATEWAY_BROKER_DEVICE_NAME_TOPIC_LEVEL, &device_name,
+                      &device_name_len)) {
+        Log_e("invalid topic %.*s", (int)message->topic_len, message->ptopic);
+        return;
+    }
+    memcpy(topic, message->ptopic, topic_len);
+    topic[topic_len] = '\0';
+
+    HAL_MutexLock(broker->lock);
+    broker->stats.downstream_cnt++;
+    for (i = 0; i < broker->session_num; i++) {
+        if (GATEWAY_BROKER_CONNECTED == broker->sessions[i]->state &&
+            _session_is(broker->sessions[i], product_id, product_id_len, device_name, device_name_len)) {
+            session = broker->sessions[i];
+            break;
+        }
+    }
+
+    if (session && json_index_parse(&index, message->payload, message->payload_len, tokens,
+                                     GATEWAY_BROKER_MAX_JSON_TOKENS) > 0 &&
+        JSOBJECT == tokens[0].type && _broker_is_reply(session, topic, topic_len, &index)) {
+        _broker_reply(broker, session, topic, topic_len, &index, message->qos);
+    } else {
+        _broker_deliver(broker, topic, topic_len, message->payload, message->payload_len, message->qos);
+    }
+    HAL_MutexUnlock(broker->lock);
+}
+
+/* $thing/down filters of its own sub-device, or filters of local topics */
+static uint8_t _session_subscribe(GatewayBrokerSession *session, const char *filter, uint16_t len, QoS qos)
+{
+    int i;
+
+    if (len >= GATEWAY_BROKER_FILTER_LEN || !_filter_is_valid(filter, len) ||
+        ('$' == filter[0] && (!_topic_is_own(session, filter, len, GATEWAY_BROKER_DOWN_TOPIC_PREFIX) ||
+                              memchr(filter, '#', len)))) {
+        Log_w("refuse subscription of %s/%s to %.*s", session->product_id, session->device_name, len, filter);
+        return GATEWAY_BROKER_SUBACK_FAILURE;
+    }
+
+    qos = QOS1 < qos ? QOS1 : qos;
+    for (i = 0; i < session->sub_num; i++) {
+        if (!strncmp(session->subs[i].filter, filter, len) && '\0' == session->subs[i].filter[len]) {
+            break;
+        }
+    }
+    if (i == session->sub_num) {
+        if (GATEWAY_BROKER_MAX_SUBS == session->sub_num) {
+            Log_w("subscriptions of %s/%s are full", session->product_id, session->device_name);
+            return GATEWAY_BROKER_SUBACK_FAILURE;
+        }
+        memcpy(session->subs[i].filter, filter, len);
+        session->subs[i].filter[len] = '\0';
+        session->sub_num++;
+    }
+    session->subs[i].qos = qos;
+
+    return (uint8_t)qos;
+}
+
+/* length-prefixed string of MQTT, NULL if it runs past end */
+static const char *_read_string(unsigned char **pptr, unsigned char *end, uint16_t *len)
+{
+    const char *str;
+
+    if (end - *pptr < 2) {
+        return NULL;
+    }
+    *len = mqtt_read_uint16_t(pptr);
+    if (end - *pptr < *len) {
+        return NULL;
+    }
+    str = (const char *)*pptr;
+    *pptr += *len;
+
+    return str;
+}
+
+static void _handle_subscribe(GatewayBroker *broker, GatewayBrokerSession *session, unsigned char *ptr,
+                              unsigned char *end, bool subscribe)
+{
+    uint8_t        codes[GATEWAY_BROKER_RX_BUF_LEN / 3];  // a topic filter takes 3 bytes at least
+    unsigned char *out    = broker->tx_buf;
+    unsigned char  header = 0;
+    const char *   filter;
+    uint16_t       packet_id, len;
+    uint32_t       ack_len;
+    QoS            qos;
+    int            i, num = 0;
+
+    if (end - ptr < 2) {
+        _session_close(session);
+        return;
+    }
+    packet_id = mqtt_read_uint16_t(&ptr);
+
+    do {
+        filter = _read_string(&ptr, end, &len);
+        if (!filter || num == sizeof(codes) ||
+            (subscribe && (ptr >= end || QOS2 < (qos = (QoS)mqtt_read_char(&ptr))))) {
+            Log_e("invalid %s of %s%s", subscribe ? "SUBSCRIBE" : "UNSUBSCRIBE", session->product_id,
+                  session->device_name);
+            _session_close(session);
+            return;
+        }
+
+        if (subscribe) {
+            codes[num++] = _session_subscribe(session, filter, len, qos);
+            continue;
+        }
+        for (i = 0; i < session->sub_num; i++) {
+            if (!strncmp(session->subs[i].filter, filter, len) && '\0' == session->subs[i].filter[len]) {
+                session->subs[i] = session->subs[--session->sub_num];
+                break;
+            }
+        }
+    } while (ptr < end);
+
+    if (!subscribe) {
+        serialize_pub_ack_packet(broker->tx_buf, sizeof(broker->tx_buf), UNSUBACK, 0, packet_id, &ack_len);
+        _session_send(broker, session, ack_len);
+        return;
+    }
+
+    /* fixed header of up to 5 bytes, the packet id and a return code for each filter */
+    if (5 + 2 + num > sizeof(broker->tx_buf)) {
+        Log_e("SUBACK of %s%s is too long", session->product_id, session->device_name);
+        _session_close(session);
+        return;
+    }
+
+    mqtt_init_packet_header(&header, SUBACK, QOS0, 0, 0);
+    mqtt_write_char(&out, header);
+    out += mqtt_write_packet_rem_len(out, 2 + num);
+    mqtt_write_uint_16(&out, packet_id);
+    memcpy(out, codes, num);
+    _session_send(broker, session, out + num - broker->tx_buf);
+}
+
+/* pick up the session of the sub-device from a former connection of it */
+static void _session_take_over(GatewayBroker *broker, GatewayBrokerSession *session)
+{
+    GatewayBrokerSession *former;
+    int                   i;
+
+    for (i = 0; i < broker->session_num; i++) {
+        former = broker->sessions[i];
+        if (former == session || GATEWAY_BROKER_CLOSED == former->state ||
+            !_session_is(former, session->product_id, strlen(session->product_id), session->device_name,
+                         strlen(session->device_name))) {
+            continue;
+        }
+
+        Log_i("%s/%s connects again, close the former connection", session->product_id, session->device_name);
+        session->online     = former->online;
+        session->op_pending = former->op_pending;
+        session->state      = GATEWAY_BROKER_CONNECTED == former->state ? GATEWAY_BROKER_ONLINE_WAIT : former->state;
+        former->online      = false;
+        former->op_pending  = false;
+        _session_close(former);
+        return;
+    }
+}
+
+static void _handle_connect(GatewayBroker *broker, GatewayBrokerSession *session, unsigned char *ptr,
+                            unsigned char *end)
+{
+    char        username[GATEWAY_BROKER_CREDENTIAL_LEN] = {0};
+    char        password[GATEWAY_BROKER_CREDENTIAL_LEN] = {0};
+    const char *protocol, *client_id, *str;
+    uint16_t    protocol_len, client_id_len, len;
+    uint8_t     level, flags;
+
+    protocol = _read_string(&ptr, end, &protocol_len);
+    if (!protocol || 4 != protocol_len || memcmp(protocol, "MQTT", 4) || end - ptr < 4) {
+        Log_e("invalid CONNECT");
+        _session_close(session);
+        return;
+    }
+    level               = mqtt_read_char(&ptr);
+    flags               = mqtt_read_char(&ptr);
+    session->keep_alive = mqtt_read_uint16_t(&ptr);
+    if (4 != level) {
+        _session_refuse(broker, session, GATEWAY_BROKER_CONNACK_BAD_PROTOCOL);
+        return;
+    }
+
+    client_id = _read_string(&ptr, end, &client_id_len);
+    if (!client_id || (flags & GATEWAY_BROKER_CONNECT_FLAG_RESERVED) ||
+        ((flags & GATEWAY_BROKER_CONNECT_FLAG_WILL) &&
+         (!_read_string(&ptr, end, &len) || !_read_string(&ptr, end, &len)))) {
+        Log_e("invalid CONNECT");
+        _session_close(session);
+        return;
+    }
+    if (flags & GATEWAY_BROKER_CONNECT_FLAG_USERNAME) {
+        str = _read_string(&ptr, end, &len);
+        if (!str || len >= sizeof(username)) {
+            _session_refuse(broker, session, GATEWAY_BROKER_CONNACK_BAD_USERDATA);
+            return;
+        }
+        memcpy(username, str, len);
+    }
+    if (flags & GATEWAY_BROKER_CONNECT_FLAG_PASSWORD) {
+        str = _read_string(&ptr, end, &len);
+        if (!str || len >= sizeof(password)) {
+            _session_refuse(broker, session, GATEWAY_BROKER_CONNACK_BAD_USERDATA);
+            return;
+        }
+        memcpy(password, str, len);
+    }
+
+    /* client id is ${product_id}${device_name} */
+    if (client_id_len <= MAX_SIZE_OF_PRODUCT_ID || client_id_len > MAX_SIZE_OF_PRODUCT_ID + MAX_SIZE_OF_DEVICE_NAME ||
+        memchr(client_id, '/', client_id_len) || memchr(client_id, '+', client_id_len) ||
+        memchr(client_id, '#', client_id_len) || memchr(client_id, '\0', client_id_len)) {
+        _session_refuse(broker, session, GATEWAY_BROKER_CONNACK_BAD_CLIENT_ID);
+        return;
+    }
+    memcpy(session->product_id, client_id, MAX_SIZE_OF_PRODUCT_ID);
+    memcpy(session->device_name, client_id + MAX_SIZE_OF_PRODUCT_ID, client_id_len - MAX_SIZE_OF_PRODUCT_ID);
+
+    if (broker->params.auth &&
+        broker->params.auth(broker->params.user_data, session->product_id, session->device_name, username, password)) {
+        _session_refuse(broker, session, GATEWAY_BROKER_CONNACK_NOT_AUTHORIZED);
+        return;
+    }
+
+    session->state = GATEWAY_BROKER_ONLINE_START;
+    _session_take_over(broker, session);
+}
+
+static void _session_online_done(GatewayBroker *broker, GatewayBrokerSession *session)
+{
+    int rc;
+
+    if (!session->online) {
+        Log_e("%s/%s online failed: %d", session->product_id, session->device_name, session->op_result);
+        _session_refuse(broker, session, GATEWAY_BROKER_CONNACK_NOT_AUTHORIZED);
+        return;
+    }
+
+    rc = IOT_Gateway_Route_Register(broker->gateway, session->product_id, session->device_name,
+                                    _broker_message_handler, broker);
+    if (QCLOUD_RET_SUCCESS != rc) {
+        Log_e("route %s/%s failed: %d", session->product_id, session->device_name, rc);
+    }
+
+    if (QCLOUD_RET_SUCCESS == _send_connack(broker, session, GATEWAY_BROKER_CONNACK_ACCEPTED)) {
+        Log_i("%s/%s connected", session->product_id, session->device_name);
+        session->state = GATEWAY_BROKER_CONNECTED;
+        broker->stats.connect_cnt++;
+    }
+}
+
+/**
+ * @brief Length of the packet at the head of rx_buf
+ *
+ * @param session       session of the local client
+ * @param len           length of the packet
+ * @param header_len    length of its fixed header
+ * @return 1 if known, 0 if more bytes are needed, or err code if invalid
+ */
+static int _session_packet_len(GatewayBrokerSession *session, uint32_t *len, uint32_t *header_len)
+{
+    uint32_t rem_len    = 0;
+    uint32_t multiplier = 1;
+    size_t   i;
+
+    for (i = 1; i < session->rx_len; i++) {
+        rem_len += (session->rx_buf[i] & 127) * multiplier;
+        if (!(session->rx_buf[i] & 128)) {
+            *header_len = i + 1;
+            *len        = *header_len + rem_len;
+            return 1;
+        }
+        if (4 == i) {
+            return QCLOUD_ERR_MQTT_PACKET_READ;
+        }
+        multiplier *= 128;
+    }
+
+    return 0;
+}
+
+static void _session_process(GatewayBroker *broker, GatewayBrokerSession *session)
+{
+    unsigned char *buf = session->rx_buf;
+    uint32_t       len, header_len;
+    uint8_t        type;
+    int            rc;
+
+    while (GATEWAY_BROKER_CONNECTING == session->state || GATEWAY_BROKER_CONNECTED == session->state) {
+        rc = _session_packet_len(session, &len, &header_len);
+        if (rc < 0 || (rc && len > sizeof(session->rx_buf))) {
+            Log_e("invalid packet of %s%s", session->product_id, session->device_name);
+            _session_close(session);
+            return;
+        }
+        if (!rc || len > session->rx_len) {
+            return;
+        }
+
+        type = (buf[0] & MQTT_HEADER_TYPE_MASK) >> MQTT_HEADER_TYPE_SHIFT;
+        if (GATEWAY_BROKER_CONNECTING == session->state) {
+            if (CONNECT != type) {
+                Log_e("first packet is not CONNECT: %u", type);
+                _session_close(session);
+                return;
+            }
+            _handle_connect(broker, session, buf + header_len, buf + len);
+        } else {
+            switch (type) {
+                case PUBLISH:
+                    _handle_publish(broker, session, buf, len);
+                    break;
+                case PUBACK:
+                    /* QoS1 deliveries are not retransmitted */
+                    break;
+                case SUBSCRIBE:
+                case UNSUBSCRIBE:
+                    _handle_subscribe(broker, session, buf + header_len, buf + len, SUBSCRIBE == type);
+                    break;
+                case PINGREQ:
+                    serialize_packet_with_zero_payload(broker->tx_buf, sizeof(broker->tx_buf), PINGRESP, &len);
+                    _session_send(broker, session, len);
+                    break;
+                case DISCONNECT:
+                    _session_close(session);
+                    break;
+                default:
+                    Log_e("unexpected packet of %s/%s: %u", session->product_id, session->device_name, type);
+                    _session_close(session);
+                    break;
+            }
+        }
+
+        session->rx_len -= len;
+        memmove(buf, buf + len, session->rx_len);
+    }
+}
+
+static void _broker_online_result(void *client, const GatewaySubdevResult *result, void *user_data)
+{
+    GatewayBroker *       broker = (GatewayBroker *)user_data;
+    GatewayBrokerSession *session;
+    int                   i;
+
+    HAL_MutexLock(broker->lock);
+    for (i = 0; i < broker->session_num; i++) {
+        session = broker->sessions[i];
+        if (session->op_pending && !strcmp(session->product_id, result->product_id) &&
+            !strcmp(session->device_name, result->device_name)) {
+            /* online already, e.g. through a former connection */
+            session->online     = 0 == result->result || QCLOUD_ERR_GATEWAY_SUBDEV_ONLINE == result->result;
+            session->op_result  = result->result;
+            session->op_pending = false;
+            break;
+        }
+    }
+    HAL_MutexUnlock(broker->lock);
+}
+
+static void _broker_offline_result(void *client, const GatewaySubdevResult *result, void *user_data)
+{
+    if (result->result && QCLOUD_ERR_GATEWAY_SUBDEV_OFFLINE != result->result) {
+        Log_w("%s/%s offline failed: %d", result->product_id, result->device_name, result->result);
+    }
+}
+
+static void _broker_accept(GatewayBroker *broker)
+{
+    GatewayBrokerSession *session;
+    uintptr_t             fd;
+
+    while ((fd = HAL_TCP_Accept((int)broker->listen_fd)) != 0) {
+        if (GATEWAY_BROKER_MAX_SESSIONS == broker->session_num) {
+            Log_w("sessions are full, refuse the connection");
+            broker->stats.refuse_cnt++;
+            HAL_TCP_Disconnect(fd);
+            continue;
+        }
+
+        session = HAL_Malloc(sizeof(GatewayBrokerSession));
+        if (!session) {
+            Log_e("malloc session failed");
+            HAL_TCP_Disconnect(fd);
+            break;
+        }
+        memset(session, 0, sizeof(GatewayBrokerSession));
+        session->fd                                  = fd;
+        session->state                               = GATEWAY_BROKER_CONNECTING;
+        session->last_rx_ms                          = HAL_GetTimeMs();
+        broker->sessions[broker->session_num++] = session;
+    }
+}
+
+/* read and handle the packets of each session, returns the number of sessions read */
+static int _broker_serve(GatewayBroker *broker)
+{
+    GatewayBrokerSession *session;
+    size_t                read_len;
+    uint32_t              now;
+    int                   i, rc;
+    int                   polled = 0;
+
+    for (i = 0; i < broker->session_num; i++) {
+        session = broker->sessions[i];
+        if (session->fd && session->rx_len < sizeof(session->rx_buf)) {
+            read_len = 0;
+            rc       = HAL_TCP_Read(session->fd, session->rx_buf + session->rx_len,
+                              sizeof(session->rx_buf) - session->rx_len, GATEWAY_BROKER_POLL_MS, &read_len);
+            polled++;
+            if (read_len) {
+                session->rx_len += read_len;
+                session->last_rx_ms = HAL_GetTimeMs();
+            } else if (QCLOUD_ERR_TCP_READ_TIMEOUT != rc && QCLOUD_ERR_TCP_NOTHING_TO_READ != rc) {
+                Log_i("%s/%s disconnected: %d", session->product_id, session->device_name, rc);
+                _session_close(session);
+            }
+        }
+
+        if (GATEWAY_BROKER_ONLINE_WAIT == session->state && !session->op_pending) {
+            _session_online_done(broker, session);
+        }
+        _session_process(broker, session);
+
+        now = HAL_GetTimeMs();
+        if (GATEWAY_BROKER_CONNECTING == session->state &&
+            _time_reached(now, session->last_rx_ms + GATEWAY_BROKER_CONNECT_TIMEOUT_MS)) {
+            Log_w("no CONNECT in time, close the connection");
+            _session_close(session);
+        } else if (GATEWAY_BROKER_CONNECTED == session->state && session->keep_alive &&
+                   _time_reached(now, session->last_rx_ms + session->keep_alive * 1500u)) {
+            Log_w("%s/%s keep alive timeout", session->product_id, session->device_name);
+            _session_close(session);
+        }
+
+        if (session->pending_params[0] &&
+            (GATEWAY_BROKER_CLOSED == session->state || _time_reached(now, session->pending_deadline_ms))) {
+            _report_flush(broker, session);
+        }
+    }
+
+    return polled;
+}
+
+static void _broker_copy_device(DeviceInfo *devices, int *num, GatewayBrokerSession *session)
+{
+    memset(&devices[*num], 0, sizeof(DeviceInfo));
+    strncpy(devices[*num].product_id, session->product_id, MAX_SIZE_OF_PRODUCT_ID);
+    strncpy(devices[*num].device_name, session->device_name, MAX_SIZE_OF_DEVICE_NAME);
+    (*num)++;
+}
+
+/**
+ * @brief Bring the sub-devices of new sessions online and take those of closed sessions offline
+ *
+ * The operations are started without the lock of the broker, as their results
+ * may be called back at once.
+ */
+static void _broker_operate(GatewayBroker *broker)
+{
+    GatewayBrokerSession *session;
+    GatewayParam          param = DEFAULT_GATEWAY_PARAMS;
+    DeviceInfo *          info  = IOT_MQTT_GetDeviceInfo(((Gateway *)broker->gateway)->mqtt);
+    DeviceInfo *          online, *offline;
+    int                   online_num = 0, offline_num = 0;
+    int                   i, num = 0;
+
+    HAL_MutexLock(broker->lock);
+    for (i = 0; i < broker->session_num; i++) {
+        session = broker->sessions[i];
+        if (GATEWAY_BROKER_ONLINE_START == session->state ||
+            (GATEWAY_BROKER_CLOSED == session->state && !session->op_pending)) {
+            num++;
+        }
+    }
+    if (!num) {
+        HAL_MutexUnlock(broker->lock);
+        return;
+    }
+
+    online = HAL_Malloc(2 * num * sizeof(DeviceInfo));
+    if (!online) {
+        Log_e("malloc devices failed");
+        HAL_MutexUnlock(broker->lock);
+        return;
+    }
+    offline = online + num;
+
+    for (i = 0; i < broker->session_num; i++) {
+        session = broker->sessions[i];
+        if (GATEWAY_BROKER_ONLINE_START == session->state) {
+            session->state      = GATEWAY_BROKER_ONLINE_WAIT;
+            session->op_pending = true;
+            _broker_copy_device(online, &online_num, session);
+            continue;
+        }
+        /* a closed session waits for the result of bringing online to take the sub-device offline */
+        if (GATEWAY_BROKER_CLOSED != session->state || session->op_pending) {
+            continue;
+        }
+
+        if (session->online) {
+            IOT_Gateway_Route_Register(broker->gateway, session->product_id, session->device_name, NULL, NULL);
+            _broker_copy_device(offline, &offline_num, session);
+        }
+        HAL_Free(session);
+        broker->sessions[i--] = broker->sessions[--broker->session_num];
+    }
+    HAL_MutexUnlock(broker->lock);
+
+    param.product_id  = info->product_id;
+    param.device_name = info->device_name;
+    if (offline_num) {
+        IOT_Gateway_Subdev_Operate_Async(broker->gateway, &param, eGATEWAY_SUBDEV_OFFLINE, offline, offline_num,
+                                         GATEWAY_BROKER_OP_TIMEOUT_MS, _broker_offline_result, NULL);
+    }
+    if (online_num) {
+        IOT_Gateway_Subdev_Operate_Async(broker->gateway, &param, eGATEWAY_SUBDEV_ONLINE, online, online_num,
+                                         GATEWAY_BROKER_OP_TIMEOUT_MS, _broker_online_result, broker);
+    }
+
+    HAL_Free(online);
+}
+
+void *IOT_Gateway_Broker_Create(void *client, const GatewayBrokerParams *params)
+{
+    GatewayBroker *broker;
+    Gateway *      gateway = (Gateway *)client;
+    int            rc;
+
+    POINTER_SANITY_CHECK(gateway, NULL);
+    POINTER_SANITY_CHECK(params, NULL);
+
+    broker = HAL_Malloc(sizeof(GatewayBroker));
+    if (!broker) {
+        Log_e("malloc gateway broker failed");
+        return NULL;
+    }
+    memset(broker, 0, sizeof(GatewayBroker));
+
+    broker->lock = HAL_MutexCreate();
+    if (!broker->lock) {
+        Log_e("create gateway broker lock failed");
+        HAL_Free(broker);
+        return NULL;
+    }
+
+    broker->gateway     = gateway;
+    broker->params      = *params;
+    broker->params.host = NULL;
+
+    /* down topics of the sub-devices come through their routes */
+    rc = IOT_Gateway_Route_Subscribe(gateway, GATEWAY_ROUTE_THING_DOWN_FILTER,
+                                     GATEWAY_ROUTE_THING_DOWN_PRODUCT_ID_LEVEL,
+                                     GATEWAY_ROUTE_THING_DOWN_DEVICE_NAME_LEVEL, QOS0);
+    if (rc < 0) {
+        Log_e("subscribe %s failed: %d", GATEWAY_ROUTE_THING_DOWN_FILTER, rc);
+        goto exit;
+    }
+
+    broker->listen_fd = HAL_TCP_CreatBind(params->host, params->port);
+    if (!broker->listen_fd) {
+        Log_e("listen on port %u failed", params->port);
+        IOT_MQTT_Unsubscribe(gateway->mqtt, GATEWAY_ROUTE_THING_DOWN_FILTER);
+        goto exit;
+    }
+
+    return broker;
+
+exit:
+    HAL_MutexDestroy(broker->lock);
+    HAL_Free(broker);
+    return NULL;
+}
+
+/* wait for the results of bringing online, which are called back with the broker. Every operation is called back
+ * by its timeout at last, the timeouts are only checked by the yield of gateway or when a result comes */
+static void _broker_drain_ops(GatewayBroker *broker)
+{
+    Gateway *gateway = (Gateway *)broker->gateway;
+    bool     pending;
+    int      i;
+#ifdef MULTITHREAD_ENABLED
+    int exit_code;
+#endif
+
+    for (;;) {
+        HAL_MutexLock(broker->lock);
+        for (pending = false, i = 0; !pending && i < broker->session_num; i++) {
+            pending = broker->sessions[i]->op_pending;
+        }
+        HAL_MutexUnlock(broker->lock);
+        if (!pending) {
+            return;
+        }
+
+#ifdef MULTITHREAD_ENABLED
+        if (IOT_MQTT_GetLoopStatus(gateway->mqtt, &exit_code)) {
+            gateway_subdev_expire_ops(gateway);
+            HAL_SleepMs(GATEWAY_BROKER_IDLE_MS);
+            continue;
+        }
+#endif
+        IOT_Gateway_Yield(gateway, GATEWAY_BROKER_IDLE_MS);
+    }
+}
+
+void IOT_Gateway_Broker_Destroy(void *handle)
+{
+    GatewayBroker *       broker = (GatewayBroker *)handle;
+    GatewayBrokerSession *session;
+    GatewayParam          param = DEFAULT_GATEWAY_PARAMS;
+    DeviceInfo *          info, *offline = NULL;
+    int                   i, offline_num = 0;
+
+    POINTER_SANITY_CHECK_RTN(broker);
+
+    /* no message of the cloud is routed to the broker once it is freed */
+    IOT_MQTT_Unsubscribe(((Gateway *)broker->gateway)->mqtt, GATEWAY_ROUTE_THING_DOWN_FILTER);
+    _broker_drain_ops(broker);
+
+    HAL_MutexLock(broker->lock);
+    if (broker->session_num) {
+        offline = HAL_Malloc(broker->session_num * sizeof(DeviceInfo));
+    }
+    for (i = 0; i < broker->session_num; i++) {
+        session = broker->sessions[i];
+        _session_close(session);
+        if (session->online) {
+            IOT_Gateway_Route_Register(broker->gateway, session->product_id, session->device_name, NULL, NULL);
+            if (offline) {
+                _broker_copy_device(offline, &offline_num, session);
+            }
+        }
+        HAL_Free(session);
+    }
+    broker->session_num = 0;
+    HAL_MutexUnlock(broker->lock);
+
+    /* the offline results don't refer to the broker */
+    if (offline_num) {
+        info              = IOT_MQTT_GetDeviceInfo(((Gateway *)broker->gateway)->mqtt);
+        param.product_id  = info->product_id;
+        param.device_name = info->device_name;
+        IOT_Gateway_Subdev_Operate_Async(broker->gateway, &param, eGATEWAY_SUBDEV_OFFLINE, offline, offline_num,
+                                         GATEWAY_BROKER_OP_TIMEOUT_MS, _broker_offline_result, NULL);
+    }
+    HAL_Free(offline);
+
+    HAL_TCP_Disconnect(broker->listen_fd);
+    HAL_MutexDestroy(broker->lock);
+    HAL_Free(broker);
+}
+
+int IOT_Gateway_Broker_Yield(void *handle, uint32_t timeout_ms)
+{
+    GatewayBroker *broker = (GatewayBroker *)handle;
+    Timer          timer;
+    int            polled, left;
+
+    POINTER_SANITY_CHECK(broker, QCLOUD_ERR_INVAL);
+
+    InitTimer(&timer);
+    countdown_ms(&timer, timeout_ms);
+    do {
+        HAL_MutexLock(broker->lock);
+        _broker_accept(broker);
+        polled = _broker_serve(broker);
+        HAL_MutexUnlock(broker->lock);
+
+        _broker_operate(broker);
+
+        /* reads of the sessions wait for data, sleep when there is none to read */
+        left = left_ms(&timer);
+        if (!polled && left > 0) {
+            HAL_SleepMs(left < GATEWAY_BROKER_IDLE_MS ? left : GATEWAY_BROKER_IDLE_MS);
+        }
+    } while (!expired(&timer));
+
+    return broker->session_num;
+}
+
+int IOT_Gateway_Broker_GetStats(void *handle, GatewayBrokerStats *stats)
+{
+    GatewayBroker *broker = (GatewayBroker *)handle;
+
+    POINTER_SANITY_CHECK(broker, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(stats, QCLOUD_ERR_INVAL);
+
+    HAL_MutexLock(broker->lock);
+    *stats             = broker->stats;
+    stats->session_num = broker->session_num;
+    HAL_MutexUnlock(broker->lock);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -20,6 +20,7 @@
  */
 
 #include "gateway_common.h"
+#include "gateway_template.h"
 
 #include "lite-utils.h"
 #include "mqtt_client.h"
@@ -29,55 +30,53 @@
 #include "json_parser.h"
 
 enum { SUBDEV_OP_DESCRIBE, SUBDEV_OP_BIND, SUBDEV_OP_UNBIND };
-static bool get_json_type(char *json, char **v)
+static bool get_json_type(char *json, json_span_t *v)
 {
-    *v = LITE_json_value_of("type", json);
-    return *v == NULL ? false : true;
+    return LITE_json_span_of("type", json, strlen(json), v) == QCLOUD_RET_SUCCESS && v->type == JSSTRING;
 }
 
-static bool get_json_devices(char *json, char **v)
+static bool get_json_devices(char *json, json_span_t *v)
 {
-    *v = LITE_json_value_of("payload.devices", json);
-    return *v == NULL ? false : true;
+    return LITE_json_span_of("payload.devices", json, strlen(json), v) == QCLOUD_RET_SUCCESS;
 }
 
-static bool get_json_result(char *json, int32_t *res)
+static bool get_json_result(const char *json, size_t len, int32_t *res)
 {
-    char *v = LITE_json_value_of("result", json);
-    if (v == NULL) {
-        return false;
-    }
-    if (LITE_get_int32(res, v) != QCLOUD_RET_SUCCESS) {
-        HAL_Free(v);
+    json_span_t v;
+
+    if (LITE_json_span_of("result", json, len, &v)) {
         return false;
     }
-    HAL_Free(v);
-    return true;
+    return LITE_span_get_int32(res, &v) == QCLOUD_RET_SUCCESS;
 }
 
 static bool get_json_payload_status(char *json, int32_t *res)
 {
-    char *v = LITE_json_value_of("payload.status", json);
-    if (!v)
+    json_span_t v;
+
+    if (LITE_json_span_of("payload.status", json, strlen(json), &v))
         return false;
-    bool ret = true;
-    if (LITE_get_int32(res, v) != QCLOUD_RET_SUCCESS) {
-        ret = false;
-    }
-    HAL_Free(v);
-    return ret;
+    return LITE_span_get_int32(res, &v) == QCLOUD_RET_SUCCESS;
 }
 
-static bool get_json_product_id(char *json, char **v)
+static bool get_json_product_id(const char *json, size_t len, char *v, size_t v_len)
 {
-    *v = LITE_json_value_of("product_id", json);
-    return *v == NULL ? false : true;
+    json_span_t span;
+
+    if (LITE_json_span_of("product_id", json, len, &span)) {
+        return false;
+    }
+    return LITE_span_get_string(v, &span, v_len) == QCLOUD_RET_SUCCESS;
 }
 
-static bool get_json_device_name(char *json, char **v)
+static bool get_json_device_name(const char *json, size_t len, char *v, size_t v_len)
 {
-    *v = LITE_json_value_of("device_name", json);
-    return *v == NULL ? false : true;
+    json_span_t span;
+
+    if (LITE_json_span_of("device_name", json, len, &span)) {
+        return false;
+    }
+    return LITE_span_get_string(v, &span, v_len) == QCLOUD_RET_SUCCESS;
 }
 
 #define MIN(a, b) ((a > b) ? b : a)
@@ -138,13 +137,12 @@ static int _subdev_unbind_device(Gateway *gateway, const char *product_id, const
 
 static void _subdev_proc_devlist(Gateway *gateway, char *devices, int type)
 {
-    char *subdev_product_id  = NULL;
-    char *subdev_device_name = NULL;
-    char *pos                = NULL;
-    char *entry              = NULL;
-    int   entry_len          = 0;
-    int   entry_type         = 0;
-    char  old_ch             = 0;
+    char  subdev_product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char  subdev_device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    char *pos        = NULL;
+    char *entry      = NULL;
+    int   entry_len  = 0;
+    int   entry_type = 0;
 
     int cont = 1;
 
@@ -153,15 +151,13 @@ static void _subdev_proc_devlist(Gateway *gateway, char *devices, int type)
     {
         if (!entry)
             continue;
-        backup_json_str_last_char(entry, entry_len, old_ch);
         cont = 1;
         do {
-            if (!get_json_product_id(entry, &subdev_product_id) || !get_json_device_name(entry, &subdev_device_name)) {
-                restore_json_str_last_char(entry, entry_len, old_ch);
-
+            if (!get_json_product_id(entry, entry_len, subdev_product_id, sizeof(subdev_product_id)) ||
+                !get_json_device_name(entry, entry_len, subdev_device_name, sizeof(subdev_device_name))) {
                 break;
             }
-            Log_d("entry is %s, %s %s", entry, subdev_product_id, subdev_device_name);
+            Log_d("entry is %.*s, %s %s", entry_len, entry, subdev_product_id, subdev_device_name);
             if (SUBDEV_OP_DESCRIBE == type || SUBDEV_OP_BIND == type) {
                 if (!_subdev_add_bindinfo(gateway, subdev_product_id, subdev_device_name)) {
                     Log_e("Failed to add bind info");
@@ -175,9 +171,6 @@ static void _subdev_proc_devlist(Gateway *gateway, char *devices, int type)
             }
         } while (0);
 
-        HAL_Free(subdev_product_id);
-        HAL_Free(subdev_device_name);
-        restore_json_str_last_char(entry, entry_len, old_ch);
         if (!cont)
             break;
     }
@@ -203,11 +196,10 @@ static void _gateway_ack_change(char *devices, Qcloud_IoT_Client *mqtt, int32_t
     char *entry      = NULL;
     int   entry_len  = 0;
     int   entry_type = 0;
-    char  old_ch     = 0;
 
-    char *subdev_product_id  = NULL;
-    char *subdev_device_name = NULL;
-    int   is_first = 1, is_cont = 1;
+    char subdev_product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char subdev_device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    int  is_first = 1, is_cont = 1;
 
 #define MAX_SUBDEV_INFO_SZ 128
 
@@ -215,10 +207,7 @@ static void _gateway_ack_change(char *devices, Qcloud_IoT_Client *mqtt, int32_t
     {
         if (!entry)
             continue;
-        backup_json_str_last_char(entry, entry_len, old_ch);
-        subdev_product_id  = NULL;
-        subdev_device_name = NULL;
-        is_cont            = 1;
+        is_cont = 1;
 
         if (left_sz < MAX_SUBDEV_INFO_SZ)
             break;
@@ -233,7 +222,8 @@ static void _gateway_ack_change(char *devices, Qcloud_IoT_Client *mqtt, int32_t
             } else {
                 is_first = 0;
             }
-            if (!get_json_product_id(entry, &subdev_product_id) || !get_json_device_name(entry, &subdev_device_name)) {
+            if (!get_json_product_id(entry, entry_len, subdev_product_id, sizeof(subdev_product_id)) ||
+                !get_json_device_name(entry, entry_len, subdev_device_name, sizeof(subdev_device_name))) {
                 break;
             }
             ret = HAL_Snprintf(p, left_sz, "{\"product_id\":\"%s\",\"device_name\":\"%s\",\"result\":%d}",
@@ -245,9 +235,6 @@ static void _gateway_ack_change(char *devices, Qcloud_IoT_Client *mqtt, int32_t
             p += ret;
             left_sz -= ret;
         } while (0);
-        restore_json_str_last_char(entry, entry_len, old_ch);
-        HAL_Free(subdev_product_id);
-        HAL_Free(subdev_device_name);
         if (!is_cont)
             break;
     }
@@ -328,28 +315,16 @@ static void _gateway_ack_search(Qcloud_IoT_Client *mqtt, int32_t status)
 
 static int _gateway_subdev_unbind_all(Gateway *gateway)
 {
-    SubdevSession *cur_session = NULL;
-    SubdevSession *pre_session = NULL;
-
     POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_FAILURE);
 
-    pre_session = cur_session = gateway->session_list;
-
-    if (NULL == cur_session) {
+    if (!gateway->sessions.count) {
         Log_e("session list is empty");
         IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
     }
 
-    /* session is exist */
-    while (cur_session) {
-        pre_session = cur_session;
-        cur_session = cur_session->next;
-        Log_d("remove all session product id: %s device_name: %s", pre_session->product_id, pre_session->device_name);
-        HAL_Free(pre_session);
-        pre_session = NULL;
-    }
-
-    gateway->session_list = NULL;
+    HAL_MutexLock(gateway->lock);
+    subdev_clear_sessions(gateway);
+    HAL_MutexUnlock(gateway->lock);
 
     return QCLOUD_RET_SUCCESS;
 }
@@ -383,6 +358,11 @@ static void _gateway_subdev_unbind_all_reply(Qcloud_IoT_Client *mqtt)
     IOT_MQTT_Publish(mqtt, topic_name, &params);
 }
 
+static const char *sg_subdev_op_str[] = {GATEWAY_ONLINE_OP_STR, GATEWAY_OFFLIN_OP_STR, GATEWAY_BIND_OP_STR,
+                                         GATEWAY_UNBIND_OP_STR};
+
+static void _subdev_proc_results(Gateway *gateway, GatewaySubdevOp op, char *devices);
+
 static void _gateway_message_handler(void *client, MQTTMessage *message, void *user_data)
 {
     Qcloud_IoT_Client *mqtt          = NULL;
@@ -390,13 +370,10 @@ static void _gateway_message_handler(void *client, MQTTMessage *message, void *u
     char *             topic         = NULL;
     size_t             topic_len     = 0;
     int                cloud_rcv_len = 0;
-    char *             type          = NULL;
-    char *             devices = NULL, *devices_strip = NULL;
-    char *             product_id                           = NULL;
-    char *             device_name                          = NULL;
-    int32_t            result                               = 0;
-    char               client_id[MAX_SIZE_OF_CLIENT_ID + 1] = {0};
-    int                size                                 = 0;
+    json_span_t        type;
+    json_span_t        devices;
+    char               devices_last_char = 0;
+    GatewaySubdevOp    op;
 
     POINTER_SANITY_CHECK_RTN(client);
     POINTER_SANITY_CHECK_RTN(message);
@@ -422,7 +399,7 @@ static void _gateway_message_handler(void *client, MQTTMessage *message, void *u
         return;
     }
 
-    if (!strncmp(type, GATEWAY_UNBIND_ALL_OP_STR, sizeof(GATEWAY_UNBIND_ALL_OP_STR) - 1)) {
+    if (!strncmp(type.ptr, GATEWAY_UNBIND_ALL_OP_STR, sizeof(GATEWAY_UNBIND_ALL_OP_STR) - 1)) {
         Log_d("recv request for unbind_all");
 
         _gateway_subdev_unbind_all(gateway);
@@ -433,9 +410,9 @@ static void _gateway_message_handler(void *client, MQTTMessage *message, void *u
         msg.msg        = NULL;
         mqtt->event_handle.h_fp(mqtt, mqtt->event_handle.context, &msg);
 
-        goto exit;
+        return;
     }
-    if (!strncmp(type, GATEWAY_SEARCH_OP_STR, sizeof(GATEWAY_SEARCH_OP_STR) - 1)) {
+    if (!strncmp(type.ptr, GATEWAY_SEARCH_OP_STR, sizeof(GATEWAY_SEARCH_OP_STR) - 1)) {
         int32_t search_status;
         if (get_json_payload_status(json_buf, &search_status)) {
             _gateway_ack_search(mqtt, search_status);
@@ -445,92 +422,82 @@ static void _gateway_message_handler(void *client, MQTTMessage *message, void *u
             msg.msg        = (void *)&search_status;
             mqtt->event_handle.h_fp(mqtt, mqtt->event_handle.context, &msg);
         }
-        goto exit;
+        return;
     }
-    if (!strncmp(type, GATEWAY_DESCRIBE_SUBDEVIES_OP_STR, sizeof(GATEWAY_DESCRIBE_SUBDEVIES_OP_STR) - 1)) {
+    if (!strncmp(type.ptr, GATEWAY_DESCRIBE_SUBDEVIES_OP_STR, sizeof(GATEWAY_DESCRIBE_SUBDEVIES_OP_STR) - 1)) {
         _gateway_ack_topo_describe(mqtt);
-        goto exit;
+        return;
     }
 
     if (!get_json_devices(json_buf, &devices)) {
         Log_e("Fail to parse devices from msg: %s", json_buf);
-        goto exit;
+        return;
     }
 
-    if (devices[0] == '[') {
-        devices_strip = devices + 1;
-    } else {
-        devices_strip = devices;
-    }
+    // devices is handed to array iterator and user callback as a string, terminate it in recv_buf
+    backup_json_str_last_char(devices.ptr, devices.len, devices_last_char);
 
-    if (!strncmp(type, GATEWAY_CHANGE_OP_STR, sizeof(GATEWAY_CHANGE_OP_STR) - 1)) {
+    if (!strncmp(type.ptr, GATEWAY_CHANGE_OP_STR, sizeof(GATEWAY_CHANGE_OP_STR) - 1)) {
         int32_t change_status = 0, change_type;
         if (get_json_payload_status(json_buf, &change_status)) {
             Log_d("Request status is %d", change_status);
             change_type = change_status ? SUBDEV_OP_BIND : SUBDEV_OP_UNBIND;
-            _subdev_proc_devlist(gateway, devices, change_type);
+            _subdev_proc_devlist(gateway, (char *)devices.ptr, change_type);
         }
-        _gateway_ack_change(devices, mqtt, change_status);
+        _gateway_ack_change((char *)devices.ptr, mqtt, change_status);
         MQTTEventMsg msg;
         msg.event_type             = MQTT_EVENT_GATEWAY_CHANGE;
-        gw_change_notify_t notify_ = {devices, change_status};
+        gw_change_notify_t notify_ = {(char *)devices.ptr, change_status};
         msg.msg                    = (void *)&notify_;
         mqtt->event_handle.h_fp(mqtt, mqtt->event_handle.context, &msg);
 
         goto exit;
     }
 
-    if (!get_json_result(devices_strip, &result) || !get_json_product_id(devices_strip, &product_id) ||
-        !get_json_device_name(devices_strip, &device_name)) {
-        Log_e("Failed to parse  from msg: %s %p %p %p", json_buf, result, product_id, device_name);
-        goto exit;
-    }
-    size = HAL_Snprintf(client_id, MAX_SIZE_OF_CLIENT_ID + 1, GATEWAY_CLIENT_ID_FMT, product_id, device_name);
-    if (size < 0 || size > MAX_SIZE_OF_CLIENT_ID) {
-        Log_e("generate client_id fail.");
-        goto exit;
-    }
-    if (!strncmp(type, GATEWAY_ONLINE_OP_STR, sizeof(GATEWAY_ONLINE_OP_STR) - 1)) {
-        if (strncmp(client_id, gateway->gateway_data.online.client_id, size) == 0) {
-            Log_i("client_id(%s), online result %d", client_id, result);
-            gateway->gateway_data.online.result = result;
-        }
-        goto exit;
-    }
-    if (!strncmp(type, GATEWAY_OFFLIN_OP_STR, sizeof(GATEWAY_OFFLIN_OP_STR) - 1)) {
-        if (strncmp(client_id, gateway->gateway_data.offline.client_id, size) == 0) {
-            Log_i("client_id(%s), offline result %d", client_id, result);
-            gateway->gateway_data.offline.result = result;
-        }
-        goto exit;
-    }
-    if (!strncmp(type, GATEWAY_BIND_OP_STR, sizeof(GATEWAY_BIND_OP_STR) - 1)) {
-        if (strncmp(client_id, gateway->gateway_data.bind.client_id, size) == 0) {
-            gateway->gateway_data.bind.result = result;
-            Log_i("client_id(%s), bind result %d", client_id, gateway->gateway_data.bind.result);
+    for (op = eGATEWAY_SUBDEV_ONLINE; op <= eGATEWAY_SUBDEV_UNBIND; op++) {
+        if (LITE_span_equal(&type, sg_subdev_op_str[op])) {
+            break;
         }
-        goto exit;
     }
-    if (!strncmp(type, GATEWAY_UNBIND_OP_STR, sizeof(GATEWAY_UNBIND_OP_STR) - 1)) {
-        if (strncmp(client_id, gateway->gateway_data.unbind.client_id, size) == 0) {
-            gateway->gateway_data.unbind.result = result;
-            Log_i("client_id(%s), unbind result %d", client_id, gateway->gateway_data.unbind.result);
-        }
+    if (op <= eGATEWAY_SUBDEV_UNBIND) {
+        _subdev_proc_results(gateway, op, (char *)devices.ptr);
     } else {
-        Log_e("shouldnt reach here: unknown type %s", type);
+        Log_e("shouldnt reach here: unknown type %.*s", (int)type.len, type.ptr);
     }
 exit:
-    HAL_Free(type);
-    HAL_Free(devices);
-    HAL_Free(product_id);
-    HAL_Free(device_name);
+    restore_json_str_last_char(devices.ptr, devices.len, devices_last_char);
+    utils_completion_signal(&gateway->gateway_data.sync_done);
+
+    /* the yield thread doesn't yield gateway, timeouts are also checked when a message comes */
+    gateway_subdev_expire_ops(gateway);
+}
+
+/* wait until the reply changes the value of *result, sync_done is reset before the request */
+static int _gateway_wait_sync(Gateway *gateway, int32_t *result)
+{
+    Completion *sync_done = &gateway->gateway_data.sync_done;
+    int32_t     value     = *result;
+    Timer       timer;
+    int         rc;
+
+    InitTimer(&timer);
+    countdown_ms(&timer, GATEWAY_SYNC_TIMEOUT_MS);
+    while (value == *result) {
+        rc = utils_completion_wait(sync_done, gateway->mqtt, left_ms(&timer), IOT_Gateway_Yield, gateway);
+        if (rc != QCLOUD_RET_SUCCESS) {
+            return rc;
+        }
+        /* woken by another reply, wait again */
+        utils_completion_reset(sync_done);
+    }
+
+    return QCLOUD_RET_SUCCESS;
 }
 
 int gateway_subscribe_unsubscribe_topic(Gateway *gateway, char *topic_filter, SubscribeParams *params, int is_subscribe)
 {
-    int      rc         = 0;
-    int      loop_count = 0;
-    uint32_t status     = -1;
+    int      rc     = 0;
+    uint32_t status = -1;
 
     POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
     POINTER_SANITY_CHECK(params, QCLOUD_ERR_INVAL);
@@ -538,6 +505,7 @@ int gateway_subscribe_unsubscribe_topic(Gateway *gateway, char *topic_filter, Su
 
     params->qos                       = QOS1;
     gateway->gateway_data.sync_status = status;
+    utils_completion_reset(&gateway->gateway_data.sync_done);
 
     if (is_subscribe) {
         /* subscribe */
@@ -553,13 +521,10 @@ int gateway_subscribe_unsubscribe_topic(Gateway *gateway, char *topic_filter, Su
     }
 
     gateway->gateway_data.sync_status = status = rc;
-    while (status == gateway->gateway_data.sync_status) {
-        if (loop_count > GATEWAY_LOOP_MAX_COUNT) {
-            Log_i("loop max count, time out");
-            IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
-        }
-        IOT_Gateway_Yield(gateway, 200);
-        loop_count++;
+    rc                                = _gateway_wait_sync(gateway, &gateway->gateway_data.sync_status);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        Log_i("sync wait time out");
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
     }
 
     if (gateway->gateway_data.sync_status != 0) {
@@ -596,23 +561,95 @@ int gateway_subscribe_unsubscribe_default(Gateway *gateway, GatewayParam *param)
     IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
 }
 
-SubdevSession *subdev_find_session(Gateway *gateway, char *product_id, char *device_name)
+static uint32_t _subdev_session_hash_n(const char *product_id, size_t product_id_len, const char *device_name,
+                                       size_t device_name_len)
 {
-    POINTER_SANITY_CHECK(gateway, NULL);
-    STRING_PTR_SANITY_CHECK(product_id, NULL);
-    STRING_PTR_SANITY_CHECK(device_name, NULL);
+    uint32_t hash = 2166136261u;
+    size_t   i;
+
+    for (i = 0; i < product_id_len; i++) {
+        hash = (hash ^ (uint8_t)product_id[i]) * 16777619u;
+    }
+    hash = (hash ^ '/') * 16777619u;
+    for (i = 0; i < device_name_len; i++) {
+        hash = (hash ^ (uint8_t)device_name[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t _subdev_session_hash(const char *product_id, const char *device_name)
+{
+    return _subdev_session_hash_n(product_id, strlen(product_id), device_name, strlen(device_name));
+}
+
+static SubdevSession **_subdev_session_bucket(Gateway *gateway, const char *product_id, const char *device_name)
+{
+    return &gateway->sessions.buckets[_subdev_session_hash(product_id, device_name) &
+                                      (gateway->sessions.bucket_num - 1)];
+}
+
+/* rehash into bucket_num buckets, the table keeps working in its old buckets if memory runs out */
+static int _subdev_session_rehash(Gateway *gateway, uint16_t bucket_num)
+{
+    SubdevSession **buckets = HAL_Malloc(bucket_num * sizeof(SubdevSession *));
+    SubdevSession * session, *next;
+    uint16_t        i, bucket;
+
+    if (!buckets) {
+        return QCLOUD_ERR_MALLOC;
+    }
+    memset(buckets, 0, bucket_num * sizeof(SubdevSession *));
+
+    for (i = 0; i < gateway->sessions.bucket_num; i++) {
+        for (session = gateway->sessions.buckets[i]; session; session = next) {
+            next            = session->next;
+            bucket          = _subdev_session_hash(session->product_id, session->device_name) & (bucket_num - 1);
+            session->next   = buckets[bucket];
+            buckets[bucket] = session;
+        }
+    }
 
-    SubdevSession *session = gateway->session_list;
+    HAL_Free(gateway->sessions.buckets);
+    gateway->sessions.buckets    = buckets;
+    gateway->sessions.bucket_num = bucket_num;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* find session by ids not terminated, like the levels of a topic */
+static SubdevSession *_subdev_find_session_n(Gateway *gateway, const char *product_id, size_t product_id_len,
+                                             const char *device_name, size_t device_name_len)
+{
+    SubdevSession *session;
+
+    if (!gateway->sessions.count) {
+        return NULL;
+    }
+
+    session = gateway->sessions.buckets[_subdev_session_hash_n(product_id, product_id_len, device_name,
+                                                               device_name_len) &
+                                        (gateway->sessions.bucket_num - 1)];
 
     /* session is exist */
     while (session) {
-        if (0 == strcmp(session->product_id, product_id) && 0 == strcmp(session->device_name, device_name)) {
-            IOT_FUNC_EXIT_RC(session);
+        if (!strncmp(session->product_id, product_id, product_id_len) && !session->product_id[product_id_len] &&
+            !strncmp(session->device_name, device_name, device_name_len) && !session->device_name[device_name_len]) {
+            return session;
         }
         session = session->next;
     }
 
-    IOT_FUNC_EXIT_RC(NULL);
+    return NULL;
+}
+
+SubdevSession *subdev_find_session(Gateway *gateway, char *product_id, char *device_name)
+{
+    POINTER_SANITY_CHECK(gateway, NULL);
+    STRING_PTR_SANITY_CHECK(product_id, NULL);
+    STRING_PTR_SANITY_CHECK(device_name, NULL);
+
+    IOT_FUNC_EXIT_RC(_subdev_find_session_n(gateway, product_id, strlen(product_id), device_name, strlen(device_name)));
 }
 
 SubdevSession *subdev_add_session(Gateway *gateway, char *product_id, char *device_name)
@@ -621,6 +658,21 @@ SubdevSession *subdev_add_session(Gateway *gateway, char *product_id, char *devi
     STRING_PTR_SANITY_CHECK(product_id, NULL);
     STRING_PTR_SANITY_CHECK(device_name, NULL);
 
+    if (strlen(product_id) > MAX_SIZE_OF_PRODUCT_ID || strlen(device_name) > MAX_SIZE_OF_DEVICE_NAME) {
+        Log_e("product_id or device_name too long");
+        IOT_FUNC_EXIT_RC(NULL);
+    }
+
+    if (!gateway->sessions.buckets) {
+        if (_subdev_session_rehash(gateway, SUBDEV_SESSION_BUCKET_NUM) != QCLOUD_RET_SUCCESS) {
+            Log_e("Not enough memory");
+            IOT_FUNC_EXIT_RC(NULL);
+        }
+    } else if (gateway->sessions.count >= gateway->sessions.bucket_num && gateway->sessions.bucket_num < 0x8000) {
+        /* longer chains are still correct, growing is only tried again on the next add */
+        _subdev_session_rehash(gateway, gateway->sessions.bucket_num * 2);
+    }
+
     SubdevSession *session = HAL_Malloc(sizeof(SubdevSession));
     if (session == NULL) {
         Log_e("Not enough memory");
@@ -628,61 +680,360 @@ SubdevSession *subdev_add_session(Gateway *gateway, char *product_id, char *devi
     }
 
     memset(session, 0, sizeof(SubdevSession));
-    /* add session to list */
-    session->next         = gateway->session_list;
-    gateway->session_list = session;
-
-    int size = strlen(product_id);
-    strncpy(session->product_id, product_id, size);
-    session->product_id[size] = '\0';
-    size                      = strlen(device_name);
-    strncpy(session->device_name, device_name, size);
-    session->device_name[size] = '\0';
-    session->session_status    = SUBDEV_SEESION_STATUS_INIT;
+    strcpy(session->product_id, product_id);
+    strcpy(session->device_name, device_name);
+    session->session_status = SUBDEV_SEESION_STATUS_INIT;
+
+    /* add session to its bucket */
+    SubdevSession **bucket = _subdev_session_bucket(gateway, product_id, device_name);
+    session->next          = *bucket;
+    *bucket                = session;
+    gateway->sessions.count++;
 
     IOT_FUNC_EXIT_RC(session);
 }
 
 int subdev_remove_session(Gateway *gateway, char *product_id, char *device_name)
 {
-    SubdevSession *cur_session = NULL, *pre_session = NULL;
+    SubdevSession **link, *session;
 
     POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_FAILURE);
     STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_FAILURE);
     STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_FAILURE);
 
-    pre_session = cur_session = gateway->session_list;
-    if (NULL == cur_session) {
+    if (!gateway->sessions.count) {
         Log_e("session list is empty");
         IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
     }
 
-    while (cur_session) {
-        if (0 == strncmp(cur_session->product_id, product_id, MAX_SIZE_OF_PRODUCT_ID) &&
-            0 == strncmp(cur_session->device_name, device_name, MAX_SIZE_OF_DEVICE_NAME)) {
-            if (cur_session == gateway->session_list) {
-                gateway->session_list = cur_session->next;
-            } else {
-                pre_session->next = cur_session->next;
-            }
-            HAL_Free(cur_session);
+    for (link = _subdev_session_bucket(gateway, product_id, device_name); (session = *link); link = &session->next) {
+        if (0 == strcmp(session->product_id, product_id) && 0 == strcmp(session->device_name, device_name)) {
+            *link = session->next;
+            gateway->sessions.count--;
+            HAL_Free(session);
             IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
         }
-        pre_session = cur_session;
-        cur_session = cur_session->next;
     }
 
     IOT_FUNC_EXIT_RC(QCLOUD_ERR_FAILURE);
 }
 
+void subdev_clear_sessions(Gateway *gateway)
+{
+    SubdevSession *session, *next;
+    uint16_t       i;
+
+    for (i = 0; i < gateway->sessions.bucket_num; i++) {
+        for (session = gateway->sessions.buckets[i]; session; session = next) {
+            next = session->next;
+            Log_d("remove session product id: %s device_name: %s", session->product_id, session->device_name);
+            HAL_Free(session);
+        }
+    }
+
+    HAL_Free(gateway->sessions.buckets);
+    memset(&gateway->sessions, 0, sizeof(SubdevSessionTable));
+}
+
+/* check the session of sub-device before its operation is published, return SUBDEV_RESULT_PENDING to publish it
+ * or the result to call back, lock held */
+static int32_t _subdev_session_prepare(Gateway *gateway, GatewaySubdevOp op, char *product_id, char *device_name)
+{
+    SubdevSession *session = subdev_find_session(gateway, product_id, device_name);
+
+    if (eGATEWAY_SUBDEV_ONLINE == op) {
+        if (NULL == session) {
+            Log_d("there is no session, create a new session");
+
+            /* create subdev session */
+            session = subdev_add_session(gateway, product_id, device_name);
+            if (NULL == session) {
+                Log_e("create session error!");
+                return QCLOUD_ERR_GATEWAY_CREATE_SESSION_FAIL;
+            }
+        } else if (SUBDEV_SEESION_STATUS_ONLINE == session->session_status) {
+            Log_i("device have online");
+            return QCLOUD_ERR_GATEWAY_SUBDEV_ONLINE;
+        }
+    } else if (eGATEWAY_SUBDEV_OFFLINE == op) {
+        if (NULL == session) {
+            Log_d("no session, can not offline");
+            return QCLOUD_ERR_GATEWAY_SESSION_NO_EXIST;
+        }
+        if (SUBDEV_SEESION_STATUS_OFFLINE == session->session_status) {
+            Log_i("device have offline");
+            /* free session */
+            subdev_remove_session(gateway, product_id, device_name);
+            return QCLOUD_ERR_GATEWAY_SUBDEV_OFFLINE;
+        }
+    }
+
+    return SUBDEV_RESULT_PENDING;
+}
+
+/* update the session of sub-device with the result of its operation, lock held */
+static void _subdev_session_finish(Gateway *gateway, GatewaySubdevOp op, char *product_id, char *device_name,
+                                   int32_t result)
+{
+    SubdevSession *session;
+
+    if (eGATEWAY_SUBDEV_ONLINE == op) {
+        session = subdev_find_session(gateway, product_id, device_name);
+        if (NULL == session || SUBDEV_SEESION_STATUS_ONLINE == session->session_status) {
+            return;
+        }
+
+        if (0 == result) {
+            session->session_status = SUBDEV_SEESION_STATUS_ONLINE;
+        } else {
+            subdev_remove_session(gateway, product_id, device_name);
+        }
+    } else if (eGATEWAY_SUBDEV_OFFLINE == op && 0 == result) {
+        /* free session */
+        subdev_remove_session(gateway, product_id, device_name);
+    }
+}
+
+static uint32_t _subdev_op_key(GatewaySubdevOp op, const char *product_id, const char *device_name)
+{
+    return (_subdev_session_hash(product_id, device_name) ^ (uint32_t)op) * 16777619u;
+}
+
+static void _subdev_call_back(Gateway *gateway, GatewaySubdevOp op, int index, const char *product_id,
+                              const char *device_name, int32_t result, OnGatewaySubdevResult callback,
+                              void *user_data)
+{
+    GatewaySubdevResult subdev_result = {op, index, product_id, device_name, result};
+
+    callback(gateway, &subdev_result, user_data);
+}
+
+/* call back the operation taken out of ops and free it, lock not held */
+static void _subdev_op_call_back(Gateway *gateway, RequestEntry *entry, int32_t result)
+{
+    SubdevOp *subdev_op = (SubdevOp *)entry->user_context;
+
+    _subdev_call_back(gateway, (GatewaySubdevOp)entry->arg, subdev_op->index, subdev_op->product_id,
+                      subdev_op->device_name, result, (OnGatewaySubdevResult)entry->callback, subdev_op->user_data);
+    HAL_Free(subdev_op);
+}
+
+/* add the operation on sub-device to ops, return SUBDEV_RESULT_PENDING if added or the result to call back */
+static int32_t _subdev_op_start(Gateway *gateway, GatewaySubdevOp op, DeviceInfo *subdev, int index,
+                                uint32_t timeout_ms, OnGatewaySubdevResult callback, void *user_data, uint32_t *key)
+{
+    SubdevOp *   subdev_op = NULL;
+    RequestEntry entry;
+    int32_t      result;
+    int          rc;
+
+    subdev_op = (SubdevOp *)HAL_Malloc(sizeof(SubdevOp));
+    if (NULL == subdev_op) {
+        Log_e("Not enough memory");
+        return QCLOUD_ERR_MALLOC;
+    }
+
+    strcpy(subdev_op->product_id, subdev->product_id);
+    strcpy(subdev_op->device_name, subdev->device_name);
+    subdev_op->index       = index;
+    subdev_op->deadline_ms = HAL_GetTimeMs() + timeout_ms;
+    subdev_op->user_data   = user_data;
+
+    entry.token        = _subdev_op_key(op, subdev->product_id, subdev->device_name);
+    entry.arg          = op;
+    entry.callback     = (void *)callback;
+    entry.user_context = subdev_op;
+
+    HAL_MutexLock(gateway->lock);
+    if (request_table_contains(&gateway->ops, entry.token)) {
+        Log_w("%s of %s/%s is pending", sg_subdev_op_str[op], subdev->product_id, subdev->device_name);
+        result = QCLOUD_ERR_GATEWAY_SUBDEV_OP_PENDING;
+    } else {
+        result = _subdev_session_prepare(gateway, op, subdev->product_id, subdev->device_name);
+        if (SUBDEV_RESULT_PENDING == result) {
+            rc = request_table_add(&gateway->ops, &entry, timeout_ms);
+            if (QCLOUD_RET_SUCCESS != rc) {
+                _subdev_session_finish(gateway, op, subdev->product_id, subdev->device_name, rc);
+                result = rc;
+            }
+        }
+    }
+    HAL_MutexUnlock(gateway->lock);
+
+    if (SUBDEV_RESULT_PENDING != result) {
+        HAL_Free(subdev_op);
+    }
+    *key = entry.token;
+
+    return result;
+}
+
+/* take the operation on sub-device out of ops and update its session, lock not held */
+static bool _subdev_op_take(Gateway *gateway, GatewaySubdevOp op, char *product_id, char *device_name,
+                            int32_t result, RequestEntry *entry)
+{
+    SubdevOp *subdev_op;
+    int32_t   left_ms;
+    bool      taken = false;
+
+    HAL_MutexLock(gateway->lock);
+    if (request_table_take(&gateway->ops, _subdev_op_key(op, product_id, device_name), entry)) {
+        subdev_op = (SubdevOp *)entry->user_context;
+        if (!strcmp(subdev_op->product_id, product_id) && !strcmp(subdev_op->device_name, device_name)) {
+            _subdev_session_finish(gateway, op, product_id, device_name, result);
+            taken = true;
+        } else {
+            /* another sub-device of the same key, put the operation back, the slot just freed is reused */
+            left_ms = (int32_t)(subdev_op->deadline_ms - HAL_GetTimeMs());
+            request_table_add(&gateway->ops, entry, left_ms > 0 ? left_ms : 0);
+        }
+    }
+    HAL_MutexUnlock(gateway->lock);
+
+    return taken;
+}
+
+static void _subdev_proc_results(Gateway *gateway, GatewaySubdevOp op, char *devices)
+{
+    char         product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char         device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    RequestEntry entry;
+    int32_t      result;
+    char *       pos        = NULL;
+    char *       entry_str  = NULL;
+    int          entry_len  = 0;
+    int          entry_type = 0;
+
+    json_array_for_each_entry(devices, pos, entry_str, entry_len, entry_type)
+    {
+        if (!entry_str)
+            continue;
+        if (!get_json_result(entry_str, entry_len, &result) ||
+            !get_json_product_id(entry_str, entry_len, product_id, sizeof(product_id)) ||
+            !get_json_device_name(entry_str, entry_len, device_name, sizeof(device_name))) {
+            Log_e("Failed to parse result from %.*s", entry_len, entry_str);
+            continue;
+        }
+
+        if (!_subdev_op_take(gateway, op, product_id, device_name, result, &entry)) {
+            Log_w("no %s of %s/%s waiting for result", sg_subdev_op_str[op], product_id, device_name);
+            continue;
+        }
+
+        Log_i("client_id(%s/%s), %s result %d", product_id, device_name, sg_subdev_op_str[op], result);
+        _subdev_op_call_back(gateway, &entry, result);
+    }
+}
+
+void gateway_subdev_expire_ops(Gateway *gateway)
+{
+    RequestEntry entry;
+    SubdevOp *   subdev_op;
+
+    for (;;) {
+        HAL_MutexLock(gateway->lock);
+        if (!request_table_take_expired(&gateway->ops, &entry)) {
+            HAL_MutexUnlock(gateway->lock);
+            break;
+        }
+        subdev_op = (SubdevOp *)entry.user_context;
+        _subdev_session_finish(gateway, (GatewaySubdevOp)entry.arg, subdev_op->product_id, subdev_op->device_name,
+                               QCLOUD_ERR_GATEWAY_SESSION_TIMEOUT);
+        HAL_MutexUnlock(gateway->lock);
+
+        Log_w("client_id(%s/%s), %s timeout", subdev_op->product_id, subdev_op->device_name,
+              sg_subdev_op_str[entry.arg]);
+        _subdev_op_call_back(gateway, &entry, QCLOUD_ERR_GATEWAY_SESSION_TIMEOUT);
+    }
+}
+
+void gateway_subdev_clear_ops(Gateway *gateway)
+{
+    RequestEntry entry;
+
+    HAL_MutexLock(gateway->lock);
+    while (request_table_take_first(&gateway->ops, &entry)) {
+        HAL_Free(entry.user_context);
+    }
+    request_table_deinit(&gateway->ops);
+    HAL_MutexUnlock(gateway->lock);
+}
+
+/* span of the level of topic, levels are counted from 0 */
+static bool _topic_level_span(const char *topic, size_t topic_len, int level, const char **ptr, size_t *len)
+{
+    const char *end = topic + topic_len;
+    const char *sep;
+
+    while (level-- > 0) {
+        sep = memchr(topic, '/', end - topic);
+        if (!sep) {
+            return false;
+        }
+        topic = sep + 1;
+    }
+
+    sep  = memchr(topic, '/', end - topic);
+    *ptr = topic;
+    *len = (sep ? sep : end) - topic;
+
+    return *len > 0;
+}
+
+void gateway_route_message_handler(void *client, MQTTMessage *message, void *user_data)
+{
+    Qcloud_IoT_Client *    mqtt         = (Qcloud_IoT_Client *)client;
+    Gateway *              gateway      = NULL;
+    uintptr_t              levels       = (uintptr_t)user_data;
+    OnGatewaySubdevMessage handler      = NULL;
+    void *                 handler_data = NULL;
+    SubdevSession *        session;
+    const char *           product_id, *device_name;
+    size_t                 product_id_len, device_name_len;
+    MQTTEventMsg           msg;
+
+    POINTER_SANITY_CHECK_RTN(client);
+    POINTER_SANITY_CHECK_RTN(message);
+
+    gateway = (Gateway *)mqtt->event_handle.context;
+    POINTER_SANITY_CHECK_RTN(gateway);
+
+    /* whichever of the overlapping filters takes the message, the template gets the controls of its devices */
+    if (gateway->tpl && gateway_template_handle_message(gateway->tpl, message)) {
+        return;
+    }
+
+    if (_topic_level_span(message->ptopic, message->topic_len, GATEWAY_ROUTE_PRODUCT_ID_LEVEL(levels), &product_id,
+                          &product_id_len) &&
+        _topic_level_span(message->ptopic, message->topic_len, GATEWAY_ROUTE_DEVICE_NAME_LEVEL(levels), &device_name,
+                          &device_name_len)) {
+        HAL_MutexLock(gateway->lock);
+        session = _subdev_find_session_n(gateway, product_id, product_id_len, device_name, device_name_len);
+        if (session) {
+            handler      = session->handler;
+            handler_data = session->handler_data;
+        }
+        HAL_MutexUnlock(gateway->lock);
+    }
+
+    if (handler) {
+        handler(gateway, message, handler_data);
+        return;
+    }
+
+    Log_d("no sub-device handler of topic %.*s", (int)message->topic_len, message->ptopic);
+    msg.event_type = MQTT_EVENT_PUBLISH_RECVEIVED;
+    msg.msg        = message;
+    mqtt->event_handle.h_fp(mqtt, mqtt->event_handle.context, &msg);
+}
+
 int gateway_publish_sync(Gateway *gateway, char *topic, PublishParams *params, int32_t *result)
 {
-    int     rc         = 0;
-    int     loop_count = 0;
-    int32_t res        = *result;
+    int rc = 0;
 
     POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
 
+    utils_completion_reset(&gateway->gateway_data.sync_done);
     rc = IOT_Gateway_Publish(gateway, topic, params);
     if (rc < 0) {
         Log_e("publish fail.");
@@ -690,14 +1041,10 @@ int gateway_publish_sync(Gateway *gateway, char *topic, PublishParams *params, i
     }
 
     /* wait for response */
-    while (res == *result) {
-        if (loop_count > GATEWAY_LOOP_MAX_COUNT) {
-            Log_i("loop max count, time out.");
-            IOT_FUNC_EXIT_RC(QCLOUD_ERR_GATEWAY_SESSION_TIMEOUT);
-        }
-
-        IOT_Gateway_Yield(gateway, 200);
-        loop_count++;
+    rc = _gateway_wait_sync(gateway, result);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        Log_i("sync wait time out.");
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_GATEWAY_SESSION_TIMEOUT);
     }
 
     if (*result != 0) {
@@ -776,3 +1123,229 @@ int subdev_bind_hmac_sha1_cal(DeviceInfo *pDevInfo, char *signout, int max_signl
 
     return (olen > max_signlen) ? QCLOUD_ERR_FAILURE : ret;
 }
+
+#ifdef AUTH_MODE_CERT
+#define SUBDEV_BIND_AUTH_TYPE "certificate"
+#else
+#define SUBDEV_BIND_AUTH_TYPE "psk"
+#endif
+
+/* write sub-device into the operation payload, return length written as snprintf, or -1 if bind sign fails */
+static int _subdev_write_device(GatewaySubdevOp op, DeviceInfo *subdev, char *buf, int buf_len)
+{
+    char sign[SUBDEV_BIND_SIGN_LEN] = {0};
+    int  nonce;
+    long timestamp;
+
+    if (eGATEWAY_SUBDEV_BIND != op) {
+        return HAL_Snprintf(buf, buf_len, GATEWAY_PAYLOAD_STATUS_DEVICE_FMT, subdev->product_id, subdev->device_name);
+    }
+
+    nonce     = rand();
+    timestamp = HAL_Timer_current_sec();
+    if (QCLOUD_RET_SUCCESS != subdev_bind_hmac_sha1_cal(subdev, sign, SUBDEV_BIND_SIGN_LEN, nonce, timestamp)) {
+        Log_e("cal sign fail");
+        return -1;
+    }
+
+    return HAL_Snprintf(buf, buf_len, GATEWAY_PAYLOAD_OP_DEVICE_FMT, subdev->product_id, subdev->device_name, sign,
+                        nonce, (int)timestamp, "hmacsha1", SUBDEV_BIND_AUTH_TYPE);
+}
+
+static int _gateway_operation_topic(GatewayParam *param, char *topic)
+{
+    int size = HAL_Snprintf(topic, MAX_SIZE_OF_CLOUD_TOPIC + 1, GATEWAY_TOPIC_OPERATION_FMT,
+                            STRING_PTR_PRINT_SANITY_CHECK(param->product_id),
+                            STRING_PTR_PRINT_SANITY_CHECK(param->device_name));
+    if (size < 0 || size > MAX_SIZE_OF_CLOUD_TOPIC) {
+        Log_e("buf size < topic length!");
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* publish the operation on sub-devices from subdevs[*next] until the message or its reply is full, *next is moved
+ * past the sub-devices handled, return QCLOUD_RET_SUCCESS or err code of publish called back to the message */
+static int _subdev_send(Gateway *gateway, char *topic, GatewaySubdevOp op, DeviceInfo *subdevs, int *next,
+                        int count, uint32_t timeout_ms, OnGatewaySubdevResult callback, void *user_data)
+{
+    char          payload[GATEWAY_PAYLOAD_BUFFER_LEN + 1];
+    uint32_t      keys[GATEWAY_OP_MAX_DEVICES];
+    RequestEntry  entry;
+    PublishParams params     = DEFAULT_PUB_PARAMS;
+    int           suffix_len = sizeof(GATEWAY_PAYLOAD_DEVICES_SUFFIX) - 1;
+    int           rc         = QCLOUD_RET_SUCCESS;
+    int           i, num, len, size, sep, left, reply_len, device_reply_len;
+    int32_t       result;
+
+    len       = HAL_Snprintf(payload, sizeof(payload), GATEWAY_PAYLOAD_DEVICES_PREFIX_FMT, sg_subdev_op_str[op]);
+    reply_len = GATEWAY_REPLY_HEAD_LEN;
+    for (i = *next, num = 0; i < count && num < GATEWAY_OP_MAX_DEVICES; i++) {
+        device_reply_len = strlen(subdevs[i].product_id) + strlen(subdevs[i].device_name) + GATEWAY_REPLY_DEVICE_LEN;
+        if (num && reply_len + device_reply_len > GATEWAY_RECEIVE_BUFFER_LEN) {
+            break;
+        }
+
+        sep  = num ? 1 : 0;
+        left = GATEWAY_PAYLOAD_BUFFER_LEN + 1 - suffix_len - len - sep;
+        size = _subdev_write_device(op, &subdevs[i], payload + len + sep, left);
+        if (size >= left && num) {
+            break;
+        }
+
+        if (size < 0 || size >= left) {
+            if (size >= left) {
+                Log_e("buf size < payload length!");
+            }
+            result = QCLOUD_ERR_FAILURE;
+        } else {
+            result = _subdev_op_start(gateway, op, &subdevs[i], i, timeout_ms, callback, user_data, &keys[num]);
+        }
+        if (SUBDEV_RESULT_PENDING != result) {
+            _subdev_call_back(gateway, op, i, subdevs[i].product_id, subdevs[i].device_name, result, callback,
+                              user_data);
+            continue;
+        }
+
+        if (sep) {
+            payload[len] = ',';
+        }
+        len += sep + size;
+        reply_len += device_reply_len;
+        num++;
+    }
+    *next = i;
+    if (!num) {
+        return QCLOUD_RET_SUCCESS;
+    }
+    memcpy(payload + len, GATEWAY_PAYLOAD_DEVICES_SUFFIX, suffix_len + 1);
+
+    Log_d("%s %d sub-devices", sg_subdev_op_str[op], num);
+    params.qos         = QOS0;
+    params.payload_len = len + suffix_len;
+    params.payload     = (char *)payload;
+
+    rc = IOT_Gateway_Publish(gateway, topic, &params);
+    if (rc >= 0) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    Log_e("publish fail.");
+    for (i = 0; i < num; i++) {
+        HAL_MutexLock(gateway->lock);
+        if (!request_table_take(&gateway->ops, keys[i], &entry)) {
+            /* taken by the timeout check of another thread */
+            HAL_MutexUnlock(gateway->lock);
+            continue;
+        }
+        _subdev_session_finish(gateway, op, ((SubdevOp *)entry.user_context)->product_id,
+                               ((SubdevOp *)entry.user_context)->device_name, rc);
+        HAL_MutexUnlock(gateway->lock);
+        _subdev_op_call_back(gateway, &entry, rc);
+    }
+
+    return rc;
+}
+
+int gateway_subdev_operate_async(Gateway *gateway, GatewayParam *param, GatewaySubdevOp op, DeviceInfo *subdevs,
+                                 int count, uint32_t timeout_ms, OnGatewaySubdevResult callback, void *user_data)
+{
+    char topic[MAX_SIZE_OF_CLOUD_TOPIC + 1];
+    int  rc   = QCLOUD_RET_SUCCESS;
+    int  next = 0;
+
+    rc = _gateway_operation_topic(param, topic);
+    if (QCLOUD_RET_SUCCESS != rc) {
+        IOT_FUNC_EXIT_RC(rc);
+    }
+
+    srand((unsigned)HAL_GetTimeMs());
+    gateway_subdev_expire_ops(gateway);
+
+    while (next < count) {
+        rc = _subdev_send(gateway, topic, op, subdevs, &next, count, timeout_ms, callback, user_data);
+        if (QCLOUD_RET_SUCCESS != rc) {
+            break;
+        }
+    }
+
+    for (; next < count; next++) {
+        _subdev_call_back(gateway, op, next, subdevs[next].product_id, subdevs[next].device_name, rc, callback,
+                          user_data);
+    }
+
+    IOT_FUNC_EXIT_RC(rc);
+}
+
+static void _subdev_sync_result(void *client, const GatewaySubdevResult *result, void *user_data)
+{
+    Gateway *gateway = (Gateway *)client;
+
+    ((int32_t *)user_data)[result->index] = result->result;
+    utils_completion_signal(&gateway->gateway_data.sync_done);
+}
+
+int gateway_subdev_operate_sync(Gateway *gateway, GatewayParam *param, GatewaySubdevOp op, DeviceInfo *subdevs,
+                                int32_t *results, int count)
+{
+    char        topic[MAX_SIZE_OF_CLOUD_TOPIC + 1];
+    Completion *sync_done = &gateway->gateway_data.sync_done;
+    int         rc        = QCLOUD_RET_SUCCESS;
+    int         next = 0, first = 0, outstanding, i;
+
+    POINTER_SANITY_CHECK(gateway, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(param, QCLOUD_ERR_INVAL);
+
+    rc = _gateway_operation_topic(param, topic);
+    if (QCLOUD_RET_SUCCESS != rc) {
+        IOT_FUNC_EXIT_RC(rc);
+    }
+
+    srand((unsigned)HAL_GetTimeMs());
+    for (i = 0; i < count; i++) {
+        results[i] = SUBDEV_RESULT_PENDING;
+    }
+
+    /* results are written by callbacks, each one to its own index, and counted here */
+    for (;;) {
+        while (first < next && results[first] != SUBDEV_RESULT_PENDING) {
+            first++;
+        }
+        for (i = first, outstanding = 0; i < next; i++) {
+            outstanding += results[i] == SUBDEV_RESULT_PENDING;
+        }
+
+        if (next < count && outstanding < GATEWAY_OP_WINDOW) {
+            rc = _subdev_send(gateway, topic, op, subdevs, &next, count, GATEWAY_SYNC_TIMEOUT_MS,
+                              _subdev_sync_result, results);
+            if (QCLOUD_RET_SUCCESS != rc) {
+                /* the sub-devices published still wait for their results in results */
+                for (; next < count; next++) {
+                    results[next] = rc;
+                }
+            }
+            continue;
+        }
+        if (!outstanding) {
+            break;
+        }
+
+        utils_completion_wait(sync_done, gateway->mqtt, GATEWAY_OP_EXPIRE_CHECK_MS, IOT_Gateway_Yield, gateway);
+        utils_completion_reset(sync_done);
+        gateway_subdev_expire_ops(gateway);
+    }
+
+    for (i = 0; QCLOUD_RET_SUCCESS == rc && i < count; i++) {
+        if (results[i] == QCLOUD_ERR_GATEWAY_SESSION_TIMEOUT) {
+            rc = QCLOUD_ERR_GATEWAY_SESSION_TIMEOUT;
+        }
+    }
+    for (i = 0; QCLOUD_RET_SUCCESS == rc && i < count; i++) {
+        if (results[i] != 0) {
+            rc = QCLOUD_ERR_FAILURE;
+        }
+    }
+
+    IOT_FUNC_EXIT_RC(rc);
+}
@@ -0,0 +1,795 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qcloud_iot_export.h"
+#include "qcloud_iot_import.h"
+
+#ifdef OTA_MQTT_CHANNEL
+
+#include "gateway_ota.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gateway_common.h"
+#include "ota_client.h"
+#include "ota_fetch.h"
+#include "ota_lib.h"
+#include "utils_param_check.h"
+
+static int _store_path(GatewayOTA *ota, const GatewayOTAImage *image, const char *suffix, char *path)
+{
+    int len = HAL_Snprintf(path, GATEWAY_OTA_PATH_LEN, "%s/%s%s", ota->store_dir, image->md5, suffix);
+
+    return (len < 0 || len >= GATEWAY_OTA_PATH_LEN) ? QCLOUD_ERR_INVAL : QCLOUD_RET_SUCCESS;
+}
+
+static int _ota_publish(GatewayOTA *ota, const char *product_id, const char *device_name, QoS qos, const char *msg)
+{
+    Gateway *     gateway = (Gateway *)ota->gateway;
+    char          topic[OTA_MAX_TOPIC_LEN];
+    PublishParams params = DEFAULT_PUB_PARAMS;
+    int           len;
+
+    len = HAL_Snprintf(topic, sizeof(topic), "$ota/report/%s/%s", product_id, device_name);
+    if (len < 0 || len >= sizeof(topic)) {
+        return IOT_OTA_ERR_STR_TOO_LONG;
+    }
+
+    params.qos         = qos;
+    params.payload     = (void *)msg;
+    params.payload_len = strlen(msg);
+
+    return IOT_MQTT_Publish(gateway->mqtt, topic, &params);
+}
+
+/*
+ * Reports of many devices are published in a burst by one firmware, by QoS0 so
+ * they don't overflow the republish list before the next yield, results from
+ * IOT_Gateway_OTA_Report_Result are one at a time and go by QoS1.
+ */
+static void _job_report(GatewayOTA *ota, GatewayOTAJob *job, int percent, IOT_OTAReportType type, QoS qos)
+{
+    char msg[GATEWAY_OTA_REPORT_LEN];
+    int  rc;
+
+    rc = qcloud_otalib_gen_report_msg(msg, sizeof(msg), 0, job->version, percent, type);
+    if (rc == QCLOUD_RET_SUCCESS) {
+        rc = _ota_publish(ota, job->product_id, job->device_name, qos, msg);
+    }
+    if (rc < 0) {
+        Log_w("report %d of %s/%s failed: %d", type, job->product_id, job->device_name, rc);
+    }
+}
+
+static GatewayOTAJob *_job_find(GatewayOTA *ota, const char *product_id, const char *device_name)
+{
+    GatewayOTAJob *job;
+
+    for (job = ota->jobs; job; job = job->next) {
+        if (!job->removed && !strcmp(job->product_id, product_id) && !strcmp(job->device_name, device_name)) {
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+static GatewayOTAImage *_image_find(GatewayOTA *ota, const char *md5)
+{
+    GatewayOTAImage *image;
+
+    for (image = ota->images; image; image = image->next) {
+        if (!strcmp(image->md5, md5)) {
+            return image;
+        }
+    }
+
+    return NULL;
+}
+
+static void _image_close(GatewayOTAImage *image)
+{
+    if (image->fetch) {
+        qcloud_ofc_deinit(image->fetch);
+        image->fetch = NULL;
+    }
+    if (image->md5_ctx) {
+        qcloud_otalib_md5_deinit(image->md5_ctx);
+        image->md5_ctx = NULL;
+    }
+    if (image->fp) {
+        HAL_FileClose(image->fp);
+        image->fp = NULL;
+    }
+}
+
+/* drop the image, and its file in the store if remove_file, the part file while fetching */
+static void _image_remove(GatewayOTA *ota, GatewayOTAImage *image, bool remove_file)
+{
+    GatewayOTAImage **link;
+    char              path[GATEWAY_OTA_PATH_LEN];
+
+    for (link = &ota->images; *link != image; link = &(*link)->next) {
+    }
+    *link = image->next;
+
+    _image_close(image);
+    if (remove_file &&
+        !_store_path(ota, image, image->state == GATEWAY_OTA_IMAGE_READY ? "" : GATEWAY_OTA_PART_SUFFIX, path)) {
+        HAL_FileRemove(path);
+    }
+    HAL_Free(image->url);
+    HAL_Free(image);
+}
+
+/* keep at most GATEWAY_OTA_MAX_IDLE_IMAGES images without devices, the least recently used go first */
+static void _store_evict(GatewayOTA *ota)
+{
+    GatewayOTAImage *image, *lru;
+    int              idle_num;
+
+    for (;;) {
+        idle_num = 0;
+        lru      = NULL;
+        for (image = ota->images; image; image = image->next) {
+            if (image->job_num || image->state != GATEWAY_OTA_IMAGE_READY) {
+                continue;
+            }
+            idle_num++;
+            if (!lru || (int32_t)(image->used_seq - lru->used_seq) < 0) {
+                lru = image;
+            }
+        }
+        if (idle_num <= GATEWAY_OTA_MAX_IDLE_IMAGES) {
+            return;
+        }
+        Log_i("evict firmware %s from store", lru->md5);
+        _image_remove(ota, lru, true);
+    }
+}
+
+/* unlink and free the job, the transport ends with result if it began */
+static void _job_remove(GatewayOTA *ota, GatewayOTAJob *job, int result)
+{
+    GatewayOTAJob **link;
+
+    if (job == ota->serving) {
+        job->removed = true;
+        job->result  = result;
+        return;
+    }
+
+    for (link = &ota->jobs; *link != job; link = &(*link)->next) {
+    }
+    *link = job->next;
+
+    if (job->state == GATEWAY_OTA_JOB_SENDING && ota->transport.end) {
+        ota->transport.end(ota->user_data, job->product_id, job->device_name, result);
+    }
+    job->image->job_num--;
+    HAL_Free(job);
+}
+
+static void _job_fail(GatewayOTA *ota, GatewayOTAJob *job, IOT_OTAReportType type)
+{
+    Log_e("update of %s/%s to %s failed: %d", job->product_id, job->device_name, job->version, type);
+    _job_report(ota, job, 0, type, QOS0);
+    _job_remove(ota, job, type);
+}
+
+/* fail every device waiting for the image, then drop it */
+static void _image_fail(GatewayOTA *ota, GatewayOTAImage *image, IOT_OTAReportType type, bool remove_part)
+{
+    GatewayOTAJob *job, *next;
+
+    Log_e("fetch firmware %s failed: %d", image->md5, type);
+    for (job = ota->jobs; job; job = next) {
+        next = job->next;
+        if (job->image == image) {
+            _job_fail(ota, job, type);
+        }
+    }
+    _image_remove(ota, image, remove_part);
+}
+
+/* the image fetched without the lock is failed with it */
+static void _image_fetch_fail(GatewayOTA *ota, GatewayOTAImage *image, IOT_OTAReportType type, bool remove_part)
+{
+    HAL_MutexLock(ota->lock);
+    _image_fail(ota, image, type, remove_part);
+    HAL_MutexUnlock(ota->lock);
+}
+
+static void _image_ready(GatewayOTA *ota, GatewayOTAImage *image, void *fp)
+{
+    HAL_MutexLock(ota->lock);
+    image->fp    = fp;
+    image->state = GATEWAY_OTA_IMAGE_READY;
+    HAL_Free(image->url);
+    image->url = NULL;
+    HAL_MutexUnlock(ota->lock);
+}
+
+/* hash len bytes of fp from its current position */
+static int _file_hash(GatewayOTA *ota, void *fp, uint32_t len, void *md5_ctx)
+{
+    uint32_t n;
+
+    while (len) {
+        n = len < GATEWAY_OTA_BUF_LEN ? len : GATEWAY_OTA_BUF_LEN;
+        if (HAL_FileRead(ota->buf, 1, n, fp) != n) {
+            return QCLOUD_ERR_FAILURE;
+        }
+        qcloud_otalib_md5_update(md5_ctx, ota->buf, n);
+        len -= n;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* a verified image in the store needs no fetching */
+static bool _store_lookup(GatewayOTA *ota, GatewayOTAImage *image)
+{
+    char  path[GATEWAY_OTA_PATH_LEN];
+    char  md5[33];
+    void *fp, *md5_ctx;
+    bool  found = false;
+
+    if (_store_path(ota, image, "", path) || !(fp = HAL_FileOpen(path, "rb"))) {
+        return false;
+    }
+
+    if (HAL_FileSize(fp) == image->size && (md5_ctx = qcloud_otalib_md5_init())) {
+        if (!_file_hash(ota, fp, image->size, md5_ctx)) {
+            qcloud_otalib_md5_finalize(md5_ctx, md5);
+            found = !strcmp(md5, image->md5);
+        }
+        qcloud_otalib_md5_deinit(md5_ctx);
+    }
+
+    if (!found) {
+        HAL_FileClose(fp);
+        HAL_FileRemove(path);
+        return false;
+    }
+
+    _image_ready(ota, image, fp);
+    return true;
+}
+
+/* open the part file, a part left by an earlier fetch is hashed and resumed */
+static int _store_open_part(GatewayOTA *ota, GatewayOTAImage *image)
+{
+    char  path[GATEWAY_OTA_PATH_LEN];
+    void *fp;
+    long  part_size;
+
+    if (_store_path(ota, image, GATEWAY_OTA_PART_SUFFIX, path)) {
+        return QCLOUD_ERR_INVAL;
+    }
+
+    image->fetched = 0;
+    image->md5_ctx = qcloud_otalib_md5_init();
+    if (!image->md5_ctx) {
+        return QCLOUD_ERR_MALLOC;
+    }
+
+    fp = HAL_FileOpen(path, "rb");
+    if (fp) {
+        part_size = HAL_FileSize(fp);
+        if (part_size > 0 && part_size < image->size && !_file_hash(ota, fp, part_size, image->md5_ctx)) {
+            image->fetched = part_size;
+            Log_i("resume firmware %s from %u", image->md5, image->fetched);
+        }
+        HAL_FileClose(fp);
+    }
+
+    if (!image->fetched) {
+        qcloud_otalib_md5_deinit(image->md5_ctx);
+        image->md5_ctx = qcloud_otalib_md5_init();
+        if (!image->md5_ctx) {
+            return QCLOUD_ERR_MALLOC;
+        }
+    }
+
+    image->fp = HAL_FileOpen(path, image->fetched ? "ab" : "wb");
+    if (!image->fp) {
+        Log_e("open %s failed", path);
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* the whole image is fetched, verify it and move it into the store */
+static void _image_fetched(GatewayOTA *ota, GatewayOTAImage *image)
+{
+    char  part[GATEWAY_OTA_PATH_LEN];
+    char  path[GATEWAY_OTA_PATH_LEN];
+    char  md5[33];
+    void *fp = NULL;
+
+    qcloud_otalib_md5_finalize(image->md5_ctx, md5);
+    _image_close(image);
+
+    if (strcmp(md5, image->md5)) {
+        _image_fetch_fail(ota, image, IOT_OTAR_MD5_NOT_MATCH, true);
+        return;
+    }
+
+    _store_path(ota, image, GATEWAY_OTA_PART_SUFFIX, part);
+    _store_path(ota, image, "", path);
+    if (HAL_FileRename(part, path) || !(fp = HAL_FileOpen(path, "rb"))) {
+        _image_fetch_fail(ota, image, IOT_OTAR_UPGRADE_FAIL, true);
+        return;
+    }
+
+    Log_i("firmware %s fetched, %u bytes", image->md5, image->size);
+    _image_ready(ota, image, fp);
+}
+
+/* fetch one piece of the image without the lock, return 1 for progress */
+static int _image_fetch(GatewayOTA *ota, GatewayOTAImage *image, uint32_t timeout_ms)
+{
+    int rc;
+
+    if (!image->fp) {
+        if (_store_lookup(ota, image)) {
+            return 1;
+        }
+        if (_store_open_part(ota, image)) {
+            _image_fetch_fail(ota, image, IOT_OTAR_UPGRADE_FAIL, true);
+            return 0;
+        }
+    }
+
+    if (!image->fetch) {
+        image->fetch = ofc_Init(image->url, image->fetched, image->size, GATEWAY_OTA_SEGMENT_LEN);
+        if (!image->fetch || qcloud_ofc_connect(image->fetch)) {
+            rc = QCLOUD_ERR_FAILURE;
+            goto retry;
+        }
+    }
+
+    /* the whole buffer always, http keeps its last byte for '\0' and the range stops at the file end */
+    rc = qcloud_ofc_fetch(image->fetch, ota->buf, GATEWAY_OTA_BUF_LEN, timeout_ms > 1000 ? timeout_ms / 1000 : 1);
+    if (rc == IOT_OTA_ERR_FETCH_NOT_EXIST) {
+        _image_fetch_fail(ota, image, IOT_OTAR_FILE_NOT_EXIST, true);
+        return 0;
+    } else if (rc == IOT_OTA_ERR_FETCH_AUTH_FAIL) {
+        _image_fetch_fail(ota, image, IOT_OTAR_AUTH_FAIL, true);
+        return 0;
+    } else if (rc < 0) {
+        goto retry;
+    } else if (rc == 0) {
+        return 0;
+    }
+
+    if (HAL_FileWrite(ota->buf, 1, rc, image->fp) != (size_t)rc) {
+        Log_e("write firmware %s failed, store is full?", image->md5);
+        _image_fetch_fail(ota, image, IOT_OTAR_UPGRADE_FAIL, true);
+        return 0;
+    }
+    qcloud_otalib_md5_update(image->md5_ctx, ota->buf, rc);
+    image->fetched += rc;
+    image->retry = 0;
+
+    if (image->fetched >= image->size) {
+        _image_fetched(ota, image);
+    }
+    return 1;
+
+retry:
+    /* reconnect from what is fetched in the next round */
+    qcloud_ofc_deinit(image->fetch);
+    image->fetch = NULL;
+    if (++image->retry > GATEWAY_OTA_FETCH_RETRY) {
+        _image_fetch_fail(ota, image, IOT_OTAR_DOWNLOAD_TIMEOUT, false);
+        return 0;
+    }
+    Log_w("fetch firmware %s failed: %d, retry %d", image->md5, rc, image->retry);
+    return 0;
+}
+
+/* read the next piece of the image and write it to the device, called without the lock */
+static int _job_send(GatewayOTA *ota, GatewayOTAJob *job)
+{
+    GatewayOTAImage *image = job->image;
+    uint32_t         len   = image->size - job->sent;
+
+    if (job->state == GATEWAY_OTA_JOB_WAITING) {
+        if (ota->transport.begin && ota->transport.begin(ota->user_data, job->product_id, job->device_name,
+                                                         job->version, image->size, image->md5) < 0) {
+            return QCLOUD_ERR_FAILURE;
+        }
+        job->state = GATEWAY_OTA_JOB_SENDING;
+    }
+
+    len = len < GATEWAY_OTA_BUF_LEN ? len : GATEWAY_OTA_BUF_LEN;
+    if (HAL_FileSeek(image->fp, job->sent, SEEK_SET) || HAL_FileRead(ota->buf, 1, len, image->fp) != len) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    return ota->transport.write(ota->user_data, job->product_id, job->device_name, job->sent, ota->buf, len);
+}
+
+/* serve one piece of the image to the device, return 1 for progress. Called with the lock held, which is released
+ * while the piece is sent, the job stays in the list till then and next is the job after it once relocked */
+static int _job_serve(GatewayOTA *ota, GatewayOTAJob *job, GatewayOTAJob **next)
+{
+    GatewayOTAImage *image = job->image;
+    uint32_t         len   = image->size - job->sent;
+    int              percent;
+    int              rc;
+
+    ota->serving = job;
+    HAL_MutexUnlock(ota->lock);
+    rc = _job_send(ota, job);
+    HAL_MutexLock(ota->lock);
+    ota->serving = NULL;
+    *next        = job->next;
+
+    if (job->removed) {
+        _job_remove(ota, job, job->result);
+        return 0;
+    }
+    if (rc < 0) {
+        _job_fail(ota, job, IOT_OTAR_UPGRADE_FAIL);
+        return 0;
+    } else if (rc == 0) {
+        return 0;
+    }
+
+    len = len < GATEWAY_OTA_BUF_LEN ? len : GATEWAY_OTA_BUF_LEN;
+    job->sent += rc < len ? rc : len;
+
+    if (job->sent == image->size) {
+        _job_report(ota, job, IOT_OTAP_FETCH_PERCENTAGE_MAX, IOT_OTAR_DOWNLOADING, QOS0);
+        if (ota->transport.end) {
+            ota->transport.end(ota->user_data, job->product_id, job->device_name, 0);
+        }
+        job->state = GATEWAY_OTA_JOB_BURNING;
+        _job_report(ota, job, 0, IOT_OTAR_UPGRADE_BEGIN, QOS0);
+        return 1;
+    }
+
+    percent = (int)((uint64_t)job->sent * 100 / image->size);
+    if (percent != job->percent && expired(&job->report_timer)) {
+        _job_report(ota, job, percent, IOT_OTAR_DOWNLOADING, QOS0);
+        job->percent = percent;
+        countdown_ms(&job->report_timer, GATEWAY_OTA_REPORT_INTERVAL);
+    }
+
+    return 1;
+}
+
+static int _job_add(GatewayOTA *ota, const char *product_id, const char *device_name, const char *version,
+                    const char *md5, char **url, uint32_t size)
+{
+    GatewayOTAJob **  link;
+    GatewayOTAJob *   job;
+    GatewayOTAImage **image_link;
+    GatewayOTAImage * image;
+
+    job = _job_find(ota, product_id, device_name);
+    if (job) {
+        if (!strcmp(job->image->md5, md5) && !strcmp(job->version, version)) {
+            Log_d("update of %s/%s to %s is in progress", product_id, device_name, version);
+            return QCLOUD_RET_SUCCESS;
+        }
+        Log_i("update of %s/%s to %s is replaced", product_id, device_name, job->version);
+        _job_remove(ota, job, IOT_OTAR_UPGRADE_FAIL);
+    }
+
+    image = _image_find(ota, md5);
+    if (!image) {
+        image = HAL_Malloc(sizeof(GatewayOTAImage));
+        if (!image) {
+            return QCLOUD_ERR_MALLOC;
+        }
+        memset(image, 0, sizeof(GatewayOTAImage));
+        strncpy(image->md5, md5, sizeof(image->md5) - 1);
+        image->url  = *url;
+        image->size = size;
+        *url        = NULL;
+
+        /* fetched in the order of arrival */
+        for (image_link = &ota->images; *image_link; image_link = &(*image_link)->next) {
+        }
+        *image_link = image;
+    } else if (image->size != size) {
+        Log_w("size of firmware %s is %u rather than %u", md5, image->size, size);
+    }
+
+    /* a new image without jobs is dropped by the next IOT_Gateway_OTA_Yield */
+    job = HAL_Malloc(sizeof(GatewayOTAJob));
+    if (!job) {
+        return QCLOUD_ERR_MALLOC;
+    }
+    memset(job, 0, sizeof(GatewayOTAJob));
+    strncpy(job->product_id, product_id, sizeof(job->product_id) - 1);
+    strncpy(job->device_name, device_name, sizeof(job->device_name) - 1);
+    strncpy(job->version, version, sizeof(job->version) - 1);
+    job->image = image;
+    InitTimer(&job->report_timer);
+    image->job_num++;
+    image->used_seq = ++ota->used_seq;
+
+    for (link = &ota->jobs; *link; link = &(*link)->next) {
+    }
+    *link = job;
+
+    Log_i("update %s/%s to %s, firmware %s", product_id, device_name, version, md5);
+    _job_report(ota, job, IOT_OTAP_FETCH_PERCENTAGE_MIN, IOT_OTAR_DOWNLOAD_BEGIN, QOS0);
+    return QCLOUD_RET_SUCCESS;
+}
+
+static void _ota_update(GatewayOTA *ota, const char *product_id, const char *device_name, const char *json)
+{
+    char *   url     = NULL;
+    char *   version = NULL;
+    char     md5[33] = {0};
+    uint32_t size    = 0;
+    int      rc;
+
+    if (qcloud_otalib_get_params(json, &url, &version, md5, &size) || !size ||
+        strlen(version) > GATEWAY_OTA_VERSION_LEN) {
+        Log_e("invalid firmware of %s/%s", product_id, device_name);
+        goto exit;
+    }
+
+    HAL_MutexLock(ota->lock);
+    rc = _job_add(ota, product_id, device_name, version, md5, &url, size);
+    HAL_MutexUnlock(ota->lock);
+    if (rc) {
+        Log_e("add update of %s/%s failed: %d", product_id, device_name, rc);
+    }
+
+exit:
+    HAL_Free(url);
+    HAL_Free(version);
+}
+
+/* $ota/update/{product_id}/{device_name} of all sub-devices */
+static void _gateway_ota_message_handler(void *client, MQTTMessage *message, void *user_data)
+{
+    GatewayOTA *ota       = (GatewayOTA *)user_data;
+    const char *topic     = message->ptopic + sizeof(GATEWAY_OTA_UPDATE_TOPIC_PREFIX) - 1;
+    const char *topic_end = message->ptopic + message->topic_len;
+    const char *sep       = memchr(topic, '/', topic_end - topic);
+    char        product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char        device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    char        type[32];
+    char *      json;
+
+    if (!sep || sep - topic > MAX_SIZE_OF_PRODUCT_ID || topic_end - sep - 1 > MAX_SIZE_OF_DEVICE_NAME) {
+        Log_e("invalid topic %.*s", (int)message->topic_len, message->ptopic);
+        return;
+    }
+    memcpy(product_id, topic, sep - topic);
+    product_id[sep - topic] = '\0';
+    memcpy(device_name, sep + 1, topic_end - sep - 1);
+    device_name[topic_end - sep - 1] = '\0';
+
+    json = HAL_Malloc(message->payload_len + 1);
+    if (!json) {
+        Log_e("malloc %u failed", (unsigned)message->payload_len);
+        return;
+    }
+    memcpy(json, message->payload, message->payload_len);
+    json[message->payload_len] = '\0';
+
+    if (qcloud_otalib_get_firmware_type(json, type, sizeof(type))) {
+        Log_e("invalid OTA message of %s/%s", product_id, device_name);
+    } else if (!strcmp(type, UPDATE_FIRMWARE)) {
+        _ota_update(ota, product_id, device_name, json);
+    } else if (!strcmp(type, REPORT_VERSION_RSP) && qcloud_otalib_get_report_version_result(json)) {
+        Log_w("report version of %s/%s failed", product_id, device_name);
+    }
+
+    HAL_Free(json);
+}
+
+void *IOT_Gateway_OTA_Create(void *client, const char *store_dir, const GatewayOTATransport *transport,
+                             void *user_data)
+{
+    GatewayOTA *    ota;
+    Gateway *       gateway = (Gateway *)client;
+    SubscribeParams params  = DEFAULT_SUB_PARAMS;
+    int             rc;
+
+    POINTER_SANITY_CHECK(gateway, NULL);
+    STRING_PTR_SANITY_CHECK(store_dir, NULL);
+    POINTER_SANITY_CHECK(transport, NULL);
+    POINTER_SANITY_CHECK(transport->write, NULL);
+
+    /* leave room for /<md5>.part */
+    if (strlen(store_dir) + 1 + 32 + sizeof(GATEWAY_OTA_PART_SUFFIX) > GATEWAY_OTA_PATH_LEN) {
+        Log_e("store dir %s is too long", store_dir);
+        return NULL;
+    }
+
+    ota = HAL_Malloc(sizeof(GatewayOTA));
+    if (!ota) {
+        Log_e("malloc gateway OTA failed");
+        return NULL;
+    }
+    memset(ota, 0, sizeof(GatewayOTA));
+
+    ota->lock = HAL_MutexCreate();
+    if (!ota->lock) {
+        Log_e("create gateway OTA lock failed");
+        HAL_Free(ota);
+        return NULL;
+    }
+
+    ota->gateway   = gateway;
+    ota->transport = *transport;
+    ota->user_data = user_data;
+    strncpy(ota->store_dir, store_dir, sizeof(ota->store_dir) - 1);
+
+    params.qos                = QOS1;
+    params.on_message_handler = _gateway_ota_message_handler;
+    params.user_data          = ota;
+
+    rc = IOT_MQTT_Subscribe(gateway->mqtt, GATEWAY_OTA_UPDATE_FILTER, &params);
+    if (rc < 0) {
+        Log_e("subscribe %s failed: %d", GATEWAY_OTA_UPDATE_FILTER, rc);
+        HAL_MutexDestroy(ota->lock);
+        HAL_Free(ota);
+        return NULL;
+    }
+
+    return ota;
+}
+
+void IOT_Gateway_OTA_Destroy(void *handle)
+{
+    GatewayOTA *     ota = (GatewayOTA *)handle;
+    GatewayOTAJob *  job;
+    GatewayOTAImage *image;
+
+    POINTER_SANITY_CHECK_RTN(ota);
+
+    /* no update is routed to the distributor once it is freed */
+    IOT_MQTT_Unsubscribe(((Gateway *)ota->gateway)->mqtt, GATEWAY_OTA_UPDATE_FILTER);
+
+    while ((job = ota->jobs)) {
+        ota->jobs = job->next;
+        HAL_Free(job);
+    }
+    while ((image = ota->images)) {
+        ota->images = image->next;
+        _image_close(image);
+        HAL_Free(image->url);
+        HAL_Free(image);
+    }
+    HAL_MutexDestroy(ota->lock);
+    HAL_Free(ota);
+}
+
+int IOT_Gateway_OTA_Report_Version(void *handle, const char *product_id, const char *device_name,
+                                   const char *version)
+{
+    GatewayOTA *ota = (GatewayOTA *)handle;
+    char        msg[GATEWAY_OTA_REPORT_LEN];
+    int         rc;
+
+    POINTER_SANITY_CHECK(ota, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(version, QCLOUD_ERR_INVAL);
+
+    if (strlen(version) > GATEWAY_OTA_VERSION_LEN) {
+        Log_e("version string is invalid: must be [1, 32] chars");
+        return QCLOUD_ERR_INVAL;
+    }
+
+    rc = qcloud_otalib_gen_info_msg(msg, sizeof(msg), 0, version);
+    if (rc) {
+        return rc;
+    }
+
+    rc = _ota_publish(ota, product_id, device_name, QOS1, msg);
+    return rc < 0 ? rc : QCLOUD_RET_SUCCESS;
+}
+
+int IOT_Gateway_OTA_Yield(void *handle, uint32_t timeout_ms)
+{
+    GatewayOTA *     ota = (GatewayOTA *)handle;
+    GatewayOTAImage *image, *next_image;
+    GatewayOTAJob *  job, *next;
+    Timer            timer;
+    int              progress;
+    int              job_num = 0;
+
+    POINTER_SANITY_CHECK(ota, QCLOUD_ERR_INVAL);
+
+    InitTimer(&timer);
+    countdown_ms(&timer, timeout_ms);
+
+    HAL_MutexLock(ota->lock);
+    do {
+        progress = 0;
+
+        /* one download at a time, in the order of arrival, unless no device waits for it any more. Only the yield
+         * frees an image that is not ready, so it is fetched without the lock */
+        for (image = ota->images; image; image = next_image) {
+            next_image = image->next;
+            if (image->state == GATEWAY_OTA_IMAGE_READY) {
+                continue;
+            } else if (!image->job_num) {
+                _image_remove(ota, image, false);
+                continue;
+            }
+            HAL_MutexUnlock(ota->lock);
+            progress += _image_fetch(ota, image, left_ms(&timer));
+            HAL_MutexLock(ota->lock);
+            break;
+        }
+
+        /* a piece for every device in each round */
+        for (job = ota->jobs; job; job = next) {
+            next = job->next;
+            if (job->state != GATEWAY_OTA_JOB_BURNING && job->image->state == GATEWAY_OTA_IMAGE_READY) {
+                progress += _job_serve(ota, job, &next);
+            }
+        }
+    } while (progress && !expired(&timer));
+    _store_evict(ota);
+
+    for (job = ota->jobs; job; job = job->next) {
+        job_num++;
+    }
+    HAL_MutexUnlock(ota->lock);
+
+    return job_num;
+}
+
+int IOT_Gateway_OTA_Report_Result(void *handle, const char *product_id, const char *device_name, bool success)
+{
+    GatewayOTA *   ota = (GatewayOTA *)handle;
+    GatewayOTAJob *job;
+
+    POINTER_SANITY_CHECK(ota, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_INVAL);
+
+    HAL_MutexLock(ota->lock);
+    job = _job_find(ota, product_id, device_name);
+    if (!job) {
+        HAL_MutexUnlock(ota->lock);
+        return QCLOUD_ERR_GATEWAY_OTA_NO_EXIST;
+    }
+
+    Log_i("update of %s/%s to %s %s", product_id, device_name, job->version, success ? "done" : "failed");
+    _job_report(ota, job, 0, success ? IOT_OTAR_UPGRADE_SUCCESS : IOT_OTAR_UPGRADE_FAIL, QOS1);
+    _job_remove(ota, job, IOT_OTAR_UPGRADE_FAIL);
+    _store_evict(ota);
+    HAL_MutexUnlock(ota->lock);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,922 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gateway_template.h"
+
+#include <string.h>
+
+#include "data_template_client_json.h"
+#include "gateway_common.h"
+#include "json_parser.h"
+#include "lite-utils.h"
+#include "mqtt_client.h"
+#include "utils_json_writer.h"
+#include "utils_param_check.h"
+
+#define GATEWAY_TEMPLATE_CELL_LEN (sizeof(GatewayTemplateCell))
+
+typedef union {
+    int32_t  int32;
+    uint32_t uint32;
+    float    float32;
+} GatewayTemplateCell;
+
+typedef struct {
+    GatewayTemplateProduct *product;
+    int                     device;
+    const char *            client_token;
+} GatewayTemplateReport;
+
+static const char *_device_get_key(void *val)
+{
+    return (const char *)val;
+}
+
+static char *_device_name(GatewayTemplateProduct *product, int device)
+{
+    return product->names + device * GATEWAY_TEMPLATE_NAME_LEN;
+}
+
+static uint8_t *_device_cell(GatewayTemplateColumn *column, int device)
+{
+    return column->cells + device * column->width;
+}
+
+static GatewayTemplateProduct *_product_find(GatewayTemplate *tpl, const char *product_id, size_t len)
+{
+    int i;
+
+    for (i = 0; i < tpl->product_num; i++) {
+        if (!strncmp(tpl->products[i]->product_id, product_id, len) && tpl->products[i]->product_id[len] == '\0') {
+            return tpl->products[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int _device_find(GatewayTemplateProduct *product, const char *device_name, size_t len)
+{
+    uint16_t slot_num;
+    char *   name;
+    int      i;
+
+    if (product->index_dirty) {
+        slot_num = hash_index_slot_num(product->device_num);
+        if (slot_num > product->index_slot_num) {
+            void **slots = HAL_Malloc(slot_num * sizeof(void *));
+            if (!slots) {
+                Log_e("malloc device index of %s failed", product->product_id);
+                return -1;
+            }
+            HAL_Free(product->index_slots);
+            product->index_slots    = slots;
+            product->index_slot_num = slot_num;
+        }
+
+        hash_index_init(&product->index, product->index_slots, slot_num, _device_get_key);
+        for (i = 0; i < product->device_num; i++) {
+            hash_index_add(&product->index, _device_name(product, i));
+        }
+        product->index_dirty = false;
+    }
+
+    name = hash_index_find(&product->index, device_name, len);
+
+    return name ? (name - product->names) / GATEWAY_TEMPLATE_NAME_LEN : -1;
+}
+
+static int _column_find(GatewayTemplateProduct *product, const char *key, size_t len)
+{
+    int i;
+
+    for (i = 0; i < product->prop_num; i++) {
+        if (!strncmp(product->columns[i].key, key, len) && product->columns[i].key[len] == '\0') {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static bool _device_is_dirty(GatewayTemplateProduct *product, int device)
+{
+    uint32_t *words = product->dirty + device * product->dirty_words;
+    int       i;
+
+    for (i = 0; i < product->dirty_words; i++) {
+        if (words[i]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void _device_mark_dirty(GatewayTemplateProduct *product, int device, int prop)
+{
+    if (!_device_is_dirty(product, device)) {
+        product->dirty_num++;
+    }
+
+    product->dirty[device * product->dirty_words + prop / 32] |= 1U << (prop % 32);
+}
+
+static void _device_clear_dirty(GatewayTemplateProduct *product, int device)
+{
+    if (_device_is_dirty(product, device)) {
+        product->dirty_num--;
+        memset(product->dirty + device * product->dirty_words, 0, product->dirty_words * sizeof(uint32_t));
+    }
+}
+
+/* storage is replaced as a whole, so a failed allocation leaves the product untouched */
+static int _product_grow(GatewayTemplateProduct *product)
+{
+    uint8_t * cells[GATEWAY_TEMPLATE_MAX_PROPERTIES] = {NULL};
+    char *    names;
+    uint32_t *dirty;
+    int       cap = product->device_cap ? product->device_cap * 2 : 4;
+    int       i;
+
+    if (product->device_cap >= GATEWAY_TEMPLATE_MAX_DEVICES) {
+        Log_e("too many devices of %s", product->product_id);
+        return QCLOUD_ERR_FAILURE;
+    }
+    if (cap > GATEWAY_TEMPLATE_MAX_DEVICES) {
+        cap = GATEWAY_TEMPLATE_MAX_DEVICES;
+    }
+
+    names = HAL_Malloc(cap * GATEWAY_TEMPLATE_NAME_LEN);
+    dirty = HAL_Malloc(cap * product->dirty_words * sizeof(uint32_t));
+    for (i = 0; names && dirty && i < product->prop_num; i++) {
+        cells[i] = HAL_Malloc(cap * product->columns[i].width);
+        if (!cells[i]) {
+            break;
+        }
+    }
+
+    if (i < product->prop_num || !names || !dirty) {
+        Log_e("malloc %d devices of %s failed", cap, product->product_id);
+        for (i = 0; i < product->prop_num; i++) {
+            HAL_Free(cells[i]);
+        }
+        HAL_Free(names);
+        HAL_Free(dirty);
+        return QCLOUD_ERR_MALLOC;
+    }
+
+    if (product->device_num) {
+        memcpy(names, product->names, product->device_num * GATEWAY_TEMPLATE_NAME_LEN);
+        memcpy(dirty, product->dirty, product->device_num * product->dirty_words * sizeof(uint32_t));
+    }
+    HAL_Free(product->names);
+    HAL_Free(product->dirty);
+    product->names = names;
+    product->dirty = dirty;
+
+    for (i = 0; i < product->prop_num; i++) {
+        if (product->device_num) {
+            memcpy(cells[i], product->columns[i].cells, product->device_num * product->columns[i].width);
+        }
+        HAL_Free(product->columns[i].cells);
+        product->columns[i].cells = cells[i];
+    }
+
+    product->device_cap  = cap;
+    product->index_dirty = true;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static void _product_free(GatewayTemplateProduct *product)
+{
+    int i;
+
+    for (i = 0; i < product->prop_num; i++) {
+        HAL_Free(product->columns[i].cells);
+    }
+    HAL_Free(product->names);
+    HAL_Free(product->dirty);
+    HAL_Free(product->index_slots);
+    HAL_Free(product);
+}
+
+/* find the cell of a property, called with the lock held */
+static int _template_locate(GatewayTemplate *tpl, const char *product_id, const char *device_name, const char *key,
+                            GatewayTemplateProduct **product, int *device, int *prop)
+{
+    *product = _product_find(tpl, product_id, strlen(product_id));
+    if (!*product) {
+        return QCLOUD_ERR_GATEWAY_TEMPLATE_NO_EXIST;
+    }
+
+    *device = _device_find(*product, device_name, strlen(device_name));
+    *prop   = _column_find(*product, key, strlen(key));
+    if (*device < 0 || *prop < 0) {
+        return QCLOUD_ERR_GATEWAY_TEMPLATE_NO_EXIST;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static bool _type_is_int(uint8_t type)
+{
+    return type == JINT32 || type == JINT8 || type == JUINT32;
+}
+
+/* store value into the cell, marking the device dirty if it changed */
+static int _template_set(void *handle, const char *product_id, const char *device_name, const char *key,
+                         const void *value, size_t len, bool (*type_match)(uint8_t type))
+{
+    GatewayTemplate *       tpl = (GatewayTemplate *)handle;
+    GatewayTemplateProduct *product;
+    GatewayTemplateColumn * column;
+    uint8_t *               cell;
+    int                     device, prop;
+    int                     rc;
+
+    POINTER_SANITY_CHECK(tpl, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(key, QCLOUD_ERR_INVAL);
+
+    HAL_MutexLock(tpl->lock);
+
+    rc = _template_locate(tpl, product_id, device_name, key, &product, &device, &prop);
+    if (rc) {
+        goto exit;
+    }
+
+    column = &product->columns[prop];
+    if (!type_match(column->type) || len > column->width) {
+        rc = QCLOUD_ERR_INVAL;
+        goto exit;
+    }
+
+    cell = _device_cell(column, device);
+    if (memcmp(cell, value, len)) {
+        memcpy(cell, value, len);
+        _device_mark_dirty(product, device, prop);
+    }
+
+exit:
+    HAL_MutexUnlock(tpl->lock);
+
+    return rc;
+}
+
+static int _template_get(void *handle, const char *product_id, const char *device_name, const char *key, void *value,
+                         size_t len, bool (*type_match)(uint8_t type))
+{
+    GatewayTemplate *       tpl = (GatewayTemplate *)handle;
+    GatewayTemplateProduct *product;
+    GatewayTemplateColumn * column;
+    uint8_t *               cell;
+    size_t                  cell_len;
+    int                     device, prop;
+    int                     rc;
+
+    POINTER_SANITY_CHECK(tpl, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(key, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(value, QCLOUD_ERR_INVAL);
+
+    HAL_MutexLock(tpl->lock);
+
+    rc = _template_locate(tpl, product_id, device_name, key, &product, &device, &prop);
+    if (rc) {
+        goto exit;
+    }
+
+    column = &product->columns[prop];
+    cell   = _device_cell(column, device);
+    /* a string is copied with its terminator only */
+    cell_len = column->type == JSTRING ? strlen((char *)cell) + 1 : GATEWAY_TEMPLATE_CELL_LEN;
+    if (!type_match(column->type) || cell_len > len) {
+        rc = QCLOUD_ERR_INVAL;
+        goto exit;
+    }
+
+    memcpy(value, cell, cell_len);
+
+exit:
+    HAL_MutexUnlock(tpl->lock);
+
+    return rc;
+}
+
+static bool _type_is_float(uint8_t type)
+{
+    return type == JFLOAT;
+}
+
+static bool _type_is_string(uint8_t type)
+{
+    return type == JSTRING;
+}
+
+static void _write_cell(JsonWriter *writer, GatewayTemplateColumn *column, int device)
+{
+    uint8_t *cell = _device_cell(column, device);
+    int32_t  int_value;
+    uint32_t uint_value;
+    float    float_value;
+
+    switch (column->type) {
+        case JUINT32:
+            memcpy(&uint_value, cell, sizeof(uint_value));
+            json_writer_uint(writer, uint_value);
+            break;
+        case JFLOAT:
+            memcpy(&float_value, cell, sizeof(float_value));
+            json_writer_double(writer, float_value);
+            break;
+        case JSTRING:
+            json_writer_string(writer, (char *)cell);
+            break;
+        default:
+            memcpy(&int_value, cell, sizeof(int_value));
+            json_writer_int(writer, int_value);
+            break;
+    }
+}
+
+/* {"method":"report","clientToken":"xxx","params":{dirty properties}} into the MQTT send buffer */
+static int _write_report_payload(unsigned char *buf, size_t buf_len, void *ctx)
+{
+    GatewayTemplateReport * report  = (GatewayTemplateReport *)ctx;
+    GatewayTemplateProduct *product = report->product;
+    uint32_t *              words   = product->dirty + report->device * product->dirty_words;
+    JsonWriter              writer;
+    int                     i;
+
+    json_writer_init(&writer, (char *)buf, buf_len);
+    json_writer_object_begin(&writer);
+    json_writer_key(&writer, METHOD_FIELD);
+    json_writer_string(&writer, REPORT_CMD);
+    json_writer_key(&writer, CLIENT_TOKEN_FIELD);
+    json_writer_string(&writer, report->client_token);
+    json_writer_key(&writer, CMD_CONTROL_PARA);
+    json_writer_object_begin(&writer);
+    for (i = 0; i < product->prop_num; i++) {
+        if (words[i / 32] & (1U << (i % 32))) {
+            json_writer_key(&writer, product->columns[i].key);
+            _write_cell(&writer, &product->columns[i], report->device);
+        }
+    }
+    json_writer_object_end(&writer);
+    json_writer_object_end(&writer);
+
+    return json_writer_finish(&writer);
+}
+
+static int _publish_report(GatewayTemplate *tpl, GatewayTemplateProduct *product, int device)
+{
+    Gateway *             gateway = (Gateway *)tpl->gateway;
+    PublishParams         params  = DEFAULT_PUB_PARAMS;
+    GatewayTemplateReport report;
+    char                  topic[MAX_SIZE_OF_CLOUD_TOPIC];
+    char                  client_token[MAX_SIZE_OF_CLIENT_TOKEN];
+    int                   size;
+
+    size = HAL_Snprintf(topic, sizeof(topic), "$thing/up/property/%s/%s", product->product_id,
+                        _device_name(product, device));
+    if (size < 0 || size > sizeof(topic) - 1) {
+        Log_e("buf size < topic length!");
+        return QCLOUD_ERR_FAILURE;
+    }
+    HAL_Snprintf(client_token, sizeof(client_token), "%s-%u", product->product_id, tpl->token_num++);
+
+    report.product      = product;
+    report.device       = device;
+    report.client_token = client_token;
+    params.qos          = QOS0;
+
+    return qcloud_iot_mqtt_publish_by_writer(gateway->mqtt, topic, &params, _write_report_payload, &report);
+}
+
+/* store the values of control, unknown properties and values of other types are skipped */
+static void _store_control(GatewayTemplateProduct *product, int device, const json_span_t *params)
+{
+    GatewayTemplateColumn *column;
+    json_span_t            value;
+    char *                 pos, *key, *val;
+    int                    key_len, val_len, val_type;
+    char                   last_char;
+    GatewayTemplateCell    cell;
+    bool                   bool_value;
+    int                    prop, rc;
+
+    backup_json_str_last_char(params->ptr, params->len, last_char);
+    json_object_for_each_kv((char *)params->ptr, pos, key, key_len, val, val_len, val_type)
+    {
+        prop = _column_find(product, key, key_len);
+        if (prop < 0) {
+            continue;
+        }
+
+        column     = &product->columns[prop];
+        value.ptr  = val;
+        value.len  = val_len;
+        value.type = val_type;
+
+        switch (column->type) {
+            case JSTRING:
+                rc = val_type == JSSTRING && value.len < column->width
+                         ? LITE_span_get_string((char *)_device_cell(column, device), &value, column->width)
+                         : QCLOUD_ERR_INVAL;
+                break;
+            case JINT8:
+                if (val_type == JSBOOLEAN) {
+                    rc         = LITE_span_get_boolean(&bool_value, &value);
+                    cell.int32 = bool_value;
+                    break;
+                }
+                /* fall through */
+            case JINT32:
+                rc = LITE_span_get_int32(&cell.int32, &value);
+                break;
+            case JUINT32:
+                rc = LITE_span_get_uint32(&cell.uint32, &value);
+                break;
+            default:
+                rc = LITE_span_get_float(&cell.float32, &value);
+                break;
+        }
+
+        if (rc) {
+            Log_w("invalid value of %.*s", key_len, key);
+        } else if (column->type != JSTRING) {
+            memcpy(_device_cell(column, device), &cell, GATEWAY_TEMPLATE_CELL_LEN);
+        }
+    }
+    restore_json_str_last_char(params->ptr, params->len, last_char);
+}
+
+static void _reply_control(GatewayTemplate *tpl, const char *product_id, const char *device_name,
+                           const char *json, size_t json_len, int code)
+{
+    Gateway *     gateway = (Gateway *)tpl->gateway;
+    PublishParams params  = DEFAULT_PUB_PARAMS;
+    json_span_t   token;
+    char          topic[MAX_SIZE_OF_CLOUD_TOPIC];
+    char          client_token[MAX_SIZE_OF_CLIENT_TOKEN];
+    char          reply[MAX_SIZE_OF_CLIENT_TOKEN + 64];
+    int           len;
+
+    if (LITE_json_span_of(CLIENT_TOKEN_FIELD, json, json_len, &token) ||
+        LITE_span_get_string(client_token, &token, sizeof(client_token))) {
+        Log_e("invalid clientToken of control");
+        return;
+    }
+
+    HAL_Snprintf(topic, sizeof(topic), "$thing/up/property/%s/%s", product_id, device_name);
+    len = HAL_Snprintf(reply, sizeof(reply), "{\"" METHOD_FIELD "\":\"" CONTROL_CMD_REPLY "\",\"" CLIENT_TOKEN_FIELD
+                       "\":\"%s\",\"" REPLY_CODE "\":%d,\"" REPLY_STATUS "\":\"%s\"}",
+                       client_token, code, code ? "failed" : "success");
+
+    params.qos         = QOS0;
+    params.payload     = reply;
+    params.payload_len = len;
+    IOT_MQTT_Publish(gateway->mqtt, topic, &params);
+}
+
+static void _template_control(GatewayTemplate *tpl, const char *product_id, const char *device_name, char *json,
+                              size_t json_len)
+{
+    GatewayTemplateProduct *product;
+    json_span_t             params;
+    char                    last_char;
+    int                     device;
+    int                     code = 0;
+
+    if (LITE_json_span_of(CMD_CONTROL_PARA, json, json_len, &params) || params.type != JSOBJECT) {
+        Log_e("invalid params of control");
+        return;
+    }
+
+    HAL_MutexLock(tpl->lock);
+    product = _product_find(tpl, product_id, strlen(product_id));
+    device  = product ? _device_find(product, device_name, strlen(device_name)) : -1;
+    if (device >= 0) {
+        _store_control(product, device, &params);
+    }
+    HAL_MutexUnlock(tpl->lock);
+
+    if (device < 0) {
+        return;
+    }
+
+    if (tpl->control) {
+        backup_json_str_last_char(params.ptr, params.len, last_char);
+        code = tpl->control(tpl, product_id, device_name, params.ptr, tpl->user_data);
+        restore_json_str_last_char(params.ptr, params.len, last_char);
+    }
+
+    _reply_control(tpl, product_id, device_name, json, json_len, code);
+}
+
+/* $thing/down/property/{product_id}/{device_name} of all sub-devices, from the subscription of the template or a
+ * broader route subscription */
+bool gateway_template_handle_message(void *handle, MQTTMessage *message)
+{
+    GatewayTemplate *       tpl        = (GatewayTemplate *)handle;
+    const size_t            prefix_len = sizeof(GATEWAY_TEMPLATE_DOWN_TOPIC_PREFIX) - 1;
+    GatewayTemplateProduct *product;
+    const char *            topic     = message->ptopic + prefix_len;
+    const char *            topic_end = message->ptopic + message->topic_len;
+    const char *            sep;
+    char                    product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char                    device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    json_span_t             method, code;
+    int32_t                 code_value;
+    char *                  json;
+    int                     device = -1;
+
+    if (message->topic_len <= prefix_len || memcmp(message->ptopic, GATEWAY_TEMPLATE_DOWN_TOPIC_PREFIX, prefix_len)) {
+        return false;
+    }
+    sep = memchr(topic, '/', topic_end - topic);
+    if (!sep || sep - topic > MAX_SIZE_OF_PRODUCT_ID || topic_end - sep - 1 > MAX_SIZE_OF_DEVICE_NAME) {
+        return false;
+    }
+    memcpy(product_id, topic, sep - topic);
+    product_id[sep - topic] = '\0';
+    memcpy(device_name, sep + 1, topic_end - sep - 1);
+    device_name[topic_end - sep - 1] = '\0';
+
+    HAL_MutexLock(tpl->lock);
+    product = _product_find(tpl, product_id, strlen(product_id));
+    if (product) {
+        device = _device_find(product, device_name, strlen(device_name));
+    }
+    HAL_MutexUnlock(tpl->lock);
+
+    /* not a template device, the route of the gateway takes it */
+    if (device < 0) {
+        return false;
+    }
+
+    json = HAL_Malloc(message->payload_len + 1);
+    if (!json) {
+        Log_e("malloc %u failed", (unsigned)message->payload_len);
+        return true;
+    }
+    memcpy(json, message->payload, message->payload_len);
+    json[message->payload_len] = '\0';
+
+    if (LITE_json_span_of(METHOD_FIELD, json, message->payload_len, &method) || method.type != JSSTRING) {
+        Log_e("invalid method of %s/%s", product_id, device_name);
+    } else if (LITE_span_equal(&method, CONTROL_CMD)) {
+        _template_control(tpl, product_id, device_name, json, message->payload_len);
+    } else if (LITE_span_equal(&method, REPORT_CMD_REPLY)) {
+        if (!LITE_json_span_of(REPLY_CODE, json, message->payload_len, &code) &&
+            !LITE_span_get_int32(&code_value, &code) && code_value) {
+            Log_w("report of %s/%s failed: %d", product_id, device_name, code_value);
+        }
+    }
+
+    HAL_Free(json);
+    return true;
+}
+
+void *IOT_Gateway_Template_Create(void *client, uint32_t flush_interval_ms, OnGatewayTemplateControl control,
+                                  void *user_data)
+{
+    GatewayTemplate *tpl;
+    Gateway *        gateway = (Gateway *)client;
+    SubscribeParams  params  = DEFAULT_SUB_PARAMS;
+    int              rc;
+
+    POINTER_SANITY_CHECK(gateway, NULL);
+
+    if (gateway->tpl) {
+        Log_e("gateway template exists");
+        return NULL;
+    }
+
+    tpl = HAL_Malloc(sizeof(GatewayTemplate));
+    if (!tpl) {
+        Log_e("malloc gateway template failed");
+        return NULL;
+    }
+    memset(tpl, 0, sizeof(GatewayTemplate));
+
+    tpl->lock = HAL_MutexCreate();
+    if (!tpl->lock) {
+        Log_e("create gateway template lock failed");
+        HAL_Free(tpl);
+        return NULL;
+    }
+
+    tpl->gateway           = gateway;
+    tpl->flush_interval_ms = flush_interval_ms;
+    tpl->control           = control;
+    tpl->user_data         = user_data;
+    InitTimer(&tpl->flush_timer);
+
+    /* a route subscription, the route handler hands the controls of template devices to gateway->tpl */
+    params.qos                = QOS0;
+    params.on_message_handler = gateway_route_message_handler;
+    params.user_data =
+        GATEWAY_ROUTE_LEVELS(GATEWAY_ROUTE_THING_DOWN_PRODUCT_ID_LEVEL, GATEWAY_ROUTE_THING_DOWN_DEVICE_NAME_LEVEL);
+
+    gateway->tpl = tpl;
+    rc           = IOT_MQTT_Subscribe(gateway->mqtt, GATEWAY_TEMPLATE_DOWN_FILTER, &params);
+    if (rc < 0) {
+        Log_e("subscribe %s failed: %d", GATEWAY_TEMPLATE_DOWN_FILTER, rc);
+        gateway->tpl = NULL;
+        HAL_MutexDestroy(tpl->lock);
+        HAL_Free(tpl);
+        return NULL;
+    }
+
+    return tpl;
+}
+
+void IOT_Gateway_Template_Destroy(void *handle)
+{
+    GatewayTemplate *tpl = (GatewayTemplate *)handle;
+    int              i;
+
+    POINTER_SANITY_CHECK_RTN(tpl);
+
+    /* no control is routed to the template once it is freed */
+    ((Gateway *)tpl->gateway)->tpl = NULL;
+    IOT_MQTT_Unsubscribe(((Gateway *)tpl->gateway)->mqtt, GATEWAY_TEMPLATE_DOWN_FILTER);
+
+    for (i = 0; i < tpl->product_num; i++) {
+        _product_free(tpl->products[i]);
+    }
+    HAL_MutexDestroy(tpl->lock);
+    HAL_Free(tpl);
+}
+
+int IOT_Gateway_Template_Add_Product(void *handle, const char *product_id, const GatewayTemplateProperty *properties,
+                                     int property_num)
+{
+    IOT_FUNC_ENTRY;
+
+    GatewayTemplate *       tpl = (GatewayTemplate *)handle;
+    GatewayTemplateProduct *product;
+    char *                  key_pos;
+    size_t                  size = 0;
+    int                     rc   = QCLOUD_RET_SUCCESS;
+    int                     i;
+
+    POINTER_SANITY_CHECK(tpl, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(properties, QCLOUD_ERR_INVAL);
+
+    if (strlen(product_id) > MAX_SIZE_OF_PRODUCT_ID || property_num <= 0 ||
+        property_num > GATEWAY_TEMPLATE_MAX_PROPERTIES) {
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+    }
+
+    for (i = 0; i < property_num; i++) {
+        if (!properties[i].key || (!_type_is_int(properties[i].type) && properties[i].type != JFLOAT &&
+                                   (properties[i].type != JSTRING || !properties[i].str_len ||
+                                    properties[i].str_len > GATEWAY_TEMPLATE_MAX_STRING))) {
+            Log_e("invalid property %d of %s", i, product_id);
+            IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+        }
+        size += strlen(properties[i].key) + 1;
+    }
+
+    HAL_MutexLock(tpl->lock);
+
+    if (_product_find(tpl, product_id, strlen(product_id)) || tpl->product_num >= GATEWAY_TEMPLATE_MAX_PRODUCTS) {
+        Log_e("product %s exists or too many products", product_id);
+        rc = QCLOUD_ERR_INVAL;
+        goto exit;
+    }
+
+    /* product, columns and keys in one allocation */
+    product = HAL_Malloc(sizeof(GatewayTemplateProduct) + property_num * sizeof(GatewayTemplateColumn) + size);
+    if (!product) {
+        rc = QCLOUD_ERR_MALLOC;
+        goto exit;
+    }
+    memset(product, 0, sizeof(GatewayTemplateProduct) + property_num * sizeof(GatewayTemplateColumn));
+
+    strncpy(product->product_id, product_id, MAX_SIZE_OF_PRODUCT_ID);
+    product->columns     = (GatewayTemplateColumn *)(product + 1);
+    product->prop_num    = property_num;
+    product->dirty_words = (property_num + 31) / 32;
+    product->index_dirty = true;
+
+    key_pos = (char *)(product->columns + property_num);
+    for (i = 0; i < property_num; i++) {
+        strcpy(key_pos, properties[i].key);
+        product->columns[i].key   = key_pos;
+        product->columns[i].type  = properties[i].type;
+        product->columns[i].width =
+            properties[i].type == JSTRING ? properties[i].str_len + 1 : GATEWAY_TEMPLATE_CELL_LEN;
+        key_pos += strlen(key_pos) + 1;
+    }
+
+    tpl->products[tpl->product_num++] = product;
+
+exit:
+    HAL_MutexUnlock(tpl->lock);
+
+    IOT_FUNC_EXIT_RC(rc);
+}
+
+int IOT_Gateway_Template_Add_Device(void *handle, const char *product_id, const char *device_name)
+{
+    IOT_FUNC_ENTRY;
+
+    GatewayTemplate *       tpl = (GatewayTemplate *)handle;
+    GatewayTemplateProduct *product;
+    int                     device;
+    int                     rc = QCLOUD_RET_SUCCESS;
+    int                     i;
+
+    POINTER_SANITY_CHECK(tpl, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_INVAL);
+
+    if (strlen(device_name) > MAX_SIZE_OF_DEVICE_NAME) {
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_INVAL);
+    }
+
+    HAL_MutexLock(tpl->lock);
+
+    product = _product_find(tpl, product_id, strlen(product_id));
+    if (!product) {
+        rc = QCLOUD_ERR_GATEWAY_TEMPLATE_NO_EXIST;
+        goto exit;
+    }
+    if (_device_find(product, device_name, strlen(device_name)) >= 0) {
+        goto exit;
+    }
+    if (product->device_num == product->device_cap) {
+        rc = _product_grow(product);
+        if (rc) {
+            goto exit;
+        }
+    }
+
+    device = product->device_num++;
+    strcpy(_device_name(product, device), device_name);
+    memset(product->dirty + device * product->dirty_words, 0, product->dirty_words * sizeof(uint32_t));
+    for (i = 0; i < product->prop_num; i++) {
+        memset(_device_cell(&product->columns[i], device), 0, product->columns[i].width);
+    }
+
+    /* rebuild the index when it is half full */
+    if (product->index_dirty || (product->index.count + 1) * 2 > product->index.mask + 1 ||
+        hash_index_add(&product->index, _device_name(product, device))) {
+        product->index_dirty = true;
+    }
+
+exit:
+    HAL_MutexUnlock(tpl->lock);
+
+    IOT_FUNC_EXIT_RC(rc);
+}
+
+int IOT_Gateway_Template_Remove_Device(void *handle, const char *product_id, const char *device_name)
+{
+    IOT_FUNC_ENTRY;
+
+    GatewayTemplate *       tpl = (GatewayTemplate *)handle;
+    GatewayTemplateProduct *product;
+    GatewayTemplateColumn * column;
+    int                     device, last;
+    int                     rc = QCLOUD_RET_SUCCESS;
+    int                     i;
+
+    POINTER_SANITY_CHECK(tpl, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(product_id, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(device_name, QCLOUD_ERR_INVAL);
+
+    HAL_MutexLock(tpl->lock);
+
+    product = _product_find(tpl, product_id, strlen(product_id));
+    device  = product ? _device_find(product, device_name, strlen(device_name)) : -1;
+    if (device < 0) {
+        rc = QCLOUD_ERR_GATEWAY_TEMPLATE_NO_EXIST;
+        goto exit;
+    }
+
+    /* the last device takes its place */
+    _device_clear_dirty(product, device);
+    last = --product->device_num;
+    if (device != last) {
+        strcpy(_device_name(product, device), _device_name(product, last));
+        memcpy(product->dirty + device * product->dirty_words, product->dirty + last * product->dirty_words,
+               product->dirty_words * sizeof(uint32_t));
+        for (i = 0; i < product->prop_num; i++) {
+            column = &product->columns[i];
+            memcpy(_device_cell(column, device), _device_cell(column, last), column->width);
+        }
+    }
+    product->index_dirty = true;
+
+exit:
+    HAL_MutexUnlock(tpl->lock);
+
+    IOT_FUNC_EXIT_RC(rc);
+}
+
+int IOT_Gateway_Template_Set_Int(void *handle, const char *product_id, const char *device_name, const char *key,
+                                 int32_t value)
+{
+    return _template_set(handle, product_id, device_name, key, &value, sizeof(value), _type_is_int);
+}
+
+int IOT_Gateway_Template_Set_Float(void *handle, const char *product_id, const char *device_name, const char *key,
+                                   float value)
+{
+    return _template_set(handle, product_id, device_name, key, &value, sizeof(value), _type_is_float);
+}
+
+int IOT_Gateway_Template_Set_String(void *handle, const char *product_id, const char *device_name, const char *key,
+                                    const char *value)
+{
+    POINTER_SANITY_CHECK(value, QCLOUD_ERR_INVAL);
+
+    return _template_set(handle, product_id, device_name, key, value, strlen(value) + 1, _type_is_string);
+}
+
+int IOT_Gateway_Template_Get_Int(void *handle, const char *product_id, const char *device_name, const char *key,
+                                 int32_t *value)
+{
+    return _template_get(handle, product_id, device_name, key, value, sizeof(*value), _type_is_int);
+}
+
+int IOT_Gateway_Template_Get_Float(void *handle, const char *product_id, const char *device_name, const char *key,
+                                   float *value)
+{
+    return _template_get(handle, product_id, device_name, key, value, sizeof(*value), _type_is_float);
+}
+
+int IOT_Gateway_Template_Get_String(void *handle, const char *product_id, const char *device_name, const char *key,
+                                    char *value, size_t value_len)
+{
+    return _template_get(handle, product_id, device_name, key, value, value_len, _type_is_string);
+}
+
+int IOT_Gateway_Template_Flush(void *handle, bool force)
+{
+    GatewayTemplate *       tpl = (GatewayTemplate *)handle;
+    GatewayTemplateProduct *product;
+    int                     count = 0;
+    int                     rc    = QCLOUD_RET_SUCCESS;
+    int                     i, device;
+
+    POINTER_SANITY_CHECK(tpl, QCLOUD_ERR_INVAL);
+
+    HAL_MutexLock(tpl->lock);
+
+    if (!force && !expired(&tpl->flush_timer)) {
+        goto exit;
+    }
+    countdown_ms(&tpl->flush_timer, tpl->flush_interval_ms);
+
+    for (i = 0; i < tpl->product_num && rc >= 0; i++) {
+        product = tpl->products[i];
+        for (device = 0; product->dirty_num && device < product->device_num; device++) {
+            if (!_device_is_dirty(product, device)) {
+                continue;
+            }
+
+            rc = _publish_report(tpl, product, device);
+            if (rc < 0) {
+                Log_e("report %s/%s failed: %d", product->product_id, _device_name(product, device), rc);
+                break;
+            }
+            _device_clear_dirty(product, device);
+            count++;
+        }
+    }
+
+exit:
+    HAL_MutexUnlock(tpl->lock);
+
+    return rc < 0 ? rc : count;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -36,20 +36,36 @@ extern "C" {
 #include "qcloud_iot_device.h"
 #include "qcloud_iot_export.h"
 #include "qcloud_iot_import.h"
+#include "utils_hash_index.h"
 #include "utils_param_check.h"
+#include "utils_request_table.h"
 
 #define MAX_CLEAE_DOC_LEN 256
 
+/* initial slots of reply_table and event_table, the tables grow on demand */
+#define TEMPLATE_REPLY_POOL_SIZE (8)
+#define TEMPLATE_EVENT_POOL_SIZE (8)
+
+/**
+ * @brief write members of an upstream request after method and clientToken
+ *
+ * @param writer    JSON writer positioned in the request object
+ * @param ctx       user context
+ * @return          QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+typedef int (*TemplateJsonWriteHandler)(JsonWriter *writer, void *ctx);
+
 typedef struct _TemplateInnerData {
-    uint32_t token_num;
-    int32_t  sync_status;
-    uint32_t eventflags;
-    List *   event_list;
-    List *   reply_list;
-    List *   action_handle_list;
-    List *   property_handle_list;
-    char *   upstream_topic;    // upstream topic
-    char *   downstream_topic;  // downstream topic
+    uint32_t     token_num;
+    int32_t      sync_status;
+    uint32_t     eventflags;
+    RequestTable event_table;  // events waiting for reply, keyed by client_token_key
+    RequestTable reply_table;  // requests waiting for reply, keyed by client_token_key
+    List *       action_handle_list;
+    List *       property_handle_list;
+    HashIndex    property_index;    // index of property_handle_list by property key
+    char *       upstream_topic;    // upstream topic
+    char *       downstream_topic;  // downstream topic
 } TemplateInnerData;
 
 typedef struct _Template {
@@ -66,6 +82,14 @@ typedef struct _Template {
     bool yield_thread_running;
     int  yield_thread_exit_code;
 #endif
+
+#ifdef LAN_CONTROL_ENABLED
+    void *lan_control;  // LAN control service, NULL if not started
+#endif
+
+#ifdef STATE_SNAPSHOT_ENABLED
+    void *snapshot;  // state snapshot journal, NULL if not started
+#endif
 } Qcloud_IoT_Template;
 
 /**
@@ -98,6 +122,18 @@ void handle_template_expired_reply(Qcloud_IoT_Template *pTemplate);
  */
 char *get_control_clientToken(void);
 
+/**
+ * @brief apply a control object to the registered properties, or hand it to
+ * usr_control_handle if registered, then journal the state if the state
+ * snapshot runs, called with mutex held
+ *
+ * @param pTemplate   data template client
+ * @param index       indexed message, its document is modified and restored in place
+ * @param ctl_tok     control object token
+ * @param type        type of control passed to usr_control_handle
+ */
+void template_apply_control(Qcloud_IoT_Template *pTemplate, const JsonIndex *index, int ctl_tok, eControlType type);
+
 /**
  * @brief all the upstream data by the way of request
  *
@@ -110,6 +146,19 @@ char *get_control_clientToken(void);
  */
 int send_template_request(Qcloud_IoT_Template *pTemplate, RequestParams *pParams, char *pJsonDoc, size_t sizeOfBuffer);
 
+/**
+ * @brief upstream request written directly into the MQTT send buffer, without
+ * an intermediate JSON document
+ *
+ * @param pTemplate     handle to data_template client
+ * @param pParams       request params
+ * @param write_cb      callback to write the members of request
+ * @param ctx           context of write_cb
+ * @return              QCLOUD_RET_SUCCESS when success, or err code for failure
+ */
+int send_template_request_by_writer(Qcloud_IoT_Template *pTemplate, RequestParams *pParams,
+                                    TemplateJsonWriteHandler write_cb, void *ctx);
+
 /**
  * @brief subscribe data_template topic $thing/down/property/%s/%s
  *
@@ -57,6 +57,24 @@ int template_common_remove_property(Qcloud_IoT_Template *ptemplate, DeviceProper
  */
 int template_common_check_property_existence(Qcloud_IoT_Template *ptemplate, DeviceProperty *pProperty);
 
+/**
+ * @brief find registered property by key through the property index, called
+ * with mutex held
+ *
+ * @param pTemplate handle to data_template client
+ * @param key       property key, not required to be '\0' terminated
+ * @param key_len   length of key
+ * @return          property handler, or NULL if not registered
+ */
+PropertyHandler *template_common_find_property(Qcloud_IoT_Template *pTemplate, const char *key, size_t key_len);
+
+/**
+ * @brief release the property index
+ *
+ * @param pTemplate handle to data_template client
+ */
+void template_common_clear_property_index(Qcloud_IoT_Template *pTemplate);
+
 #ifdef __cplusplus
 }
 #endif
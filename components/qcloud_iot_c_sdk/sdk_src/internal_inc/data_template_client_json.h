@@ -24,17 +24,27 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
+#include "json_index.h"
 #include "qcloud_iot_export.h"
 #include "qcloud_iot_import.h"
+#include "utils_hash_index.h"
+#include "utils_json_writer.h"
 
 #define min(a, b) (a) < (b) ? (a) : (b)
 
-/* Max number of requests in appending state */
-#define MAX_APPENDING_REQUEST_AT_ANY_GIVEN_TIME (10)
-
 /* Size of buffer to receive JSON document from server */
 #define CLOUD_IOT_JSON_RX_BUF_LEN (QCLOUD_IOT_MQTT_RX_BUF_LEN + 1)
 
+/* Number of JSON tokens for indexing a downstream message without heap,
+ * larger messages get token storage from heap */
+#define MAX_TEMPLATE_JSON_TOKENS (64)
+
+/* Max size of method field */
+#define MAX_SIZE_OF_METHOD (32)
+
+/* Max size of actionId field */
+#define MAX_SIZE_OF_ACTION_ID (64)
+
 /* Max size of clientToken */
 #define MAX_SIZE_OF_CLIENT_TOKEN (MAX_SIZE_OF_CLIENT_ID + 10)
 
@@ -91,7 +101,6 @@ typedef struct {
     Method method;                                  // method type
 
     void *user_context;  // user context
-    Timer timer;         // timer for timeout
 
     OnReplyCallback callback;  // request response callback
 } Request;
@@ -104,6 +113,9 @@ typedef struct {
 
     OnPropRegCallback callback;
 
+#ifdef STATE_SNAPSHOT_ENABLED
+    uint32_t snapshot_hash;  // hash of the value journaled last, 0 if none
+#endif
 } PropertyHandler;
 
 /**
@@ -114,6 +126,8 @@ typedef struct {
 
     OnActionHandleCallback callback;
 
+    HashIndex input_index;  // index of action inputs by key, slots follow the handler
+
 } ActionHandler;
 
 /**
@@ -127,15 +141,6 @@ typedef struct {
 
 int check_snprintf_return(int32_t returnCode, size_t maxSizeOfWrite);
 
-/**
- * @brief insert source string to the dest string with specified position
- *
- * @param pSourceStr   source string
- * @param pDestStr     dest string
- * @param pos          dest string positon
- */
-void insert_str(char *pDestStr, char *pSourceStr, int pos);
-
 /**
  * add a JSON node to JSON string
  *
@@ -159,6 +164,37 @@ int put_json_node(char *jsonBuffer, size_t sizeOfBuffer, DeviceProperty *pJsonNo
  */
 int template_put_json_node(char *jsonBuffer, size_t sizeOfBuffer, const char *pKey, void *pData, JsonDataType type);
 
+/**
+ * @brief write a JSON node as object member, nodes of JOBJECT type are written
+ * recursively
+ *
+ * @param writer        JSON writer
+ * @param pJsonNode     JSON node
+ * @return              QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int write_json_node(JsonWriter *writer, DeviceProperty *pJsonNode);
+
+/**
+ * @brief write a JSON node as object member, same format as
+ * template_put_json_node
+ *
+ * @param writer        JSON writer
+ * @param pKey          key of JSON node
+ * @param pData         value of JSON node
+ * @param type          value type of JSON node
+ * @return              QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int template_write_json_node(JsonWriter *writer, const char *pKey, void *pData, JsonDataType type);
+
+/**
+ * @brief write clientToken member like "clientToken":"{prefix}-{number}"
+ *
+ * @param writer        JSON writer
+ * @param tokenNumber   token number, increment every time
+ * @param tokenPrefix   prefix of token, like product_id
+ */
+void template_write_client_token(JsonWriter *writer, uint32_t *tokenNumber, const char *tokenPrefix);
+
 /**
  * @brief generate an empty JSON with only clientToken
  *
@@ -172,19 +208,31 @@ void build_empty_json(uint32_t *tokenNumber, char *pJsonBuffer, char *tokenPrefi
  * @brief parse field of clientToken from JSON string
  *
  * @param pJsonDoc       source JSON string
- * @param pClientToken   pointer to field of ClientToken
+ * @param pClientToken   buffer for field of ClientToken
+ * @param buf_len        size of pClientToken
  * @return               true for success
  */
-bool parse_client_token(char *pJsonDoc, char **pClientToken);
+bool parse_client_token(char *pJsonDoc, char *pClientToken, size_t buf_len);
+
+/**
+ * @brief key of clientToken in the request table, the number of "{prefix}-{number}"
+ * or a hash of any other token
+ *
+ * @param pClientToken   clientToken string
+ * @param tokenPrefix    prefix of token, like product_id
+ * @return               key of the token
+ */
+uint32_t client_token_key(const char *pClientToken, const char *tokenPrefix);
 
 /**
  * @brief parse field of aciont_id from JSON string
  *
  * @param pJsonDoc       source JSON string
- * @param pActionID   	 pointer to field of action_id
+ * @param pActionID   	 buffer for field of action_id
+ * @param buf_len        size of pActionID
  * @return               true for success
  */
-bool parse_action_id(char *pJsonDoc, char **pActionID);
+bool parse_action_id(char *pJsonDoc, char *pActionID, size_t buf_len);
 
 /**
  * @brief parse field of timestamp from JSON string
@@ -199,19 +247,20 @@ bool parse_time_stamp(char *pJsonDoc, int32_t *pTimestamp);
  * @brief parse field of input from JSON string
  *
  * @param pJsonDoc       source JSON string
- * @param pActionInput   filed of params as action input parameters
+ * @param pActionInput   view of params as action input parameters
  * @return               true for success
  */
-bool parse_action_input(char *pJsonDoc, char **pActionInput);
+bool parse_action_input(char *pJsonDoc, json_span_t *pActionInput);
 
 /**
  * @brief parse field of status from JSON string
  *
  * @param pJsonDoc       source JSON string
- * @param pStatus   	 pointer to field of status
+ * @param pStatus   	 buffer for field of status
+ * @param buf_len        size of pStatus
  * @return               true for success
  */
-bool parse_status_return(char *pJsonDoc, char **pStatus);
+bool parse_status_return(char *pJsonDoc, char *pStatus, size_t buf_len);
 
 /**
  * @brief parse field of code from JSON string
@@ -226,37 +275,59 @@ bool parse_code_return(char *pJsonDoc, int32_t *pCode);
  * @brief update value in JSON if key is matched, not for OBJECT type
  *
  * @param pJsonDoc       JSON string
+ * @param len            length of pJsonDoc
+ * @param pProperty      device property
+ * @return               true for success
+ */
+bool update_value_if_key_match(const char *pJsonDoc, size_t len, DeviceProperty *pProperty);
+
+/**
+ * @brief update value of property from an indexed JSON object if key is matched
+ *
+ * @param index          index of the JSON document
+ * @param obj            object token holding the properties
+ * @param pProperty      device property
+ * @return               true for success
+ */
+bool update_value_by_index(const JsonIndex *index, int obj, DeviceProperty *pProperty);
+
+/**
+ * @brief update value of property from a value token of an indexed JSON
+ *
+ * @param index          index of the JSON document
+ * @param val            value token
  * @param pProperty      device property
  * @return               true for success
  */
-bool update_value_if_key_match(char *pJsonDoc, DeviceProperty *pProperty);
+bool update_value_by_token(const JsonIndex *index, int val, DeviceProperty *pProperty);
 
 /**
  * @brief parse field of method from JSON string
  *
  * @param pJsonDoc		 source JSON string
- * @param pMethod 		 pointer to field of method
+ * @param pMethod 		 buffer for field of method
+ * @param buf_len		 size of pMethod
  * @return				 true for success
  */
-bool parse_template_method_type(char *pJsonDoc, char **pMethod);
+bool parse_template_method_type(char *pJsonDoc, char *pMethod, size_t buf_len);
 
 /**
  * @brief parse field of control from get_status_reply JSON string
  *
  * @param pJsonDoc		 source JSON string
- * @param control 		 pointer to field of control
+ * @param control 		 view of field of control
  * @return				 true for success
  */
-bool parse_template_get_control(char *pJsonDoc, char **control);
+bool parse_template_get_control(char *pJsonDoc, json_span_t *control);
 
 /**
  * @brief parse field of control from control JSON string
  *
  * @param pJsonDoc		 source JSON string
- * @param control 		 pointer to field of control
+ * @param control 		 view of field of control
  * @return				 true for success
  */
-bool parse_template_cmd_control(char *pJsonDoc, char **control);
+bool parse_template_cmd_control(char *pJsonDoc, json_span_t *control);
 
 #ifdef __cplusplus
 }
@@ -36,8 +36,7 @@ extern "C" {
 #define SINGLE_EVENT        (1)
 #define MUTLTI_EVENTS       (2)
 
-#define MAX_EVENT_WAIT_REPLY (10)
-#define EVENT_MAX_DATA_NUM   (255)
+#define EVENT_MAX_DATA_NUM (255)
 
 #define POST_EVENT  "event_post"
 #define POST_EVENTS "events_post"
@@ -51,19 +50,6 @@ typedef enum {
     eEVENT_REPLY,
 } eEventMethod;
 
-typedef enum _eEventDealType_ {
-    eDEAL_REPLY_CB = 0,
-    eDEAL_EXPIRED  = 1,
-} eEventDealType;
-
-typedef struct _sReply_ {
-    char  client_token[EVENT_TOKEN_MAX_LEN];  // clientToken for this event reply
-    void *user_context;                       // user context
-    Timer timer;                              // timer for request timeout
-
-    OnEventReplyCallback callback;  // callback for this event reply
-} sEventReply;
-
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,100 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_DATA_TEMPLATE_LAN_CONTROL_H_
+#define QCLOUD_IOT_DATA_TEMPLATE_LAN_CONTROL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef LAN_CONTROL_ENABLED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "data_template_client.h"
+#include "json_index.h"
+
+#define LAN_CONTROL_SIGN_LEN        (40)    // hex HMAC-SHA1 before the JSON message
+#define LAN_CONTROL_BUF_LEN         (1024)  // max datagram
+#define LAN_CONTROL_MAX_JSON_TOKENS (64)
+#define LAN_CONTROL_MAX_CLIENTS     (8)     // clients whose seq is tracked
+#define LAN_CONTROL_CLIENT_ID_LEN   (32)
+#define LAN_CONTROL_MAX_SYNC        (32)    // properties waiting to be synced to the cloud
+#define LAN_CONTROL_POLL_MS         (100)   // read wait of the service task
+#define LAN_CONTROL_ERR_SLEEP_MS    (500)
+#define LAN_CONTROL_EXIT_WAIT_CNT   (20)    // LAN_CONTROL_POLL_MS each
+#define LAN_CONTROL_ADDR_LEN        (32)
+#define LAN_CONTROL_NONCE_BLOCK     (256)   // nonces reserved in the nonce file at a time
+#define LAN_CONTROL_PATH_LEN        (128)
+#define LAN_CONTROL_TMP_SUFFIX      ".tmp"
+#define LAN_CONTROL_KEY_SALT        "lan_control"
+
+#define LAN_CONTROL_CLIENT_ID_FIELD "clientId"
+#define LAN_CONTROL_SEQ_FIELD       "seq"
+#define LAN_CONTROL_NONCE_FIELD     "nonce"
+#define LAN_CONTROL_TASK_NAME       "lan_control_task"
+
+typedef struct {
+    char     client_id[LAN_CONTROL_CLIENT_ID_LEN + 1];  // "" for a free slot
+    uint32_t seq;                                       // last accepted under the nonce
+} LanControlClient;
+
+/**
+ * @brief LAN control service of a data template client
+ *
+ * dirty holds the properties controlled over LAN and not synced to the cloud
+ * yet, syncing the ones of the report in flight, which go back to dirty if the
+ * report fails.
+ *
+ * A request carries the nonce of the device besides its seq. The seqs taken
+ * are kept for the current nonce only, the nonce changes on every start and
+ * whenever a client has to be forgotten, so a captured request is never
+ * accepted again.
+ */
+typedef struct {
+    Qcloud_IoT_Template *    pTemplate;
+    TemplateLanControlParams params;
+    int                      fd;
+    char                     key[LAN_CONTROL_SIGN_LEN];
+    volatile bool            running;
+    volatile bool            exit;
+    void *                   lock;  // lock of the sync state and stats
+    LanControlClient         clients[LAN_CONTROL_MAX_CLIENTS];
+    uint32_t                 nonce;
+    uint32_t                 nonce_end;                         // end of the nonces reserved in the nonce file
+    char                     nonce_path[LAN_CONTROL_PATH_LEN];  // "" without the nonce file
+    DeviceProperty *         dirty[LAN_CONTROL_MAX_SYNC];
+    int                      dirty_num;
+    DeviceProperty *         syncing[LAN_CONTROL_MAX_SYNC];
+    int                      syncing_num;
+    bool                     sync_inflight;
+    uint32_t                 sync_retry_ms;  // no sync before it after a failure
+    TemplateLanControlStats  stats;
+    char                     addr[LAN_CONTROL_ADDR_LEN];  // sender of the datagram in rx_buf
+    uint16_t                 port;
+    JsonToken                tokens[LAN_CONTROL_MAX_JSON_TOKENS];
+    char                     rx_buf[LAN_CONTROL_BUF_LEN + 1];
+    char                     tx_buf[LAN_CONTROL_BUF_LEN];
+} LanControl;
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_DATA_TEMPLATE_LAN_CONTROL_H_
@@ -0,0 +1,87 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_DATA_TEMPLATE_SNAPSHOT_H_
+#define QCLOUD_IOT_DATA_TEMPLATE_SNAPSHOT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef STATE_SNAPSHOT_ENABLED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "data_template_client.h"
+#include "json_index.h"
+
+#define STATE_SNAPSHOT_ENTRY_LEN   (256)  // max encoded property, larger ones are not journaled
+#define STATE_SNAPSHOT_RECORD_HDR  (6)    // entry length and hash before each entry
+#define STATE_SNAPSHOT_PATH_LEN    (128)
+#define STATE_SNAPSHOT_TMP_SUFFIX  ".tmp"
+#define STATE_SNAPSHOT_MAX_RESTORE (256)  // properties counted by a restore
+
+/**
+ * @brief State snapshot journal of a data template client
+ *
+ * The journal is a sequence of records, each an entry of one property value
+ * prefixed by its length and hash, a later record of a key overriding the
+ * former ones. A torn record at the end fails its hash and ends the journal.
+ * An entry is the key length, key, type, value length and value, the value of
+ * a JOBJECT property being the entries of its members. Values are kept in the
+ * byte order of the device.
+ *
+ * All the members are used with the mutex of the client held.
+ */
+typedef struct {
+    char                  path[STATE_SNAPSHOT_PATH_LEN];
+    void *                fp;            // journal opened for append
+    uint32_t              size;          // bytes in the journal
+    uint32_t              compact_size;  // bytes of the snapshot it was rewritten into
+    bool                  broken;        // a write failed, the journal is rewritten on the next save
+    TemplateSnapshotStats stats;
+    uint8_t               buf[STATE_SNAPSHOT_RECORD_HDR + STATE_SNAPSHOT_ENTRY_LEN];
+    uint8_t               prev[STATE_SNAPSHOT_ENTRY_LEN];  // value before the update of a get_status control
+} TemplateSnapshot;
+
+/**
+ * @brief append the registered properties whose values changed since they
+ * were journaled last, called with mutex held
+ *
+ * @param pTemplate   data template client
+ */
+void template_snapshot_save(Qcloud_IoT_Template *pTemplate);
+
+/**
+ * @brief update a property from a control of get_status, called with mutex
+ * held while the journal runs
+ *
+ * @param pTemplate   data template client
+ * @param index       indexed message
+ * @param val         value token of the property
+ * @param pProperty   property to update
+ * @return            true if the value of the property changed
+ */
+bool template_snapshot_update_delta(Qcloud_IoT_Template *pTemplate, const JsonIndex *index, int val,
+                                    DeviceProperty *pProperty);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_DATA_TEMPLATE_SNAPSHOT_H_
@@ -0,0 +1,171 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_GATEWAY_AUTOMATION_H_
+#define QCLOUD_IOT_GATEWAY_AUTOMATION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "qcloud_iot_export.h"
+#include "utils_hash_index.h"
+
+#ifdef GATEWAY_AUTOMATION_ENABLED
+
+/* limits of the engine, slots are indexed by 16 bits */
+#define GATEWAY_AUTOMATION_MAX_RULES    (4096)
+#define GATEWAY_AUTOMATION_MAX_SLOTS    (8192)
+#define GATEWAY_AUTOMATION_MAX_CONDS    (16)
+#define GATEWAY_AUTOMATION_MAX_ACTIONS  (16)
+#define GATEWAY_AUTOMATION_MAX_PROPERTY (32)
+
+/* properties of a report settled before rules are checked */
+#define GATEWAY_AUTOMATION_REPORT_BATCH (16)
+
+#define GATEWAY_AUTOMATION_MINUTES_OF_DAY (1440)
+#define GATEWAY_AUTOMATION_ALL_DAYS       (0x7F)
+
+/* "product_id/device_name/property" */
+#define GATEWAY_AUTOMATION_KEY_LEN \
+    (MAX_SIZE_OF_PRODUCT_ID + MAX_SIZE_OF_DEVICE_NAME + GATEWAY_AUTOMATION_MAX_PROPERTY + 3)
+
+typedef enum {
+    eAUTOMATION_COND_PROPERTY = 0,
+    eAUTOMATION_COND_TIMER    = 1,
+} AutomationCondType;
+
+typedef enum {
+    eAUTOMATION_OP_EQ = 0,
+    eAUTOMATION_OP_NE,
+    eAUTOMATION_OP_GT,
+    eAUTOMATION_OP_GE,
+    eAUTOMATION_OP_LT,
+    eAUTOMATION_OP_LE,
+} AutomationOp;
+
+typedef struct {
+    double   value;    // operand of op
+    uint16_t slot;     // property slot, or minute of day for timer
+    uint8_t  type;     // AutomationCondType
+    uint8_t  op;       // AutomationOp, or days mask for timer, bit 0 is Sunday
+    uint8_t  is_true;  // result with the latest value of the slot
+} AutomationCond;
+
+typedef struct {
+    const char *product_id;
+    const char *device_name;
+    const char *data;  // JSON of the properties to control
+} AutomationAction;
+
+/**
+ * @brief compiled automation, conditions, actions and strings share its allocation
+ */
+typedef struct {
+    const char *      id;
+    AutomationCond *  conds;
+    AutomationAction *actions;
+    uint32_t          rise_seq;   // update in which a condition of the rule became true
+    uint32_t          fire_seq;   // update in which the rule was checked to fire
+    uint16_t          begin_min;  // effective window in minutes of day, across midnight if begin > end
+    uint16_t          end_min;
+    uint8_t           days;       // effective days mask, bit 0 is Sunday
+    uint8_t           status;     // 0 for disabled
+    uint8_t           match_any;  // fire on any condition instead of all of them
+    uint8_t           cond_num;
+    uint8_t           action_num;
+    uint8_t           prop_num;  // property conditions
+    uint8_t           true_num;  // property conditions that are true
+    uint8_t           timer_num;
+} AutomationRule;
+
+typedef struct {
+    AutomationRule *rule;
+    uint8_t         cond;
+} AutomationDep;
+
+/**
+ * @brief latest value of a sub-device property and the conditions on it
+ */
+typedef struct {
+    double         value;
+    AutomationDep *deps;
+    uint16_t       dep_num;
+    uint16_t       dep_cap;
+    uint16_t       index;  // position in slots of the engine
+    uint8_t        valid;
+    char           key[];  // "product_id/device_name/property"
+} AutomationSlot;
+
+typedef struct {
+    AutomationRule *rule;
+    uint16_t        minute;  // minute of day
+    uint8_t         cond;
+} AutomationTimer;
+
+typedef void (*AutomationReport)(void *client, const char *automation_id, int result);
+
+/**
+ * @brief Local automation engine
+ *
+ * A property update only visits the conditions registered on its slot, found
+ * through a hash index of "product_id/device_name/property", and rules keep a
+ * count of their true conditions, so the cost of an update does not depend on
+ * the number of rules. Timer conditions are kept sorted by minute of day.
+ * Indexes are rebuilt lazily after rules are replaced or deleted.
+ */
+typedef struct {
+    void *           lock;
+    AutomationRule **rules;
+    AutomationSlot **slots;
+    AutomationTimer *timers;
+    void **          rule_slots;  // storage of rule_index
+    void **          slot_slots;  // storage of slot_index
+    HashIndex        rule_index;
+    HashIndex        slot_index;
+    uint16_t         rule_num;
+    uint16_t         rule_cap;
+    uint16_t         rule_slot_num;
+    uint16_t         slot_num;
+    uint16_t         slot_cap;
+    uint16_t         slot_slot_num;
+    uint16_t         timer_num;
+    bool             rule_index_dirty;
+    bool             slot_index_dirty;
+    bool             timers_dirty;
+    uint32_t         seq;            // sequence of property updates
+    uint32_t         local_time;     // local time in seconds of the latest tick
+    uint32_t         local_time_ms;  // HAL_GetTimeMs of the latest tick
+    int32_t          last_minute;    // local_time / 60 of the latest tick, -1 before the first
+
+    OnAutoMationAction action;
+    void *             user_data;
+
+    /* set when the engine is attached to a gateway client */
+    void *                         client;
+    AutomationReport               report;
+    QCLOUD_IO_GATEWAY_AUTOMATION_T cloud;
+} AutomationEngine;
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_GATEWAY_AUTOMATION_H_
@@ -0,0 +1,133 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_GATEWAY_BROKER_H_
+#define QCLOUD_IOT_GATEWAY_BROKER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef GATEWAY_LOCAL_BROKER_ENABLED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "qcloud_iot_export.h"
+
+#define GATEWAY_BROKER_MAX_SESSIONS       (32)
+#define GATEWAY_BROKER_MAX_SUBS           (8)     // subscriptions of a session
+#define GATEWAY_BROKER_FILTER_LEN         (128)
+#define GATEWAY_BROKER_RX_BUF_LEN         (1024)  // max packet from a local client
+#define GATEWAY_BROKER_TX_BUF_LEN         (QCLOUD_IOT_MQTT_RX_BUF_LEN + 256)
+#define GATEWAY_BROKER_CREDENTIAL_LEN     (128)   // username and password
+#define GATEWAY_BROKER_REPORT_LEN         (512)   // merged params of a sub-device
+#define GATEWAY_BROKER_MAX_MERGE          (8)     // reports merged into one
+#define GATEWAY_BROKER_TOKEN_LEN          (64)
+#define GATEWAY_BROKER_MAX_JSON_TOKENS    (64)
+#define GATEWAY_BROKER_CONNECT_TIMEOUT_MS (10000)  // from accept to CONNECT
+#define GATEWAY_BROKER_OP_TIMEOUT_MS      (5000)   // bringing a sub-device online or offline
+#define GATEWAY_BROKER_WRITE_TIMEOUT_MS   (200)
+#define GATEWAY_BROKER_POLL_MS            (1)      // read wait of each session
+#define GATEWAY_BROKER_IDLE_MS            (10)     // sleep of the yield without any session
+#define GATEWAY_BROKER_TOKEN_PREFIX       "gwbroker-"
+
+#define GATEWAY_BROKER_UP_TOPIC_PREFIX         "$thing/up/"
+#define GATEWAY_BROKER_DOWN_TOPIC_PREFIX       "$thing/down/"
+#define GATEWAY_BROKER_PROPERTY_TOPIC_FMT      "$thing/up/property/%s/%s"
+#define GATEWAY_BROKER_PROPERTY_TOPIC_LEVEL    2  // topic levels of ${type}, ${product_id} and ${device_name}
+#define GATEWAY_BROKER_PRODUCT_ID_TOPIC_LEVEL  3
+#define GATEWAY_BROKER_DEVICE_NAME_TOPIC_LEVEL 4
+#define GATEWAY_BROKER_THING_TOPIC_LEVELS      5
+
+/* MQTT 3.1.1 CONNECT flags and CONNACK return codes */
+#define GATEWAY_BROKER_CONNECT_FLAG_USERNAME  0x80
+#define GATEWAY_BROKER_CONNECT_FLAG_PASSWORD  0x40
+#define GATEWAY_BROKER_CONNECT_FLAG_WILL      0x04
+#define GATEWAY_BROKER_CONNECT_FLAG_RESERVED  0x01
+#define GATEWAY_BROKER_CONNACK_ACCEPTED       0
+#define GATEWAY_BROKER_CONNACK_BAD_PROTOCOL   1
+#define GATEWAY_BROKER_CONNACK_BAD_CLIENT_ID  2
+#define GATEWAY_BROKER_CONNACK_BAD_USERDATA   4
+#define GATEWAY_BROKER_CONNACK_NOT_AUTHORIZED 5
+#define GATEWAY_BROKER_SUBACK_FAILURE         0x80
+
+typedef enum {
+    GATEWAY_BROKER_CONNECTING,    // waiting for CONNECT
+    GATEWAY_BROKER_ONLINE_START,  // CONNECT accepted, bringing the sub-device online is due
+    GATEWAY_BROKER_ONLINE_WAIT,   // waiting for the result of bringing online
+    GATEWAY_BROKER_CONNECTED,
+    GATEWAY_BROKER_CLOSED,        // socket closed, taking the sub-device offline is due
+} GatewayBrokerState;
+
+typedef struct {
+    char filter[GATEWAY_BROKER_FILTER_LEN];
+    QoS  qos;
+} GatewayBrokerSub;
+
+/* clientTokens of the reports merged into one */
+typedef struct {
+    char tokens[GATEWAY_BROKER_MAX_MERGE][GATEWAY_BROKER_TOKEN_LEN];
+    int  num;
+} GatewayBrokerTokens;
+
+/**
+ * @brief Session of a local client
+ *
+ * pending holds the params merged from the property reports received within the
+ * coalesce window, sent holds the clientTokens of the merged report published
+ * last, whose reply is handed to each of them.
+ */
+typedef struct {
+    uintptr_t           fd;
+    GatewayBrokerState  state;
+    bool                online;      // the sub-device is online through the gateway
+    bool                op_pending;  // bringing online is in progress
+    int32_t             op_result;
+    char                product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char                device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    uint16_t            keep_alive;  // seconds, 0 for none
+    uint16_t            packet_id;   // of the last QoS1 delivery
+    uint32_t            last_rx_ms;
+    GatewayBrokerSub    subs[GATEWAY_BROKER_MAX_SUBS];
+    int                 sub_num;
+    char                pending_params[GATEWAY_BROKER_REPORT_LEN];  // "" when nothing is pending
+    GatewayBrokerTokens pending;
+    uint32_t            pending_deadline_ms;
+    char                sent_token[GATEWAY_BROKER_TOKEN_LEN];
+    GatewayBrokerTokens sent;
+    size_t              rx_len;
+    unsigned char       rx_buf[GATEWAY_BROKER_RX_BUF_LEN];
+} GatewayBrokerSession;
+
+typedef struct {
+    void *                gateway;
+    void *                lock;  // lock of sessions and stats
+    uintptr_t             listen_fd;
+    GatewayBrokerParams   params;
+    GatewayBrokerSession *sessions[GATEWAY_BROKER_MAX_SESSIONS];
+    int                   session_num;
+    uint32_t              token_num;
+    GatewayBrokerStats    stats;
+    unsigned char         tx_buf[GATEWAY_BROKER_TX_BUF_LEN];
+} GatewayBroker;
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_GATEWAY_BROKER_H_
@@ -23,10 +23,12 @@
 #define IOT_GATEWAY_COMMON_H_
 
 #include "qcloud_iot_export.h"
+#include "utils_completion.h"
+#include "utils_request_table.h"
 
 #define GATEWAY_PAYLOAD_BUFFER_LEN        1024
 #define GATEWAY_RECEIVE_BUFFER_LEN        1024
-#define GATEWAY_LOOP_MAX_COUNT            100
+#define GATEWAY_SYNC_TIMEOUT_MS           (20 * 1000)
 #define SUBDEV_BIND_SIGN_LEN              64
 #define BIND_SIGN_KEY_SIZE                MAX_SIZE_OF_DEVICE_SECRET
 #define GATEWAY_ONLINE_OP_STR             "online"
@@ -47,16 +49,44 @@
 /* The format of gateway client id */
 #define GATEWAY_CLIENT_ID_FMT "%s/%s"
 
-/* The format of status cmd payload */
-#define GATEWAY_PAYLOAD_STATUS_FMT                                       \
-    "{\"type\":\"%s\",\"payload\":{\"devices\":[{\"product_id\":\"%s\"," \
-    "\"device_name\":\"%s\"}]}}"
+/* The format of sub-device operation payload, devices are written between prefix and suffix */
+#define GATEWAY_PAYLOAD_DEVICES_PREFIX_FMT "{\"type\":\"%s\",\"payload\":{\"devices\":["
+#define GATEWAY_PAYLOAD_DEVICES_SUFFIX     "]}}"
 
-/* The format of bind cmd payload */
-#define GATEWAY_PAYLOAD_OP_FMT                                                    \
-    "{\"type\":\"%s\",\"payload\":{\"devices\":[{\"product_id\":\"%s\","          \
-    "\"device_name\":\"%s\",\"signature\":\"%s\",\"random\":%d,\"timestamp\":%d," \
-    "\"signmethod\":\"%s\",\"authtype\":\"%s\"}]}}"
+/* The format of device in status cmd payload */
+#define GATEWAY_PAYLOAD_STATUS_DEVICE_FMT "{\"product_id\":\"%s\",\"device_name\":\"%s\"}"
+
+/* The format of device in bind cmd payload */
+#define GATEWAY_PAYLOAD_OP_DEVICE_FMT                                                                    \
+    "{\"product_id\":\"%s\",\"device_name\":\"%s\",\"signature\":\"%s\",\"random\":%d,\"timestamp\":%d," \
+    "\"signmethod\":\"%s\",\"authtype\":\"%s\"}"
+
+/* Bytes of the result reply besides product_id and device_name, for the reply head and each device,
+ * the devices of a message are limited so that the reply fits in GATEWAY_RECEIVE_BUFFER_LEN */
+#define GATEWAY_REPLY_HEAD_LEN   64
+#define GATEWAY_REPLY_DEVICE_LEN 64
+#define GATEWAY_OP_MAX_DEVICES   ((GATEWAY_RECEIVE_BUFFER_LEN - GATEWAY_REPLY_HEAD_LEN) / GATEWAY_REPLY_DEVICE_LEN)
+
+/* Result of sub-device before its reply */
+#define SUBDEV_RESULT_PENDING INT32_MIN
+
+/* Sub-devices a sync operation keeps outstanding, more are published as their results come */
+#define GATEWAY_OP_WINDOW 64
+
+/* Interval of checking the timeouts of sub-device operations while waiting */
+#define GATEWAY_OP_EXPIRE_CHECK_MS 1000
+
+/* Initial number of outstanding sub-device operations in the table */
+#define GATEWAY_OP_POOL_SIZE 16
+
+/* Initial number of session hash buckets, doubled when sessions outnumber buckets */
+#define SUBDEV_SESSION_BUCKET_NUM 16
+
+/* Levels of product_id and device_name in the topics of a route subscription, kept in its user_data */
+#define GATEWAY_ROUTE_LEVELS(product_id_level, device_name_level) \
+    ((void *)(uintptr_t)(((product_id_level) << 8) | (device_name_level)))
+#define GATEWAY_ROUTE_PRODUCT_ID_LEVEL(levels)  ((int)((levels) >> 8))
+#define GATEWAY_ROUTE_DEVICE_NAME_LEVEL(levels) ((int)((levels) & 0xFF))
 
 /* Subdevice    seesion status */
 typedef enum _SubdevSessionStatus {
@@ -78,9 +108,28 @@ typedef struct _SubdevSession {
     char                   product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
     char                   device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
     SubdevSessionStatus    session_status;
-    struct _SubdevSession *next;
+    OnGatewaySubdevMessage handler;  // handler of messages routed to sub-device
+    void *                 handler_data;
+    struct _SubdevSession *next;  // next session in hash bucket
 } SubdevSession;
 
+/* The structure of sub-device sessions hashed by product_id and device_name */
+typedef struct _SubdevSessionTable {
+    SubdevSession **buckets;
+    uint16_t        bucket_num;  // power of 2
+    uint16_t        count;
+} SubdevSessionTable;
+
+/* The structure of outstanding operation on a sub-device, its entry in ops is keyed by operation, product_id
+ * and device_name, the entry holds the operation in arg, the callback and this structure as user_context */
+typedef struct _SubdevOp {
+    char     product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char     device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    int      index;        // index of the sub-device in subdevs of the operation
+    uint32_t deadline_ms;  // HAL_GetTimeMs when the operation expires
+    void *   user_data;
+} SubdevOp;
+
 /* The structure of common reply data */
 typedef struct _ReplyData {
     int32_t result;
@@ -90,22 +139,23 @@ typedef struct _ReplyData {
 /* The structure of gateway data */
 typedef struct _GatewayData {
     int32_t   sync_status;
-    ReplyData online;
-    ReplyData offline;
-    ReplyData bind;
-    ReplyData unbind;
     ReplyData get_bindlist;
+    /* signaled on every reply and sub ack, the sync waiter checks its own result */
+    Completion sync_done;
 } GatewayData;
 
 /* The structure of gateway context */
 typedef struct _Gateway {
-    void *           mqtt;
-    SubdevSession *  session_list;
-    SubdevBindList   bind_list;
-    GatewayData      gateway_data;
-    MQTTEventHandler event_handle;
-    int              is_construct;
-    char             recv_buf[GATEWAY_RECEIVE_BUFFER_LEN];
+    void *             mqtt;
+    SubdevSessionTable sessions;
+    RequestTable       ops;   // outstanding operations on sub-devices
+    void *             lock;  // lock of sessions and ops
+    SubdevBindList     bind_list;
+    GatewayData        gateway_data;
+    MQTTEventHandler   event_handle;
+    void *             tpl;  // gateway template, NULL if none
+    int                is_construct;
+    char               recv_buf[GATEWAY_RECEIVE_BUFFER_LEN];
 #ifdef MULTITHREAD_ENABLED
     bool yield_thread_running;
     int  yield_thread_exit_code;
@@ -118,6 +168,19 @@ SubdevSession *subdev_find_session(Gateway *gateway, char *product_id, char *dev
 
 int subdev_remove_session(Gateway *gateway, char *product_id, char *device_name);
 
+void subdev_clear_sessions(Gateway *gateway);
+
+/**
+ * @brief Message handler of route subscriptions, the message is dispatched to the gateway template if its
+ * sub-device is added there, to the handler in the session of sub-device named by its topic, or to the event
+ * handler as MQTT_EVENT_PUBLISH_RECVEIVED if there is none
+ *
+ * @param client    MQTT client of gateway
+ * @param message   message received
+ * @param user_data levels of product_id and device_name, GATEWAY_ROUTE_LEVELS
+ */
+void gateway_route_message_handler(void *client, MQTTMessage *message, void *user_data);
+
 int gateway_subscribe_unsubscribe_topic(Gateway *gateway, char *topic_filter, SubscribeParams *params,
                                         int is_subscribe);
 
@@ -125,6 +188,54 @@ int gateway_subscribe_unsubscribe_default(Gateway *gateway, GatewayParam *param)
 
 int gateway_publish_sync(Gateway *gateway, char *topic, PublishParams *params, int32_t *result);
 
+/**
+ * @brief Publish the operation on sub-devices without waiting, as many as fit are sent in one message, each
+ * one is added to ops and called back with its result, those rejected before publishing are called back at once
+ *
+ * @param gateway   gateway client
+ * @param param     gateway parameters
+ * @param op        operation on sub-devices
+ * @param subdevs   sub-devices, bind signs with their secret
+ * @param count     number of sub-devices
+ * @param timeout_ms    timeout of each sub-device
+ * @param callback  result callback
+ * @param user_data user data of callback
+ * @return          QCLOUD_RET_SUCCESS, or err code of publish, the sub-devices not published are called back
+ *                  with it
+ */
+int gateway_subdev_operate_async(Gateway *gateway, GatewayParam *param, GatewaySubdevOp op, DeviceInfo *subdevs,
+                                 int count, uint32_t timeout_ms, OnGatewaySubdevResult callback, void *user_data);
+
+/**
+ * @brief Operate on sub-devices and wait for all the results, GATEWAY_OP_WINDOW sub-devices are kept
+ * outstanding at most
+ *
+ * @param gateway   gateway client
+ * @param param     gateway parameters
+ * @param op        operation on sub-devices
+ * @param subdevs   sub-devices, bind signs with their secret
+ * @param results   result of each sub-device
+ * @param count     number of sub-devices
+ * @return          QCLOUD_RET_SUCCESS if every result is 0, QCLOUD_ERR_FAILURE if some is not,
+ *                  QCLOUD_ERR_GATEWAY_SESSION_TIMEOUT if a reply didn't come, or err code of publish
+ */
+int gateway_subdev_operate_sync(Gateway *gateway, GatewayParam *param, GatewaySubdevOp op, DeviceInfo *subdevs,
+                                int32_t *results, int count);
+
+/**
+ * @brief Call back the outstanding operations on sub-devices past their timeout
+ *
+ * @param gateway   gateway client
+ */
+void gateway_subdev_expire_ops(Gateway *gateway);
+
+/**
+ * @brief Drop the outstanding operations on sub-devices without callback
+ *
+ * @param gateway   gateway client
+ */
+void gateway_subdev_clear_ops(Gateway *gateway);
+
 int subdev_bind_hmac_sha1_cal(DeviceInfo *pDevInfo, char *signout, int max_signlen, int nonce, long timestamp);
 
 #endif /* IOT_GATEWAY_COMMON_H_ */
@@ -0,0 +1,120 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_GATEWAY_OTA_H_
+#define QCLOUD_IOT_GATEWAY_OTA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef OTA_MQTT_CHANNEL
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "qcloud_iot_export.h"
+#include "utils_timer.h"
+
+#define GATEWAY_OTA_MAX_IDLE_IMAGES (2)     // images kept in the store without any device
+#define GATEWAY_OTA_PATH_LEN        (128)   // store directory and file name
+#define GATEWAY_OTA_VERSION_LEN     (32)    // same as OTA_VERSION_STR_LEN_MAX
+#define GATEWAY_OTA_BUF_LEN         (1024)  // bytes fetched or served at a time
+#define GATEWAY_OTA_SEGMENT_LEN     (128 * 1024)
+#define GATEWAY_OTA_FETCH_RETRY     (3)
+#define GATEWAY_OTA_REPORT_INTERVAL (1000)  // ms between progress reports of a device
+#define GATEWAY_OTA_REPORT_LEN      (256)
+#define GATEWAY_OTA_PART_SUFFIX     ".part"
+
+#define GATEWAY_OTA_UPDATE_TOPIC_PREFIX "$ota/update/"
+#define GATEWAY_OTA_UPDATE_FILTER       GATEWAY_OTA_UPDATE_TOPIC_PREFIX "+/+"
+
+typedef enum {
+    GATEWAY_OTA_IMAGE_FETCHING = 0,  // in the store partly or not at all
+    GATEWAY_OTA_IMAGE_READY,         // verified and opened for reading
+} GatewayOTAImageState;
+
+typedef enum {
+    GATEWAY_OTA_JOB_WAITING = 0,  // image not ready yet
+    GATEWAY_OTA_JOB_SENDING,      // transport began, sent bytes so far
+    GATEWAY_OTA_JOB_BURNING,      // all sent, waiting for IOT_Gateway_OTA_Report_Result
+} GatewayOTAJobState;
+
+/**
+ * @brief One firmware image, stored as <store_dir>/<md5> once fetched
+ *
+ * The md5 addresses the content, devices of any product or version
+ * updating to the same file share one image and one download.
+ */
+typedef struct GatewayOTAImage {
+    struct GatewayOTAImage *next;
+    char                    md5[33];
+    char *                  url;       // url of the first update, NULL when ready
+    uint32_t                size;
+    uint32_t                fetched;
+    void *                  fetch;     // download channel while fetching
+    void *                  md5_ctx;   // md5 of the fetched bytes while fetching
+    void *                  fp;        // part file while fetching, image file when ready
+    uint32_t                used_seq;  // of the last job, the least recent idle image is evicted
+    int                     job_num;
+    uint8_t                 retry;
+    uint8_t                 state;     // GatewayOTAImageState
+} GatewayOTAImage;
+
+/**
+ * @brief Update of one sub-device
+ */
+typedef struct GatewayOTAJob {
+    struct GatewayOTAJob *next;
+    GatewayOTAImage *     image;
+    char                  product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    char                  device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    char                  version[GATEWAY_OTA_VERSION_LEN + 1];
+    uint32_t              sent;
+    Timer                 report_timer;
+    int                   result;   // of the transport, when removed while served
+    int8_t                percent;  // last reported
+    uint8_t               state;    // GatewayOTAJobState
+    bool                  removed;  // removed while served, freed by the yield after the piece
+} GatewayOTAJob;
+
+/**
+ * @brief OTA distributor of a gateway
+ *
+ * Pieces are fetched and served by IOT_Gateway_OTA_Yield without the lock, so
+ * the update handler and IOT_Gateway_OTA_Report_Result don't wait for the
+ * network or the store. An image is only freed by the yield while it is
+ * fetched, and a job being served is marked removed instead of freed.
+ */
+typedef struct {
+    void *              gateway;
+    void *              lock;
+    char                store_dir[GATEWAY_OTA_PATH_LEN];
+    GatewayOTATransport transport;
+    void *              user_data;
+    GatewayOTAImage *   images;
+    GatewayOTAJob *     jobs;
+    GatewayOTAJob *     serving;  // job served without the lock
+    uint32_t            used_seq;
+    char                buf[GATEWAY_OTA_BUF_LEN];
+} GatewayOTA;
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QCLOUD_IOT_GATEWAY_OTA_H_ */
@@ -0,0 +1,98 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_GATEWAY_TEMPLATE_H_
+#define QCLOUD_IOT_GATEWAY_TEMPLATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "qcloud_iot_export.h"
+#include "utils_hash_index.h"
+#include "utils_timer.h"
+
+#define GATEWAY_TEMPLATE_MAX_PRODUCTS   (16)
+#define GATEWAY_TEMPLATE_MAX_PROPERTIES (64)
+#define GATEWAY_TEMPLATE_MAX_DEVICES    (8192)
+#define GATEWAY_TEMPLATE_MAX_STRING     (512)
+#define GATEWAY_TEMPLATE_NAME_LEN       (MAX_SIZE_OF_DEVICE_NAME + 1)
+
+#define GATEWAY_TEMPLATE_DOWN_TOPIC_PREFIX "$thing/down/property/"
+#define GATEWAY_TEMPLATE_DOWN_FILTER       GATEWAY_TEMPLATE_DOWN_TOPIC_PREFIX "+/+"
+
+/**
+ * @brief values of one property for all devices of a product, width bytes apiece
+ */
+typedef struct {
+    const char *key;
+    uint8_t *   cells;
+    uint16_t    width;  // 4 for number, max length + 1 for string
+    uint8_t     type;   // JsonDataType
+} GatewayTemplateColumn;
+
+/**
+ * @brief Devices of one product, stored by column
+ *
+ * Device i has the i-th name, the i-th cell of each column and dirty_words
+ * words of dirty bits from dirty[i * dirty_words], one bit per property.
+ * Devices are found by name through index, which is rebuilt after the
+ * storage grows or a device is removed.
+ */
+typedef struct {
+    char                   product_id[MAX_SIZE_OF_PRODUCT_ID + 1];
+    GatewayTemplateColumn *columns;
+    char *                 names;  // GATEWAY_TEMPLATE_NAME_LEN bytes apiece
+    uint32_t *             dirty;
+    void **                index_slots;
+    HashIndex              index;
+    uint16_t               index_slot_num;
+    uint16_t               device_num;
+    uint16_t               device_cap;
+    uint16_t               dirty_num;  // devices with dirty properties
+    uint8_t                prop_num;
+    uint8_t                dirty_words;
+    bool                   index_dirty;
+} GatewayTemplateProduct;
+
+typedef struct {
+    void *                   gateway;
+    void *                   lock;
+    GatewayTemplateProduct * products[GATEWAY_TEMPLATE_MAX_PRODUCTS];
+    int                      product_num;
+    Timer                    flush_timer;
+    uint32_t                 flush_interval_ms;
+    uint32_t                 token_num;
+    OnGatewayTemplateControl control;
+    void *                   user_data;
+} GatewayTemplate;
+
+/**
+ * @brief hand a message of the gateway to the template if it is a property message of a device added to it
+ *
+ * @param handle    gateway template handle
+ * @param message   message received
+ * @return false if the topic is not $thing/down/property/{product_id}/{device_name} of a template device
+ */
+bool gateway_template_handle_message(void *handle, MQTTMessage *message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_GATEWAY_TEMPLATE_H_
@@ -0,0 +1,114 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_JSON_INDEX_H_
+#define QCLOUD_IOT_JSON_INDEX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "json_parser.h"
+
+/* max length of JSON document that can be indexed */
+#define JSON_INDEX_MAX_DOC_LEN (0xFFFF)
+
+/**
+ * @brief one token of the index
+ *
+ * Object members are stored as a key token (JSSTRING) whose only child is the
+ * value token, which always directly follows the key. Strings span the content
+ * without quotes, objects and arrays span the brackets.
+ */
+typedef struct {
+    int8_t   type;    // enum JSONTYPE
+    uint16_t size;    // number of direct children
+    uint16_t start;   // offset in the document
+    uint16_t len;     // length of the token
+    int16_t  parent;  // parent token, -1 for root
+    int16_t  next;    // next sibling, -1 for the last one
+} JsonToken;
+
+typedef struct {
+    const char *json;
+    JsonToken * tokens;
+    int         count;
+} JsonIndex;
+
+/**
+ * @brief Tokenize a JSON document in one pass
+ *
+ * @param index         index to fill
+ * @param json          JSON document, not required to be '\0' terminated
+ * @param len           length of json
+ * @param tokens        token storage provided by caller, NULL to only count
+ *                      the tokens needed for the document
+ * @param max_tokens    number of tokens in storage
+ * @return              number of tokens, QCLOUD_ERR_MAX_JSON_TOKEN if storage
+ *                      is not enough, or QCLOUD_ERR_JSON_PARSE for invalid JSON
+ */
+int json_index_parse(JsonIndex *index, const char *json, size_t len, JsonToken *tokens, int max_tokens);
+
+/**
+ * @brief Find value of a key among the members of an object token
+ *
+ * @param index     parsed index
+ * @param obj       object token
+ * @param key       key to find
+ * @param key_len   length of key
+ * @return          value token, or -1 if not found
+ */
+int json_index_find(const JsonIndex *index, int obj, const char *key, int key_len);
+
+/**
+ * @brief Find value by a dotted path like "data.control" starting from a token
+ *
+ * @param index     parsed index
+ * @param from      token to start from, 0 for the root
+ * @param path      dotted path
+ * @return          value token, or -1 if not found
+ */
+int json_index_get(const JsonIndex *index, int from, const char *path);
+
+/**
+ * @brief Get first child of an object/array/key token, -1 if none
+ */
+#define json_index_first_child(index, tok) ((index)->tokens[tok].size ? (tok) + 1 : -1)
+
+/**
+ * @brief Get pointer to the text of a token
+ */
+#define json_index_str(index, tok) ((index)->json + (index)->tokens[tok].start)
+
+/**
+ * @brief iterate members of an object token
+ *
+ * @param index     parsed index
+ * @param obj       object token
+ * @param key       key token of current member
+ * @param val       value token of current member
+ */
+#define json_index_for_each_member(index, obj, key, val)                                     \
+    for (key = json_index_first_child(index, obj), val = (key) < 0 ? -1 : (key) + 1; key >= 0; \
+         key = (index)->tokens[key].next, val = (key) < 0 ? -1 : (key) + 1)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_JSON_INDEX_H_
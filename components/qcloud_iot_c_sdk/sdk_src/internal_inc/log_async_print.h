@@ -0,0 +1,56 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_LOG_ASYNC_PRINT_H_
+#define QCLOUD_IOT_LOG_ASYNC_PRINT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "qcloud_iot_export_log.h"
+
+/**
+ * @brief create the print queue and start the print task
+ *
+ * @param params queue and task parameters, NULL for default
+ * @return QCLOUD_RET_SUCCESS when success
+ */
+int init_log_async_print(LogAsyncPrintParams *params);
+
+/**
+ * @brief print the queued logs, stop the print task and free the queue
+ */
+void fini_log_async_print(void);
+
+/**
+ * @brief queue one formatted log for the print task, never blocks
+ *
+ * @param log   formatted log ending with "\r\n"
+ * @param len   length of log
+ * @param level level of log
+ * @return true if the log is taken by the print task or dropped by overflow
+ *         behaviour, false if it should be printed on the calling thread
+ */
+bool log_async_print(const char *log, size_t len, int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_LOG_ASYNC_PRINT_H_
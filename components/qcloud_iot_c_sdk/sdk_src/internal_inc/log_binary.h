@@ -0,0 +1,66 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_LOG_BINARY_H_
+#define QCLOUD_IOT_LOG_BINARY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/*
+ * Binary log record, all integers are LEB128 varints, signed ones zigzag encoded:
+ *
+ *   version(1 byte) flags(1 byte) level time_sec file func line fmt args...
+ *
+ * file, func and fmt are addresses of the strings in firmware, resolved by
+ * tools/log_decoder.py with the ELF file. Arguments follow the conversions of
+ * fmt: integers and pointers as varints, doubles as 8 raw bytes, strings as
+ * length and bytes. The record is uploaded as one base64 text line after
+ * LOG_BINARY_PREFIX, so it fits the text log format of the server.
+ */
+#define LOG_BINARY_VERSION         (1)
+#define LOG_BINARY_FLAG_TRUNCATED  (0x01)  // arguments did not fit, the rest are missing
+#define LOG_BINARY_PREFIX          "B|"
+#define LOG_BINARY_MAX_RECORD_SIZE (192)
+
+/* base64 of a full record, with prefix and "\r\n" */
+#define LOG_BINARY_MAX_LINE_LEN \
+    (sizeof(LOG_BINARY_PREFIX) - 1 + (LOG_BINARY_MAX_RECORD_SIZE + 2) / 3 * 4 + sizeof("\r\n"))
+
+/**
+ * @brief Encode one log call as a binary record line, no formatting is done
+ *
+ * @param buf       buffer of the line, LOG_BINARY_MAX_LINE_LEN bytes at least
+ * @param buf_len   size of buf
+ * @param file      file name of the log call
+ * @param func      function name of the log call
+ * @param line      line number of the log call
+ * @param level     log level
+ * @param fmt       format string
+ * @param ap        arguments of fmt
+ * @return          length of the line ending with "\r\n", or 0 if failed
+ */
+int log_binary_encode(char *buf, size_t buf_len, const char *file, const char *func, int line, int level,
+                      const char *fmt, va_list ap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_LOG_BINARY_H_
@@ -0,0 +1,140 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_LOG_RING_H_
+#define QCLOUD_IOT_LOG_RING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* every log record ends with this delimiter */
+#define LOG_DELIMITER     "\n\f"
+#define LOG_DELIMITER_LEN (2)
+
+/**
+ * @brief Multi-producer single-consumer byte ring of log records
+ *
+ * Producers never block: a record is reserved with one CAS, filled in place and
+ * committed. Committed bytes become visible to the consumer once every record
+ * reserved before them is committed too, so the consumer always sees whole
+ * records in order. A record never wraps, the tail of the ring is padded
+ * instead, and the consumer gets committed bytes as contiguous spans it can
+ * post in place.
+ *
+ * Positions run over many laps of data, so that a full ring differs from an
+ * empty one and a stale position is told from a new one. headroom bytes behind
+ * the read position are never handed to producers, together with the same
+ * amount of memory in front of data this lets the consumer prepend a header to
+ * any span without copying it.
+ */
+typedef struct {
+    char *            data;
+    uint32_t          size;
+    uint32_t          pos_range;        // positions wrap at this multiple of size
+    uint32_t          headroom;
+    bool              overwrite;        // drop the oldest records instead of the new one when full
+    volatile uint32_t reserve;          // (position << 8) | number of producers writing
+    volatile uint32_t commit;           // end of committed records
+    volatile uint32_t read;             // (position << 1) | claimed by consumer
+    volatile uint32_t wrap;             // position of the padding before the last wrap
+    volatile uint32_t dropped_count;    // records dropped, never reset
+    volatile uint32_t dropped_bytes;    // bytes dropped, never reset
+} LogRing;
+
+/**
+ * @brief Init ring on a buffer
+ *
+ * @param ring      ring to init
+ * @param buf       buffer, the first headroom bytes are reserved for the consumer
+ * @param buf_size  size of buf
+ * @param headroom  bytes the consumer may write in front of a claimed span
+ * @param overwrite drop the oldest records when full
+ * @return          QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int log_ring_init(LogRing *ring, char *buf, size_t buf_size, size_t headroom, bool overwrite);
+
+/**
+ * @brief Reserve space of one record, safe to call from any thread
+ *
+ * @param ring  log ring
+ * @param len   size of the record
+ * @return      space to fill before log_ring_commit, or NULL if ring is full
+ *              and the record is dropped
+ */
+char *log_ring_reserve(LogRing *ring, size_t len);
+
+/**
+ * @brief Commit the record reserved by the calling thread
+ */
+void log_ring_commit(LogRing *ring);
+
+/**
+ * @brief Claim the oldest contiguous span of committed records, consumer only
+ *
+ * @param ring  log ring
+ * @param span  start of the span
+ * @param len   length of the span, 0 if there is nothing to read
+ * @return      QCLOUD_RET_SUCCESS for success, QCLOUD_ERR_FAILURE if a span is
+ *              already claimed
+ */
+int log_ring_claim(LogRing *ring, char **span, size_t *len);
+
+/**
+ * @brief Free the first len bytes of the claimed span and end the claim
+ */
+void log_ring_release(LogRing *ring, size_t len);
+
+/**
+ * @brief Free the first len bytes of the claimed span and claim the span behind them
+ *
+ * The claim is never dropped in between, so a consumer waiting for records to
+ * be acknowledged can hold them safe from the overwrite policy while it sees
+ * the records committed meanwhile.
+ *
+ * @param ring      log ring
+ * @param len       bytes to free, at most the length of the claimed span
+ * @param span      start of the new span
+ * @param span_len  length of the new span, 0 if there is nothing to read
+ */
+void log_ring_reclaim(LogRing *ring, size_t len, char **span, size_t *span_len);
+
+/**
+ * @brief Drop all the committed records, consumer only
+ */
+void log_ring_discard(LogRing *ring);
+
+/**
+ * @brief Bytes left for new records
+ */
+size_t log_ring_free(LogRing *ring);
+
+/**
+ * @brief Number of records dropped since init
+ *
+ * @param ring          log ring
+ * @param dropped_bytes bytes dropped since init, may be NULL
+ */
+uint32_t log_ring_dropped(LogRing *ring, uint32_t *dropped_bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_LOG_RING_H_
@@ -0,0 +1,115 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_LOG_STORE_H_
+#define QCLOUD_IOT_LOG_STORE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "qcloud_iot_export_log.h"
+
+#define LOG_STORE_MAX_SEGMENTS (16)
+
+/**
+ * @brief Append-only store of log records in fixed-size segments
+ *
+ * Segment layout:
+ *
+ *   magic(4) seq(4) acked(4) drain_map(32) | len(2) crc(2) data... | len(2) crc(2) data... | erased
+ *
+ * A segment is live while its magic is valid and acked is still erased, seq
+ * orders the live segments. Bit i of drain_map stands for the i-th 1/256 of the
+ * segment, and its leading bits are cleared as records are committed, so the
+ * records starting in the cleared part are not drained again after a reboot.
+ * Only the records in the unit of the last commit may be posted twice. Record data is programmed before its len and crc,
+ * so a record torn by power loss fails the crc and ends the segment, which is
+ * then sealed. A drained segment is deleted by programming acked to zero,
+ * which needs no erase. Segments are erased only when they are reused, the
+ * oldest live one is dropped when no free one is left.
+ */
+typedef struct {
+    LogStoreOps ops;
+    uint32_t    segment_size;
+    uint32_t    segment_num;
+    uint32_t    max_record;                   // max data size of one record
+    uint32_t    seq[LOG_STORE_MAX_SEGMENTS];  // seq of live segments, LOG_STORE_SEQ_NONE for free ones
+    uint32_t    next_seq;
+    int         write_seg;                    // segment appended to, -1 when a new one is to be opened
+    uint32_t    write_off;
+    int         read_seg;                     // segment being drained, -1 when not started
+    uint32_t    read_off;                     // records before this are committed
+    uint32_t    drain_unit;                   // bytes of the segment a bit of drain_map stands for
+    uint32_t    drain_mark;                   // leading bits of drain_map of read_seg cleared
+    uint32_t    pending_off;                  // end of records read but not committed yet
+    bool        pending_end;                  // the read reached the end of read_seg
+    uint32_t    dropped_segments;             // live segments dropped for lack of room
+} LogStore;
+
+/**
+ * @brief Open the store, recovering the segments left by a previous run
+ *
+ * @param store         store to open
+ * @param ops           storage, copied into store
+ * @param segment_size  size of a segment, multiple of ops->sector_size
+ * @param max_record    max data size of one record
+ * @return              QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int log_store_open(LogStore *store, const LogStoreOps *ops, uint32_t segment_size, uint32_t max_record);
+
+/**
+ * @brief Append logs, packed into records of whole logs ending with "\n\f"
+ *
+ * @return  bytes of logs stored, logs longer than max_record are skipped, or
+ *          err code for storage failure
+ */
+int log_store_append(LogStore *store, const char *logs, size_t len);
+
+/**
+ * @brief Read the oldest records not read yet, all from the same segment
+ *
+ * @param store     log store
+ * @param buf       buffer for the records
+ * @param buf_len   size of buf, max_record at least
+ * @param read_len  size of the records read, 0 when the store is drained
+ * @return          QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int log_store_read(LogStore *store, char *buf, size_t buf_len, size_t *read_len);
+
+/**
+ * @brief Commit the records read so far, a segment is deleted when all its records are committed
+ */
+int log_store_commit(LogStore *store);
+
+/**
+ * @brief Forget the records read but not committed, they are read again
+ */
+void log_store_rewind(LogStore *store);
+
+/**
+ * @brief Whether there is any record to drain
+ */
+bool log_store_empty(LogStore *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_LOG_STORE_H_
@@ -78,6 +78,14 @@ int do_log_upload(bool force_upload);
  */
 void set_log_mqtt_client(void *client);
 
+/**
+ * @brief free the logs of an acked message published by log upload over MQTT
+ *
+ * @param client    MQTT client the PUBACK comes from
+ * @param packet_id packet id of the PUBACK
+ */
+void log_mqtt_upload_on_puback(void *client, uint16_t packet_id);
+
 /**
  * @brief set if only do log upload when communication error with IoT Hub
  *
@@ -328,6 +328,33 @@ int qcloud_iot_mqtt_disconnect(Qcloud_IoT_Client *pClient);
  */
 int qcloud_iot_mqtt_publish(Qcloud_IoT_Client *pClient, char *topicName, PublishParams *pParams);
 
+/**
+ * @brief Callback to write MQTT payload
+ *
+ * @param buf           buffer for payload
+ * @param buf_len       size of buf
+ * @param ctx           user context
+ *
+ * @return length of payload (>=0) when success, or err code (<0) for failure
+ */
+typedef int (*MQTTPayloadWriter)(unsigned char *buf, size_t buf_len, void *ctx);
+
+/**
+ * @brief Publish MQTT message with payload written directly into the send buffer,
+ * the fixed header is patched after the payload length is known.
+ * pParams->payload and pParams->payload_len are ignored.
+ *
+ * @param pClient       handle to MQTT client
+ * @param topicName     MQTT topic name
+ * @param pParams       publish parameters
+ * @param writer        callback to write payload
+ * @param ctx           context of writer
+ *
+ * @return packet id (>=0) when success, or err code (<0) for failure
+ */
+int qcloud_iot_mqtt_publish_by_writer(Qcloud_IoT_Client *pClient, char *topicName, PublishParams *pParams,
+                                      MQTTPayloadWriter writer, void *ctx);
+
 /**
  * @brief Subscribe MQTT topic
  *
@@ -526,6 +553,10 @@ int serialize_pub_ack_packet(unsigned char *buf, size_t buf_len, MessageTypes pa
 int serialize_packet_with_zero_payload(unsigned char *buf, size_t buf_len, MessageTypes packetType,
                                        uint32_t *serialized_len);
 
+int serialize_publish_packet(unsigned char *buf, size_t buf_len, uint8_t dup, QoS qos, uint8_t retained,
+                             uint16_t packet_id, char *topicName, unsigned char *payload, size_t payload_len,
+                             uint32_t *serialized_len);
+
 int deserialize_publish_packet(unsigned char *dup, QoS *qos, uint8_t *retained, uint16_t *packet_id, char **topicName,
                                uint16_t *topicNameLen, unsigned char **payload, size_t *payload_len, unsigned char *buf,
                                size_t buf_len);
@@ -537,6 +568,15 @@ int deserialize_unsuback_packet(uint16_t *packet_id, unsigned char *buf, size_t
 
 int deserialize_ack_packet(uint8_t *packet_type, uint8_t *dup, uint16_t *packet_id, unsigned char *buf, size_t buf_len);
 
+#ifdef SYSTEM_COMM
+/**
+ * @brief Sync time with IoT Hub when it is due, never waits for the reply
+ *
+ * @param pClient MQTT client
+ */
+void qcloud_iot_sys_time_sync(void *pClient);
+#endif
+
 #ifdef MQTT_RMDUP_MSG_ENABLED
 
 void reset_repeat_packet_id_buffer(Qcloud_IoT_Client *pClient);
@@ -559,6 +599,16 @@ void mqtt_write_uint_16(unsigned char **pptr, uint16_t anInt);
 
 void mqtt_write_utf8_string(unsigned char **pptr, const char *string);
 
+/**
+ * @brief Check if a topic name matches a topic filter with wildcards
+ *
+ * @param topic_filter  topic filter, '+' and '#' are supported
+ * @param topicName     topic name, not required to be '\0' terminated
+ * @param topicNameLen  length of topic name
+ * @return              1 if matched, 0 otherwise
+ */
+uint8_t mqtt_is_topic_matched(char *topic_filter, char *topicName, uint16_t topicNameLen);
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,7 +37,7 @@ void qcloud_otalib_md5_finalize(void *md5, char *output_str);
 
 void qcloud_otalib_md5_deinit(void *md5);
 
-int qcloud_otalib_get_firmware_type(const char *json, char **type);
+int qcloud_otalib_get_firmware_type(const char *json, char *type, size_t type_len);
 
 int qcloud_otalib_get_report_version_result(const char *json);
 
@@ -45,14 +45,13 @@ int qcloud_otalib_get_report_version_result(const char *json);
  * @brief Parse firmware info from JSON string
  *
  * @param json          source JSON string
- * @param type          parsed type
  * @param url           parsed url
  * @param version       parsed version
  * @param md5           parsed MD5
  * @param fileSize      parsed file size
  * @return              QCLOUD_RET_SUCCESS for success, or err code for failure
  */
-int qcloud_otalib_get_params(const char *json, char **type, char **url, char **version, char *md5, uint32_t *fileSize);
+int qcloud_otalib_get_params(const char *json, char **url, char **version, char *md5, uint32_t *fileSize);
 
 /**
  * @brief Generate firmware info from id and version
@@ -0,0 +1,92 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_UTILS_COMPLETION_H_
+#define QCLOUD_IOT_UTILS_COMPLETION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Completion of a request a sync API waits for
+ *
+ * The reply handler signals it. If a yield thread of the MQTT client reads the
+ * replies, the waiter blocks on a semaphore, otherwise it drives the yield of
+ * the client itself in short slices. Either way the wait ends right after the
+ * reply is handled instead of on a polling period.
+ *
+ * A completion can be rearmed and waited on again, a waiter woken by a reply
+ * that is not the one it waits for checks its own condition and waits again.
+ */
+typedef struct {
+    volatile bool done;
+    void *        sem;  // posted by signal, NULL without MULTITHREAD_ENABLED
+} Completion;
+
+/**
+ * @brief Drive the client to handle replies, IOT_MQTT_Yield and the like
+ */
+typedef int (*CompletionYieldFunc)(void *client, uint32_t timeout_ms);
+
+/**
+ * @brief Init completion, not signaled
+ *
+ * @param completion    completion to init
+ */
+void utils_completion_init(Completion *completion);
+
+/**
+ * @brief Release completion
+ *
+ * @param completion    completion to release
+ */
+void utils_completion_deinit(Completion *completion);
+
+/**
+ * @brief Rearm completion before the next request, a zeroed completion may be rearmed without init
+ *
+ * @param completion    completion to rearm
+ */
+void utils_completion_reset(Completion *completion);
+
+/**
+ * @brief Signal completion, called by the reply handler from any thread
+ *
+ * @param completion    completion to signal
+ */
+void utils_completion_signal(Completion *completion);
+
+/**
+ * @brief Wait for completion to be signaled
+ *
+ * @param completion    completion to wait for
+ * @param mqtt_client   MQTT client the reply comes from, tells if a yield thread reads it
+ * @param timeout_ms    wait timeout (unit: ms)
+ * @param yield         drives client when no yield thread is running
+ * @param client        argument of yield
+ * @return              QCLOUD_RET_SUCCESS if signaled, QCLOUD_ERR_MQTT_REQUEST_TIMEOUT otherwise
+ */
+int utils_completion_wait(Completion *completion, void *mqtt_client, uint32_t timeout_ms, CompletionYieldFunc yield,
+                          void *client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QCLOUD_IOT_UTILS_COMPLETION_H_ */
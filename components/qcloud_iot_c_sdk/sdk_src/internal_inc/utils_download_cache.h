@@ -0,0 +1,108 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_UTILS_DOWNLOAD_CACHE_H_
+#define QCLOUD_IOT_UTILS_DOWNLOAD_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "utils_flash_writer.h"
+
+#define DOWNLOAD_CACHE_MAX_ENTRIES 16
+#define DOWNLOAD_CACHE_PATH_LEN    128
+#define DOWNLOAD_CACHE_MD5_LEN     33
+#define DOWNLOAD_CACHE_BUF_LEN     512
+#define DOWNLOAD_CACHE_PAGE_LEN    256  // fetched bytes are appended to the cache file in whole pages
+#define DOWNLOAD_CACHE_PART_SUFFIX ".part"
+#define DOWNLOAD_CACHE_INDEX_NAME  "index"
+
+/**
+ * @brief Cache side of one download, embedded in the download handle.
+ *
+ * A zeroed session is idle, so the handles need no init for it. Bytes below
+ * cached_end are read from the cache file, the rest come from the network and
+ * are appended to the entry while filling (md5 != NULL), through writer once
+ * the cached bytes are all read.
+ */
+typedef struct {
+    void *      entry;       // entry used by the session, NULL when idle
+    void *      fp;          // cache file being read or appended
+    void *      md5;         // hash of the entry from offset 0 while filling
+    uint32_t    pos;         // offset of the next byte handed to the client
+    uint32_t    cached_end;  // bytes below this offset are read from the cache
+    uint32_t    stored;      // bytes handed to the cache file, buffered ones included
+    uint32_t    size;        // size of the file
+    FlashWriter writer;      // coalesces fetched bytes into pages, writer.buf is NULL until appending
+} DownloadCacheSession;
+
+/**
+ * @brief Begin a download of the file from offset, ending the former one of the session
+ *
+ * @param session   cache session of the download
+ * @param md5sum    MD5 string of the file
+ * @param size      size of the file
+ * @param offset    offset the client downloads from
+ * @return          offset the network download has to start from, size if the
+ *                  rest of the file is served from the cache
+ */
+uint32_t qcloud_download_cache_begin(DownloadCacheSession *session, const char *md5sum, uint32_t size,
+                                     uint32_t offset);
+
+/**
+ * @brief Read the next bytes of the download from the cache
+ *
+ * @param session   cache session of the download
+ * @param buf       buffer to read into
+ * @param buf_len   size of buf
+ * @return          bytes read, 0 when the next bytes come from the network,
+ *                  or err code when the cache file failed (the entry is dropped)
+ */
+int qcloud_download_cache_read(DownloadCacheSession *session, char *buf, uint32_t buf_len);
+
+/**
+ * @brief Hand bytes fetched from the network to the cache
+ *
+ * The bytes are appended to the entry while filling, the entry is verified and
+ * committed once the whole file is in.
+ *
+ * @param session   cache session of the download
+ * @param buf       bytes fetched
+ * @param len       number of bytes
+ */
+void qcloud_download_cache_write(DownloadCacheSession *session, const char *buf, uint32_t len);
+
+/**
+ * @brief End the download, a partly filled entry is kept to be resumed
+ *
+ * @param session   cache session of the download
+ */
+void qcloud_download_cache_end(DownloadCacheSession *session);
+
+/**
+ * @brief Drop the entry of the file, e.g. when the client rejected its MD5
+ *
+ * @param md5sum    MD5 string of the file
+ */
+void qcloud_download_cache_remove(const char *md5sum);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QCLOUD_IOT_UTILS_DOWNLOAD_CACHE_H_ */
@@ -0,0 +1,98 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_UTILS_FLASH_SIM_H_
+#define QCLOUD_IOT_UTILS_FLASH_SIM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "utils_flash_writer.h"
+
+/*
+ * NOR flash emulator on top of HAL_File*, for measuring the flash writer on Linux.
+ * Erase sets a sector to 0xFF, program can only clear bits, and every operation
+ * adds its modeled duration to busy_us.
+ */
+
+typedef struct {
+    uint32_t erase_sector_us;  // time to erase one sector
+    uint32_t program_page_us;  // time to program one (partial) page
+    bool     realtime;         // also sleep for the modeled time
+} FlashSimTiming;
+
+typedef struct {
+    uint32_t erase_cnt;           // sectors erased
+    uint32_t max_sector_erase;    // highest erase count of a single sector
+    uint32_t program_cnt;         // pages programmed, partial pages included
+    uint32_t bytes_programmed;    // bytes programmed
+    uint32_t program_violations;  // programs trying to set bits of non-erased cells
+    uint64_t busy_us;             // modeled flash busy time
+} FlashSimStats;
+
+/**
+ * @brief Open (create when not exist) a file backed flash emulator
+ *
+ * @param file_name     backing file
+ * @param size          flash size, multiple of sector_size
+ * @param sector_size   erase unit
+ * @param page_size     program unit
+ * @param timing        timing model, NULL for zero cost
+ * @return              emulator handle, or NULL for failure
+ */
+void *utils_flash_sim_open(const char *file_name, uint32_t size, uint32_t sector_size, uint32_t page_size,
+                           const FlashSimTiming *timing);
+
+/**
+ * @brief Close emulator, the backing file is kept
+ */
+void utils_flash_sim_close(void *sim);
+
+/**
+ * @brief Get flash writer operations bound to the emulator
+ */
+void utils_flash_sim_get_ops(void *sim, FlashWriterOps *ops);
+
+/**
+ * @brief Read back flash content
+ *
+ * @return QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int utils_flash_sim_read(void *sim, uint32_t offset, void *buf, uint32_t len);
+
+/**
+ * @brief Get accumulated statistics
+ */
+void utils_flash_sim_get_stats(void *sim, FlashSimStats *stats);
+
+/**
+ * @brief Get erase count of one sector
+ */
+uint32_t utils_flash_sim_sector_erase_cnt(void *sim, uint32_t sector_idx);
+
+/**
+ * @brief Clear statistics and per-sector erase counters
+ */
+void utils_flash_sim_reset_stats(void *sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_UTILS_FLASH_SIM_H_
@@ -0,0 +1,113 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_UTILS_FLASH_WRITER_H_
+#define QCLOUD_IOT_UTILS_FLASH_WRITER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief Storage operations used by the flash writer.
+ *
+ * All addresses are offsets inside the region handed to utils_flash_writer_init.
+ * erase is NULL for media without explicit erase (e.g. HAL_File* backends),
+ * the writer then only coalesces data into page aligned blocks.
+ */
+typedef struct {
+    int (*erase)(void *usr_data, uint32_t offset, uint32_t len);
+    int (*program)(void *usr_data, uint32_t offset, const void *data, uint32_t len);
+    void *   usr_data;
+    uint32_t sector_size;  // erase unit, must be multiple of page_size
+    uint32_t page_size;    // program unit
+} FlashWriterOps;
+
+typedef struct {
+    uint32_t bytes_in;          // bytes handed to utils_flash_writer_write
+    uint32_t bytes_programmed;  // bytes passed to ops.program
+    uint32_t program_cnt;       // number of ops.program calls
+    uint32_t erase_cnt;         // number of sectors erased
+    uint32_t erase_ahead_cnt;   // sectors erased out of the write path
+} FlashWriterStats;
+
+typedef struct {
+    FlashWriterOps   ops;
+    uint32_t         region_size;  // size of the writable region
+    uint32_t         write_pos;    // offset of the next byte to program
+    uint32_t         erased_end;   // sectors below this offset are erased
+    uint32_t         erase_ahead;  // sectors kept erased in front of write_pos
+    uint8_t *        buf;          // coalescing buffer, multiple of page_size
+    uint32_t         buf_size;
+    uint32_t         buf_len;
+    FlashWriterStats stats;
+} FlashWriter;
+
+/**
+ * @brief Init flash writer
+ *
+ * @param writer        flash writer to init
+ * @param ops           storage operations, copied into writer
+ * @param start         offset to resume writing from (0 for a new image),
+ *                      the sector holding it is assumed erased already
+ * @param region_size   size of the region, erase never goes beyond it
+ * @param buf           coalescing buffer provided by caller
+ * @param buf_size      size of buf, rounded down to a multiple of page_size
+ * @param erase_ahead   number of sectors to keep erased ahead of the cursor
+ * @return              QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int utils_flash_writer_init(FlashWriter *writer, const FlashWriterOps *ops, uint32_t start, uint32_t region_size,
+                            void *buf, uint32_t buf_size, uint32_t erase_ahead);
+
+/**
+ * @brief Append data, programming only full aligned blocks
+ *
+ * @param writer    flash writer
+ * @param data      source data
+ * @param len       length of data
+ * @return          QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int utils_flash_writer_write(FlashWriter *writer, const void *data, uint32_t len);
+
+/**
+ * @brief Erase sectors in front of the write cursor out of the write path.
+ *        Call it when the caller is idle, e.g. while waiting for network data.
+ *
+ * @param writer        flash writer
+ * @param max_sectors   max number of sectors to erase in this call
+ * @return              number of sectors erased, or err code for failure
+ */
+int utils_flash_writer_erase_ahead(FlashWriter *writer, uint32_t max_sectors);
+
+/**
+ * @brief Program buffered data, including a trailing partial page
+ *
+ * @param writer    flash writer
+ * @return          QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int utils_flash_writer_flush(FlashWriter *writer);
+
+/**
+ * @brief Get total bytes accepted, including the ones still buffered
+ */
+uint32_t utils_flash_writer_tell(FlashWriter *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_UTILS_FLASH_WRITER_H_
@@ -0,0 +1,80 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_UTILS_HASH_INDEX_H_
+#define QCLOUD_IOT_UTILS_HASH_INDEX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief get the '\0' terminated key of an element
+ */
+typedef const char *(*HashIndexGetKey)(void *val);
+
+/**
+ * @brief open addressing index of elements keyed by string
+ *
+ * The index only holds pointers to elements owned by caller. It is built once
+ * when the element set changes and looked up many times, so there is no
+ * removal: rebuild the index instead.
+ */
+typedef struct {
+    void **         slots;
+    uint16_t        mask;   // number of slots - 1
+    uint16_t        count;  // number of elements
+    HashIndexGetKey get_key;
+} HashIndex;
+
+/**
+ * @brief Number of slots needed to index count elements, load factor is kept
+ * under 1/2
+ */
+uint16_t hash_index_slot_num(int count);
+
+/**
+ * @brief Init an empty index on slot storage provided by caller
+ *
+ * @param index     index to init
+ * @param slots     slot storage, its size must come from hash_index_slot_num
+ * @param slot_num  number of slots
+ * @param get_key   callback to get key of an element
+ */
+void hash_index_init(HashIndex *index, void **slots, uint16_t slot_num, HashIndexGetKey get_key);
+
+/**
+ * @brief Add an element
+ *
+ * @return QCLOUD_RET_SUCCESS for success, QCLOUD_ERR_INVAL if the key exists
+ *         or QCLOUD_ERR_FAILURE if the index is full
+ */
+int hash_index_add(HashIndex *index, void *val);
+
+/**
+ * @brief Find an element by key, key is not required to be '\0' terminated
+ *
+ * @return element, or NULL if not found
+ */
+void *hash_index_find(const HashIndex *index, const char *key, size_t key_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_UTILS_HASH_INDEX_H_
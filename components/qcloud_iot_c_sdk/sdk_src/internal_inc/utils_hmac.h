@@ -23,10 +23,40 @@
 
 #include <string.h>
 
+#include "utils_sha1.h"
+
+#define HMAC_KEY_IOPAD_SIZE 64
+
+/* context of HMAC-SHA1 computed over data given piece by piece */
+typedef struct {
+    iot_sha1_context sha1;
+    unsigned char    k_opad[HMAC_KEY_IOPAD_SIZE];
+} iot_hmac_sha1_context;
+
 void utils_hmac_md5(const char *msg, int msg_len, char *digest, const char *key, int key_len);
 
 void utils_hmac_sha1(const char *msg, int msg_len, char *digest, const char *key, int key_len);
 
+/**
+ * @brief Start an incremental HMAC-SHA1
+ *
+ * @param ctx     context to start
+ * @param key     key, HMAC_KEY_IOPAD_SIZE bytes at most
+ * @param key_len length of key
+ * @return        0 for success, -1 if key is invalid
+ */
+int utils_hmac_sha1_starts(iot_hmac_sha1_context *ctx, const char *key, int key_len);
+
+/**
+ * @brief Feed the next piece of message
+ */
+void utils_hmac_sha1_update(iot_hmac_sha1_context *ctx, const char *msg, int msg_len);
+
+/**
+ * @brief Finish the HMAC-SHA1, the digest is written as 40 hex chars without terminator
+ */
+void utils_hmac_sha1_finish(iot_hmac_sha1_context *ctx, char *digest);
+
 int utils_hmac_sha1_hex(const char *msg, int msg_len, char *digest, const char *key, int key_len);
 
 #endif
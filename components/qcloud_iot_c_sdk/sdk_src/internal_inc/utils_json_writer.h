@@ -0,0 +1,125 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_UTILS_JSON_WRITER_H_
+#define QCLOUD_IOT_UTILS_JSON_WRITER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* max nesting level of objects and arrays */
+#define JSON_WRITER_MAX_DEPTH (32)
+
+/**
+ * @brief JSON writer appending to a fixed buffer at an explicit cursor
+ *
+ * Separators between members are inserted by the writer. Errors are sticky:
+ * once the buffer runs out every further call is a no-op, so a document can be
+ * written without checking each call and only the result of json_writer_finish
+ * needs to be checked.
+ */
+typedef struct {
+    char *   buf;
+    size_t   size;
+    size_t   pos;
+    int      err;
+    uint8_t  depth;
+    bool     after_key;
+    uint32_t need_comma;  // one bit per nesting level
+} JsonWriter;
+
+/**
+ * @brief Init writer on a buffer
+ *
+ * @param writer    JSON writer
+ * @param buf       buffer to write into
+ * @param size      size of buf, including space for the terminating '\0'
+ */
+void json_writer_init(JsonWriter *writer, char *buf, size_t size);
+
+void json_writer_object_begin(JsonWriter *writer);
+
+void json_writer_object_end(JsonWriter *writer);
+
+void json_writer_array_begin(JsonWriter *writer);
+
+void json_writer_array_end(JsonWriter *writer);
+
+/**
+ * @brief Write key of an object member, the value is written by the next call
+ */
+void json_writer_key(JsonWriter *writer, const char *key);
+
+/**
+ * @brief Write a '\0' terminated string value with escaping
+ */
+void json_writer_string(JsonWriter *writer, const char *str);
+
+/**
+ * @brief Write a string value of len bytes with escaping
+ */
+void json_writer_string_len(JsonWriter *writer, const char *str, size_t len);
+
+void json_writer_int(JsonWriter *writer, int32_t value);
+
+void json_writer_uint(JsonWriter *writer, uint32_t value);
+
+/**
+ * @brief Write a number with 6 decimals like "%f", NaN and infinity are written as null
+ */
+void json_writer_double(JsonWriter *writer, double value);
+
+void json_writer_bool(JsonWriter *writer, bool value);
+
+void json_writer_null(JsonWriter *writer);
+
+/**
+ * @brief Write a preformatted JSON value as is
+ */
+void json_writer_raw_value(JsonWriter *writer, const char *raw, size_t len);
+
+/**
+ * @brief Merge members of a preformatted JSON object into the current object
+ *
+ * @param writer    JSON writer, an object must be open
+ * @param obj       JSON object text including braces
+ * @param len       length of obj
+ */
+void json_writer_raw_members(JsonWriter *writer, const char *obj, size_t len);
+
+/**
+ * @brief Append bytes as is, without any separator
+ */
+void json_writer_raw(JsonWriter *writer, const char *raw, size_t len);
+
+/**
+ * @brief Terminate the document with '\0'
+ *
+ * @param writer    JSON writer
+ * @return          length of the document excluding '\0', or err code
+ *                  (QCLOUD_ERR_JSON_BUFFER_TOO_SMALL if the buffer ran out)
+ */
+int json_writer_finish(JsonWriter *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_UTILS_JSON_WRITER_H_
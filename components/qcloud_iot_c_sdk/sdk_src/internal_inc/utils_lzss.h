@@ -0,0 +1,100 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_UTILS_LZSS_H_
+#define QCLOUD_IOT_UTILS_LZSS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * LZSS stream, decoded by tools/log_upload_server.py:
+ *
+ * Items come in groups of eight after one flag byte, bit i (LSB first) of the
+ * flag tells item i is a match. A literal is one byte. A match is two bytes,
+ * big endian ((distance - 1) << LZSS_LENGTH_BITS) | (length - LZSS_MIN_MATCH),
+ * copying length bytes from distance bytes back in the output. The last group
+ * may have less than eight items.
+ */
+#define LZSS_WINDOW_BITS (10)
+#define LZSS_LENGTH_BITS (6)
+#define LZSS_WINDOW_SIZE (1 << LZSS_WINDOW_BITS)
+#define LZSS_MIN_MATCH   (3)
+#define LZSS_MAX_MATCH   (LZSS_MIN_MATCH + (1 << LZSS_LENGTH_BITS) - 1)
+#define LZSS_HASH_BITS   (8)
+#define LZSS_MAX_INPUT   (0xFFFF)
+
+/* called with each finished piece of output, e.g. to hash it on the fly */
+typedef void (*LzssOutputCb)(void *user_data, const uint8_t *data, size_t len);
+
+/**
+ * @brief Encoder over input in memory, the window is the input itself so no
+ * copy of it is kept, only the hash chains
+ */
+typedef struct {
+    const uint8_t *in;
+    size_t         in_pos;  // input compressed so far
+    uint8_t *      out;
+    size_t         out_size;
+    size_t         out_len;
+    size_t         out_done;  // output passed to on_output
+    size_t         flag_pos;  // flag byte of the open group
+    uint8_t        flag_items;
+    uint16_t       head[1 << LZSS_HASH_BITS];  // last input pos + 1 of each hash
+    uint16_t       prev[LZSS_WINDOW_SIZE];     // former pos + 1 of the same hash
+    LzssOutputCb   on_output;
+    void *         user_data;
+} LzssEncoder;
+
+/* output size of len more input bytes in the worst case */
+#define LZSS_BOUND(len) ((len) + ((len) + 7) / 8 + 1)
+
+/**
+ * @brief Init encoder
+ *
+ * @param enc       encoder
+ * @param in        input, LZSS_MAX_INPUT bytes at most are compressed
+ * @param out       output buffer
+ * @param out_size  size of out
+ * @param on_output callback of finished output, may be NULL
+ * @param user_data user data of on_output
+ */
+void utils_lzss_init(LzssEncoder *enc, const uint8_t *in, uint8_t *out, size_t out_size, LzssOutputCb on_output,
+                     void *user_data);
+
+/**
+ * @brief Compress the next len bytes of input, matches never reach beyond them
+ *
+ * @return 0 for success, -1 if LZSS_BOUND(len) does not fit in what is left of
+ *         out or the input is too long, nothing is compressed then
+ */
+int utils_lzss_compress(LzssEncoder *enc, size_t len);
+
+/**
+ * @brief Finish the stream
+ *
+ * @return size of output
+ */
+size_t utils_lzss_finish(LzssEncoder *enc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // QCLOUD_IOT_UTILS_LZSS_H_
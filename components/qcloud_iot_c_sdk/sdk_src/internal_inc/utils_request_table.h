@@ -0,0 +1,134 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef QCLOUD_IOT_UTILS_REQUEST_TABLE_H_
+#define QCLOUD_IOT_UTILS_REQUEST_TABLE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* requests a table holds at most, slot indexes are 16 bits */
+#define REQUEST_TABLE_MAX_SIZE (0x4000)
+
+/**
+ * @brief request waiting for its reply
+ */
+typedef struct {
+    uint32_t token;         // numeric key of the request, carried in clientToken
+    uint32_t arg;           // argument of callback, e.g. method of the request
+    void *   callback;      // called by the owner with the reply or on timeout
+    void *   user_context;  // context of callback
+} RequestEntry;
+
+typedef struct {
+    RequestEntry entry;
+    uint32_t     deadline_ms;  // HAL_GetTimeMs when the request expires
+    uint16_t     heap_pos;     // position in heap
+    uint16_t     next;         // next slot in bucket, or in free list
+} RequestSlot;
+
+/**
+ * @brief Correlation table of requests and their replies
+ *
+ * Requests live in a pool of slots, looked up by token through hash buckets and
+ * ordered by deadline in a binary heap, so a reply and each expired request are
+ * handled without walking the pending ones. The pool doubles when it is full
+ * instead of rejecting the request, entries are taken out by copy so a slot may
+ * move while the callback of a taken entry runs.
+ *
+ * The table is not locked, callers serialize access.
+ */
+typedef struct {
+    RequestSlot *slots;
+    uint16_t *   buckets;  // first slot of each bucket, capacity buckets
+    uint16_t *   heap;     // pending slots, the earliest deadline first
+    uint16_t     capacity;
+    uint16_t     count;
+    uint16_t     free_head;
+} RequestTable;
+
+/**
+ * @brief Init table with a pool of capacity slots
+ *
+ * @param table     table to init
+ * @param capacity  initial number of slots, rounded up to a power of 2
+ * @return          QCLOUD_RET_SUCCESS for success, or err code for failure
+ */
+int request_table_init(RequestTable *table, uint16_t capacity);
+
+/**
+ * @brief Release table, pending requests are dropped without callback
+ *
+ * @param table     table to release
+ */
+void request_table_deinit(RequestTable *table);
+
+/**
+ * @brief Add request, the pool grows if it is full
+ *
+ * @param table         request table
+ * @param entry         request to add, its token must not be pending
+ * @param timeout_ms    request expires in this time (unit: ms)
+ * @return              QCLOUD_RET_SUCCESS for success, QCLOUD_ERR_MAX_APPENDING_REQUEST if
+ *                      REQUEST_TABLE_MAX_SIZE requests are pending, or QCLOUD_ERR_MALLOC
+ */
+int request_table_add(RequestTable *table, const RequestEntry *entry, uint32_t timeout_ms);
+
+/**
+ * @brief Take out the request of a reply
+ *
+ * @param table     request table
+ * @param token     token of the reply
+ * @param entry     receives the request
+ * @return          true if the request was pending
+ */
+bool request_table_take(RequestTable *table, uint32_t token, RequestEntry *entry);
+
+/**
+ * @brief Check if a request of token is pending
+ *
+ * @param table     request table
+ * @param token     token of the request
+ * @return          true if the request is pending
+ */
+bool request_table_contains(const RequestTable *table, uint32_t token);
+
+/**
+ * @brief Take out the request with the earliest deadline, expired or not
+ *
+ * @param table     request table
+ * @param entry     receives the request
+ * @return          true if a request was taken, false if the table is empty
+ */
+bool request_table_take_first(RequestTable *table, RequestEntry *entry);
+
+/**
+ * @brief Take out the request with the earliest deadline if it is expired
+ *
+ * @param table     request table
+ * @param entry     receives the request
+ * @return          true if an expired request was taken, call again until false
+ */
+bool request_table_take_expired(RequestTable *table, RequestEntry *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QCLOUD_IOT_UTILS_REQUEST_TABLE_H_ */
@@ -0,0 +1,299 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "json_index.h"
+
+#include <string.h>
+
+#include "qcloud_iot_export_error.h"
+#include "qcloud_iot_export_log.h"
+
+/*
+ * While a container (object, array or key) is open, its "next" field holds its
+ * last child so that siblings can be linked in O(1). It is reset to -1 when the
+ * container is closed and becomes the real next-sibling link afterwards.
+ */
+
+/* what the next token may be, members are separated by exactly one ',' */
+enum { JSON_EXPECT_VALUE, JSON_EXPECT_KEY, JSON_EXPECT_COLON, JSON_EXPECT_SEP };
+
+static int _is_key(JsonIndex *index, int tok)
+{
+    int parent = index->tokens[tok].parent;
+    return parent >= 0 && index->tokens[parent].type == JSOBJECT && index->tokens[tok].type == JSSTRING;
+}
+
+static int _alloc_token(JsonIndex *index, int max_tokens, int parent, int type, size_t start)
+{
+    JsonToken *tok;
+    int        last;
+
+    if (index->count >= max_tokens || index->count >= INT16_MAX) {
+        return QCLOUD_ERR_MAX_JSON_TOKEN;
+    }
+
+    tok         = &index->tokens[index->count];
+    tok->type   = type;
+    tok->size   = 0;
+    tok->start  = start;
+    tok->len    = 0;
+    tok->parent = parent;
+    tok->next   = -1;
+
+    if (parent >= 0) {
+        last = index->tokens[parent].next;
+        if (last >= 0) {
+            index->tokens[last].next = index->count;
+        }
+        index->tokens[parent].next = index->count;
+        index->tokens[parent].size++;
+    }
+
+    return index->count++;
+}
+
+/* close a key once its value is complete, return the enclosing object */
+static int _close_key(JsonIndex *index, int cur)
+{
+    if (cur >= 0 && _is_key(index, cur)) {
+        if (index->tokens[cur].size != 1) {
+            return QCLOUD_ERR_JSON_PARSE;
+        }
+        index->tokens[cur].next = -1;
+        return index->tokens[cur].parent;
+    }
+    return cur;
+}
+
+/* count tokens without building the index, no validation */
+static int _count_tokens(const char *json, size_t len)
+{
+    size_t pos;
+    int    count = 0;
+    char   c;
+
+    for (pos = 0; pos < len && json[pos]; pos++) {
+        c = json[pos];
+        if (c == '"') {
+            count++;
+            for (pos++; pos < len && json[pos] && json[pos] != '"'; pos++) {
+                if (json[pos] == '\\' && pos + 1 < len) {
+                    pos++;
+                }
+            }
+        } else if (c == '{' || c == '[') {
+            count++;
+        } else if (!strchr(" \t\r\n,:]}", c)) {
+            count++;
+            while (pos + 1 < len && json[pos + 1] && !strchr(" \t\r\n,:]}", json[pos + 1])) {
+                pos++;
+            }
+        }
+    }
+
+    return count;
+}
+
+int json_index_parse(JsonIndex *index, const char *json, size_t len, JsonToken *tokens, int max_tokens)
+{
+    size_t pos;
+    int    cur = -1, tok, type;
+    int    expect = JSON_EXPECT_VALUE;
+    char   c;
+
+    if (!index || !json) {
+        return QCLOUD_ERR_INVAL;
+    }
+
+    if (!tokens) {
+        return _count_tokens(json, len);
+    }
+
+    if (max_tokens <= 0) {
+        return QCLOUD_ERR_INVAL;
+    }
+
+    if (len > JSON_INDEX_MAX_DOC_LEN) {
+        Log_e("json too long to index: %u", (unsigned)len);
+        return QCLOUD_ERR_JSON_PARSE;
+    }
+
+    index->json   = json;
+    index->tokens = tokens;
+    index->count  = 0;
+
+    for (pos = 0; pos < len && json[pos]; pos++) {
+        c = json[pos];
+        switch (c) {
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+                break;
+
+            case '{':
+            case '[':
+                if (expect != JSON_EXPECT_VALUE) {
+                    return QCLOUD_ERR_JSON_PARSE;
+                }
+                tok = _alloc_token(index, max_tokens, cur, (c == '{') ? JSOBJECT : JSARRAY, pos);
+                if (tok < 0) {
+                    return tok;
+                }
+                cur    = tok;
+                expect = (c == '{') ? JSON_EXPECT_KEY : JSON_EXPECT_VALUE;
+                break;
+
+            case '}':
+            case ']':
+                /* after a member, or right after the opening of an empty container */
+                if (expect != JSON_EXPECT_SEP &&
+                    (expect == JSON_EXPECT_COLON || cur < 0 || index->tokens[cur].type == JSSTRING ||
+                     index->tokens[cur].size)) {
+                    return QCLOUD_ERR_JSON_PARSE;
+                }
+                cur = _close_key(index, cur);
+                if (cur < 0 || index->tokens[cur].type != ((c == '}') ? JSOBJECT : JSARRAY)) {
+                    return QCLOUD_ERR_JSON_PARSE;
+                }
+                index->tokens[cur].len  = pos + 1 - index->tokens[cur].start;
+                index->tokens[cur].next = -1;
+                cur                     = _close_key(index, index->tokens[cur].parent);
+                if (cur == QCLOUD_ERR_JSON_PARSE) {
+                    return cur;
+                }
+                expect = JSON_EXPECT_SEP;
+                break;
+
+            case ',':
+                if (expect != JSON_EXPECT_SEP) {
+                    return QCLOUD_ERR_JSON_PARSE;
+                }
+                cur = _close_key(index, cur);
+                if (cur < 0) {
+                    return QCLOUD_ERR_JSON_PARSE;
+                }
+                expect = (index->tokens[cur].type == JSOBJECT) ? JSON_EXPECT_KEY : JSON_EXPECT_VALUE;
+                break;
+
+            case ':':
+                if (expect != JSON_EXPECT_COLON || !_is_key(index, cur) || index->tokens[cur].size) {
+                    return QCLOUD_ERR_JSON_PARSE;
+                }
+                expect = JSON_EXPECT_VALUE;
+                break;
+
+            case '"':
+                if (expect != JSON_EXPECT_VALUE && expect != JSON_EXPECT_KEY) {
+                    return QCLOUD_ERR_JSON_PARSE;
+                }
+                tok = _alloc_token(index, max_tokens, cur, JSSTRING, pos + 1);
+                if (tok < 0) {
+                    return tok;
+                }
+                for (pos++; pos < len && json[pos] && json[pos] != '"'; pos++) {
+                    if (json[pos] == '\\' && pos + 1 < len) {
+                        pos++;
+                    }
+                }
+                if (pos >= len || json[pos] != '"') {
+                    return QCLOUD_ERR_JSON_PARSE;
+                }
+                index->tokens[tok].len = pos - index->tokens[tok].start;
+                if (_is_key(index, tok)) {
+                    cur    = tok;
+                    expect = JSON_EXPECT_COLON;
+                } else {
+                    expect = JSON_EXPECT_SEP;
+                }
+                break;
+
+            default:
+                if (c == '-' || (c >= '0' && c <= '9')) {
+                    type = JSNUMBER;
+                } else if (c == 't' || c == 'T' || c == 'f' || c == 'F') {
+                    type = JSBOOLEAN;
+                } else if (c == 'n' || c == 'N') {
+                    type = JSNULL;
+                } else {
+                    return QCLOUD_ERR_JSON_PARSE;
+                }
+                if (expect != JSON_EXPECT_VALUE) {
+                    return QCLOUD_ERR_JSON_PARSE;
+                }
+                tok = _alloc_token(index, max_tokens, cur, type, pos);
+                if (tok < 0) {
+                    return tok;
+                }
+                while (pos + 1 < len && json[pos + 1] && !strchr(" \t\r\n,:]}", json[pos + 1])) {
+                    pos++;
+                }
+                index->tokens[tok].len = pos + 1 - index->tokens[tok].start;
+                expect                 = JSON_EXPECT_SEP;
+                break;
+        }
+    }
+
+    if (cur >= 0 || index->count == 0) {
+        return QCLOUD_ERR_JSON_PARSE;
+    }
+
+    return index->count;
+}
+
+int json_index_find(const JsonIndex *index, int obj, const char *key, int key_len)
+{
+    const JsonToken *tok;
+    int              k, v;
+
+    if (!index || !key || obj < 0 || obj >= index->count || index->tokens[obj].type != JSOBJECT) {
+        return -1;
+    }
+
+    json_index_for_each_member(index, obj, k, v)
+    {
+        tok = &index->tokens[k];
+        if (tok->len == key_len && !memcmp(index->json + tok->start, key, key_len)) {
+            return v;
+        }
+    }
+
+    return -1;
+}
+
+int json_index_get(const JsonIndex *index, int from, const char *path)
+{
+    const char *delim;
+    int         tok = from;
+
+    if (!index || !path) {
+        return -1;
+    }
+
+    while (tok >= 0 && (delim = strchr(path, '.')) != NULL) {
+        tok  = json_index_find(index, tok, path, delim - path);
+        path = delim + 1;
+    }
+
+    return (tok < 0) ? -1 : json_index_find(index, tok, path, strlen(path));
+}
+
+#ifdef __cplusplus
+}
+#endif
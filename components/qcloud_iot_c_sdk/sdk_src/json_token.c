@@ -79,47 +79,81 @@ char *LITE_json_value_of(char *key, char *src)
     return ret;
 }
 
+#define LITE_JSON_KEY_PATH_LEN (256)
+
+/*
+ * Append the dotted keys of the object at obj to keylist, path holds the prefix
+ * of path_len chars. Nested objects are walked in place, bounded by their
+ * length, and each key takes a single allocation holding the entry and the key.
+ */
+static void _json_keys_of_span(list_head_t *keylist, const char *obj, size_t obj_len, char *path, size_t path_len)
+{
+    char *      pos = NULL, *k = NULL, *v = NULL;
+    int         klen = 0, vlen = 0, vtype = 0;
+    json_key_t *entry;
+
+    json_object_for_each_kv((char *)obj, pos, k, klen, v, vlen, vtype)
+    {
+        if (!k || k >= obj + obj_len) {
+            break;
+        }
+        if (!klen || !v || !vlen) {
+            continue;
+        }
+        if (path_len + klen + 1 >= LITE_JSON_KEY_PATH_LEN) {
+            Log_w("key %.*s is too long, skipped", klen, k);
+            continue;
+        }
+
+        memcpy(path + path_len, k, klen);
+        path[path_len + klen] = '\0';
+
+        entry = HAL_Malloc(sizeof(json_key_t) + path_len + klen + 1);
+        if (NULL == entry) {
+            Log_e("malloc json key failed");
+            return;
+        }
+        entry->key = (char *)(entry + 1);
+        memcpy(entry->key, path, path_len + klen + 1);
+        list_add_tail(&entry->list, keylist);
+
+        if (JSOBJECT == vtype) {
+            path[path_len + klen] = '.';
+            _json_keys_of_span(keylist, v, vlen, path, path_len + klen + 1);
+        }
+    }
+}
+
 list_head_t *LITE_json_keys_of(char *src, char *prefix)
 {
     static LIST_HEAD(keylist);
 
-    char *pos = 0, *key = 0, *val = 0;
-    int   klen = 0, vlen = 0, vtype = 0;
+    char        path[LITE_JSON_KEY_PATH_LEN];
+    size_t      prefix_len;
+    json_key_t *entry = NULL;
 
     if (src == NULL || prefix == NULL) {
         return NULL;
     }
 
-    if (!strcmp("", prefix)) {
+    prefix_len = strlen(prefix);
+    if (prefix_len >= LITE_JSON_KEY_PATH_LEN) {
+        return NULL;
+    }
+    memcpy(path, prefix, prefix_len + 1);
+
+    if (!prefix_len) {
         INIT_LIST_HEAD(&keylist);
     }
 
-    json_object_for_each_kv(src, pos, key, klen, val, vlen, vtype)
-    {
-        if (key && klen && val && vlen) {
-            json_key_t *entry = NULL;
+    _json_keys_of_span(&keylist, src, strlen(src), path, prefix_len);
 
-            entry = HAL_Malloc(sizeof(json_key_t));
+    if (!prefix_len) {
+        entry = HAL_Malloc(sizeof(json_key_t));
+        if (NULL != entry) {
             memset(entry, 0, sizeof(json_key_t));
-            entry->key = LITE_format_string("%s%.*s", prefix, klen, key);
             list_add_tail(&entry->list, &keylist);
-
-            if (JSOBJECT == vtype) {
-                char *iter_val = LITE_format_string("%.*s", vlen, val);
-                char *iter_pre = LITE_format_string("%s%.*s.", prefix, klen, key);
-                LITE_json_keys_of(iter_val, iter_pre);
-                HAL_Free(iter_val);
-                HAL_Free(iter_pre);
-            }
         }
-    }
-
-    if (!strcmp("", prefix)) {
-        json_key_t *entry = NULL;
-
-        entry = HAL_Malloc(sizeof(json_key_t));
-        memset(entry, 0, sizeof(json_key_t));
-        list_add_tail(&entry->list, &keylist);
 
         return &keylist;
     }
@@ -127,15 +161,13 @@ list_head_t *LITE_json_keys_of(char *src, char *prefix)
     return NULL;
 }
 
+/* the key of an entry is allocated with the entry */
 void LITE_json_keys_release(list_head_t *keylist)
 {
     json_key_t *pos, *tmp;
 
     list_for_each_entry_safe(pos, tmp, keylist, list, json_key_t)
     {
-        if (pos->key) {
-            HAL_Free(pos->key);
-        }
         list_del(&pos->list);
         HAL_Free(pos);
     }
@@ -229,6 +261,321 @@ int LITE_get_string(int8_t *value, char *src, uint16_t max_len)
     return rc;
 }
 
+#define LITE_SPAN_NUM_MAX_LEN 32
+
+static int _span_find_member(const char *obj, size_t obj_len, const char *key, size_t key_len, json_span_t *span)
+{
+    char *pos = NULL, *k = NULL, *v = NULL;
+    int   klen = 0, vlen = 0, vtype = 0;
+
+    /* the iterator does not stop at the end of a nested object, so bound it by obj_len */
+    json_object_for_each_kv((char *)obj, pos, k, klen, v, vlen, vtype)
+    {
+        if (!k || k >= obj + obj_len) {
+            break;
+        }
+        if (v && klen == key_len && !strncmp(k, key, key_len)) {
+            span->ptr  = v;
+            span->len  = vlen;
+            span->type = vtype;
+            return QCLOUD_RET_SUCCESS;
+        }
+    }
+
+    return QCLOUD_ERR_JSON_PARSE;
+}
+
+int LITE_json_span_of(const char *key, const char *src, size_t src_len, json_span_t *span)
+{
+    const char *delim;
+    json_span_t obj;
+
+    if (!key || !src || !span) {
+        return QCLOUD_ERR_INVAL;
+    }
+
+    obj.ptr  = src;
+    obj.len  = src_len;
+    obj.type = JSOBJECT;
+    while ((delim = strchr(key, '.')) != NULL) {
+        if (_span_find_member(obj.ptr, obj.len, key, delim - key, &obj) || obj.type != JSOBJECT) {
+            return QCLOUD_ERR_JSON_PARSE;
+        }
+        key = delim + 1;
+    }
+
+    return _span_find_member(obj.ptr, obj.len, key, strlen(key), span);
+}
+
+/* numbers sent as string are accepted as well */
+static int _span_num_str(const json_span_t *span, char *buf)
+{
+    if (!span || !span->ptr || (span->type != JSNUMBER && span->type != JSSTRING) || !span->len ||
+        span->len >= LITE_SPAN_NUM_MAX_LEN) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    memcpy(buf, span->ptr, span->len);
+    buf[span->len] = '\0';
+    return QCLOUD_RET_SUCCESS;
+}
+
+static int _span_get_long(const json_span_t *span, long min, long max, long *value)
+{
+    char  buf[LITE_SPAN_NUM_MAX_LEN];
+    char *end = NULL;
+
+    if (_span_num_str(span, buf)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    *value = strtol(buf, &end, 10);
+    return (end != buf && *value >= min && *value <= max) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+}
+
+static int _span_get_ulong(const json_span_t *span, unsigned long max, unsigned long *value)
+{
+    char  buf[LITE_SPAN_NUM_MAX_LEN];
+    char *end = NULL;
+
+    if (_span_num_str(span, buf) || buf[0] == '-') {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    *value = strtoul(buf, &end, 10);
+    return (end != buf && *value <= max) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+}
+
+int LITE_span_get_int32(int32_t *value, const json_span_t *span)
+{
+    long v;
+
+    if (_span_get_long(span, INT32_MIN, INT32_MAX, &v)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    *value = v;
+    return QCLOUD_RET_SUCCESS;
+}
+
+int LITE_span_get_int16(int16_t *value, const json_span_t *span)
+{
+    long v;
+
+    if (_span_get_long(span, INT16_MIN, INT16_MAX, &v)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    *value = v;
+    return QCLOUD_RET_SUCCESS;
+}
+
+int LITE_span_get_int8(int8_t *value, const json_span_t *span)
+{
+    long v;
+
+    if (_span_get_long(span, INT8_MIN, INT8_MAX, &v)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    *value = v;
+    return QCLOUD_RET_SUCCESS;
+}
+
+int LITE_span_get_uint32(uint32_t *value, const json_span_t *span)
+{
+    unsigned long v;
+
+    if (_span_get_ulong(span, UINT32_MAX, &v)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    *value = v;
+    return QCLOUD_RET_SUCCESS;
+}
+
+int LITE_span_get_uint16(uint16_t *value, const json_span_t *span)
+{
+    unsigned long v;
+
+    if (_span_get_ulong(span, UINT16_MAX, &v)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    *value = v;
+    return QCLOUD_RET_SUCCESS;
+}
+
+int LITE_span_get_uint8(uint8_t *value, const json_span_t *span)
+{
+    unsigned long v;
+
+    if (_span_get_ulong(span, UINT8_MAX, &v)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    *value = v;
+    return QCLOUD_RET_SUCCESS;
+}
+
+int LITE_span_get_double(double *value, const json_span_t *span)
+{
+    char  buf[LITE_SPAN_NUM_MAX_LEN];
+    char *end = NULL;
+
+    if (_span_num_str(span, buf)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    *value = strtod(buf, &end);
+    return (end != buf) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+}
+
+int LITE_span_get_float(float *value, const json_span_t *span)
+{
+    double v;
+
+    if (LITE_span_get_double(&v, span)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    *value = (float)v;
+    return QCLOUD_RET_SUCCESS;
+}
+
+int LITE_span_get_boolean(bool *value, const json_span_t *span)
+{
+    double v;
+
+    if (span && span->ptr && span->type == JSBOOLEAN) {
+        *value = (span->ptr[0] == 't' || span->ptr[0] == 'T');
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    if (LITE_span_get_double(&v, span)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    *value = (v != 0);
+    return QCLOUD_RET_SUCCESS;
+}
+
+static int _hex4_value(const char *p, uint32_t *value)
+{
+    int i;
+
+    *value = 0;
+    for (i = 0; i < 4; i++) {
+        *value <<= 4;
+        if (p[i] >= '0' && p[i] <= '9') {
+            *value |= p[i] - '0';
+        } else if (p[i] >= 'a' && p[i] <= 'f') {
+            *value |= p[i] - 'a' + 10;
+        } else if (p[i] >= 'A' && p[i] <= 'F') {
+            *value |= p[i] - 'A' + 10;
+        } else {
+            return QCLOUD_ERR_FAILURE;
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* decode escape at p (after the backslash) into out, return bytes consumed from p */
+static size_t _unescape_one(const char *p, size_t left, char *out, size_t *out_len)
+{
+    uint32_t cp, low;
+    size_t   used = 1;
+
+    *out_len = 1;
+    switch (p[0]) {
+        case 'b':
+            out[0] = '\b';
+            return used;
+        case 'f':
+            out[0] = '\f';
+            return used;
+        case 'n':
+            out[0] = '\n';
+            return used;
+        case 'r':
+            out[0] = '\r';
+            return used;
+        case 't':
+            out[0] = '\t';
+            return used;
+        case 'u':
+            break;
+        default:
+            out[0] = p[0];
+            return used;
+    }
+
+    if (left < 5 || _hex4_value(p + 1, &cp)) {
+        out[0] = p[0];
+        return used;
+    }
+    used = 5;
+
+    /* surrogate pair */
+    if (cp >= 0xD800 && cp <= 0xDBFF && left >= 11 && p[5] == '\\' && p[6] == 'u' && !_hex4_value(p + 7, &low) &&
+        low >= 0xDC00 && low <= 0xDFFF) {
+        cp   = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        used = 11;
+    }
+
+    if (cp < 0x80) {
+        out[0] = cp;
+    } else if (cp < 0x800) {
+        out[0]   = 0xC0 | (cp >> 6);
+        out[1]   = 0x80 | (cp & 0x3F);
+        *out_len = 2;
+    } else if (cp < 0x10000) {
+        out[0]   = 0xE0 | (cp >> 12);
+        out[1]   = 0x80 | ((cp >> 6) & 0x3F);
+        out[2]   = 0x80 | (cp & 0x3F);
+        *out_len = 3;
+    } else {
+        out[0]   = 0xF0 | (cp >> 18);
+        out[1]   = 0x80 | ((cp >> 12) & 0x3F);
+        out[2]   = 0x80 | ((cp >> 6) & 0x3F);
+        out[3]   = 0x80 | (cp & 0x3F);
+        *out_len = 4;
+    }
+
+    return used;
+}
+
+int LITE_span_get_string(char *value, const json_span_t *span, size_t buf_len)
+{
+    char   ch[4];
+    size_t i, n = 0, ch_len;
+    int    rc = QCLOUD_RET_SUCCESS;
+
+    if (!value || !span || !span->ptr || !buf_len) {
+        return QCLOUD_ERR_INVAL;
+    }
+
+    for (i = 0; i < span->len;) {
+        if (span->type == JSSTRING && span->ptr[i] == '\\' && i + 1 < span->len) {
+            i++;
+            i += _unescape_one(span->ptr + i, span->len - i, ch, &ch_len);
+        } else {
+            ch[0]  = span->ptr[i++];
+            ch_len = 1;
+        }
+
+        if (n + ch_len >= buf_len) {
+            rc = QCLOUD_ERR_JSON_BUFFER_TRUNCATED;
+            break;
+        }
+        memcpy(value + n, ch, ch_len);
+        n += ch_len;
+    }
+    value[n] = '\0';
+
+    return rc;
+}
+
+bool LITE_span_equal(const json_span_t *span, const char *str)
+{
+    size_t len = strlen(str);
+
+    return span && span->ptr && span->len == len && !strncmp(span->ptr, str, len);
+}
+
 /* Input string must be like \"aaaa\" or {\"aaaa\":1234} */
 int LITE_dt_format_strobj_array(char *out_res, size_t out_sz, char *items[], size_t item_size)
 {
@@ -26,6 +26,7 @@ extern "C" {
 #include <stdlib.h>
 #include <string.h>
 
+#include "utils_completion.h"
 #include "utils_timer.h"
 #include "lite-utils.h"
 #include "mqtt_client.h"
@@ -35,6 +36,9 @@ extern "C" {
 
 static int sg_kgmusic_client_token_index = 0;
 
+/* signaled by the reply of a sync query */
+static Completion sg_kgmusic_reply;
+
 typedef struct {
     char *type_key;
     char *json_format;
@@ -57,15 +61,7 @@ const static KgmusicCommandJsonFormat sg_kgmusic_command_json_format[] = {
 
 static int _qcloud_iot_kgmusic_wait_reply(void *mqtt_client, QcloudIotKgmusic *kgmusic, int timeout_ms)
 {
-    Timer wait_timer;
-    InitTimer(&wait_timer);
-    countdown_ms(&wait_timer, timeout_ms);
-    while (false == expired(&wait_timer) && kgmusic->e_reply_result == E_KGMUSIC_QUERY_REPLY_TIMEOUT) {
-        if (QCLOUD_RET_SUCCESS != IOT_MQTT_Yield(mqtt_client, 200)) {
-            break;
-        }
-        HAL_SleepMs(200);
-    }
+    utils_completion_wait(&sg_kgmusic_reply, mqtt_client, timeout_ms, IOT_MQTT_Yield, mqtt_client);
 
     if (kgmusic->e_reply_result == E_KGMUSIC_QUERY_REPLY_TIMEOUT) {
         Log_e("recv timeout");
@@ -153,7 +149,8 @@ int IOT_KGMUSIC_syncquery_songlist(void *client, QcloudIotKgmusicSongListParams
     }
 
     kgmusic->e_reply_result = E_KGMUSIC_QUERY_REPLY_TIMEOUT;
-    int ret                 = _qcloud_iot_kgmusic_publish_msg(client, "kugou_user_command", params);
+    utils_completion_reset(&sg_kgmusic_reply);
+    int ret = _qcloud_iot_kgmusic_publish_msg(client, "kugou_user_command", params);
     if (QCLOUD_RET_SUCCESS != ret) {
         return ret;
     }
@@ -169,7 +166,8 @@ int IOT_KGMUSIC_syncquery_song(void *client, char *song_id, QcloudIotKgmusic *kg
     HAL_Snprintf(params, sizeof(params), "{\"song_id\":\"%s\"}", song_id);
 
     kgmusic->e_reply_result = E_KGMUSIC_QUERY_REPLY_TIMEOUT;
-    int ret                 = _qcloud_iot_kgmusic_publish_msg(client, "kugou_query_song", params);
+    utils_completion_reset(&sg_kgmusic_reply);
+    int ret = _qcloud_iot_kgmusic_publish_msg(client, "kugou_query_song", params);
     if (QCLOUD_RET_SUCCESS != ret) {
         return ret;
     }
@@ -257,10 +255,12 @@ static void _kgmusic_down_message_callback(void *user_data, const char *payload,
     } else if (0 == strncmp(method, METHOD_KGMUSIC_QUERY_SONG_REPLY, sizeof(METHOD_KGMUSIC_QUERY_SONG_REPLY) - 1)) {
         // delete auto mation
         _kgmusic_query_song_reply_proc(kgmusic->mqtt_client, (char *)payload, user_data);
+        utils_completion_signal(&sg_kgmusic_reply);
     } else if (0 ==
                strncmp(method, METHOD_KGMUSIC_QUERY_SONGLIST_REPLY, sizeof(METHOD_KGMUSIC_QUERY_SONGLIST_REPLY) - 1)) {
         // delete auto mation
         _kgmusic_query_songlist_reply_proc(kgmusic->mqtt_client, (char *)payload, user_data);
+        utils_completion_signal(&sg_kgmusic_reply);
     }
 
     HAL_Free(method);
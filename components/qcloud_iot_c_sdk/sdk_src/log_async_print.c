@@ -0,0 +1,241 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qcloud_iot_export.h"
+#include "qcloud_iot_import.h"
+
+#ifdef LOG_ASYNC_PRINT_ENABLED
+
+#include <string.h>
+
+#include "log_async_print.h"
+#include "log_ring.h"
+
+/* wait for print task to exit, in LOG_ASYNC_PRINT_INTERVAL_MS */
+#define LOG_ASYNC_PRINT_EXIT_WAIT_CNT (100)
+
+/* state of the print task, the one leaving it last frees the queue */
+#define LOG_ASYNC_PRINT_RUNNING   (0)
+#define LOG_ASYNC_PRINT_STOPPING  (1)
+#define LOG_ASYNC_PRINT_EXITED    (2)
+#define LOG_ASYNC_PRINT_ABANDONED (3)
+
+typedef struct {
+    LogRing             ring;
+    char *              buffer;
+    LogAsyncPrintParams params;
+    uint32_t            reported_dropped;
+    volatile uint32_t   state;
+} LogAsyncPrint;
+
+static LogAsyncPrint *sg_log_async_print = NULL;
+
+/* callers of log_async_print in progress, the queue is not freed before they leave */
+static volatile uint32_t sg_log_async_print_users = 0;
+
+static bool _set_state(LogAsyncPrint *async_print, uint32_t expected, uint32_t desired)
+{
+    return __atomic_compare_exchange_n(&async_print->state, &expected, desired, false, __ATOMIC_ACQ_REL,
+                                       __ATOMIC_ACQUIRE);
+}
+
+static void _free_async_print(LogAsyncPrint *async_print)
+{
+    HAL_Free(async_print->buffer);
+    HAL_Free(async_print);
+}
+
+/* print the records in queue, return the number of records printed */
+static int _print_queued_logs(LogAsyncPrint *async_print)
+{
+    char *   span;
+    size_t   len, pos, record_len;
+    int      i, count = 0;
+    uint32_t dropped = log_ring_dropped(&async_print->ring, NULL);
+
+    if (dropped != async_print->reported_dropped) {
+        HAL_Printf("WRN|log print queue overflowed, %u logs not queued\r\n", dropped - async_print->reported_dropped);
+        async_print->reported_dropped = dropped;
+    }
+
+    /* committed logs are at most two spans, before and after the ring wraps */
+    for (i = 0; i < 2; i++) {
+        if (log_ring_claim(&async_print->ring, &span, &len) != QCLOUD_RET_SUCCESS) {
+            break;
+        }
+
+        for (pos = 0; pos < len; pos += record_len) {
+            for (record_len = LOG_DELIMITER_LEN; pos + record_len < len; record_len++) {
+                if (!memcmp(span + pos + record_len - LOG_DELIMITER_LEN, LOG_DELIMITER, LOG_DELIMITER_LEN)) {
+                    break;
+                }
+            }
+            HAL_Printf("%.*s\r\n", (int)(record_len - LOG_DELIMITER_LEN), span + pos);
+            count++;
+        }
+        log_ring_release(&async_print->ring, len);
+
+        if (!len) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+static void _log_async_print_task(void *arg)
+{
+    LogAsyncPrint *async_print = (LogAsyncPrint *)arg;
+
+    while (__atomic_load_n(&async_print->state, __ATOMIC_ACQUIRE) == LOG_ASYNC_PRINT_RUNNING) {
+        if (!_print_queued_logs(async_print)) {
+            HAL_SleepMs(LOG_ASYNC_PRINT_INTERVAL_MS);
+        }
+    }
+
+    _print_queued_logs(async_print);
+
+    /* fini gave up waiting, the queue is left to the task */
+    if (!_set_state(async_print, LOG_ASYNC_PRINT_STOPPING, LOG_ASYNC_PRINT_EXITED)) {
+        _free_async_print(async_print);
+    }
+}
+
+int init_log_async_print(LogAsyncPrintParams *params)
+{
+    static ThreadParams thread_params  = {0};
+    LogAsyncPrintParams default_params = DEFAULT_LOG_ASYNC_PRINT_PARAMS;
+    LogAsyncPrint *     async_print    = NULL;
+    int                 rc;
+
+    if (sg_log_async_print) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    if (!params) {
+        params = &default_params;
+    }
+
+    async_print = HAL_Malloc(sizeof(LogAsyncPrint));
+    if (!async_print) {
+        Log_e("malloc log async print failed");
+        return QCLOUD_ERR_MALLOC;
+    }
+    memset(async_print, 0, sizeof(LogAsyncPrint));
+    async_print->params = *params;
+
+    async_print->buffer = HAL_Malloc(params->queue_size);
+    if (!async_print->buffer) {
+        Log_e("malloc log print queue of %u bytes failed", params->queue_size);
+        HAL_Free(async_print);
+        return QCLOUD_ERR_MALLOC;
+    }
+
+    rc = log_ring_init(&async_print->ring, async_print->buffer, params->queue_size, 0,
+                       params->overflow == eLOG_ASYNC_DROP_OLD);
+    if (rc) {
+        Log_e("invalid log print queue size %u", params->queue_size);
+        goto err_exit;
+    }
+
+    async_print->state        = LOG_ASYNC_PRINT_RUNNING;
+    thread_params.thread_func = _log_async_print_task;
+    thread_params.thread_name = "log_print_task";
+    thread_params.user_arg    = async_print;
+    thread_params.stack_size  = params->stack_size;
+    thread_params.priority    = params->priority;
+    rc                        = HAL_ThreadCreate(&thread_params);
+    if (rc) {
+        Log_e("create log print task fail: %d", rc);
+        goto err_exit;
+    }
+    __atomic_store_n(&sg_log_async_print, async_print, __ATOMIC_RELEASE);
+
+    return QCLOUD_RET_SUCCESS;
+
+err_exit:
+    _free_async_print(async_print);
+    return QCLOUD_ERR_FAILURE;
+}
+
+void fini_log_async_print(void)
+{
+    LogAsyncPrint *async_print = sg_log_async_print;
+    int            cnt         = 0;
+
+    if (!async_print) {
+        return;
+    }
+
+    /* new logs are printed on the calling thread from now on, the ones being queued are committed first */
+    __atomic_store_n(&sg_log_async_print, NULL, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&sg_log_async_print_users, __ATOMIC_SEQ_CST)) {
+        HAL_SleepMs(1);
+    }
+
+    __atomic_store_n(&async_print->state, LOG_ASYNC_PRINT_STOPPING, __ATOMIC_RELEASE);
+    do {
+        HAL_SleepMs(LOG_ASYNC_PRINT_INTERVAL_MS);
+        cnt++;
+    } while (__atomic_load_n(&async_print->state, __ATOMIC_ACQUIRE) != LOG_ASYNC_PRINT_EXITED &&
+             cnt < LOG_ASYNC_PRINT_EXIT_WAIT_CNT);
+
+    /* the task still uses the queue, it frees the queue when it exits */
+    if (_set_state(async_print, LOG_ASYNC_PRINT_STOPPING, LOG_ASYNC_PRINT_ABANDONED)) {
+        Log_e("log print task does not exit");
+        return;
+    }
+
+    _free_async_print(async_print);
+}
+
+bool log_async_print(const char *log, size_t len, int level)
+{
+    LogAsyncPrint *async_print;
+    char *         record;
+    bool           taken = false;
+
+    __atomic_fetch_add(&sg_log_async_print_users, 1, __ATOMIC_SEQ_CST);
+    async_print = __atomic_load_n(&sg_log_async_print, __ATOMIC_SEQ_CST);
+    if (!async_print || level <= async_print->params.bypass_level || len < LOG_DELIMITER_LEN) {
+        goto exit;
+    }
+
+    record = log_ring_reserve(&async_print->ring, len);
+    if (!record) {
+        taken = async_print->params.overflow != eLOG_ASYNC_PRINT_SYNC;
+        goto exit;
+    }
+
+    /* replace \r\n to \n\f as delimiter */
+    memcpy(record, log, len - LOG_DELIMITER_LEN);
+    memcpy(record + len - LOG_DELIMITER_LEN, LOG_DELIMITER, LOG_DELIMITER_LEN);
+    log_ring_commit(&async_print->ring);
+    taken = true;
+
+exit:
+    __atomic_fetch_sub(&sg_log_async_print_users, 1, __ATOMIC_RELEASE);
+    return taken;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
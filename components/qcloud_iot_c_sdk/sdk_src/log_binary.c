@@ -0,0 +1,258 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qcloud_iot_export.h"
+#include "qcloud_iot_import.h"
+
+#if defined(LOG_UPLOAD) && defined(LOG_UPLOAD_BINARY)
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "log_binary.h"
+#include "utils_base64.h"
+
+typedef struct {
+    uint8_t *buf;
+    size_t   size;
+    size_t   len;
+    bool     truncated;
+} LogRecord;
+
+static void _put_bytes(LogRecord *record, const void *data, size_t len)
+{
+    if (record->truncated || len > record->size - record->len) {
+        record->truncated = true;
+        return;
+    }
+
+    memcpy(record->buf + record->len, data, len);
+    record->len += len;
+}
+
+static void _put_varint(LogRecord *record, uint64_t value)
+{
+    uint8_t bytes[10];
+    size_t  len = 0;
+
+    do {
+        bytes[len] = value & 0x7F;
+        value >>= 7;
+        if (value) {
+            bytes[len] |= 0x80;
+        }
+        len++;
+    } while (value);
+
+    _put_bytes(record, bytes, len);
+}
+
+static void _put_signed(LogRecord *record, int64_t value)
+{
+    _put_varint(record, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+static void _put_string(LogRecord *record, const char *str, int precision)
+{
+    size_t len;
+    size_t left = record->size - record->len;
+    bool   cut  = false;
+
+    if (!str) {
+        str = "null";
+    }
+
+    /* the string is not required to be terminated within precision */
+    for (len = 0; (precision < 0 || len < (size_t)precision) && str[len]; len++) {
+    }
+
+    /* cut the string to what is left, two bytes at most for the length */
+    if (len + 2 > left) {
+        len = (left > 2) ? left - 2 : 0;
+        cut = true;
+    }
+    _put_varint(record, len);
+    _put_bytes(record, str, len);
+    record->truncated |= cut;
+}
+
+/* walk the conversions of fmt and put the arguments they take */
+static void _put_args(LogRecord *record, const char *fmt, va_list ap)
+{
+    const char *p = fmt;
+    int         precision;
+    int         longs;
+    char        size;
+
+    while (!record->truncated && (p = strchr(p, '%'))) {
+        p++;
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+
+        while (*p && strchr("-+ #0", *p)) {
+            p++;
+        }
+        if (*p == '*') {
+            _put_signed(record, va_arg(ap, int));
+            p++;
+        }
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+
+        precision = -1;
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                precision = va_arg(ap, int);
+                _put_signed(record, precision);
+                p++;
+            } else {
+                for (precision = 0; *p >= '0' && *p <= '9'; p++) {
+                    precision = precision * 10 + *p - '0';
+                }
+            }
+        }
+
+        longs = 0;
+        size  = 0;
+        for (; *p && strchr("hlLqjzt", *p); p++) {
+            if (*p == 'l') {
+                longs++;
+            } else {
+                size = *p;
+            }
+        }
+
+        switch (*p) {
+            case 'd':
+            case 'i':
+                if (longs >= 2 || size == 'j' || size == 'q') {
+                    _put_signed(record, va_arg(ap, long long));
+                } else if (longs == 1) {
+                    _put_signed(record, va_arg(ap, long));
+                } else if (size == 'z' || size == 't') {
+                    _put_signed(record, va_arg(ap, ptrdiff_t));
+                } else {
+                    _put_signed(record, va_arg(ap, int));
+                }
+                break;
+
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                if (longs >= 2 || size == 'j' || size == 'q') {
+                    _put_varint(record, va_arg(ap, unsigned long long));
+                } else if (longs == 1) {
+                    _put_varint(record, va_arg(ap, unsigned long));
+                } else if (size == 'z' || size == 't') {
+                    _put_varint(record, va_arg(ap, size_t));
+                } else {
+                    _put_varint(record, va_arg(ap, unsigned int));
+                }
+                break;
+
+            case 'c':
+                _put_varint(record, (unsigned char)va_arg(ap, int));
+                break;
+
+            case 'p':
+                _put_varint(record, (uintptr_t)va_arg(ap, void *));
+                break;
+
+            case 's':
+                _put_string(record, va_arg(ap, const char *), precision);
+                break;
+
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A': {
+                double value = (size == 'L') ? (double)va_arg(ap, long double) : va_arg(ap, double);
+                _put_bytes(record, &value, sizeof(value));
+                break;
+            }
+
+            case 'n':
+                (void)va_arg(ap, void *);
+                break;
+
+            default:
+                /* unknown conversion, the arguments behind can't be located */
+                record->truncated = true;
+                return;
+        }
+        p++;
+    }
+}
+
+int log_binary_encode(char *buf, size_t buf_len, const char *file, const char *func, int line, int level,
+                      const char *fmt, va_list ap)
+{
+    uint8_t   raw[LOG_BINARY_MAX_RECORD_SIZE];
+    LogRecord record = {raw, sizeof(raw), 0, false};
+    size_t    prefix_len = strlen(LOG_BINARY_PREFIX);
+    size_t    olen;
+    va_list   args;
+
+    if (buf_len < LOG_BINARY_MAX_LINE_LEN) {
+        return 0;
+    }
+
+    raw[record.len++] = LOG_BINARY_VERSION;
+    raw[record.len++] = 0;
+    _put_varint(&record, level);
+    _put_varint(&record, (uint64_t)HAL_Timer_current_sec());
+    _put_varint(&record, (uintptr_t)file);
+    _put_varint(&record, (uintptr_t)func);
+    _put_varint(&record, line);
+    _put_varint(&record, (uintptr_t)fmt);
+
+    va_copy(args, ap);
+    _put_args(&record, fmt, args);
+    va_end(args);
+
+    if (record.truncated) {
+        raw[1] |= LOG_BINARY_FLAG_TRUNCATED;
+    }
+
+    memcpy(buf, LOG_BINARY_PREFIX, prefix_len);
+    if (qcloud_iot_utils_base64encode((unsigned char *)buf + prefix_len, buf_len - prefix_len, &olen, raw,
+                                      record.len)) {
+        return 0;
+    }
+    memcpy(buf + prefix_len + olen, "\r\n", sizeof("\r\n"));
+
+    return prefix_len + olen + 2;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
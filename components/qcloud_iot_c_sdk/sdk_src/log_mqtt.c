@@ -37,17 +37,12 @@ static LogMQTTState sg_log_state = {.topic_sub_ok = false, .result_recv_ok = fal
 
 static bool _get_json_log_level(char *json, int32_t *res)
 {
-    char *v = LITE_json_value_of("log_level", json);
-    if (v == NULL) {
+    json_span_t v;
+
+    if (LITE_json_span_of("log_level", json, strlen(json), &v) || LITE_span_get_int32(res, &v)) {
         Log_e("Invalid log level from JSON: %s", STRING_PTR_PRINT_SANITY_CHECK(json));
         return false;
     }
-    if (LITE_get_int32(res, v) != QCLOUD_RET_SUCCESS) {
-        Log_e("Invalid log level from JSON: %s", json);
-        HAL_Free(v);
-        return false;
-    }
-    HAL_Free(v);
     return true;
 }
 
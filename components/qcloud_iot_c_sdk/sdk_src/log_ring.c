@@ -0,0 +1,313 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "log_ring.h"
+
+#include <string.h>
+
+#include "qcloud_iot_export_error.h"
+
+#define LOG_RING_WRITERS_BITS (8)
+#define LOG_RING_WRITERS_MASK ((1u << LOG_RING_WRITERS_BITS) - 1)
+#define LOG_RING_CLAIMED      (1u)
+#define LOG_RING_NO_WRAP      (0xFFFFFFFFu)
+#define LOG_RING_POS_LIMIT    (1u << (31 - LOG_RING_WRITERS_BITS))
+
+/* targets without atomic instructions get these from the toolchain atomic library */
+static inline uint32_t _load(volatile uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void _store(volatile uint32_t *p, uint32_t val)
+{
+    __atomic_store_n(p, val, __ATOMIC_RELEASE);
+}
+
+static inline bool _cas(volatile uint32_t *p, uint32_t expected, uint32_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static inline void _add(volatile uint32_t *p, uint32_t val)
+{
+    __atomic_fetch_add(p, val, __ATOMIC_RELAXED);
+}
+
+static uint32_t _pos_add(LogRing *ring, uint32_t pos, uint32_t n)
+{
+    pos += n;
+    return (pos >= ring->pos_range) ? pos - ring->pos_range : pos;
+}
+
+/* bytes from pos 'from' forward to pos 'to' */
+static uint32_t _pos_dist(LogRing *ring, uint32_t to, uint32_t from)
+{
+    return (to >= from) ? to - from : to + ring->pos_range - from;
+}
+
+static uint32_t _pos_index(LogRing *ring, uint32_t pos)
+{
+    return pos % ring->size;
+}
+
+static uint32_t _next_lap(LogRing *ring, uint32_t pos)
+{
+    return _pos_add(ring, pos, ring->size - _pos_index(ring, pos));
+}
+
+/* contiguous committed bytes from pos, stop at the padding or the end of data */
+static uint32_t _span_len(LogRing *ring, uint32_t pos, uint32_t commit)
+{
+    uint32_t len  = _pos_dist(ring, commit, pos);
+    uint32_t left = ring->size - _pos_index(ring, pos);
+    uint32_t wrap = _load(&ring->wrap);
+
+    if (len > left) {
+        len = left;
+    }
+    if (wrap != LOG_RING_NO_WRAP && _pos_dist(ring, wrap, pos) < len) {
+        len = _pos_dist(ring, wrap, pos);
+    }
+
+    return len;
+}
+
+/* length of the first record of a span, 0 if the delimiter is missing */
+static uint32_t _record_len(const char *span, uint32_t len)
+{
+    uint32_t i;
+
+    for (i = 1; i < len; i++) {
+        if (span[i] == LOG_DELIMITER[1] && span[i - 1] == LOG_DELIMITER[0]) {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+/* free the oldest record for the overwrite policy, return true if the reservation should be retried */
+static bool _drop_oldest(LogRing *ring)
+{
+    uint32_t read = _load(&ring->read);
+    uint32_t pos  = read >> 1;
+    uint32_t commit, end, len;
+
+    /* the oldest records are being read out or written */
+    if (read & LOG_RING_CLAIMED) {
+        return false;
+    }
+    commit = _load(&ring->commit);
+    if (pos == commit) {
+        return false;
+    }
+
+    if (pos == _load(&ring->wrap)) {
+        end = _next_lap(ring, pos);
+        if (_cas(&ring->read, read, end << 1)) {
+            _cas(&ring->wrap, pos, LOG_RING_NO_WRAP);
+        }
+        return true;
+    }
+
+    len = _record_len(ring->data + _pos_index(ring, pos), _span_len(ring, pos, commit));
+    if (!len) {
+        return false;
+    }
+    if (_cas(&ring->read, read, _pos_add(ring, pos, len) << 1)) {
+        _add(&ring->dropped_count, 1);
+        _add(&ring->dropped_bytes, len);
+    }
+
+    return true;
+}
+
+int log_ring_init(LogRing *ring, char *buf, size_t buf_size, size_t headroom, bool overwrite)
+{
+    if (!ring || !buf || buf_size <= 2 * headroom || 2 * (buf_size - headroom) > LOG_RING_POS_LIMIT) {
+        return QCLOUD_ERR_INVAL;
+    }
+
+    memset(ring, 0, sizeof(LogRing));
+    ring->data      = buf + headroom;
+    ring->size      = buf_size - headroom;
+    ring->pos_range = LOG_RING_POS_LIMIT / ring->size * ring->size;
+    ring->headroom  = headroom;
+    ring->overwrite = overwrite;
+    ring->wrap      = LOG_RING_NO_WRAP;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+char *log_ring_reserve(LogRing *ring, size_t len)
+{
+    uint32_t reserve, next, pos, index, pad, used;
+
+    if (!len || len > ring->size - ring->headroom) {
+        goto drop;
+    }
+
+    for (;;) {
+        reserve = _load(&ring->reserve);
+        pos     = reserve >> LOG_RING_WRITERS_BITS;
+        if ((reserve & LOG_RING_WRITERS_MASK) == LOG_RING_WRITERS_MASK) {
+            goto drop;
+        }
+
+        /* pad to the end of data if the record does not fit before it */
+        index = _pos_index(ring, pos);
+        pad   = (index + len > ring->size) ? ring->size - index : 0;
+        used  = _pos_dist(ring, pos, _load(&ring->read) >> 1);
+
+        /* read is loaded after pos, the records were consumed past a stale pos meanwhile */
+        if (used > ring->size) {
+            continue;
+        }
+        if (used + pad + len > ring->size - ring->headroom) {
+            if (ring->overwrite && _drop_oldest(ring)) {
+                continue;
+            }
+            goto drop;
+        }
+
+        next = (_pos_add(ring, pos, pad + len) << LOG_RING_WRITERS_BITS) | ((reserve & LOG_RING_WRITERS_MASK) + 1);
+        if (_cas(&ring->reserve, reserve, next)) {
+            break;
+        }
+    }
+
+    /* published before the padding can be committed, so the consumer always sees it */
+    if (pad) {
+        _store(&ring->wrap, pos);
+        return ring->data;
+    }
+
+    return ring->data + index;
+
+drop:
+    _add(&ring->dropped_count, 1);
+    _add(&ring->dropped_bytes, len);
+    return NULL;
+}
+
+void log_ring_commit(LogRing *ring)
+{
+    uint32_t reserve, commit, dist, pos;
+
+    do {
+        reserve = _load(&ring->reserve);
+    } while (!_cas(&ring->reserve, reserve, reserve - 1));
+
+    /* the last producer done publishes all the records reserved so far */
+    if ((reserve - 1) & LOG_RING_WRITERS_MASK) {
+        return;
+    }
+    pos = reserve >> LOG_RING_WRITERS_BITS;
+
+    /* a later producer may have published further already, then pos is far behind commit in the wide position
+     * range, while an unpublished pos is at most size ahead of it */
+    do {
+        commit = _load(&ring->commit);
+        dist   = _pos_dist(ring, pos, commit);
+        if (dist == 0 || dist > ring->size) {
+            return;
+        }
+    } while (!_cas(&ring->commit, commit, pos));
+}
+
+/* hand out the span at pos of a claimed ring, skip the padding in front of it */
+static void _claim_span(LogRing *ring, uint32_t pos, char **span, size_t *len)
+{
+    uint32_t commit = _load(&ring->commit);
+
+    if (pos != commit && pos == _load(&ring->wrap)) {
+        _cas(&ring->wrap, pos, LOG_RING_NO_WRAP);
+        pos = _next_lap(ring, pos);
+    }
+    _store(&ring->read, (pos << 1) | LOG_RING_CLAIMED);
+
+    *span = ring->data + _pos_index(ring, pos);
+    *len  = _span_len(ring, pos, commit);
+}
+
+int log_ring_claim(LogRing *ring, char **span, size_t *len)
+{
+    uint32_t read;
+
+    do {
+        read = _load(&ring->read);
+        if (read & LOG_RING_CLAIMED) {
+            return QCLOUD_ERR_FAILURE;
+        }
+    } while (!_cas(&ring->read, read, read | LOG_RING_CLAIMED));
+
+    _claim_span(ring, read >> 1, span, len);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+void log_ring_reclaim(LogRing *ring, size_t len, char **span, size_t *span_len)
+{
+    uint32_t pos = _load(&ring->read) >> 1;
+
+    _claim_span(ring, _pos_add(ring, pos, len), span, span_len);
+}
+
+void log_ring_release(LogRing *ring, size_t len)
+{
+    uint32_t pos = _load(&ring->read) >> 1;
+
+    _store(&ring->read, _pos_add(ring, pos, len) << 1);
+}
+
+void log_ring_discard(LogRing *ring)
+{
+    char * span;
+    size_t len;
+
+    /* release span by span until no committed record is left */
+    do {
+        if (log_ring_claim(ring, &span, &len)) {
+            return;
+        }
+        log_ring_release(ring, len);
+    } while (len);
+}
+
+size_t log_ring_free(LogRing *ring)
+{
+    uint32_t pos  = _load(&ring->reserve) >> LOG_RING_WRITERS_BITS;
+    uint32_t used = _pos_dist(ring, pos, _load(&ring->read) >> 1);
+
+    return (used < ring->size - ring->headroom) ? ring->size - ring->headroom - used : 0;
+}
+
+uint32_t log_ring_dropped(LogRing *ring, uint32_t *dropped_bytes)
+{
+    if (dropped_bytes) {
+        *dropped_bytes = _load(&ring->dropped_bytes);
+    }
+
+    return _load(&ring->dropped_count);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,524 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "log_store.h"
+
+#include <string.h>
+
+#include "log_ring.h"
+#include "qcloud_iot_export_error.h"
+
+#define LOG_STORE_MAGIC         (0x32534C51)  // "QLS2"
+#define LOG_STORE_SEQ_NONE      (0xFFFFFFFFu)
+#define LOG_STORE_ERASED_WORD   (0xFFFFFFFFu)
+#define LOG_STORE_DRAIN_MAP_OFF (12)
+#define LOG_STORE_DRAIN_MAP_LEN (32)
+#define LOG_STORE_DRAIN_BITS    (LOG_STORE_DRAIN_MAP_LEN * 8)
+#define LOG_STORE_SEG_HDR_SIZE  (LOG_STORE_DRAIN_MAP_OFF + LOG_STORE_DRAIN_MAP_LEN)
+#define LOG_STORE_REC_HDR_SIZE  (4)
+#define LOG_STORE_MAX_REC_LEN   (0xFFFE)
+#define LOG_STORE_IO_CHUNK_SIZE (64)
+
+static uint32_t _seg_addr(LogStore *store, int seg)
+{
+    return (uint32_t)seg * store->segment_size;
+}
+
+/* CRC-16/CCITT-FALSE */
+static uint16_t _crc16(uint16_t crc, const uint8_t *data, size_t len)
+{
+    int i;
+
+    while (len--) {
+        crc ^= (uint16_t)*data++ << 8;
+        for (i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+static void _put_u32(uint8_t *p, uint32_t val)
+{
+    p[0] = val & 0xFF;
+    p[1] = (val >> 8) & 0xFF;
+    p[2] = (val >> 16) & 0xFF;
+    p[3] = (val >> 24) & 0xFF;
+}
+
+static uint32_t _get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool _is_erased(LogStore *store, uint32_t addr, uint32_t len)
+{
+    uint8_t  chunk[LOG_STORE_IO_CHUNK_SIZE];
+    uint32_t n, i;
+
+    for (; len; addr += n, len -= n) {
+        n = (len < sizeof(chunk)) ? len : sizeof(chunk);
+        if (store->ops.read(store->ops.usr_data, addr, chunk, n)) {
+            return false;
+        }
+        for (i = 0; i < n; i++) {
+            if (chunk[i] != 0xFF) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static int _erase_segment(LogStore *store, int seg)
+{
+    uint8_t  chunk[LOG_STORE_IO_CHUNK_SIZE];
+    uint32_t addr = _seg_addr(store, seg);
+    uint32_t n, left;
+
+    if (store->ops.erase) {
+        return store->ops.erase(store->ops.usr_data, addr, store->segment_size);
+    }
+
+    memset(chunk, 0xFF, sizeof(chunk));
+    for (left = store->segment_size; left; addr += n, left -= n) {
+        n = (left < sizeof(chunk)) ? left : sizeof(chunk);
+        if (store->ops.program(store->ops.usr_data, addr, chunk, n)) {
+            return QCLOUD_ERR_FAILURE;
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* data length of the record at off, 0 if the data of the segment ends there */
+static uint32_t _get_record_len(LogStore *store, int seg, uint32_t off, uint16_t *crc)
+{
+    uint8_t  hdr[LOG_STORE_REC_HDR_SIZE];
+    uint32_t len;
+
+    if (off + LOG_STORE_REC_HDR_SIZE > store->segment_size ||
+        store->ops.read(store->ops.usr_data, _seg_addr(store, seg) + off, hdr, sizeof(hdr))) {
+        return 0;
+    }
+
+    len  = hdr[0] | (hdr[1] << 8);
+    *crc = hdr[2] | (hdr[3] << 8);
+    if (!len || len > store->max_record || off + LOG_STORE_REC_HDR_SIZE + len > store->segment_size) {
+        return 0;
+    }
+
+    return len;
+}
+
+/* read and check the data of the record at off into buf, or only check it if buf is NULL */
+static bool _read_record(LogStore *store, int seg, uint32_t off, uint32_t len, uint16_t crc, char *buf)
+{
+    uint8_t  chunk[LOG_STORE_IO_CHUNK_SIZE];
+    uint32_t addr = _seg_addr(store, seg) + off + LOG_STORE_REC_HDR_SIZE;
+    uint16_t sum  = 0xFFFF;
+    uint32_t n;
+
+    if (buf) {
+        if (store->ops.read(store->ops.usr_data, addr, buf, len)) {
+            return false;
+        }
+        return _crc16(sum, (uint8_t *)buf, len) == crc;
+    }
+
+    for (; len; addr += n, len -= n) {
+        n = (len < sizeof(chunk)) ? len : sizeof(chunk);
+        if (store->ops.read(store->ops.usr_data, addr, chunk, n)) {
+            return false;
+        }
+        sum = _crc16(sum, chunk, n);
+    }
+
+    return sum == crc;
+}
+
+static int _oldest_segment(LogStore *store)
+{
+    int      oldest = -1;
+    uint32_t i;
+
+    for (i = 0; i < store->segment_num; i++) {
+        if (store->seq[i] != LOG_STORE_SEQ_NONE && (oldest < 0 || store->seq[i] < store->seq[oldest])) {
+            oldest = i;
+        }
+    }
+
+    return oldest;
+}
+
+/* delete a segment by clearing its acked word, no erase needed */
+static int _ack_segment(LogStore *store, int seg)
+{
+    uint8_t acked[4] = {0};
+    int     rc;
+
+    rc = store->ops.program(store->ops.usr_data, _seg_addr(store, seg) + 8, acked, sizeof(acked));
+    store->seq[seg] = LOG_STORE_SEQ_NONE;
+    if (seg == store->write_seg) {
+        store->write_seg = -1;
+    }
+    if (seg == store->read_seg) {
+        store->read_seg = -1;
+    }
+
+    return rc;
+}
+
+/* leading bits of the drain map of a segment that are cleared */
+static uint32_t _read_drain_mark(LogStore *store, int seg)
+{
+    uint8_t  map[LOG_STORE_DRAIN_MAP_LEN];
+    uint32_t mark = 0;
+
+    if (store->ops.read(store->ops.usr_data, _seg_addr(store, seg) + LOG_STORE_DRAIN_MAP_OFF, map, sizeof(map))) {
+        return 0;
+    }
+    while (mark < LOG_STORE_DRAIN_BITS && !(map[mark / 8] & (1 << (mark % 8)))) {
+        mark++;
+    }
+
+    return mark;
+}
+
+/* clear the drain map of read_seg up to the unit of read_off, the bits programmed are ANDed with the ones on
+ * flash so a map torn by power loss is never set back */
+static int _write_drain_mark(LogStore *store)
+{
+    uint8_t  map[LOG_STORE_DRAIN_MAP_LEN];
+    uint32_t addr  = _seg_addr(store, store->read_seg) + LOG_STORE_DRAIN_MAP_OFF;
+    uint32_t mark  = store->read_off / store->drain_unit;
+    uint32_t first = store->drain_mark / 8;
+    uint32_t len, i;
+
+    if (mark > LOG_STORE_DRAIN_BITS) {
+        mark = LOG_STORE_DRAIN_BITS;
+    }
+    if (mark <= store->drain_mark) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    len = (mark - 1) / 8 + 1 - first;
+    if (store->ops.read(store->ops.usr_data, addr + first, map, len)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+    for (i = store->drain_mark; i < mark; i++) {
+        map[i / 8 - first] &= ~(1 << (i % 8));
+    }
+    if (store->ops.program(store->ops.usr_data, addr + first, map, len)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    store->drain_mark = mark;
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* offset of the first record of a segment starting at or after limit, or of the end of its data */
+static uint32_t _skip_records(LogStore *store, int seg, uint32_t limit)
+{
+    uint32_t off = LOG_STORE_SEG_HDR_SIZE;
+    uint32_t len;
+    uint16_t crc;
+
+    while (off < limit && (len = _get_record_len(store, seg, off, &crc)) != 0) {
+        off += LOG_STORE_REC_HDR_SIZE + len;
+    }
+
+    return off;
+}
+
+static int _open_segment(LogStore *store)
+{
+    uint8_t  word[4];
+    uint32_t addr;
+    uint32_t i;
+    int      seg = -1;
+    int      rc;
+
+    for (i = 0; i < store->segment_num && seg < 0; i++) {
+        if (store->seq[i] == LOG_STORE_SEQ_NONE) {
+            seg = i;
+        }
+    }
+
+    /* full, make room by dropping the oldest logs */
+    if (seg < 0) {
+        seg = _oldest_segment(store);
+        _ack_segment(store, seg);
+        store->dropped_segments++;
+    }
+
+    /* seq is programmed before magic, so a torn header leaves the segment free */
+    addr = _seg_addr(store, seg);
+    rc   = _erase_segment(store, seg);
+    if (rc == QCLOUD_RET_SUCCESS) {
+        _put_u32(word, store->next_seq);
+        rc = store->ops.program(store->ops.usr_data, addr + 4, word, sizeof(word));
+    }
+    if (rc == QCLOUD_RET_SUCCESS) {
+        _put_u32(word, LOG_STORE_MAGIC);
+        rc = store->ops.program(store->ops.usr_data, addr, word, sizeof(word));
+    }
+    if (rc != QCLOUD_RET_SUCCESS) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    store->seq[seg]  = store->next_seq++;
+    store->write_seg = seg;
+    store->write_off = LOG_STORE_SEG_HDR_SIZE;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* size of the longest run of whole logs from the start of logs within max_len */
+static size_t _fit_logs(const char *logs, size_t len, size_t max_len)
+{
+    size_t size = (len < max_len) ? len : max_len;
+
+    for (; size >= LOG_DELIMITER_LEN; size--) {
+        if (!memcmp(logs + size - LOG_DELIMITER_LEN, LOG_DELIMITER, LOG_DELIMITER_LEN)) {
+            return size;
+        }
+    }
+
+    return 0;
+}
+
+int log_store_open(LogStore *store, const LogStoreOps *ops, uint32_t segment_size, uint32_t max_record)
+{
+    uint8_t  hdr[LOG_STORE_SEG_HDR_SIZE];
+    uint32_t i, off, len;
+    uint16_t crc;
+    int      newest = -1;
+
+    if (!store || !ops || !ops->read || !ops->program || segment_size <= LOG_STORE_SEG_HDR_SIZE ||
+        (ops->sector_size && segment_size % ops->sector_size) || !max_record || max_record > LOG_STORE_MAX_REC_LEN ||
+        ops->size < segment_size) {
+        return QCLOUD_ERR_INVAL;
+    }
+
+    memset(store, 0, sizeof(LogStore));
+    store->ops          = *ops;
+    store->segment_size = segment_size;
+    store->segment_num  = ops->size / segment_size;
+    store->max_record   = max_record;
+    store->drain_unit   = (segment_size + LOG_STORE_DRAIN_BITS - 1) / LOG_STORE_DRAIN_BITS;
+    store->write_seg    = -1;
+    store->read_seg     = -1;
+    if (store->segment_num > LOG_STORE_MAX_SEGMENTS) {
+        store->segment_num = LOG_STORE_MAX_SEGMENTS;
+    }
+
+    for (i = 0; i < store->segment_num; i++) {
+        store->seq[i] = LOG_STORE_SEQ_NONE;
+        if (ops->read(ops->usr_data, _seg_addr(store, i), hdr, sizeof(hdr))) {
+            return QCLOUD_ERR_FAILURE;
+        }
+        if (_get_u32(hdr) != LOG_STORE_MAGIC || _get_u32(hdr + 4) == LOG_STORE_SEQ_NONE ||
+            _get_u32(hdr + 8) != LOG_STORE_ERASED_WORD) {
+            continue;
+        }
+
+        store->seq[i] = _get_u32(hdr + 4);
+        if (newest < 0 || store->seq[i] > store->seq[newest]) {
+            newest = i;
+        }
+    }
+
+    if (newest < 0) {
+        return QCLOUD_RET_SUCCESS;
+    }
+    store->next_seq = store->seq[newest] + 1;
+
+    /* go on appending to the newest segment only if it ends cleanly, a torn write seals it */
+    for (off = LOG_STORE_SEG_HDR_SIZE; (len = _get_record_len(store, newest, off, &crc)) != 0;
+         off += LOG_STORE_REC_HDR_SIZE + len) {
+        if (!_read_record(store, newest, off, len, crc, NULL)) {
+            break;
+        }
+    }
+    if (_is_erased(store, _seg_addr(store, newest) + off, store->segment_size - off)) {
+        store->write_seg = newest;
+        store->write_off = off;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int log_store_append(LogStore *store, const char *logs, size_t len)
+{
+    uint8_t  hdr[LOG_STORE_REC_HDR_SIZE];
+    uint16_t crc;
+    uint32_t addr;
+    size_t   pos    = 0;
+    size_t   stored = 0;
+    size_t   room, take;
+    int      rc;
+
+    while (pos < len) {
+        if (store->write_seg < 0) {
+            rc = _open_segment(store);
+            if (rc != QCLOUD_RET_SUCCESS) {
+                return rc;
+            }
+        }
+
+        room = store->segment_size - store->write_off;
+        room = (room > LOG_STORE_REC_HDR_SIZE) ? room - LOG_STORE_REC_HDR_SIZE : 0;
+        take = _fit_logs(logs + pos, len - pos, (room < store->max_record) ? room : store->max_record);
+        if (!take) {
+            if (store->write_off == LOG_STORE_SEG_HDR_SIZE) {
+                /* a log too long for any record */
+                take = _fit_logs(logs + pos, len - pos, len - pos);
+                pos += take ? take : len - pos;
+            } else {
+                /* seal the segment and go on in a new one */
+                store->write_seg = -1;
+            }
+            continue;
+        }
+
+        /* the header goes last, so the record is not valid before its data is complete */
+        crc    = _crc16(0xFFFF, (const uint8_t *)logs + pos, take);
+        hdr[0] = take & 0xFF;
+        hdr[1] = take >> 8;
+        hdr[2] = crc & 0xFF;
+        hdr[3] = crc >> 8;
+        addr   = _seg_addr(store, store->write_seg) + store->write_off;
+        if (store->ops.program(store->ops.usr_data, addr + LOG_STORE_REC_HDR_SIZE, logs + pos, take) ||
+            store->ops.program(store->ops.usr_data, addr, hdr, sizeof(hdr))) {
+            store->write_seg = -1;
+            return QCLOUD_ERR_FAILURE;
+        }
+
+        store->write_off += LOG_STORE_REC_HDR_SIZE + take;
+        pos += take;
+        stored += take;
+    }
+
+    return stored;
+}
+
+int log_store_read(LogStore *store, char *buf, size_t buf_len, size_t *read_len)
+{
+    uint32_t off, len, end;
+    uint16_t crc;
+    int      rc;
+
+    *read_len = 0;
+    for (;;) {
+        if (store->read_seg < 0) {
+            store->read_seg = _oldest_segment(store);
+            if (store->read_seg < 0) {
+                return QCLOUD_RET_SUCCESS;
+            }
+            /* the records committed before a reboot are skipped */
+            store->drain_mark  = _read_drain_mark(store, store->read_seg);
+            store->read_off    = _skip_records(store, store->read_seg, store->drain_mark * store->drain_unit);
+            store->pending_off = store->read_off;
+            store->pending_end = false;
+        }
+
+        /* data of the segment being appended to ends at write_off */
+        end = (store->read_seg == store->write_seg) ? store->write_off : store->segment_size;
+        for (off = store->pending_off; !store->pending_end; off += LOG_STORE_REC_HDR_SIZE + len) {
+            len = (off < end) ? _get_record_len(store, store->read_seg, off, &crc) : 0;
+            if (!len) {
+                store->pending_end = true;
+                break;
+            }
+            if (len > buf_len - *read_len) {
+                break;
+            }
+            if (!_read_record(store, store->read_seg, off, len, crc, buf + *read_len)) {
+                store->pending_end = true;
+                break;
+            }
+            *read_len += len;
+        }
+        store->pending_off = off;
+
+        if (*read_len) {
+            return QCLOUD_RET_SUCCESS;
+        }
+        if (!store->pending_end) {
+            return QCLOUD_ERR_INVAL;
+        }
+
+        /* nothing left in this segment, delete it and go on with the next one */
+        rc = log_store_commit(store);
+        if (rc != QCLOUD_RET_SUCCESS || store->read_seg >= 0) {
+            return rc;
+        }
+    }
+}
+
+int log_store_commit(LogStore *store)
+{
+    if (store->read_seg < 0) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    store->read_off = store->pending_off;
+
+    /* keep the segment being appended to if logs came after the read */
+    if (!store->pending_end || (store->read_seg == store->write_seg && store->read_off < store->write_off)) {
+        store->pending_end = false;
+        return _write_drain_mark(store);
+    }
+
+    return _ack_segment(store, store->read_seg);
+}
+
+void log_store_rewind(LogStore *store)
+{
+    store->pending_off = store->read_off;
+    store->pending_end = false;
+}
+
+bool log_store_empty(LogStore *store)
+{
+    uint32_t i, start;
+
+    for (i = 0; i < store->segment_num; i++) {
+        if (store->seq[i] == LOG_STORE_SEQ_NONE) {
+            continue;
+        }
+        if (i != store->write_seg) {
+            return false;
+        }
+
+        start = (i == store->read_seg) ? store->read_off : LOG_STORE_SEG_HDR_SIZE;
+        if (store->write_off > start) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -36,11 +36,15 @@ extern "C" {
 
 #include "lite-utils.h"
 #include "utils_param_check.h"
+#include "log_ring.h"
+#include "log_store.h"
 #include "log_upload.h"
+#include "mqtt_client.h"
 #include "qcloud_iot_common.h"
 #include "qcloud_iot_ca.h"
 #include "utils_hmac.h"
 #include "utils_httpc.h"
+#include "utils_lzss.h"
 #include "utils_timer.h"
 
 /* log post header format */
@@ -51,6 +55,25 @@ extern "C" {
 #define LOG_BUF_FIXED_HEADER_SIZE \
     (SIGNATURE_SIZE + CTRL_BYTES_SIZE + MAX_SIZE_OF_PRODUCT_ID + MAX_SIZE_OF_DEVICE_NAME + TIMESTAMP_SIZE)
 
+/* second control byte of the post header, set when the logs are LZSS compressed */
+#define CTRL_BYTE_COMPRESSED 'Z'
+
+#ifdef LOG_UPLOAD_COMPRESS
+#define LOG_POST_CONTENT_TYPE "application/octet-stream"
+#else
+#define LOG_POST_CONTENT_TYPE "text/plain;charset=utf-8"
+#endif
+
+/* logs published over MQTT go in one message, with room for the publish packet header */
+#define LOG_MQTT_UPLOAD_TOPIC "$log/operation/upload/%s/%s"
+#define LOG_MQTT_MAX_POST_SIZE                                                                                \
+    ((QCLOUD_IOT_MQTT_TX_BUF_LEN - MAX_SIZE_OF_CLOUD_TOPIC - 10) < MAX_HTTP_LOG_POST_SIZE                     \
+         ? (QCLOUD_IOT_MQTT_TX_BUF_LEN - MAX_SIZE_OF_CLOUD_TOPIC - 10)                                        \
+         : MAX_HTTP_LOG_POST_SIZE)
+
+/* a saved record is posted as one post */
+#define LOG_STORE_MAX_RECORD (MAX_HTTP_LOG_POST_SIZE - LOG_BUF_FIXED_HEADER_SIZE - 1)
+
 /* do immediate log update if buffer is lower than this threshold (about two max log item) */
 #define LOG_LOW_BUFFER_THRESHOLD (LOG_UPLOAD_BUFFER_SIZE / 4)
 #define SIGN_KEY_SIZE            (24)
@@ -81,6 +104,19 @@ typedef struct {
     HTTPClientData http_data; /* http client data */
 } LogHTTPStruct;
 
+#ifdef LOG_UPLOAD_MQTT
+/* id of a message being published, MQTT packet ids start from 1 */
+#define LOG_MQTT_PACKET_ID_PENDING (0)
+
+/* a log message published with QoS1, its logs stay in the ring until it is acked */
+typedef struct {
+    uint16_t packet_id;
+    bool     acked;
+    uint16_t payload;  // bytes of logs in the message
+    Timer    ack_timer;
+} LogMQTTMessage;
+#endif
+
 /*Log  client*/
 typedef struct {
     DeviceInfo     dev_info;
@@ -89,24 +125,46 @@ typedef struct {
     bool           upload_only_in_comm_err;
 
     char *   log_buffer;
-    uint32_t log_index;
-    void *   lock_buf;
+    LogRing  log_ring;
+    char     log_header[LOG_BUF_FIXED_HEADER_SIZE];
+    uint32_t reported_dropped;
     char     sign_key[SIGN_KEY_SIZE + 1];
 
     long  system_time;
     Timer upload_timer;
-    Timer time_update_timer;
 
     LogSaveFunc    save_func;
     LogReadFunc    read_func;
     LogDelFunc     del_func;
     LogGetSizeFunc get_size_func;
+    LogStore *     log_store;
+
+#ifdef LOG_UPLOAD_MQTT
+    char           mqtt_topic[MAX_SIZE_OF_CLOUD_TOPIC + 1];
+    void *         inflight_lock;  // the messages in flight are acked from the yield thread
+    LogMQTTMessage inflight[LOG_MQTT_MAX_INFLIGHT];
+    uint8_t        inflight_head;
+    uint8_t        inflight_num;
+    uint16_t       early_acks[LOG_MQTT_MAX_INFLIGHT];  // acks of unknown ids while a publish is pending
+    uint8_t        early_ack_num;
+    size_t         inflight_bytes;  // logs published from the read position of the ring
+    bool           ring_claimed;    // the claim is held while messages are in flight
+#endif
 
     bool log_save_enabled;
     bool log_client_init_done;
 } Qcloud_IoT_Log;
 static Qcloud_IoT_Log *sg_log_client = NULL;
 
+#ifdef LOG_UPLOAD_COMPRESS
+/* a compressed post can't be built in place, its buffers are allocated only while uploading */
+typedef struct {
+    LzssEncoder           encoder;
+    iot_hmac_sha1_context hmac;
+    char                  buf[MAX_HTTP_LOG_POST_SIZE];
+} LogCompressedPost;
+#endif
+
 static void _set_log_client(void *client)
 {
     sg_log_client = client;
@@ -187,12 +245,6 @@ static int _gen_key_from_cert_file(char *sign_key, const char *file_path)
 }
 #endif
 
-static void _reset_log_buffer(Qcloud_IoT_Log *pLogClient)
-{
-    pLogClient->log_index = LOG_BUF_FIXED_HEADER_SIZE;
-    memset(pLogClient->log_buffer + LOG_BUF_FIXED_HEADER_SIZE, 0, LOG_UPLOAD_BUFFER_SIZE - LOG_BUF_FIXED_HEADER_SIZE);
-}
-
 int init_log_uploader(LogUploadInitParams *init_params)
 {
     Qcloud_IoT_Log *pLogClient = NULL;
@@ -229,7 +281,16 @@ int init_log_uploader(LogUploadInitParams *init_params)
     pLogClient->upload_only_in_comm_err = false;
 
     /* all the call back functions are necessary to handle log save and re-upload*/
-    if (init_params->save_func != NULL && init_params->read_func != NULL && init_params->del_func != NULL &&
+    if (init_params->store_ops != NULL) {
+        pLogClient->log_store = HAL_Malloc(sizeof(LogStore));
+        if (pLogClient->log_store == NULL ||
+            log_store_open(pLogClient->log_store, init_params->store_ops, LOG_STORE_SEGMENT_SIZE,
+                           LOG_STORE_MAX_RECORD) != QCLOUD_RET_SUCCESS) {
+            UPLOAD_ERR("open log store failed");
+            goto err_exit;
+        }
+        pLogClient->log_save_enabled = true;
+    } else if (init_params->save_func != NULL && init_params->read_func != NULL && init_params->del_func != NULL &&
         init_params->get_size_func) {
         pLogClient->save_func        = init_params->save_func;
         pLogClient->read_func        = init_params->read_func;
@@ -241,18 +302,16 @@ int init_log_uploader(LogUploadInitParams *init_params)
     }
 
     InitTimer(&pLogClient->upload_timer);
-    InitTimer(&pLogClient->time_update_timer);
-    if ((pLogClient->lock_buf = HAL_MutexCreate()) == NULL) {
-        UPLOAD_ERR("mutex create failed");
-        goto err_exit;
-    }
 
+    /* the post header is written in front of the logs, so the ring keeps room for it */
     pLogClient->log_buffer = HAL_Malloc(LOG_UPLOAD_BUFFER_SIZE);
     if (pLogClient->log_buffer == NULL) {
         UPLOAD_ERR("malloc log buffer failed");
         goto err_exit;
     }
-    memset(pLogClient->log_buffer, '#', LOG_BUF_FIXED_HEADER_SIZE);
+    log_ring_init(&pLogClient->log_ring, pLogClient->log_buffer, LOG_UPLOAD_BUFFER_SIZE, LOG_BUF_FIXED_HEADER_SIZE,
+                  LOG_UPLOAD_OVERWRITE_OLDEST);
+    memset(pLogClient->log_header, '#', LOG_BUF_FIXED_HEADER_SIZE);
 
     /*init sign key*/
     memset(pLogClient->sign_key, 0, SIGN_KEY_SIZE);
@@ -261,14 +320,14 @@ int init_log_uploader(LogUploadInitParams *init_params)
         UPLOAD_ERR("gen_key_from_file failed");
         goto err_exit;
     }
-    pLogClient->log_buffer[SIGNATURE_SIZE] = 'C';
+    pLogClient->log_header[SIGNATURE_SIZE] = 'C';
 #else
     memcpy(pLogClient->sign_key, init_params->sign_key, key_len > SIGN_KEY_SIZE ? SIGN_KEY_SIZE : key_len);
-    pLogClient->log_buffer[SIGNATURE_SIZE] = 'P';
+    pLogClient->log_header[SIGNATURE_SIZE] = 'P';
 #endif
 
-    memcpy(pLogClient->log_buffer + SIGNATURE_SIZE + CTRL_BYTES_SIZE, init_params->product_id, MAX_SIZE_OF_PRODUCT_ID);
-    memcpy(pLogClient->log_buffer + SIGNATURE_SIZE + CTRL_BYTES_SIZE + MAX_SIZE_OF_PRODUCT_ID, init_params->device_name,
+    memcpy(pLogClient->log_header + SIGNATURE_SIZE + CTRL_BYTES_SIZE, init_params->product_id, MAX_SIZE_OF_PRODUCT_ID);
+    memcpy(pLogClient->log_header + SIGNATURE_SIZE + CTRL_BYTES_SIZE + MAX_SIZE_OF_PRODUCT_ID, init_params->device_name,
            strlen(init_params->device_name));
 
     pLogClient->http_client = HAL_Malloc(sizeof(LogHTTPStruct));
@@ -284,7 +343,16 @@ int init_log_uploader(LogUploadInitParams *init_params)
     pLogClient->http_client->port        = LOG_UPLOAD_SERVER_PORT;
     pLogClient->http_client->ca_crt      = NULL;
 
-    _reset_log_buffer(pLogClient);
+#ifdef LOG_UPLOAD_MQTT
+    HAL_Snprintf(pLogClient->mqtt_topic, sizeof(pLogClient->mqtt_topic), LOG_MQTT_UPLOAD_TOPIC,
+                 init_params->product_id, init_params->device_name);
+    pLogClient->inflight_lock = HAL_MutexCreate();
+    if (pLogClient->inflight_lock == NULL) {
+        UPLOAD_ERR("create log inflight lock failed");
+        goto err_exit;
+    }
+#endif
+
     _set_log_client(pLogClient);
     pLogClient->log_client_init_done = true;
 
@@ -303,11 +371,18 @@ err_exit:
             pLogClient->log_buffer = NULL;
         }
 
-        if (pLogClient->lock_buf) {
-            HAL_MutexDestroy(pLogClient->lock_buf);
-            pLogClient->lock_buf = NULL;
+        if (pLogClient->log_store) {
+            HAL_Free(pLogClient->log_store);
+            pLogClient->log_store = NULL;
         }
 
+#ifdef LOG_UPLOAD_MQTT
+        if (pLogClient->inflight_lock) {
+            HAL_MutexDestroy(pLogClient->inflight_lock);
+            pLogClient->inflight_lock = NULL;
+        }
+#endif
+
         HAL_Free(pLogClient);
         pLogClient = NULL;
     }
@@ -323,13 +398,17 @@ void fini_log_uploader(void)
         return;
     }
 
-    HAL_MutexLock(pLogClient->lock_buf);
+    _set_log_client(NULL);
     HAL_Free(pLogClient->http_client);
     pLogClient->http_client = NULL;
     HAL_Free(pLogClient->log_buffer);
     pLogClient->log_buffer = NULL;
-    HAL_MutexUnlock(pLogClient->lock_buf);
-    HAL_MutexDestroy(pLogClient->lock_buf);
+    HAL_Free(pLogClient->log_store);
+    pLogClient->log_store = NULL;
+#ifdef LOG_UPLOAD_MQTT
+    HAL_MutexDestroy(pLogClient->inflight_lock);
+    pLogClient->inflight_lock = NULL;
+#endif
     HAL_Free(pLogClient);
     pLogClient = NULL;
 }
@@ -364,31 +443,22 @@ int append_to_upload_buffer(const char *log_content, size_t log_size)
         return -1;
     }
 
-    if (log_content == NULL || log_size == 0) {
+    if (log_content == NULL || log_size < LOG_DELIMITER_LEN) {
         UPLOAD_ERR("invalid log content!");
         return -1;
     }
 
-    if (HAL_MutexTryLock(pLogClient->lock_buf) != 0) {
-        UPLOAD_ERR("trylock buffer failed!");
+    /* never block or print here, dropped logs are counted by the ring and reported on upload */
+    char *record = log_ring_reserve(&pLogClient->log_ring, log_size);
+    if (record == NULL) {
         return -1;
     }
 
-    if ((pLogClient->log_index + log_size + 1) > LOG_UPLOAD_BUFFER_SIZE) {
-        countdown_ms(&pLogClient->upload_timer, 0);
-        HAL_MutexUnlock(pLogClient->lock_buf);
-        UPLOAD_ERR("log upload buffer is not enough!");
-        return -1;
-    }
-
-    memcpy(pLogClient->log_buffer + pLogClient->log_index, log_content, log_size);
-    pLogClient->log_index += log_size;
-
     /* replace \r\n to \n\f as delimiter */
-    pLogClient->log_buffer[pLogClient->log_index - 1] = '\f';
-    pLogClient->log_buffer[pLogClient->log_index - 2] = '\n';
+    memcpy(record, log_content, log_size - LOG_DELIMITER_LEN);
+    memcpy(record + log_size - LOG_DELIMITER_LEN, LOG_DELIMITER, LOG_DELIMITER_LEN);
+    log_ring_commit(&pLogClient->log_ring);
 
-    HAL_MutexUnlock(pLogClient->lock_buf);
     return 0;
 }
 
@@ -400,36 +470,19 @@ void clear_upload_buffer(void)
         return;
     }
 
-    HAL_MutexLock(pLogClient->lock_buf);
-    _reset_log_buffer(pLogClient);
-    HAL_MutexUnlock(pLogClient->lock_buf);
+    log_ring_discard(&pLogClient->log_ring);
 }
 
-static long _get_system_time(Qcloud_IoT_Log *pLogClient)
+static long _get_system_time(void)
 {
 #ifdef SYSTEM_COMM
-    long sys_time = 0;
-    int  rc       = IOT_Get_Sys_Resource(pLogClient->mqtt_client, eRESOURCE_TIME, &pLogClient->dev_info, &sys_time);
-    if (rc == QCLOUD_RET_SUCCESS)
-        return sys_time;
-    else
-        return 0;
+    /* estimated from the last time sync done in IOT_MQTT_Yield, no request here */
+    return (long)(IOT_Get_Sys_Time_Ms() / 1000);
 #else
     return 0;
 #endif
 }
 
-static void _update_system_time(Qcloud_IoT_Log *pLogClient)
-{
-    /* to avoid frequent get_system_time */
-#define LOG_TIME_UPDATE_INTERVAL 2
-    if (!expired(&pLogClient->time_update_timer)) {
-        return;
-    }
-    pLogClient->system_time = _get_system_time(pLogClient);
-    countdown(&pLogClient->time_update_timer, LOG_TIME_UPDATE_INTERVAL);
-}
-
 static int _check_server_connection(Qcloud_IoT_Log *pLogClient)
 {
     int rc;
@@ -446,17 +499,12 @@ static int _check_server_connection(Qcloud_IoT_Log *pLogClient)
 #ifdef LOG_CHECK_HTTP_RET_CODE
 static bool _get_json_ret_code(char *json, int32_t *res)
 {
-    char *v = LITE_json_value_of("Retcode", json);
-    if (v == NULL) {
-        UPLOAD_ERR("Invalid json content: %s", STRING_PTR_PRINT_SANITY_CHECK(json));
-        return false;
-    }
-    if (LITE_get_int32(res, v) != QCLOUD_RET_SUCCESS) {
+    json_span_t v;
+
+    if (LITE_json_span_of("Retcode", json, strlen(json), &v) || LITE_span_get_int32(res, &v)) {
         UPLOAD_ERR("Invalid json content: %s", STRING_PTR_PRINT_SANITY_CHECK(json));
-        HAL_Free(v);
         return false;
     }
-    HAL_Free(v);
     return true;
 }
 #endif
@@ -471,7 +519,7 @@ static int _post_one_http_to_server(char *post_buf, size_t post_size)
         return QCLOUD_ERR_FAILURE;
     }
 
-    pLogClient->http_client->http_data.post_content_type = "text/plain;charset=utf-8";
+    pLogClient->http_client->http_data.post_content_type = LOG_POST_CONTENT_TYPE;
     pLogClient->http_client->http_data.post_buf          = post_buf;
     pLogClient->http_client->http_data.post_buf_len      = post_size;
     rc = qcloud_http_client_common(&pLogClient->http_client->http, pLogClient->http_client->url,
@@ -513,9 +561,21 @@ static int _post_one_http_to_server(char *post_buf, size_t post_size)
     return rc;
 }
 
-static void update_time_and_signature(char *log_buf, size_t log_size)
+static void _update_timestamp(Qcloud_IoT_Log *pLogClient, char *log_buf)
 {
     char timestamp[TIMESTAMP_SIZE + 1] = {0};
+
+    /* get system time from IoT hub first */
+    pLogClient->system_time = _get_system_time();
+
+    /* record the timestamp for this log uploading */
+    HAL_Snprintf(timestamp, TIMESTAMP_SIZE + 1, "%010ld", pLogClient->system_time);
+    memcpy(log_buf + LOG_BUF_FIXED_HEADER_SIZE - TIMESTAMP_SIZE, timestamp, strlen(timestamp));
+}
+
+#ifndef LOG_UPLOAD_COMPRESS
+static void update_time_and_signature(char *log_buf, size_t log_size)
+{
     char signature[SIGNATURE_SIZE + 1] = {0};
 
     Qcloud_IoT_Log *pLogClient = get_log_client();
@@ -524,12 +584,7 @@ static void update_time_and_signature(char *log_buf, size_t log_size)
         return;
     }
 
-    /* get system time from IoT hub first */
-    _update_system_time(pLogClient);
-
-    /* record the timestamp for this log uploading */
-    HAL_Snprintf(timestamp, TIMESTAMP_SIZE + 1, "%010ld", pLogClient->system_time);
-    memcpy(log_buf + LOG_BUF_FIXED_HEADER_SIZE - TIMESTAMP_SIZE, timestamp, strlen(timestamp));
+    _update_timestamp(pLogClient, log_buf);
 
     /* signature of this log uploading */
     utils_hmac_sha1(log_buf + SIGNATURE_SIZE, log_size - SIGNATURE_SIZE, signature, pLogClient->sign_key,
@@ -537,76 +592,140 @@ static void update_time_and_signature(char *log_buf, size_t log_size)
     memcpy(log_buf, signature, SIGNATURE_SIZE);
 }
 
-static int post_log_to_server(char *post_buf, size_t post_size, size_t *actual_post_payload)
+/* size of the next post payload, cut at the last delimiter that fits in one post of post_limit bytes */
+static size_t _get_post_payload_size(const char *log_buf, size_t log_size, size_t post_limit)
 {
-#define LOG_DELIMITER "\n\f"
-    int ret = QCLOUD_RET_SUCCESS;
-    /* one shot upload */
-    if (post_size < MAX_HTTP_LOG_POST_SIZE) {
-        update_time_and_signature(post_buf, post_size);
-        ret = _post_one_http_to_server(post_buf, post_size);
-        if (QCLOUD_RET_SUCCESS == ret) {
-            *actual_post_payload = post_size - LOG_BUF_FIXED_HEADER_SIZE;
-        } else {
-            UPLOAD_ERR("one time log send failed");
-            *actual_post_payload = 0;
+    size_t max_size = post_limit - LOG_BUF_FIXED_HEADER_SIZE - 1;
+    size_t size;
+
+    if (log_size <= max_size) {
+        return log_size;
+    }
+
+    for (size = max_size; size >= LOG_DELIMITER_LEN; size--) {
+        if (!memcmp(log_buf + size - LOG_DELIMITER_LEN, LOG_DELIMITER, LOG_DELIMITER_LEN)) {
+            return size;
         }
-        return ret;
     }
 
-    /* Log size is larger than one HTTP post size */
-    /* Fragment the log and upload multi-times */
-    UPLOAD_DBG("to post large log size %d", post_size);
-    *actual_post_payload  = 0;
-    size_t delimiter_len  = strlen(LOG_DELIMITER);
-    size_t orig_post_size = post_size;
-    size_t post_payload, upload_size, possible_size;
-    do {
-        char *next_log_buf = NULL;
-        possible_size      = 0;
-        while (possible_size < MAX_HTTP_LOG_POST_SIZE) {
-            /*remember last valid position */
-            upload_size = possible_size;
-            /* locate the delimiter */
-            next_log_buf = strstr(post_buf + upload_size, LOG_DELIMITER);
-            if (next_log_buf == NULL) {
-                UPLOAD_ERR("Invalid log delimiter. Total sent: %d. Left: %d",
-                           *actual_post_payload + LOG_BUF_FIXED_HEADER_SIZE, post_size);
-                return QCLOUD_ERR_INVAL;
-            }
-            possible_size = (size_t)(next_log_buf - post_buf + delimiter_len);
-            /* end of log */
-            if (next_log_buf[delimiter_len] == 0 && possible_size < MAX_HTTP_LOG_POST_SIZE) {
-                upload_size = possible_size;
-                break;
-            }
+    return 0;
+}
+#endif
+
+#ifdef LOG_UPLOAD_COMPRESS
+static void _sign_compressed_data(void *user_data, const uint8_t *data, size_t len)
+{
+    utils_hmac_sha1_update((iot_hmac_sha1_context *)user_data, (const char *)data, len);
+}
+
+/* length of the first log record, 0 if the delimiter is missing */
+static size_t _get_record_len(const char *log_buf, size_t log_size)
+{
+    size_t len;
+
+    for (len = LOG_DELIMITER_LEN; len <= log_size; len++) {
+        if (!memcmp(log_buf + len - LOG_DELIMITER_LEN, LOG_DELIMITER, LOG_DELIMITER_LEN)) {
+            return len;
         }
+    }
 
-        if (upload_size == 0) {
-            UPLOAD_ERR("Upload size should not be 0! Total sent: %d. Left: %d",
-                       *actual_post_payload + LOG_BUF_FIXED_HEADER_SIZE, post_size);
-            return QCLOUD_ERR_FAILURE;
+    return 0;
+}
+
+/* compress the logs that fit in one post, signed as the compressed data comes out, return the size of logs taken */
+static size_t _compress_post(Qcloud_IoT_Log *pLogClient, LogCompressedPost *post, const char *log_buf,
+                             size_t log_size, size_t post_limit, size_t *post_size)
+{
+    size_t payload, record_len;
+
+    memcpy(post->buf, pLogClient->log_header, LOG_BUF_FIXED_HEADER_SIZE);
+    post->buf[SIGNATURE_SIZE + 1] = CTRL_BYTE_COMPRESSED;
+    _update_timestamp(pLogClient, post->buf);
+
+    utils_hmac_sha1_starts(&post->hmac, pLogClient->sign_key, strlen(pLogClient->sign_key));
+    utils_hmac_sha1_update(&post->hmac, post->buf + SIGNATURE_SIZE, LOG_BUF_FIXED_HEADER_SIZE - SIGNATURE_SIZE);
+    utils_lzss_init(&post->encoder, (const uint8_t *)log_buf, (uint8_t *)post->buf + LOG_BUF_FIXED_HEADER_SIZE,
+                    post_limit - LOG_BUF_FIXED_HEADER_SIZE - 1, _sign_compressed_data, &post->hmac);
+
+    for (payload = 0; payload < log_size; payload += record_len) {
+        record_len = _get_record_len(log_buf + payload, log_size - payload);
+        if (!record_len || utils_lzss_compress(&post->encoder, record_len)) {
+            break;
         }
+    }
+
+    *post_size = LOG_BUF_FIXED_HEADER_SIZE + utils_lzss_finish(&post->encoder);
+    utils_hmac_sha1_finish(&post->hmac, post->buf);
 
-        update_time_and_signature(post_buf, upload_size);
-        ret = _post_one_http_to_server(post_buf, upload_size);
+    return payload;
+}
+#endif
+
+/* post logs in place, LOG_BUF_FIXED_HEADER_SIZE bytes in front of log_buf are overwritten by the post header.
+ * With LOG_UPLOAD_COMPRESS, the logs are compressed into a post buffer instead */
+static int post_log_to_server(char *log_buf, size_t log_size, size_t *actual_post_payload)
+{
+    int             ret = QCLOUD_RET_SUCCESS;
+    size_t          post_payload;
+    size_t          post_size;
+    char *          post_buf;
+    Qcloud_IoT_Log *pLogClient = get_log_client();
+    POINTER_CHECK_RET_ERR(pLogClient, QCLOUD_ERR_INVAL);
+
+#ifdef LOG_UPLOAD_COMPRESS
+    LogCompressedPost *post = HAL_Malloc(sizeof(LogCompressedPost));
+    if (post == NULL) {
+        UPLOAD_ERR("malloc compressed post failed");
+        *actual_post_payload = 0;
+        return QCLOUD_ERR_MALLOC;
+    }
+#endif
+
+    /* Log size may be larger than one HTTP post size */
+    /* Fragment the log and upload multi-times */
+    UPLOAD_DBG("to post log size %d", log_size);
+    *actual_post_payload = 0;
+    while (*actual_post_payload < log_size) {
+#ifdef LOG_UPLOAD_COMPRESS
+        post_payload = _compress_post(pLogClient, post, log_buf + *actual_post_payload,
+                                      log_size - *actual_post_payload, MAX_HTTP_LOG_POST_SIZE, &post_size);
+        post_buf     = post->buf;
+#else
+        post_payload = _get_post_payload_size(log_buf + *actual_post_payload, log_size - *actual_post_payload,
+                                              MAX_HTTP_LOG_POST_SIZE);
+        post_size    = post_payload + LOG_BUF_FIXED_HEADER_SIZE;
+
+        /* the logs in front are sent already, no need to move the left ones */
+        post_buf = log_buf + *actual_post_payload - LOG_BUF_FIXED_HEADER_SIZE;
+#endif
+        if (post_payload == 0) {
+            UPLOAD_ERR("Invalid log delimiter. Total sent: %d. Left: %d", *actual_post_payload,
+                       log_size - *actual_post_payload);
+            ret = QCLOUD_ERR_INVAL;
+            break;
+        }
+
+#ifndef LOG_UPLOAD_COMPRESS
+        memcpy(post_buf, pLogClient->log_header, LOG_BUF_FIXED_HEADER_SIZE);
+        update_time_and_signature(post_buf, post_size);
+#endif
+        ret = _post_one_http_to_server(post_buf, post_size);
         if (QCLOUD_RET_SUCCESS != ret) {
-            UPLOAD_ERR("Send log failed. Total sent: %d. Left: %d", *actual_post_payload + LOG_BUF_FIXED_HEADER_SIZE,
-                       post_size);
-            return QCLOUD_ERR_FAILURE;
+            UPLOAD_ERR("Send log failed. Total sent: %d. Left: %d", *actual_post_payload,
+                       log_size - *actual_post_payload);
+            break;
         }
 
-        /* move the left log forward and do next upload */
-        memmove(post_buf + LOG_BUF_FIXED_HEADER_SIZE, post_buf + upload_size, post_size - upload_size);
-        post_payload = upload_size - LOG_BUF_FIXED_HEADER_SIZE;
-        post_size -= post_payload;
         *actual_post_payload += post_payload;
-        memset(post_buf + post_size, 0, orig_post_size - post_size);
-        UPLOAD_DBG("post log %d OK. Total sent: %d. Left: %d", upload_size,
-                   *actual_post_payload + LOG_BUF_FIXED_HEADER_SIZE, post_size);
-    } while (post_size > LOG_BUF_FIXED_HEADER_SIZE);
+        UPLOAD_DBG("post log %d in %d bytes OK. Total sent: %d. Left: %d", post_payload, post_size,
+                   *actual_post_payload, log_size - *actual_post_payload);
+    }
 
-    return QCLOUD_RET_SUCCESS;
+#ifdef LOG_UPLOAD_COMPRESS
+    HAL_Free(post);
+#endif
+
+    return ret;
 }
 
 static int _save_log(char *log_buf, size_t log_size)
@@ -618,6 +737,16 @@ static int _save_log(char *log_buf, size_t log_size)
     if (!pLogClient->log_client_init_done) {
         return QCLOUD_ERR_FAILURE;
     }
+
+    if (pLogClient->log_store) {
+        rc = log_store_append(pLogClient->log_store, log_buf, log_size);
+        if (rc < 0) {
+            Log_e("fail to save log. RC %d - log size %d", rc, log_size);
+            return rc;
+        }
+        return 0;
+    }
+
     current_size = pLogClient->get_size_func();
 
     /* overwrite the previous saved log to avoid too many saved logs */
@@ -639,6 +768,56 @@ static int _save_log(char *log_buf, size_t log_size)
     return rc;
 }
 
+/* post the saved logs a record at a time, only the posted ones are deleted */
+static int _drain_log_store(Qcloud_IoT_Log *pLogClient)
+{
+    LogStore *store    = pLogClient->log_store;
+    size_t    buf_size = LOG_BUF_FIXED_HEADER_SIZE + LOG_STORE_MAX_RECORD;
+    size_t    read_len, actual_post_payload;
+    char *    log_buf;
+    int       rc;
+
+    if (log_store_empty(store)) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    /* only do the job when connection is OK */
+    if (_check_server_connection(pLogClient) != QCLOUD_RET_SUCCESS)
+        return QCLOUD_ERR_FAILURE;
+
+    log_buf = HAL_Malloc(buf_size);
+    if (log_buf == NULL) {
+        Log_e("Malloc failed, size: %u", buf_size);
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    for (;;) {
+        rc = log_store_read(store, log_buf + LOG_BUF_FIXED_HEADER_SIZE, LOG_STORE_MAX_RECORD, &read_len);
+        if (rc != QCLOUD_RET_SUCCESS || read_len == 0) {
+            break;
+        }
+
+        rc = post_log_to_server(log_buf + LOG_BUF_FIXED_HEADER_SIZE, read_len, &actual_post_payload);
+        if (rc != QCLOUD_RET_SUCCESS && rc != QCLOUD_ERR_INVAL) {
+            log_store_rewind(store);
+            break;
+        }
+
+        rc = log_store_commit(store);
+        if (rc != QCLOUD_RET_SUCCESS) {
+            break;
+        }
+    }
+
+    if (store->dropped_segments) {
+        Log_w("%u segments of saved log dropped for lack of room", store->dropped_segments);
+        store->dropped_segments = 0;
+    }
+    HAL_Free(log_buf);
+
+    return rc;
+}
+
 static int _handle_saved_log(void)
 {
     int             rc         = QCLOUD_RET_SUCCESS;
@@ -648,26 +827,24 @@ static int _handle_saved_log(void)
         return QCLOUD_ERR_FAILURE;
     }
 
+    if (pLogClient->log_store) {
+        return _drain_log_store(pLogClient);
+    }
+
     size_t whole_log_size = pLogClient->get_size_func();
     if (whole_log_size > 0) {
         /* only do the job when connection is OK */
         if (_check_server_connection(pLogClient) != QCLOUD_RET_SUCCESS)
             return QCLOUD_ERR_FAILURE;
 
-        size_t buf_size = whole_log_size + LOG_BUF_FIXED_HEADER_SIZE + 1;
+        size_t buf_size = whole_log_size + LOG_BUF_FIXED_HEADER_SIZE;
         char * log_buf  = HAL_Malloc(buf_size);
         if (log_buf != NULL) {
             /* read the whole log to buffer */
             size_t read_len = pLogClient->read_func(log_buf + LOG_BUF_FIXED_HEADER_SIZE, whole_log_size);
             if (read_len == whole_log_size) {
-                size_t upload_size = whole_log_size + LOG_BUF_FIXED_HEADER_SIZE;
-
-                /* copy header from global log buffer */
-                memcpy(log_buf, pLogClient->log_buffer, LOG_BUF_FIXED_HEADER_SIZE);
-                log_buf[buf_size - 1] = 0;
-
                 size_t actual_post_payload;
-                rc = post_log_to_server(log_buf, upload_size, &actual_post_payload);
+                rc = post_log_to_server(log_buf + LOG_BUF_FIXED_HEADER_SIZE, whole_log_size, &actual_post_payload);
                 if (rc == QCLOUD_RET_SUCCESS || rc == QCLOUD_ERR_INVAL) {
                     Log_d("handle saved log done! Size: %d. upload paylod: %d", whole_log_size, actual_post_payload);
                     pLogClient->del_func();
@@ -688,25 +865,43 @@ static int _handle_saved_log(void)
     return rc;
 }
 
+/* leave a log line for the logs dropped by full buffer since last upload */
+static void _report_dropped_log(Qcloud_IoT_Log *pLogClient)
+{
+    char     log_line[128];
+    char     time_str[TIME_FORMAT_STR_LEN] = {0};
+    uint32_t dropped_bytes;
+    uint32_t dropped = log_ring_dropped(&pLogClient->log_ring, &dropped_bytes);
+    int      len;
+
+    if (dropped == pLogClient->reported_dropped) {
+        return;
+    }
+
+    len = HAL_Snprintf(log_line, sizeof(log_line), "WRN|%s|log_upload.c|%s(%d): %u logs dropped, %u bytes in total\r\n",
+                       STRING_PTR_PRINT_SANITY_CHECK(HAL_Timer_current(time_str)), __FUNCTION__, __LINE__,
+                       dropped - pLogClient->reported_dropped, dropped_bytes);
+    if (len > 0 && len < sizeof(log_line) && !append_to_upload_buffer(log_line, len)) {
+        pLogClient->reported_dropped = dropped;
+    }
+}
+
 static bool _check_force_upload(bool force_upload)
 {
     Qcloud_IoT_Log *pLogClient = get_log_client();
     if (!force_upload) {
         /* Double check if the buffer is low */
-        HAL_MutexLock(pLogClient->lock_buf);
-        bool is_low_buffer = (LOG_UPLOAD_BUFFER_SIZE - pLogClient->log_index) < LOG_LOW_BUFFER_THRESHOLD ? true : false;
+        bool is_low_buffer = log_ring_free(&pLogClient->log_ring) < LOG_LOW_BUFFER_THRESHOLD ? true : false;
 
         /* force_upload is false and upload_only_in_comm_err is true */
         if (pLogClient->upload_only_in_comm_err) {
             /* buffer is low but we couldn't upload now, reset buffer */
             if (is_low_buffer) {
-                _reset_log_buffer(pLogClient);
+                log_ring_discard(&pLogClient->log_ring);
             }
-            HAL_MutexUnlock(pLogClient->lock_buf);
             countdown_ms(&pLogClient->upload_timer, LOG_UPLOAD_INTERVAL_MS);
             return false;
         }
-        HAL_MutexUnlock(pLogClient->lock_buf);
 
         if (is_low_buffer) {
             /* buffer is low, handle it right now */
@@ -720,10 +915,223 @@ static bool _check_force_upload(bool force_upload)
     }
 }
 
+#ifdef LOG_UPLOAD_MQTT
+void log_mqtt_upload_on_puback(void *client, uint16_t packet_id)
+{
+    Qcloud_IoT_Log *pLogClient = get_log_client();
+    LogMQTTMessage *msg;
+    int             i;
+
+    if (pLogClient == NULL || !pLogClient->log_client_init_done || client != pLogClient->mqtt_client) {
+        return;
+    }
+
+    HAL_MutexLock(pLogClient->inflight_lock);
+    for (i = 0; i < pLogClient->inflight_num; i++) {
+        msg = &pLogClient->inflight[(pLogClient->inflight_head + i) % LOG_MQTT_MAX_INFLIGHT];
+        if (msg->packet_id == packet_id) {
+            msg->acked = true;
+            break;
+        }
+    }
+
+    /* may be the ack of the message being published, its id is known when the publish returns */
+    if (i == pLogClient->inflight_num && pLogClient->early_ack_num < LOG_MQTT_MAX_INFLIGHT) {
+        pLogClient->early_acks[pLogClient->early_ack_num++] = packet_id;
+    }
+    HAL_MutexUnlock(pLogClient->inflight_lock);
+}
+
+/* a message is published with its slot taken and its id pending, lock held */
+static void _start_log_mqtt_publish(Qcloud_IoT_Log *pLogClient, LogMQTTMessage *msg)
+{
+    msg->packet_id            = LOG_MQTT_PACKET_ID_PENDING;
+    msg->acked                = false;
+    pLogClient->early_ack_num = 0;
+}
+
+/* record the id of the message published, and the ack that came before it */
+static void _finish_log_mqtt_publish(Qcloud_IoT_Log *pLogClient, LogMQTTMessage *msg, int rc)
+{
+    int i;
+
+    if (rc < 0) {
+        return;
+    }
+
+    HAL_MutexLock(pLogClient->inflight_lock);
+    msg->packet_id = rc;
+    for (i = 0; i < pLogClient->early_ack_num; i++) {
+        if (pLogClient->early_acks[i] == msg->packet_id) {
+            msg->acked = true;
+        }
+    }
+    pLogClient->early_ack_num = 0;
+    HAL_MutexUnlock(pLogClient->inflight_lock);
+
+    countdown_ms(&msg->ack_timer, LOG_MQTT_ACK_TIMEOUT_MS);
+}
+
+/* publish the logs that fit in one message, return the packet id or err code. The post header is built in front of
+ * the logs and the bytes there are put back after, the logs stay in the ring for republishing until acked */
+static int _publish_log_message(Qcloud_IoT_Log *pLogClient, char *log_buf, size_t log_size, size_t *payload)
+{
+    PublishParams pub_params = DEFAULT_PUB_PARAMS;
+    size_t        post_size;
+    int           rc;
+
+#ifdef LOG_UPLOAD_COMPRESS
+    LogCompressedPost *post = HAL_Malloc(sizeof(LogCompressedPost));
+    if (post == NULL) {
+        UPLOAD_ERR("malloc compressed post failed");
+        return QCLOUD_ERR_MALLOC;
+    }
+
+    *payload           = _compress_post(pLogClient, post, log_buf, log_size, LOG_MQTT_MAX_POST_SIZE, &post_size);
+    pub_params.payload = post->buf;
+#else
+    char  saved[LOG_BUF_FIXED_HEADER_SIZE];
+    char *post_buf = log_buf - LOG_BUF_FIXED_HEADER_SIZE;
+
+    *payload  = _get_post_payload_size(log_buf, log_size, LOG_MQTT_MAX_POST_SIZE);
+    post_size = *payload + LOG_BUF_FIXED_HEADER_SIZE;
+    if (*payload) {
+        memcpy(saved, post_buf, LOG_BUF_FIXED_HEADER_SIZE);
+        memcpy(post_buf, pLogClient->log_header, LOG_BUF_FIXED_HEADER_SIZE);
+        update_time_and_signature(post_buf, post_size);
+    }
+    pub_params.payload = post_buf;
+#endif
+
+    if (*payload == 0) {
+        UPLOAD_ERR("Invalid log delimiter. Left: %d", log_size);
+        rc = QCLOUD_ERR_INVAL;
+    } else {
+        pub_params.qos         = QOS1;
+        pub_params.payload_len = post_size;
+        rc = IOT_MQTT_Publish(pLogClient->mqtt_client, pLogClient->mqtt_topic, &pub_params);
+        if (rc < 0) {
+            UPLOAD_ERR("publish log failed, rc = %d", rc);
+        }
+    }
+
+#ifdef LOG_UPLOAD_COMPRESS
+    HAL_Free(post);
+#else
+    if (*payload) {
+        memcpy(post_buf, saved, LOG_BUF_FIXED_HEADER_SIZE);
+    }
+#endif
+
+    return rc;
+}
+
+/* stop tracking the messages in flight, their logs go on by HTTP and may reach the server twice */
+static void _reset_log_mqtt_inflight(Qcloud_IoT_Log *pLogClient)
+{
+    if (pLogClient->ring_claimed) {
+        log_ring_release(&pLogClient->log_ring, 0);
+        pLogClient->ring_claimed = false;
+    }
+    HAL_MutexLock(pLogClient->inflight_lock);
+    pLogClient->inflight_num = 0;
+    HAL_MutexUnlock(pLogClient->inflight_lock);
+    pLogClient->inflight_bytes = 0;
+}
+
+/* publish the logs over the MQTT connection, ring space is freed as the messages in front are acked */
+static int _upload_log_by_mqtt(Qcloud_IoT_Log *pLogClient)
+{
+    LogMQTTMessage *msg;
+    char *          log_span;
+    size_t          log_size, payload, offset;
+    size_t          acked = 0;
+    int             rc    = QCLOUD_RET_SUCCESS;
+    int             i;
+    bool            expired_msg;
+
+    HAL_MutexLock(pLogClient->inflight_lock);
+    while (pLogClient->inflight_num && pLogClient->inflight[pLogClient->inflight_head].acked) {
+        acked += pLogClient->inflight[pLogClient->inflight_head].payload;
+        pLogClient->inflight_head = (pLogClient->inflight_head + 1) % LOG_MQTT_MAX_INFLIGHT;
+        pLogClient->inflight_num--;
+    }
+    HAL_MutexUnlock(pLogClient->inflight_lock);
+    pLogClient->inflight_bytes -= acked;
+
+    if (pLogClient->ring_claimed) {
+        log_ring_reclaim(&pLogClient->log_ring, acked, &log_span, &log_size);
+    } else if (log_ring_claim(&pLogClient->log_ring, &log_span, &log_size) == QCLOUD_RET_SUCCESS) {
+        pLogClient->ring_claimed = true;
+    } else {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    /* republish the messages not acked in time, all of them lie in the span one after another */
+    for (i = 0, offset = 0; i < pLogClient->inflight_num && rc >= 0; i++, offset += msg->payload) {
+        msg = &pLogClient->inflight[(pLogClient->inflight_head + i) % LOG_MQTT_MAX_INFLIGHT];
+        HAL_MutexLock(pLogClient->inflight_lock);
+        expired_msg = !msg->acked && expired(&msg->ack_timer);
+        if (expired_msg) {
+            UPLOAD_DBG("republish log message %u of %u bytes", msg->packet_id, msg->payload);
+            _start_log_mqtt_publish(pLogClient, msg);
+        }
+        HAL_MutexUnlock(pLogClient->inflight_lock);
+        if (!expired_msg) {
+            continue;
+        }
+
+        rc = _publish_log_message(pLogClient, log_span + offset, msg->payload, &payload);
+        _finish_log_mqtt_publish(pLogClient, msg, rc);
+    }
+
+    while (rc >= 0 && pLogClient->inflight_num < LOG_MQTT_MAX_INFLIGHT && pLogClient->inflight_bytes < log_size) {
+        /* the slot is counted before publishing, the ack may come from the yield thread before the publish returns */
+        HAL_MutexLock(pLogClient->inflight_lock);
+        msg = &pLogClient->inflight[(pLogClient->inflight_head + pLogClient->inflight_num) % LOG_MQTT_MAX_INFLIGHT];
+        _start_log_mqtt_publish(pLogClient, msg);
+        pLogClient->inflight_num++;
+        HAL_MutexUnlock(pLogClient->inflight_lock);
+
+        rc = _publish_log_message(pLogClient, log_span + pLogClient->inflight_bytes,
+                                  log_size - pLogClient->inflight_bytes, &payload);
+        _finish_log_mqtt_publish(pLogClient, msg, rc);
+        if (rc < 0) {
+            HAL_MutexLock(pLogClient->inflight_lock);
+            pLogClient->inflight_num--;
+            HAL_MutexUnlock(pLogClient->inflight_lock);
+        }
+
+        if (rc == QCLOUD_ERR_INVAL && pLogClient->inflight_num == 0) {
+            /* no way to cut the logs into messages, drop them */
+            log_ring_reclaim(&pLogClient->log_ring, log_size, &log_span, &log_size);
+            break;
+        }
+        if (rc < 0) {
+            break;
+        }
+
+        msg->payload = payload;
+        pLogClient->inflight_bytes += payload;
+    }
+
+    /* nothing in flight, let the ring go for the overwrite policy and clear_upload_buffer */
+    if (pLogClient->inflight_num == 0) {
+        log_ring_release(&pLogClient->log_ring, 0);
+        pLogClient->ring_claimed = false;
+    }
+
+    return rc < 0 ? rc : QCLOUD_RET_SUCCESS;
+}
+#endif
+
 int do_log_upload(bool force_upload)
 {
-    int         rc;
-    int         upload_log_size    = 0;
+    int         rc = QCLOUD_RET_SUCCESS;
+    int         i;
+    char *      log_span;
+    size_t      log_size;
+    size_t      actual_post_payload;
     static bool unhandle_saved_log = true;
 
     Qcloud_IoT_Log *pLogClient = get_log_client();
@@ -744,50 +1152,48 @@ int do_log_upload(bool force_upload)
         }
     }
 
-    /* no more log in buffer */
-    if (pLogClient->log_index == LOG_BUF_FIXED_HEADER_SIZE) {
+    _report_dropped_log(pLogClient);
+
+#ifdef LOG_UPLOAD_MQTT
+    /* logs go over the live MQTT connection, HTTP posts are only for the time it is down */
+    if (pLogClient->mqtt_client && IOT_MQTT_IsConnected(pLogClient->mqtt_client)) {
+        _upload_log_by_mqtt(pLogClient);
+        countdown_ms(&pLogClient->upload_timer, LOG_UPLOAD_INTERVAL_MS);
         return QCLOUD_RET_SUCCESS;
     }
+    _reset_log_mqtt_inflight(pLogClient);
+#endif
 
-    HAL_MutexLock(pLogClient->lock_buf);
-    upload_log_size = pLogClient->log_index;
-    HAL_MutexUnlock(pLogClient->lock_buf);
+    /* committed logs are at most two spans, before and after the ring wraps */
+    for (i = 0; i < 2; i++) {
+        if (log_ring_claim(&pLogClient->log_ring, &log_span, &log_size) != QCLOUD_RET_SUCCESS) {
+            return QCLOUD_RET_SUCCESS;
+        }
 
-    size_t actual_post_payload;
-    rc = post_log_to_server(pLogClient->log_buffer, upload_log_size, &actual_post_payload);
-    if (rc != QCLOUD_RET_SUCCESS) {
-        /* save log via user callbacks when log upload fail */
-        if (pLogClient->log_save_enabled) {
-            /* new error logs should have been added, update log size */
-            HAL_MutexLock(pLogClient->lock_buf);
-            /* parts of log were uploaded succesfully. Need to move the new logs
-             * forward */
-            if (actual_post_payload) {
-                UPLOAD_DBG("move the new log %d forward", actual_post_payload);
-                memmove(pLogClient->log_buffer + upload_log_size - actual_post_payload,
-                        pLogClient->log_buffer + upload_log_size, pLogClient->log_index - upload_log_size);
-                pLogClient->log_index = pLogClient->log_index - actual_post_payload;
-                memset(pLogClient->log_buffer + pLogClient->log_index, 0,
-                       LOG_UPLOAD_BUFFER_SIZE - pLogClient->log_index);
-            }
-            upload_log_size = pLogClient->log_index;
-            HAL_MutexUnlock(pLogClient->lock_buf);
-            _save_log(pLogClient->log_buffer + LOG_BUF_FIXED_HEADER_SIZE, upload_log_size - LOG_BUF_FIXED_HEADER_SIZE);
+        /* no more log in buffer */
+        if (log_size == 0) {
+            log_ring_release(&pLogClient->log_ring, 0);
+            break;
+        }
+
+        /* the span is posted in place, and the new logs go on into the ring meanwhile */
+        rc = post_log_to_server(log_span, log_size, &actual_post_payload);
+        if (rc != QCLOUD_RET_SUCCESS && pLogClient->log_save_enabled) {
+            /* save log via user callbacks when log upload fail */
+            _save_log(log_span + actual_post_payload, log_size - actual_post_payload);
             unhandle_saved_log = true;
         }
+        log_ring_release(&pLogClient->log_ring, log_size);
+
+        if (rc != QCLOUD_RET_SUCCESS) {
+            break;
+        }
     }
 
-    /* move the new log during send_log_to_server */
-    HAL_MutexLock(pLogClient->lock_buf);
-    if (upload_log_size == pLogClient->log_index) {
-        _reset_log_buffer(pLogClient);
-    } else {
-        memmove(pLogClient->log_buffer + LOG_BUF_FIXED_HEADER_SIZE, pLogClient->log_buffer + upload_log_size,
-                pLogClient->log_index - upload_log_size);
-        pLogClient->log_index = pLogClient->log_index - upload_log_size + LOG_BUF_FIXED_HEADER_SIZE;
-        memset(pLogClient->log_buffer + pLogClient->log_index, 0, LOG_UPLOAD_BUFFER_SIZE - pLogClient->log_index);
+    /* nothing posted */
+    if (i == 0 && log_size == 0) {
+        return QCLOUD_RET_SUCCESS;
     }
-    HAL_MutexUnlock(pLogClient->lock_buf);
     countdown_ms(&pLogClient->upload_timer, LOG_UPLOAD_INTERVAL_MS);
 
     return QCLOUD_RET_SUCCESS;
@@ -212,6 +212,12 @@ int IOT_MQTT_Yield(void *pClient, uint32_t timeout_ms)
 
     int rc = qcloud_iot_mqtt_yield(mqtt_client, timeout_ms);
 
+#ifdef SYSTEM_COMM
+    if (rc == QCLOUD_RET_SUCCESS) {
+        qcloud_iot_sys_time_sync(mqtt_client);
+    }
+#endif
+
 #ifdef LOG_UPLOAD
     /* do instant log uploading if MQTT communication error */
     if (rc == QCLOUD_RET_SUCCESS)
@@ -284,6 +290,13 @@ static void _mqtt_yield_thread(void *ptr)
     while (mqtt_client->yield_thread_running) {
         rc = qcloud_iot_mqtt_yield(mqtt_client, 200);
 
+#ifdef SYSTEM_COMM
+        /* IOT_MQTT_Yield returns at once while this thread runs, the time is synced here */
+        if (rc == QCLOUD_RET_SUCCESS) {
+            qcloud_iot_sys_time_sync(mqtt_client);
+        }
+#endif
+
 #ifdef LOG_UPLOAD
         /* do instant log uploading if MQTT communication error */
         if (rc == QCLOUD_RET_SUCCESS)
@@ -302,9 +315,9 @@ static void _mqtt_yield_thread(void *ptr)
         }
         if (rc != QCLOUD_RET_SUCCESS && rc != QCLOUD_RET_MQTT_RECONNECTED) {
             Log_e("MQTT Yield thread error: %d", rc);
+            /* yield already blocks on the network, sleep only if it failed at once */
+            HAL_SleepMs(200);
         }
-
-        HAL_SleepMs(200);
     }
 
     mqtt_client->yield_thread_running   = false;
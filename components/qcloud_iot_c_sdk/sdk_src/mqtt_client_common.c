@@ -23,6 +23,7 @@ extern "C" {
 #include <string.h>
 #include <time.h>
 
+#include "log_upload.h"
 #include "mqtt_client.h"
 #include "utils_list.h"
 
@@ -690,7 +691,7 @@ static uint8_t _is_topic_equals(char *topic_filter, char *topicName)
  * @param topicNameLen  length of topic name
  * @return
  */
-static uint8_t _is_topic_matched(char *topic_filter, char *topicName, uint16_t topicNameLen)
+uint8_t mqtt_is_topic_matched(char *topic_filter, char *topicName, uint16_t topicNameLen)
 {
     char *curf;
     char *curn;
@@ -752,18 +753,22 @@ static int _deliver_message(Qcloud_IoT_Client *pClient, char *topicName, uint16_
     message->ptopic    = topicName;
     message->topic_len = (size_t)topicNameLen;
 
-    uint32_t i;
+    uint32_t i, pass;
     HAL_MutexLock(pClient->lock_generic);
-    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-        if ((pClient->sub_handles[i].topic_filter != NULL) &&
-            (_is_topic_equals(topicName, (char *)pClient->sub_handles[i].topic_filter) ||
-             _is_topic_matched((char *)pClient->sub_handles[i].topic_filter, topicName, topicNameLen))) {
-            HAL_MutexUnlock(pClient->lock_generic);
-            if (pClient->sub_handles[i].message_handler != NULL) {
-                pClient->sub_handles[i].message_handler(pClient, message, pClient->sub_handles[i].handler_user_data);
-                IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+    /* exact subscriptions first, so a wildcard one like a gateway route doesn't take their messages */
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
+            if ((pClient->sub_handles[i].topic_filter != NULL) &&
+                (pass ? mqtt_is_topic_matched((char *)pClient->sub_handles[i].topic_filter, topicName, topicNameLen)
+                      : _is_topic_equals(topicName, (char *)pClient->sub_handles[i].topic_filter))) {
+                HAL_MutexUnlock(pClient->lock_generic);
+                if (pClient->sub_handles[i].message_handler != NULL) {
+                    pClient->sub_handles[i].message_handler(pClient, message,
+                                                            pClient->sub_handles[i].handler_user_data);
+                    IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
+                }
+                HAL_MutexLock(pClient->lock_generic);
             }
-            HAL_MutexLock(pClient->lock_generic);
         }
     }
 
@@ -899,6 +904,10 @@ static int _handle_puback_packet(Qcloud_IoT_Client *pClient, Timer *timer)
 
     (void)_mask_pubInfo_from(pClient, packet_id);
 
+#ifdef LOG_UPLOAD_MQTT
+    log_mqtt_upload_on_puback(pClient, packet_id);
+#endif
+
     /* notify this event to user callback */
     if (NULL != pClient->event_handle.h_fp) {
         MQTTEventMsg msg;
@@ -258,9 +258,9 @@ int serialize_pub_ack_packet(unsigned char *buf, size_t buf_len, MessageTypes pa
  * @param payload_len integer - the length of the MQTT payload
  * @return the length of the serialized data.  <= 0 indicates error
  */
-static int _serialize_publish_packet(unsigned char *buf, size_t buf_len, uint8_t dup, QoS qos, uint8_t retained,
-                                     uint16_t packet_id, char *topicName, unsigned char *payload, size_t payload_len,
-                                     uint32_t *serialized_len)
+int serialize_publish_packet(unsigned char *buf, size_t buf_len, uint8_t dup, QoS qos, uint8_t retained,
+                             uint16_t packet_id, char *topicName, unsigned char *payload, size_t payload_len,
+                             uint32_t *serialized_len)
 {
     IOT_FUNC_ENTRY;
     POINTER_SANITY_CHECK(buf, QCLOUD_ERR_INVAL);
@@ -301,6 +301,51 @@ static int _serialize_publish_packet(unsigned char *buf, size_t buf_len, uint8_t
     IOT_FUNC_EXIT_RC(QCLOUD_RET_SUCCESS);
 }
 
+static int _check_publish_params(Qcloud_IoT_Client *pClient, char *topicName, PublishParams *pParams)
+{
+    if (strlen(topicName) > MAX_SIZE_OF_CLOUD_TOPIC) {
+        return QCLOUD_ERR_MAX_TOPIC_LENGTH;
+    }
+
+    if (pParams->qos == QOS2) {
+        Log_e("QoS2 is not supported currently");
+        return QCLOUD_ERR_MQTT_QOS_NOT_SUPPORT;
+    }
+
+    if (!get_client_conn_state(pClient)) {
+        return QCLOUD_ERR_MQTT_NO_CONN;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* send the publish packet serialized in write_buf, lock_write_buf must be held */
+static int _send_publish_packet(Qcloud_IoT_Client *pClient, PublishParams *pParams, uint32_t len, Timer *timer)
+{
+    ListNode *node = NULL;
+    int       rc;
+
+    if (pParams->qos > QOS0) {
+        rc = _mask_push_pubInfo_to(pClient, len, pParams->id, &node);
+        if (QCLOUD_RET_SUCCESS != rc) {
+            Log_e("push publish into to pubInfolist failed!");
+            return rc;
+        }
+    }
+
+    /* send the publish packet */
+    rc = send_mqtt_packet(pClient, len, timer);
+    if (QCLOUD_RET_SUCCESS != rc) {
+        if (pParams->qos > QOS0) {
+            HAL_MutexLock(pClient->lock_list_pub);
+            qcloud_list_remove(pClient->list_pub_wait_ack, node);
+            HAL_MutexUnlock(pClient->lock_list_pub);
+        }
+    }
+
+    return rc;
+}
+
 int qcloud_iot_mqtt_publish(Qcloud_IoT_Client *pClient, char *topicName, PublishParams *pParams)
 {
     IOT_FUNC_ENTRY;
@@ -313,20 +358,9 @@ int qcloud_iot_mqtt_publish(Qcloud_IoT_Client *pClient, char *topicName, Publish
     uint32_t len = 0;
     int      rc;
 
-    ListNode *node = NULL;
-
-    size_t topicLen = strlen(topicName);
-    if (topicLen > MAX_SIZE_OF_CLOUD_TOPIC) {
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MAX_TOPIC_LENGTH);
-    }
-
-    if (pParams->qos == QOS2) {
-        Log_e("QoS2 is not supported currently");
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_QOS_NOT_SUPPORT);
-    }
-
-    if (!get_client_conn_state(pClient)) {
-        IOT_FUNC_EXIT_RC(QCLOUD_ERR_MQTT_NO_CONN);
+    rc = _check_publish_params(pClient, topicName, pParams);
+    if (QCLOUD_RET_SUCCESS != rc) {
+        IOT_FUNC_EXIT_RC(rc);
     }
 
     InitTimer(&timer);
@@ -350,37 +384,96 @@ int qcloud_iot_mqtt_publish(Qcloud_IoT_Client *pClient, char *topicName, Publish
         }
     }
 
-    rc = _serialize_publish_packet(pClient->write_buf, pClient->write_buf_size, 0, pParams->qos, pParams->retained,
-                                   pParams->id, topicName, (unsigned char *)pParams->payload, pParams->payload_len,
-                                   &len);
+    rc = serialize_publish_packet(pClient->write_buf, pClient->write_buf_size, 0, pParams->qos, pParams->retained,
+                                  pParams->id, topicName, (unsigned char *)pParams->payload, pParams->payload_len,
+                                  &len);
     if (QCLOUD_RET_SUCCESS != rc) {
         HAL_MutexUnlock(pClient->lock_write_buf);
         IOT_FUNC_EXIT_RC(rc);
     }
 
-    if (pParams->qos > QOS0) {
-        rc = _mask_push_pubInfo_to(pClient, len, pParams->id, &node);
-        if (QCLOUD_RET_SUCCESS != rc) {
-            Log_e("push publish into to pubInfolist failed!");
-            HAL_MutexUnlock(pClient->lock_write_buf);
-            IOT_FUNC_EXIT_RC(rc);
-        }
+    rc = _send_publish_packet(pClient, pParams, len, &timer);
+    HAL_MutexUnlock(pClient->lock_write_buf);
+    if (QCLOUD_RET_SUCCESS != rc) {
+        IOT_FUNC_EXIT_RC(rc);
     }
 
-    /* send the publish packet */
-    rc = send_mqtt_packet(pClient, len, &timer);
+    IOT_FUNC_EXIT_RC(pParams->id);
+}
+
+int qcloud_iot_mqtt_publish_by_writer(Qcloud_IoT_Client *pClient, char *topicName, PublishParams *pParams,
+                                      MQTTPayloadWriter writer, void *ctx)
+{
+    IOT_FUNC_ENTRY;
+
+    POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(pParams, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(writer, QCLOUD_ERR_INVAL);
+    STRING_PTR_SANITY_CHECK(topicName, QCLOUD_ERR_INVAL);
+
+    Timer          timer;
+    unsigned char  header[5];
+    unsigned char *ptr;
+    uint32_t       rem_len, header_len, max_header_len, var_header_len;
+    int            payload_len;
+    int            rc;
+
+    rc = _check_publish_params(pClient, topicName, pParams);
     if (QCLOUD_RET_SUCCESS != rc) {
-        if (pParams->qos > QOS0) {
-            HAL_MutexLock(pClient->lock_list_pub);
-            qcloud_list_remove(pClient->list_pub_wait_ack, node);
-            HAL_MutexUnlock(pClient->lock_list_pub);
-        }
+        IOT_FUNC_EXIT_RC(rc);
+    }
 
-        HAL_MutexUnlock(pClient->lock_write_buf);
+    rc = mqtt_init_packet_header(&header[0], PUBLISH, pParams->qos, 0, pParams->retained);
+    if (QCLOUD_RET_SUCCESS != rc) {
         IOT_FUNC_EXIT_RC(rc);
     }
 
+    /* reserve room for the longest fixed header the send buffer can need */
+    max_header_len = 1 + mqtt_write_packet_rem_len(&header[1], pClient->write_buf_size);
+    var_header_len = _get_publish_packet_len(pParams->qos, topicName, 0);
+    if (max_header_len + var_header_len >= pClient->write_buf_size) {
+        IOT_FUNC_EXIT_RC(QCLOUD_ERR_BUF_TOO_SHORT);
+    }
+
+    InitTimer(&timer);
+    countdown_ms(&timer, pClient->command_timeout_ms);
+
+    HAL_MutexLock(pClient->lock_write_buf);
+    if (pParams->qos == QOS1) {
+        pParams->id = get_next_packet_id(pClient);
+    }
+
+    ptr = pClient->write_buf + max_header_len;
+    mqtt_write_utf8_string(&ptr, topicName);
+    if (pParams->qos > 0) {
+        mqtt_write_uint_16(&ptr, pParams->id);
+    }
+
+    payload_len = writer(ptr, pClient->write_buf_size - (ptr - pClient->write_buf), ctx);
+    if (payload_len < 0) {
+        HAL_MutexUnlock(pClient->lock_write_buf);
+        IOT_FUNC_EXIT_RC(payload_len);
+    }
+
+    if (IOT_Log_Get_Level() <= eLOG_DEBUG) {
+        Log_d("publish packetID=%d|topicName=%s|payload=%.*s", pParams->id, topicName, payload_len, (char *)ptr);
+    } else {
+        Log_i("publish packetID=%d|topicName=%s", pParams->id, topicName);
+    }
+
+    /* patch the fixed header, only short packets need a shorter one and are moved */
+    rem_len    = var_header_len + payload_len;
+    header_len = 1 + mqtt_write_packet_rem_len(&header[1], rem_len);
+    if (header_len < max_header_len) {
+        memmove(pClient->write_buf + header_len, pClient->write_buf + max_header_len, rem_len);
+    }
+    memcpy(pClient->write_buf, header, header_len);
+
+    rc = _send_publish_packet(pClient, pParams, header_len + rem_len, &timer);
     HAL_MutexUnlock(pClient->lock_write_buf);
+    if (QCLOUD_RET_SUCCESS != rc) {
+        IOT_FUNC_EXIT_RC(rc);
+    }
 
     IOT_FUNC_EXIT_RC(pParams->id);
 }
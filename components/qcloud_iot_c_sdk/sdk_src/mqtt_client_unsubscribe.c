@@ -118,9 +118,9 @@ int qcloud_iot_mqtt_unsubscribe(Qcloud_IoT_Client *pClient, char *topicFilter)
     /* Remove from message handler array */
     HAL_MutexLock(pClient->lock_generic);
     for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-        if ((pClient->sub_handles[i].topic_filter != NULL &&
-             !strcmp(pClient->sub_handles[i].topic_filter, topicFilter)) ||
-            strstr(topicFilter, "/#") != NULL || strstr(topicFilter, "/+") != NULL) {
+        /* a wildcard filter is stored as given, so it only matches itself */
+        if (pClient->sub_handles[i].topic_filter != NULL &&
+            !strcmp(pClient->sub_handles[i].topic_filter, topicFilter)) {
             /* notify this event to topic subscriber */
             if (NULL != pClient->sub_handles[i].sub_event_handler)
                 pClient->sub_handles[i].sub_event_handler(pClient, MQTT_EVENT_UNSUBSCRIBE,
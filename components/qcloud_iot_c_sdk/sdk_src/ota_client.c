@@ -75,7 +75,7 @@ static void _ota_callback(void *pcontext, const char *msg, uint32_t msg_len)
 {
 #define OTA_JSON_TYPE_VALUE_LENGTH 64
 
-    char *json_type = NULL;
+    char json_type[OTA_JSON_TYPE_VALUE_LENGTH];
 
     OTA_Struct_t *h_ota = (OTA_Struct_t *)pcontext;
 
@@ -89,7 +89,7 @@ static void _ota_callback(void *pcontext, const char *msg, uint32_t msg_len)
         return;
     }
 
-    if (qcloud_otalib_get_firmware_type(msg, &json_type) != QCLOUD_RET_SUCCESS) {
+    if (qcloud_otalib_get_firmware_type(msg, json_type, sizeof(json_type)) != QCLOUD_RET_SUCCESS) {
         Log_e("Get firmware type failed!");
         goto End;
     }
@@ -105,18 +105,11 @@ static void _ota_callback(void *pcontext, const char *msg, uint32_t msg_len)
         goto End;
     } else {
         if (strcmp(json_type, UPDATE_FIRMWARE) != 0) {
-            Log_e("Netheir Report version result nor update firmware! type: %s",
-                  STRING_PTR_PRINT_SANITY_CHECK(json_type));
+            Log_e("Netheir Report version result nor update firmware! type: %s", json_type);
             goto End;
         }
 
-        if (NULL != json_type) {
-            HAL_Free(json_type);
-            json_type = NULL;
-        }
-
-        if (0 != qcloud_otalib_get_params(msg, &json_type, &h_ota->purl, &h_ota->version, h_ota->md5sum,
-                                          &h_ota->size_file)) {
+        if (0 != qcloud_otalib_get_params(msg, &h_ota->purl, &h_ota->version, h_ota->md5sum, &h_ota->size_file)) {
             Log_e("Get firmware parameter failed");
             goto End;
         }
@@ -125,9 +118,6 @@ static void _ota_callback(void *pcontext, const char *msg, uint32_t msg_len)
     }
 
 End:
-    if (json_type != NULL)
-        HAL_Free(json_type);
-
 #undef OTA_JSON_TYPE_VALUE_LENGTH
 }
 
@@ -25,7 +25,10 @@ extern "C" {
 
 #include <string.h>
 
+#include "log_async_print.h"
+#include "log_binary.h"
 #include "log_upload.h"
+#include "qcloud_iot_export_error.h"
 #include "qcloud_iot_export_log.h"
 #include "qcloud_iot_import.h"
 
@@ -41,6 +44,35 @@ LOG_LEVEL g_log_upload_level = eLOG_ERROR;
 LOG_LEVEL g_log_upload_level = eLOG_DISABLE;
 #endif
 
+#ifdef LOG_RATE_LIMIT_ENABLED
+typedef struct {
+    uint16_t burst;
+    uint32_t interval_ms;
+} LogRateLimit;
+
+/* token bucket of one call site */
+typedef struct {
+    const char *file;
+    int         line;
+    uint16_t    tokens;
+    uint32_t    refill_ms;
+    uint32_t    suppressed;
+} LogRateSite;
+
+static LogRateLimit sg_log_rate_limit[] = {{0, 0},
+                                           {LOG_RATE_LIMIT_BURST, LOG_RATE_LIMIT_INTERVAL_MS},
+                                           {LOG_RATE_LIMIT_BURST, LOG_RATE_LIMIT_INTERVAL_MS},
+                                           {0, 0},
+                                           {0, 0}};
+
+/* storms come from a few call sites at a time, so a small table is kept instead of one bucket per call site.
+ * There is no lock on the log path, counts may be a little off when threads race on a site. */
+static LogRateSite sg_log_rate_sites[LOG_RATE_LIMIT_SITES];
+
+/* logs suppressed at sites which are no longer tracked */
+static uint32_t sg_log_rate_evicted = 0;
+#endif
+
 static const char *_get_filename(const char *p)
 {
 #ifdef WIN32
@@ -110,11 +142,126 @@ int IOT_Log_Upload(bool force_upload)
 #endif
 }
 
-void IOT_Log_Gen(const char *file, const char *func, const int line, const int level, const char *fmt, ...)
+void IOT_Log_Set_Rate_Limit(LOG_LEVEL level, uint16_t burst, uint32_t interval_ms)
 {
-    if (level > g_log_print_level && level > g_log_upload_level) {
+#ifdef LOG_RATE_LIMIT_ENABLED
+    if (level > eLOG_DISABLE && level <= eLOG_DEBUG) {
+        sg_log_rate_limit[level].burst       = burst;
+        sg_log_rate_limit[level].interval_ms = interval_ms ? interval_ms : 1;
+    }
+#endif
+}
+
+int IOT_Log_Start_Async_Print(LogAsyncPrintParams *params)
+{
+#ifdef LOG_ASYNC_PRINT_ENABLED
+    return init_log_async_print(params);
+#else
+    return QCLOUD_ERR_FAILURE;
+#endif
+}
+
+void IOT_Log_Stop_Async_Print(void)
+{
+#ifdef LOG_ASYNC_PRINT_ENABLED
+    fini_log_async_print();
+#endif
+}
+
+#if defined(LOG_UPLOAD) && defined(LOG_UPLOAD_BINARY)
+/* upload the raw arguments, the record is formatted by tools/log_decoder.py */
+static void _append_binary_log(const char *file, const char *func, const int line, const int level,
+                               const char *fmt, va_list ap)
+{
+    char record_line[LOG_BINARY_MAX_LINE_LEN];
+    int  len = log_binary_encode(record_line, sizeof(record_line), file, func, line, level, fmt, ap);
+
+    if (len > 0) {
+        append_to_upload_buffer(record_line, len);
+    }
+}
+#endif
+
+#ifdef LOG_RATE_LIMIT_ENABLED
+static LogRateSite *_get_rate_site(const char *file, int line, uint16_t burst, uint32_t now)
+{
+    LogRateSite *site, *victim = sg_log_rate_sites;
+    int          i;
+
+    for (i = 0; i < LOG_RATE_LIMIT_SITES; i++) {
+        site = &sg_log_rate_sites[i];
+        if (site->file && site->line == line && (site->file == file || !strcmp(site->file, file))) {
+            return site;
+        }
+
+        /* take a free site, or the one idle for the longest time */
+        if (victim->file && (!site->file || now - site->refill_ms > now - victim->refill_ms)) {
+            victim = site;
+        }
+    }
+
+    sg_log_rate_evicted += victim->suppressed;
+    victim->file       = file;
+    victim->line       = line;
+    victim->tokens     = burst;
+    victim->refill_ms  = now;
+    victim->suppressed = 0;
+
+    return victim;
+}
+
+/* return false if the log is suppressed, or the number of logs suppressed before it in *suppressed */
+static bool _log_rate_check(const char *file, int line, int level, uint32_t *suppressed)
+{
+    LogRateLimit *limit = &sg_log_rate_limit[level];
+    LogRateSite * site;
+    uint32_t      now, earned;
+
+    *suppressed = 0;
+    if (!limit->burst) {
+        return true;
+    }
+
+    now  = HAL_GetTimeMs();
+    site = _get_rate_site(file, line, limit->burst, now);
+    earned = (now - site->refill_ms) / limit->interval_ms;
+    if (site->tokens + earned >= limit->burst) {
+        site->tokens    = limit->burst;
+        site->refill_ms = now;
+    } else if (earned) {
+        site->tokens += earned;
+        site->refill_ms += earned * limit->interval_ms;
+    }
+
+    if (!site->tokens) {
+        site->suppressed++;
+        return false;
+    }
+
+    site->tokens--;
+    *suppressed      = site->suppressed;
+    site->suppressed = 0;
+
+    return true;
+}
+#endif
+
+static void _log_gen_v(const char *file, const char *func, const int line, const int level, const char *fmt,
+                       va_list ap)
+{
+#if defined(LOG_UPLOAD) && defined(LOG_UPLOAD_BINARY)
+    if (level <= g_log_upload_level) {
+        va_list args;
+        va_copy(args, ap);
+        _append_binary_log(file, func, line, level, fmt, args);
+        va_end(args);
+    }
+
+    /* no formatting at all if the log is only uploaded */
+    if (level > g_log_print_level) {
         return;
     }
+#endif
 
     /* format log content */
     const char *file_name = _get_filename(file);
@@ -129,14 +276,11 @@ void IOT_Log_Gen(const char *file, const char *func, const int line, const int l
                       STRING_PTR_PRINT_SANITY_CHECK(HAL_Timer_current(time_str)),
                       STRING_PTR_PRINT_SANITY_CHECK(file_name), STRING_PTR_PRINT_SANITY_CHECK(func), line);
 
-    va_list ap;
-    va_start(ap, fmt);
     HAL_Vsnprintf(o, MAX_LOG_MSG_LEN - 2 - strlen(tmp_buf), fmt, ap);
-    va_end(ap);
 
     strcat(tmp_buf, "\r\n");
 
-#ifdef LOG_UPLOAD
+#if defined(LOG_UPLOAD) && !defined(LOG_UPLOAD_BINARY)
     /* append to upload buffer */
     if (level <= g_log_upload_level) {
         append_to_upload_buffer(tmp_buf, strlen(tmp_buf));
@@ -150,12 +294,55 @@ void IOT_Log_Gen(const char *file, const char *func, const int line, const int l
         }
 
         /* default log handler: print to console */
+#ifdef LOG_ASYNC_PRINT_ENABLED
+        if (log_async_print(tmp_buf, strlen(tmp_buf), level)) {
+            return;
+        }
+#endif
         HAL_Printf("%s", tmp_buf);
     }
 
     return;
 }
 
+#ifdef LOG_RATE_LIMIT_ENABLED
+static void _log_gen(const char *file, const char *func, const int line, const int level, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    _log_gen_v(file, func, line, level, fmt, ap);
+    va_end(ap);
+}
+#endif
+
+void IOT_Log_Gen(const char *file, const char *func, const int line, const int level, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (level > g_log_print_level && level > g_log_upload_level) {
+        return;
+    }
+
+#ifdef LOG_RATE_LIMIT_ENABLED
+    uint32_t suppressed;
+    if (!_log_rate_check(file, line, level, &suppressed)) {
+        return;
+    }
+    if (suppressed) {
+        _log_gen(file, func, line, level, "suppressed %u similar messages", suppressed);
+    }
+    if (sg_log_rate_evicted) {
+        suppressed          = sg_log_rate_evicted;
+        sg_log_rate_evicted = 0;
+        _log_gen(file, func, line, level, "suppressed %u messages from other call sites", suppressed);
+    }
+#endif
+
+    va_start(ap, fmt);
+    _log_gen_v(file, func, line, level, fmt, ap);
+    va_end(ap);
+}
+
 #ifdef __cplusplus
 }
 #endif
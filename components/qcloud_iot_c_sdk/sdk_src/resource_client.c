@@ -25,6 +25,7 @@ extern "C" {
 #include "utils_param_check.h"
 #include "utils_timer.h"
 #include "utils_md5.h"
+#include "utils_download_cache.h"
 #include "service_mqtt.h"
 
 #include "resource_client.h"
@@ -46,6 +47,7 @@ struct QCLOUD_RESOURCE_INFO_T
     char                         resource_name[IOT_RESOURCE_NAME_LEN];        /* point to string */
     char                         md5sum[33];                                  /* MD5 string */
     iot_md5_context              md5;                                         /* MD5 handle */
+    DownloadCacheSession         cache;                                       /* download cache session */
     int                          err;                                         /* last error code */
     Timer                        report_timer;
     uint32_t                     result_code;
@@ -242,6 +244,7 @@ static void _qcloud_iot_resource_info_reset(void *handle)
     struct QCLOUD_RESOURCE_INFO_T *resource_info_handle = (struct QCLOUD_RESOURCE_INFO_T *)handle;
     Log_i("reset resource state!");
 
+    qcloud_download_cache_end(&resource_info_handle->cache);
     memset(resource_info_handle, 0, sizeof(struct QCLOUD_RESOURCE_INFO_T));
     resource_info_handle->state         = QCLOUD_RESOURCE_STATE_INITED_E;
     resource_info_handle->resource_size = -1;
@@ -733,6 +736,7 @@ static int _qcloud_iot_resource_destroy(void *handle)
 
     qcloud_resource_mqtt_deinit(resource_handle->resoure_mqtt);
     qcloud_ofc_deinit(resource_handle->download.channel);
+    qcloud_download_cache_end(&resource_handle->download.cache);
     qcloud_resource_upload_http_deinit(resource_handle->upload.channel);
     qcloud_lib_md5_deinit(&(resource_handle->download.md5));
     qcloud_lib_md5_deinit(&(resource_handle->upload.md5));
@@ -862,6 +866,7 @@ int IOT_Resource_IsDownloadFinish(void *handle)
 int IOT_Resource_StartDownload(void *handle, uint32_t offset, uint32_t resource_size, uint32_t segment_size)
 {
     QCLOUD_RESOURCE_CONTEXT_T *resource_handle = (QCLOUD_RESOURCE_CONTEXT_T *)handle;
+    uint32_t                   fetch_offset;
     int                        ret;
 
     Log_d("to download FW from offset: %u, size: %u", offset, resource_size);
@@ -876,9 +881,18 @@ int IOT_Resource_StartDownload(void *handle, uint32_t offset, uint32_t resource_
         }
     }
 
-    // reinit ofc
+    // reinit ofc, the bytes in the download cache need no fetching
     qcloud_ofc_deinit(resource_handle->download.channel);
-    resource_handle->download.channel = ofc_Init(resource_handle->download.resource_url, offset, resource_size, segment_size);
+    resource_handle->download.channel = NULL;
+
+    fetch_offset = qcloud_download_cache_begin(&resource_handle->download.cache, resource_handle->download.md5sum,
+                                               resource_handle->download.resource_size, offset);
+    if (fetch_offset >= resource_size) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    resource_handle->download.channel =
+        ofc_Init(resource_handle->download.resource_url, fetch_offset, resource_size, segment_size);
     if (NULL == resource_handle->download.channel) {
         Log_e("Initialize fetch module failed");
         return QCLOUD_ERR_FAILURE;
@@ -907,7 +921,13 @@ int IOT_Resource_DownloadYield(void *handle, char *buf, uint32_t buf_len, uint32
         return QCLOUD_RESOURCE_ERRCODE_INVALID_STATE_E;
     }
 
-    ret = qcloud_ofc_fetch(resource_handle->download.channel, buf, buf_len, timeout_s);
+    ret = qcloud_download_cache_read(&resource_handle->download.cache, buf, buf_len);
+    if (ret == 0) {
+        ret = qcloud_ofc_fetch(resource_handle->download.channel, buf, buf_len, timeout_s);
+        if (ret > 0) {
+            qcloud_download_cache_write(&resource_handle->download.cache, buf, ret);
+        }
+    }
     if (ret < 0) {
         resource_handle->download.err   = QCLOUD_RESOURCE_ERRCODE_FETCH_FAILED_E;
 
@@ -946,6 +966,7 @@ int IOT_Resource_DownloadYield(void *handle, char *buf, uint32_t buf_len, uint32
 
     if (resource_handle->download.size_prepared >= resource_handle->download.resource_size) {
         resource_handle->download.state = QCLOUD_RESOURCE_STATE_END_E;
+        qcloud_download_cache_end(&resource_handle->download.cache);
     }
 
     qcloud_lib_md5_update(&(resource_handle->download.md5), buf, ret);
@@ -1015,6 +1036,7 @@ int IOT_Resource_DownloadIoctl(void *handle, QCLOUD_IOT_RESOURCE_CMDTYPE_E type,
                     *((uint32_t *)buf) = 1;
                 } else {
                     *((uint32_t *)buf) = 0;
+                    qcloud_download_cache_remove(resource_handle->download.md5sum);
                     // report MD5 inconsistent TODO
                     _qcloud_iot_resource_report_download_result(resource_handle, resource_handle->download.resource_name,
                                                                 QCLOUD_RESOURCE_RESULTCODE_MD5_NOTMATCH_E);
@@ -89,28 +89,32 @@ static int _set_service_event_handle(eServiceEvent evt, OnServiceMessageCallback
     return QCLOUD_RET_SUCCESS;
 }
 
-static eServiceEvent _service_mqtt_parse_event(char *method)
+static eServiceEvent _service_mqtt_parse_event(const json_span_t *method)
 {
-    if (!strcmp(method, METHOD_UNBIND_DEVICE)) {
+    if (LITE_span_equal(method, METHOD_UNBIND_DEVICE)) {
         return eSERVICE_UNBIND_DEV;
-    } else if (!strcmp(method, METHOD_UNBIND_DEVICE_REPLY)) {
+    } else if (LITE_span_equal(method, METHOD_UNBIND_DEVICE_REPLY)) {
         return eSERVICE_UNBIND_DEV_REPLY;
-    } else if (!strcmp(method, METHOD_FACE_AI_REPLY)) {
+    } else if (LITE_span_equal(method, METHOD_FACE_AI_REPLY)) {
         return eSERVICE_FACE_AI;
-    } else if (!strcmp(method, METHOD_RES_REPORT_VERSION_RSP) || !strcmp(method, METHOD_RES_UPDATE_RESOURCE) ||
-               !strcmp(method, METHOD_RES_DELETE_RESOURCE) || !strcmp(method, METHOD_RES_REQ_URL_RESP)) {
+    } else if (LITE_span_equal(method, METHOD_RES_REPORT_VERSION_RSP) ||
+               LITE_span_equal(method, METHOD_RES_UPDATE_RESOURCE) ||
+               LITE_span_equal(method, METHOD_RES_DELETE_RESOURCE) ||
+               LITE_span_equal(method, METHOD_RES_REQ_URL_RESP)) {
         return eSERVICE_RESOURCE;
-    } else if ((!strcmp(method, METHOD_GATEWAY_AUTOMATION_SET)) || (!strcmp(method, METHOD_GATEWAY_AUTOMATION_DEL)) ||
-               (!strcmp(method, METHOD_GATEWAY_AUTOMATION_LIST))) {
+    } else if ((LITE_span_equal(method, METHOD_GATEWAY_AUTOMATION_SET)) ||
+               (LITE_span_equal(method, METHOD_GATEWAY_AUTOMATION_DEL)) ||
+               (LITE_span_equal(method, METHOD_GATEWAY_AUTOMATION_LIST))) {
         return eSERVICE_GATEWAY_AUTOMATION;
-    } else if ((!strcmp(method, METHOD_KGMUSIC_QUERY_SONG_REPLY)) ||
-               (!strcmp(method, METHOD_KGMUSIC_QUERY_PID_REPLY)) ||
-               (!strcmp(method, METHOD_KGMUSIC_QUERY_SONGLIST_REPLY))) {
+    } else if ((LITE_span_equal(method, METHOD_KGMUSIC_QUERY_SONG_REPLY)) ||
+               (LITE_span_equal(method, METHOD_KGMUSIC_QUERY_PID_REPLY)) ||
+               (LITE_span_equal(method, METHOD_KGMUSIC_QUERY_SONGLIST_REPLY))) {
         return eSERVICE_KGMUSIC;
-    } else if (!strcmp(method, METHOD_ALEART_FENCE_EVENT) || !strcmp(method, METHOd_ALEART_FENCE_EVENT_REPLY)) {
+    } else if (LITE_span_equal(method, METHOD_ALEART_FENCE_EVENT) ||
+               LITE_span_equal(method, METHOd_ALEART_FENCE_EVENT_REPLY)) {
         return eSERVICE_LOCATION;
     }
-    Log_i("not support service method %s", STRING_PTR_PRINT_SANITY_CHECK(method));
+    Log_i("not support service method %.*s", (int)method->len, method->ptr);
     return eSERVICE_DEFAULT;
 }
 
@@ -130,14 +134,13 @@ static void _service_mqtt_cb(void *pClient, MQTTMessage *message, void *pContext
     }
     memset(recv_payload, '\0', len + 1);
     strncpy(recv_payload, message->payload, len);
-    char *json_method = LITE_json_value_of(FIELD_METHOD, recv_payload);
-    if (json_method) {
-        eServiceEvent           event  = _service_mqtt_parse_event(json_method);
+    json_span_t json_method;
+    if (!LITE_json_span_of(FIELD_METHOD, recv_payload, len, &json_method) && json_method.type == JSSTRING) {
+        eServiceEvent           event  = _service_mqtt_parse_event(&json_method);
         Service_Event_Struct_t *handle = _get_service_event_handle(event);
         if (handle != NULL && handle->callback) {
             handle->callback(handle->context, recv_payload, len);
         }
-        HAL_Free(json_method);
     } else {
         Log_e("no method found");
     }
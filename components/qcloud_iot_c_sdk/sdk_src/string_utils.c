@@ -23,29 +23,30 @@
 #include "qcloud_iot_export_log.h"
 #include "qcloud_iot_import.h"
 
+/* the length is measured first, so the result is the only allocation */
 char *LITE_format_string(const char *fmt, ...)
 {
-#define TEMP_STRING_MAXLEN (512)
-
     va_list ap;
-    char *  tmp = NULL;
     char *  dst;
-    int     rc = -1;
+    int     len;
 
     va_start(ap, fmt);
-    tmp = HAL_Malloc(TEMP_STRING_MAXLEN);
-    memset(tmp, 0, TEMP_STRING_MAXLEN);
-    rc = HAL_Vsnprintf(tmp, TEMP_STRING_MAXLEN, fmt, ap);
+    len = HAL_Vsnprintf(NULL, 0, fmt, ap);
     va_end(ap);
-    LITE_ASSERT(tmp);
-    LITE_ASSERT(rc < 1024);
+    if (len < 0) {
+        return NULL;
+    }
 
-    dst = LITE_strdup(tmp);
-    HAL_Free(tmp);
+    dst = HAL_Malloc(len + 1);
+    if (NULL == dst) {
+        return NULL;
+    }
 
-    return dst;
+    va_start(ap, fmt);
+    HAL_Vsnprintf(dst, len + 1, fmt, ap);
+    va_end(ap);
 
-#undef TEMP_STRING_MAXLEN
+    return dst;
 }
 
 char *LITE_format_nstring(const int len, const char *fmt, ...)
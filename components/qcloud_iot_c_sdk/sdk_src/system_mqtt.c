@@ -13,6 +13,7 @@
  *
  */
 
+#include <stdlib.h>
 #include <string.h>
 
 #ifdef __cplusplus
@@ -26,18 +27,121 @@ extern "C" {
 #include "mqtt_client.h"
 #include "lite-utils.h"
 #include "qcloud_iot_device.h"
+#include "utils_completion.h"
 
 #define RESOURCE_TIME_STR "time"
+#define RESOURCE_NTP_STR  "ntptime2"  // server time in ms when the request is handled, if the server gives it
+
+/* samples with longer round trip are too loose to sync with */
+#define TIME_SYNC_MAX_RTT_MS (3000)
+/* drift is estimated only over a span of this long at least, and reset beyond the limits */
+#define TIME_SYNC_DRIFT_MIN_SPAN_MS (10 * 60 * 1000)
+#define TIME_SYNC_DRIFT_MAX_SPAN_MS (0x7FFFFFFFu)
+#define TIME_SYNC_MAX_DRIFT_PPM     (1000)
+#define TIME_SYNC_SUB_WAIT_MS       (1000)
 
 typedef struct _sys_mqtt_state {
-    bool  topic_sub_ok;
-    bool  result_recv_ok;
-    long  time;
-    char *ipList;
+    bool       topic_sub_ok;
+    bool       result_recv_ok;
+    Completion result_done;  // signaled by the reply of IOT_Get_Sys_Resource
+    long       time;
+    char *     ipList;
 } SysMQTTState;
 
 static SysMQTTState sg_sys_state = {.topic_sub_ok = false, .result_recv_ok = false, .time = 0, .ipList = NULL};
 
+/* Server time is kept as an offset of the local ms clock taken at the last sync, so it is read in O(1) without any
+ * request. The estimate is written by the thread doing IOT_MQTT_Yield and read by any thread: seq is odd while it
+ * is being written and readers retry on a change. Elapsed time is taken modulo 2^32 ms, the syncs are far more
+ * frequent than the wrap of HAL_GetTimeMs. */
+typedef struct {
+    volatile uint32_t seq;
+    bool              synced;
+    uint32_t          base_ms;         // local time of the last sync
+    int64_t           server_base_ms;  // server time at base_ms
+    int32_t           drift_ppm;       // server clock gain over the local clock, in parts per million
+
+    uint32_t epoch_ms;         // first sync of the drift estimation span
+    int64_t  server_epoch_ms;  // server time at epoch_ms
+    bool     request_pending;
+    uint32_t request_ms;  // local time the pending time request is sent
+    Timer    sync_timer;
+} SysTimeSync;
+
+static SysTimeSync sg_time_sync = {0};
+
+static void _time_sync_write_begin(SysTimeSync *sync)
+{
+    __atomic_store_n(&sync->seq, sync->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void _time_sync_write_end(SysTimeSync *sync)
+{
+    __atomic_store_n(&sync->seq, sync->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* server time at local time now_ms */
+static int64_t _time_sync_estimate(SysTimeSync *sync, uint32_t now_ms)
+{
+    uint32_t elapsed = now_ms - sync->base_ms;
+
+    return sync->server_base_ms + elapsed + (int64_t)elapsed * sync->drift_ppm / 1000000;
+}
+
+/* take a time reply as a sync sample, half of the round trip is taken as the way back */
+static void _time_sync_on_reply(SysTimeSync *sync, const char *reply, long server_sec)
+{
+    uint32_t now_ms = HAL_GetTimeMs();
+    uint32_t rtt_ms = now_ms - sync->request_ms;
+    uint32_t span_ms;
+    int64_t  server_ms;
+    int64_t  drift_ppm = 0;
+    char *   ntp_time;
+
+    if (!sync->request_pending) {
+        return;
+    }
+    sync->request_pending = false;
+    if (rtt_ms > TIME_SYNC_MAX_RTT_MS) {
+        Log_w("time sync round trip %u ms too long, sample dropped", rtt_ms);
+        return;
+    }
+
+    /* a time in seconds is anywhere in its second, take the middle */
+    ntp_time = LITE_json_value_of(RESOURCE_NTP_STR, (char *)reply);
+    if (ntp_time) {
+        server_ms = strtoll(ntp_time, NULL, 10);
+        HAL_Free(ntp_time);
+    } else {
+        server_ms = (int64_t)server_sec * 1000 + 500;
+    }
+    server_ms += rtt_ms / 2;
+
+    /* the drift of the local clock is the error the estimate has built up since the start of the span */
+    span_ms = now_ms - sync->epoch_ms;
+    if (sync->synced && span_ms >= TIME_SYNC_DRIFT_MIN_SPAN_MS) {
+        drift_ppm = ((server_ms - sync->server_epoch_ms) - (int64_t)span_ms) * 1000000 / span_ms;
+    }
+
+    _time_sync_write_begin(sync);
+    if (!sync->synced || span_ms > TIME_SYNC_DRIFT_MAX_SPAN_MS || drift_ppm > TIME_SYNC_MAX_DRIFT_PPM ||
+        drift_ppm < -TIME_SYNC_MAX_DRIFT_PPM) {
+        /* first sync, or the server time jumped, start a new span */
+        sync->epoch_ms        = now_ms;
+        sync->server_epoch_ms = server_ms;
+        drift_ppm             = 0;
+    }
+    sync->base_ms        = now_ms;
+    sync->server_base_ms = server_ms;
+    sync->drift_ppm      = drift_ppm;
+    sync->synced         = true;
+    _time_sync_write_end(sync);
+    countdown_ms(&sync->sync_timer, TIME_SYNC_INTERVAL_MS);
+
+    Log_d("time synced: %lld ms, rtt %u ms, drift %d ppm", (long long)server_ms, rtt_ms, (int)drift_ppm);
+}
+
 static void _system_mqtt_message_callback(void *pClient, MQTTMessage *message, void *pUserData)
 {
 #define MAX_RECV_LEN (512)
@@ -61,10 +165,12 @@ static void _system_mqtt_message_callback(void *pClient, MQTTMessage *message, v
         if (time) {
             state->time           = atol(time);
             state->result_recv_ok = true;
+            _time_sync_on_reply(&sg_time_sync, rcv_buf, state->time);
         } else {
             state->result_recv_ok = false;
         }
         HAL_Free(time);
+        utils_completion_signal(&state->result_done);
     }
 
     return;
@@ -118,6 +224,8 @@ static int _iot_resource_get_publish(void *pClient, DeviceInfo *dev_info, eSysRe
         case eRESOURCE_TIME:
             HAL_Snprintf(payload_content, sizeof(payload_content), "{\"type\": \"get\", \"resource\": [\"%s\"]}",
                          RESOURCE_TIME_STR);
+            sg_time_sync.request_pending = true;
+            sg_time_sync.request_ms      = HAL_GetTimeMs();
             break;
 
         case eRESOURCE_IP:
@@ -160,11 +268,10 @@ static int _iot_system_info_result_subscribe(void *pClient, DeviceInfo *dev_info
 int IOT_Get_Sys_Resource(void *pClient, eSysResourcType eType, DeviceInfo *pDevInfo, void *usrArg)
 {
 #define SUB_RETRY_TIMES 3
-#define SYNC_TIMES      20
+#define SYNC_TIMEOUT_MS 2000
 
     int ret    = 0;
     int cntSub = 0;
-    int cntRev = 0;
 
     POINTER_SANITY_CHECK(pClient, QCLOUD_ERR_INVAL);
     Qcloud_IoT_Client *mqtt_client = (Qcloud_IoT_Client *)pClient;
@@ -195,6 +302,7 @@ int IOT_Get_Sys_Resource(void *pClient, eSysResourcType eType, DeviceInfo *pDevI
     }
 
     pSysState->result_recv_ok = false;
+    utils_completion_reset(&pSysState->result_done);
     // publish msg to get resource
     ret = _iot_resource_get_publish(mqtt_client, pDevInfo, eType);
     if (ret < 0) {
@@ -202,10 +310,7 @@ int IOT_Get_Sys_Resource(void *pClient, eSysResourcType eType, DeviceInfo *pDevI
         return ret;
     }
 
-    do {
-        ret = IOT_MQTT_Yield(mqtt_client, 100);
-        cntRev++;
-    } while (!pSysState->result_recv_ok && cntRev < SYNC_TIMES);
+    utils_completion_wait(&pSysState->result_done, mqtt_client, SYNC_TIMEOUT_MS, IOT_MQTT_Yield, mqtt_client);
 
     switch (eType) {
         case eRESOURCE_TIME:
@@ -227,7 +332,55 @@ int IOT_Get_Sys_Resource(void *pClient, eSysResourcType eType, DeviceInfo *pDevI
 
     return ret;
 #undef SUB_RETRY_TIMES
-#undef SYNC_TIMES
+#undef SYNC_TIMEOUT_MS
+}
+
+void qcloud_iot_sys_time_sync(void *pClient)
+{
+    Qcloud_IoT_Client *mqtt_client = (Qcloud_IoT_Client *)pClient;
+    SysTimeSync *      sync        = &sg_time_sync;
+    int                rc;
+
+    if (!expired(&sync->sync_timer)) {
+        return;
+    }
+
+    /* subscribe without waiting for the ack, the request goes a while later */
+    if (!sg_sys_state.topic_sub_ok) {
+        rc = _iot_system_info_result_subscribe(mqtt_client, &mqtt_client->device_info);
+        if (rc < 0) {
+            Log_w("time sync subscribe failed: %d", rc);
+        }
+        countdown_ms(&sync->sync_timer, TIME_SYNC_SUB_WAIT_MS);
+        return;
+    }
+
+    /* the reply is taken by the subscription callback and puts off the next sync, a request not answered (or given
+     * up for a loose sample) is retried sooner */
+    rc = _iot_resource_get_publish(mqtt_client, &mqtt_client->device_info, eRESOURCE_TIME);
+    if (rc < 0) {
+        sync->request_pending = false;
+        Log_w("time sync request failed: %d", rc);
+    }
+    countdown_ms(&sync->sync_timer, TIME_SYNC_RETRY_INTERVAL_MS);
+}
+
+int64_t IOT_Get_Sys_Time_Ms(void)
+{
+    SysTimeSync *sync = &sg_time_sync;
+    uint32_t     seq;
+    int64_t      time_ms;
+
+    do {
+        seq = __atomic_load_n(&sync->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        time_ms = sync->synced ? _time_sync_estimate(sync, HAL_GetTimeMs()) : 0;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&sync->seq, __ATOMIC_RELAXED));
+
+    return time_ms;
 }
 
 #ifdef __cplusplus
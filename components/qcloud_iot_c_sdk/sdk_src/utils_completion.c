@@ -0,0 +1,122 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "utils_completion.h"
+
+#include "mqtt_client.h"
+#include "qcloud_iot_export_error.h"
+#include "qcloud_iot_import.h"
+#include "utils_timer.h"
+
+void utils_completion_init(Completion *completion)
+{
+    completion->done = false;
+    completion->sem  = NULL;
+    utils_completion_reset(completion);
+}
+
+void utils_completion_deinit(Completion *completion)
+{
+    if (completion->sem) {
+        HAL_SemaphoreDestroy(completion->sem);
+        completion->sem = NULL;
+    }
+}
+
+void utils_completion_reset(Completion *completion)
+{
+    completion->done = false;
+
+#ifdef MULTITHREAD_ENABLED
+    if (!completion->sem) {
+        /* without a semaphore the waiter polls the flag */
+        completion->sem = HAL_SemaphoreCreate();
+    }
+    /* drain a signal of the previous request, or the initial count of the platform semaphore */
+    while (completion->sem && HAL_SemaphoreWait(completion->sem, 0) == QCLOUD_RET_SUCCESS) {
+    }
+#endif
+}
+
+void utils_completion_signal(Completion *completion)
+{
+    completion->done = true;
+
+    /* last access, a waiter on the semaphore may release the completion as soon as it is posted */
+    if (completion->sem) {
+        HAL_SemaphorePost(completion->sem);
+    }
+}
+
+static bool _yield_thread_running(void *mqtt_client)
+{
+#ifdef MULTITHREAD_ENABLED
+    return ((Qcloud_IoT_Client *)mqtt_client)->yield_thread_running;
+#else
+    return false;
+#endif
+}
+
+int utils_completion_wait(Completion *completion, void *mqtt_client, uint32_t timeout_ms, CompletionYieldFunc yield,
+                          void *client)
+{
+    Timer    timer;
+    Timer    slice_timer;
+    uint32_t slice_ms;
+
+    InitTimer(&timer);
+    countdown_ms(&timer, timeout_ms);
+
+    for (;;) {
+        if (_yield_thread_running(mqtt_client) && completion->sem) {
+            /* done alone is not enough, signal may still be about to post */
+            if (HAL_SemaphoreWait(completion->sem, left_ms(&timer)) == QCLOUD_RET_SUCCESS) {
+                return QCLOUD_RET_SUCCESS;
+            }
+            if (expired(&timer)) {
+                return QCLOUD_ERR_MQTT_REQUEST_TIMEOUT;
+            }
+            continue;
+        }
+
+        if (completion->done) {
+            return QCLOUD_RET_SUCCESS;
+        }
+
+        /* less than 1 ms left is a timeout too, yield rejects a zero timeout */
+        slice_ms = Min(left_ms(&timer), COMPLETION_YIELD_SLICE_MS);
+        if (expired(&timer) || !slice_ms) {
+            return QCLOUD_ERR_MQTT_REQUEST_TIMEOUT;
+        }
+        if (_yield_thread_running(mqtt_client)) {
+            HAL_SleepMs(slice_ms);
+            continue;
+        }
+
+        /* yield returns early without connection, don't spin on it */
+        countdown_ms(&slice_timer, slice_ms);
+        if (yield(client, slice_ms) != QCLOUD_RET_SUCCESS && !expired(&slice_timer)) {
+            HAL_SleepMs(left_ms(&slice_timer));
+        }
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
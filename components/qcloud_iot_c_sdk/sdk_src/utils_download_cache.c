@@ -0,0 +1,635 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "utils_download_cache.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "qcloud_iot_export.h"
+#include "qcloud_iot_import.h"
+#include "utils_md5.h"
+#include "utils_param_check.h"
+
+typedef struct {
+    char     md5sum[DOWNLOAD_CACHE_MD5_LEN];
+    uint32_t size;      // size of the file, 0 for a free slot
+    uint32_t stored;    // bytes in the cache file, the entry is complete when stored == size
+    uint32_t used_seq;  // sequence of the last use, the least recently used is evicted first
+    uint32_t busy;      // sessions using the entry, a busy entry is never evicted
+} DownloadCacheEntry;
+
+typedef struct {
+    void *             lock;  // NULL while the cache is disabled
+    char               dir[DOWNLOAD_CACHE_PATH_LEN];
+    uint32_t           budget;
+    uint32_t           used_seq;
+    DownloadCacheEntry entries[DOWNLOAD_CACHE_MAX_ENTRIES];
+    DownloadCacheStats stats;
+} DownloadCache;
+
+static DownloadCache sg_download_cache;
+
+/* the length of dir is checked in IOT_DownloadCache_Init, so paths of entries always fit */
+static void _cache_path(const char *name, const char *suffix, char *path)
+{
+    HAL_Snprintf(path, DOWNLOAD_CACHE_PATH_LEN, "%s/%s%s", sg_download_cache.dir, name, suffix);
+}
+
+/* entries are keyed by the lowercase MD5 string */
+static int _cache_key(const char *md5sum, char *key)
+{
+    int i;
+
+    if (!md5sum || strlen(md5sum) != DOWNLOAD_CACHE_MD5_LEN - 1) {
+        return QCLOUD_ERR_INVAL;
+    }
+
+    for (i = 0; i < DOWNLOAD_CACHE_MD5_LEN - 1; i++) {
+        if (md5sum[i] >= '0' && md5sum[i] <= '9') {
+            key[i] = md5sum[i];
+        } else if ((md5sum[i] >= 'a' && md5sum[i] <= 'f') || (md5sum[i] >= 'A' && md5sum[i] <= 'F')) {
+            key[i] = md5sum[i] | 0x20;
+        } else {
+            return QCLOUD_ERR_INVAL;
+        }
+    }
+    key[i] = '\0';
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* the index keeps the size and the LRU order of the entries, stored bytes are taken from the files */
+static void _cache_save_index(void)
+{
+    DownloadCacheEntry *entry;
+    char                path[DOWNLOAD_CACHE_PATH_LEN];
+    char                tmp[DOWNLOAD_CACHE_PATH_LEN];
+    char                line[64];
+    void *              fp;
+    int                 len;
+    bool                ok = true;
+
+    _cache_path(DOWNLOAD_CACHE_INDEX_NAME, ".tmp", tmp);
+    fp = HAL_FileOpen(tmp, "wb");
+    if (!fp) {
+        Log_w("open %s failed", tmp);
+        return;
+    }
+
+    for (entry = sg_download_cache.entries; ok && entry < sg_download_cache.entries + DOWNLOAD_CACHE_MAX_ENTRIES;
+         entry++) {
+        if (entry->size) {
+            len = HAL_Snprintf(line, sizeof(line), "%s %u %u\n", entry->md5sum, entry->size, entry->used_seq);
+            ok  = HAL_FileWrite(line, 1, len, fp) == len;
+        }
+    }
+    ok = !HAL_FileClose(fp) && ok;
+
+    _cache_path(DOWNLOAD_CACHE_INDEX_NAME, "", path);
+    if (ok && HAL_FileRename(tmp, path)) {
+        // file systems which do not rename over a file, the index is loaded from index.tmp while it is missing
+        HAL_FileRemove(path);
+        ok = !HAL_FileRename(tmp, path);
+    }
+    if (!ok) {
+        Log_w("save download cache index failed");
+        HAL_FileRemove(tmp);
+    }
+}
+
+/* size of the file at path, -1 if it can't be opened */
+static long _cache_file_size(const char *path)
+{
+    void *fp   = HAL_FileOpen(path, "rb");
+    long  size = -1;
+
+    if (fp) {
+        size = HAL_FileSize(fp);
+        HAL_FileClose(fp);
+    }
+
+    return size;
+}
+
+static void _cache_load_index(void)
+{
+    DownloadCacheEntry *entry = sg_download_cache.entries;
+    char                path[DOWNLOAD_CACHE_PATH_LEN];
+    char                line[64];
+    char                md5sum[DOWNLOAD_CACHE_MD5_LEN];
+    uint32_t            size, used_seq;
+    long                stored;
+    void *              fp;
+
+    _cache_path(DOWNLOAD_CACHE_INDEX_NAME, "", path);
+    fp = HAL_FileOpen(path, "rb");
+    if (!fp) {
+        _cache_path(DOWNLOAD_CACHE_INDEX_NAME, ".tmp", path);
+        fp = HAL_FileOpen(path, "rb");
+    }
+    if (!fp) {
+        return;
+    }
+
+    while (entry < sg_download_cache.entries + DOWNLOAD_CACHE_MAX_ENTRIES && HAL_FileGets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%32s %u %u", md5sum, &size, &used_seq) != 3 || _cache_key(md5sum, entry->md5sum) || !size) {
+            continue;
+        }
+
+        _cache_path(entry->md5sum, "", path);
+        stored = _cache_file_size(path);
+        if (stored != (long)size) {
+            _cache_path(entry->md5sum, DOWNLOAD_CACHE_PART_SUFFIX, path);
+            stored = _cache_file_size(path);
+            if (stored < 0 || stored >= (long)size) {
+                continue;
+            }
+        }
+
+        entry->size     = size;
+        entry->stored   = stored;
+        entry->used_seq = used_seq;
+        if ((int32_t)(used_seq - sg_download_cache.used_seq) > 0) {
+            sg_download_cache.used_seq = used_seq;
+        }
+        entry++;
+    }
+
+    HAL_FileClose(fp);
+}
+
+static DownloadCacheEntry *_entry_find(const char *key)
+{
+    DownloadCacheEntry *entry;
+
+    for (entry = sg_download_cache.entries; entry < sg_download_cache.entries + DOWNLOAD_CACHE_MAX_ENTRIES; entry++) {
+        if (entry->size && !strcmp(entry->md5sum, key)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/* drop the entry and its file, complete or partial */
+static void _entry_remove(DownloadCacheEntry *entry)
+{
+    char path[DOWNLOAD_CACHE_PATH_LEN];
+
+    _cache_path(entry->md5sum, entry->stored == entry->size ? "" : DOWNLOAD_CACHE_PART_SUFFIX, path);
+    HAL_FileRemove(path);
+    memset(entry, 0, sizeof(DownloadCacheEntry));
+}
+
+/*
+ * Evict the least recently used idle entries until size more bytes fit in the
+ * budget, and a slot is free if need_slot. Entries reserve their whole size
+ * from the start, so a partial entry never grows beyond the budget.
+ */
+static DownloadCacheEntry *_cache_trim(uint32_t size, bool need_slot)
+{
+    DownloadCacheEntry *entry, *free_slot, *lru;
+    uint32_t            used;
+
+    if (size > sg_download_cache.budget) {
+        return NULL;
+    }
+
+    for (;;) {
+        used      = 0;
+        free_slot = NULL;
+        lru       = NULL;
+        for (entry = sg_download_cache.entries; entry < sg_download_cache.entries + DOWNLOAD_CACHE_MAX_ENTRIES;
+             entry++) {
+            if (!entry->size) {
+                free_slot = free_slot ? free_slot : entry;
+                continue;
+            }
+            used += entry->size;
+            if (!entry->busy && (!lru || (int32_t)(entry->used_seq - lru->used_seq) < 0)) {
+                lru = entry;
+            }
+        }
+
+        if (used + size <= sg_download_cache.budget && (free_slot || !need_slot)) {
+            return free_slot;
+        }
+        if (!lru) {
+            return NULL;
+        }
+
+        Log_i("evict %s from download cache", lru->md5sum);
+        _entry_remove(lru);
+        sg_download_cache.stats.evict_cnt++;
+    }
+}
+
+/* the cache file failed, stop using it and drop the entry unless others read it */
+static void _session_drop(DownloadCacheSession *session)
+{
+    DownloadCacheEntry *entry = (DownloadCacheEntry *)session->entry;
+
+    if (session->fp) {
+        HAL_FileClose(session->fp);
+    }
+    utils_md5_delete(session->md5);
+    HAL_Free(session->writer.buf);
+
+    if (sg_download_cache.lock) {
+        HAL_MutexLock(sg_download_cache.lock);
+        if (!--entry->busy) {
+            _entry_remove(entry);
+            _cache_save_index();
+        }
+        HAL_MutexUnlock(sg_download_cache.lock);
+    }
+
+    memset(session, 0, sizeof(DownloadCacheSession));
+}
+
+/* the part file is appended at the offset of the writer, HAL_File* has no erase */
+static int _session_program(void *usr_data, uint32_t offset, const void *data, uint32_t len)
+{
+    return HAL_FileWrite(data, 1, len, usr_data) == len ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+}
+
+/* start appending fetched bytes to the part file opened for writing */
+static int _session_start_writer(DownloadCacheSession *session)
+{
+    FlashWriterOps ops = {NULL};
+    void *         buf = HAL_Malloc(DOWNLOAD_CACHE_BUF_LEN);
+
+    if (!buf) {
+        return QCLOUD_ERR_MALLOC;
+    }
+
+    ops.program   = _session_program;
+    ops.usr_data  = session->fp;
+    ops.page_size = DOWNLOAD_CACHE_PAGE_LEN;
+    if (utils_flash_writer_init(&session->writer, &ops, session->stored, session->size, buf, DOWNLOAD_CACHE_BUF_LEN,
+                                0)) {
+        HAL_Free(buf);
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* the cached bytes of the part are all read, the rest comes from the network and is appended */
+static int _session_append(DownloadCacheSession *session)
+{
+    DownloadCacheEntry *entry = (DownloadCacheEntry *)session->entry;
+    char                path[DOWNLOAD_CACHE_PATH_LEN];
+
+    HAL_FileClose(session->fp);
+    _cache_path(entry->md5sum, DOWNLOAD_CACHE_PART_SUFFIX, path);
+    session->fp = HAL_FileOpen(path, "ab");
+
+    return session->fp ? _session_start_writer(session) : QCLOUD_ERR_FAILURE;
+}
+
+/* open the part file of the entry, the bytes below offset are hashed as the client won't get them */
+static int _session_open_part(DownloadCacheSession *session, const char *path, uint32_t offset)
+{
+    char     buf[DOWNLOAD_CACHE_BUF_LEN];
+    uint32_t pos, len;
+
+    session->md5 = utils_md5_create();
+    if (!session->md5) {
+        return QCLOUD_ERR_MALLOC;
+    }
+
+    session->fp = HAL_FileOpen(path, session->stored ? "rb" : "wb");
+    if (!session->fp) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    for (pos = 0; pos < offset; pos += len) {
+        len = offset - pos < sizeof(buf) ? offset - pos : sizeof(buf);
+        if (HAL_FileRead(buf, 1, len, session->fp) != len) {
+            return QCLOUD_ERR_FAILURE;
+        }
+        utils_md5_update(session->md5, (const unsigned char *)buf, len);
+    }
+
+    if (!session->stored) {
+        return _session_start_writer(session);
+    }
+
+    return offset == session->stored ? _session_append(session) : QCLOUD_RET_SUCCESS;
+}
+
+/* the whole file is in the part, verify it and make the entry complete */
+static void _session_commit(DownloadCacheSession *session)
+{
+    DownloadCacheEntry *entry = (DownloadCacheEntry *)session->entry;
+    char                md5sum[DOWNLOAD_CACHE_MD5_LEN];
+    char                part[DOWNLOAD_CACHE_PATH_LEN];
+    char                path[DOWNLOAD_CACHE_PATH_LEN];
+    bool                flushed;
+
+    utils_md5_finish_str(session->md5, md5sum);
+    flushed = !utils_flash_writer_flush(&session->writer);
+    if (HAL_FileClose(session->fp) || !flushed || session->stored != session->size || strcmp(md5sum, entry->md5sum)) {
+        Log_w("download of %s doesn't match, not cached", entry->md5sum);
+        session->fp = NULL;
+        _session_drop(session);
+        return;
+    }
+    session->fp = NULL;
+    utils_md5_delete(session->md5);
+    session->md5 = NULL;
+    HAL_Free(session->writer.buf);
+    session->writer.buf = NULL;
+
+    _cache_path(entry->md5sum, DOWNLOAD_CACHE_PART_SUFFIX, part);
+    _cache_path(entry->md5sum, "", path);
+    HAL_FileRemove(path);
+    if (HAL_FileRename(part, path)) {
+        Log_w("rename %s failed", part);
+        _session_drop(session);
+        return;
+    }
+
+    HAL_MutexLock(sg_download_cache.lock);
+    entry->stored = session->size;
+    _cache_save_index();
+    HAL_MutexUnlock(sg_download_cache.lock);
+    Log_i("%s cached, %u bytes", entry->md5sum, session->size);
+}
+
+uint32_t qcloud_download_cache_begin(DownloadCacheSession *session, const char *md5sum, uint32_t size,
+                                     uint32_t offset)
+{
+    DownloadCacheEntry *entry;
+    char                key[DOWNLOAD_CACHE_MD5_LEN];
+    char                path[DOWNLOAD_CACHE_PATH_LEN];
+    int                 rc;
+
+    qcloud_download_cache_end(session);
+    if (!sg_download_cache.lock || offset >= size || _cache_key(md5sum, key)) {
+        return offset;
+    }
+
+    HAL_MutexLock(sg_download_cache.lock);
+    entry = _entry_find(key);
+    if (entry && entry->size != size && !entry->busy) {
+        _entry_remove(entry);
+        entry = NULL;
+    }
+    if (!entry && !offset && (entry = _cache_trim(size, true))) {
+        strncpy(entry->md5sum, key, sizeof(entry->md5sum));
+        entry->size = size;
+        _cache_save_index();
+    }
+    /* complete entries are shared by readers, a partial one is filled by a single session */
+    if (!entry || entry->size != size || (entry->stored < size && (entry->busy || offset > entry->stored))) {
+        sg_download_cache.stats.miss_cnt++;
+        HAL_MutexUnlock(sg_download_cache.lock);
+        return offset;
+    }
+
+    entry->busy++;
+    entry->used_seq     = ++sg_download_cache.used_seq;
+    session->entry      = entry;
+    session->pos        = offset;
+    session->cached_end = entry->stored;
+    session->stored     = entry->stored;
+    session->size       = size;
+    HAL_MutexUnlock(sg_download_cache.lock);
+
+    if (session->stored < size) {
+        _cache_path(key, DOWNLOAD_CACHE_PART_SUFFIX, path);
+        rc = _session_open_part(session, path, offset);
+    } else {
+        _cache_path(key, "", path);
+        session->fp = HAL_FileOpen(path, "rb");
+        rc          = (session->fp && !HAL_FileSeek(session->fp, offset, SEEK_SET)) ? QCLOUD_RET_SUCCESS
+                                                                                      : QCLOUD_ERR_FAILURE;
+    }
+
+    HAL_MutexLock(sg_download_cache.lock);
+    if (rc) {
+        sg_download_cache.stats.miss_cnt++;
+    } else if (session->cached_end == size) {
+        sg_download_cache.stats.hit_cnt++;
+    } else if (session->cached_end > offset) {
+        sg_download_cache.stats.resume_cnt++;
+    } else {
+        sg_download_cache.stats.miss_cnt++;
+    }
+    HAL_MutexUnlock(sg_download_cache.lock);
+
+    if (rc) {
+        Log_w("open %s failed", path);
+        _session_drop(session);
+        return offset;
+    }
+
+    if (session->cached_end > offset) {
+        Log_i("%s from download cache, %u of %u bytes", key, session->cached_end - offset, size - offset);
+    }
+    return session->cached_end > offset ? session->cached_end : offset;
+}
+
+int qcloud_download_cache_read(DownloadCacheSession *session, char *buf, uint32_t buf_len)
+{
+    uint32_t len;
+
+    if (!session->entry || session->pos >= session->cached_end) {
+        return 0;
+    }
+
+    len = session->cached_end - session->pos;
+    len = len < buf_len ? len : buf_len;
+    if (HAL_FileRead(buf, 1, len, session->fp) != len) {
+        Log_e("read download cache failed");
+        _session_drop(session);
+        return QCLOUD_ERR_FAILURE;
+    }
+    session->pos += len;
+
+    if (session->md5) {
+        utils_md5_update(session->md5, (const unsigned char *)buf, len);
+        if (session->pos == session->cached_end && _session_append(session)) {
+            Log_w("append download cache failed");
+            _session_drop(session);
+        }
+    }
+
+    if (sg_download_cache.lock) {
+        HAL_MutexLock(sg_download_cache.lock);
+        sg_download_cache.stats.bytes_cached += len;
+        HAL_MutexUnlock(sg_download_cache.lock);
+    }
+
+    return len;
+}
+
+void qcloud_download_cache_write(DownloadCacheSession *session, const char *buf, uint32_t len)
+{
+    if (sg_download_cache.lock) {
+        HAL_MutexLock(sg_download_cache.lock);
+        sg_download_cache.stats.bytes_fetched += len;
+        HAL_MutexUnlock(sg_download_cache.lock);
+    }
+
+    if (!session->md5 || !session->writer.buf) {
+        return;
+    }
+
+    if (utils_flash_writer_write(&session->writer, buf, len)) {
+        Log_w("write download cache failed");
+        _session_drop(session);
+        return;
+    }
+    utils_md5_update(session->md5, (const unsigned char *)buf, len);
+    session->pos += len;
+    session->stored = session->pos;
+
+    if (session->stored >= session->size) {
+        _session_commit(session);
+    }
+}
+
+void qcloud_download_cache_end(DownloadCacheSession *session)
+{
+    DownloadCacheEntry *entry = (DownloadCacheEntry *)session->entry;
+
+    if (!entry) {
+        return;
+    }
+
+    /* the bytes of a failed flush are fetched again on resume */
+    if (session->writer.buf && utils_flash_writer_flush(&session->writer)) {
+        session->stored = session->writer.write_pos;
+    }
+    if (session->fp) {
+        HAL_FileClose(session->fp);
+    }
+    utils_md5_delete(session->md5);
+    HAL_Free(session->writer.buf);
+
+    if (sg_download_cache.lock) {
+        HAL_MutexLock(sg_download_cache.lock);
+        if (entry->stored < session->stored) {
+            entry->stored = session->stored;
+        }
+        entry->busy--;
+        _cache_save_index();
+        HAL_MutexUnlock(sg_download_cache.lock);
+    }
+
+    memset(session, 0, sizeof(DownloadCacheSession));
+}
+
+void qcloud_download_cache_remove(const char *md5sum)
+{
+    DownloadCacheEntry *entry;
+    char                key[DOWNLOAD_CACHE_MD5_LEN];
+
+    if (!sg_download_cache.lock || _cache_key(md5sum, key)) {
+        return;
+    }
+
+    HAL_MutexLock(sg_download_cache.lock);
+    entry = _entry_find(key);
+    if (entry && !entry->busy) {
+        Log_i("remove %s from download cache", key);
+        _entry_remove(entry);
+        _cache_save_index();
+    }
+    HAL_MutexUnlock(sg_download_cache.lock);
+}
+
+int IOT_DownloadCache_Init(const char *dir, uint32_t budget)
+{
+    STRING_PTR_SANITY_CHECK(dir, QCLOUD_ERR_INVAL);
+
+    if (sg_download_cache.lock) {
+        Log_e("download cache is enabled already");
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    if (strlen(dir) + 1 + DOWNLOAD_CACHE_MD5_LEN + strlen(DOWNLOAD_CACHE_PART_SUFFIX) > DOWNLOAD_CACHE_PATH_LEN) {
+        Log_e("cache dir %s too long", dir);
+        return QCLOUD_ERR_INVAL;
+    }
+
+    memset(&sg_download_cache, 0, sizeof(DownloadCache));
+    strncpy(sg_download_cache.dir, dir, sizeof(sg_download_cache.dir) - 1);
+    sg_download_cache.budget = budget;
+
+    _cache_load_index();
+    _cache_trim(0, false);
+    _cache_save_index();
+
+    sg_download_cache.lock = HAL_MutexCreate();
+    if (!sg_download_cache.lock) {
+        Log_e("create download cache lock failed");
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    Log_i("download cache in %s, budget %u bytes", dir, budget);
+    return QCLOUD_RET_SUCCESS;
+}
+
+void IOT_DownloadCache_Deinit(void)
+{
+    void *lock = sg_download_cache.lock;
+
+    if (!lock) {
+        return;
+    }
+
+    HAL_MutexLock(lock);
+    _cache_save_index();
+    sg_download_cache.lock = NULL;
+    HAL_MutexUnlock(lock);
+    HAL_MutexDestroy(lock);
+}
+
+int IOT_DownloadCache_GetStats(DownloadCacheStats *stats)
+{
+    DownloadCacheEntry *entry;
+
+    POINTER_SANITY_CHECK(stats, QCLOUD_ERR_INVAL);
+
+    if (!sg_download_cache.lock) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    HAL_MutexLock(sg_download_cache.lock);
+    *stats = sg_download_cache.stats;
+    for (entry = sg_download_cache.entries; entry < sg_download_cache.entries + DOWNLOAD_CACHE_MAX_ENTRIES; entry++) {
+        if (entry->size) {
+            stats->entry_num++;
+            stats->bytes_used += entry->size;
+        }
+    }
+    HAL_MutexUnlock(sg_download_cache.lock);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,276 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "utils_flash_sim.h"
+
+#include <string.h>
+
+#include "qcloud_iot_export_error.h"
+#include "qcloud_iot_export_log.h"
+#include "qcloud_iot_import.h"
+#include "utils_param_check.h"
+
+#define FLASH_SIM_CHUNK_SIZE 256
+
+typedef struct {
+    void *         fp;
+    uint32_t       size;
+    uint32_t       sector_size;
+    uint32_t       page_size;
+    FlashSimTiming timing;
+    FlashSimStats  stats;
+    uint32_t *     sector_erase_cnt;
+} FlashSim;
+
+static void _account_busy(FlashSim *sim, uint32_t us)
+{
+    sim->stats.busy_us += us;
+    if (sim->timing.realtime && us >= 1000) {
+        HAL_SleepMs(us / 1000);
+    }
+}
+
+static int _file_io(FlashSim *sim, uint32_t offset, void *buf, uint32_t len, bool write)
+{
+    size_t n;
+
+    if (HAL_FileSeek(sim->fp, offset, SEEK_SET)) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    n = write ? HAL_FileWrite(buf, 1, len, sim->fp) : HAL_FileRead(buf, 1, len, sim->fp);
+    return (n == len) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_FAILURE;
+}
+
+static int _sim_erase(void *usr_data, uint32_t offset, uint32_t len)
+{
+    FlashSim *sim = (FlashSim *)usr_data;
+    uint8_t   ff[FLASH_SIM_CHUNK_SIZE];
+    uint32_t  pos, idx;
+    int       rc;
+
+    if (offset % sim->sector_size || len % sim->sector_size || offset + len > sim->size) {
+        Log_e("unaligned erase 0x%x len %u", offset, len);
+        return QCLOUD_ERR_INVAL;
+    }
+
+    memset(ff, 0xFF, sizeof(ff));
+    for (pos = offset; pos < offset + len; pos += FLASH_SIM_CHUNK_SIZE) {
+        rc = _file_io(sim, pos, ff, Min(FLASH_SIM_CHUNK_SIZE, offset + len - pos), true);
+        if (rc) {
+            return rc;
+        }
+    }
+
+    for (idx = offset / sim->sector_size; idx < (offset + len) / sim->sector_size; idx++) {
+        sim->sector_erase_cnt[idx]++;
+        sim->stats.max_sector_erase = Max(sim->stats.max_sector_erase, sim->sector_erase_cnt[idx]);
+        sim->stats.erase_cnt++;
+        _account_busy(sim, sim->timing.erase_sector_us);
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static int _sim_program(void *usr_data, uint32_t offset, const void *data, uint32_t len)
+{
+    FlashSim *     sim = (FlashSim *)usr_data;
+    const uint8_t *src = (const uint8_t *)data;
+    uint8_t        cell[FLASH_SIM_CHUNK_SIZE];
+    uint32_t       pos, n, i, pages;
+    int            rc;
+
+    if (offset + len > sim->size) {
+        Log_e("program out of range 0x%x len %u", offset, len);
+        return QCLOUD_ERR_INVAL;
+    }
+
+    for (pos = 0; pos < len; pos += n) {
+        n  = Min(FLASH_SIM_CHUNK_SIZE, len - pos);
+        rc = _file_io(sim, offset + pos, cell, n, false);
+        if (rc) {
+            return rc;
+        }
+
+        /* NOR program can only turn 1 into 0 */
+        for (i = 0; i < n; i++) {
+            if ((cell[i] & src[pos + i]) != src[pos + i]) {
+                sim->stats.program_violations++;
+            }
+            cell[i] &= src[pos + i];
+        }
+
+        rc = _file_io(sim, offset + pos, cell, n, true);
+        if (rc) {
+            return rc;
+        }
+    }
+
+    pages = (offset + len + sim->page_size - 1) / sim->page_size - offset / sim->page_size;
+    sim->stats.program_cnt += pages;
+    sim->stats.bytes_programmed += len;
+    _account_busy(sim, pages * sim->timing.program_page_us);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+void *utils_flash_sim_open(const char *file_name, uint32_t size, uint32_t sector_size, uint32_t page_size,
+                           const FlashSimTiming *timing)
+{
+    POINTER_SANITY_CHECK(file_name, NULL);
+    NUMBERIC_SANITY_CHECK(sector_size, NULL);
+    NUMBERIC_SANITY_CHECK(page_size, NULL);
+
+    FlashSim *sim = NULL;
+    uint8_t   ff[FLASH_SIM_CHUNK_SIZE];
+    uint32_t  pos;
+
+    if (!size || size % sector_size || sector_size % page_size) {
+        Log_e("invalid flash geometry: size %u sector %u page %u", size, sector_size, page_size);
+        return NULL;
+    }
+
+    sim = HAL_Malloc(sizeof(FlashSim));
+    if (sim == NULL) {
+        Log_e("malloc flash sim failed");
+        return NULL;
+    }
+    memset(sim, 0, sizeof(FlashSim));
+
+    sim->sector_erase_cnt = HAL_Malloc(sizeof(uint32_t) * (size / sector_size));
+    if (sim->sector_erase_cnt == NULL) {
+        Log_e("malloc erase counters failed");
+        goto err_exit;
+    }
+    memset(sim->sector_erase_cnt, 0, sizeof(uint32_t) * (size / sector_size));
+
+    sim->size        = size;
+    sim->sector_size = sector_size;
+    sim->page_size   = page_size;
+    if (timing) {
+        memcpy(&sim->timing, timing, sizeof(FlashSimTiming));
+    }
+
+    sim->fp = HAL_FileOpen(file_name, "rb+");
+    if (sim->fp == NULL || HAL_FileSize(sim->fp) < (long)size) {
+        if (sim->fp) {
+            HAL_FileClose(sim->fp);
+        }
+
+        /* fresh chip comes erased */
+        sim->fp = HAL_FileOpen(file_name, "wb+");
+        if (sim->fp == NULL) {
+            Log_e("open flash file %s failed", file_name);
+            goto err_exit;
+        }
+
+        memset(ff, 0xFF, sizeof(ff));
+        for (pos = 0; pos < size; pos += FLASH_SIM_CHUNK_SIZE) {
+            if (_file_io(sim, pos, ff, Min(FLASH_SIM_CHUNK_SIZE, size - pos), true)) {
+                Log_e("init flash file %s failed", file_name);
+                goto err_exit;
+            }
+        }
+        HAL_FileFlush(sim->fp);
+    }
+
+    return sim;
+
+err_exit:
+    if (sim->fp) {
+        HAL_FileClose(sim->fp);
+    }
+    HAL_Free(sim->sector_erase_cnt);
+    HAL_Free(sim);
+    return NULL;
+}
+
+void utils_flash_sim_close(void *sim)
+{
+    POINTER_SANITY_CHECK_RTN(sim);
+
+    FlashSim *flash = (FlashSim *)sim;
+
+    HAL_FileClose(flash->fp);
+    HAL_Free(flash->sector_erase_cnt);
+    HAL_Free(flash);
+}
+
+void utils_flash_sim_get_ops(void *sim, FlashWriterOps *ops)
+{
+    POINTER_SANITY_CHECK_RTN(sim);
+    POINTER_SANITY_CHECK_RTN(ops);
+
+    FlashSim *flash = (FlashSim *)sim;
+
+    ops->erase       = _sim_erase;
+    ops->program     = _sim_program;
+    ops->usr_data    = flash;
+    ops->sector_size = flash->sector_size;
+    ops->page_size   = flash->page_size;
+}
+
+int utils_flash_sim_read(void *sim, uint32_t offset, void *buf, uint32_t len)
+{
+    POINTER_SANITY_CHECK(sim, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(buf, QCLOUD_ERR_INVAL);
+
+    FlashSim *flash = (FlashSim *)sim;
+
+    if (offset + len > flash->size) {
+        return QCLOUD_ERR_INVAL;
+    }
+
+    return _file_io(flash, offset, buf, len, false);
+}
+
+void utils_flash_sim_get_stats(void *sim, FlashSimStats *stats)
+{
+    POINTER_SANITY_CHECK_RTN(sim);
+    POINTER_SANITY_CHECK_RTN(stats);
+
+    memcpy(stats, &((FlashSim *)sim)->stats, sizeof(FlashSimStats));
+}
+
+uint32_t utils_flash_sim_sector_erase_cnt(void *sim, uint32_t sector_idx)
+{
+    POINTER_SANITY_CHECK(sim, 0);
+
+    FlashSim *flash = (FlashSim *)sim;
+
+    if (sector_idx >= flash->size / flash->sector_size) {
+        return 0;
+    }
+
+    return flash->sector_erase_cnt[sector_idx];
+}
+
+void utils_flash_sim_reset_stats(void *sim)
+{
+    POINTER_SANITY_CHECK_RTN(sim);
+
+    FlashSim *flash = (FlashSim *)sim;
+
+    memset(&flash->stats, 0, sizeof(FlashSimStats));
+    memset(flash->sector_erase_cnt, 0, sizeof(uint32_t) * (flash->size / flash->sector_size));
+}
+
+#ifdef __cplusplus
+}
+#endif
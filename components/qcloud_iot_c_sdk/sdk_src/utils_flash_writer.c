@@ -0,0 +1,238 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "utils_flash_writer.h"
+
+#include <string.h>
+
+#include "qcloud_iot_export_error.h"
+#include "qcloud_iot_export_log.h"
+#include "qcloud_iot_import.h"
+#include "utils_param_check.h"
+
+#define FLASH_ALIGN_UP(x, a) ((((x) + (a)-1) / (a)) * (a))
+
+/* bytes to collect before programming, so that every block ends on a page boundary */
+static uint32_t _block_room(FlashWriter *writer)
+{
+    return writer->buf_size - (writer->write_pos % writer->ops.page_size);
+}
+
+static int _erase_one_sector(FlashWriter *writer)
+{
+    int rc;
+
+    if (writer->erased_end + writer->ops.sector_size > writer->region_size) {
+        Log_e("erase out of region: 0x%x + 0x%x > 0x%x", writer->erased_end, writer->ops.sector_size,
+              writer->region_size);
+        return QCLOUD_ERR_INVAL;
+    }
+
+    rc = writer->ops.erase(writer->ops.usr_data, writer->erased_end, writer->ops.sector_size);
+    if (rc) {
+        Log_e("erase sector at 0x%x failed: %d", writer->erased_end, rc);
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    writer->erased_end += writer->ops.sector_size;
+    writer->stats.erase_cnt++;
+    return QCLOUD_RET_SUCCESS;
+}
+
+static int _ensure_erased(FlashWriter *writer, uint32_t end)
+{
+    int rc;
+
+    if (!writer->ops.erase) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    while (writer->erased_end < end) {
+        rc = _erase_one_sector(writer);
+        if (rc) {
+            return rc;
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static int _program(FlashWriter *writer, const void *data, uint32_t len)
+{
+    int rc;
+
+    if (writer->write_pos + len > writer->region_size) {
+        Log_e("write out of region: 0x%x + %u > 0x%x", writer->write_pos, len, writer->region_size);
+        return QCLOUD_ERR_INVAL;
+    }
+
+    rc = _ensure_erased(writer, writer->write_pos + len);
+    if (rc) {
+        return rc;
+    }
+
+    rc = writer->ops.program(writer->ops.usr_data, writer->write_pos, data, len);
+    if (rc) {
+        Log_e("program %u bytes at 0x%x failed: %d", len, writer->write_pos, rc);
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    writer->write_pos += len;
+    writer->stats.bytes_programmed += len;
+    writer->stats.program_cnt++;
+    return QCLOUD_RET_SUCCESS;
+}
+
+int utils_flash_writer_init(FlashWriter *writer, const FlashWriterOps *ops, uint32_t start, uint32_t region_size,
+                            void *buf, uint32_t buf_size, uint32_t erase_ahead)
+{
+    POINTER_SANITY_CHECK(writer, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(ops, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(ops->program, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(buf, QCLOUD_ERR_INVAL);
+    NUMBERIC_SANITY_CHECK(ops->page_size, QCLOUD_ERR_INVAL);
+
+    if (ops->erase && (!ops->sector_size || ops->sector_size % ops->page_size)) {
+        Log_e("sector size %u is not multiple of page size %u", ops->sector_size, ops->page_size);
+        return QCLOUD_ERR_INVAL;
+    }
+
+    if (buf_size < ops->page_size || start > region_size) {
+        Log_e("invalid buf size %u or start 0x%x", buf_size, start);
+        return QCLOUD_ERR_INVAL;
+    }
+
+    memset(writer, 0, sizeof(FlashWriter));
+    memcpy(&writer->ops, ops, sizeof(FlashWriterOps));
+    writer->region_size = region_size;
+    writer->write_pos   = start;
+    writer->erase_ahead = erase_ahead;
+    writer->buf         = buf;
+    writer->buf_size    = buf_size - (buf_size % ops->page_size);
+    writer->buf_len     = 0;
+
+    if (ops->erase) {
+        /* the sector holding a resume point has been erased and partly written before */
+        writer->erased_end = FLASH_ALIGN_UP(start, ops->sector_size);
+    } else {
+        writer->erased_end = region_size;
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int utils_flash_writer_write(FlashWriter *writer, const void *data, uint32_t len)
+{
+    POINTER_SANITY_CHECK(writer, QCLOUD_ERR_INVAL);
+    POINTER_SANITY_CHECK(data, QCLOUD_ERR_INVAL);
+
+    const uint8_t *src = (const uint8_t *)data;
+    uint32_t       room, n;
+    int            rc;
+
+    writer->stats.bytes_in += len;
+
+    while (len > 0) {
+        room = _block_room(writer) - writer->buf_len;
+
+        if (writer->buf_len == 0 && len >= room) {
+            /* aligned and large enough, program straight from caller data */
+            rc = _program(writer, src, room);
+            if (rc) {
+                return rc;
+            }
+            src += room;
+            len -= room;
+            continue;
+        }
+
+        n = Min(room, len);
+        memcpy(writer->buf + writer->buf_len, src, n);
+        writer->buf_len += n;
+        src += n;
+        len -= n;
+
+        if (writer->buf_len == _block_room(writer)) {
+            rc = _program(writer, writer->buf, writer->buf_len);
+            if (rc) {
+                return rc;
+            }
+            writer->buf_len = 0;
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int utils_flash_writer_erase_ahead(FlashWriter *writer, uint32_t max_sectors)
+{
+    POINTER_SANITY_CHECK(writer, QCLOUD_ERR_INVAL);
+
+    uint32_t target, cnt = 0;
+    int      rc;
+
+    if (!writer->ops.erase) {
+        return 0;
+    }
+
+    target = FLASH_ALIGN_UP(writer->write_pos + writer->buf_size, writer->ops.sector_size) +
+             writer->erase_ahead * writer->ops.sector_size;
+    target = Min(target, writer->region_size - (writer->region_size % writer->ops.sector_size));
+
+    while (cnt < max_sectors && writer->erased_end < target) {
+        rc = _erase_one_sector(writer);
+        if (rc) {
+            return rc;
+        }
+        writer->stats.erase_ahead_cnt++;
+        cnt++;
+    }
+
+    return cnt;
+}
+
+int utils_flash_writer_flush(FlashWriter *writer)
+{
+    POINTER_SANITY_CHECK(writer, QCLOUD_ERR_INVAL);
+
+    int rc;
+
+    if (writer->buf_len == 0) {
+        return QCLOUD_RET_SUCCESS;
+    }
+
+    rc = _program(writer, writer->buf, writer->buf_len);
+    if (rc) {
+        return rc;
+    }
+    writer->buf_len = 0;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+uint32_t utils_flash_writer_tell(FlashWriter *writer)
+{
+    POINTER_SANITY_CHECK(writer, 0);
+
+    return writer->write_pos + writer->buf_len;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,110 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "utils_hash_index.h"
+
+#include <string.h>
+
+#include "qcloud_iot_export_error.h"
+
+#define HASH_INDEX_MIN_SLOTS (4)
+#define HASH_INDEX_MAX_SLOTS (0x8000)
+
+/* FNV-1a */
+static uint32_t _hash_key(const char *key, size_t key_len)
+{
+    uint32_t hash = 2166136261u;
+
+    while (key_len--) {
+        hash ^= (uint8_t)*key++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static int _key_equal(const char *key, const char *other, size_t other_len)
+{
+    return !strncmp(key, other, other_len) && key[other_len] == '\0';
+}
+
+uint16_t hash_index_slot_num(int count)
+{
+    uint32_t slot_num = HASH_INDEX_MIN_SLOTS;
+
+    while (slot_num < (uint32_t)count * 2 && slot_num < HASH_INDEX_MAX_SLOTS) {
+        slot_num <<= 1;
+    }
+
+    return (uint16_t)slot_num;
+}
+
+void hash_index_init(HashIndex *index, void **slots, uint16_t slot_num, HashIndexGetKey get_key)
+{
+    memset(slots, 0, slot_num * sizeof(void *));
+    index->slots   = slots;
+    index->mask    = slot_num - 1;
+    index->count   = 0;
+    index->get_key = get_key;
+}
+
+int hash_index_add(HashIndex *index, void *val)
+{
+    const char *key = index->get_key(val);
+    size_t      key_len;
+    uint32_t    pos;
+
+    if (!key || index->count >= index->mask) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    key_len = strlen(key);
+    for (pos = _hash_key(key, key_len) & index->mask; index->slots[pos]; pos = (pos + 1) & index->mask) {
+        if (_key_equal(index->get_key(index->slots[pos]), key, key_len)) {
+            return QCLOUD_ERR_INVAL;
+        }
+    }
+
+    index->slots[pos] = val;
+    index->count++;
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+void *hash_index_find(const HashIndex *index, const char *key, size_t key_len)
+{
+    uint32_t pos;
+
+    if (!index->slots || !key) {
+        return NULL;
+    }
+
+    /* there is always an empty slot, so probing ends */
+    for (pos = _hash_key(key, key_len) & index->mask; index->slots[pos]; pos = (pos + 1) & index->mask) {
+        if (_key_equal(index->get_key(index->slots[pos]), key, key_len)) {
+            return index->slots[pos];
+        }
+    }
+
+    return NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
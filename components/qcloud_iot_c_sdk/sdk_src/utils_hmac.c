@@ -26,7 +26,7 @@
 #include "utils_md5.h"
 #include "utils_sha1.h"
 
-#define KEY_IOPAD_SIZE 64
+#define KEY_IOPAD_SIZE HMAC_KEY_IOPAD_SIZE
 
 #define MD5_DIGEST_SIZE  16
 #define SHA1_DIGEST_SIZE 20
@@ -81,49 +81,59 @@ void utils_hmac_md5(const char *msg, int msg_len, char *digest, const char *key,
     }
 }
 
-void utils_hmac_sha1(const char *msg, int msg_len, char *digest, const char *key, int key_len)
+int utils_hmac_sha1_starts(iot_hmac_sha1_context *ctx, const char *key, int key_len)
 {
-    if ((NULL == msg) || (NULL == digest) || (NULL == key)) {
+    unsigned char k_ipad[KEY_IOPAD_SIZE]; /* inner padding - key XORd with ipad */
+    int           i;
+
+    if ((NULL == ctx) || (NULL == key)) {
         Log_e("parameter is Null,failed!");
-        return;
+        return -1;
     }
 
     if (key_len > KEY_IOPAD_SIZE) {
         Log_e("key_len > size(%d) of array", KEY_IOPAD_SIZE);
-        return;
+        return -1;
     }
 
-    iot_sha1_context context;
-    unsigned char    k_ipad[KEY_IOPAD_SIZE]; /* inner padding - key XORd with ipad */
-    unsigned char    k_opad[KEY_IOPAD_SIZE]; /* outer padding - key XORd with opad */
-    unsigned char    out[SHA1_DIGEST_SIZE];
-    int              i;
-
     /* start out by storing key in pads */
     memset(k_ipad, 0, sizeof(k_ipad));
-    memset(k_opad, 0, sizeof(k_opad));
+    memset(ctx->k_opad, 0, sizeof(ctx->k_opad));
     memcpy(k_ipad, key, key_len);
-    memcpy(k_opad, key, key_len);
+    memcpy(ctx->k_opad, key, key_len);
 
     /* XOR key with ipad and opad values */
     for (i = 0; i < KEY_IOPAD_SIZE; i++) {
         k_ipad[i] ^= 0x36;
-        k_opad[i] ^= 0x5c;
+        ctx->k_opad[i] ^= 0x5c;
     }
 
-    /* perform inner SHA */
-    utils_sha1_init(&context);                                  /* init context for 1st pass */
-    utils_sha1_starts(&context);                                /* setup context for 1st pass */
-    utils_sha1_update(&context, k_ipad, KEY_IOPAD_SIZE);        /* start with inner pad */
-    utils_sha1_update(&context, (unsigned char *)msg, msg_len); /* then text of datagram */
-    utils_sha1_finish(&context, out);                           /* finish up 1st pass */
+    /* start inner SHA, the message follows */
+    utils_sha1_init(&ctx->sha1);
+    utils_sha1_starts(&ctx->sha1);
+    utils_sha1_update(&ctx->sha1, k_ipad, KEY_IOPAD_SIZE);
+
+    return 0;
+}
+
+void utils_hmac_sha1_update(iot_hmac_sha1_context *ctx, const char *msg, int msg_len)
+{
+    utils_sha1_update(&ctx->sha1, (unsigned char *)msg, msg_len);
+}
+
+void utils_hmac_sha1_finish(iot_hmac_sha1_context *ctx, char *digest)
+{
+    unsigned char out[SHA1_DIGEST_SIZE];
+    int           i;
+
+    utils_sha1_finish(&ctx->sha1, out); /* finish up 1st pass */
 
     /* perform outer SHA */
-    utils_sha1_init(&context);                           /* init context for 2nd pass */
-    utils_sha1_starts(&context);                         /* setup context for 2nd pass */
-    utils_sha1_update(&context, k_opad, KEY_IOPAD_SIZE); /* start with outer pad */
-    utils_sha1_update(&context, out, SHA1_DIGEST_SIZE);  /* then results of 1st hash */
-    utils_sha1_finish(&context, out);                    /* finish up 2nd pass */
+    utils_sha1_init(&ctx->sha1);                                /* init context for 2nd pass */
+    utils_sha1_starts(&ctx->sha1);                              /* setup context for 2nd pass */
+    utils_sha1_update(&ctx->sha1, ctx->k_opad, KEY_IOPAD_SIZE); /* start with outer pad */
+    utils_sha1_update(&ctx->sha1, out, SHA1_DIGEST_SIZE);       /* then results of 1st hash */
+    utils_sha1_finish(&ctx->sha1, out);                         /* finish up 2nd pass */
 
     for (i = 0; i < SHA1_DIGEST_SIZE; ++i) {
         digest[i * 2]     = utils_hb2hex(out[i] >> 4);
@@ -131,6 +141,22 @@ void utils_hmac_sha1(const char *msg, int msg_len, char *digest, const char *key
     }
 }
 
+void utils_hmac_sha1(const char *msg, int msg_len, char *digest, const char *key, int key_len)
+{
+    iot_hmac_sha1_context context;
+
+    if ((NULL == msg) || (NULL == digest)) {
+        Log_e("parameter is Null,failed!");
+        return;
+    }
+
+    if (utils_hmac_sha1_starts(&context, key, key_len)) {
+        return;
+    }
+    utils_hmac_sha1_update(&context, msg, msg_len);
+    utils_hmac_sha1_finish(&context, digest);
+}
+
 int utils_hmac_sha1_hex(const char *msg, int msg_len, char *digest, const char *key, int key_len)
 {
     if ((NULL == msg) || (NULL == digest) || (NULL == key)) {
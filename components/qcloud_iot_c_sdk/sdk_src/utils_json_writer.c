@@ -0,0 +1,353 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "utils_json_writer.h"
+
+#include <string.h>
+
+#include "qcloud_iot_export_error.h"
+#include "qcloud_iot_import.h"
+
+/* doubles below this magnitude are formatted without snprintf */
+#define JSON_WRITER_FAST_DOUBLE_MAX (1e13)
+
+static const char sg_hex_digits[] = "0123456789abcdef";
+
+static void _put(JsonWriter *writer, const char *data, size_t len)
+{
+    if (writer->err) {
+        return;
+    }
+
+    /* always keep one byte for '\0' */
+    if (len >= writer->size - writer->pos) {
+        writer->err = QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
+        return;
+    }
+
+    memcpy(writer->buf + writer->pos, data, len);
+    writer->pos += len;
+}
+
+static void _put_char(JsonWriter *writer, char c)
+{
+    if (writer->err) {
+        return;
+    }
+
+    if (writer->pos + 1 >= writer->size) {
+        writer->err = QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
+        return;
+    }
+
+    writer->buf[writer->pos++] = c;
+}
+
+/* write ',' before a value unless it is the first one of the container or follows a key */
+static void _value_prefix(JsonWriter *writer)
+{
+    uint32_t bit = 1u << writer->depth;
+
+    if (writer->after_key) {
+        writer->after_key = false;
+        return;
+    }
+
+    if (writer->need_comma & bit) {
+        _put_char(writer, ',');
+    }
+    writer->need_comma |= bit;
+}
+
+static void _container_begin(JsonWriter *writer, char c)
+{
+    _value_prefix(writer);
+    if (writer->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        writer->err = QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
+        return;
+    }
+    _put_char(writer, c);
+    writer->depth++;
+    writer->need_comma &= ~(1u << writer->depth);
+}
+
+static void _container_end(JsonWriter *writer, char c)
+{
+    if (writer->depth) {
+        writer->depth--;
+    }
+    _put_char(writer, c);
+}
+
+static void _put_escaped(JsonWriter *writer, const char *str, size_t len)
+{
+    const char *run = str;
+    const char *end = str + len;
+    char        esc[6];
+
+    _put_char(writer, '"');
+    for (; str < end; str++) {
+        unsigned char c = (unsigned char)*str;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        /* copy the run of plain characters at once */
+        _put(writer, run, str - run);
+        run = str + 1;
+
+        esc[0] = '\\';
+        switch (c) {
+            case '"':
+            case '\\':
+                esc[1] = c;
+                break;
+            case '\b':
+                esc[1] = 'b';
+                break;
+            case '\f':
+                esc[1] = 'f';
+                break;
+            case '\n':
+                esc[1] = 'n';
+                break;
+            case '\r':
+                esc[1] = 'r';
+                break;
+            case '\t':
+                esc[1] = 't';
+                break;
+            default:
+                esc[1] = 'u';
+                esc[2] = '0';
+                esc[3] = '0';
+                esc[4] = sg_hex_digits[c >> 4];
+                esc[5] = sg_hex_digits[c & 0xF];
+                _put(writer, esc, 6);
+                continue;
+        }
+        _put(writer, esc, 2);
+    }
+    _put(writer, run, end - run);
+    _put_char(writer, '"');
+}
+
+/* format digits backwards from end, return pointer to the first digit */
+static char *_format_uint64(char *end, uint64_t value)
+{
+    do {
+        *--end = '0' + (char)(value % 10);
+        value /= 10;
+    } while (value);
+
+    return end;
+}
+
+void json_writer_init(JsonWriter *writer, char *buf, size_t size)
+{
+    writer->buf        = buf;
+    writer->size       = size;
+    writer->pos        = 0;
+    writer->err        = (buf && size) ? QCLOUD_RET_SUCCESS : QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
+    writer->depth      = 0;
+    writer->after_key  = false;
+    writer->need_comma = 0;
+}
+
+void json_writer_object_begin(JsonWriter *writer)
+{
+    _container_begin(writer, '{');
+}
+
+void json_writer_object_end(JsonWriter *writer)
+{
+    _container_end(writer, '}');
+}
+
+void json_writer_array_begin(JsonWriter *writer)
+{
+    _container_begin(writer, '[');
+}
+
+void json_writer_array_end(JsonWriter *writer)
+{
+    _container_end(writer, ']');
+}
+
+void json_writer_key(JsonWriter *writer, const char *key)
+{
+    _value_prefix(writer);
+    _put_escaped(writer, key, strlen(key));
+    _put_char(writer, ':');
+    writer->after_key = true;
+}
+
+void json_writer_string(JsonWriter *writer, const char *str)
+{
+    json_writer_string_len(writer, str, strlen(str));
+}
+
+void json_writer_string_len(JsonWriter *writer, const char *str, size_t len)
+{
+    _value_prefix(writer);
+    _put_escaped(writer, str, len);
+}
+
+void json_writer_int(JsonWriter *writer, int32_t value)
+{
+    char  digits[20];
+    char *end = digits + sizeof(digits);
+    char *p   = _format_uint64(end, (value < 0) ? -(int64_t)value : value);
+
+    if (value < 0) {
+        *--p = '-';
+    }
+    _value_prefix(writer);
+    _put(writer, p, end - p);
+}
+
+void json_writer_uint(JsonWriter *writer, uint32_t value)
+{
+    char  digits[20];
+    char *end = digits + sizeof(digits);
+    char *p   = _format_uint64(end, value);
+
+    _value_prefix(writer);
+    _put(writer, p, end - p);
+}
+
+void json_writer_double(JsonWriter *writer, double value)
+{
+    char     digits[32];
+    char *   end = digits + sizeof(digits);
+    char *   p;
+    double   abs_value;
+    uint64_t int_part;
+    uint32_t frac_part;
+    int      i, rc;
+
+    if (value != value || value - value != 0) {
+        json_writer_null(writer);
+        return;
+    }
+
+    _value_prefix(writer);
+    if (value >= JSON_WRITER_FAST_DOUBLE_MAX || value <= -JSON_WRITER_FAST_DOUBLE_MAX) {
+        if (writer->err) {
+            return;
+        }
+        rc = HAL_Snprintf(writer->buf + writer->pos, writer->size - writer->pos, "%f", value);
+        if (rc < 0 || rc >= writer->size - writer->pos) {
+            writer->err = QCLOUD_ERR_JSON_BUFFER_TOO_SMALL;
+            return;
+        }
+        writer->pos += rc;
+        return;
+    }
+
+    /* scale the fraction alone to keep the rounding error off the integer part */
+    abs_value = (value < 0) ? -value : value;
+    int_part  = (uint64_t)abs_value;
+    frac_part = (uint32_t)((abs_value - (double)int_part) * 1000000 + 0.5);
+    if (frac_part >= 1000000) {
+        frac_part -= 1000000;
+        int_part++;
+    }
+    for (i = 0; i < 6; i++) {
+        *--end = '0' + (char)(frac_part % 10);
+        frac_part /= 10;
+    }
+    *--end = '.';
+    p      = _format_uint64(end, int_part);
+    if (value < 0) {
+        *--p = '-';
+    }
+    _put(writer, p, digits + sizeof(digits) - p);
+}
+
+void json_writer_bool(JsonWriter *writer, bool value)
+{
+    _value_prefix(writer);
+    if (value) {
+        _put(writer, "true", 4);
+    } else {
+        _put(writer, "false", 5);
+    }
+}
+
+void json_writer_null(JsonWriter *writer)
+{
+    _value_prefix(writer);
+    _put(writer, "null", 4);
+}
+
+void json_writer_raw_value(JsonWriter *writer, const char *raw, size_t len)
+{
+    _value_prefix(writer);
+    _put(writer, raw, len);
+}
+
+void json_writer_raw_members(JsonWriter *writer, const char *obj, size_t len)
+{
+    const char *begin = obj;
+    const char *end   = obj + len;
+
+    while (begin < end && *begin != '{') {
+        begin++;
+    }
+    while (end > begin && *(end - 1) != '}') {
+        end--;
+    }
+    if (end - begin < 2) {
+        writer->err = QCLOUD_ERR_INVAL;
+        return;
+    }
+
+    /* strip the braces and surrounding blanks */
+    for (begin++, end--; begin < end && strchr(" \t\r\n", *begin); begin++) {
+    }
+    while (end > begin && strchr(" \t\r\n", *(end - 1))) {
+        end--;
+    }
+    if (begin == end) {
+        return;
+    }
+
+    _value_prefix(writer);
+    _put(writer, begin, end - begin);
+}
+
+void json_writer_raw(JsonWriter *writer, const char *raw, size_t len)
+{
+    _put(writer, raw, len);
+}
+
+int json_writer_finish(JsonWriter *writer)
+{
+    if (writer->err) {
+        return writer->err;
+    }
+
+    writer->buf[writer->pos] = '\0';
+    return (int)writer->pos;
+}
+
+#ifdef __cplusplus
+}
+#endif
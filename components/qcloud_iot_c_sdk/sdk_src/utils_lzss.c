@@ -0,0 +1,155 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "utils_lzss.h"
+
+#include <string.h>
+
+/* a longer chain finds longer matches but costs more time per byte */
+#define LZSS_MAX_CHAIN (8)
+
+static uint32_t _hash(const uint8_t *p)
+{
+    return ((p[0] << 6) ^ (p[1] << 3) ^ p[2]) & ((1 << LZSS_HASH_BITS) - 1);
+}
+
+/* pass the finished output before the open group */
+static void _flush_output(LzssEncoder *enc, size_t end)
+{
+    if (enc->on_output && end > enc->out_done) {
+        enc->on_output(enc->user_data, enc->out + enc->out_done, end - enc->out_done);
+    }
+    enc->out_done = end;
+}
+
+static void _put_item(LzssEncoder *enc, int is_match)
+{
+    if (enc->flag_items == 8) {
+        _flush_output(enc, enc->out_len);
+        enc->flag_items = 0;
+    }
+    if (!enc->flag_items) {
+        enc->flag_pos           = enc->out_len++;
+        enc->out[enc->flag_pos] = 0;
+    }
+    if (is_match) {
+        enc->out[enc->flag_pos] |= 1 << enc->flag_items;
+    }
+    enc->flag_items++;
+}
+
+static void _insert(LzssEncoder *enc, size_t pos)
+{
+    uint32_t h = _hash(enc->in + pos);
+
+    enc->prev[pos % LZSS_WINDOW_SIZE] = enc->head[h];
+    enc->head[h]                      = pos + 1;
+}
+
+static size_t _find_match(LzssEncoder *enc, size_t pos, size_t end, size_t *distance)
+{
+    size_t   max_len  = (end - pos < LZSS_MAX_MATCH) ? end - pos : LZSS_MAX_MATCH;
+    size_t   best_len = 0;
+    size_t   len;
+    uint32_t cand;
+    int      chain;
+
+    if (max_len < LZSS_MIN_MATCH) {
+        return 0;
+    }
+
+    cand = enc->head[_hash(enc->in + pos)];
+    for (chain = 0; cand && chain < LZSS_MAX_CHAIN; chain++) {
+        cand--;
+        if (cand >= pos || pos - cand > LZSS_WINDOW_SIZE) {
+            break;
+        }
+
+        for (len = 0; len < max_len && enc->in[cand + len] == enc->in[pos + len]; len++) {
+        }
+        if (len > best_len) {
+            best_len  = len;
+            *distance = pos - cand;
+            if (len == max_len) {
+                break;
+            }
+        }
+        cand = enc->prev[cand % LZSS_WINDOW_SIZE];
+    }
+
+    return (best_len >= LZSS_MIN_MATCH) ? best_len : 0;
+}
+
+void utils_lzss_init(LzssEncoder *enc, const uint8_t *in, uint8_t *out, size_t out_size, LzssOutputCb on_output,
+                     void *user_data)
+{
+    memset(enc, 0, sizeof(LzssEncoder));
+    enc->in        = in;
+    enc->out       = out;
+    enc->out_size  = out_size;
+    enc->on_output = on_output;
+    enc->user_data = user_data;
+}
+
+int utils_lzss_compress(LzssEncoder *enc, size_t len)
+{
+    size_t   pos = enc->in_pos;
+    size_t   end = pos + len;
+    size_t   match_len, distance, i;
+    uint16_t token;
+
+    if (end > LZSS_MAX_INPUT || LZSS_BOUND(len) > enc->out_size - enc->out_len) {
+        return -1;
+    }
+
+    while (pos < end) {
+        match_len = _find_match(enc, pos, end, &distance);
+        if (match_len) {
+            _put_item(enc, 1);
+            token                    = ((distance - 1) << LZSS_LENGTH_BITS) | (match_len - LZSS_MIN_MATCH);
+            enc->out[enc->out_len++] = token >> 8;
+            enc->out[enc->out_len++] = token & 0xFF;
+        } else {
+            match_len = 1;
+            _put_item(enc, 0);
+            enc->out[enc->out_len++] = enc->in[pos];
+        }
+
+        /* positions whose hash reaches beyond this input are left out */
+        for (i = 0; i < match_len; i++, pos++) {
+            if (pos + LZSS_MIN_MATCH <= end) {
+                _insert(enc, pos);
+            }
+        }
+    }
+    enc->in_pos = end;
+
+    return 0;
+}
+
+size_t utils_lzss_finish(LzssEncoder *enc)
+{
+    _flush_output(enc, enc->out_len);
+
+    return enc->out_len;
+}
+
+#ifdef __cplusplus
+}
+#endif
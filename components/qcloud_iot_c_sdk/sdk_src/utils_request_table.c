@@ -0,0 +1,254 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "utils_request_table.h"
+
+#include <string.h>
+
+#include "qcloud_iot_export_error.h"
+#include "qcloud_iot_import.h"
+
+#define REQUEST_SLOT_NIL (0xFFFF)
+
+static uint16_t _bucket_of(const RequestTable *table, uint32_t token)
+{
+    return (token ^ (token >> 16)) & (table->capacity - 1);
+}
+
+/* a is due before b, deadlines wrap with HAL_GetTimeMs */
+static bool _is_before(const RequestTable *table, uint16_t a, uint16_t b)
+{
+    return (int32_t)(table->slots[a].deadline_ms - table->slots[b].deadline_ms) < 0;
+}
+
+static void _heap_set(RequestTable *table, uint16_t pos, uint16_t slot)
+{
+    table->heap[pos]            = slot;
+    table->slots[slot].heap_pos = pos;
+}
+
+static void _heap_sift_up(RequestTable *table, uint16_t pos)
+{
+    uint16_t slot = table->heap[pos];
+    uint16_t parent;
+
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (!_is_before(table, slot, table->heap[parent])) {
+            break;
+        }
+        _heap_set(table, pos, table->heap[parent]);
+        pos = parent;
+    }
+    _heap_set(table, pos, slot);
+}
+
+static void _heap_sift_down(RequestTable *table, uint16_t pos)
+{
+    uint16_t slot = table->heap[pos];
+    uint16_t child;
+
+    while ((child = 2 * pos + 1) < table->count) {
+        if (child + 1 < table->count && _is_before(table, table->heap[child + 1], table->heap[child])) {
+            child++;
+        }
+        if (!_is_before(table, table->heap[child], slot)) {
+            break;
+        }
+        _heap_set(table, pos, table->heap[child]);
+        pos = child;
+    }
+    _heap_set(table, pos, slot);
+}
+
+static void _link_free_slots(RequestTable *table, uint16_t from)
+{
+    uint16_t i;
+
+    for (i = from; i < table->capacity; i++) {
+        table->slots[i].next = (i + 1 < table->capacity) ? i + 1 : table->free_head;
+    }
+    table->free_head = from;
+}
+
+/* slots, buckets and heap share one allocation, slot indexes stay valid across a resize */
+static int _resize(RequestTable *table, uint16_t capacity)
+{
+    RequestSlot *slots;
+    uint16_t     old_capacity = table->capacity;
+    uint16_t     i, bucket;
+
+    slots = (RequestSlot *)HAL_Malloc(capacity * (sizeof(RequestSlot) + 2 * sizeof(uint16_t)));
+    if (!slots) {
+        return QCLOUD_ERR_MALLOC;
+    }
+
+    if (table->slots) {
+        memcpy(slots, table->slots, old_capacity * sizeof(RequestSlot));
+        memcpy(slots + capacity, table->heap, table->count * sizeof(uint16_t));
+        HAL_Free(table->slots);
+    }
+    table->slots    = slots;
+    table->heap     = (uint16_t *)(slots + capacity);
+    table->buckets  = table->heap + capacity;
+    table->capacity = capacity;
+
+    /* pending slots are found in heap, rehash them into the new buckets */
+    memset(table->buckets, 0xFF, capacity * sizeof(uint16_t));
+    for (i = 0; i < table->count; i++) {
+        bucket                     = _bucket_of(table, slots[table->heap[i]].entry.token);
+        slots[table->heap[i]].next = table->buckets[bucket];
+        table->buckets[bucket]     = table->heap[i];
+    }
+    _link_free_slots(table, old_capacity);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+int request_table_init(RequestTable *table, uint16_t capacity)
+{
+    uint16_t size = 1;
+
+    while (size < capacity && size < REQUEST_TABLE_MAX_SIZE) {
+        size <<= 1;
+    }
+
+    memset(table, 0, sizeof(RequestTable));
+    table->free_head = REQUEST_SLOT_NIL;
+
+    return _resize(table, size);
+}
+
+void request_table_deinit(RequestTable *table)
+{
+    HAL_Free(table->slots);
+    memset(table, 0, sizeof(RequestTable));
+}
+
+int request_table_add(RequestTable *table, const RequestEntry *entry, uint32_t timeout_ms)
+{
+    uint16_t slot, bucket;
+    int      rc;
+
+    if (table->free_head == REQUEST_SLOT_NIL) {
+        if (table->capacity >= REQUEST_TABLE_MAX_SIZE) {
+            return QCLOUD_ERR_MAX_APPENDING_REQUEST;
+        }
+        rc = _resize(table, table->capacity * 2);
+        if (rc != QCLOUD_RET_SUCCESS) {
+            return rc;
+        }
+    }
+
+    slot             = table->free_head;
+    table->free_head = table->slots[slot].next;
+
+    table->slots[slot].entry       = *entry;
+    table->slots[slot].deadline_ms = HAL_GetTimeMs() + timeout_ms;
+
+    bucket                  = _bucket_of(table, entry->token);
+    table->slots[slot].next = table->buckets[bucket];
+    table->buckets[bucket]  = slot;
+
+    table->heap[table->count] = slot;
+    _heap_sift_up(table, table->count++);
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+static void _remove_slot(RequestTable *table, uint16_t slot, RequestEntry *entry)
+{
+    uint16_t *link = &table->buckets[_bucket_of(table, table->slots[slot].entry.token)];
+    uint16_t  pos  = table->slots[slot].heap_pos;
+    uint16_t  moved;
+
+    while (*link != slot) {
+        link = &table->slots[*link].next;
+    }
+    *link = table->slots[slot].next;
+
+    /* fill the hole with the last one, it may go either way */
+    if (pos != --table->count) {
+        moved = table->heap[table->count];
+        _heap_set(table, pos, moved);
+        _heap_sift_up(table, pos);
+        _heap_sift_down(table, table->slots[moved].heap_pos);
+    }
+
+    *entry                  = table->slots[slot].entry;
+    table->slots[slot].next = table->free_head;
+    table->free_head        = slot;
+}
+
+static uint16_t _find_slot(const RequestTable *table, uint32_t token)
+{
+    uint16_t slot;
+
+    if (!table->capacity) {
+        return REQUEST_SLOT_NIL;
+    }
+
+    for (slot = table->buckets[_bucket_of(table, token)]; slot != REQUEST_SLOT_NIL; slot = table->slots[slot].next) {
+        if (table->slots[slot].entry.token == token) {
+            break;
+        }
+    }
+
+    return slot;
+}
+
+bool request_table_contains(const RequestTable *table, uint32_t token)
+{
+    return _find_slot(table, token) != REQUEST_SLOT_NIL;
+}
+
+bool request_table_take(RequestTable *table, uint32_t token, RequestEntry *entry)
+{
+    uint16_t slot = _find_slot(table, token);
+
+    if (slot == REQUEST_SLOT_NIL) {
+        return false;
+    }
+
+    _remove_slot(table, slot, entry);
+    return true;
+}
+
+bool request_table_take_first(RequestTable *table, RequestEntry *entry)
+{
+    if (!table->count) {
+        return false;
+    }
+
+    _remove_slot(table, table->heap[0], entry);
+    return true;
+}
+
+bool request_table_take_expired(RequestTable *table, RequestEntry *entry)
+{
+    if (!table->count || (int32_t)(table->slots[table->heap[0]].deadline_ms - HAL_GetTimeMs()) > 0) {
+        return false;
+    }
+
+    return request_table_take_first(table, entry);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,360 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Benchmark and regression test of the flash writer on the NOR flash emulator
+ *
+ * Build in components/qcloud_iot_c_sdk:
+ *   gcc -O2 -Iinclude -Iinclude/exports -Isdk_src/internal_inc -o flash_writer_bench tools/flash_writer_bench.c \
+ *       sdk_src/utils_flash_writer.c sdk_src/utils_flash_sim.c
+ *
+ * Run:
+ *   ./flash_writer_bench [-n image_size] [-c max_chunk] [-S sector_size] [-p page_size] [-a erase_ahead]
+ *                        [-e erase_us] [-w program_us] [-s seed] [-f flash_file]
+ *
+ * An image is written in random network sized chunks twice: programmed chunk by
+ * chunk with sectors erased on demand, as esp_ota_write did, then through the
+ * flash writer with erase-ahead between chunks and a power cut resume halfway.
+ * Both are read back and compared. The exit code is non-zero if the content or
+ * the NOR program rule is wrong, or the writer erases more than the image, the
+ * spare sector and the sectors it erased ahead before the power cut.
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "qcloud_iot_export_error.h"
+#include "qcloud_iot_export_log.h"
+#include "qcloud_iot_import.h"
+#include "utils_flash_sim.h"
+#include "utils_flash_writer.h"
+
+/* HAL and log of the writer and the emulator */
+void *HAL_Malloc(uint32_t size)
+{
+    return malloc(size);
+}
+
+void HAL_Free(void *ptr)
+{
+    free(ptr);
+}
+
+void HAL_SleepMs(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+void *HAL_FileOpen(const char *filename, const char *mode)
+{
+    return fopen(filename, mode);
+}
+
+size_t HAL_FileRead(void *ptr, size_t size, size_t nmemb, void *fp)
+{
+    return fread(ptr, size, nmemb, (FILE *)fp);
+}
+
+size_t HAL_FileWrite(const void *ptr, size_t size, size_t nmemb, void *fp)
+{
+    return fwrite(ptr, size, nmemb, (FILE *)fp);
+}
+
+int HAL_FileSeek(void *fp, long int offset, int whence)
+{
+    return fseek((FILE *)fp, offset, whence);
+}
+
+int HAL_FileClose(void *fp)
+{
+    return fclose((FILE *)fp);
+}
+
+int HAL_FileFlush(void *fp)
+{
+    return fflush((FILE *)fp);
+}
+
+long HAL_FileSize(void *fp)
+{
+    long pos = ftell((FILE *)fp);
+    long size;
+
+    fseek((FILE *)fp, 0, SEEK_END);
+    size = ftell((FILE *)fp);
+    fseek((FILE *)fp, pos, SEEK_SET);
+
+    return size;
+}
+
+void IOT_Log_Gen(const char *file, const char *func, const int line, const int level, const char *fmt, ...)
+{
+    va_list args;
+
+    if (level > eLOG_WARN) {
+        return;
+    }
+
+    va_start(args, fmt);
+    fprintf(stderr, "%s|%d ", func, line);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+typedef struct {
+    uint32_t image_size;
+    uint32_t max_chunk;
+    uint32_t sector_size;
+    uint32_t page_size;
+    uint32_t erase_ahead;
+    uint32_t erase_us;    // modeled time to erase a sector
+    uint32_t program_us;  // modeled time to program a page
+} BenchConfig;
+
+typedef struct {
+    FlashSimStats stats;
+    uint64_t      write_path_us;  // modeled flash time spent inside the write calls
+} BenchResult;
+
+/* the image rounded up to sectors, and a spare sector for erase-ahead to stop at */
+static uint32_t _flash_size(const BenchConfig *cfg)
+{
+    return (cfg->image_size + cfg->sector_size - 1) / cfg->sector_size * cfg->sector_size + cfg->sector_size;
+}
+
+static uint32_t _next_chunk(const BenchConfig *cfg, uint32_t pos)
+{
+    uint32_t len = 1 + rand() % cfg->max_chunk;
+
+    return len < cfg->image_size - pos ? len : cfg->image_size - pos;
+}
+
+static uint64_t _busy_us(void *sim)
+{
+    FlashSimStats stats;
+
+    utils_flash_sim_get_stats(sim, &stats);
+    return stats.busy_us;
+}
+
+/* program every chunk as it arrives, erasing the sectors it reaches first */
+static int _write_direct(void *sim, const BenchConfig *cfg, const uint8_t *image, BenchResult *result)
+{
+    FlashWriterOps ops;
+    uint32_t       pos, len, erased_end = 0;
+
+    utils_flash_sim_get_ops(sim, &ops);
+    for (pos = 0; pos < cfg->image_size; pos += len) {
+        len = _next_chunk(cfg, pos);
+        for (; erased_end < pos + len; erased_end += cfg->sector_size) {
+            if (ops.erase(ops.usr_data, erased_end, cfg->sector_size)) {
+                return QCLOUD_ERR_FAILURE;
+            }
+        }
+        if (ops.program(ops.usr_data, pos, image + pos, len)) {
+            return QCLOUD_ERR_FAILURE;
+        }
+    }
+
+    result->write_path_us = _busy_us(sim);
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* write through the flash writer from start to end, erasing ahead after every chunk */
+static int _write_range(void *sim, const BenchConfig *cfg, const uint8_t *image, uint32_t start, uint32_t end,
+                        uint8_t *buf, BenchResult *result)
+{
+    FlashWriterOps ops;
+    FlashWriter    writer;
+    uint32_t       pos, len;
+    uint64_t       busy;
+    int            rc;
+
+    utils_flash_sim_get_ops(sim, &ops);
+    rc = utils_flash_writer_init(&writer, &ops, start, _flash_size(cfg), buf, cfg->sector_size, cfg->erase_ahead);
+    for (pos = start; !rc && pos < end; pos += len) {
+        len  = _next_chunk(cfg, pos);
+        len  = len < end - pos ? len : end - pos;
+        busy = _busy_us(sim);
+        rc   = utils_flash_writer_write(&writer, image + pos, len);
+        result->write_path_us += _busy_us(sim) - busy;
+
+        /* the idle slot while the next chunk is fetched */
+        if (!rc && utils_flash_writer_erase_ahead(&writer, 1) < 0) {
+            rc = QCLOUD_ERR_FAILURE;
+        }
+    }
+
+    if (!rc) {
+        busy = _busy_us(sim);
+        rc   = utils_flash_writer_flush(&writer);
+        result->write_path_us += _busy_us(sim) - busy;
+    }
+
+    return rc;
+}
+
+static int _write_by_writer(void *sim, const BenchConfig *cfg, const uint8_t *image, BenchResult *result)
+{
+    uint8_t *buf = malloc(cfg->sector_size);
+    uint32_t half;
+    int      rc;
+
+    if (!buf) {
+        return QCLOUD_ERR_MALLOC;
+    }
+
+    /* power is cut after half of the image, the download resumes from the bytes flushed */
+    half = cfg->image_size / 2;
+    rc   = _write_range(sim, cfg, image, 0, half, buf, result);
+    if (!rc) {
+        rc = _write_range(sim, cfg, image, half, cfg->image_size, buf, result);
+    }
+
+    free(buf);
+    return rc;
+}
+
+static int _run(const char *name, const char *flash_file, const BenchConfig *cfg, const uint8_t *image, int seed,
+                int (*write)(void *, const BenchConfig *, const uint8_t *, BenchResult *), BenchResult *result)
+{
+    FlashSimTiming timing = {0};
+    uint8_t *      readback;
+    void *         sim;
+    int            rc;
+
+    timing.erase_sector_us = cfg->erase_us;
+    timing.program_page_us = cfg->program_us;
+
+    /* a fresh chip, the same chunk sizes for every run */
+    remove(flash_file);
+    sim = utils_flash_sim_open(flash_file, _flash_size(cfg), cfg->sector_size, cfg->page_size, &timing);
+    if (!sim) {
+        fprintf(stderr, "%s: open flash sim failed\n", name);
+        return 1;
+    }
+
+    srand(seed);
+    memset(result, 0, sizeof(BenchResult));
+    rc = write(sim, cfg, image, result);
+    utils_flash_sim_get_stats(sim, &result->stats);
+
+    readback = malloc(cfg->image_size);
+    if (!rc && readback) {
+        rc = utils_flash_sim_read(sim, 0, readback, cfg->image_size);
+    }
+    if (!rc && memcmp(readback, image, cfg->image_size)) {
+        fprintf(stderr, "%s: read back differs from the image\n", name);
+        rc = QCLOUD_ERR_FAILURE;
+    }
+    free(readback);
+    utils_flash_sim_close(sim);
+    remove(flash_file);
+
+    printf("%-8s erases %5u (max %u per sector)  programs %6u  bytes %8u  write path %8.1f ms  total %8.1f ms\n",
+           name, result->stats.erase_cnt, result->stats.max_sector_erase, result->stats.program_cnt,
+           result->stats.bytes_programmed, result->write_path_us / 1000.0, result->stats.busy_us / 1000.0);
+
+    return rc ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig cfg        = {512 * 1024, 2048, 4096, 256, 2, 45000, 700};
+    const char *flash_file = "flash_writer_bench.bin";
+    int         seed       = 1;
+    BenchResult direct, writer;
+    uint8_t *   image;
+    uint32_t    i;
+    int         opt, failed = 0;
+
+    while ((opt = getopt(argc, argv, "n:c:S:p:a:e:w:s:f:")) != -1) {
+        switch (opt) {
+            case 'n':
+                cfg.image_size = atoi(optarg);
+                break;
+            case 'c':
+                cfg.max_chunk = atoi(optarg);
+                break;
+            case 'S':
+                cfg.sector_size = atoi(optarg);
+                break;
+            case 'p':
+                cfg.page_size = atoi(optarg);
+                break;
+            case 'a':
+                cfg.erase_ahead = atoi(optarg);
+                break;
+            case 'e':
+                cfg.erase_us = atoi(optarg);
+                break;
+            case 'w':
+                cfg.program_us = atoi(optarg);
+                break;
+            case 's':
+                seed = atoi(optarg);
+                break;
+            case 'f':
+                flash_file = optarg;
+                break;
+            default:
+                fprintf(stderr,
+                        "usage: %s [-n image_size] [-c max_chunk] [-S sector_size] [-p page_size] [-a erase_ahead] "
+                        "[-e erase_us] [-w program_us] [-s seed] [-f flash_file]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    if (!cfg.image_size || !cfg.max_chunk || !cfg.page_size || !cfg.sector_size || cfg.sector_size % cfg.page_size) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    image = malloc(cfg.image_size);
+    if (!image) {
+        return 1;
+    }
+    srand(seed);
+    for (i = 0; i < cfg.image_size; i++) {
+        image[i] = rand();
+    }
+
+    failed |= _run("direct", flash_file, &cfg, image, seed, _write_direct, &direct);
+    failed |= _run("writer", flash_file, &cfg, image, seed, _write_by_writer, &writer);
+
+    /* the sectors erased ahead before the power cut are erased again by the resumed writer */
+    if (writer.stats.program_violations ||
+        writer.stats.erase_cnt > _flash_size(&cfg) / cfg.sector_size + cfg.erase_ahead + 1) {
+        fprintf(stderr, "writer: %u program violations, %u erases, max %u per sector\n",
+                writer.stats.program_violations, writer.stats.erase_cnt, writer.stats.max_sector_erase);
+        failed = 1;
+    }
+
+    if (!failed) {
+        printf("programs %.2fx fewer, write path %.2fx faster\n",
+               (double)direct.stats.program_cnt / (writer.stats.program_cnt ? writer.stats.program_cnt : 1),
+               (double)direct.write_path_us / (writer.write_path_us ? writer.write_path_us : 1));
+    }
+
+    free(image);
+    printf("%s\n", failed ? "FAILED" : "PASSED");
+    return failed;
+}
@@ -0,0 +1,281 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Benchmark of the gateway local automation engine on Linux
+ *
+ * Build in components/qcloud_iot_c_sdk:
+ *   gcc -O2 -Iinclude -Iinclude/exports -Isdk_src/internal_inc -o automation_bench tools/gateway_automation_bench.c \
+ *       sdk_src/gateway_automation.c sdk_src/utils_hash_index.c sdk_src/json_parser.c sdk_src/json_token.c \
+ *       sdk_src/string_utils.c
+ *
+ * Run:
+ *   ./automation_bench [-r rules] [-d devices] [-p properties] [-n updates] [-s seed] [-f stream_file]
+ *
+ * Random rules over devices * properties are compiled, then a property stream is
+ * replayed, either random or from stream_file with one "product_id device_name
+ * property value" per line. Latency of each update includes the actions fired.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gateway_automation.h"
+#include "qcloud_iot_import.h"
+
+#define BENCH_PRODUCT_ID  "BENCHPID01"
+#define BENCH_MAX_LATENCY (10000)  // us
+
+/* HAL and log of the engine */
+void *HAL_Malloc(uint32_t size)
+{
+    return malloc(size);
+}
+
+void HAL_Free(void *ptr)
+{
+    free(ptr);
+}
+
+void *HAL_MutexCreate(void)
+{
+    return (void *)1;
+}
+
+void HAL_MutexDestroy(void *mutex) {}
+
+void HAL_MutexLock(void *mutex) {}
+
+void HAL_MutexUnlock(void *mutex) {}
+
+uint32_t HAL_GetTimeMs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void HAL_Printf(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+int HAL_Snprintf(char *str, const int len, const char *fmt, ...)
+{
+    va_list args;
+    int     rc;
+
+    va_start(args, fmt);
+    rc = vsnprintf(str, len, fmt, args);
+    va_end(args);
+
+    return rc;
+}
+
+int HAL_Vsnprintf(char *str, const int len, const char *format, va_list ap)
+{
+    return vsnprintf(str, len, format, ap);
+}
+
+void IOT_Log_Gen(const char *file, const char *func, const int line, const int level, const char *fmt, ...)
+{
+    va_list args;
+
+    if (level > eLOG_WARN) {
+        return;
+    }
+
+    va_start(args, fmt);
+    fprintf(stderr, "%s|%d ", func, line);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+static uint64_t sg_action_count;
+
+static int _bench_action(const char *automation_id, const char *product_id, const char *device_name,
+                         const char *data, void *user_data)
+{
+    sg_action_count++;
+    return 0;
+}
+
+static uint64_t _now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int _compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int _bench_rules(void *engine, int rules, int devices, int properties)
+{
+    static const char *ops[] = {"gt", "lt", "ge", "le", "eq", "ne"};
+    char               id[32];
+    char               params[2048];
+    int                len, cond_num, i, j;
+    uint64_t           start = _now_us();
+
+    for (i = 0; i < rules; i++) {
+        cond_num = 1 + rand() % 3;
+        len      = snprintf(params, sizeof(params), "{\"matchType\":%d,\"conditions\":[", rand() % 2);
+        for (j = 0; j < cond_num; j++) {
+            if (rand() % 10 == 0) {
+                len += snprintf(params + len, sizeof(params) - len,
+                                "%s{\"type\":1,\"days\":\"1111111\",\"time\":\"%02d:%02d\"}", j ? "," : "",
+                                rand() % 24, rand() % 60);
+            } else {
+                len += snprintf(params + len, sizeof(params) - len,
+                                "%s{\"type\":0,\"productId\":\"" BENCH_PRODUCT_ID
+                                "\",\"deviceName\":\"dev%d\",\"propertyId\":\"prop%d\",\"op\":\"%s\",\"value\":%d}",
+                                j ? "," : "", rand() % devices, rand() % properties, ops[rand() % 4], rand() % 100);
+            }
+        }
+        snprintf(params + len, sizeof(params) - len,
+                 "],\"actions\":[{\"productId\":\"" BENCH_PRODUCT_ID
+                 "\",\"deviceName\":\"dev%d\",\"data\":{\"power_switch\":%d}}]}",
+                 rand() % devices, rand() % 2);
+
+        snprintf(id, sizeof(id), "auto%d", i);
+        if (IOT_Gateway_AutoMation_Set(engine, id, 1, params)) {
+            return -1;
+        }
+    }
+
+    printf("compiled %d rules in %.1f ms\n", rules, (_now_us() - start) / 1000.0);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int         rules = 4000, devices = 200, properties = 8, updates = 200000, seed = 1;
+    const char *stream_file = NULL;
+    FILE *      stream      = NULL;
+    uint32_t *  latency;
+    uint64_t    total = 0, start;
+    char        product_id[MAX_SIZE_OF_PRODUCT_ID + 1], device_name[MAX_SIZE_OF_DEVICE_NAME + 1];
+    char        property[GATEWAY_AUTOMATION_MAX_PROPERTY + 1];
+    char        name[MAX_SIZE_OF_DEVICE_NAME + 1], prop[GATEWAY_AUTOMATION_MAX_PROPERTY + 1];
+    double      value;
+    void *      engine;
+    int         opt, count = 0, rc;
+
+    while ((opt = getopt(argc, argv, "r:d:p:n:s:f:")) != -1) {
+        switch (opt) {
+            case 'r':
+                rules = atoi(optarg);
+                break;
+            case 'd':
+                devices = atoi(optarg);
+                break;
+            case 'p':
+                properties = atoi(optarg);
+                break;
+            case 'n':
+                updates = atoi(optarg);
+                break;
+            case 's':
+                seed = atoi(optarg);
+                break;
+            case 'f':
+                stream_file = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-r rules] [-d devices] [-p properties] [-n updates] [-s seed] [-f file]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    if (rules <= 0 || devices <= 0 || properties <= 0 || updates <= 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    if (stream_file) {
+        stream = fopen(stream_file, "r");
+        if (!stream) {
+            perror(stream_file);
+            return 1;
+        }
+    }
+
+    srand(seed);
+    engine  = IOT_Gateway_AutoMation_Create(_bench_action, NULL);
+    latency = malloc(updates * sizeof(uint32_t));
+    if (!engine || !latency || _bench_rules(engine, rules, devices, properties)) {
+        fprintf(stderr, "setup failed\n");
+        return 1;
+    }
+
+    IOT_Gateway_AutoMation_Tick(engine, time(NULL));
+
+    while (count < updates) {
+        if (stream) {
+            if (fscanf(stream, "%10s %48s %32s %lf", product_id, device_name, property, &value) != 4) {
+                break;
+            }
+        } else {
+            snprintf(name, sizeof(name), "dev%d", rand() % devices);
+            snprintf(prop, sizeof(prop), "prop%d", rand() % properties);
+            strcpy(product_id, BENCH_PRODUCT_ID);
+            strcpy(device_name, name);
+            strcpy(property, prop);
+            value = rand() % 100;
+        }
+
+        start = _now_us();
+        IOT_Gateway_AutoMation_Property(engine, product_id, device_name, property, value);
+        latency[count] = _now_us() - start;
+        total += latency[count++];
+    }
+
+    if (!count) {
+        fprintf(stderr, "no update replayed\n");
+        return 1;
+    }
+
+    qsort(latency, count, sizeof(uint32_t), _compare_u32);
+    printf("%d updates, %llu actions, latency avg %.2f us, p99 %u us, max %u us\n", count,
+           (unsigned long long)sg_action_count, (double)total / count, latency[count * 99 / 100], latency[count - 1]);
+
+    rc = latency[count - 1] > BENCH_MAX_LATENCY;
+
+    IOT_Gateway_AutoMation_Destroy(engine);
+    free(latency);
+    if (stream) {
+        fclose(stream);
+    }
+
+    return rc;
+}
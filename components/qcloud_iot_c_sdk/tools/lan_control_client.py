@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# Tencent is pleased to support the open source community by making IoT Hub available.
+# Copyright (C) 2018-2020 Tencent. All rights reserved.
+#
+# Licensed under the MIT License (the "License"); you may not use this file except in
+# compliance with the License. You may obtain a copy of the License at
+# http://opensource.org/licenses/MIT
+#
+# Unless required by applicable law or agreed to in writing, software distributed under the License is
+# distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+# either express or implied. See the License for the specific language governing permissions and
+# limitations under the License.
+#
+"""Client of the LAN control service of sdk_src/data_template_lan_control.c.
+
+Signs requests with the LAN key derived from the device secret and prints the
+verified reply. The nonce of the device is learned from the stale nonce reply
+to the first request, which is sent again with it. With --bench N it sends N controls one after another and
+prints the round trip latency, against a device running on the same host it
+is a loopback benchmark of the service.
+
+usage: lan_control_client.py -H host -P product_id -N device_name -S device_secret [-p port]
+                             [-c client_id] (--control JSON | --get-status | --bench N [--property KEY])
+"""
+
+import argparse
+import hashlib
+import hmac
+import json
+import socket
+import sys
+import time
+
+SIGN_LEN = 40
+KEY_SALT = "lan_control"
+
+
+def lan_key(product_id, device_name, device_secret):
+    msg = (product_id + device_name + KEY_SALT).encode()
+    return hmac.new(device_secret.encode(), msg, hashlib.sha1).hexdigest().encode()
+
+
+def sign(key, payload):
+    return hmac.new(key, payload, hashlib.sha1).hexdigest().encode()
+
+
+class Client:
+    def __init__(self, host, port, key, client_id, timeout):
+        self.addr = (host, port)
+        self.key = key
+        self.client_id = client_id
+        # the device keeps the last seq of each client id under its nonce
+        self.seq = 0
+        self.nonce = None
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.settimeout(timeout)
+
+    def send(self, method, **members):
+        self.seq += 1
+        msg = {"method": method, "clientToken": "lan-%d" % self.seq, "clientId": self.client_id, "seq": self.seq}
+        if self.nonce is not None:
+            msg["nonce"] = self.nonce
+        msg.update(members)
+        payload = json.dumps(msg, separators=(",", ":")).encode()
+        self.sock.sendto(sign(self.key, payload) + payload, self.addr)
+        while True:
+            data, _ = self.sock.recvfrom(2048)
+            reply = data[SIGN_LEN:]
+            if not hmac.compare_digest(data[:SIGN_LEN], sign(self.key, reply)):
+                raise ValueError("bad signature of reply")
+            reply = json.loads(reply)
+            if reply.get("clientToken") == msg["clientToken"]:
+                return reply
+
+    def request(self, method, **members):
+        reply = self.send(method, **members)
+        while reply.get("status") == "stale nonce" and reply["nonce"] != self.nonce:
+            # seqs start over under a new nonce
+            self.nonce = reply["nonce"]
+            self.seq = 0
+            reply = self.send(method, **members)
+        return reply
+
+
+def bench(client, count, prop):
+    latencies = []
+    for i in range(count):
+        start = time.perf_counter()
+        reply = client.request("control", params={prop: i % 2})
+        latencies.append((time.perf_counter() - start) * 1000)
+        if reply.get("code") != 0:
+            sys.exit("control %d failed: %s" % (i, reply))
+    latencies.sort()
+
+    def pct(p):
+        return latencies[min(len(latencies) - 1, int(len(latencies) * p / 100))]
+
+    print("%d controls: avg %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms" %
+          (count, sum(latencies) / count, pct(50), pct(99), latencies[-1]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-H", "--host", default="127.0.0.1")
+    parser.add_argument("-p", "--port", type=int, default=8267)
+    parser.add_argument("-P", "--product-id", required=True)
+    parser.add_argument("-N", "--device-name", required=True)
+    parser.add_argument("-S", "--device-secret", required=True)
+    parser.add_argument("-c", "--client-id", default="lan_control_client")
+    parser.add_argument("-t", "--timeout", type=float, default=2.0)
+    group = parser.add_mutually_exclusive_group(required=True)
+    group.add_argument("--control", help="params object of the control, e.g. '{\"power_switch\":1}'")
+    group.add_argument("--get-status", action="store_true")
+    group.add_argument("--bench", type=int, metavar="N")
+    parser.add_argument("--property", default="power_switch", help="property toggled by --bench")
+    args = parser.parse_args()
+
+    key = lan_key(args.product_id, args.device_name, args.device_secret)
+    client = Client(args.host, args.port, key, args.client_id, args.timeout)
+    if args.bench:
+        bench(client, args.bench, args.property)
+    elif args.get_status:
+        print(json.dumps(client.request("get_status")))
+    else:
+        print(json.dumps(client.request("control", params=json.loads(args.control))))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# Tencent is pleased to support the open source community by making IoT Hub available.
+# Copyright (C) 2018-2020 Tencent. All rights reserved.
+#
+# Licensed under the MIT License (the "License"); you may not use this file except in
+# compliance with the License. You may obtain a copy of the License at
+# http://opensource.org/licenses/MIT
+#
+# Unless required by applicable law or agreed to in writing, software distributed under the License is
+# distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+# either express or implied. See the License for the specific language governing permissions and
+# limitations under the License.
+#
+"""Expand binary log records uploaded with LOG_UPLOAD_BINARY into text logs.
+
+The device uploads "B|<base64>" lines holding the addresses of the format,
+file and function strings together with the raw arguments, see
+sdk_src/internal_inc/log_binary.h. The strings are read from the ELF file of
+the very firmware that produced the logs. Text lines are passed through.
+
+usage: log_decoder.py -e firmware.elf [log_file ...]
+"""
+
+import argparse
+import base64
+import struct
+import sys
+import time
+
+LOG_BINARY_PREFIX = "B|"
+LOG_BINARY_VERSION = 1
+LOG_BINARY_FLAG_TRUNCATED = 0x01
+LEVEL_STR = ["DIS", "ERR", "WRN", "INF", "DBG"]
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+
+class ElfStrings(object):
+    """Read '\\0' terminated strings at their load address from an ELF file"""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % path)
+        is_64 = self.data[4] == 2
+        endian = "<" if self.data[5] == 1 else ">"
+        if is_64:
+            shoff, = struct.unpack_from(endian + "Q", self.data, 0x28)
+            shentsize, shnum = struct.unpack_from(endian + "HH", self.data, 0x3A)
+            sh_fmt = endian + "IIQQQQ"
+        else:
+            shoff, = struct.unpack_from(endian + "I", self.data, 0x20)
+            shentsize, shnum = struct.unpack_from(endian + "HH", self.data, 0x2E)
+            sh_fmt = endian + "IIIIII"
+
+        self.sections = []
+        for i in range(shnum):
+            _, sh_type, flags, addr, offset, size = struct.unpack_from(sh_fmt, self.data, shoff + i * shentsize)
+            if flags & SHF_ALLOC and sh_type != SHT_NOBITS and addr:
+                self.sections.append((addr, offset, size))
+
+    def get(self, addr):
+        for sec_addr, offset, size in self.sections:
+            if sec_addr <= addr < sec_addr + size:
+                start = offset + addr - sec_addr
+                end = self.data.find(b"\0", start, offset + size)
+                return self.data[start:end if end >= 0 else offset + size].decode("utf-8", "replace")
+        return "<0x%x?>" % addr
+
+
+class Record(object):
+    def __init__(self, raw):
+        self.raw = raw
+        self.pos = 0
+
+    def left(self):
+        return len(self.raw) - self.pos
+
+    def byte(self):
+        value = self.raw[self.pos]
+        self.pos += 1
+        return value
+
+    def varint(self):
+        value = shift = 0
+        while True:
+            b = self.byte()
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return value
+
+    def signed(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def double(self):
+        value, = struct.unpack_from("<d", self.raw, self.pos)
+        self.pos += 8
+        return value
+
+    def string(self):
+        n = self.varint()
+        value = self.raw[self.pos:self.pos + n]
+        if len(value) < n:
+            raise IndexError("string out of record")
+        self.pos += n
+        return value.decode("utf-8", "replace")
+
+
+def _format(fmt, record):
+    """Walk conversions of fmt like the device and format the arguments of record"""
+    out = []
+    i = 0
+    while True:
+        j = fmt.find("%", i)
+        if j < 0:
+            out.append(fmt[i:])
+            return "".join(out), True
+        out.append(fmt[i:j])
+        i = j + 1
+        if fmt[i:i + 1] == "%":
+            out.append("%")
+            i += 1
+            continue
+
+        try:
+            spec = "%"
+            args = []
+            while i < len(fmt) and fmt[i] in "-+ #0":
+                spec += fmt[i]
+                i += 1
+            if fmt[i:i + 1] == "*":
+                spec += "*"
+                args.append(record.signed())
+                i += 1
+            while i < len(fmt) and fmt[i].isdigit():
+                spec += fmt[i]
+                i += 1
+            precision = None
+            if fmt[i:i + 1] == ".":
+                i += 1
+                if fmt[i:i + 1] == "*":
+                    precision = record.signed()
+                    i += 1
+                else:
+                    digits = ""
+                    while i < len(fmt) and fmt[i].isdigit():
+                        digits += fmt[i]
+                        i += 1
+                    precision = int(digits or "0")
+                if precision >= 0:
+                    spec += ".%d" % precision
+            while i < len(fmt) and fmt[i] in "hlLqjzt":
+                i += 1
+
+            conv = fmt[i:i + 1]
+            i += 1
+            if conv in ("d", "i"):
+                out.append((spec + "d") % tuple(args + [record.signed()]))
+            elif conv in ("u", "o", "x", "X"):
+                out.append((spec + ("d" if conv == "u" else conv)) % tuple(args + [record.varint()]))
+            elif conv == "c":
+                out.append((spec + "c") % tuple(args + [chr(record.varint())]))
+            elif conv == "p":
+                out.append("0x%x" % record.varint())
+            elif conv == "s":
+                out.append((spec + "s") % tuple(args + [record.string()]))
+            elif conv in ("a", "A"):
+                value = record.double().hex()
+                out.append(value.upper() if conv == "A" else value)
+            elif conv in ("f", "F", "e", "E", "g", "G"):
+                out.append((spec + conv) % tuple(args + [record.double()]))
+            elif conv == "n":
+                pass
+            else:
+                return "".join(out), False
+        except (IndexError, struct.error):
+            return "".join(out), False
+
+
+def decode_line(line, strings):
+    if not line.startswith(LOG_BINARY_PREFIX):
+        return line
+
+    try:
+        record = Record(base64.b64decode(line[len(LOG_BINARY_PREFIX):]))
+        version = record.byte()
+        if version != LOG_BINARY_VERSION:
+            return "<unsupported binary log version %d> %s" % (version, line)
+        flags = record.byte()
+        level = record.varint()
+        time_sec = record.varint()
+        file_name = strings.get(record.varint()).replace("\\", "/").split("/")[-1]
+        func = strings.get(record.varint())
+        line_no = record.varint()
+        fmt = strings.get(record.varint())
+    except (IndexError, ValueError):
+        return "<invalid binary log> %s" % line
+
+    msg, complete = _format(fmt, record)
+    if not complete or flags & LOG_BINARY_FLAG_TRUNCATED:
+        msg += "...<truncated>"
+
+    return "%s|%s|%s|%s(%d): %s" % (LEVEL_STR[level] if level < len(LEVEL_STR) else str(level),
+                                    time.strftime("%Y-%m-%d %H:%M:%S", time.gmtime(time_sec)), file_name, func,
+                                    line_no, msg.rstrip("\r\n"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="decode binary log records of qcloud iot sdk")
+    parser.add_argument("-e", "--elf", required=True, help="ELF file of the firmware which uploaded the logs")
+    parser.add_argument("logs", nargs="*", help="log files, read stdin if none")
+    args = parser.parse_args()
+
+    strings = ElfStrings(args.elf)
+    inputs = [open(path, "r", errors="replace") for path in args.logs] or [sys.stdin]
+    for f in inputs:
+        # uploaded logs are delimited by "\n\f"
+        for line in f.read().replace("\f", "").splitlines():
+            if line:
+                print(decode_line(line, strings))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,217 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# Tencent is pleased to support the open source community by making IoT Hub available.
+# Copyright (C) 2018-2020 Tencent. All rights reserved.
+#
+# Licensed under the MIT License (the "License"); you may not use this file except in
+# compliance with the License. You may obtain a copy of the License at
+# http://opensource.org/licenses/MIT
+#
+# Unless required by applicable law or agreed to in writing, software distributed under the License is
+# distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+# either express or implied. See the License for the specific language governing permissions and
+# limitations under the License.
+#
+"""Local stand-in of the MQTT broker for testing log upload over MQTT on Linux.
+
+A minimal MQTT 3.1.1 broker on plain TCP: it accepts any CONNECT, routes
+PUBLISH to exact topic subscribers, answers the get_log_level request of
+sdk_src/log_mqtt.c and checks the log messages published by
+sdk_src/log_upload.c with LOG_UPLOAD_MQTT the same way log_upload_server.py
+checks HTTP posts. --drop-ack N leaves every Nth log message unacked, so the
+device has to republish it.
+
+usage: log_mqtt_broker.py -k sign_key [-p port] [--log-level N] [--drop-ack N]
+"""
+
+import argparse
+import json
+import os
+import socketserver
+import struct
+import sys
+import threading
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from log_upload_server import Stats, handle_post  # noqa: E402
+
+CONNECT, CONNACK, PUBLISH, PUBACK = 1, 2, 3, 4
+SUBSCRIBE, SUBACK, UNSUBSCRIBE, UNSUBACK = 8, 9, 10, 11
+PINGREQ, PINGRESP, DISCONNECT = 12, 13, 14
+
+LOG_UPLOAD_TOPIC = "$log/operation/upload/"
+LOG_LEVEL_TOPIC = "$log/operation/"
+LOG_RESULT_TOPIC = "$log/operation/result/"
+
+
+def encode_length(length):
+    out = bytearray()
+    while True:
+        byte = length % 128
+        length //= 128
+        out.append(byte | 0x80 if length else byte)
+        if not length:
+            return bytes(out)
+
+
+def packet(ptype, flags, body):
+    return bytes([(ptype << 4) | flags]) + encode_length(len(body)) + body
+
+
+def publish_packet(topic, payload):
+    topic = topic.encode()
+    return packet(PUBLISH, 0, struct.pack("!H", len(topic)) + topic + payload)
+
+
+class Broker:
+    def __init__(self, key, log_level, drop_ack):
+        self.key = key
+        self.log_level = log_level
+        self.drop_ack = drop_ack
+        self.stats = Stats()
+        self.log_messages = 0
+        self.lock = threading.Lock()
+        self.subscribers = {}
+
+    def subscribe(self, topic, session):
+        with self.lock:
+            self.subscribers.setdefault(topic, set()).add(session)
+
+    def unsubscribe(self, topic, session):
+        with self.lock:
+            self.subscribers.get(topic, set()).discard(session)
+
+    def forget(self, session):
+        with self.lock:
+            for sessions in self.subscribers.values():
+                sessions.discard(session)
+
+    def route(self, topic, payload):
+        with self.lock:
+            sessions = list(self.subscribers.get(topic, ()))
+        for session in sessions:
+            session.send(publish_packet(topic, payload))
+
+    def on_publish(self, topic, payload):
+        """Handle one publish, return False to leave it unacked."""
+        if topic.startswith(LOG_UPLOAD_TOPIC):
+            with self.lock:
+                self.log_messages += 1
+                if self.drop_ack and self.log_messages % self.drop_ack == 0:
+                    sys.stderr.write("ack of log message %d dropped\n" % self.log_messages)
+                    return False
+                error = handle_post(payload, self.key, self.stats, sys.stdout)
+                if error:
+                    sys.stderr.write("rejected: %s\n" % error)
+                self.stats.report(sys.stderr)
+                sys.stdout.flush()
+            return True
+
+        if topic.startswith(LOG_LEVEL_TOPIC) and b"get_log_level" in payload:
+            reply = {"type": "get_log_level", "log_level": self.log_level}
+            self.route(LOG_RESULT_TOPIC + topic[len(LOG_LEVEL_TOPIC):], json.dumps(reply).encode())
+            return True
+
+        self.route(topic, payload)
+        return True
+
+
+class Session(socketserver.BaseRequestHandler):
+    def setup(self):
+        self.send_lock = threading.Lock()
+
+    def send(self, data):
+        with self.send_lock:
+            self.request.sendall(data)
+
+    def recv_exact(self, size):
+        data = b""
+        while len(data) < size:
+            chunk = self.request.recv(size - len(data))
+            if not chunk:
+                raise EOFError()
+            data += chunk
+        return data
+
+    def recv_packet(self):
+        header = self.recv_exact(1)[0]
+        length, shift = 0, 0
+        while True:
+            byte = self.recv_exact(1)[0]
+            length |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                break
+        return header >> 4, header & 0x0F, self.recv_exact(length)
+
+    def handle(self):
+        broker = self.server.broker
+        try:
+            while True:
+                ptype, flags, body = self.recv_packet()
+                if ptype == CONNECT:
+                    self.send(packet(CONNACK, 0, b"\x00\x00"))
+                elif ptype == PUBLISH:
+                    qos = (flags >> 1) & 0x03
+                    (topic_len,) = struct.unpack("!H", body[:2])
+                    topic = body[2:2 + topic_len].decode()
+                    pos = 2 + topic_len
+                    packet_id = None
+                    if qos:
+                        (packet_id,) = struct.unpack("!H", body[pos:pos + 2])
+                        pos += 2
+                    if broker.on_publish(topic, body[pos:]) and qos:
+                        self.send(packet(PUBACK, 0, struct.pack("!H", packet_id)))
+                elif ptype == SUBSCRIBE:
+                    (packet_id,) = struct.unpack("!H", body[:2])
+                    pos, granted = 2, bytearray()
+                    while pos < len(body):
+                        (topic_len,) = struct.unpack("!H", body[pos:pos + 2])
+                        broker.subscribe(body[pos + 2:pos + 2 + topic_len].decode(), self)
+                        granted.append(min(body[pos + 2 + topic_len], 1))
+                        pos += 3 + topic_len
+                    self.send(packet(SUBACK, 0, struct.pack("!H", packet_id) + bytes(granted)))
+                elif ptype == UNSUBSCRIBE:
+                    (packet_id,) = struct.unpack("!H", body[:2])
+                    pos = 2
+                    while pos < len(body):
+                        (topic_len,) = struct.unpack("!H", body[pos:pos + 2])
+                        broker.unsubscribe(body[pos + 2:pos + 2 + topic_len].decode(), self)
+                        pos += 2 + topic_len
+                    self.send(packet(UNSUBACK, 0, struct.pack("!H", packet_id)))
+                elif ptype == PINGREQ:
+                    self.send(packet(PINGRESP, 0, b""))
+                elif ptype == DISCONNECT:
+                    break
+        except (EOFError, ConnectionError):
+            pass
+        finally:
+            broker.forget(self)
+
+
+class Server(socketserver.ThreadingMixIn, socketserver.TCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description="local MQTT broker for log upload of qcloud iot sdk")
+    parser.add_argument("-k", "--key", required=True, help="sign key of the device, device secret for PSK device")
+    parser.add_argument("-p", "--port", type=int, default=1883, help="port to listen on")
+    parser.add_argument("--log-level", type=int, default=1, help="upload log level answered to the device")
+    parser.add_argument("--drop-ack", type=int, default=0, metavar="N", help="leave every Nth log message unacked")
+    args = parser.parse_args()
+
+    server = Server(("", args.port), Session)
+    server.broker = Broker(args.key.encode(), args.log_level, args.drop_ack)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    server.broker.stats.report(sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
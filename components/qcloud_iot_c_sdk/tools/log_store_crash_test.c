@@ -0,0 +1,471 @@
+/*
+ * Tencent is pleased to support the open source community by making IoT Hub available.
+ * Copyright (C) 2018-2020 Tencent. All rights reserved.
+
+ * Licensed under the MIT License (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Crash consistency test of the segmented log store on the NOR flash emulator
+ *
+ * Build in components/qcloud_iot_c_sdk:
+ *   gcc -O2 -Iinclude -Iinclude/exports -Isdk_src/internal_inc -o log_store_crash_test tools/log_store_crash_test.c \
+ *       sdk_src/log_store.c sdk_src/utils_flash_sim.c
+ *
+ * Run:
+ *   ./log_store_crash_test [-S segment_size] [-N segments] [-r rounds] [-t step] [-m max_cut] [-f flash_file]
+ *
+ * Logs are appended, drained, rewound and committed at random on a fresh chip
+ * until power is cut after a given number of programmed bytes. A program is
+ * torn at the cut, an erase cut short leaves the sector either untouched or
+ * half erased with garbage in the rest. The store is reopened, more logs are
+ * appended and all of them are drained. The cut is moved by step bytes until a
+ * run completes without one. The exit code is non-zero if a drained log is
+ * corrupted or out of order, a log stored before the cut is lost while no
+ * segment was dropped, or a program tries to set bits. It is also non-zero if
+ * a log committed before the cut is drained again after the reboot, unless it
+ * was in the last commit or in the unit of the drain map that commit ended in.
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log_ring.h"
+#include "log_store.h"
+#include "qcloud_iot_export_error.h"
+#include "qcloud_iot_export_log.h"
+#include "qcloud_iot_import.h"
+#include "utils_flash_sim.h"
+
+#define TEST_MAX_LINES    (20000)
+#define TEST_MAX_RECORD   (300)
+#define TEST_PAGE_SIZE    (256)
+#define TEST_ERASE_COST   (16)  // bytes of the cut budget an erase takes
+#define TEST_LINE_PATTERN "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijkl"
+#define TEST_LINE_HDR_LEN (8)  // "L%06d "
+
+/* HAL and log of the store and the emulator */
+void *HAL_Malloc(uint32_t size)
+{
+    return malloc(size);
+}
+
+void HAL_Free(void *ptr)
+{
+    free(ptr);
+}
+
+void HAL_SleepMs(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+void *HAL_FileOpen(const char *filename, const char *mode)
+{
+    return fopen(filename, mode);
+}
+
+size_t HAL_FileRead(void *ptr, size_t size, size_t nmemb, void *fp)
+{
+    return fread(ptr, size, nmemb, (FILE *)fp);
+}
+
+size_t HAL_FileWrite(const void *ptr, size_t size, size_t nmemb, void *fp)
+{
+    return fwrite(ptr, size, nmemb, (FILE *)fp);
+}
+
+int HAL_FileSeek(void *fp, long int offset, int whence)
+{
+    return fseek((FILE *)fp, offset, whence);
+}
+
+int HAL_FileClose(void *fp)
+{
+    return fclose((FILE *)fp);
+}
+
+int HAL_FileFlush(void *fp)
+{
+    return fflush((FILE *)fp);
+}
+
+long HAL_FileSize(void *fp)
+{
+    long pos = ftell((FILE *)fp);
+    long size;
+
+    fseek((FILE *)fp, 0, SEEK_END);
+    size = ftell((FILE *)fp);
+    fseek((FILE *)fp, pos, SEEK_SET);
+
+    return size;
+}
+
+void IOT_Log_Gen(const char *file, const char *func, const int line, const int level, const char *fmt, ...)
+{
+    va_list args;
+
+    if (level > eLOG_WARN) {
+        return;
+    }
+
+    va_start(args, fmt);
+    fprintf(stderr, "%s|%d ", func, line);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+/* the emulated chip with a power budget, every call fails once it is cut */
+typedef struct {
+    void *         sim;
+    FlashWriterOps flash;
+    long           budget;  // bytes that can still be programmed, negative for no cut
+    bool           cut;
+} TestPower;
+
+/* what happened to each log line */
+typedef struct {
+    int  next_line;
+    bool rebooted;
+    int  again;                        // committed lines drained again after the reboot
+    char stored[TEST_MAX_LINES];       // appended before the cut
+    char drained[TEST_MAX_LINES];      // drained and posted
+    char last_commit[TEST_MAX_LINES];  // in the last commit before the cut
+    char found[TEST_MAX_LINES];        // drained at the end
+} TestLines;
+
+/* count the lines drained again, the ones of the last commit before the cut may be */
+static void _count_again(TestLines *lines, const char *read_lines)
+{
+    int i;
+
+    for (i = 0; i < TEST_MAX_LINES; i++) {
+        lines->again += read_lines[i] && lines->drained[i] && !lines->last_commit[i];
+    }
+}
+
+static int _power_read(void *usr_data, uint32_t offset, void *buf, uint32_t len)
+{
+    TestPower *power = (TestPower *)usr_data;
+
+    return power->cut ? QCLOUD_ERR_FAILURE : utils_flash_sim_read(power->sim, offset, buf, len);
+}
+
+static int _power_program(void *usr_data, uint32_t offset, const void *data, uint32_t len)
+{
+    TestPower *power = (TestPower *)usr_data;
+
+    if (power->cut) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    /* torn at the cut, the bytes before it are programmed */
+    if (power->budget >= 0 && len > power->budget) {
+        if (power->budget) {
+            power->flash.program(power->flash.usr_data, offset, data, power->budget);
+        }
+        power->cut = true;
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    if (power->budget >= 0) {
+        power->budget -= len;
+    }
+    return power->flash.program(power->flash.usr_data, offset, data, len);
+}
+
+static int _power_erase(void *usr_data, uint32_t offset, uint32_t len)
+{
+    TestPower *power = (TestPower *)usr_data;
+    uint8_t    garbage[TEST_PAGE_SIZE];
+    uint32_t   pos, n, i;
+
+    if (power->cut) {
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    if (power->budget >= 0 && power->budget < TEST_ERASE_COST) {
+        power->cut = true;
+
+        /* by the parity of the budget: nothing erased yet, or the first half erased and the rest undefined */
+        if (power->budget & 1) {
+            power->flash.erase(power->flash.usr_data, offset, len);
+            for (pos = offset + len / 2; pos < offset + len; pos += n) {
+                n = (offset + len - pos < sizeof(garbage)) ? offset + len - pos : sizeof(garbage);
+                for (i = 0; i < n; i++) {
+                    garbage[i] = rand();
+                }
+                power->flash.program(power->flash.usr_data, pos, garbage, n);
+            }
+        }
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    if (power->budget >= 0) {
+        power->budget -= TEST_ERASE_COST;
+    }
+    return power->flash.erase(power->flash.usr_data, offset, len);
+}
+
+static int _make_lines(TestLines *lines, char *buf, int num)
+{
+    int len = 0, i;
+
+    for (i = 0; i < num && lines->next_line < TEST_MAX_LINES; i++, lines->next_line++) {
+        len += sprintf(buf + len, "L%06d %.*s" LOG_DELIMITER, lines->next_line,
+                       lines->next_line % (int)(sizeof(TEST_LINE_PATTERN) - 1), TEST_LINE_PATTERN);
+    }
+
+    return len;
+}
+
+/* mark the lines of records read, -1 for a corrupted line, -2 for a line out of order */
+static int _check_lines(const char *buf, size_t len, int *last, char *mark)
+{
+    const char *end;
+    size_t      pos = 0;
+    int         line;
+
+    while (pos < len) {
+        for (end = buf + pos; end + LOG_DELIMITER_LEN <= buf + len; end++) {
+            if (!memcmp(end, LOG_DELIMITER, LOG_DELIMITER_LEN)) {
+                break;
+            }
+        }
+        if (end + LOG_DELIMITER_LEN > buf + len || sscanf(buf + pos, "L%06d", &line) != 1 || line < 0 ||
+            line >= TEST_MAX_LINES) {
+            return -1;
+        }
+
+        if (end - (buf + pos) != TEST_LINE_HDR_LEN + line % (int)(sizeof(TEST_LINE_PATTERN) - 1) ||
+            memcmp(buf + pos + TEST_LINE_HDR_LEN, TEST_LINE_PATTERN, end - (buf + pos) - TEST_LINE_HDR_LEN)) {
+            return -1;
+        }
+
+        if (last) {
+            if (line <= *last) {
+                return -2;
+            }
+            *last = line;
+        }
+        if (mark) {
+            mark[line] = 1;
+        }
+        pos = end + LOG_DELIMITER_LEN - buf;
+    }
+
+    return 0;
+}
+
+/* append and drain at random, committing some of the reads and rewinding others */
+static int _workload(LogStore *store, TestPower *power, TestLines *lines, int rounds, unsigned seed)
+{
+    char   buf[16 * (TEST_LINE_HDR_LEN + sizeof(TEST_LINE_PATTERN) + LOG_DELIMITER_LEN)];
+    char   record[TEST_MAX_RECORD];
+    char   read_lines[TEST_MAX_LINES];
+    size_t read_len;
+    int    r, k, i, first, len;
+
+    srand(seed);
+    for (r = 0; r < rounds && !power->cut; r++) {
+        first = lines->next_line;
+        len   = _make_lines(lines, buf, 1 + rand() % 12);
+        if (log_store_append(store, buf, len) == len && !power->cut) {
+            memset(lines->stored + first, 1, lines->next_line - first);
+        }
+
+        if (rand() % 3) {
+            continue;
+        }
+
+        for (k = rand() % 4; k >= 0 && !power->cut; k--) {
+            if (log_store_read(store, record, sizeof(record), &read_len) || !read_len) {
+                break;
+            }
+
+            memset(read_lines, 0, sizeof(read_lines));
+            if (_check_lines(record, read_len, NULL, read_lines)) {
+                fprintf(stderr, "corrupted record read before the cut\n");
+                return QCLOUD_ERR_FAILURE;
+            }
+
+            /* a read is committed after it is posted, the logs are delivered even if the commit is cut */
+            if (rand() % 4 == 0) {
+                log_store_rewind(store);
+            } else {
+                if (lines->rebooted) {
+                    _count_again(lines, read_lines);
+                } else {
+                    memcpy(lines->last_commit, read_lines, sizeof(read_lines));
+                }
+                for (i = 0; i < TEST_MAX_LINES; i++) {
+                    lines->drained[i] |= read_lines[i];
+                }
+                log_store_commit(store);
+            }
+        }
+    }
+
+    return QCLOUD_RET_SUCCESS;
+}
+
+/* run with power cut after cut bytes, return -1 for failure, 0 if the cut was not reached, 1 if it was */
+static int _run_cut(const char *flash_file, uint32_t segment_size, uint32_t segment_num, int rounds, long cut)
+{
+    static TestLines lines;
+    TestPower        power = {NULL, {0}, -1, false};
+    LogStoreOps      ops   = {_power_read, _power_program, _power_erase, &power, segment_size * segment_num,
+                       segment_size};
+    FlashSimStats    stats;
+    LogStore         store;
+    char             record[TEST_MAX_RECORD];
+    char             read_lines[TEST_MAX_LINES];
+    size_t           read_len;
+    void *           sim;
+    uint32_t         dropped;
+    int              i, rc, last = -1, lost = 0, failed = 0;
+    bool             was_cut;
+
+    remove(flash_file);
+    sim = utils_flash_sim_open(flash_file, segment_size * segment_num, segment_size, TEST_PAGE_SIZE, NULL);
+    if (!sim) {
+        fprintf(stderr, "open flash sim failed\n");
+        return -1;
+    }
+    power.sim = sim;
+    utils_flash_sim_get_ops(sim, &power.flash);
+    memset(&lines, 0, sizeof(lines));
+
+    if (log_store_open(&store, &ops, segment_size, TEST_MAX_RECORD)) {
+        fprintf(stderr, "cut %ld: open failed\n", cut);
+        failed = 1;
+        goto exit;
+    }
+
+    power.budget = cut;
+    failed |= _workload(&store, &power, &lines, rounds, (unsigned)cut) != QCLOUD_RET_SUCCESS;
+    was_cut = power.cut;
+    dropped = store.dropped_segments;
+
+    /* reboot, then log some more and drain everything */
+    power.cut      = false;
+    power.budget   = -1;
+    lines.rebooted = true;
+    if (log_store_open(&store, &ops, segment_size, TEST_MAX_RECORD)) {
+        fprintf(stderr, "cut %ld: reopen failed\n", cut);
+        failed = 1;
+        goto exit;
+    }
+    failed |= _workload(&store, &power, &lines, rounds / 6 + 1, 1) != QCLOUD_RET_SUCCESS;
+
+    while (!(rc = log_store_read(&store, record, sizeof(record), &read_len)) && read_len) {
+        memset(read_lines, 0, sizeof(read_lines));
+        if ((rc = _check_lines(record, read_len, &last, read_lines)) != 0) {
+            fprintf(stderr, "cut %ld: %s line drained\n", cut, rc == -2 ? "out of order" : "corrupted");
+            failed = 1;
+            break;
+        }
+        _count_again(&lines, read_lines);
+        for (i = 0; i < TEST_MAX_LINES; i++) {
+            lines.found[i] |= read_lines[i];
+        }
+        log_store_commit(&store);
+    }
+    if (!failed && (rc || !log_store_empty(&store))) {
+        fprintf(stderr, "cut %ld: drain failed %d\n", cut, rc);
+        failed = 1;
+    }
+
+    for (i = 0; i < lines.next_line; i++) {
+        lost += lines.stored[i] && !lines.drained[i] && !lines.found[i];
+    }
+    if (lost && !dropped && !store.dropped_segments) {
+        fprintf(stderr, "cut %ld: %d lines lost\n", cut, lost);
+        failed = 1;
+    }
+
+    /* the records in the unit of the last commit, each line takes its header and delimiter at least */
+    if (lines.again > (int)(store.drain_unit / (TEST_LINE_HDR_LEN + LOG_DELIMITER_LEN))) {
+        fprintf(stderr, "cut %ld: %d committed lines drained again\n", cut, lines.again);
+        failed = 1;
+    }
+
+    utils_flash_sim_get_stats(sim, &stats);
+    if (stats.program_violations) {
+        fprintf(stderr, "cut %ld: %u program violations\n", cut, stats.program_violations);
+        failed = 1;
+    }
+
+exit:
+    utils_flash_sim_close(sim);
+    remove(flash_file);
+    return failed ? -1 : was_cut;
+}
+
+int main(int argc, char **argv)
+{
+    const char *flash_file   = "log_store_crash_test.bin";
+    uint32_t    segment_size = 1024, segment_num = 8;
+    int         rounds = 60, step = 7, opt, rc, runs = 0, failed = 0;
+    long        cut, max_cut = 100000;
+
+    while ((opt = getopt(argc, argv, "S:N:r:t:m:f:")) != -1) {
+        switch (opt) {
+            case 'S':
+                segment_size = atoi(optarg);
+                break;
+            case 'N':
+                segment_num = atoi(optarg);
+                break;
+            case 'r':
+                rounds = atoi(optarg);
+                break;
+            case 't':
+                step = atoi(optarg);
+                break;
+            case 'm':
+                max_cut = atol(optarg);
+                break;
+            case 'f':
+                flash_file = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-S segment_size] [-N segments] [-r rounds] [-t step] [-m max_cut] [-f flash_file]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    if (segment_size < TEST_MAX_RECORD || segment_size % TEST_PAGE_SIZE || segment_num < 2 ||
+        segment_num > LOG_STORE_MAX_SEGMENTS || step <= 0 || rounds <= 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    for (cut = 0; cut <= max_cut; cut += step) {
+        rc = _run_cut(flash_file, segment_size, segment_num, rounds, cut);
+        runs++;
+        failed += rc < 0;
+        if (!rc) {
+            break;
+        }
+    }
+
+    printf("%d power cuts, up to %ld bytes programmed, %d failed\n", runs, cut, failed);
+    printf("%s\n", failed ? "FAILED" : "PASSED");
+    return failed != 0;
+}
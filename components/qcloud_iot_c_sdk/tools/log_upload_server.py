@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# Tencent is pleased to support the open source community by making IoT Hub available.
+# Copyright (C) 2018-2020 Tencent. All rights reserved.
+#
+# Licensed under the MIT License (the "License"); you may not use this file except in
+# compliance with the License. You may obtain a copy of the License at
+# http://opensource.org/licenses/MIT
+#
+# Unless required by applicable law or agreed to in writing, software distributed under the License is
+# distributed on an "AS IS" basis, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+# either express or implied. See the License for the specific language governing permissions and
+# limitations under the License.
+#
+"""Local stand-in of the log server for testing log upload on Linux.
+
+It takes the HTTP posts of sdk_src/log_upload.c, checks the HMAC-SHA1
+signature with the device key, expands posts compressed with
+LOG_UPLOAD_COMPRESS (see sdk_src/internal_inc/utils_lzss.h), prints the logs
+and reports the compression ratio. Point the log domain of the device to this
+host, or pass captured post bodies with --decode.
+
+usage: log_upload_server.py -k sign_key [-p port] [--decode post_file ...]
+"""
+
+import argparse
+import hashlib
+import hmac
+import sys
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+SIGNATURE_SIZE = 40
+CTRL_BYTES_SIZE = 4
+MAX_SIZE_OF_PRODUCT_ID = 10
+MAX_SIZE_OF_DEVICE_NAME = 48
+TIMESTAMP_SIZE = 10
+HEADER_SIZE = SIGNATURE_SIZE + CTRL_BYTES_SIZE + MAX_SIZE_OF_PRODUCT_ID + MAX_SIZE_OF_DEVICE_NAME + TIMESTAMP_SIZE
+CTRL_BYTE_COMPRESSED = ord("Z")
+LOG_DELIMITER = b"\n\f"
+
+LZSS_LENGTH_BITS = 6
+LZSS_MIN_MATCH = 3
+
+# sign key is cut to this size on the device
+SIGN_KEY_SIZE = 24
+
+
+def lzss_decompress(data):
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        flags = data[pos]
+        pos += 1
+        for i in range(8):
+            if pos >= len(data):
+                break
+            if flags & (1 << i):
+                if pos + 2 > len(data):
+                    raise ValueError("truncated match at %d" % pos)
+                token = (data[pos] << 8) | data[pos + 1]
+                pos += 2
+                distance = (token >> LZSS_LENGTH_BITS) + 1
+                length = (token & ((1 << LZSS_LENGTH_BITS) - 1)) + LZSS_MIN_MATCH
+                if distance > len(out):
+                    raise ValueError("match distance %d beyond output %d" % (distance, len(out)))
+                for _ in range(length):
+                    out.append(out[-distance])
+            else:
+                out.append(data[pos])
+                pos += 1
+    return bytes(out)
+
+
+class Stats:
+    posts = 0
+    bad_posts = 0
+    post_bytes = 0
+    log_bytes = 0
+
+    def report(self, out):
+        ratio = float(self.log_bytes) / self.post_bytes if self.post_bytes else 0
+        out.write("posts: %d, rejected: %d, logs %d bytes in %d bytes posted, ratio %.2f\n" %
+                  (self.posts, self.bad_posts, self.log_bytes, self.post_bytes, ratio))
+
+
+def handle_post(body, key, stats, out):
+    """Check one post body, print its logs, return an error string or None."""
+    stats.posts += 1
+    if len(body) < HEADER_SIZE:
+        stats.bad_posts += 1
+        return "post of %d bytes is shorter than the header" % len(body)
+
+    signature = body[:SIGNATURE_SIZE].decode("ascii", "replace")
+    expected = hmac.new(key[:SIGN_KEY_SIZE], body[SIGNATURE_SIZE:], hashlib.sha1).hexdigest()
+    if signature != expected:
+        stats.bad_posts += 1
+        return "bad signature %s, expected %s" % (signature, expected)
+
+    ctrl = body[SIGNATURE_SIZE:SIGNATURE_SIZE + CTRL_BYTES_SIZE]
+    ids = body[SIGNATURE_SIZE + CTRL_BYTES_SIZE:HEADER_SIZE - TIMESTAMP_SIZE].decode("utf-8", "replace")
+    timestamp = body[HEADER_SIZE - TIMESTAMP_SIZE:HEADER_SIZE].decode("ascii", "replace")
+    payload = body[HEADER_SIZE:]
+    if ctrl[1] == CTRL_BYTE_COMPRESSED:
+        try:
+            logs = lzss_decompress(payload)
+        except ValueError as e:
+            stats.bad_posts += 1
+            return "bad compressed data: %s" % e
+    else:
+        logs = payload
+
+    stats.post_bytes += len(body)
+    stats.log_bytes += len(logs) + HEADER_SIZE
+    out.write("# %s time %s, %d bytes of logs in %d bytes\n" % (ids.replace("#", " ").strip(), timestamp,
+                                                                  len(logs), len(payload)))
+    for record in logs.split(LOG_DELIMITER):
+        if record:
+            out.write(record.decode("utf-8", "replace") + "\n")
+    return None
+
+
+def serve(port, key, stats):
+    class Handler(BaseHTTPRequestHandler):
+        def do_POST(self):
+            body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+            error = handle_post(body, key, stats, sys.stdout)
+            if error:
+                sys.stderr.write("rejected: %s\n" % error)
+            reply = ('{"Retcode":%d}' % (1 if error else 0)).encode()
+            self.send_response(200)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(reply)))
+            self.end_headers()
+            self.wfile.write(reply)
+            stats.report(sys.stderr)
+
+        def log_message(self, fmt, *args):
+            pass
+
+    server = HTTPServer(("", port), Handler)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description="local log server of qcloud iot sdk")
+    parser.add_argument("-k", "--key", required=True, help="sign key of the device, device secret for PSK device")
+    parser.add_argument("-p", "--port", type=int, default=80, help="port to listen on")
+    parser.add_argument("--decode", nargs="+", metavar="POST_FILE", help="check post bodies in files and exit")
+    args = parser.parse_args()
+
+    stats = Stats()
+    key = args.key.encode()
+    if not args.decode:
+        serve(args.port, key, stats)
+        return 0
+
+    failed = 0
+    for name in args.decode:
+        with open(name, "rb") as f:
+            error = handle_post(f.read(), key, stats, sys.stdout)
+        if error:
+            sys.stderr.write("%s: %s\n" % (name, error))
+            failed += 1
+    stats.report(sys.stderr)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -28,9 +28,11 @@
 #include "esp_task_wdt.h"
 #include "esp_ota_ops.h"
 #include "esp_partition.h"
+#include "esp_spi_flash.h"
 
 #include "qcloud_iot_ota_esp.h"
 #include "qcloud_iot_import.h"
+#include "utils_flash_writer.h"
 #include "utils_param_check.h"
 #include "sdkconfig.h"
 
@@ -44,9 +46,15 @@
 #define MAX_OTA_RETRY_CNT      3
 #define MAX_SIZE_OF_FW_VERSION 32
 
+/* fw data is coalesced into whole sectors before programming */
+#define ESP_FLASH_WRITE_BUF_LEN     SPI_FLASH_SEC_SIZE
+#define ESP_FLASH_PAGE_SIZE         256
+#define ESP_OTA_ERASE_AHEAD_SECTORS 1
+
 typedef struct _EspOTAHandle {
-    esp_partition_t  partition;
-    esp_ota_handle_t handle;
+    esp_partition_t partition;
+    FlashWriter     writer;
+    uint8_t *       write_buf;
 } EspOTAHandle;
 
 typedef struct OTAContextData {
@@ -143,9 +151,48 @@ static int _cal_exist_fw_md5(OTAContextData *ota_ctx)
 
 #endif
 
+static int _esp_flash_erase(void *usr_data, uint32_t offset, uint32_t len)
+{
+    return (esp_partition_erase_range((esp_partition_t *)usr_data, offset, len) == ESP_OK) ? 0 : QCLOUD_ERR_FAILURE;
+}
+
+static int _esp_flash_program(void *usr_data, uint32_t offset, const void *data, uint32_t len)
+{
+    return (esp_partition_write((esp_partition_t *)usr_data, offset, data, len) == ESP_OK) ? 0 : QCLOUD_ERR_FAILURE;
+}
+
+// setup flash writer on the OTA partition, start is the resuming offset
+static int _init_esp_fw_writer(EspOTAHandle *ota_handle, uint32_t start)
+{
+    FlashWriterOps ops = {0};
+
+    if (ota_handle->write_buf == NULL) {
+        ota_handle->write_buf = HAL_Malloc(ESP_FLASH_WRITE_BUF_LEN);
+        if (ota_handle->write_buf == NULL) {
+            Log_e("malloc flash write buffer failed");
+            return QCLOUD_ERR_MALLOC;
+        }
+    }
+
+    ops.erase       = _esp_flash_erase;
+    ops.program     = _esp_flash_program;
+    ops.usr_data    = &ota_handle->partition;
+    ops.sector_size = SPI_FLASH_SEC_SIZE;
+    ops.page_size   = ESP_FLASH_PAGE_SIZE;
+
+    return utils_flash_writer_init(&ota_handle->writer, &ops, start, ota_handle->partition.size,
+                                   ota_handle->write_buf, ESP_FLASH_WRITE_BUF_LEN, ESP_OTA_ERASE_AHEAD_SECTORS);
+}
+
+static void _deinit_esp_fw_writer(EspOTAHandle *ota_handle)
+{
+    HAL_Free(ota_handle->write_buf);
+    ota_handle->write_buf = NULL;
+}
+
 static int _save_fw_data(OTAContextData *ota_ctx, char *buf, int len)
 {
-    if (esp_ota_write(ota_ctx->esp_ota->handle, buf, len) != ESP_OK) {
+    if (utils_flash_writer_write(&ota_ctx->esp_ota->writer, buf, len) != QCLOUD_RET_SUCCESS) {
         Log_e("write esp fw failed");
         return QCLOUD_ERR_FAILURE;
     }
@@ -195,13 +242,20 @@ static int _init_esp_fw_ota(EspOTAHandle *ota_handle, size_t fw_size)
 
     Log_i("to use partition type: %d subtype: %d addr: 0x%x label: %s", partition_ptr->type, partition_ptr->subtype,
           partition_ptr->address, partition_ptr->label);
+
+    if (fw_size > partition_ptr->size) {
+        Log_e("fw size %u exceeds partition size %u", fw_size, partition_ptr->size);
+        return QCLOUD_ERR_FAILURE;
+    }
+
+    // partition is erased sector by sector while downloading, instead of all at once here
     memcpy(&ota_handle->partition, partition_ptr, sizeof(esp_partition_t));
-    if (esp_ota_begin(&ota_handle->partition, fw_size, &ota_handle->handle) != ESP_OK) {
-        Log_e("esp_ota_begin failed!");
+    if (_init_esp_fw_writer(ota_handle, 0)) {
+        Log_e("init fw writer failed!");
         return QCLOUD_ERR_FAILURE;
     }
 
-    Log_i("esp_ota_begin done!");
+    Log_i("esp fw writer init done!");
 
     return 0;
 }
@@ -214,13 +268,15 @@ static int _pre_ota_download(OTAContextData *ota_ctx)
         strncmp(ota_ctx->remote_version, ota_ctx->downloading_version, MAX_SIZE_OF_FW_VERSION) == 0) {
         Log_i("setup local MD5 with offset: %d for version %s", ota_ctx->downloaded_size, ota_ctx->remote_version);
         int ret = _cal_exist_fw_md5(ota_ctx);
-        if (ret) {
-            Log_e("regen OTA MD5 error: %d", ret);
-            ota_ctx->downloaded_size = 0;
+        if (ret == 0) {
+            ret = _init_esp_fw_writer(ota_ctx->esp_ota, ota_ctx->downloaded_size);
+        }
+        if (ret == 0) {
+            Log_d("local MD5 update done!");
             return 0;
         }
-        Log_d("local MD5 update done!");
-        return 0;
+        Log_e("regen OTA MD5 error: %d, restart download", ret);
+        IOT_OTA_ResetClientMD5(ota_ctx->ota_handle);
     }
 #endif
 
@@ -236,12 +292,14 @@ static int _pre_ota_download(OTAContextData *ota_ctx)
 
 static int _post_ota_download(OTAContextData *ota_ctx)
 {
-    if (esp_ota_end(ota_ctx->esp_ota->handle) != ESP_OK) {
-        Log_e("esp_ota_end failed!");
+    if (utils_flash_writer_flush(&ota_ctx->esp_ota->writer) != QCLOUD_RET_SUCCESS) {
+        Log_e("flush esp fw failed!");
         return QCLOUD_ERR_FAILURE;
     }
-    Log_i("esp_ota_end done!");
+    Log_i("esp fw flush done! erased sectors: %u, program ops: %u", ota_ctx->esp_ota->writer.stats.erase_cnt,
+          ota_ctx->esp_ota->writer.stats.program_cnt);
 
+    // image is verified again before being set as boot partition
     if (esp_ota_set_boot_partition(&ota_ctx->esp_ota->partition) != ESP_OK) {
         Log_e("esp_ota_set_boot_partition failed!");
         return QCLOUD_ERR_FAILURE;
@@ -334,6 +392,12 @@ begin_of_ota:
 
                 // get OTA downloaded size
                 IOT_OTA_Ioctl(h_ota, IOT_OTAG_FETCHED_SIZE, &ota_ctx->downloaded_size, 4);
+                // erase flash ahead of the write cursor while the link is idle
+                if (utils_flash_writer_erase_ahead(&ota_ctx->esp_ota->writer, ESP_OTA_ERASE_AHEAD_SECTORS) < 0) {
+                    Log_e("erase ahead failed");
+                    upgrade_fetch_success = false;
+                    goto end_of_ota;
+                }
                 // delay is needed to avoid TCP read timeout
                 HAL_SleepMs(500);
 
@@ -398,6 +462,13 @@ end_of_ota:
         HAL_Free(buf_ota);
         buf_ota               = NULL;
         g_fw_downloading      = false;
+
+        // buffered data should reach flash so that downloaded size matches for resuming
+        if (ota_ctx->downloaded_size && utils_flash_writer_flush(&esp_ota.writer) != QCLOUD_RET_SUCCESS) {
+            Log_e("flush esp fw failed, restart download");
+            ota_ctx->downloaded_size = 0;
+        }
+
         upgrade_fetch_success = true;
 
         Log_e("OTA failed! downloaded %u. retry %d time!", ota_ctx->downloaded_size, ota_ctx->ota_fail_cnt);
@@ -439,6 +510,7 @@ end_of_ota:
         HAL_Free(buf_ota);
         buf_ota = NULL;
     }
+    _deinit_esp_fw_writer(&esp_ota);
 
     IOT_OTA_Destroy(ota_ctx->ota_handle);
     memset(ota_ctx, 0, sizeof(OTAContextData));
@@ -38,6 +38,11 @@ static bool          sg_control_msg_arrived    = false;
 static char          sg_data_report_buffer[2048];
 static size_t        sg_data_report_buffersize = sizeof(sg_data_report_buffer) / sizeof(sg_data_report_buffer[0]);
 
+#ifdef STATE_SNAPSHOT_ENABLED
+// journal of the property values, on a file system provided by HAL_File*
+#define STATE_SNAPSHOT_FILE "/spiffs/data_template_state"
+#endif
+
 #ifdef EVENT_POST_ENABLED
 
 #include "events_config.c"
@@ -393,6 +398,21 @@ int qcloud_iot_explorer_demo(eDemoType eType)
     // init log level
     IOT_Log_Set_Level(eLOG_DEBUG);
 
+    // init data template
+    _init_data_template();
+
+#ifdef STATE_SNAPSHOT_ENABLED
+    // take the state of the last run before the network is up
+    DeviceProperty *pRestoreList[TOTAL_PROPERTY_COUNT];
+    int             i;
+    for (i = 0; i < TOTAL_PROPERTY_COUNT; i++) {
+        pRestoreList[i] = &sg_DataTemplate[i].data_property;
+    }
+    if (IOT_Template_Snapshot_Restore(STATE_SNAPSHOT_FILE, TOTAL_PROPERTY_COUNT, pRestoreList) > 0) {
+        deal_down_stream_user_logic(NULL, &sg_ProductData);
+    }
+#endif
+
     // init connection
     TemplateInitParams init_params = DEFAULT_TEMPLATE_INIT_PARAMS;
     rc                             = _setup_connect_init_params(&init_params);
@@ -419,9 +439,6 @@ int qcloud_iot_explorer_demo(eDemoType eType)
     // user init
     _usr_init();
 
-    // init data template
-    _init_data_template();
-
     // register data template propertys here
     rc = _register_data_template_property(client);
     if (rc == QCLOUD_RET_SUCCESS) {
@@ -431,6 +448,14 @@ int qcloud_iot_explorer_demo(eDemoType eType)
         goto exit;
     }
 
+#ifdef STATE_SNAPSHOT_ENABLED
+    // journal the applied controls and accepted reports, get status then hands on only what changed offline
+    rc = IOT_Template_Snapshot_Start(client, STATE_SNAPSHOT_FILE);
+    if (rc != QCLOUD_RET_SUCCESS) {
+        Log_e("Start state snapshot journal failed: %d", rc);
+    }
+#endif
+
     // register data template actions here
 #ifdef ACTION_ENABLED
     rc = _register_data_template_action(client);
@@ -211,6 +211,7 @@ int qcloud_iot_explorer_demo(eDemoType eType)
     GatewayDeviceInfo *gw     = &sg_GWdevInfo;
     GatewayParam       param  = DEFAULT_GATEWAY_PARAMS;
     DeviceInfo *       subDevInfo;
+    int32_t *          results = NULL;
 
     IOT_Log_Set_Level(eLOG_DEBUG);
 
@@ -251,15 +252,19 @@ int qcloud_iot_explorer_demo(eDemoType eType)
     param.product_id  = gw->gw_info.product_id;
     param.device_name = gw->gw_info.device_name;
 
-    // make sub-device online
-    for (i = 0; i < gw->sub_dev_num; i++) {
-        subDevInfo               = &gw->sub_dev_info[i];
-        param.subdev_product_id  = subDevInfo->product_id;
-        param.subdev_device_name = subDevInfo->device_name;
+    results = (int32_t *)HAL_Malloc(gw->sub_dev_num * sizeof(int32_t));
+    if (results == NULL) {
+        Log_e("malloc results fail");
+        goto exit;
+    }
 
-        rc = IOT_Gateway_Subdev_Online(client, &param);
-        if (rc != QCLOUD_RET_SUCCESS) {
-            Log_e("subDev Pid:%s devName:%s online fail.", subDevInfo->product_id, subDevInfo->device_name);
+    // make sub-devices online, several sub-devices are carried by one message
+    IOT_Gateway_Subdev_Online_Batch(client, &param, gw->sub_dev_info, results, gw->sub_dev_num);
+    for (i = 0; i < gw->sub_dev_num; i++) {
+        subDevInfo = &gw->sub_dev_info[i];
+        if (results[i] != 0) {
+            Log_e("subDev Pid:%s devName:%s online fail: %d", subDevInfo->product_id, subDevInfo->device_name,
+                  results[i]);
             errCount++;
         } else {
             Log_d("subDev Pid:%s devName:%s online success.", subDevInfo->product_id, subDevInfo->device_name);
@@ -270,9 +275,15 @@ int qcloud_iot_explorer_demo(eDemoType eType)
         Log_e("%d of %d sub devices online fail", errCount, gw->sub_dev_num);
     }
 
-    // subscribe sub-device data_template down stream topic for example
-    char            topic_filter[MAX_SIZE_OF_TOPIC + 1];
-    SubscribeParams sub_param = DEFAULT_SUB_PARAMS;
+    // subscribe data_template down stream topic of all sub-devices once, messages are routed by sub-device
+    rc = IOT_Gateway_Route_Subscribe(client, GATEWAY_ROUTE_THING_DOWN_FILTER, GATEWAY_ROUTE_THING_DOWN_PRODUCT_ID_LEVEL,
+                                     GATEWAY_ROUTE_THING_DOWN_DEVICE_NAME_LEVEL, QOS1);
+    if (rc < 0) {
+        Log_e("IOT_Gateway_Route_Subscribe fail.");
+        goto exit;
+    }
+
+    char topic_filter[MAX_SIZE_OF_TOPIC + 1];
     for (i = 0; i < gw->sub_dev_num; i++) {
         subDevInfo = &gw->sub_dev_info[i];
 
@@ -299,21 +310,15 @@ int qcloud_iot_explorer_demo(eDemoType eType)
         }
 #endif
 
-        memset(topic_filter, 0, MAX_SIZE_OF_TOPIC + 1);
-        size = HAL_Snprintf(topic_filter, MAX_SIZE_OF_TOPIC, "$thing/down/property/%s/%s", subDevInfo->product_id,
-                            subDevInfo->device_name);
-
-        if (size < 0 || size > MAX_SIZE_OF_TOPIC) {
-            Log_e("buf size < topic length!");
-            rc = QCLOUD_ERR_FAILURE;
-            goto exit;
+        if (results[i] != 0) {
+            continue;
         }
 
-        sub_param.on_message_handler = _message_handler;
-        rc                           = IOT_Gateway_Subscribe(client, topic_filter, &sub_param);
-        if (rc < 0) {
-            Log_e("IOT_Gateway_Subscribe fail.");
-            return rc;
+        rc = IOT_Gateway_Route_Register(client, subDevInfo->product_id, subDevInfo->device_name, _message_handler,
+                                        subDevInfo);
+        if (rc != QCLOUD_RET_SUCCESS) {
+            Log_e("IOT_Gateway_Route_Register fail.");
+            goto exit;
         }
     }
 
@@ -363,20 +368,21 @@ exit:
     // set GateWay device info
     param.product_id  = gw->gw_info.product_id;
     param.device_name = gw->gw_info.device_name;
-    // make sub-device offline
+    // make sub-devices offline
     errCount = 0;
-    for (i = 0; i < gw->sub_dev_num; i++) {
-        subDevInfo               = &gw->sub_dev_info[i];
-        param.subdev_product_id  = subDevInfo->product_id;
-        param.subdev_device_name = subDevInfo->device_name;
-
-        rc = IOT_Gateway_Subdev_Offline(client, &param);
-        if (rc != QCLOUD_RET_SUCCESS) {
-            Log_e("subDev Pid:%s devName:%s offline fail.", subDevInfo->product_id, subDevInfo->device_name);
-            errCount++;
-        } else {
-            Log_d("subDev Pid:%s devName:%s offline success.", subDevInfo->product_id, subDevInfo->device_name);
+    if (results != NULL) {
+        IOT_Gateway_Subdev_Offline_Batch(client, &param, gw->sub_dev_info, results, gw->sub_dev_num);
+        for (i = 0; i < gw->sub_dev_num; i++) {
+            subDevInfo = &gw->sub_dev_info[i];
+            if (results[i] != 0) {
+                Log_e("subDev Pid:%s devName:%s offline fail: %d", subDevInfo->product_id, subDevInfo->device_name,
+                      results[i]);
+                errCount++;
+            } else {
+                Log_d("subDev Pid:%s devName:%s offline success.", subDevInfo->product_id, subDevInfo->device_name);
+            }
         }
+        HAL_Free(results);
     }
 
     if (errCount > 0) {